@@ -126,6 +126,130 @@ public:
   }
 };
 
+/*
+ * Channels benchmark, a typed channel compared with a mailbox carrying
+ * pointers to objects allocated from a pool. The consumers run at higher
+ * priority so each message costs a context switch in both cases.
+ */
+struct BenchSample {
+  uint32_t      seq;
+  uint32_t      data[3];
+};
+
+static Channel<BenchSample, 4> bench_channel;
+static MailboxBuffer<4> bench_mailbox;
+static ObjectsPool<BenchSample, 6> bench_pool;
+static volatile uint32_t bench_sum;
+
+class ChannelConsumer : public BaseStaticThread<256> {
+protected:
+  virtual msg_t main(void) {
+    BenchSample s;
+
+    do {
+      bench_channel.receive(s);
+      bench_sum += s.data[0];
+    } while (s.seq != 0);
+    return 0;
+  }
+};
+
+class MailboxConsumer : public BaseStaticThread<256> {
+protected:
+  virtual msg_t main(void) {
+    BenchSample *sp;
+    uint32_t seq;
+    msg_t msg;
+
+    do {
+      bench_mailbox.fetch(&msg, TIME_INFINITE);
+      sp = (BenchSample *)msg;
+      bench_sum += sp->data[0];
+      seq = sp->seq;
+      bench_pool.free(sp);
+    } while (seq != 0);
+    return 0;
+  }
+};
+
+static ChannelConsumer channel_consumer;
+static MailboxConsumer mailbox_consumer;
+
+static void bench_channel_execute(void) {
+  BenchSample s = {0, {1, 2, 3}};
+  uint32_t n = 0;
+
+  channel_consumer.start(chThdGetPriority() + 1);
+  test_bench_begin(NULL, 0);
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    s.seq = ++n;
+    test_bench_start();
+    bench_channel.send(s);
+    test_bench_stop();
+  } while (!test_timer_done);
+  s.seq = 0;
+  bench_channel.send(s);
+  channel_consumer.wait();
+  test_print("--- Score : ");
+  test_printn(n);
+  test_println(" msgs/S");
+  test_bench_end(1);
+}
+
+static void bench_mailbox_execute(void) {
+  BenchSample *sp;
+  uint32_t n = 0;
+
+  mailbox_consumer.start(chThdGetPriority() + 1);
+  test_bench_begin(NULL, 0);
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    test_bench_start();
+    sp = (BenchSample *)bench_pool.alloc();
+    sp->seq = ++n;
+    sp->data[0] = 1;
+    sp->data[1] = 2;
+    sp->data[2] = 3;
+    bench_mailbox.post((msg_t)sp, TIME_INFINITE);
+    test_bench_stop();
+  } while (!test_timer_done);
+  sp = (BenchSample *)bench_pool.alloc();
+  sp->seq = 0;
+  bench_mailbox.post((msg_t)sp, TIME_INFINITE);
+  mailbox_consumer.wait();
+  test_print("--- Score : ");
+  test_printn(n);
+  test_println(" msgs/S");
+  test_bench_end(1);
+}
+
+static ROMCONST struct testcase bench_channel_case = {
+  "Benchmark, typed channel",
+  NULL,
+  NULL,
+  bench_channel_execute
+};
+
+static ROMCONST struct testcase bench_mailbox_case = {
+  "Benchmark, mailbox and objects pool",
+  NULL,
+  NULL,
+  bench_mailbox_execute
+};
+
+static ROMCONST struct testcase * ROMCONST channel_cases[] = {
+  &bench_channel_case,
+  &bench_mailbox_case,
+  NULL
+};
+
+static struct testsuite channel_suite = {
+  "channels", NULL, NULL, channel_cases, FALSE, NULL
+};
+
 /*
  * Tester thread class. This thread executes the test suite.
  */
@@ -188,6 +312,11 @@ int main(void) {
   blinker3.start(NORMALPRIO + 10);
   blinker4.start(NORMALPRIO + 10);
 
+  /*
+   * Adds the channels benchmarks to the test suite.
+   */
+  test_register_suite(&channel_suite);
+
   /*
    * Serves timer events.
    */
@@ -45,6 +45,12 @@
 #  define USB_DRIVER_EXT_FIELDS     void *MSD_USB_DRIVER_EXT_FIELDS_NAME;
 #endif
 
+/*
+ * Mass storage read/write activity LED.
+ */
+#define MSD_RW_LED_ON()     palSetPad(GPIOI, GPIOI_LED4)
+#define MSD_RW_LED_OFF()    palClearPad(GPIOI, GPIOI_LED4)
+
 
 
 
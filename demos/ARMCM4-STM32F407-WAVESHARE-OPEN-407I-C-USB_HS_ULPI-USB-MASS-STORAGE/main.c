@@ -113,7 +113,7 @@ int main(void) {
 
   BaseBlockDevice *bbdp = (BaseBlockDevice*) &SDCD1;
   chprintf(chp, "setting up MSD\r\n");
-  USBMassStorageDriver UMSD1;
+  static USBMassStorageDriver UMSD1;
 
   msdInit(usb_driver, bbdp, &UMSD1, USB_MS_DATA_EP);
 
@@ -0,0 +1,173 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "ch.hpp"
+#include "hal.h"
+#include "coro.hpp"
+
+using namespace chibios_rt;
+
+/*
+ * Token ring benchmark. NUM_TASKS activities wait for an event then pass
+ * it to the next activity in the ring. The ring is executed once with a
+ * thread for each activity and once with stackless tasks sharing a single
+ * carrier thread, the memory consumed and the cost of each hop are
+ * compared.
+ */
+#define NUM_TASKS               32
+#define TASK_STACK_SIZE         256
+#define BENCH_DURATION          1000
+
+static EvtSource ring[NUM_TASKS];
+static volatile bool done;
+static volatile uint32_t hops;
+
+/*
+ * Memory consumed from the core allocator and the default heap.
+ */
+static size_t mem_used(void) {
+  size_t heap_free;
+
+  chHeapStatus(NULL, &heap_free);
+  return chCoreStatus() + heap_free;
+}
+
+/*
+ * Thread per activity.
+ */
+static msg_t ring_thread(void *arg) {
+  unsigned i = (unsigned)(size_t)arg;
+  EvtListener el;
+
+  ring[i].registerOne(&el, 0);
+  while (true) {
+    chEvtWaitAny(EVENT_MASK(0));
+    if (done)
+      break;
+    hops = hops + 1;
+    ring[(i + 1) % NUM_TASKS].broadcastFlags(1);
+  }
+  ring[i].unregister(&el);
+  return 0;
+}
+
+/*
+ * Stackless task per activity.
+ */
+static Task ring_task(unsigned i) {
+
+  while (true) {
+    co_await coWaitEvent(ring[i]);
+    if (done)
+      co_return;
+    hops = hops + 1;
+    ring[(i + 1) % NUM_TASKS].broadcastFlags(1);
+  }
+}
+
+static Executor<TASK_STACK_SIZE> executor;
+
+static void report(const char *name, size_t mem, uint32_t n) {
+
+  printf("%-12s %8lu bytes, %6lu bytes/task, %8lu hops/S, %6lu nS/hop\n",
+         name, (unsigned long)mem, (unsigned long)(mem / NUM_TASKS),
+         (unsigned long)n,
+         n > 0 ? (unsigned long)(1000000000ULL / n) : 0UL);
+}
+
+static void bench_threads(void) {
+  Thread *tps[NUM_TASKS];
+  size_t mem;
+  unsigned i;
+
+  done = false;
+  hops = 0;
+  mem = mem_used();
+  for (i = 0; i < NUM_TASKS; i++)
+    tps[i] = chThdCreateFromHeap(NULL, THD_WA_SIZE(TASK_STACK_SIZE),
+                                 NORMALPRIO - 1, ring_thread,
+                                 (void *)(size_t)i);
+  mem -= mem_used();
+
+  /* Lets the threads register on the ring then starts the token.*/
+  chThdSleepMilliseconds(10);
+  ring[0].broadcastFlags(1);
+  chThdSleepMilliseconds(BENCH_DURATION);
+  report("threads", mem, hops);
+
+  done = true;
+  for (i = 0; i < NUM_TASKS; i++)
+    ring[i].broadcastFlags(1);
+  for (i = 0; i < NUM_TASKS; i++)
+    chThdWait(tps[i]);
+}
+
+static void bench_coroutines(void) {
+  size_t mem;
+  unsigned i;
+
+  done = false;
+  hops = 0;
+  mem = mem_used();
+  for (i = 0; i < NUM_TASKS; i++)
+    executor.spawn(ring_task(i));
+  mem -= mem_used();
+  mem += sizeof executor;
+
+  chThdSleepMilliseconds(10);
+  ring[0].broadcastFlags(1);
+  chThdSleepMilliseconds(BENCH_DURATION);
+  report("coroutines", mem, hops);
+
+  done = true;
+  for (i = 0; i < NUM_TASKS; i++)
+    ring[i].broadcastFlags(1);
+  while (executor.getTaskCount() > 0)
+    chThdSleepMilliseconds(1);
+}
+
+/*
+ * Simulator main.
+ */
+int main(void) {
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  System::init();
+
+  /*
+   * The carrier thread runs at the same priority of the ring threads.
+   */
+  executor.start(NORMALPRIO - 1);
+
+  printf("Token ring, %d activities, %d bytes stacks\n",
+         NUM_TASKS, TASK_STACK_SIZE);
+  bench_threads();
+  bench_coroutines();
+  return 0;
+}
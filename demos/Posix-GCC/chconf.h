@@ -146,6 +146,29 @@
 #define CH_USE_WAITEXIT                 TRUE
 #endif
 
+/**
+ * @brief   CPU budget servers APIs.
+ * @details If enabled then the CPU budget servers APIs are included in
+ *          the kernel.
+ *
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_BUDGETS) || defined(__DOXYGEN__)
+#define CH_USE_BUDGETS                  TRUE
+#endif
+
+/**
+ * @brief   EDF scheduling class.
+ * @details If enabled then the threads at the @p CH_EDF_PRIO priority
+ *          level are scheduled by earliest deadline first and the periodic
+ *          threads APIs are included in the kernel.
+ *
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_EDF) || defined(__DOXYGEN__)
+#define CH_USE_EDF                      TRUE
+#endif
+
 /**
  * @brief   Semaphores APIs.
  * @details If enabled then the Semaphores APIs are included in the kernel.
@@ -331,6 +354,32 @@
 #define CH_USE_MEMPOOLS                 TRUE
 #endif
 
+/**
+ * @brief   Memory Arenas APIs.
+ * @details If enabled then the memory arenas APIs are included in the
+ *          kernel, each thread can own an arena serving its allocations
+ *          without entering the kernel lock.
+ *
+ * @note    The default is @p FALSE.
+ * @note    Requires @p CH_USE_MEMCORE.
+ */
+#if !defined(CH_USE_MEMARENAS) || defined(__DOXYGEN__)
+#define CH_USE_MEMARENAS                TRUE
+#endif
+
+/**
+ * @brief   Memory accounting.
+ * @details If enabled then the heap, the memory pools and the core
+ *          allocator keep per allocator, per thread and per call site
+ *          counters of live and peak memory usage.
+ *
+ * @note    The default is @p FALSE.
+ * @note    Requires @p CH_USE_MEMCORE.
+ */
+#if !defined(CH_USE_MEMACCT) || defined(__DOXYGEN__)
+#define CH_USE_MEMACCT                  TRUE
+#endif
+
 /**
  * @brief   Dynamic Threads APIs.
  * @details If enabled then the dynamic threads creation APIs are included
@@ -344,6 +393,19 @@
 #define CH_USE_DYNAMIC                  TRUE
 #endif
 
+/**
+ * @brief   Dynamic threads cache size.
+ * @details Number of working areas of terminated dynamic threads kept for
+ *          reuse by the dynamic threads creation APIs, zero disables the
+ *          cache.
+ *
+ * @note    The default is @p 0.
+ * @note    Requires @p CH_USE_DYNAMIC.
+ */
+#if !defined(CH_THD_CACHE_SIZE) || defined(__DOXYGEN__)
+#define CH_THD_CACHE_SIZE               4
+#endif
+
 /** @} */
 
 /*===========================================================================*/
@@ -421,7 +483,7 @@
  * @note    The default is @p FALSE.
  */
 #if !defined(CH_DBG_FILL_THREADS) || defined(__DOXYGEN__)
-#define CH_DBG_FILL_THREADS             FALSE
+#define CH_DBG_FILL_THREADS             TRUE
 #endif
 
 /**
@@ -437,6 +499,30 @@
 #define CH_DBG_THREADS_PROFILING        TRUE
 #endif
 
+/**
+ * @brief   Latency histograms.
+ * @details If enabled then the ready-to-run latency of the threads and the
+ *          lateness of the virtual timers callbacks are recorded into log2
+ *          histograms and the latency monitor APIs are included in the
+ *          kernel.
+ *
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_LATENCY) || defined(__DOXYGEN__)
+#define CH_USE_LATENCY                  TRUE
+#endif
+
+/**
+ * @brief   Number of bins in a latency histogram.
+ * @details The latency clock is the host monotonic clock in nanoseconds,
+ *          the bins cover up to about eight milliseconds.
+ *
+ * @note    The default is 16.
+ */
+#if !defined(CH_LATENCY_BINS) || defined(__DOXYGEN__)
+#define CH_LATENCY_BINS                 24
+#endif
+
 /** @} */
 
 /*===========================================================================*/
@@ -19,23 +19,55 @@
 */
 
 #include <stdio.h>
+#include <string.h>
 
 #include "ch.h"
 #include "hal.h"
 #include "test.h"
 #include "shell.h"
 #include "chprintf.h"
+#include "stkmon.h"
+#include "reactor.h"
+#include "ipc.h"
 
 #define SHELL_WA_SIZE       THD_WA_SIZE(4096)
 #define CONSOLE_WA_SIZE     THD_WA_SIZE(4096)
 #define TEST_WA_SIZE        THD_WA_SIZE(4096)
-
-#define cputs(msg) chMsgSend(cdtp, (msg_t)msg)
+#define SNAPSHOT_SIZE       32
+#define CONSOLE_BUFFERS     4
+#define CONSOLE_LINE_SIZE   128
+#define CONSOLE_BUDGET      (CH_LATENCY_FREQUENCY / 100)
 
 static Thread *cdtp;
 static Thread *shelltp1;
 static Thread *shelltp2;
 
+/*
+ * Console print server, the lines are carried by the server request buffers
+ * and the same buffer is used for the reply.
+ */
+static IpcServer console;
+static IPC_BUFFERS_DECL(console_buffers, CONSOLE_BUFFERS, CONSOLE_LINE_SIZE);
+
+static const IpcConfig console_cfg = {
+  CONSOLE_LINE_SIZE,
+  console_buffers,
+  CONSOLE_BUFFERS,
+  0,
+  NULL,
+  0,
+  IPC_ORDER_PRIO
+};
+
+static void cputs(const char *msg) {
+  IpcBuffer *bp;
+
+  bp = ipcAllocRequest(&console, TIME_INFINITE);
+  strncpy(ipcPayload(bp), msg, CONSOLE_LINE_SIZE - 1);
+  ((char *)ipcPayload(bp))[CONSOLE_LINE_SIZE - 1] = 0;
+  ipcFree(ipcCall(&console, bp));
+}
+
 static void cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
   size_t n, size;
 
@@ -52,34 +84,55 @@ static void cmd_mem(BaseSequentialStream *chp, int argc, char *argv[]) {
 
 static void cmd_threads(BaseSequentialStream *chp, int argc, char *argv[]) {
   static const char *states[] = {THD_STATE_NAMES};
-  Thread *tp;
+  static ThreadSnapshot snapshot[SNAPSHOT_SIZE];
+  cnt_t i, n;
 
   (void)argv;
   if (argc > 0) {
     chprintf(chp, "Usage: threads\r\n");
     return;
   }
-  chprintf(chp, "    addr    stack prio refs     state time\r\n");
-  tp = chRegFirstThread();
-  do {
-    chprintf(chp, "%.8lx %.8lx %4lu %4lu %9s %lu\r\n",
-            (uint32_t)tp, (uint32_t)tp->p_ctx.esp,
-            (uint32_t)tp->p_prio, (uint32_t)(tp->p_refs - 1),
-            states[tp->p_state], (uint32_t)tp->p_time);
-    tp = chRegNextThread(tp);
-  } while (tp != NULL);
+  n = chRegSnapshot(snapshot, SNAPSHOT_SIZE);
+  chprintf(chp, "    addr prio refs     state time\r\n");
+  for (i = 0; (i < n) && (i < SNAPSHOT_SIZE); i++)
+    chprintf(chp, "%.8lx %4lu %4lu %9s %lu\r\n",
+             (uint32_t)snapshot[i].ts_thread, (uint32_t)snapshot[i].ts_prio,
+             (uint32_t)snapshot[i].ts_refs, states[snapshot[i].ts_state],
+             (uint32_t)snapshot[i].ts_time);
+  if (n > SNAPSHOT_SIZE)
+    chprintf(chp, "%lu more threads\r\n", (uint32_t)(n - SNAPSHOT_SIZE));
+}
+
+static msg_t test_thread(void *p) {
+
+  return (msg_t)test_run(p);
 }
 
 static void cmd_test(BaseSequentialStream *chp, int argc, char *argv[]) {
+  struct testconfig cfg;
   Thread *tp;
-
-  (void)argv;
-  if (argc > 0) {
-    chprintf(chp, "Usage: test\r\n");
-    return;
+  int i;
+
+  cfg.chp = chp;
+  cfg.filter = NULL;
+  cfg.output = TEST_OUTPUT_TEXT;
+  cfg.parallel = FALSE;
+  for (i = 0; i < argc; i++) {
+    if (strcmp(argv[i], "-tap") == 0)
+      cfg.output = TEST_OUTPUT_TAP;
+    else if (strcmp(argv[i], "-junit") == 0)
+      cfg.output = TEST_OUTPUT_JUNIT;
+    else if (strcmp(argv[i], "-p") == 0)
+      cfg.parallel = TRUE;
+    else if ((argv[i][0] != '-') && (cfg.filter == NULL))
+      cfg.filter = argv[i];
+    else {
+      chprintf(chp, "Usage: test [-tap|-junit] [-p] [filter]\r\n");
+      return;
+    }
   }
   tp = chThdCreateFromHeap(NULL, TEST_WA_SIZE, chThdGetPriority(),
-                           TestThread, chp);
+                           test_thread, &cfg);
   if (tp == NULL) {
     chprintf(chp, "out of memory\r\n");
     return;
@@ -87,13 +140,208 @@ static void cmd_test(BaseSequentialStream *chp, int argc, char *argv[]) {
   chThdWait(tp);
 }
 
+/*
+ * Events reactor of the main thread, the serial ports are served before
+ * the shells termination.
+ */
+static Reactor reactor;
+static ReactorSource termination_src, sd1_src, sd2_src;
+
+static void print_stats(BaseSequentialStream *chp, const char *name,
+                        ReactorSource *rsp) {
+  uint32_t f = halGetCounterFrequency() / 1000000;
+
+  chprintf(chp, "%-12s %8lu %8lu %8lu %8lu\r\n", name,
+           (uint32_t)rsp->stats.count,
+           (uint32_t)(rsp->stats.last / f),
+           (uint32_t)(rsp->stats.worst / f),
+           rsp->stats.count > 0 ?
+             (uint32_t)(rsp->stats.cumulative / rsp->stats.count / f) : 0);
+}
+
+static void cmd_reactor(BaseSequentialStream *chp, int argc, char *argv[]) {
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: reactor\r\n");
+    return;
+  }
+  chprintf(chp, "handler         count  last uS worst uS   avg uS\r\n");
+  print_stats(chp, "termination", &termination_src);
+  print_stats(chp, "SD1", &sd1_src);
+  print_stats(chp, "SD2", &sd2_src);
+}
+
+static void cmd_ipc(BaseSequentialStream *chp, int argc, char *argv[]) {
+  uint32_t f = halGetCounterFrequency() / 1000000;
+  IpcStats *sp = &console.stats;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: ipc\r\n");
+    return;
+  }
+  chprintf(chp, "server       requests  starved peak  wait uS  serv uS  last uS worst uS   avg uS\r\n");
+  chprintf(chp, "%-12s %8lu %8lu %4lu %8lu %8lu %8lu %8lu %8lu\r\n", "console",
+           sp->requests, sp->starved, sp->queued_peak,
+           (uint32_t)(sp->wait_worst / f),
+           (uint32_t)(sp->service_worst / f),
+           (uint32_t)(sp->latency_last / f),
+           (uint32_t)(sp->latency_worst / f),
+           sp->requests > 0 ?
+             (uint32_t)(sp->latency_cumulative / sp->requests / f) : 0);
+}
+
+static void print_account(BaseSequentialStream *chp, const char *name,
+                          const MemAccount *ap) {
+
+  chprintf(chp, "%-12s %8u %8u %8lu %8lu %8lu\r\n", name,
+           ap->ma_live, ap->ma_peak,
+           ap->ma_allocs, ap->ma_frees, ap->ma_failures);
+}
+
+static void cmd_memstat(BaseSequentialStream *chp, int argc, char *argv[]) {
+  static MemAcctSnapshot snapshot;
+  MemAccount heap;
+  const MemOwner *op;
+  unsigned i;
+
+  (void)argv;
+  if (argc > 0) {
+    chprintf(chp, "Usage: memstat\r\n");
+    return;
+  }
+  chMemAcctSnapshot(&snapshot);
+  chHeapGetAccount(NULL, &heap);
+  chprintf(chp, "allocator        live     peak   allocs    frees failures\r\n");
+  print_account(chp, "core", &snapshot.core);
+  print_account(chp, "heap", &heap);
+  chprintf(chp, "\r\nowner            live     peak   allocs    frees\r\n");
+  for (i = 0; i < CH_MEMACCT_OWNERS; i++) {
+    op = &snapshot.owners[i];
+    if (op->mo_acct.ma_allocs == 0)
+      continue;
+    chprintf(chp, "%-12s %8u %8u %8lu %8lu%s\r\n",
+             i == 0 ? "(other)" : op->mo_name != NULL ? op->mo_name : "-",
+             op->mo_acct.ma_live, op->mo_acct.ma_peak,
+             op->mo_acct.ma_allocs, op->mo_acct.ma_frees,
+             (i != 0) && (op->mo_thread == NULL) && (op->mo_acct.ma_live > 0) ?
+               " leaked" : "");
+  }
+  chprintf(chp, "\r\nsite             live     peak   allocs    frees\r\n");
+  for (i = 0; i < CH_MEMACCT_SITES; i++) {
+    if (snapshot.sites[i].ms_acct.ma_allocs == 0)
+      continue;
+    chprintf(chp, "    %08lx %8u %8u %8lu %8lu\r\n",
+             (uint32_t)snapshot.sites[i].ms_site,
+             snapshot.sites[i].ms_acct.ma_live,
+             snapshot.sites[i].ms_acct.ma_peak,
+             snapshot.sites[i].ms_acct.ma_allocs,
+             snapshot.sites[i].ms_acct.ma_frees);
+  }
+  chprintf(chp, "\r\nsize class     allocs     live\r\n");
+  for (i = 0; i < CH_MEMACCT_CLASSES; i++) {
+    if (snapshot.class_allocs[i] == 0)
+      continue;
+    chprintf(chp, "%s%8u %8lu %8lu\r\n",
+             i < CH_MEMACCT_CLASSES - 1 ? "<= " : " > ",
+             i < CH_MEMACCT_CLASSES - 1 ? 8U << i : 8U << (i - 1),
+             snapshot.class_allocs[i], snapshot.class_live[i]);
+  }
+}
+
+static void print_latency(BaseSequentialStream *chp, const char *name,
+                          const LatencyHistogram *lhp) {
+
+  chprintf(chp, "%-12s %8lu %8lu %8lu %8lu\r\n", name,
+           lhp->lh_samples, LAT2US(lhp->lh_max),
+           lhp->lh_overruns, lhp->lh_stalls);
+}
+
+static LatencyHistogram console_latency;
+
+static void cmd_latency(BaseSequentialStream *chp, int argc, char *argv[]) {
+  LatencyHistogram threads, timers;
+  unsigned i;
+
+  if ((argc > 1) || ((argc == 1) && (strcmp(argv[0], "reset") != 0))) {
+    chprintf(chp, "Usage: latency [reset]\r\n");
+    return;
+  }
+  if (argc == 1) {
+    chLatencyReset();
+    return;
+  }
+  chLatencySnapshot(&threads, &timers);
+  chprintf(chp, "histogram     samples   max uS overruns   stalls\r\n");
+  print_latency(chp, "threads", &threads);
+  print_latency(chp, "timers", &timers);
+  print_latency(chp, "console", &console_latency);
+  chprintf(chp, "\r\nclock >=       threads   timers  console (%lu Hz)\r\n",
+           (uint32_t)CH_LATENCY_FREQUENCY);
+  for (i = 0; i < CH_LATENCY_BINS; i++) {
+    if ((threads.lh_bins[i] == 0) && (timers.lh_bins[i] == 0) &&
+        (console_latency.lh_bins[i] == 0))
+      continue;
+    chprintf(chp, "%10lu %12lu %8lu %8lu\r\n", chLatencyBinBase(i),
+             threads.lh_bins[i], timers.lh_bins[i],
+             console_latency.lh_bins[i]);
+  }
+}
+
 static const ShellCommand commands[] = {
   {"mem", cmd_mem},
   {"threads", cmd_threads},
   {"test", cmd_test},
+  {"reactor", cmd_reactor},
+  {"ipc", cmd_ipc},
+  {"memstat", cmd_memstat},
+  {"latency", cmd_latency},
   {NULL, NULL}
 };
 
+/*
+ * Stack monitor, a message is printed when a thread uses more than half of
+ * the interrupts reserve included in its working area.
+ */
+static void stkmon_cb(StackMonitor *smp, Thread *tp, size_t unused) {
+  static char msg[64];
+
+  (void)tp;
+  snprintf(msg, sizeof msg, "Stack: %s has %u unused bytes",
+           smp->min_name != NULL ? smp->min_name : "thread",
+           (unsigned)unused);
+  cputs(msg);
+}
+
+static StackMonitor stkmon;
+
+/*
+ * Latency monitor, a message is printed when the console thread waits in
+ * the ready list longer than its budget.
+ */
+static void latmon_cb(LatencyHistogram *lhp, uint32_t latency) {
+  static char msg[64];
+
+  (void)lhp;
+  snprintf(msg, sizeof msg, "Latency: console waited %u uS",
+           (unsigned)LAT2US(latency));
+  cputs(msg);
+}
+
+static WORKING_AREA(latmon_wa, 2048);
+
+static const LatencyMonitorConfig latmon_cfg = {
+  S2ST(1),
+  latmon_cb
+};
+
+static const StackMonitorConfig stkmon_cfg = {
+  S2ST(1),
+  PORT_INT_REQUIRED_STACK / 2,
+  stkmon_cb
+};
+
 static const ShellConfig shell_cfg1 = {
   (BaseSequentialStream *)&SD1,
   commands
@@ -105,18 +353,19 @@ static const ShellConfig shell_cfg2 = {
 };
 
 /*
- * Console print server done using synchronous messages. This makes the access
- * to the C printf() thread safe and the print operation atomic among threads.
- * In this example the message is the zero terminated string itself.
+ * Console print server thread. This makes the access to the C printf()
+ * thread safe and the print operation atomic among threads. In this example
+ * the request is the zero terminated string and the reply is the request
+ * buffer itself.
  */
 static msg_t console_thread(void *arg) {
 
   (void)arg;
   while (!chThdShouldTerminate()) {
-    Thread *tp = chMsgWait();
-    puts((char *)chMsgGet(tp));
+    IpcBuffer *bp = ipcReceive(&console, TIME_INFINITE);
+    puts((char *)ipcPayload(bp));
     fflush(stdout);
-    chMsgRelease(tp, RDY_OK);
+    ipcReply(&console, bp, bp);
   }
   return 0;
 }
@@ -124,11 +373,13 @@ static msg_t console_thread(void *arg) {
 /**
  * @brief Shell termination handler.
  *
- * @param[in] id event id.
+ * @param[in] arg       handler argument
+ * @param[in] flags     event flags
  */
-static void termination_handler(eventid_t id) {
+static void termination_handler(void *arg, flagsmask_t flags) {
 
-  (void)id;
+  (void)arg;
+  (void)flags;
   if (shelltp1 && chThdTerminated(shelltp1)) {
     chThdWait(shelltp1);
     shelltp1 = NULL;
@@ -149,18 +400,15 @@ static void termination_handler(eventid_t id) {
   }
 }
 
-static EventListener sd1fel, sd2fel;
-
 /**
  * @brief SD1 status change handler.
  *
- * @param[in] id event id.
+ * @param[in] arg       handler argument
+ * @param[in] flags     channel flags
  */
-static void sd1_handler(eventid_t id) {
-  flagsmask_t flags;
+static void sd1_handler(void *arg, flagsmask_t flags) {
 
-  (void)id;
-  flags = chEvtGetAndClearFlags(&sd1fel);
+  (void)arg;
   if ((flags & CHN_CONNECTED) && (shelltp1 == NULL)) {
     cputs("Init: connection on SD1");
     shelltp1 = shellCreate(&shell_cfg1, SHELL_WA_SIZE, NORMALPRIO + 1);
@@ -176,13 +424,12 @@ static void sd1_handler(eventid_t id) {
 /**
  * @brief SD2 status change handler.
  *
- * @param[in] id event id.
+ * @param[in] arg       handler argument
+ * @param[in] flags     channel flags
  */
-static void sd2_handler(eventid_t id) {
-  flagsmask_t flags;
+static void sd2_handler(void *arg, flagsmask_t flags) {
 
-  (void)id;
-  flags = chEvtGetAndClearFlags(&sd2fel);
+  (void)arg;
   if ((flags & CHN_CONNECTED) && (shelltp2 == NULL)) {
     cputs("Init: connection on SD2");
     shelltp2 = shellCreate(&shell_cfg2, SHELL_WA_SIZE, NORMALPRIO + 10);
@@ -195,17 +442,10 @@ static void sd2_handler(eventid_t id) {
   }
 }
 
-static evhandler_t fhandlers[] = {
-  termination_handler,
-  sd1_handler,
-  sd2_handler
-};
-
 /*------------------------------------------------------------------------*
  * Simulator main.                                                        *
  *------------------------------------------------------------------------*/
 int main(void) {
-  EventListener tel;
 
   /*
    * System initializations.
@@ -227,33 +467,51 @@ int main(void) {
    * Shell manager initialization.
    */
   shellInit();
-  chEvtRegister(&shell_terminated, &tel, 0);
+  reactorInit(&reactor);
+  reactorBindEvent(&reactor, &termination_src, 1,
+                   termination_handler, NULL, &shell_terminated);
 
   /*
-   * Console thread started.
+   * Console server and thread started.
    */
+  ipcObjectInit(&console, &console_cfg);
   cdtp = chThdCreateFromHeap(NULL, CONSOLE_WA_SIZE, NORMALPRIO + 1,
                              console_thread, NULL);
 
+  /*
+   * Stack usage sampling.
+   */
+  smStart(&stkmon, &stkmon_cfg, LOWPRIO);
+
+  /*
+   * Console thread latency monitoring.
+   */
+  chLatencyAttach(&console_latency, cdtp, CONSOLE_BUDGET);
+  chLatencyMonitorStart(latmon_wa, sizeof(latmon_wa), HIGHPRIO, &latmon_cfg);
+
   /*
    * Initializing connection/disconnection events.
    */
   cputs("Shell service started on SD1, SD2");
   cputs("  - Listening for connections on SD1");
-  chEvtRegister(chnGetEventSource(&SD1), &sd1fel, 1);
+  reactorBindEvent(&reactor, &sd1_src, 0,
+                   sd1_handler, NULL, chnGetEventSource(&SD1));
   cputs("  - Listening for connections on SD2");
-  chEvtRegister(chnGetEventSource(&SD2), &sd2fel, 2);
+  reactorBindEvent(&reactor, &sd2_src, 0,
+                   sd2_handler, NULL, chnGetEventSource(&SD2));
 
   /*
    * Events servicing loop.
    */
   while (!chThdShouldTerminate())
-    chEvtDispatch(fhandlers, chEvtWaitOne(ALL_EVENTS));
+    reactorDispatch(&reactor, TIME_INFINITE);
 
   /*
    * Clean simulator exit.
    */
-  chEvtUnregister(chnGetEventSource(&SD1), &sd1fel);
-  chEvtUnregister(chnGetEventSource(&SD2), &sd2fel);
+  reactorUnbind(&sd1_src);
+  reactorUnbind(&sd2_src);
+  reactorUnbind(&termination_src);
+  smStop(&stkmon);
   return 0;
 }
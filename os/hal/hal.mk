@@ -2,6 +2,8 @@
 # from this list, you can disable parts of the kernel by editing halconf.h.
 HALSRC = ${CHIBIOS}/os/hal/src/hal.c \
          ${CHIBIOS}/os/hal/src/adc.c \
+         ${CHIBIOS}/os/hal/src/adc_stream.c \
+         ${CHIBIOS}/os/hal/src/blk_queue.c \
          ${CHIBIOS}/os/hal/src/can.c \
          ${CHIBIOS}/os/hal/src/ext.c \
          ${CHIBIOS}/os/hal/src/gpt.c \
@@ -0,0 +1,650 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    adc_stream.h
+ * @brief   ADC streaming pipeline header.
+ *
+ * @addtogroup ADC_STREAM
+ * @{
+ */
+
+#ifndef _ADC_STREAM_H_
+#define _ADC_STREAM_H_
+
+#if HAL_USE_ADC_STREAM || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Stream event flags
+ * @{
+ */
+#define ADC_STREAM_OVERRUN          1   /**< @brief Block dropped.          */
+#define ADC_STREAM_ERROR            2   /**< @brief ADC error.              */
+/** @} */
+
+/**
+ * @name    Trigger edges
+ * @{
+ */
+#define ADC_TRIGGER_RISING          1   /**< @brief Rising crossing.        */
+#define ADC_TRIGGER_FALLING         2   /**< @brief Falling crossing.       */
+#define ADC_TRIGGER_BOTH            3   /**< @brief Both crossings.         */
+/** @} */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    ADC stream configuration options
+ * @{
+ */
+/**
+ * @brief   Maximum number of channels in a stream.
+ * @details The stages keep their state per channel.
+ */
+#if !defined(ADC_STREAM_MAX_CHANNELS) || defined(__DOXYGEN__)
+#define ADC_STREAM_MAX_CHANNELS     4
+#endif
+
+/**
+ * @brief   Maximum number of blocks in the pool of a stream.
+ */
+#if !defined(ADC_STREAM_MAX_BLOCKS) || defined(__DOXYGEN__)
+#define ADC_STREAM_MAX_BLOCKS       8
+#endif
+
+/**
+ * @brief   Maximum number of taps of a FIR stage.
+ */
+#if !defined(ADC_FIR_MAX_TAPS) || defined(__DOXYGEN__)
+#define ADC_FIR_MAX_TAPS            32
+#endif
+
+/**
+ * @brief   Maximum order of a CIC stage.
+ */
+#if !defined(ADC_CIC_MAX_ORDER) || defined(__DOXYGEN__)
+#define ADC_CIC_MAX_ORDER           4
+#endif
+
+/**
+ * @brief   Stream thread stack size.
+ */
+#if !defined(ADC_STREAM_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define ADC_STREAM_THREAD_STACK_SIZE 512
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !HAL_USE_ADC
+#error "ADC_STREAM requires HAL_USE_ADC"
+#endif
+
+#if !CH_USE_EVENTS || !CH_USE_WAITEXIT
+#error "ADC_STREAM requires CH_USE_EVENTS and CH_USE_WAITEXIT"
+#endif
+
+#if (ADC_STREAM_MAX_BLOCKS < 2) || (ADC_STREAM_MAX_CHANNELS < 1)
+#error "invalid ADC_STREAM_MAX_BLOCKS or ADC_STREAM_MAX_CHANNELS value"
+#endif
+
+/**
+ * @brief   Samples reserved in front of each channel in the work buffers.
+ * @details The FIR stages prepend their history there so that every
+ *          filter window is contiguous in memory.
+ */
+#define ADC_STREAM_HEADROOM         ADC_FIR_MAX_TAPS
+
+/**
+ * @brief   Units of the processing time statistics, in Hz.
+ */
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+#define ADC_STREAM_TIME_FREQUENCY   halGetCounterFrequency()
+#else
+#define ADC_STREAM_TIME_FREQUENCY   CH_FREQUENCY
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a sample flowing through the stages.
+ */
+typedef int32_t adcstreamsample_t;
+
+/**
+ * @brief   Samples being processed by the stages.
+ * @details The samples are stored per channel, each channel is a
+ *          contiguous array of @p n samples so that the stages loops run
+ *          over plain arrays. The stages can process in place or write
+ *          into the @p scratch buffer and swap it with @p data.
+ */
+typedef struct {
+  /**
+   * @brief Current buffer, see @p adcStreamChannel().
+   */
+  adcstreamsample_t     *data;
+  /**
+   * @brief Spare buffer of the same size.
+   */
+  adcstreamsample_t     *scratch;
+  /**
+   * @brief Distance between the channels in both buffers.
+   */
+  size_t                stride;
+  /**
+   * @brief Number of samples per channel.
+   */
+  size_t                n;
+  /**
+   * @brief Number of channels.
+   */
+  adc_channels_num_t    channels;
+  /**
+   * @brief Index of the first ADC row of the block.
+   */
+  uint32_t              index;
+  /**
+   * @brief Blocks have been dropped right before this one.
+   */
+  bool_t                gap;
+} ADCStreamData;
+
+/**
+ * @brief   @p ADCStage specific methods.
+ */
+#define _adc_stage_methods                                                  \
+  /* Resets the stage state, invoked when the stream starts.*/              \
+  void (*reset)(void *instance, adc_channels_num_t channels);               \
+  /* Processes a block of samples.*/                                        \
+  void (*process)(void *instance, ADCStreamData *dp);
+
+/**
+ * @brief   @p ADCStage specific data.
+ * @note    It is empty because @p ADCStage is only an interface without
+ *          implementation.
+ */
+#define _adc_stage_data
+
+/**
+ * @brief   @p ADCStage virtual methods table.
+ */
+struct ADCStageVMT {
+  _adc_stage_methods
+};
+
+/**
+ * @brief   Base stage class.
+ * @details This class represents a generic processing stage of a stream.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+} ADCStage;
+
+/**
+ * @extends ADCStage
+ *
+ * @brief   CIC decimator stage.
+ * @details Cascaded integrator-comb decimator with unit differential delay,
+ *          the arithmetic wraps on 32 bits so the input bits plus the
+ *          growth of @p order times log2(@p ratio) must fit 32 bits.
+ *          The output is shifted right to compensate the filter gain.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+  /** @brief Number of integrator and comb sections.*/
+  unsigned              order;
+  /** @brief Decimation ratio.*/
+  unsigned              ratio;
+  /** @brief Output right shift.*/
+  unsigned              shift;
+  /** @brief Input samples until the next output.*/
+  unsigned              phase;
+  /** @brief Integrators state.*/
+  uint32_t              integ[ADC_STREAM_MAX_CHANNELS][ADC_CIC_MAX_ORDER];
+  /** @brief Combs state.*/
+  uint32_t              comb[ADC_STREAM_MAX_CHANNELS][ADC_CIC_MAX_ORDER];
+} ADCStageCIC;
+
+/**
+ * @extends ADCStage
+ *
+ * @brief   FIR decimator stage.
+ * @details The coefficients are Q15 fixed point, the accumulation is
+ *          performed on 64 bits.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+  /** @brief Number of taps.*/
+  unsigned              ntaps;
+  /** @brief Decimation ratio, one for plain filtering.*/
+  unsigned              ratio;
+  /** @brief Input samples to skip before the next output.*/
+  unsigned              phase;
+  /** @brief Coefficients in reverse order.*/
+  int32_t               coeffs[ADC_FIR_MAX_TAPS];
+  /** @brief Last @p ntaps - 1 input samples of each channel.*/
+  adcstreamsample_t     history[ADC_STREAM_MAX_CHANNELS][ADC_FIR_MAX_TAPS];
+} ADCStageFIR;
+
+/**
+ * @brief   Statistics of a channel over a window.
+ */
+typedef struct {
+  /** @brief Minimum sample.*/
+  adcstreamsample_t     min;
+  /** @brief Maximum sample.*/
+  adcstreamsample_t     max;
+  /** @brief Average.*/
+  adcstreamsample_t     mean;
+  /** @brief Root mean square.*/
+  uint32_t              rms;
+} ADCChannelStats;
+
+/**
+ * @brief   Type of a statistics stage.
+ */
+typedef struct ADCStageStats ADCStageStats;
+
+/**
+ * @brief   Statistics window callback type.
+ * @note    The callback is invoked from the stream thread.
+ *
+ * @param[in] ssp       pointer to the @p ADCStageStats object, the
+ *                      results are in the @p last field
+ */
+typedef void (*adcstatscallback_t)(ADCStageStats *ssp);
+
+/**
+ * @extends ADCStage
+ *
+ * @brief   Statistics stage.
+ * @details Computes minimum, maximum, average and RMS value of each
+ *          channel over windows of a fixed number of samples, the samples
+ *          are passed through unchanged.
+ */
+struct ADCStageStats {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+  /** @brief Window length in samples.*/
+  uint32_t              window;
+  /** @brief Window callback or @p NULL.*/
+  adcstatscallback_t    callback;
+  /** @brief Samples accumulated in the current window.*/
+  uint32_t              count;
+  /** @brief Number of completed windows.*/
+  uint32_t              windows;
+  /** @brief Accumulators of the current window.*/
+  struct {
+    adcstreamsample_t   min;
+    adcstreamsample_t   max;
+    int64_t             sum;
+    uint64_t            sumsq;
+  }                     acc[ADC_STREAM_MAX_CHANNELS];
+  /** @brief Results of the last completed window.*/
+  ADCChannelStats       last[ADC_STREAM_MAX_CHANNELS];
+};
+
+/**
+ * @brief   Type of a threshold trigger stage.
+ */
+typedef struct ADCStageTrigger ADCStageTrigger;
+
+/**
+ * @brief   Trigger callback type.
+ * @note    The callback is invoked from the stream thread.
+ *
+ * @param[in] tsp       pointer to the @p ADCStageTrigger object
+ * @param[in] edge      @p ADC_TRIGGER_RISING or @p ADC_TRIGGER_FALLING
+ * @param[in] index     index of the crossing sample in the input of the
+ *                      stage
+ */
+typedef void (*adctriggercallback_t)(ADCStageTrigger *tsp, unsigned edge,
+                                     uint32_t index);
+
+/**
+ * @extends ADCStage
+ *
+ * @brief   Threshold trigger stage.
+ * @details Detects the crossings of a level on a channel, a crossing is
+ *          recognized when the sample goes beyond the level plus or minus
+ *          the hysteresis. The samples are passed through unchanged.
+ */
+struct ADCStageTrigger {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+  /** @brief Monitored channel.*/
+  adc_channels_num_t    channel;
+  /** @brief Trigger level.*/
+  adcstreamsample_t     level;
+  /** @brief Hysteresis around the level.*/
+  adcstreamsample_t     hysteresis;
+  /** @brief Reported edges, @p ADC_TRIGGER_xxx mask.*/
+  unsigned              edges;
+  /** @brief Trigger callback or @p NULL.*/
+  adctriggercallback_t  callback;
+  /** @brief The signal is currently above the level.*/
+  bool_t                above;
+  /** @brief The state is not yet known.*/
+  bool_t                unknown;
+  /** @brief Samples seen by the stage.*/
+  uint32_t              samples;
+  /** @brief Rising crossings counter.*/
+  uint32_t              rising;
+  /** @brief Falling crossings counter.*/
+  uint32_t              falling;
+};
+
+/**
+ * @brief   Type of a sink stage.
+ */
+typedef struct ADCStageSink ADCStageSink;
+
+/**
+ * @brief   Sink callback type.
+ * @note    The callback is invoked from the stream thread.
+ *
+ * @param[in] skp       pointer to the @p ADCStageSink object
+ * @param[in] dp        pointer to the processed samples
+ */
+typedef void (*adcsinkcallback_t)(ADCStageSink *skp, const ADCStreamData *dp);
+
+/**
+ * @extends ADCStage
+ *
+ * @brief   Sink stage.
+ * @details Hands the processed samples to the application.
+ */
+struct ADCStageSink {
+  /** @brief Virtual Methods Table.*/
+  const struct ADCStageVMT *vmt;
+  _adc_stage_data
+  /** @brief Sink callback.*/
+  adcsinkcallback_t     callback;
+  /** @brief Callback argument, not used by the stage.*/
+  void                  *arg;
+};
+
+/**
+ * @brief   ADC stream configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief ADC driver, already started.
+   */
+  ADCDriver             *adcp;
+  /**
+   * @brief Conversion group template.
+   * @details The group is copied, the circular mode and the callbacks are
+   *          set by the stream.
+   */
+  const ADCConversionGroup *grpp;
+  /**
+   * @brief Circular conversion buffer.
+   */
+  adcsample_t           *buffer;
+  /**
+   * @brief Depth of the conversion buffer, an even number of rows.
+   * @details A block is half of the buffer.
+   */
+  size_t                depth;
+  /**
+   * @brief Blocks pool, @p ADC_STREAM_POOL_SIZE() samples.
+   */
+  adcsample_t           *pool;
+  /**
+   * @brief Number of blocks in the pool.
+   */
+  unsigned              nblocks;
+  /**
+   * @brief Work buffers, @p ADC_STREAM_WORK_SIZE() samples.
+   */
+  adcstreamsample_t     *work;
+  /**
+   * @brief @p NULL terminated array of stages.
+   */
+  ADCStage * const      *stages;
+  /**
+   * @brief Priority of the stream thread.
+   */
+  tprio_t               prio;
+} ADCStreamConfig;
+
+/**
+ * @brief   Stream states.
+ */
+typedef enum {
+  ADC_STREAM_UNINIT = 0,            /**< Not initialized.                   */
+  ADC_STREAM_STOP = 1,              /**< Stopped.                           */
+  ADC_STREAM_ACTIVE = 2             /**< Streaming.                         */
+} adcstreamstate_t;
+
+/**
+ * @brief   Structure representing an ADC stream.
+ * @details The conversion callback copies each completed half of the
+ *          conversion buffer into a free block of the pool and hands it
+ *          to the stream thread, the stages run in the thread. The pool
+ *          is a single producer single consumer ring, the callback only
+ *          advances @p wr and the thread only advances @p rd.
+ */
+typedef struct {
+  /**
+   * @brief Stream state.
+   */
+  adcstreamstate_t      state;
+  /**
+   * @brief Current configuration data.
+   */
+  const ADCStreamConfig *config;
+  /**
+   * @brief Conversion group, copy of the configured one.
+   */
+  ADCConversionGroup    group;
+  /**
+   * @brief Rows per block.
+   */
+  size_t                rows;
+  /**
+   * @brief Blocks handed to the thread, only advanced by the callback.
+   */
+  volatile uint32_t     wr;
+  /**
+   * @brief Blocks processed, only advanced by the thread.
+   */
+  volatile uint32_t     rd;
+  /**
+   * @brief Index of the first row of each block in the pool.
+   */
+  uint32_t              index[ADC_STREAM_MAX_BLOCKS];
+  /**
+   * @brief Blocks have been dropped before each block in the pool.
+   */
+  bool_t                gap[ADC_STREAM_MAX_BLOCKS];
+  /**
+   * @brief Blocks converted since the start.
+   */
+  uint32_t              converted;
+  /**
+   * @brief Blocks dropped because the pool was full.
+   */
+  uint32_t              dropped;
+  /**
+   * @brief A block has been dropped after the last one handed to the
+   *        thread.
+   */
+  bool_t                dropping;
+  /**
+   * @brief Maximum number of blocks ever waiting in the pool.
+   */
+  uint32_t              peak;
+  /**
+   * @brief ADC errors.
+   */
+  uint32_t              errors;
+  /**
+   * @brief Processing time of the blocks, worst case in
+   *        @p ADC_STREAM_TIME_FREQUENCY units.
+   */
+  uint32_t              busy_worst;
+  /**
+   * @brief Processing time of the blocks, accumulated in
+   *        @p ADC_STREAM_TIME_FREQUENCY units.
+   */
+  uint64_t              busy_total;
+  /**
+   * @brief Stream thread.
+   */
+  Thread                *thread;
+  /**
+   * @brief Stream thread is waiting for blocks.
+   */
+  bool_t                idle;
+  /**
+   * @brief Overrun and error event source.
+   */
+  EventSource           event;
+  /**
+   * @brief Stream thread working area.
+   */
+  WORKING_AREA(wa, ADC_STREAM_THREAD_STACK_SIZE);
+} ADCStream;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Size of a blocks pool in samples.
+ *
+ * @param[in] channels  number of channels
+ * @param[in] depth     depth of the conversion buffer
+ * @param[in] nblocks   number of blocks
+ */
+#define ADC_STREAM_POOL_SIZE(channels, depth, nblocks)                      \
+  ((channels) * ((depth) / 2) * (nblocks))
+
+/**
+ * @brief   Size of the work buffers in samples.
+ *
+ * @param[in] channels  number of channels
+ * @param[in] depth     depth of the conversion buffer
+ */
+#define ADC_STREAM_WORK_SIZE(channels, depth)                               \
+  (2 * (channels) * (ADC_STREAM_HEADROOM + (depth) / 2))
+
+/**
+ * @brief   Returns the samples of a channel.
+ *
+ * @param[in] dp        pointer to the @p ADCStreamData object
+ * @param[in] ch        channel number
+ * @return              Pointer to the first sample of the channel.
+ *
+ * @special
+ */
+#define adcStreamChannel(dp, ch)                                            \
+  ((dp)->data + (ch) * (dp)->stride + ADC_STREAM_HEADROOM)
+
+/**
+ * @brief   Returns the overrun and error event source of a stream.
+ *
+ * @param[in] asp       pointer to the @p ADCStream object
+ *
+ * @api
+ */
+#define adcStreamGetEventSource(asp) (&(asp)->event)
+
+/**
+ * @brief   Resets a stage.
+ *
+ * @param[in] sp        pointer to an @p ADCStage or derived object
+ * @param[in] channels  number of channels of the stream
+ *
+ * @api
+ */
+#define adcStageReset(sp, channels)                                         \
+  ((sp)->vmt->reset(sp, channels))
+
+/**
+ * @brief   Processes a block of samples through a stage.
+ *
+ * @param[in] sp        pointer to an @p ADCStage or derived object
+ * @param[in,out] dp    pointer to the @p ADCStreamData object
+ *
+ * @api
+ */
+#define adcStageProcess(sp, dp)                                             \
+  ((sp)->vmt->process(sp, dp))
+/** @} */
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void adcStreamObjectInit(ADCStream *asp);
+  void adcStreamStart(ADCStream *asp, const ADCStreamConfig *config);
+  void adcStreamStop(ADCStream *asp);
+  void adcStreamRun(ADCStage * const *stages, ADCStreamData *dp);
+  void adcStageCICObjectInit(ADCStageCIC *csp, unsigned order,
+                             unsigned ratio);
+  void adcStageFIRObjectInit(ADCStageFIR *fsp, const int16_t *coeffs,
+                             unsigned ntaps, unsigned ratio);
+  void adcStageStatsObjectInit(ADCStageStats *ssp, uint32_t window,
+                               adcstatscallback_t callback);
+  void adcStageTriggerObjectInit(ADCStageTrigger *tsp,
+                                 adc_channels_num_t channel,
+                                 adcstreamsample_t level,
+                                 adcstreamsample_t hysteresis,
+                                 unsigned edges,
+                                 adctriggercallback_t callback);
+  void adcStageSinkObjectInit(ADCStageSink *skp, adcsinkcallback_t callback,
+                              void *arg);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_ADC_STREAM */
+
+#endif /* _ADC_STREAM_H_ */
+
+/** @} */
@@ -0,0 +1,350 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    blk_queue.h
+ * @brief   Block I/O request queue header.
+ *
+ * @addtogroup BLK_QUEUE
+ * @{
+ */
+
+#ifndef _BLK_QUEUE_H_
+#define _BLK_QUEUE_H_
+
+#if HAL_USE_BLOCK_QUEUE || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Request operations
+ * @{
+ */
+#define BQ_OP_READ                  0   /**< @brief Blocks read.            */
+#define BQ_OP_WRITE                 1   /**< @brief Blocks write.           */
+#define BQ_OP_SYNC                  2   /**< @brief Write synchronization.  */
+/** @} */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Block queue configuration options
+ * @{
+ */
+/**
+ * @brief   Maximum number of blocks transferred by a single device call.
+ * @details Adjacent requests are merged up to this size.
+ */
+#if !defined(BQ_MAX_MERGE_BLOCKS) || defined(__DOXYGEN__)
+#define BQ_MAX_MERGE_BLOCKS         128
+#endif
+
+/**
+ * @brief   Queue thread stack size.
+ */
+#if !defined(BQ_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define BQ_THREAD_STACK_SIZE        512
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !CH_USE_EVENTS || !CH_USE_WAITEXIT
+#error "BLK_QUEUE requires CH_USE_EVENTS and CH_USE_WAITEXIT"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a block queue object.
+ */
+typedef struct BlockQueue BlockQueue;
+
+/**
+ * @brief   Type of a block I/O request.
+ */
+typedef struct BlockRequest BlockRequest;
+
+/**
+ * @brief   Request completion callback type.
+ * @note    The callback is invoked from the queue thread, with the system
+ *          unlocked. The request can be reused or resubmitted from within
+ *          the callback.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[in] brp       pointer to the completed @p BlockRequest
+ */
+typedef void (*bqcallback_t)(BlockQueue *bqp, BlockRequest *brp);
+
+/**
+ * @brief   Request states.
+ */
+typedef enum {
+  BQ_REQ_DONE = 0,                  /**< Completed or never submitted.      */
+  BQ_REQ_WAITING = 1,               /**< Ordered after a conflicting one.   */
+  BQ_REQ_PENDING = 2,               /**< Eligible for dispatch.             */
+  BQ_REQ_ACTIVE = 3                 /**< Being transferred.                 */
+} bqreqstate_t;
+
+/**
+ * @brief   Structure representing a block I/O request.
+ * @details The descriptor is owned by the queue from the submission until
+ *          the completion.
+ */
+struct BlockRequest {
+  /**
+   * @brief Next request in the same list.
+   */
+  BlockRequest          *next;
+  /**
+   * @brief Request operation.
+   */
+  uint8_t               op;
+  /**
+   * @brief Request state.
+   */
+  volatile bqreqstate_t state;
+  /**
+   * @brief First block.
+   */
+  uint32_t              startblk;
+  /**
+   * @brief Number of blocks.
+   */
+  uint32_t              n;
+  /**
+   * @brief Data buffer.
+   */
+  uint8_t               *buf;
+  /**
+   * @brief Completion callback or @p NULL.
+   */
+  bqcallback_t          callback;
+  /**
+   * @brief Callback argument, not used by the queue.
+   */
+  void                  *arg;
+  /**
+   * @brief Operation result, @p CH_SUCCESS or @p CH_FAILED.
+   */
+  bool_t                result;
+  /**
+   * @brief Thread waiting for the completion or @p NULL.
+   */
+  Thread                *thread;
+};
+
+/**
+ * @brief   Block queue configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief Block device served by the queue.
+   */
+  BaseBlockDevice       *bbdp;
+  /**
+   * @brief Priority of the queue thread.
+   */
+  tprio_t               prio;
+} BlockQueueConfig;
+
+/**
+ * @brief   @p BlockQueue specific methods.
+ */
+#define _block_queue_methods                                                \
+  _base_block_device_methods
+
+/**
+ * @extends BaseBlockDeviceVMT
+ *
+ * @brief   @p BlockQueue virtual methods table.
+ */
+struct BlockQueueVMT {
+  _block_queue_methods
+};
+
+/**
+ * @extends BaseBlockDevice
+ *
+ * @brief   Structure representing a block I/O request queue.
+ * @details The queue is itself a block device, the synchronous methods
+ *          are implemented as a submission followed by a wait.
+ */
+struct BlockQueue {
+  /**
+   * @brief Virtual Methods Table.
+   */
+  const struct BlockQueueVMT *vmt;
+  _base_block_device_data
+  /**
+   * @brief Current configuration data.
+   */
+  const BlockQueueConfig *config;
+  /**
+   * @brief Requests eligible for dispatch, ordered by block address.
+   */
+  BlockRequest          *pending;
+  /**
+   * @brief Requests held back by a conflicting request, FIFO order.
+   */
+  BlockRequest          *waiting;
+  /**
+   * @brief Requests being transferred, ordered by block address.
+   */
+  BlockRequest          *active;
+  /**
+   * @brief Block size of the device, zero if not yet known.
+   */
+  uint32_t              blk_size;
+  /**
+   * @brief Elevator position, the block following the last transfer.
+   */
+  uint32_t              position;
+  /**
+   * @brief Queue thread.
+   */
+  Thread                *thread;
+  /**
+   * @brief Queue thread is idle and waiting for requests.
+   */
+  bool_t                idle;
+  /**
+   * @brief Completion event source.
+   */
+  EventSource           event;
+  /**
+   * @brief Number of completed requests.
+   */
+  uint32_t              requests;
+  /**
+   * @brief Number of device transfers.
+   */
+  uint32_t              transfers;
+  /**
+   * @brief Queue thread working area.
+   */
+  WORKING_AREA(wa, BQ_THREAD_STACK_SIZE);
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Returns the completion event source of a queue.
+ * @details The source is broadcast after each request completion.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ *
+ * @api
+ */
+#define bqGetEventSource(bqp) (&(bqp)->event)
+
+/**
+ * @brief   Determines if a request is completed.
+ *
+ * @param[in] brp       pointer to the @p BlockRequest object
+ *
+ * @special
+ */
+#define bqIsDone(brp) ((brp)->state == BQ_REQ_DONE)
+
+/**
+ * @brief   Starts an asynchronous blocks read.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[out] brp      pointer to the @p BlockRequest object
+ * @param[in] startblk  first block to read
+ * @param[out] buf      pointer to the read buffer
+ * @param[in] n         number of blocks to read
+ * @param[in] cb        completion callback or @p NULL
+ *
+ * @api
+ */
+#define bqStartRead(bqp, brp, startblk, buf, n, cb)                         \
+  bqSubmit(bqp, brp, BQ_OP_READ, startblk, buf, n, cb)
+
+/**
+ * @brief   Starts an asynchronous blocks write.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[out] brp      pointer to the @p BlockRequest object
+ * @param[in] startblk  first block to write
+ * @param[in] buf       pointer to the write buffer
+ * @param[in] n         number of blocks to write
+ * @param[in] cb        completion callback or @p NULL
+ *
+ * @api
+ */
+#define bqStartWrite(bqp, brp, startblk, buf, n, cb)                        \
+  bqSubmit(bqp, brp, BQ_OP_WRITE, startblk, (uint8_t *)(buf), n, cb)
+
+/**
+ * @brief   Starts an asynchronous write synchronization.
+ * @details The operation is performed after all the previously submitted
+ *          requests and before all the following ones.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[out] brp      pointer to the @p BlockRequest object
+ * @param[in] cb        completion callback or @p NULL
+ *
+ * @api
+ */
+#define bqStartSync(bqp, brp, cb)                                           \
+  bqSubmit(bqp, brp, BQ_OP_SYNC, 0, NULL, 0, cb)
+/** @} */
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void bqObjectInit(BlockQueue *bqp);
+  void bqStart(BlockQueue *bqp, const BlockQueueConfig *config);
+  void bqStop(BlockQueue *bqp);
+  void bqSubmitI(BlockQueue *bqp, BlockRequest *brp);
+  void bqSubmit(BlockQueue *bqp, BlockRequest *brp, uint8_t op,
+                uint32_t startblk, uint8_t *buf, uint32_t n,
+                bqcallback_t callback);
+  bool_t bqWaitS(BlockRequest *brp);
+  bool_t bqWait(BlockRequest *brp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_BLOCK_QUEUE */
+
+#endif /* _BLK_QUEUE_H_ */
+
+/** @} */
@@ -83,6 +83,45 @@
 #if !defined(CAN_USE_SLEEP_MODE) || defined(__DOXYGEN__)
 #define CAN_USE_SLEEP_MODE          TRUE
 #endif
+
+/**
+ * @brief   Software receive FIFO switch.
+ * @details If enabled the low level driver moves the received frames into
+ *          a software FIFO from within its interrupt handler, each frame is
+ *          timestamped on arrival. The hardware mailboxes are released
+ *          immediately so bursts no longer overflow them.
+ */
+#if !defined(CAN_USE_RX_FIFO) || defined(__DOXYGEN__)
+#define CAN_USE_RX_FIFO             FALSE
+#endif
+
+/**
+ * @brief   Software receive FIFO size in frames.
+ * @note    The value must be a power of two.
+ */
+#if !defined(CAN_RX_FIFO_SIZE) || defined(__DOXYGEN__)
+#define CAN_RX_FIFO_SIZE            32
+#endif
+
+/**
+ * @brief   Software acceptance filter switch.
+ * @details If enabled a filter can be attached to the driver, it accepts
+ *          standard identifiers through a bitmap and extended identifiers
+ *          through an hash table, frames with a routed identifier are
+ *          posted to a dedicated mailbox instead of the receive FIFO.
+ * @note    Requires @p CAN_USE_RX_FIFO.
+ */
+#if !defined(CAN_USE_RX_FILTER) || defined(__DOXYGEN__)
+#define CAN_USE_RX_FILTER           FALSE
+#endif
+
+/**
+ * @brief   Number of hash buckets of a software filter.
+ * @note    The value must be a power of two.
+ */
+#if !defined(CAN_RX_FILTER_BUCKETS) || defined(__DOXYGEN__)
+#define CAN_RX_FILTER_BUCKETS       16
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -93,6 +132,23 @@
 #error "CAN driver requires CH_USE_SEMAPHORES and CH_USE_EVENTS"
 #endif
 
+#if CAN_USE_RX_FIFO && ((CAN_RX_FIFO_SIZE & (CAN_RX_FIFO_SIZE - 1)) != 0)
+#error "CAN_RX_FIFO_SIZE must be a power of two"
+#endif
+
+#if CAN_USE_RX_FILTER && !CAN_USE_RX_FIFO
+#error "CAN_USE_RX_FILTER requires CAN_USE_RX_FIFO"
+#endif
+
+#if CAN_USE_RX_FILTER && (!CH_USE_MAILBOXES || !CH_USE_MEMPOOLS)
+#error "CAN_USE_RX_FILTER requires CH_USE_MAILBOXES and CH_USE_MEMPOOLS"
+#endif
+
+#if CAN_USE_RX_FILTER &&                                                    \
+    ((CAN_RX_FILTER_BUCKETS & (CAN_RX_FILTER_BUCKETS - 1)) != 0)
+#error "CAN_RX_FILTER_BUCKETS must be a power of two"
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -108,8 +164,134 @@ typedef enum {
   CAN_SLEEP = 4                             /**< Sleep state.               */
 } canstate_t;
 
+#if CAN_USE_RX_FIFO || defined(__DOXYGEN__)
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+/**
+ * @brief   Type of a receive timestamp.
+ * @details Timestamps are taken from the realtime counter when the HAL
+ *          implements it, from the system time otherwise.
+ */
+typedef halrtcnt_t cantime_t;
+#else
+typedef systime_t cantime_t;
+#endif
+#endif /* CAN_USE_RX_FIFO */
+
+#if CAN_USE_RX_FILTER || defined(__DOXYGEN__)
+/**
+ * @brief   Type of a receive route.
+ */
+typedef struct CANRxRoute CANRxRoute;
+
+/**
+ * @brief   Structure representing a receive route.
+ * @details A route selects a single identifier. If a mailbox is specified
+ *          then the matching frames are copied into objects allocated from
+ *          the associated pool and posted to the mailbox, the objects are
+ *          of type @p CANRxStamped. A route without mailbox just accepts
+ *          the identifier into the receive FIFO.
+ */
+struct CANRxRoute {
+  /**
+   * @brief   Next route in the same hash bucket.
+   */
+  CANRxRoute                *next;
+  /**
+   * @brief   Routed identifier, bit 31 is set for extended identifiers.
+   */
+  uint32_t                  key;
+  /**
+   * @brief   Destination mailbox or @p NULL.
+   */
+  Mailbox                   *mbp;
+  /**
+   * @brief   Pool of @p CANRxStamped objects or @p NULL.
+   */
+  MemoryPool                *mp;
+  /**
+   * @brief   Number of frames posted to the mailbox.
+   */
+  uint32_t                  frames;
+  /**
+   * @brief   Number of frames lost because mailbox or pool exhaustion.
+   */
+  uint32_t                  dropped;
+};
+
+/**
+ * @brief   Structure representing a software acceptance filter.
+ * @details Standard identifiers are accepted through a bitmap, extended
+ *          identifiers are accepted only if a route exists for them.
+ */
+typedef struct {
+  /**
+   * @brief   Accepted standard identifiers, one bit each.
+   */
+  uint32_t                  stdmap[2048 / 32];
+  /**
+   * @brief   Routes hash table.
+   */
+  CANRxRoute                *buckets[CAN_RX_FILTER_BUCKETS];
+  /**
+   * @brief   Number of routes with a mailbox.
+   */
+  unsigned                  routes;
+} CANRxFilter;
+
+/**
+ * @brief   Filter data of a @p CANDriver.
+ */
+#define _can_driver_filter_data                                             \
+  /* Attached software filter or NULL.*/                                    \
+  CANRxFilter               *rxfilter;                                      \
+  /* Frames rejected by the software filter.*/                              \
+  uint32_t                  rxrejected;
+#else
+#define _can_driver_filter_data
+#endif /* CAN_USE_RX_FILTER */
+
+#if CAN_USE_RX_FIFO || defined(__DOXYGEN__)
+/**
+ * @brief   Software receive FIFO data of a @p CANDriver.
+ * @details The low level driver includes this macro in its @p CANDriver
+ *          structure, it expands to nothing if the FIFO is disabled.
+ */
+#define _can_driver_rx_data                                                 \
+  /* Software receive FIFO frames.*/                                        \
+  CANRxFrame                rxfifo[CAN_RX_FIFO_SIZE];                       \
+  /* Arrival timestamps of the frames.*/                                    \
+  cantime_t                 rxtime[CAN_RX_FIFO_SIZE];                       \
+  /* Frames counter, only advanced by the interrupt handler.*/              \
+  uint32_t                  rxwr;                                           \
+  /* Frames counter, only advanced by the readers.*/                        \
+  uint32_t                  rxrd;                                           \
+  /* Maximum number of frames ever buffered.*/                              \
+  uint32_t                  rxpeak;                                         \
+  /* Frames lost because the FIFO was full.*/                               \
+  uint32_t                  rxoverflows;                                    \
+  _can_driver_filter_data
+#else
+#define _can_driver_rx_data
+#endif /* CAN_USE_RX_FIFO */
+
 #include "can_lld.h"
 
+#if CAN_USE_RX_FILTER || defined(__DOXYGEN__)
+/**
+ * @brief   Timestamped frame posted by a receive route.
+ */
+typedef struct {
+  /**
+   * @brief   Arrival timestamp.
+   */
+  cantime_t                 time;
+  /**
+   * @brief   Received frame.
+   */
+  CANRxFrame                frame;
+} CANRxStamped;
+#endif /* CAN_USE_RX_FILTER */
+
 /*===========================================================================*/
 /* Driver macros.                                                            */
 /*===========================================================================*/
@@ -132,6 +314,24 @@ typedef enum {
  * @iclass
  */
 #define canAddFlagsI(canp, mask) ((canp)->status |= (mask))
+
+#if CAN_USE_RX_FIFO || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the number of frames in the receive FIFO.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ *
+ * @iclass
+ */
+#define canGetRxCountI(canp) ((size_t)((canp)->rxwr - (canp)->rxrd))
+
+/**
+ * @brief   Returns the number of frames lost because a full receive FIFO.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ */
+#define canGetRxOverflows(canp) ((canp)->rxoverflows)
+#endif /* CAN_USE_RX_FIFO */
 /** @} */
 
 /*===========================================================================*/
@@ -157,6 +357,27 @@ extern "C" {
   void canSleep(CANDriver *canp);
   void canWakeup(CANDriver *canp);
 #endif /* CAN_USE_SLEEP_MODE */
+#if CAN_USE_RX_FIFO
+  size_t canReceiveN(CANDriver *canp,
+                     CANRxFrame *crfp,
+                     cantime_t *tsp,
+                     size_t n,
+                     systime_t timeout);
+  void canRxIncomingI(CANDriver *canp, const CANRxFrame *crfp);
+#endif /* CAN_USE_RX_FIFO */
+#if CAN_USE_RX_FILTER
+  void canFilterObjectInit(CANRxFilter *cfp, bool_t acceptstd);
+  void canFilterAcceptStd(CANRxFilter *cfp, uint32_t first, uint32_t last);
+  void canRouteObjectInit(CANRxRoute *crp, bool_t ide, uint32_t id,
+                          Mailbox *mbp, MemoryPool *mp);
+  void canFilterAddRoute(CANRxFilter *cfp, CANRxRoute *crp);
+  void canFilterRemoveRoute(CANRxFilter *cfp, CANRxRoute *crp);
+  void canSetFilter(CANDriver *canp, CANRxFilter *cfp);
+  msg_t canRouteReceive(CANRxRoute *crp,
+                        CANRxFrame *crfp,
+                        cantime_t *tsp,
+                        systime_t timeout);
+#endif /* CAN_USE_RX_FILTER */
 #ifdef __cplusplus
 }
 #endif
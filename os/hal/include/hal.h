@@ -61,6 +61,8 @@
 #include "usb.h"
 
 /* Complex drivers.*/
+#include "adc_stream.h"
+#include "blk_queue.h"
 #include "mmc_spi.h"
 #include "serial_usb.h"
 #include "usb_msd.h"
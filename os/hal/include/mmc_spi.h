@@ -39,6 +39,7 @@
 #define MMC_CMD1_RETRY              100
 #define MMC_ACMD41_RETRY            100
 #define MMC_WAIT_DATA               10000
+#define MMC_POLL_CHUNK              8
 
 /*===========================================================================*/
 /* Driver pre-compile time settings.                                         */
@@ -59,6 +60,18 @@
 #if !defined(MMC_NICE_WAITING) || defined(__DOXYGEN__)
 #define MMC_NICE_WAITING            TRUE
 #endif
+
+/**
+ * @brief   Enables the CRC verification of the data blocks.
+ * @details If enabled the card is switched in CRC mode during the
+ *          connection, the CRC16 of the received blocks is verified and
+ *          the CRC16 of the transmitted blocks is calculated.
+ * @note    The CRC is calculated using a lookup table, the overhead is
+ *          a table access per byte.
+ */
+#if !defined(MMC_USE_CRC) || defined(__DOXYGEN__)
+#define MMC_USE_CRC                 FALSE
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -125,6 +138,12 @@ typedef struct {
    * @brief Addresses use blocks instead of bytes.
    */
   bool_t                block_addresses;
+#if MMC_USE_CRC || defined(__DOXYGEN__)
+  /**
+   * @brief Number of data CRC errors, detected or reported by the card.
+   */
+  uint32_t              crc_errors;
+#endif
 } MMCDriver;
 
 /*===========================================================================*/
@@ -183,6 +202,10 @@ extern "C" {
   bool_t mmcStartSequentialWrite(MMCDriver *mmcp, uint32_t startblk);
   bool_t mmcSequentialWrite(MMCDriver *mmcp, const uint8_t *buffer);
   bool_t mmcStopSequentialWrite(MMCDriver *mmcp);
+  bool_t mmcRead(MMCDriver *mmcp, uint32_t startblk,
+                 uint8_t *buffer, uint32_t n);
+  bool_t mmcWrite(MMCDriver *mmcp, uint32_t startblk,
+                  const uint8_t *buffer, uint32_t n);
   bool_t mmcSync(MMCDriver *mmcp);
   bool_t mmcGetInfo(MMCDriver *mmcp, BlockDeviceInfo *bdip);
   bool_t mmcErase(MMCDriver *mmcp, uint32_t startblk, uint32_t endblk);
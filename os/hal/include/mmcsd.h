@@ -95,6 +95,7 @@
 #define MMCSD_CMD_LOCK_UNLOCK           42
 #define MMCSD_CMD_APP_CMD               55
 #define MMCSD_CMD_READ_OCR              58
+#define MMCSD_CMD_CRC_ON_OFF            59
 /** @} */
 
 /**
@@ -53,6 +53,39 @@
 #if !defined(SERIAL_USB_BUFFERS_SIZE) || defined(__DOXYGEN__)
 #define SERIAL_USB_BUFFERS_SIZE     256
 #endif
+
+/**
+ * @brief   Double buffered transmit mode.
+ * @details If enabled the transmit side does not use the output queue,
+ *          writers fill a linear buffer while the other one is in flight
+ *          on the IN data endpoint.
+ * @note    The default is @p FALSE.
+ */
+#if !defined(SERIAL_USB_USE_TX_DOUBLE_BUFFER) || defined(__DOXYGEN__)
+#define SERIAL_USB_USE_TX_DOUBLE_BUFFER     FALSE
+#endif
+
+/**
+ * @brief   Size of each transmit buffer in double buffered mode.
+ * @details This is the maximum size of a single IN transfer, it must be a
+ *          multiple of the USB data endpoint maximum packet size, packets
+ *          are aggregated up to this size.
+ * @note    The default is 512 bytes, eight full speed bulk packets.
+ */
+#if !defined(SERIAL_USB_TX_BUFFER_SIZE) || defined(__DOXYGEN__)
+#define SERIAL_USB_TX_BUFFER_SIZE           512
+#endif
+
+/**
+ * @brief   Transmit coalescing time in double buffered mode.
+ * @details When the IN endpoint is idle and the transmit buffer is not
+ *          full the transfer is delayed by this number of system ticks
+ *          so that small writes are batched into full packets.
+ * @note    Zero means that transfers are started immediately.
+ */
+#if !defined(SERIAL_USB_TX_COALESCE_TIME) || defined(__DOXYGEN__)
+#define SERIAL_USB_TX_COALESCE_TIME         1
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -64,6 +97,10 @@
        "CH_USE_EVENTS"
 #endif
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER && (SERIAL_USB_TX_BUFFER_SIZE < 64)
+#error "SERIAL_USB_TX_BUFFER_SIZE must hold at least one full speed packet"
+#endif
+
 /*===========================================================================*/
 /* Driver data structures and types.                                         */
 /*===========================================================================*/
@@ -94,6 +131,29 @@ typedef struct {
   USBDriver                 *usbp;
 } SerialUSBConfig;
 
+#if !SERIAL_USB_USE_TX_DOUBLE_BUFFER || defined(__DOXYGEN__)
+/**
+ * @brief   Transmit side data, output queue mode.
+ */
+#define _serial_usb_driver_tx_data                                          \
+  /* Output queue.*/                                                        \
+  OutputQueue               oqueue;                                         \
+  /* Output buffer.*/                                                       \
+  uint8_t                   ob[SERIAL_USB_BUFFERS_SIZE];
+#else
+#define _serial_usb_driver_tx_data                                          \
+  /* Transmit buffers, one is filled while the other one is in flight.*/    \
+  uint8_t                   tb[2][SERIAL_USB_TX_BUFFER_SIZE];               \
+  /* Bytes contained in each transmit buffer.*/                             \
+  size_t                    tbcnt[2];                                       \
+  /* Index of the transmit buffer currently being filled.*/                 \
+  unsigned                  tbfill;                                         \
+  /* Threads waiting for space in the transmit buffers.*/                   \
+  ThreadsQueue              tbwaiting;                                      \
+  /* Transmit coalescing timer.*/                                           \
+  VirtualTimer              tbvt;
+#endif
+
 /**
  * @brief   @p SerialDriver specific data.
  */
@@ -103,12 +163,10 @@ typedef struct {
   sdustate_t                state;                                          \
   /* Input queue.*/                                                         \
   InputQueue                iqueue;                                         \
-  /* Output queue.*/                                                        \
-  OutputQueue               oqueue;                                         \
   /* Input buffer.*/                                                        \
   uint8_t                   ib[SERIAL_USB_BUFFERS_SIZE];                    \
-  /* Output buffer.*/                                                       \
-  uint8_t                   ob[SERIAL_USB_BUFFERS_SIZE];                    \
+  /* Transmit side.*/                                                       \
+  _serial_usb_driver_tx_data                                                \
   /* End of the mandatory fields.*/                                         \
   /* Current configuration data.*/                                          \
   const SerialUSBConfig     *config;
@@ -18,6 +18,14 @@
     along with this program.  If not, see <http://www.gnu.org/licenses/>.
 */
 
+/**
+ * @file    usb_msd.h
+ * @brief   USB Mass Storage Driver macros and structures.
+ *
+ * @addtogroup MSD_USB
+ * @{
+ */
+
 #ifndef _USB_MSD_H_
 #define _USB_MSD_H_
 
@@ -30,26 +38,29 @@
 
 #if HAL_USE_MASS_STORAGE_USB || defined(__DOXYGEN__)
 
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
 
-#define MSD_RW_LED_ON()   palSetPad(GPIOI, GPIOI_LED4);
-#define MSD_RW_LED_OFF()  palClearPad(GPIOI, GPIOI_LED4);
-
-
+#if defined(STM32_USB_USE_OTG2) && defined(STM32_USE_USB_OTG2_HS)
 #if STM32_USB_USE_OTG2 && STM32_USE_USB_OTG2_HS
 #  define USB_MS_EP_SIZE 512
-#else
+#endif
+#endif
+#if !defined(USB_MS_EP_SIZE)
 #  define USB_MS_EP_SIZE 64
 #endif
 
-
 #ifdef MSD_USB_DRIVER_EXT_FIELDS_NAME
 #  define   USBD_PARAM_NAME     MSD_USB_DRIVER_EXT_FIELDS_NAME
 #else
 #  define   USBD_PARAM_NAME     param
 #endif
 
-
-
+/**
+ * @brief   Size of the blocks exchanged with the block device.
+ */
+#define MSD_BLOCK_SIZE          512
 
 #define MSD_REQ_RESET		0xFF
 #define MSD_GET_MAX_LUN		0xFE
@@ -75,6 +86,7 @@
 #define SCSI_CMD_SEND_DIAGNOSTIC				0x1D
 #define SCSI_CMD_MODE_SENSE_6                   0x1A
 #define SCSI_CMD_START_STOP_UNIT				0x1B
+#define SCSI_CMD_SYNCHRONIZE_CACHE_10           0x35
 
 #define MSD_COMMAND_PASSED 0x00
 #define MSD_COMMAND_FAILED 0x01
@@ -108,6 +120,135 @@
 #define SCSI_ASENSEQ_INITIALIZING_COMMAND_REQUIRED     0x02
 #define SCSI_ASENSEQ_OPERATION_IN_PROGRESS             0x07
 
+/**
+ * @name    Latency histogram classes
+ * @{
+ */
+#define MSD_HIST_READ           0   /**< @brief READ(10) commands.          */
+#define MSD_HIST_WRITE          1   /**< @brief WRITE(10) commands.         */
+#define MSD_HIST_OTHER          2   /**< @brief All the other commands.     */
+#define MSD_HIST_CLASSES        3   /**< @brief Number of classes.          */
+/** @} */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    USB Mass Storage configuration options
+ * @{
+ */
+/**
+ * @brief   Number of transfer buffers in the pipeline ring.
+ * @details USB transfers and block device operations proceed in parallel
+ *          on different buffers of the ring, a bigger ring absorbs the
+ *          latency jitter of the block device.
+ */
+#if !defined(MSD_NUM_BUFFERS) || defined(__DOXYGEN__)
+#define MSD_NUM_BUFFERS             4
+#endif
+
+/**
+ * @brief   Size of each transfer buffer in blocks.
+ */
+#if !defined(MSD_BUFFER_BLOCKS) || defined(__DOXYGEN__)
+#define MSD_BUFFER_BLOCKS           8
+#endif
+
+/**
+ * @brief   Maximum number of logical units per instance.
+ */
+#if !defined(MSD_MAX_LUNS) || defined(__DOXYGEN__)
+#define MSD_MAX_LUNS                4
+#endif
+
+/**
+ * @brief   Stack size of the per-instance mass storage thread.
+ */
+#if !defined(MSD_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define MSD_THREAD_STACK_SIZE       1024
+#endif
+
+/**
+ * @brief   Priority of the per-instance mass storage thread.
+ */
+#if !defined(MSD_THREAD_PRIORITY) || defined(__DOXYGEN__)
+#define MSD_THREAD_PRIORITY         NORMALPRIO
+#endif
+
+/**
+ * @brief   Priority of the write-behind threads of the queued LUNs.
+ */
+#if !defined(MSD_LUN_THREAD_PRIORITY) || defined(__DOXYGEN__)
+#define MSD_LUN_THREAD_PRIORITY     MSD_THREAD_PRIORITY
+#endif
+
+/**
+ * @brief   Enables the per-command latency histograms.
+ */
+#if !defined(MSD_USE_LATENCY_HISTOGRAM) || defined(__DOXYGEN__)
+#define MSD_USE_LATENCY_HISTOGRAM   TRUE
+#endif
+
+/**
+ * @brief   Number of bins in each latency histogram.
+ * @details Bin @p i counts the commands with a latency in the
+ *          [2^i, 2^(i+1)) range, the last bin also counts all the slower
+ *          commands. Latencies are expressed in @p MSD_LATENCY_FREQUENCY
+ *          units.
+ */
+#if !defined(MSD_HISTOGRAM_BINS) || defined(__DOXYGEN__)
+#define MSD_HISTOGRAM_BINS          16
+#endif
+
+/**
+ * @brief   Read/write activity indicator.
+ * @note    Define both @p MSD_RW_LED_ON() and @p MSD_RW_LED_OFF() in
+ *          halconf.h in order to drive a board LED.
+ */
+#if !defined(MSD_RW_LED_ON) || defined(__DOXYGEN__)
+#define MSD_RW_LED_ON()
+#endif
+
+#if !defined(MSD_RW_LED_OFF) || defined(__DOXYGEN__)
+#define MSD_RW_LED_OFF()
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if MSD_NUM_BUFFERS < 2
+#error "MSD_NUM_BUFFERS must be at least 2"
+#endif
+
+#if MSD_BUFFER_BLOCKS < 1
+#error "MSD_BUFFER_BLOCKS must be at least 1"
+#endif
+
+#if (MSD_MAX_LUNS < 1) || (MSD_MAX_LUNS > 16)
+#error "MSD_MAX_LUNS must be in the 1..16 range"
+#endif
+
+/**
+ * @brief   Size of each transfer buffer in bytes.
+ */
+#define MSD_BUFFER_SIZE         (MSD_BUFFER_BLOCKS * MSD_BLOCK_SIZE)
+
+/**
+ * @brief   Units of the latency histograms, in Hz.
+ */
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+#define MSD_LATENCY_FREQUENCY   halGetCounterFrequency()
+#else
+#define MSD_LATENCY_FREQUENCY   CH_FREQUENCY
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
 PACK_STRUCT_BEGIN typedef struct {
 	uint32_t signature;
 	uint32_t tag;
@@ -162,21 +303,144 @@ typedef struct USBMassStorageDriver USBMassStorageDriver;
 
 typedef enum { idle, read_cmd_block, ejected} msd_state_t;
 
+/**
+ * @brief   Direction of the data pipeline.
+ */
+typedef enum {
+  MSD_PIPE_IDLE = 0,                /**< No data phase in progress.         */
+  MSD_PIPE_OUT,                     /**< Host to device (WRITE).            */
+  MSD_PIPE_IN                       /**< Device to host (READ).             */
+} msd_pipe_t;
+
+/**
+ * @brief   Latency histogram of a class of commands.
+ */
+typedef struct {
+  uint32_t                  count;      /**< @brief Completed commands.     */
+  uint32_t                  max;        /**< @brief Worst case latency.     */
+  uint32_t                  bins[MSD_HISTOGRAM_BINS];
+} msd_histogram_t;
+
+/**
+ * @brief   Data pipeline state.
+ * @details The ring buffers are filled and drained in order. For OUT
+ *          transfers the USB ISR is the producer and the driver thread is
+ *          the consumer, for IN transfers the roles are swapped. Buffers
+ *          between @p tail and @p head are full, the USB side chains its
+ *          transfers from the ISR as long as there are buffers to work on.
+ */
+typedef struct {
+  msd_pipe_t                dir;
+  /** @brief Next buffer to be filled.*/
+  unsigned                  head;
+  /** @brief Next buffer to be drained.*/
+  unsigned                  tail;
+  /** @brief Number of buffers holding data.*/
+  unsigned                  full;
+  /** @brief A USB transfer is in progress.*/
+  bool_t                    busy;
+  /** @brief A USB transfer ended with an unexpected size.*/
+  bool_t                    error;
+  /** @brief Blocks still to be moved over USB.*/
+  uint32_t                  usb_blocks;
+  /** @brief Size in blocks of the data in each buffer.*/
+  uint16_t                  blocks[MSD_NUM_BUFFERS];
+} msd_pipeline_t;
+
+/**
+ * @brief   Write-behind queue slot.
+ */
+typedef struct {
+  /** @brief First block on the block device.*/
+  uint32_t                  lba;
+  /** @brief Number of blocks in @p data.*/
+  uint32_t                  n;
+  /** @brief Slot data.*/
+  uint8_t                   data[MSD_BUFFER_SIZE];
+} msd_slot_t;
+
+/**
+ * @brief   Logical unit configuration.
+ * @details A logical unit exposes a range of blocks of a block device,
+ *          several units can share the same device as partitions.
+ *          Units with a write-behind queue have their own thread writing
+ *          to the block device, the write commands complete as soon as the
+ *          data is in the queue so a slow device does not stall the other
+ *          units.
+ */
+typedef struct {
+  /**
+   * @brief   Block device backing the logical unit.
+   */
+  BaseBlockDevice           *bbdp;
+  /**
+   * @brief   First block of the unit on the block device.
+   */
+  uint32_t                  start;
+  /**
+   * @brief   Number of blocks of the unit, zero for up to the device end.
+   */
+  uint32_t                  blocks;
+  /**
+   * @brief   The unit is exposed as write protected.
+   */
+  bool_t                    read_only;
+  /**
+   * @brief   Write-behind queue slots, @p NULL for synchronous writes.
+   */
+  msd_slot_t                *slots;
+  /**
+   * @brief   Number of slots in the write-behind queue.
+   */
+  unsigned                  depth;
+  /**
+   * @brief   Working area of the write-behind thread.
+   */
+  void                      *wsp;
+  /**
+   * @brief   Size of the write-behind thread working area.
+   */
+  size_t                    wsize;
+} MSDLunConfig;
+
+/**
+ * @brief   Logical unit runtime state.
+ */
+typedef struct {
+  /** @brief Back pointer to the owning driver.*/
+  USBMassStorageDriver      *msdp;
+  /** @brief Unit configuration.*/
+  const MSDLunConfig        *config;
+  /** @brief Exposed size in blocks.*/
+  uint32_t                  blk_num;
+  /** @brief Sense data of the last command.*/
+  scsi_sense_response_t     sense;
+  /** @brief Free write-behind slots.*/
+  Semaphore                 free_slots;
+  /** @brief Write-behind slots waiting to be written.*/
+  Semaphore                 full_slots;
+  /** @brief Next slot to be filled.*/
+  unsigned                  head;
+  /** @brief Next slot to be written.*/
+  unsigned                  tail;
+  /** @brief A write-behind operation failed.*/
+  bool_t                    deferred_error;
+  /** @brief Write-behind thread.*/
+  Thread                    *thdp;
+} msd_lun_t;
+
+/**
+ * @brief   USB mass storage driver instance.
+ */
 struct USBMassStorageDriver {
 	USBDriver                 *usbp;
 	BinarySemaphore bsem;
-	BinarySemaphore usb_transfer_thread_bsem;
-	BinarySemaphore mass_sorage_thd_bsem;
-	BaseBlockDevice *bbdp;
 	EventSource evt_connected, evt_ejected;
-	BlockDeviceInfo block_dev_info;
 	msd_state_t state;
 	msd_cbw_t cbw;
 	msd_csw_t csw;
-	scsi_sense_response_t sense;
 	bool_t result;
 	bool_t reconfigured_or_reset_event;
-	uint32_t trigger_transfer_index;
     usbep_t  ms_ep_number;
 
     bool_t (*enable_msd_callback)(void);
@@ -184,18 +448,53 @@ struct USBMassStorageDriver {
 
     uint32_t read_error_count;
     uint32_t write_error_count;
+
+    /** @brief Mass storage thread, @p NULL if not started.*/
+    Thread *thdp;
+    /** @brief Logical units.*/
+    msd_lun_t luns[MSD_MAX_LUNS];
+    /** @brief Highest logical unit number, as returned to the host.*/
+    uint8_t max_lun;
+    /** @brief Logical unit addressed by the current command.*/
+    msd_lun_t *lunp;
+    /** @brief Unit configuration built by @p msdInit().*/
+    MSDLunConfig lun0cfg;
+    /** @brief Buffer for short command responses.*/
+    uint8_t response[8];
+    /** @brief Bytes moved in the data phase of the current command.*/
+    uint32_t data_transferred;
+    /** @brief Data pipeline state.*/
+    msd_pipeline_t pipe;
+#if MSD_USE_LATENCY_HISTOGRAM || defined(__DOXYGEN__)
+    /** @brief Per-command latency histograms.*/
+    msd_histogram_t latency[MSD_HIST_CLASSES];
+#endif
+    /** @brief Transfer buffers ring.*/
+    uint8_t buffers[MSD_NUM_BUFFERS][MSD_BUFFER_SIZE];
+    /** @brief Mass storage thread working area.*/
+    WORKING_AREA(wa, MSD_THREAD_STACK_SIZE);
 };
 
 #define MSD_CONNECTED			0
 #define MSD_EJECTED				1
 
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
 #ifdef __cplusplus
 extern "C" {
 #endif
 void msdInit(USBDriver *usbp, BaseBlockDevice *bbdp, USBMassStorageDriver *msdp, const usbep_t  ms_ep_number);
+void msdInitLuns(USBDriver *usbp, USBMassStorageDriver *msdp,
+                 const usbep_t ms_ep_number,
+                 const MSDLunConfig *luns, unsigned n);
 void msdStart(USBMassStorageDriver *msdp);
 void msdUsbEvent(USBDriver *usbp, usbep_t ep);
 bool_t msdRequestsHook(USBDriver *usbp);
+#if MSD_USE_LATENCY_HISTOGRAM || defined(__DOXYGEN__)
+void msdResetLatency(USBMassStorageDriver *msdp);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -205,3 +504,4 @@ bool_t msdRequestsHook(USBDriver *usbp);
 
 #endif /* _USB_MSD_H_ */
 
+/** @} */
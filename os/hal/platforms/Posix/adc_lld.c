@@ -0,0 +1,297 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/adc_lld.c
+ * @brief   Posix simulated ADC Driver subsystem low level driver source.
+ *
+ * @addtogroup POSIX_ADC
+ * @{
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_ADC || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/** @brief ADC1 driver identifier.*/
+#if USE_SIM_ADC1 || defined(__DOXYGEN__)
+ADCDriver ADCD1;
+#endif
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Host monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief   Rows due since the conversion start.
+ */
+static uint64_t rows_due(ADCDriver *adcp) {
+  uint64_t elapsed = now_ns() - adcp->start;
+  uint32_t rate = adcp->config->rate;
+
+  return (elapsed / 1000000000U) * rate +
+         (elapsed % 1000000000U) * rate / 1000000000U;
+}
+
+/**
+ * @brief   Reads rows from the samples file.
+ *
+ * @param[in] adcp      pointer to the @p ADCDriver object
+ * @param[out] dst      destination of the samples, @p NULL to discard
+ * @param[in] n         number of rows
+ * @return              @p FALSE if the end of the file has been reached.
+ */
+static bool_t read_rows(ADCDriver *adcp, adcsample_t *dst, size_t n) {
+  adc_channels_num_t channels = adcp->grpp->num_channels;
+  FILE *fp = (FILE *)adcp->file;
+  bool_t rewound = FALSE;
+
+  if (fp == NULL) {
+    size_t r;
+    adc_channels_num_t c;
+
+    if (dst != NULL) {
+      for (r = 0; r < n; r++) {
+        for (c = 0; c < channels; c++)
+          *dst++ = (adcsample_t)(adcp->rows + r);
+      }
+    }
+    return TRUE;
+  }
+
+  if (dst == NULL) {
+    long rowsize = (long)(channels * sizeof(adcsample_t));
+    long size, pos = ftell(fp);
+
+    fseek(fp, 0, SEEK_END);
+    size = ftell(fp) / rowsize * rowsize;
+    pos += (long)n * rowsize;
+    if (pos >= size) {
+      if (!adcp->config->loop || (size == 0))
+        return FALSE;
+      pos %= size;
+    }
+    fseek(fp, pos, SEEK_SET);
+    return TRUE;
+  }
+
+  while (n > 0) {
+    size_t got = fread(dst, channels * sizeof(adcsample_t), n, fp);
+
+    dst += got * channels;
+    n -= got;
+    if (n > 0) {
+      /* An empty file cannot be looped.*/
+      if (!adcp->config->loop || (rewound && (got == 0)))
+        return FALSE;
+      rewind(fp);
+      rewound = TRUE;
+    }
+  }
+  return TRUE;
+}
+
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level ADC driver initialization.
+ *
+ * @notapi
+ */
+void adc_lld_init(void) {
+
+#if USE_SIM_ADC1
+  adcObjectInit(&ADCD1);
+  ADCD1.file = NULL;
+#endif
+}
+
+/**
+ * @brief   Configures and activates the ADC peripheral.
+ * @details The samples file is opened.
+ *
+ * @param[in] adcp      pointer to the @p ADCDriver object
+ *
+ * @notapi
+ */
+void adc_lld_start(ADCDriver *adcp) {
+
+  if (adcp->config->rate == 0) {
+    printf("ADC: Invalid conversion rate\n");
+    exit(1);
+  }
+  if (adcp->state == ADC_READY)
+    adc_lld_stop(adcp);
+  if (adcp->config->path != NULL) {
+    adcp->file = fopen(adcp->config->path, "rb");
+    if (adcp->file == NULL) {
+      printf("%s: Error opening ADC samples file\n", adcp->config->path);
+      exit(1);
+    }
+  }
+}
+
+/**
+ * @brief   Deactivates the ADC peripheral.
+ *
+ * @param[in] adcp      pointer to the @p ADCDriver object
+ *
+ * @notapi
+ */
+void adc_lld_stop(ADCDriver *adcp) {
+
+  if (adcp->file != NULL) {
+    fclose((FILE *)adcp->file);
+    adcp->file = NULL;
+  }
+}
+
+/**
+ * @brief   Starts an ADC conversion.
+ * @details The file is played from the beginning.
+ *
+ * @param[in] adcp      pointer to the @p ADCDriver object
+ *
+ * @notapi
+ */
+void adc_lld_start_conversion(ADCDriver *adcp) {
+
+  if (adcp->file != NULL)
+    rewind((FILE *)adcp->file);
+  adcp->start = now_ns();
+  adcp->rows  = 0;
+  adcp->pos   = 0;
+  adcp->lost  = 0;
+}
+
+/**
+ * @brief   Stops an ongoing conversion.
+ * @details The interrupt source only serves active drivers, there is
+ *          nothing to do.
+ *
+ * @param[in] adcp      pointer to the @p ADCDriver object
+ *
+ * @notapi
+ */
+void adc_lld_stop_conversion(ADCDriver *adcp) {
+
+  (void)adcp;
+}
+
+/**
+ * @brief   ADC simulated interrupt source.
+ * @details The rows due since the last poll are written into the
+ *          conversion buffer and the half and full buffer callbacks are
+ *          invoked. If the source has not been polled for longer than a
+ *          whole buffer the oldest rows are skipped, as a DMA overwriting
+ *          data not yet handled would do.
+ *
+ * @return              @p TRUE if an interrupt has been served.
+ *
+ * @notapi
+ */
+bool_t adc_lld_interrupt_pending(void) {
+  ADCDriver *adcp = &ADCD1;
+  size_t half;
+  uint64_t due;
+
+  if (adcp->state != ADC_ACTIVE)
+    return FALSE;
+  due = rows_due(adcp);
+  if (due == adcp->rows)
+    return FALSE;
+
+  CH_IRQ_PROLOGUE();
+
+  if (due - adcp->rows > adcp->depth) {
+    uint64_t skip = due - adcp->rows - adcp->depth;
+
+    adcp->lost += (uint32_t)skip;
+    if (!read_rows(adcp, NULL, (size_t)skip)) {
+      _adc_isr_error_code(adcp, ADC_ERR_EOF);
+    }
+    adcp->rows += skip;
+    adcp->pos = (size_t)((adcp->pos + skip) % adcp->depth);
+  }
+
+  half = adcp->depth > 1 ? adcp->depth / 2 : adcp->depth;
+  while ((adcp->state == ADC_ACTIVE) && (adcp->rows < due)) {
+    size_t end = adcp->pos < half ? half : adcp->depth;
+    size_t n = end - adcp->pos;
+
+    if (n > due - adcp->rows)
+      n = (size_t)(due - adcp->rows);
+    if (!read_rows(adcp, adcp->samples + adcp->pos * adcp->grpp->num_channels,
+                   n)) {
+      _adc_isr_error_code(adcp, ADC_ERR_EOF);
+      break;
+    }
+    adcp->pos  += n;
+    adcp->rows += n;
+    if (adcp->pos == adcp->depth) {
+      adcp->pos = 0;
+      _adc_isr_full_code(adcp);
+    }
+    else if (adcp->pos == half) {
+      _adc_isr_half_code(adcp);
+    }
+  }
+
+  CH_IRQ_EPILOGUE();
+
+  return TRUE;
+}
+
+#endif /* HAL_USE_ADC */
+
+/** @} */
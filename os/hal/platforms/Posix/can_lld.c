@@ -0,0 +1,1062 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/can_lld.c
+ * @brief   Posix simulated CAN Driver subsystem low level driver source.
+ *
+ * @addtogroup POSIX_CAN
+ * @{
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <sched.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_CAN || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Bus initialized marker.
+ */
+#define BUS_MAGIC           0x43414E42U
+
+/**
+ * @brief   Bus being initialized marker.
+ */
+#define BUS_INIT            0x43414E30U
+
+/**
+ * @brief   Bits of a frame not subject to stuffing, CRC delimiter, ACK
+ *          slot and delimiter, end of frame and intermission.
+ */
+#define FRAME_TAIL_BITS     13
+
+/**
+ * @brief   Bus-off recovery time, 128 occurrences of 11 recessive bits.
+ */
+#define BUSOFF_BITS         (128 * 11)
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/** @brief CAN1 driver identifier.*/
+#if USE_SIM_CAN1 || defined(__DOXYGEN__)
+CANDriver CAND1;
+#endif
+
+/** @brief CAN2 driver identifier.*/
+#if USE_SIM_CAN2 || defined(__DOXYGEN__)
+CANDriver CAND2;
+#endif
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Frame on the bus.
+ */
+typedef struct {
+  /**
+   * @brief   Host time of the end of the frame, in nanoseconds.
+   */
+  uint64_t                  end;
+  /**
+   * @brief   Slot of the transmitting node.
+   */
+  uint32_t                  src;
+  /**
+   * @brief   The frame has been destroyed by an error frame.
+   */
+  uint32_t                  error;
+  /**
+   * @brief   Frame content.
+   */
+  CANTxFrame                frame;
+} bus_frame_t;
+
+/**
+ * @brief   Node slot on the bus.
+ * @details The slot contains the frame the node is trying to transmit
+ *          and the node state seen by the other nodes.
+ */
+typedef struct {
+  /**
+   * @brief   Owner process or zero if the slot is free.
+   */
+  int32_t                   pid;
+  /**
+   * @brief   A frame is contending for the bus.
+   */
+  uint32_t                  posted;
+  /**
+   * @brief   Arbitration key of the contending frame.
+   */
+  uint32_t                  key;
+  /**
+   * @brief   Mailbox of the contending frame.
+   */
+  uint32_t                  mbx;
+  /**
+   * @brief   Host time the node started contending for the bus.
+   */
+  uint64_t                  ready;
+  /**
+   * @brief   Contending frame.
+   */
+  CANTxFrame                frame;
+  /**
+   * @brief   Error frames probability, in frames per million.
+   */
+  uint32_t                  error_rate;
+  /**
+   * @brief   Transmit error counter.
+   */
+  uint32_t                  tec;
+  /**
+   * @brief   Receive error counter.
+   */
+  uint32_t                  rec;
+  /**
+   * @brief   End of the bus-off state, zero if error active or passive.
+   */
+  uint64_t                  busoff;
+  /**
+   * @brief   End time of the transmitted frames, zero if not transmitted.
+   */
+  uint64_t                  done[CAN_TX_MAILBOXES];
+} bus_node_t;
+
+/**
+ * @brief   Structure representing a simulated bus.
+ * @details The structure can be shared between processes, it only
+ *          contains position independent data.
+ */
+struct CANSimBus {
+  /**
+   * @brief   Initialization marker.
+   */
+  volatile uint32_t         magic;
+  /**
+   * @brief   Size of the structure, layouts check.
+   */
+  uint32_t                  size;
+  /**
+   * @brief   Spinlock protecting the bus.
+   */
+  volatile uint32_t         lock;
+  /**
+   * @brief   Bus bit rate.
+   */
+  uint32_t                  bitrate;
+  /**
+   * @brief   Number of frames put on the bus.
+   */
+  uint32_t                  wr;
+  /**
+   * @brief   Host time the bus becomes idle, in nanoseconds.
+   */
+  uint64_t                  idle;
+  /**
+   * @brief   Host time of the statistics reset, in nanoseconds.
+   */
+  uint64_t                  start;
+  /**
+   * @brief   Accumulated busy time, in nanoseconds.
+   */
+  uint64_t                  busy;
+  /**
+   * @brief   Frames successfully transmitted.
+   */
+  uint32_t                  frames;
+  /**
+   * @brief   Error frames.
+   */
+  uint32_t                  errors;
+  /**
+   * @brief   Node slots.
+   */
+  bus_node_t                nodes[CAN_SIM_MAX_NODES];
+  /**
+   * @brief   Recent frames.
+   */
+  bus_frame_t               history[CAN_SIM_HISTORY_SIZE];
+};
+
+/**
+ * @brief   Nodes of this process.
+ */
+static CANDriver * const nodes[] = {
+#if USE_SIM_CAN1
+  &CAND1,
+#endif
+#if USE_SIM_CAN2
+  &CAND2,
+#endif
+};
+
+#define NUM_NODES   (sizeof nodes / sizeof nodes[0])
+
+/**
+ * @brief   Bus private to this process.
+ */
+static CANSimBus private_bus;
+
+/**
+ * @brief   Shared memory buses mapped by this process.
+ */
+static struct {
+  char                      name[64];
+  CANSimBus                 *bus;
+} shared_buses[CAN_SIM_MAX_BUSES];
+
+/**
+ * @brief   Error injection generator state.
+ */
+static uint32_t rng_state = 1;
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Host monotonic time in nanoseconds.
+ */
+static uint64_t now_ns(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000U + (uint64_t)ts.tv_nsec;
+}
+
+/**
+ * @brief   Duration of a number of bits on a bus, in nanoseconds.
+ */
+static uint64_t bit_time(CANSimBus *bp, uint32_t bits) {
+
+  return (uint64_t)bits * 1000000000U / bp->bitrate;
+}
+
+/**
+ * @brief   Pseudo random number.
+ */
+static uint32_t rng(void) {
+
+  rng_state = rng_state * 1103515245 + 12345;
+  return rng_state >> 8;
+}
+
+static void bus_lock(CANSimBus *bp) {
+
+  while (__sync_lock_test_and_set(&bp->lock, 1))
+    sched_yield();
+}
+
+static void bus_unlock(CANSimBus *bp) {
+
+  __sync_lock_release(&bp->lock);
+}
+
+/**
+ * @brief   Arbitration key of a frame, lower keys win.
+ * @details The key follows the order of the arbitration field bits, the
+ *          11 bits of the base identifier, the RTR or SRR bit, the IDE
+ *          bit, the 18 bits of the extended identifier and the RTR bit.
+ */
+static uint32_t frame_key(const CANTxFrame *ctfp) {
+
+  if (ctfp->IDE)
+    return ((uint32_t)(ctfp->EID >> 18) << 21) | (1U << 20) | (1U << 19) |
+           (((uint32_t)ctfp->EID & 0x3FFFF) << 1) | ctfp->RTR;
+  return ((uint32_t)ctfp->SID << 21) | ((uint32_t)ctfp->RTR << 20);
+}
+
+/**
+ * @brief   Appends a field to a bits sequence, MSB first.
+ *
+ * @param[out] bits     bits sequence
+ * @param[in] n         bits in the sequence
+ * @param[in] value     field value
+ * @param[in] width     field width
+ * @return              The new number of bits in the sequence.
+ */
+static uint32_t put_bits(uint8_t *bits, uint32_t n, uint32_t value,
+                         unsigned width) {
+
+  while (width-- > 0)
+    bits[n++] = (uint8_t)((value >> width) & 1);
+  return n;
+}
+
+/**
+ * @brief   Initializes a bus.
+ *
+ * @param[out] bp       pointer to the zero filled @p CANSimBus object
+ */
+static void bus_init(CANSimBus *bp) {
+
+  /* The memory is zero filled, only the non zero fields are set.*/
+  bp->size  = sizeof *bp;
+  bp->start = now_ns();
+  bp->magic = BUS_MAGIC;
+}
+
+/**
+ * @brief   Maps a bus.
+ * @details A shared memory bus is created and initialized by the first
+ *          process mapping it.
+ *
+ * @param[in] name      shared memory object name or @p NULL
+ * @return              Pointer to the @p CANSimBus object.
+ */
+static CANSimBus *bus_map(const char *name) {
+  CANSimBus *bp;
+  unsigned i;
+  int fd;
+
+  if (name == NULL) {
+    if (private_bus.magic != BUS_MAGIC)
+      bus_init(&private_bus);
+    return &private_bus;
+  }
+
+  for (i = 0; i < CAN_SIM_MAX_BUSES; i++) {
+    if ((shared_buses[i].bus != NULL) &&
+        (strcmp(shared_buses[i].name, name) == 0))
+      return shared_buses[i].bus;
+  }
+  for (i = 0; i < CAN_SIM_MAX_BUSES; i++) {
+    if (shared_buses[i].bus == NULL)
+      break;
+  }
+  if ((i == CAN_SIM_MAX_BUSES) || (strlen(name) >= sizeof shared_buses[i].name)) {
+    printf("%s: Too many CAN buses or name too long\n", name);
+    exit(1);
+  }
+
+  fd = shm_open(name, O_RDWR | O_CREAT, 0600);
+  if (fd < 0) {
+    printf("%s: Error opening CAN bus shared memory\n", name);
+    exit(1);
+  }
+  if (ftruncate(fd, sizeof (CANSimBus)) < 0) {
+    printf("%s: Error sizing CAN bus shared memory\n", name);
+    exit(1);
+  }
+  bp = mmap(NULL, sizeof (CANSimBus), PROT_READ | PROT_WRITE, MAP_SHARED,
+            fd, 0);
+  close(fd);
+  if (bp == MAP_FAILED) {
+    printf("%s: Error mapping CAN bus shared memory\n", name);
+    exit(1);
+  }
+
+  /* The new object is filled with zeros, the first process initializes
+     it.*/
+  if (__sync_bool_compare_and_swap(&bp->magic, 0, BUS_INIT))
+    bus_init(bp);
+  else {
+    while (bp->magic == BUS_INIT)
+      sched_yield();
+  }
+  if ((bp->magic != BUS_MAGIC) || (bp->size != sizeof (CANSimBus))) {
+    printf("%s: Incompatible CAN bus shared memory\n", name);
+    exit(1);
+  }
+
+  strcpy(shared_buses[i].name, name);
+  shared_buses[i].bus = bp;
+  return bp;
+}
+
+/**
+ * @brief   Posts the frame a local node contends the bus with.
+ * @details The frame is the one with the highest priority among the
+ *          mailboxes not yet transmitted, the node contends the bus since
+ *          its oldest request.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ */
+static void node_post(CANDriver *canp) {
+  bus_node_t *np = &canp->bus->nodes[canp->slot];
+  uint32_t key = 0xFFFFFFFFU;
+  uint64_t ready = 0;
+  canmbx_t mbx, best = 0;
+
+  for (mbx = 1; mbx <= CAN_TX_MAILBOXES; mbx++) {
+    uint32_t k;
+
+    if (((canp->txpending & CAN_MAILBOX_TO_MASK(mbx)) == 0) ||
+        (np->done[mbx - 1] != 0))
+      continue;
+    k = frame_key(&canp->txmb[mbx - 1]);
+    if ((best == 0) || (k < key)) {
+      key  = k;
+      best = mbx;
+    }
+    if ((ready == 0) || (canp->txtime[mbx - 1] < ready))
+      ready = canp->txtime[mbx - 1];
+  }
+  np->posted = best != 0;
+  if (best != 0) {
+    np->key   = key;
+    np->mbx   = best;
+    np->ready = ready;
+    np->frame = canp->txmb[best - 1];
+  }
+}
+
+/**
+ * @brief   Executes an arbitration round.
+ * @details When the bus is idle the nodes contending the bus at the start
+ *          of the next frame are arbitrated, the winner frame is put on
+ *          the bus with its modelled duration. If an error is injected
+ *          an error frame is put on the bus instead and the frame stays
+ *          contending for the next round.
+ *
+ * @param[in] bp        pointer to the @p CANSimBus object
+ * @param[in] now       current host time
+ * @return              @p TRUE if a frame has been put on the bus.
+ */
+static bool_t bus_round(CANSimBus *bp, uint64_t now) {
+  bus_node_t *np, *winner = NULL;
+  bus_frame_t *bfp;
+  uint64_t first = 0, start, end;
+  uint32_t bits;
+  unsigned i;
+
+  if (bp->idle > now)
+    return FALSE;
+
+  /* Bus-off recovery and start of the next frame.*/
+  for (i = 0; i < CAN_SIM_MAX_NODES; i++) {
+    np = &bp->nodes[i];
+    if ((np->busoff != 0) && (np->busoff <= now)) {
+      np->busoff = 0;
+      np->tec    = 0;
+      np->rec    = 0;
+    }
+    if ((np->pid == 0) || !np->posted || (np->busoff != 0))
+      continue;
+    if ((first == 0) || (np->ready < first))
+      first = np->ready;
+  }
+  if (first == 0)
+    return FALSE;
+  start = first > bp->idle ? first : bp->idle;
+
+  /* Arbitration among the nodes ready at the start of frame.*/
+  for (i = 0; i < CAN_SIM_MAX_NODES; i++) {
+    np = &bp->nodes[i];
+    if ((np->pid == 0) || !np->posted || (np->busoff != 0) ||
+        (np->ready > start))
+      continue;
+    if ((winner == NULL) || (np->key < winner->key))
+      winner = np;
+  }
+
+  bfp = &bp->history[bp->wr & (CAN_SIM_HISTORY_SIZE - 1)];
+  bfp->src   = (uint32_t)(winner - bp->nodes);
+  bfp->frame = winner->frame;
+  bits = canSimGetFrameBits(&winner->frame);
+  if ((winner->error_rate > 0) && (rng() % 1000000 < winner->error_rate)) {
+    /* The error is detected in a random position of the frame, then the
+       error frame follows.*/
+    end = start + bit_time(bp, rng() % (bits - FRAME_TAIL_BITS) + 1 +
+                               CAN_SIM_ERROR_FRAME_BITS);
+    bfp->error = TRUE;
+    winner->tec += 8;
+    if (winner->tec > 255)
+      winner->busoff = end + bit_time(bp, BUSOFF_BITS);
+    for (i = 0; i < CAN_SIM_MAX_NODES; i++) {
+      np = &bp->nodes[i];
+      if ((np != winner) && (np->pid != 0) && (np->busoff == 0) &&
+          (np->rec < 255))
+        np->rec++;
+    }
+    bp->errors++;
+  }
+  else {
+    end = start + bit_time(bp, bits);
+    bfp->error = FALSE;
+    winner->posted = FALSE;
+    winner->done[winner->mbx - 1] = end;
+    if (winner->tec > 0)
+      winner->tec--;
+    for (i = 0; i < CAN_SIM_MAX_NODES; i++) {
+      np = &bp->nodes[i];
+      if ((np != winner) && (np->pid != 0) && (np->rec > 0))
+        np->rec--;
+    }
+    bp->frames++;
+  }
+  bfp->end = end;
+  bp->wr++;
+  bp->busy += end - start;
+  bp->idle  = end;
+  return TRUE;
+}
+
+/**
+ * @brief   Receives a frame from the bus.
+ *
+ * @param[in] canp      pointer to the receiving @p CANDriver object
+ * @param[in] ctfp      pointer to the frame on the bus
+ */
+static void rx_frame(CANDriver *canp, const CANTxFrame *ctfp) {
+  CANRxFrame crf;
+
+  memset(&crf, 0, sizeof crf);
+  crf.DLC = ctfp->DLC;
+  crf.RTR = ctfp->RTR;
+  crf.IDE = ctfp->IDE;
+  if (ctfp->IDE)
+    crf.EID = ctfp->EID;
+  else
+    crf.SID = ctfp->SID;
+  crf.data32[0] = ctfp->data32[0];
+  crf.data32[1] = ctfp->data32[1];
+  canp->rxframes++;
+
+#if CAN_USE_RX_FIFO
+  chSysLockFromIsr();
+  canRxIncomingI(canp, &crf);
+  chSysUnlockFromIsr();
+#else /* !CAN_USE_RX_FIFO */
+  if (canp->rxcnt >= CAN_SIM_RX_DEPTH) {
+    canp->rxlost++;
+    chSysLockFromIsr();
+    chEvtBroadcastFlagsI(&canp->error_event, CAN_OVERFLOW_ERROR);
+    chSysUnlockFromIsr();
+    return;
+  }
+  canp->rxmb[(canp->rxfirst + canp->rxcnt) % CAN_SIM_RX_DEPTH] = crf;
+  canp->rxcnt++;
+  if (canp->rxie) {
+    /* No more receive events until the queue has been emptied.*/
+    canp->rxie = FALSE;
+    chSysLockFromIsr();
+    while (chSemGetCounterI(&canp->rxsem) < 0)
+      chSemSignalI(&canp->rxsem);
+    chEvtBroadcastFlagsI(&canp->rxfull_event, CAN_MAILBOX_TO_MASK(1));
+    chSysUnlockFromIsr();
+  }
+#endif /* !CAN_USE_RX_FIFO */
+}
+
+/**
+ * @brief   Serves the interrupts of a local node.
+ * @details The transmitted mailboxes are released, then the frames ended
+ *          on the bus are received. The error counters are updated and
+ *          changes of the error state are broadcasted.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] now       current host time
+ * @return              @p TRUE if an interrupt has been served.
+ */
+static bool_t node_serve(CANDriver *canp, uint64_t now) {
+  CANSimBus *bp = canp->bus;
+  bus_node_t *np = &bp->nodes[canp->slot];
+  flagsmask_t errors = 0, state;
+  uint32_t done = 0;
+  canmbx_t mbx;
+
+  /* Transmitted frames.*/
+  for (mbx = 1; mbx <= CAN_TX_MAILBOXES; mbx++) {
+    uint64_t t = np->done[mbx - 1];
+
+    if ((t == 0) || (t > now))
+      continue;
+    np->done[mbx - 1] = 0;
+    canp->txpending &= ~CAN_MAILBOX_TO_MASK(mbx);
+    done |= CAN_MAILBOX_TO_MASK(mbx);
+    canp->txframes++;
+    t -= canp->txtime[mbx - 1];
+    canp->txlat_total += t;
+    if (t > canp->txlat_worst)
+      canp->txlat_worst = t;
+  }
+
+  /* Frames ended on the bus, the oldest ones are lost if the node has
+     been left behind.*/
+  if (bp->wr - canp->busrd > CAN_SIM_HISTORY_SIZE) {
+    canp->rxlost += bp->wr - canp->busrd - CAN_SIM_HISTORY_SIZE;
+    canp->busrd = bp->wr - CAN_SIM_HISTORY_SIZE;
+  }
+  while (canp->busrd != bp->wr) {
+    bus_frame_t *bfp = &bp->history[canp->busrd & (CAN_SIM_HISTORY_SIZE - 1)];
+
+    if (bfp->end > now)
+      break;
+    canp->busrd++;
+    if (bfp->error) {
+      canp->errors++;
+      errors |= CAN_FRAMING_ERROR;
+      continue;
+    }
+    if ((bfp->src == canp->slot) && !canp->config->loopback)
+      continue;
+#if CAN_USE_SLEEP_MODE
+    /* Bus activity wakes up the node, the frame is lost.*/
+    if (canp->state == CAN_SLEEP) {
+      canp->state = CAN_READY;
+      chSysLockFromIsr();
+      chEvtBroadcastI(&canp->wakeup_event);
+      chSysUnlockFromIsr();
+      continue;
+    }
+#endif /* CAN_USE_SLEEP_MODE */
+    rx_frame(canp, &bfp->frame);
+  }
+
+  if (done != 0) {
+    chSysLockFromIsr();
+    while (chSemGetCounterI(&canp->txsem) < 0)
+      chSemSignalI(&canp->txsem);
+    chEvtBroadcastFlagsI(&canp->txempty_event, (flagsmask_t)done);
+    chSysUnlockFromIsr();
+  }
+
+  /* Error state, the counters are reported in the upper half word of the
+     flags, TEC in bits 16-23 and REC in bits 24-31.*/
+  canp->tec = np->tec;
+  canp->rec = np->rec;
+  state = 0;
+  if (np->busoff != 0)
+    state |= CAN_BUS_OFF_ERROR;
+  if ((np->tec >= 128) || (np->rec >= 128))
+    state |= CAN_LIMIT_ERROR;
+  if ((np->tec >= 96) || (np->rec >= 96))
+    state |= CAN_LIMIT_WARNING;
+  if ((errors != 0) || ((state & ~canp->errstate) != 0)) {
+    chSysLockFromIsr();
+    chEvtBroadcastFlagsI(&canp->error_event,
+                         errors | state |
+                         ((flagsmask_t)(np->tec > 255 ? 255 : np->tec) << 16) |
+                         ((flagsmask_t)np->rec << 24));
+    chSysUnlockFromIsr();
+  }
+  canp->errstate = state;
+
+  return (done != 0) || (errors != 0);
+}
+
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level CAN driver initialization.
+ *
+ * @notapi
+ */
+void can_lld_init(void) {
+  unsigned i;
+
+  for (i = 0; i < NUM_NODES; i++) {
+    canObjectInit(nodes[i]);
+    nodes[i]->bus         = NULL;
+    nodes[i]->txpending   = 0;
+    nodes[i]->rxcnt       = 0;
+    nodes[i]->txframes    = 0;
+    nodes[i]->rxframes    = 0;
+    nodes[i]->rxlost      = 0;
+    nodes[i]->errors      = 0;
+    nodes[i]->txlat_worst = 0;
+    nodes[i]->txlat_total = 0;
+  }
+}
+
+/**
+ * @brief   Configures and activates the CAN peripheral.
+ * @details The node is attached to its bus.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ *
+ * @notapi
+ */
+void can_lld_start(CANDriver *canp) {
+  CANSimBus *bp = bus_map(canp->config->bus);
+  int32_t pid = (int32_t)getpid();
+  bool_t alone = TRUE;
+  unsigned i, slot = CAN_SIM_MAX_NODES;
+
+  bus_lock(bp);
+  for (i = 0; i < CAN_SIM_MAX_NODES; i++) {
+    bus_node_t *np = &bp->nodes[i];
+
+    /* Slots of terminated processes are reclaimed.*/
+    if ((np->pid != 0) && (np->pid != pid) &&
+        (kill(np->pid, 0) < 0) && (errno == ESRCH))
+      np->pid = 0;
+    if (np->pid != 0)
+      alone = FALSE;
+    else if (slot == CAN_SIM_MAX_NODES)
+      slot = i;
+  }
+  if (slot == CAN_SIM_MAX_NODES) {
+    bus_unlock(bp);
+    printf("CAN: Too many nodes on the bus\n");
+    exit(1);
+  }
+  if (alone || (bp->bitrate == 0))
+    bp->bitrate = canp->config->bitrate;
+  chDbgAssert(bp->bitrate == canp->config->bitrate,
+              "can_lld_start(), #1", "bit rate mismatch");
+  memset(&bp->nodes[slot], 0, sizeof bp->nodes[slot]);
+  bp->nodes[slot].error_rate = canp->config->error_rate;
+  bp->nodes[slot].pid        = pid;
+  canp->busrd = bp->wr;
+  bus_unlock(bp);
+
+  canp->bus       = bp;
+  canp->slot      = slot;
+  canp->txpending = 0;
+  canp->rxfirst   = 0;
+  canp->rxcnt     = 0;
+  canp->rxie      = TRUE;
+  canp->tec       = 0;
+  canp->rec       = 0;
+  canp->errstate  = 0;
+}
+
+/**
+ * @brief   Deactivates the CAN peripheral.
+ * @details The node is detached from its bus, the frames not yet
+ *          transmitted are discarded.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ *
+ * @notapi
+ */
+void can_lld_stop(CANDriver *canp) {
+
+  if (canp->bus != NULL) {
+    bus_lock(canp->bus);
+    canp->bus->nodes[canp->slot].pid    = 0;
+    canp->bus->nodes[canp->slot].posted = FALSE;
+    bus_unlock(canp->bus);
+    canp->bus = NULL;
+  }
+  canp->txpending = 0;
+  canp->rxcnt     = 0;
+}
+
+/**
+ * @brief   Determines whether a frame can be transmitted.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] mailbox   mailbox number, @p CAN_ANY_MAILBOX for any mailbox
+ *
+ * @return              The queue space availability.
+ * @retval FALSE        no space in the transmit queue.
+ * @retval TRUE         transmit slot available.
+ *
+ * @notapi
+ */
+bool_t can_lld_is_tx_empty(CANDriver *canp, canmbx_t mailbox) {
+
+  if (mailbox == CAN_ANY_MAILBOX)
+    return canp->txpending != (1U << CAN_TX_MAILBOXES) - 1;
+  return (canp->txpending & CAN_MAILBOX_TO_MASK(mailbox)) == 0;
+}
+
+/**
+ * @brief   Inserts a frame into the transmit queue.
+ * @details The frame contends the bus from the next simulated interrupt.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] ctfp      pointer to the CAN frame to be transmitted
+ * @param[in] mailbox   mailbox number,  @p CAN_ANY_MAILBOX for any mailbox
+ *
+ * @notapi
+ */
+void can_lld_transmit(CANDriver *canp,
+                      canmbx_t mailbox,
+                      const CANTxFrame *ctfp) {
+
+  if (mailbox == CAN_ANY_MAILBOX) {
+    mailbox = 1;
+    while ((canp->txpending & CAN_MAILBOX_TO_MASK(mailbox)) != 0)
+      mailbox++;
+  }
+  canp->txmb[mailbox - 1]   = *ctfp;
+  canp->txtime[mailbox - 1] = now_ns();
+  canp->txpending |= CAN_MAILBOX_TO_MASK(mailbox);
+}
+
+/**
+ * @brief   Determines whether a frame has been received.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] mailbox   mailbox number, @p CAN_ANY_MAILBOX for any mailbox
+ *
+ * @return              The queue status.
+ * @retval FALSE        the receive queue is empty.
+ * @retval TRUE         a frame is available.
+ *
+ * @notapi
+ */
+bool_t can_lld_is_rx_nonempty(CANDriver *canp, canmbx_t mailbox) {
+
+  (void)mailbox;
+  return canp->rxcnt > 0;
+}
+
+/**
+ * @brief   Receives a frame from the input queue.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] mailbox   mailbox number, @p CAN_ANY_MAILBOX for any mailbox
+ * @param[out] crfp     pointer to the buffer where the CAN frame is copied
+ *
+ * @notapi
+ */
+void can_lld_receive(CANDriver *canp,
+                     canmbx_t mailbox,
+                     CANRxFrame *crfp) {
+
+  (void)mailbox;
+  if (canp->rxcnt == 0)
+    return;
+  *crfp = canp->rxmb[canp->rxfirst];
+  canp->rxfirst = (canp->rxfirst + 1) % CAN_SIM_RX_DEPTH;
+
+  /* If the queue is empty re-enables the interrupt in order to generate
+     events again.*/
+  if (--canp->rxcnt == 0)
+    canp->rxie = TRUE;
+}
+
+#if CAN_USE_SLEEP_MODE || defined(__DOXYGEN__)
+/**
+ * @brief   Enters the sleep mode.
+ * @details A sleeping node is woken up by the next frame on the bus.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ *
+ * @notapi
+ */
+void can_lld_sleep(CANDriver *canp) {
+
+  (void)canp;
+}
+
+/**
+ * @brief   Enforces leaving the sleep mode.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ *
+ * @notapi
+ */
+void can_lld_wakeup(CANDriver *canp) {
+
+  (void)canp;
+}
+#endif /* CAN_USE_SLEEP_MODE */
+
+/**
+ * @brief   CAN bus simulated interrupt source.
+ * @details The frames of the local nodes contend their buses, the
+ *          arbitration rounds are executed up to the current time, then
+ *          the interrupts of the local nodes are served.
+ *
+ * @return              @p TRUE if an interrupt has been served.
+ *
+ * @notapi
+ */
+bool_t can_lld_interrupt_pending(void) {
+  bool_t served = FALSE;
+  uint64_t now;
+  unsigned i, j;
+
+  for (i = 0; i < NUM_NODES; i++) {
+    if (nodes[i]->bus != NULL)
+      break;
+  }
+  if (i == NUM_NODES)
+    return FALSE;
+
+  now = now_ns();
+  for (i = 0; i < NUM_NODES; i++) {
+    CANSimBus *bp = nodes[i]->bus;
+
+    /* Each bus is processed once, with the first local node on it.*/
+    if (bp == NULL)
+      continue;
+    for (j = 0; j < i; j++) {
+      if (nodes[j]->bus == bp)
+        break;
+    }
+    if (j < i)
+      continue;
+
+    bus_lock(bp);
+    do {
+      for (j = i; j < NUM_NODES; j++) {
+        if (nodes[j]->bus == bp)
+          node_post(nodes[j]);
+      }
+    } while (bus_round(bp, now));
+
+    CH_IRQ_PROLOGUE();
+
+    for (j = i; j < NUM_NODES; j++) {
+      if ((nodes[j]->bus == bp) && (nodes[j]->state != CAN_STOP))
+        served |= node_serve(nodes[j], now);
+    }
+
+    CH_IRQ_EPILOGUE();
+
+    bus_unlock(bp);
+  }
+  return served;
+}
+
+/**
+ * @brief   Length of a frame on the bus.
+ * @details The length includes the stuff bits, the end of frame and the
+ *          intermission.
+ *
+ * @param[in] ctfp      pointer to the frame
+ * @return              The number of bits.
+ */
+uint32_t canSimGetFrameBits(const CANTxFrame *ctfp) {
+  uint8_t bits[128];
+  uint32_t n = 0, i, len, crc = 0, stuff = 0, run = 1;
+  uint8_t last;
+
+  /* SOF, arbitration and control fields. In an extended frame the SRR
+     and IDE bits are recessive, in a standard frame IDE and r0 are
+     dominant.*/
+  n = put_bits(bits, n, 0, 1);
+  if (ctfp->IDE) {
+    n = put_bits(bits, n, ctfp->EID >> 18, 11);
+    n = put_bits(bits, n, 3, 2);
+    n = put_bits(bits, n, ctfp->EID & 0x3FFFF, 18);
+    n = put_bits(bits, n, ctfp->RTR, 1);
+    n = put_bits(bits, n, 0, 2);
+  }
+  else {
+    n = put_bits(bits, n, ctfp->SID, 11);
+    n = put_bits(bits, n, ctfp->RTR, 1);
+    n = put_bits(bits, n, 0, 2);
+  }
+  n = put_bits(bits, n, ctfp->DLC, 4);
+  len = ctfp->RTR ? 0 : (ctfp->DLC > 8 ? 8 : ctfp->DLC);
+  for (i = 0; i < len; i++)
+    n = put_bits(bits, n, ctfp->data8[i], 8);
+
+  /* CRC-15 of the previous fields.*/
+  for (i = 0; i < n; i++) {
+    uint32_t nxt = bits[i] ^ ((crc >> 14) & 1);
+
+    crc = (crc << 1) & 0x7FFF;
+    if (nxt)
+      crc ^= 0x4599;
+  }
+  n = put_bits(bits, n, crc, 15);
+
+  /* A stuff bit follows each sequence of five equal bits.*/
+  last = bits[0];
+  for (i = 1; i < n; i++) {
+    if (bits[i] == last)
+      run++;
+    else {
+      last = bits[i];
+      run  = 1;
+    }
+    if (run == 5) {
+      stuff++;
+      last ^= 1;
+      run   = 1;
+    }
+  }
+  return n + stuff + FRAME_TAIL_BITS;
+}
+
+/**
+ * @brief   Returns the statistics of the bus of a node.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[out] bsp      pointer to the @p CANSimBusStats object
+ */
+void canSimGetBusStats(CANDriver *canp, CANSimBusStats *bsp) {
+  CANSimBus *bp = canp->bus;
+
+  chDbgCheck((canp != NULL) && (bp != NULL) && (bsp != NULL),
+             "canSimGetBusStats");
+
+  bus_lock(bp);
+  bsp->frames  = bp->frames;
+  bsp->errors  = bp->errors;
+  bsp->busy    = bp->busy;
+  bsp->elapsed = now_ns() - bp->start;
+  bus_unlock(bp);
+  bsp->load = bsp->elapsed > 0 ?
+              (uint32_t)(bsp->busy * 1000 / bsp->elapsed) : 0;
+}
+
+/**
+ * @brief   Resets the statistics of a node and of its bus.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ */
+void canSimResetStats(CANDriver *canp) {
+  CANSimBus *bp = canp->bus;
+
+  chDbgCheck((canp != NULL) && (bp != NULL), "canSimResetStats");
+
+  bus_lock(bp);
+  bp->frames = 0;
+  bp->errors = 0;
+  bp->busy   = 0;
+  bp->start  = now_ns();
+  bus_unlock(bp);
+  canp->txframes    = 0;
+  canp->rxframes    = 0;
+  canp->rxlost      = 0;
+  canp->errors      = 0;
+  canp->txlat_worst = 0;
+  canp->txlat_total = 0;
+}
+
+#endif /* HAL_USE_CAN */
+
+/** @} */
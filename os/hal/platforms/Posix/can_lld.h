@@ -0,0 +1,445 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/can_lld.h
+ * @brief   Posix simulated CAN Driver subsystem low level driver header.
+ * @details Each driver is a node attached to a simulated bus, a bus is
+ *          either private to the simulator process or a shared memory
+ *          object visible to other simulator processes. The bus models
+ *          the bit timing of the frames, including the stuff bits, the
+ *          identifier based arbitration and the error frames, the frames
+ *          are delivered from the simulated interrupt source at the end
+ *          of their modelled transmission time.
+ *
+ * @addtogroup POSIX_CAN
+ * @{
+ */
+
+#ifndef _CAN_LLD_H_
+#define _CAN_LLD_H_
+
+#if HAL_USE_CAN || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   This switch defines whether the driver implementation supports
+ *          a low power switch mode with automatic an wakeup feature.
+ */
+#define CAN_SUPPORTS_SLEEP          TRUE
+
+/**
+ * @brief   This implementation supports three transmit mailboxes.
+ */
+#define CAN_TX_MAILBOXES            3
+
+/**
+ * @brief   This implementation supports one receive mailbox.
+ */
+#define CAN_RX_MAILBOXES            1
+
+/**
+ * @brief   Depth of the hardware receive queue.
+ */
+#define CAN_SIM_RX_DEPTH            3
+
+/**
+ * @brief   Length in bits of an error frame, delimiter and intermission.
+ */
+#define CAN_SIM_ERROR_FRAME_BITS    17
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Configuration options
+ * @{
+ */
+/**
+ * @brief   CAN1 driver enable switch.
+ * @details If set to @p TRUE the support for CAND1 is included.
+ * @note    The default is @p TRUE.
+ */
+#if !defined(USE_SIM_CAN1) || defined(__DOXYGEN__)
+#define USE_SIM_CAN1                        TRUE
+#endif
+
+/**
+ * @brief   CAN2 driver enable switch.
+ * @details If set to @p TRUE the support for CAND2 is included.
+ * @note    The default is @p TRUE.
+ */
+#if !defined(USE_SIM_CAN2) || defined(__DOXYGEN__)
+#define USE_SIM_CAN2                        TRUE
+#endif
+
+/**
+ * @brief   Maximum number of nodes on a bus, across all the processes.
+ */
+#if !defined(CAN_SIM_MAX_NODES) || defined(__DOXYGEN__)
+#define CAN_SIM_MAX_NODES                   16
+#endif
+
+/**
+ * @brief   Number of frames kept on a bus for the receiving nodes.
+ * @details A node polling the bus less often than the time required to
+ *          transmit this number of frames loses frames.
+ * @note    The value must be a power of two.
+ */
+#if !defined(CAN_SIM_HISTORY_SIZE) || defined(__DOXYGEN__)
+#define CAN_SIM_HISTORY_SIZE                1024
+#endif
+
+/**
+ * @brief   Maximum number of shared memory buses per process.
+ */
+#if !defined(CAN_SIM_MAX_BUSES) || defined(__DOXYGEN__)
+#define CAN_SIM_MAX_BUSES                   4
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !USE_SIM_CAN1 && !USE_SIM_CAN2
+#error "CAN driver activated but no CAN peripheral assigned"
+#endif
+
+#if CAN_USE_SLEEP_MODE && !CAN_SUPPORTS_SLEEP
+#error "CAN sleep mode not supported in this architecture"
+#endif
+
+#if (CAN_SIM_HISTORY_SIZE & (CAN_SIM_HISTORY_SIZE - 1)) != 0
+#error "CAN_SIM_HISTORY_SIZE must be a power of two"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a transmission mailbox index.
+ */
+typedef uint32_t canmbx_t;
+
+/**
+ * @brief   CAN transmission frame.
+ * @note    Accessing the frame data as word16 or word32 is not portable because
+ *          machine data endianness, it can be still useful for a quick filling.
+ */
+typedef struct {
+  struct {
+    uint8_t                 DLC:4;          /**< @brief Data length.        */
+    uint8_t                 RTR:1;          /**< @brief Frame type.         */
+    uint8_t                 IDE:1;          /**< @brief Identifier type.    */
+  };
+  union {
+    struct {
+      uint32_t              SID:11;         /**< @brief Standard identifier.*/
+    };
+    struct {
+      uint32_t              EID:29;         /**< @brief Extended identifier.*/
+    };
+  };
+  union {
+    uint8_t                 data8[8];       /**< @brief Frame data.         */
+    uint16_t                data16[4];      /**< @brief Frame data.         */
+    uint32_t                data32[2];      /**< @brief Frame data.         */
+  };
+} CANTxFrame;
+
+/**
+ * @brief   CAN received frame.
+ * @note    Accessing the frame data as word16 or word32 is not portable because
+ *          machine data endianness, it can be still useful for a quick filling.
+ */
+typedef struct {
+  struct {
+    uint8_t                 DLC:4;          /**< @brief Data length.        */
+    uint8_t                 RTR:1;          /**< @brief Frame type.         */
+    uint8_t                 IDE:1;          /**< @brief Identifier type.    */
+  };
+  union {
+    struct {
+      uint32_t              SID:11;         /**< @brief Standard identifier.*/
+    };
+    struct {
+      uint32_t              EID:29;         /**< @brief Extended identifier.*/
+    };
+  };
+  union {
+    uint8_t                 data8[8];       /**< @brief Frame data.         */
+    uint16_t                data16[4];      /**< @brief Frame data.         */
+    uint32_t                data32[2];      /**< @brief Frame data.         */
+  };
+} CANRxFrame;
+
+/**
+ * @brief   Type of a simulated bus.
+ */
+typedef struct CANSimBus CANSimBus;
+
+/**
+ * @brief   Bus statistics.
+ */
+typedef struct {
+  /**
+   * @brief   Frames successfully transmitted.
+   */
+  uint32_t                  frames;
+  /**
+   * @brief   Error frames.
+   */
+  uint32_t                  errors;
+  /**
+   * @brief   Bus busy time in nanoseconds.
+   */
+  uint64_t                  busy;
+  /**
+   * @brief   Observation time in nanoseconds.
+   */
+  uint64_t                  elapsed;
+  /**
+   * @brief   Bus load in permille.
+   */
+  uint32_t                  load;
+} CANSimBusStats;
+
+/**
+ * @brief   Driver configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief   Bit rate in bits per second.
+   * @note    All the nodes of a bus must use the same bit rate, the rate
+   *          of the first node attached to the bus is used.
+   */
+  uint32_t                  bitrate;
+  /**
+   * @brief   Loopback mode, the node also receives its own frames.
+   */
+  bool_t                    loopback;
+  /**
+   * @brief   Name of the shared memory bus, @p NULL for the bus private to
+   *          the simulator process.
+   * @note    The shared memory object is not removed when the processes
+   *          terminate, see @p shm_unlink().
+   */
+  const char                *bus;
+  /**
+   * @brief   Probability of an error frame during the transmission of a
+   *          frame from this node, in frames per million.
+   */
+  uint32_t                  error_rate;
+} CANConfig;
+
+/**
+ * @brief   Structure representing an CAN driver.
+ */
+typedef struct {
+  /**
+   * @brief   Driver state.
+   */
+  canstate_t                state;
+  /**
+   * @brief   Current configuration data.
+   */
+  const CANConfig           *config;
+  /**
+   * @brief   Transmission queue semaphore.
+   */
+  Semaphore                 txsem;
+  /**
+   * @brief   Receive queue semaphore.
+   */
+  Semaphore                 rxsem;
+  /**
+   * @brief   One or more frames become available.
+   * @note    After broadcasting this event it will not be broadcasted again
+   *          until the received frames queue has been completely emptied. It
+   *          is <b>not</b> broadcasted for each received frame. It is
+   *          responsibility of the application to empty the queue by
+   *          repeatedly invoking @p chReceive() when listening to this event.
+   *          This behavior minimizes the interrupt served by the system
+   *          because CAN traffic.
+   * @note    The flags associated to the listeners will indicate which
+   *          receive mailboxes become non-empty.
+   */
+  EventSource               rxfull_event;
+  /**
+   * @brief   One or more transmission mailbox become available.
+   * @note    The flags associated to the listeners will indicate which
+   *          transmit mailboxes become empty.
+   *
+   */
+  EventSource               txempty_event;
+  /**
+   * @brief   A CAN bus error happened.
+   * @note    The flags associated to the listeners will indicate the
+   *          error(s) that have occurred.
+   */
+  EventSource               error_event;
+#if CAN_USE_SLEEP_MODE || defined (__DOXYGEN__)
+  /**
+   * @brief   Entering sleep state event.
+   */
+  EventSource               sleep_event;
+  /**
+   * @brief   Exiting sleep state event.
+   */
+  EventSource               wakeup_event;
+#endif /* CAN_USE_SLEEP_MODE */
+  /* Software receive FIFO, empty if CAN_USE_RX_FIFO is disabled.*/
+  _can_driver_rx_data
+  /* End of the mandatory fields.*/
+  /**
+   * @brief   Bus the node is attached to, @p NULL if stopped.
+   */
+  CANSimBus                 *bus;
+  /**
+   * @brief   Node slot on the bus.
+   */
+  unsigned                  slot;
+  /**
+   * @brief   Transmit mailboxes.
+   */
+  CANTxFrame                txmb[CAN_TX_MAILBOXES];
+  /**
+   * @brief   Host time of the transmit requests, in nanoseconds.
+   */
+  uint64_t                  txtime[CAN_TX_MAILBOXES];
+  /**
+   * @brief   Mask of the transmit mailboxes not yet transmitted.
+   */
+  uint32_t                  txpending;
+  /**
+   * @brief   Next bus frame to be received.
+   */
+  uint32_t                  busrd;
+  /**
+   * @brief   Hardware receive queue.
+   */
+  CANRxFrame                rxmb[CAN_SIM_RX_DEPTH];
+  /**
+   * @brief   Index of the oldest frame in the hardware receive queue.
+   */
+  unsigned                  rxfirst;
+  /**
+   * @brief   Number of frames in the hardware receive queue.
+   */
+  unsigned                  rxcnt;
+  /**
+   * @brief   Receive interrupt enabled.
+   */
+  bool_t                    rxie;
+  /**
+   * @brief   Number of frames transmitted on the bus.
+   */
+  uint32_t                  txframes;
+  /**
+   * @brief   Number of frames received from the bus.
+   */
+  uint32_t                  rxframes;
+  /**
+   * @brief   Number of frames lost because the hardware queue was full or
+   *          because the bus was not polled in time.
+   */
+  uint32_t                  rxlost;
+  /**
+   * @brief   Number of error frames seen on the bus.
+   */
+  uint32_t                  errors;
+  /**
+   * @brief   Transmit error counter.
+   */
+  uint32_t                  tec;
+  /**
+   * @brief   Receive error counter.
+   */
+  uint32_t                  rec;
+  /**
+   * @brief   Error state flags last broadcasted.
+   */
+  flagsmask_t               errstate;
+  /**
+   * @brief   Transmit latency, from request to end of frame, worst case in
+   *          nanoseconds.
+   */
+  uint64_t                  txlat_worst;
+  /**
+   * @brief   Transmit latency, accumulated in nanoseconds.
+   */
+  uint64_t                  txlat_total;
+} CANDriver;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if USE_SIM_CAN1 && !defined(__DOXYGEN__)
+extern CANDriver CAND1;
+#endif
+
+#if USE_SIM_CAN2 && !defined(__DOXYGEN__)
+extern CANDriver CAND2;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void can_lld_init(void);
+  void can_lld_start(CANDriver *canp);
+  void can_lld_stop(CANDriver *canp);
+  bool_t can_lld_is_tx_empty(CANDriver *canp,
+                             canmbx_t mailbox);
+  void can_lld_transmit(CANDriver *canp,
+                        canmbx_t mailbox,
+                        const CANTxFrame *crfp);
+  bool_t can_lld_is_rx_nonempty(CANDriver *canp,
+                                canmbx_t mailbox);
+  void can_lld_receive(CANDriver *canp,
+                       canmbx_t mailbox,
+                       CANRxFrame *ctfp);
+#if CAN_USE_SLEEP_MODE
+  void can_lld_sleep(CANDriver *canp);
+  void can_lld_wakeup(CANDriver *canp);
+#endif /* CAN_USE_SLEEP_MODE */
+  bool_t can_lld_interrupt_pending(void);
+  uint32_t canSimGetFrameBits(const CANTxFrame *ctfp);
+  void canSimGetBusStats(CANDriver *canp, CANSimBusStats *bsp);
+  void canSimResetStats(CANDriver *canp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_CAN */
+
+#endif /* _CAN_LLD_H_ */
+
+/** @} */
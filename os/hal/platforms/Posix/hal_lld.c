@@ -86,6 +86,49 @@ void ChkIntSources(void) {
   }
 #endif
 
+#if HAL_USE_SPI
+  if (spi_lld_interrupt_pending()) {
+    dbg_check_lock();
+    if (chSchIsPreemptionRequired())
+      chSchDoReschedule();
+    dbg_check_unlock();
+    return;
+  }
+#endif
+
+#if HAL_USE_ADC
+  /* Conversions do not return immediately so that a continuously active
+     converter cannot starve the system tick.*/
+  if (adc_lld_interrupt_pending()) {
+    dbg_check_lock();
+    if (chSchIsPreemptionRequired())
+      chSchDoReschedule();
+    dbg_check_unlock();
+  }
+#endif
+
+#if HAL_USE_CAN
+  /* Bus activity does not return immediately so that a continuously busy
+     bus cannot starve the system tick.*/
+  if (can_lld_interrupt_pending()) {
+    dbg_check_lock();
+    if (chSchIsPreemptionRequired())
+      chSchDoReschedule();
+    dbg_check_unlock();
+  }
+#endif
+
+#if HAL_USE_USB
+  /* USB activity does not return immediately so that a continuously busy
+     bus cannot starve the system tick.*/
+  if (usb_lld_interrupt_pending()) {
+    dbg_check_lock();
+    if (chSchIsPreemptionRequired())
+      chSchDoReschedule();
+    dbg_check_unlock();
+  }
+#endif
+
   gettimeofday(&tv, NULL);
   if (timercmp(&tv, &nextcnt, >=)) {
     timeradd(&nextcnt, &tick, &nextcnt);
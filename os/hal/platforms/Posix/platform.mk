@@ -1,7 +1,11 @@
 # List of all the Posix platform files.
 PLATFORMSRC = ${CHIBIOS}/os/hal/platforms/Posix/hal_lld.c \
+              ${CHIBIOS}/os/hal/platforms/Posix/adc_lld.c \
+              ${CHIBIOS}/os/hal/platforms/Posix/can_lld.c \
               ${CHIBIOS}/os/hal/platforms/Posix/pal_lld.c \
-              ${CHIBIOS}/os/hal/platforms/Posix/serial_lld.c
+              ${CHIBIOS}/os/hal/platforms/Posix/serial_lld.c \
+              ${CHIBIOS}/os/hal/platforms/Posix/spi_lld.c \
+              ${CHIBIOS}/os/hal/platforms/Posix/usb_lld.c
 
 # Required include directories
 PLATFORMINC = ${CHIBIOS}/os/hal/platforms/Posix
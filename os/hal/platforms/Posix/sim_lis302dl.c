@@ -0,0 +1,208 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_lis302dl.c
+ * @brief   Simulated LIS302DL accelerometer code.
+ * @details The first byte of a transaction holds the read flag in bit 7,
+ *          the address auto increment flag in bit 6 and the register
+ *          address, the following bytes are data.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "sim_lis302dl.h"
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+#define REG_WHO_AM_I                0x0F
+#define REG_CTRL_REG1               0x20
+#define REG_CTRL_REG3               0x22
+#define REG_STATUS                  0x27
+#define REG_OUTX                    0x29
+#define REG_OUTY                    0x2B
+#define REG_OUTZ                    0x2D
+#define REG_FF_WU_CFG1              0x30
+#define REG_FF_WU_SRC1              0x31
+#define REG_FF_WU_SRC2              0x35
+#define REG_CLICK_SRC               0x39
+#define REG_CLICK_WINDOW            0x3F
+
+#define CTRL_REG1_DR                0x80
+#define CTRL_REG1_PD                0x40
+
+#define STATUS_ZYXDA                0x08
+#define STATUS_ZYXOR                0x80
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/*
+ * Updates the status register, a new sample is available at each output
+ * data rate period while powered.
+ */
+static void lis_update(SimLIS302DL *slp) {
+  struct timeval tv, period;
+
+  if (!(slp->regs[REG_CTRL_REG1] & CTRL_REG1_PD))
+    return;
+
+  gettimeofday(&tv, NULL);
+  if (timercmp(&tv, &slp->next_sample, <))
+    return;
+
+  /* 100Hz or 400Hz.*/
+  period.tv_sec  = 0;
+  period.tv_usec = slp->regs[REG_CTRL_REG1] & CTRL_REG1_DR ? 2500 : 10000;
+  timeradd(&tv, &period, &slp->next_sample);
+  if (slp->regs[REG_STATUS] & STATUS_ZYXDA)
+    slp->regs[REG_STATUS] |= STATUS_ZYXOR;
+  slp->regs[REG_STATUS] |= STATUS_ZYXDA;
+}
+
+static uint8_t lis_read(SimLIS302DL *slp, uint8_t addr) {
+  unsigned axis;
+
+  switch (addr) {
+  case REG_STATUS:
+    lis_update(slp);
+    return slp->regs[REG_STATUS];
+  case REG_OUTX:
+  case REG_OUTY:
+  case REG_OUTZ:
+    axis = (addr - REG_OUTX) / 2;
+    if (addr == REG_OUTZ)
+      slp->regs[REG_STATUS] = 0;
+    /* Axis enabled and device powered.*/
+    if ((slp->regs[REG_CTRL_REG1] & CTRL_REG1_PD) &&
+        (slp->regs[REG_CTRL_REG1] & (1 << axis)))
+      return (uint8_t)slp->accel[axis];
+    return 0;
+  default:
+    return slp->regs[addr];
+  }
+}
+
+static void lis_write(SimLIS302DL *slp, uint8_t addr, uint8_t value) {
+
+  /* Only the control and configuration registers are writable.*/
+  if (((addr >= REG_CTRL_REG1) && (addr <= REG_CTRL_REG3)) ||
+      ((addr >= REG_FF_WU_CFG1) && (addr <= REG_CLICK_WINDOW) &&
+       (addr != REG_FF_WU_SRC1) && (addr != REG_FF_WU_SRC2) &&
+       (addr != REG_CLICK_SRC)))
+    slp->regs[addr] = value;
+}
+
+static void lis_select(SPISimSlave *ssp) {
+
+  ((SimLIS302DL *)ssp)->cnt = 0;
+}
+
+static void lis_unselect(SPISimSlave *ssp) {
+
+  ((SimLIS302DL *)ssp)->cnt = 0;
+}
+
+static void lis_exchange(SPISimSlave *ssp, size_t n,
+                         const uint8_t *txbuf, uint8_t *rxbuf) {
+  SimLIS302DL *slp = (SimLIS302DL *)ssp;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    uint8_t in = txbuf != NULL ? txbuf[i] : 0xFF, out = 0xFF;
+
+    if (slp->cnt == 0) {
+      slp->read      = (in & 0x80) != 0;
+      slp->increment = (in & 0x40) != 0;
+      slp->addr      = in & 0x3F;
+    }
+    else {
+      if (slp->read)
+        out = lis_read(slp, slp->addr);
+      else
+        lis_write(slp, slp->addr, in);
+      if (slp->increment)
+        slp->addr = (slp->addr + 1) & 0x3F;
+    }
+    slp->cnt++;
+    if (rxbuf != NULL)
+      rxbuf[i] = out;
+  }
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes a simulated accelerometer.
+ * @details The device is powered down with all the axes enabled, as after
+ *          a physical power on.
+ *
+ * @param[out] slp      pointer to the @p SimLIS302DL object
+ */
+void simlisObjectInit(SimLIS302DL *slp) {
+
+  chDbgCheck(slp != NULL, "simlisObjectInit");
+
+  memset(slp, 0, sizeof *slp);
+  slp->slave.select         = lis_select;
+  slp->slave.unselect       = lis_unselect;
+  slp->slave.exchange       = lis_exchange;
+  slp->regs[REG_WHO_AM_I]   = SIMLIS_WHO_AM_I_VALUE;
+  slp->regs[REG_CTRL_REG1]  = 0x07;
+}
+
+/**
+ * @brief   Sets the simulated acceleration.
+ *
+ * @param[in] slp       pointer to the @p SimLIS302DL object
+ * @param[in] x         X axis acceleration, 18mg per digit
+ * @param[in] y         Y axis acceleration, 18mg per digit
+ * @param[in] z         Z axis acceleration, 18mg per digit
+ */
+void simlisSetAcceleration(SimLIS302DL *slp, int8_t x, int8_t y, int8_t z) {
+
+  chDbgCheck(slp != NULL, "simlisSetAcceleration");
+
+  chSysLock();
+  slp->accel[0] = x;
+  slp->accel[1] = y;
+  slp->accel[2] = z;
+  chSysUnlock();
+}
+
+#endif /* HAL_USE_SPI */
+
+/** @} */
@@ -0,0 +1,126 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_lis302dl.h
+ * @brief   Simulated LIS302DL accelerometer header.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#ifndef _SIM_LIS302DL_H_
+#define _SIM_LIS302DL_H_
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+#include <sys/time.h>
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Value of the WHO_AM_I register.
+ */
+#define SIMLIS_WHO_AM_I_VALUE           0x3B
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Structure representing a simulated LIS302DL.
+ * @details The outputs return the acceleration set by the application,
+ *          new data is signaled in the status register at the output data
+ *          rate selected in CTRL_REG1.
+ */
+typedef struct {
+  /**
+   * @brief Bus interface, must be the first field.
+   */
+  SPISimSlave           slave;
+  /**
+   * @brief Register file.
+   */
+  uint8_t               regs[0x40];
+  /**
+   * @brief Simulated acceleration, 18mg per digit.
+   */
+  int8_t                accel[3];
+  /**
+   * @brief Time of the next sample.
+   */
+  struct timeval        next_sample;
+  /**
+   * @brief Current register address.
+   */
+  uint8_t               addr;
+  /**
+   * @brief Current transaction is a read.
+   */
+  bool_t                read;
+  /**
+   * @brief Address auto increment enabled.
+   */
+  bool_t                increment;
+  /**
+   * @brief Number of bytes received since the chip select.
+   */
+  size_t                cnt;
+} SimLIS302DL;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the bus interface of an accelerometer.
+ *
+ * @param[in] slp       pointer to the @p SimLIS302DL object
+ */
+#define simlisGetSlave(slp) (&(slp)->slave)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void simlisObjectInit(SimLIS302DL *slp);
+  void simlisSetAcceleration(SimLIS302DL *slp, int8_t x, int8_t y, int8_t z);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_SPI */
+
+#endif /* _SIM_LIS302DL_H_ */
+
+/** @} */
@@ -0,0 +1,476 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_sdcard.c
+ * @brief   Simulated SD card in SPI mode code.
+ * @details The card model is connected to a simulated SPI bus, the
+ *          commands, data tokens and CRCs are processed as a physical card
+ *          would do, response and busy times are expressed in bytes.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "sim_sdcard.h"
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @name    R1 response bits
+ * @{
+ */
+#define R1_IDLE                     0x01
+#define R1_ILLEGAL_COMMAND          0x04
+#define R1_COM_CRC_ERROR            0x08
+#define R1_PARAMETER_ERROR          0x40
+/** @} */
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static uint8_t sd_crc7(const uint8_t *p, size_t n) {
+  uint8_t crc = 0;
+  unsigned i;
+
+  while (n-- > 0) {
+    uint8_t b = *p++;
+
+    for (i = 0; i < 8; i++) {
+      crc <<= 1;
+      if ((b ^ crc) & 0x80)
+        crc ^= 0x09;
+      b <<= 1;
+    }
+  }
+  return crc & 0x7F;
+}
+
+static uint16_t sd_crc16(const uint8_t *p, size_t n) {
+  uint16_t crc = 0;
+  unsigned i;
+
+  while (n-- > 0) {
+    crc ^= (uint16_t)*p++ << 8;
+    for (i = 0; i < 8; i++)
+      crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x1021) :
+                           (uint16_t)(crc << 1);
+  }
+  return crc;
+}
+
+static void sd_push(SimSDCard *scp, uint8_t b) {
+  unsigned next = (scp->out_wr + 1) % SIMSD_OUT_SIZE;
+
+  /* Overflows are not possible with the FIFO size, the bytes would be
+     lost.*/
+  if (next != scp->out_rd) {
+    scp->out[scp->out_wr] = b;
+    scp->out_wr = next;
+  }
+}
+
+static void sd_flush(SimSDCard *scp) {
+
+  scp->out_rd = scp->out_wr = 0;
+}
+
+static void sd_push_busy(SimSDCard *scp) {
+  unsigned i;
+
+  for (i = 0; i < SIMSD_BUSY_BYTES; i++)
+    sd_push(scp, 0x00);
+}
+
+/*
+ * Queues a data token followed by the data and its CRC, the access time is
+ * simulated with a few idle bytes.
+ */
+static void sd_push_data(SimSDCard *scp, const uint8_t *p, size_t n) {
+  uint16_t crc = sd_crc16(p, n);
+  unsigned i;
+
+  if (scp->corrupt) {
+    scp->corrupt = FALSE;
+    crc ^= 0x0001;
+  }
+  for (i = 0; i < SIMSD_ACCESS_BYTES; i++)
+    sd_push(scp, 0xFF);
+  sd_push(scp, 0xFE);
+  for (i = 0; i < n; i++)
+    sd_push(scp, p[i]);
+  sd_push(scp, (uint8_t)(crc >> 8));
+  sd_push(scp, (uint8_t)crc);
+}
+
+/*
+ * Queues the next block of a read transfer.
+ */
+static void sd_read_block(SimSDCard *scp) {
+  uint8_t buf[SIMSD_BLOCK_SIZE];
+
+  if (!scp->multi)
+    scp->phase = SIMSD_COMMAND;
+  if ((scp->blk >= scp->blk_num) ||
+      (pread(scp->fd, buf, SIMSD_BLOCK_SIZE,
+             (off_t)scp->blk * SIMSD_BLOCK_SIZE) != SIMSD_BLOCK_SIZE)) {
+    /* Error token, out of range.*/
+    sd_push(scp, 0xFF);
+    sd_push(scp, 0x08);
+    scp->phase = SIMSD_COMMAND;
+    return;
+  }
+  sd_push_data(scp, buf, SIMSD_BLOCK_SIZE);
+  scp->reads++;
+  scp->blk++;
+}
+
+static uint8_t sd_pop(SimSDCard *scp) {
+  uint8_t b;
+
+  if ((scp->out_rd == scp->out_wr) && (scp->phase == SIMSD_READING))
+    sd_read_block(scp);
+  if (scp->out_rd == scp->out_wr)
+    return 0xFF;
+  b = scp->out[scp->out_rd];
+  scp->out_rd = (scp->out_rd + 1) % SIMSD_OUT_SIZE;
+  return b;
+}
+
+/*
+ * Erases the blocks in the erase range.
+ */
+static void sd_erase(SimSDCard *scp) {
+  static const uint8_t zero[SIMSD_BLOCK_SIZE];
+  uint32_t blk;
+
+  for (blk = scp->erase_start;
+       (blk <= scp->erase_end) && (blk < scp->blk_num); blk++)
+    (void)pwrite(scp->fd, zero, SIMSD_BLOCK_SIZE,
+                 (off_t)blk * SIMSD_BLOCK_SIZE);
+}
+
+/*
+ * Executes a complete command.
+ */
+static void sd_command(SimSDCard *scp) {
+  uint8_t cmd = scp->cmd[0] & 0x3F;
+  uint32_t arg = ((uint32_t)scp->cmd[1] << 24) | ((uint32_t)scp->cmd[2] << 16) |
+                 ((uint32_t)scp->cmd[3] << 8) | (uint32_t)scp->cmd[4];
+  bool_t app = scp->app_cmd;
+  uint8_t r1 = scp->idle ? R1_IDLE : 0x00;
+  uint8_t reg[16];
+
+  scp->app_cmd = FALSE;
+
+  /* CMD0 and CMD8 are always checked.*/
+  if ((scp->crc_on || (cmd == 0) || (cmd == 8)) &&
+      (((sd_crc7(scp->cmd, 5) << 1) | 0x01) != scp->cmd[5])) {
+    scp->crc_errors++;
+    sd_push(scp, 0xFF);
+    sd_push(scp, r1 | R1_COM_CRC_ERROR);
+    return;
+  }
+
+  /* Command response time.*/
+  sd_push(scp, 0xFF);
+  if (app) {
+    if (cmd == 41) {
+      scp->idle = FALSE;
+      sd_push(scp, 0x00);
+    }
+    else
+      sd_push(scp, r1 | R1_ILLEGAL_COMMAND);
+    return;
+  }
+
+  switch (cmd) {
+  case 0:                                   /* GO_IDLE_STATE.               */
+    scp->idle = TRUE;
+    scp->crc_on = FALSE;
+    scp->phase = SIMSD_COMMAND;
+    sd_push(scp, R1_IDLE);
+    break;
+  case 1:                                   /* SEND_OP_COND.                */
+    scp->idle = FALSE;
+    sd_push(scp, 0x00);
+    break;
+  case 8:                                   /* SEND_IF_COND, R7.            */
+    sd_push(scp, r1);
+    sd_push(scp, 0x00);
+    sd_push(scp, 0x00);
+    sd_push(scp, (uint8_t)((arg >> 8) & 0x0F));
+    sd_push(scp, (uint8_t)arg);
+    break;
+  case 9:                                   /* SEND_CSD, version 2.0.       */
+    memset(reg, 0, sizeof reg);
+    reg[0] = 0x40;
+    reg[3] = 0x32;                          /* 25MHz.                       */
+    reg[5] = 0x59;                          /* 512 bytes blocks.            */
+    reg[7] = (uint8_t)(((scp->blk_num / 1024 - 1) >> 16) & 0x3F);
+    reg[8] = (uint8_t)((scp->blk_num / 1024 - 1) >> 8);
+    reg[9] = (uint8_t)(scp->blk_num / 1024 - 1);
+    reg[15] = (uint8_t)((sd_crc7(reg, 15) << 1) | 0x01);
+    sd_push(scp, r1);
+    sd_push_data(scp, reg, sizeof reg);
+    break;
+  case 10:                                  /* SEND_CID.                    */
+    memset(reg, 0, sizeof reg);
+    memcpy(&reg[1], "CHSIMSD", 7);
+    reg[15] = (uint8_t)((sd_crc7(reg, 15) << 1) | 0x01);
+    sd_push(scp, r1);
+    sd_push_data(scp, reg, sizeof reg);
+    break;
+  case 12:                                  /* STOP_TRANSMISSION.           */
+    sd_flush(scp);
+    scp->phase = SIMSD_COMMAND;
+    sd_push(scp, 0xFF);                     /* Stuff byte.                  */
+    sd_push(scp, 0xFF);
+    sd_push(scp, r1);
+    break;
+  case 13:                                  /* SEND_STATUS, R2.             */
+    sd_push(scp, r1);
+    sd_push(scp, 0x00);
+    break;
+  case 16:                                  /* SET_BLOCKLEN.                */
+    sd_push(scp, arg == SIMSD_BLOCK_SIZE ? r1 : r1 | R1_PARAMETER_ERROR);
+    break;
+  case 17:                                  /* READ_SINGLE_BLOCK.           */
+  case 18:                                  /* READ_MULTIPLE_BLOCK.         */
+    if (arg >= scp->blk_num) {
+      sd_push(scp, r1 | R1_PARAMETER_ERROR);
+      break;
+    }
+    sd_push(scp, r1);
+    scp->blk = arg;
+    scp->multi = cmd == 18;
+    scp->phase = SIMSD_READING;
+    break;
+  case 24:                                  /* WRITE_BLOCK.                 */
+  case 25:                                  /* WRITE_MULTIPLE_BLOCK.        */
+    if (arg >= scp->blk_num) {
+      sd_push(scp, r1 | R1_PARAMETER_ERROR);
+      break;
+    }
+    sd_push(scp, r1);
+    scp->blk = arg;
+    scp->multi = cmd == 25;
+    scp->phase = SIMSD_WRITE_TOKEN;
+    break;
+  case 32:                                  /* ERASE_WR_BLK_START.          */
+    scp->erase_start = arg;
+    sd_push(scp, r1);
+    break;
+  case 33:                                  /* ERASE_WR_BLK_END.            */
+    scp->erase_end = arg;
+    sd_push(scp, r1);
+    break;
+  case 38:                                  /* ERASE.                       */
+    sd_erase(scp);
+    sd_push(scp, r1);
+    sd_push_busy(scp);
+    break;
+  case 55:                                  /* APP_CMD.                     */
+    scp->app_cmd = TRUE;
+    sd_push(scp, r1);
+    break;
+  case 58:                                  /* READ_OCR, R3, CCS set.       */
+    sd_push(scp, r1);
+    sd_push(scp, 0xC0);
+    sd_push(scp, 0xFF);
+    sd_push(scp, 0x80);
+    sd_push(scp, 0x00);
+    break;
+  case 59:                                  /* CRC_ON_OFF.                  */
+    scp->crc_on = (arg & 1) != 0;
+    sd_push(scp, r1);
+    break;
+  default:
+    sd_push(scp, r1 | R1_ILLEGAL_COMMAND);
+  }
+}
+
+/*
+ * Stores a received data block and queues the data response.
+ */
+static void sd_write_block(SimSDCard *scp) {
+  uint16_t crc = ((uint16_t)scp->data[SIMSD_BLOCK_SIZE] << 8) |
+                 scp->data[SIMSD_BLOCK_SIZE + 1];
+
+  scp->phase = scp->multi ? SIMSD_WRITE_TOKEN : SIMSD_COMMAND;
+  if (scp->crc_on && (sd_crc16(scp->data, SIMSD_BLOCK_SIZE) != crc)) {
+    scp->crc_errors++;
+    sd_push(scp, 0x0B);                     /* Data rejected, CRC error.    */
+    return;
+  }
+  if ((scp->blk >= scp->blk_num) ||
+      (pwrite(scp->fd, scp->data, SIMSD_BLOCK_SIZE,
+              (off_t)scp->blk * SIMSD_BLOCK_SIZE) != SIMSD_BLOCK_SIZE)) {
+    sd_push(scp, 0x0D);                     /* Data rejected, write error.  */
+    return;
+  }
+  scp->writes++;
+  scp->blk++;
+  sd_push(scp, 0x05);                       /* Data accepted.               */
+  sd_push_busy(scp);
+}
+
+/*
+ * Processes a byte received from the master.
+ */
+static void sd_feed(SimSDCard *scp, uint8_t b) {
+
+  switch (scp->phase) {
+  case SIMSD_COMMAND:
+  case SIMSD_READING:
+    /* Commands are accepted also while streaming, for CMD12.*/
+    if ((scp->cmd_cnt == 0) && ((b & 0xC0) != 0x40))
+      break;
+    scp->cmd[scp->cmd_cnt++] = b;
+    if (scp->cmd_cnt >= sizeof scp->cmd) {
+      scp->cmd_cnt = 0;
+      sd_command(scp);
+    }
+    break;
+  case SIMSD_WRITE_TOKEN:
+    if (b == (scp->multi ? 0xFC : 0xFE)) {
+      scp->data_cnt = 0;
+      scp->phase = SIMSD_WRITE_DATA;
+    }
+    else if (scp->multi && (b == 0xFD)) {
+      /* Stop transmission token.*/
+      scp->phase = SIMSD_COMMAND;
+      sd_push(scp, 0xFF);
+      sd_push_busy(scp);
+    }
+    break;
+  case SIMSD_WRITE_DATA:
+    scp->data[scp->data_cnt++] = b;
+    if (scp->data_cnt >= sizeof scp->data)
+      sd_write_block(scp);
+    break;
+  }
+}
+
+static void sd_select(SPISimSlave *ssp) {
+
+  ((SimSDCard *)ssp)->selected = TRUE;
+}
+
+static void sd_unselect(SPISimSlave *ssp) {
+  SimSDCard *scp = (SimSDCard *)ssp;
+
+  /* The card releases the bus, the command decoder is resynchronized.*/
+  scp->selected = FALSE;
+  scp->cmd_cnt = 0;
+  sd_flush(scp);
+}
+
+static void sd_exchange(SPISimSlave *ssp, size_t n,
+                        const uint8_t *txbuf, uint8_t *rxbuf) {
+  SimSDCard *scp = (SimSDCard *)ssp;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    uint8_t b = 0xFF;
+
+    /* The byte sent by the card was prepared before the current byte is
+       clocked in.*/
+    if (scp->selected) {
+      b = sd_pop(scp);
+      sd_feed(scp, txbuf != NULL ? txbuf[i] : 0xFF);
+    }
+    if (rxbuf != NULL)
+      rxbuf[i] = b;
+  }
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Opens a simulated card.
+ * @details The image file is created if it does not exist and is resized
+ *          to the card size.
+ *
+ * @param[out] scp      pointer to the @p SimSDCard object
+ * @param[in] name      image file name
+ * @param[in] blk_num   card size in blocks, a multiple of 1024
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    the image file cannot be opened.
+ */
+bool_t simsdOpen(SimSDCard *scp, const char *name, uint32_t blk_num) {
+
+  chDbgCheck((scp != NULL) && (name != NULL) &&
+             (blk_num >= 1024) && (blk_num % 1024 == 0), "simsdOpen");
+
+  memset(scp, 0, sizeof *scp);
+  scp->slave.select   = sd_select;
+  scp->slave.unselect = sd_unselect;
+  scp->slave.exchange = sd_exchange;
+  scp->blk_num        = blk_num;
+  scp->idle           = TRUE;
+  scp->phase          = SIMSD_COMMAND;
+  scp->fd = open(name, O_RDWR | O_CREAT, 0644);
+  if (scp->fd < 0)
+    return CH_FAILED;
+  if (ftruncate(scp->fd, (off_t)blk_num * SIMSD_BLOCK_SIZE) < 0) {
+    close(scp->fd);
+    scp->fd = -1;
+    return CH_FAILED;
+  }
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Closes a simulated card.
+ *
+ * @param[in] scp       pointer to the @p SimSDCard object
+ */
+void simsdClose(SimSDCard *scp) {
+
+  chDbgCheck(scp != NULL, "simsdClose");
+
+  if (scp->fd >= 0) {
+    close(scp->fd);
+    scp->fd = -1;
+  }
+}
+
+#endif /* HAL_USE_SPI */
+
+/** @} */
@@ -0,0 +1,221 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_sdcard.h
+ * @brief   Simulated SD card in SPI mode header.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#ifndef _SIM_SDCARD_H_
+#define _SIM_SDCARD_H_
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Simulated card block size.
+ */
+#define SIMSD_BLOCK_SIZE            512
+
+/**
+ * @brief   Size of the card output FIFO.
+ * @details Large enough for a data block with its token, CRC and the
+ *          preceding access time.
+ */
+#define SIMSD_OUT_SIZE              1024
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Access time in bytes before a data token.
+ */
+#if !defined(SIMSD_ACCESS_BYTES) || defined(__DOXYGEN__)
+#define SIMSD_ACCESS_BYTES          4
+#endif
+
+/**
+ * @brief   Busy time in bytes after a block write.
+ */
+#if !defined(SIMSD_BUSY_BYTES) || defined(__DOXYGEN__)
+#define SIMSD_BUSY_BYTES            16
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Card data phase.
+ */
+typedef enum {
+  SIMSD_COMMAND = 0,                /**< Waiting for commands.              */
+  SIMSD_READING = 1,                /**< Streaming data blocks.             */
+  SIMSD_WRITE_TOKEN = 2,            /**< Waiting for a data token.          */
+  SIMSD_WRITE_DATA = 3              /**< Receiving a data block.            */
+} simsdphase_t;
+
+/**
+ * @brief   Structure representing a simulated SD card.
+ * @details The card is an high capacity card backed by an host file, it
+ *          implements the SPI mode protocol byte by byte.
+ */
+typedef struct {
+  /**
+   * @brief Bus interface, must be the first field.
+   */
+  SPISimSlave           slave;
+  /**
+   * @brief Host file descriptor.
+   */
+  int                   fd;
+  /**
+   * @brief Size of the card in blocks.
+   */
+  uint32_t              blk_num;
+  /**
+   * @brief Chip select state.
+   */
+  bool_t                selected;
+  /**
+   * @brief Card in idle state.
+   */
+  bool_t                idle;
+  /**
+   * @brief Next command is an application command.
+   */
+  bool_t                app_cmd;
+  /**
+   * @brief CRC checking enabled by CMD59.
+   */
+  bool_t                crc_on;
+  /**
+   * @brief Current data phase.
+   */
+  simsdphase_t          phase;
+  /**
+   * @brief Multiple blocks transfer in progress.
+   */
+  bool_t                multi;
+  /**
+   * @brief Next block of the current transfer.
+   */
+  uint32_t              blk;
+  /**
+   * @brief Command being received.
+   */
+  uint8_t               cmd[6];
+  /**
+   * @brief Number of command bytes received.
+   */
+  unsigned              cmd_cnt;
+  /**
+   * @brief Data block being received, with its CRC.
+   */
+  uint8_t               data[SIMSD_BLOCK_SIZE + 2];
+  /**
+   * @brief Number of data bytes received.
+   */
+  unsigned              data_cnt;
+  /**
+   * @brief Output FIFO.
+   */
+  uint8_t               out[SIMSD_OUT_SIZE];
+  /**
+   * @brief Output FIFO read index.
+   */
+  unsigned              out_rd;
+  /**
+   * @brief Output FIFO write index.
+   */
+  unsigned              out_wr;
+  /**
+   * @brief Erase range start.
+   */
+  uint32_t              erase_start;
+  /**
+   * @brief Erase range end.
+   */
+  uint32_t              erase_end;
+  /**
+   * @brief Corrupt the CRC of the next transmitted block.
+   */
+  bool_t                corrupt;
+  /**
+   * @brief Number of blocks read.
+   */
+  uint32_t              reads;
+  /**
+   * @brief Number of blocks written.
+   */
+  uint32_t              writes;
+  /**
+   * @brief Number of commands and blocks rejected for a CRC error.
+   */
+  uint32_t              crc_errors;
+} SimSDCard;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the bus interface of a card.
+ *
+ * @param[in] scp       pointer to the @p SimSDCard object
+ */
+#define simsdGetSlave(scp) (&(scp)->slave)
+
+/**
+ * @brief   Corrupts the CRC of the next block sent by the card.
+ *
+ * @param[in] scp       pointer to the @p SimSDCard object
+ */
+#define simsdCorruptNextRead(scp) ((scp)->corrupt = TRUE)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  bool_t simsdOpen(SimSDCard *scp, const char *name, uint32_t blk_num);
+  void simsdClose(SimSDCard *scp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_SPI */
+
+#endif /* _SIM_SDCARD_H_ */
+
+/** @} */
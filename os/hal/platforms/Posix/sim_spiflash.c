@@ -0,0 +1,262 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_spiflash.c
+ * @brief   Simulated SPI NOR flash code.
+ * @details The model implements the common 25 series command set with
+ *          24 bits addresses.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "sim_spiflash.h"
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   JEDEC manufacturer and memory type returned by the model.
+ */
+#define FLASH_ID_MANUFACTURER           0xEF
+#define FLASH_ID_TYPE                   0x40
+
+/**
+ * @brief   Internal code of a command ignored because the device is busy.
+ */
+#define SIMFLASH_CMD_IGNORED            0x00
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static void sf_set_busy(SimSPIFlash *sfp, uint32_t us) {
+  struct timeval tv;
+
+  gettimeofday(&sfp->busy_until, NULL);
+  tv.tv_sec  = us / 1000000;
+  tv.tv_usec = us % 1000000;
+  timeradd(&sfp->busy_until, &tv, &sfp->busy_until);
+  sfp->status |= SIMFLASH_SR_WIP;
+}
+
+static bool_t sf_is_busy(SimSPIFlash *sfp) {
+  struct timeval tv;
+
+  if (sfp->status & SIMFLASH_SR_WIP) {
+    gettimeofday(&tv, NULL);
+    if (timercmp(&tv, &sfp->busy_until, <))
+      return TRUE;
+    sfp->status &= ~(SIMFLASH_SR_WIP | SIMFLASH_SR_WEL);
+  }
+  return FALSE;
+}
+
+static void sf_erase(SimSPIFlash *sfp, size_t size, uint32_t us) {
+
+  memset(sfp->storage + (sfp->addr & (sfp->size - 1) & ~(size - 1)),
+         0xFF, size);
+  sfp->erases++;
+  sf_set_busy(sfp, us);
+}
+
+/*
+ * Returns the byte sent by the flash while receiving the byte number
+ * cnt of the current command.
+ */
+static uint8_t sf_output(SimSPIFlash *sfp) {
+  uint8_t b;
+
+  if (sfp->cnt == 0)
+    return 0xFF;
+
+  switch (sfp->cmd) {
+  case SIMFLASH_CMD_READ_STATUS:
+    (void)sf_is_busy(sfp);
+    return sfp->status;
+  case SIMFLASH_CMD_READ_ID:
+    switch (sfp->cnt) {
+    case 1:
+      return FLASH_ID_MANUFACTURER;
+    case 2:
+      return FLASH_ID_TYPE;
+    case 3:
+      /* Capacity as a power of two.*/
+      for (b = 0; ((size_t)1 << b) < sfp->size; b++)
+        ;
+      return b;
+    }
+    break;
+  case SIMFLASH_CMD_READ:
+  case SIMFLASH_CMD_FAST_READ:
+    if (sfp->cnt >= (sfp->cmd == SIMFLASH_CMD_READ ? 4U : 5U))
+      return sfp->storage[sfp->addr++ & (sfp->size - 1)];
+    break;
+  }
+  return 0xFF;
+}
+
+/*
+ * Processes a byte received from the master.
+ */
+static void sf_input(SimSPIFlash *sfp, uint8_t b) {
+
+  if (sfp->cnt == 0) {
+    /* While busy only the status register can be read, the other commands
+       are ignored.*/
+    if (sf_is_busy(sfp) && (b != SIMFLASH_CMD_READ_STATUS))
+      b = SIMFLASH_CMD_IGNORED;
+    sfp->cmd = b;
+    sfp->page_cnt = 0;
+    switch (b) {
+    case SIMFLASH_CMD_WRITE_ENABLE:
+      sfp->status |= SIMFLASH_SR_WEL;
+      break;
+    case SIMFLASH_CMD_WRITE_DISABLE:
+      sfp->status &= ~SIMFLASH_SR_WEL;
+      break;
+    }
+  }
+  else if (sfp->cnt <= 3) {
+    /* Address bytes.*/
+    sfp->addr = (sfp->addr << 8) | b;
+  }
+  else if ((sfp->cmd == SIMFLASH_CMD_PAGE_PROGRAM) &&
+           (sfp->page_cnt < SIMFLASH_PAGE_SIZE)) {
+    /* Data beyond the page size is ignored, physical devices would wrap
+       within the page.*/
+    sfp->page[sfp->page_cnt++] = b;
+  }
+  sfp->cnt++;
+}
+
+/*
+ * Executes a program or erase command at the end of the transaction.
+ */
+static void sf_execute(SimSPIFlash *sfp) {
+  uint32_t base, i;
+
+  if (sf_is_busy(sfp) || !(sfp->status & SIMFLASH_SR_WEL))
+    return;
+
+  switch (sfp->cmd) {
+  case SIMFLASH_CMD_PAGE_PROGRAM:
+    if ((sfp->cnt < 4) || (sfp->page_cnt == 0))
+      return;
+    base = sfp->addr & (sfp->size - 1) & ~(SIMFLASH_PAGE_SIZE - 1);
+    for (i = 0; i < sfp->page_cnt; i++) {
+      uint32_t offset = (sfp->addr + i) & (SIMFLASH_PAGE_SIZE - 1);
+
+      /* Programming can only clear bits.*/
+      sfp->storage[base + offset] &= sfp->page[i];
+    }
+    sfp->programs++;
+    sf_set_busy(sfp, SIMFLASH_PAGE_PROGRAM_TIME);
+    break;
+  case SIMFLASH_CMD_SECTOR_ERASE:
+    if (sfp->cnt == 4)
+      sf_erase(sfp, SIMFLASH_SECTOR_SIZE, SIMFLASH_SECTOR_ERASE_TIME);
+    break;
+  case SIMFLASH_CMD_BLOCK_ERASE:
+    if (sfp->cnt == 4)
+      sf_erase(sfp, SIMFLASH_BLOCK_SIZE, SIMFLASH_BLOCK_ERASE_TIME);
+    break;
+  case SIMFLASH_CMD_CHIP_ERASE:
+    if (sfp->cnt == 1) {
+      sfp->addr = 0;
+      sf_erase(sfp, sfp->size, SIMFLASH_BLOCK_ERASE_TIME *
+                               (sfp->size / SIMFLASH_BLOCK_SIZE));
+    }
+    break;
+  }
+}
+
+static void sf_select(SPISimSlave *ssp) {
+  SimSPIFlash *sfp = (SimSPIFlash *)ssp;
+
+  sfp->cnt = 0;
+  sfp->addr = 0;
+}
+
+static void sf_unselect(SPISimSlave *ssp) {
+  SimSPIFlash *sfp = (SimSPIFlash *)ssp;
+
+  if (sfp->cnt > 0)
+    sf_execute(sfp);
+  sfp->cnt = 0;
+}
+
+static void sf_exchange(SPISimSlave *ssp, size_t n,
+                        const uint8_t *txbuf, uint8_t *rxbuf) {
+  SimSPIFlash *sfp = (SimSPIFlash *)ssp;
+  size_t i;
+
+  for (i = 0; i < n; i++) {
+    uint8_t b = sf_output(sfp);
+
+    sf_input(sfp, txbuf != NULL ? txbuf[i] : 0xFF);
+    if (rxbuf != NULL)
+      rxbuf[i] = b;
+  }
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes a simulated flash.
+ * @details The memory array is erased.
+ *
+ * @param[out] sfp      pointer to the @p SimSPIFlash object
+ * @param[in] storage   pointer to the memory array
+ * @param[in] size      memory array size, a power of two multiple of
+ *                      @p SIMFLASH_BLOCK_SIZE
+ */
+void simflashObjectInit(SimSPIFlash *sfp, uint8_t *storage, size_t size) {
+
+  chDbgCheck((sfp != NULL) && (storage != NULL) &&
+             (size >= SIMFLASH_BLOCK_SIZE) && ((size & (size - 1)) == 0),
+             "simflashObjectInit");
+
+  memset(sfp, 0, sizeof *sfp);
+  sfp->slave.select   = sf_select;
+  sfp->slave.unselect = sf_unselect;
+  sfp->slave.exchange = sf_exchange;
+  sfp->storage        = storage;
+  sfp->size           = size;
+  memset(storage, 0xFF, size);
+}
+
+#endif /* HAL_USE_SPI */
+
+/** @} */
@@ -0,0 +1,192 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/sim_spiflash.h
+ * @brief   Simulated SPI NOR flash header.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#ifndef _SIM_SPIFLASH_H_
+#define _SIM_SPIFLASH_H_
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+#include <sys/time.h>
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Flash commands
+ * @{
+ */
+#define SIMFLASH_CMD_PAGE_PROGRAM       0x02
+#define SIMFLASH_CMD_READ               0x03
+#define SIMFLASH_CMD_WRITE_DISABLE      0x04
+#define SIMFLASH_CMD_READ_STATUS        0x05
+#define SIMFLASH_CMD_WRITE_ENABLE       0x06
+#define SIMFLASH_CMD_FAST_READ          0x0B
+#define SIMFLASH_CMD_SECTOR_ERASE       0x20
+#define SIMFLASH_CMD_CHIP_ERASE         0xC7
+#define SIMFLASH_CMD_BLOCK_ERASE        0xD8
+#define SIMFLASH_CMD_READ_ID            0x9F
+/** @} */
+
+/**
+ * @name    Status register bits
+ * @{
+ */
+#define SIMFLASH_SR_WIP                 0x01
+#define SIMFLASH_SR_WEL                 0x02
+/** @} */
+
+/**
+ * @name    Flash geometry
+ * @{
+ */
+#define SIMFLASH_PAGE_SIZE              256
+#define SIMFLASH_SECTOR_SIZE            4096
+#define SIMFLASH_BLOCK_SIZE             65536
+/** @} */
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Page program time in microseconds.
+ */
+#if !defined(SIMFLASH_PAGE_PROGRAM_TIME) || defined(__DOXYGEN__)
+#define SIMFLASH_PAGE_PROGRAM_TIME      700
+#endif
+
+/**
+ * @brief   Sector erase time in microseconds.
+ */
+#if !defined(SIMFLASH_SECTOR_ERASE_TIME) || defined(__DOXYGEN__)
+#define SIMFLASH_SECTOR_ERASE_TIME      45000
+#endif
+
+/**
+ * @brief   Block erase time in microseconds.
+ * @note    The chip erase takes this time for each block.
+ */
+#if !defined(SIMFLASH_BLOCK_ERASE_TIME) || defined(__DOXYGEN__)
+#define SIMFLASH_BLOCK_ERASE_TIME       150000
+#endif
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Structure representing a simulated SPI NOR flash.
+ * @details The memory array is a RAM buffer, erased bytes are 0xFF and
+ *          programming can only clear bits. Program and erase operations
+ *          are started when the chip select is released, the device then
+ *          stays busy for the modelled time.
+ */
+typedef struct {
+  /**
+   * @brief Bus interface, must be the first field.
+   */
+  SPISimSlave           slave;
+  /**
+   * @brief Memory array.
+   */
+  uint8_t               *storage;
+  /**
+   * @brief Memory array size, a power of two multiple of a block.
+   */
+  size_t                size;
+  /**
+   * @brief Status register.
+   */
+  uint8_t               status;
+  /**
+   * @brief End time of the current program or erase operation.
+   */
+  struct timeval        busy_until;
+  /**
+   * @brief Current command.
+   */
+  uint8_t               cmd;
+  /**
+   * @brief Number of bytes received since the chip select.
+   */
+  size_t                cnt;
+  /**
+   * @brief Current address.
+   */
+  uint32_t              addr;
+  /**
+   * @brief Page program buffer.
+   */
+  uint8_t               page[SIMFLASH_PAGE_SIZE];
+  /**
+   * @brief Page program data bytes received.
+   */
+  size_t                page_cnt;
+  /**
+   * @brief Number of program operations.
+   */
+  uint32_t              programs;
+  /**
+   * @brief Number of erase operations.
+   */
+  uint32_t              erases;
+} SimSPIFlash;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the bus interface of a flash.
+ *
+ * @param[in] sfp       pointer to the @p SimSPIFlash object
+ */
+#define simflashGetSlave(sfp) (&(sfp)->slave)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void simflashObjectInit(SimSPIFlash *sfp, uint8_t *storage, size_t size);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_SPI */
+
+#endif /* _SIM_SPIFLASH_H_ */
+
+/** @} */
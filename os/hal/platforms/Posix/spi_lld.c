@@ -0,0 +1,323 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/spi_lld.c
+ * @brief   Posix simulated SPI Driver subsystem low level driver code.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/** @brief SPI1 driver identifier.*/
+#if USE_SIM_SPI1 || defined(__DOXYGEN__)
+SPIDriver SPID1;
+#endif
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Modelled duration of an exchange.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of frames
+ * @return              The duration in microseconds.
+ */
+static uint32_t exchange_time(SPIDriver *spip, size_t n) {
+  uint32_t us = spip->config->latency;
+
+  if (spip->config->bitrate > 0)
+    us += (uint32_t)(((uint64_t)n * 8 * 1000000 + spip->config->bitrate - 1) /
+                     spip->config->bitrate);
+  return us;
+}
+
+/**
+ * @brief   Moves frames between the master and the slave.
+ * @details Without a slave the bus lines are pulled up.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of frames
+ * @param[in] txbuf     transmit buffer or @p NULL
+ * @param[out] rxbuf    receive buffer or @p NULL
+ */
+static void bus_exchange(SPIDriver *spip, size_t n,
+                         const uint8_t *txbuf, uint8_t *rxbuf) {
+  SPISimSlave *ssp = spip->config->slave;
+
+  if (ssp != NULL)
+    ssp->exchange(ssp, n, txbuf, rxbuf);
+  else if (rxbuf != NULL)
+    memset(rxbuf, 0xFF, n);
+  spip->exchanges++;
+  spip->frames += n;
+}
+
+/**
+ * @brief   Starts an exchange.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of frames
+ * @param[in] txbuf     transmit buffer or @p NULL
+ * @param[out] rxbuf    receive buffer or @p NULL
+ */
+static void start_exchange(SPIDriver *spip, size_t n,
+                           const void *txbuf, void *rxbuf) {
+  struct timeval tv;
+  uint32_t us = exchange_time(spip, n);
+
+  gettimeofday(&spip->deadline, NULL);
+  tv.tv_sec  = us / 1000000;
+  tv.tv_usec = us % 1000000;
+  timeradd(&spip->deadline, &tv, &spip->deadline);
+  spip->busy_time += us;
+
+  spip->n       = n;
+  spip->txbuf   = txbuf;
+  spip->rxbuf   = rxbuf;
+  spip->pending = TRUE;
+}
+
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level SPI driver initialization.
+ *
+ * @notapi
+ */
+void spi_lld_init(void) {
+
+  spiObjectInit(&SPID1);
+  SPID1.pending   = FALSE;
+  SPID1.exchanges = 0;
+  SPID1.frames    = 0;
+  SPID1.busy_time = 0;
+}
+
+/**
+ * @brief   Configures and activates the SPI peripheral.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ *
+ * @notapi
+ */
+void spi_lld_start(SPIDriver *spip) {
+
+  spip->pending = FALSE;
+}
+
+/**
+ * @brief   Deactivates the SPI peripheral.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ *
+ * @notapi
+ */
+void spi_lld_stop(SPIDriver *spip) {
+
+  spip->pending = FALSE;
+}
+
+/**
+ * @brief   Asserts the slave select signal and prepares for transfers.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ *
+ * @notapi
+ */
+void spi_lld_select(SPIDriver *spip) {
+  SPISimSlave *ssp = spip->config->slave;
+
+  if (ssp != NULL)
+    ssp->select(ssp);
+}
+
+/**
+ * @brief   Deasserts the slave select signal.
+ * @details The previously selected peripheral is unselected.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ *
+ * @notapi
+ */
+void spi_lld_unselect(SPIDriver *spip) {
+  SPISimSlave *ssp = spip->config->slave;
+
+  if (ssp != NULL)
+    ssp->unselect(ssp);
+}
+
+/**
+ * @brief   Ignores data on the SPI bus.
+ * @details This asynchronous function starts the transmission of a series of
+ *          idle words on the SPI bus and ignores the received data.
+ * @post    At the end of the operation the configured callback is invoked.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of words to be ignored
+ *
+ * @notapi
+ */
+void spi_lld_ignore(SPIDriver *spip, size_t n) {
+
+  start_exchange(spip, n, NULL, NULL);
+}
+
+/**
+ * @brief   Exchanges data on the SPI bus.
+ * @details This asynchronous function starts a simultaneous transmit/receive
+ *          operation.
+ * @post    At the end of the operation the configured callback is invoked.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of words to be exchanged
+ * @param[in] txbuf     the pointer to the transmit buffer
+ * @param[out] rxbuf    the pointer to the receive buffer
+ *
+ * @notapi
+ */
+void spi_lld_exchange(SPIDriver *spip, size_t n,
+                      const void *txbuf, void *rxbuf) {
+
+  start_exchange(spip, n, txbuf, rxbuf);
+}
+
+/**
+ * @brief   Sends data over the SPI bus.
+ * @details This asynchronous function starts a transmit operation.
+ * @post    At the end of the operation the configured callback is invoked.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of words to send
+ * @param[in] txbuf     the pointer to the transmit buffer
+ *
+ * @notapi
+ */
+void spi_lld_send(SPIDriver *spip, size_t n, const void *txbuf) {
+
+  start_exchange(spip, n, txbuf, NULL);
+}
+
+/**
+ * @brief   Receives data from the SPI bus.
+ * @details This asynchronous function starts a receive operation.
+ * @post    At the end of the operation the configured callback is invoked.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] n         number of words to receive
+ * @param[out] rxbuf    the pointer to the receive buffer
+ *
+ * @notapi
+ */
+void spi_lld_receive(SPIDriver *spip, size_t n, void *rxbuf) {
+
+  start_exchange(spip, n, NULL, rxbuf);
+}
+
+/**
+ * @brief   Exchanges one frame using a polled wait.
+ * @details This synchronous function exchanges one frame using a polled
+ *          synchronization method, the modelled transfer time is spent
+ *          spinning.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object
+ * @param[in] frame     the data frame to send over the SPI bus
+ * @return              The received data frame from the SPI bus.
+ */
+uint16_t spi_lld_polled_exchange(SPIDriver *spip, uint16_t frame) {
+  uint8_t tx = (uint8_t)frame, rx;
+  struct timeval end, tv;
+  uint32_t us = exchange_time(spip, 1);
+
+  gettimeofday(&end, NULL);
+  tv.tv_sec  = us / 1000000;
+  tv.tv_usec = us % 1000000;
+  timeradd(&end, &tv, &end);
+  do {
+    gettimeofday(&tv, NULL);
+  } while (timercmp(&tv, &end, <));
+  spip->busy_time += us;
+
+  bus_exchange(spip, 1, &tx, &rx);
+  return rx;
+}
+
+/**
+ * @brief   SPI interrupt simulation.
+ * @details Executes the pending exchange, if any, when its modelled
+ *          duration has elapsed and invokes the completion callback.
+ *
+ * @return              The interrupt status.
+ * @retval FALSE        No exchange completed.
+ * @retval TRUE         An exchange has been completed.
+ */
+bool_t spi_lld_interrupt_pending(void) {
+  SPIDriver *spip = &SPID1;
+  struct timeval tv;
+
+  if (!spip->pending)
+    return FALSE;
+
+  gettimeofday(&tv, NULL);
+  if (timercmp(&tv, &spip->deadline, <))
+    return FALSE;
+
+  CH_IRQ_PROLOGUE();
+
+  /* The callback could start another exchange.*/
+  spip->pending = FALSE;
+  bus_exchange(spip, spip->n, spip->txbuf, spip->rxbuf);
+  _spi_isr_code(spip);
+
+  CH_IRQ_EPILOGUE();
+
+  return TRUE;
+}
+
+#endif /* HAL_USE_SPI */
+
+/** @} */
@@ -0,0 +1,244 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/spi_lld.h
+ * @brief   Posix simulated SPI Driver subsystem low level driver header.
+ * @details The bus is connected to slave models living in the same
+ *          process, the exchanges are executed from the simulated
+ *          interrupt source after the modelled transfer time.
+ *
+ * @addtogroup POSIX_SPI
+ * @{
+ */
+
+#ifndef _SPI_LLD_H_
+#define _SPI_LLD_H_
+
+#if HAL_USE_SPI || defined(__DOXYGEN__)
+
+#include <sys/time.h>
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/**
+ * @name    Configuration options
+ * @{
+ */
+/**
+ * @brief   SPI1 driver enable switch.
+ * @details If set to @p TRUE the support for SPID1 is included.
+ * @note    The default is @p TRUE.
+ */
+#if !defined(USE_SIM_SPI1) || defined(__DOXYGEN__)
+#define USE_SIM_SPI1                        TRUE
+#endif
+/** @} */
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+#if !USE_SIM_SPI1
+#error "SPI driver activated but no SPI peripheral assigned"
+#endif
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   Type of a structure representing an SPI driver.
+ */
+typedef struct SPIDriver SPIDriver;
+
+/**
+ * @brief   SPI notification callback type.
+ *
+ * @param[in] spip      pointer to the @p SPIDriver object triggering the
+ *                      callback
+ */
+typedef void (*spicallback_t)(SPIDriver *spip);
+
+/**
+ * @brief   Type of a simulated SPI slave.
+ */
+typedef struct SPISimSlave SPISimSlave;
+
+/**
+ * @brief   Simulated SPI slave interface.
+ * @details A slave model embeds this structure as its first field, the
+ *          functions are invoked from the simulated interrupt source.
+ */
+struct SPISimSlave {
+  /**
+   * @brief Chip select asserted.
+   */
+  void (*select)(SPISimSlave *ssp);
+  /**
+   * @brief Chip select released.
+   */
+  void (*unselect)(SPISimSlave *ssp);
+  /**
+   * @brief Full duplex exchange of @p n frames.
+   * @note  A @p NULL @p txbuf means that the master transmits 0xFF, a
+   *        @p NULL @p rxbuf means that the received frames are ignored.
+   */
+  void (*exchange)(SPISimSlave *ssp, size_t n,
+                   const uint8_t *txbuf, uint8_t *rxbuf);
+};
+
+/**
+ * @brief   Driver configuration structure.
+ * @details Each configuration selects a slave, multiple slaves can share
+ *          a bus using different configurations as the chip select lines
+ *          of a physical bus would do.
+ * @note    Only 8 bits frames are supported.
+ */
+typedef struct {
+  /**
+   * @brief Operation complete callback or @p NULL.
+   */
+  spicallback_t         end_cb;
+  /* End of the mandatory fields.*/
+  /**
+   * @brief Slave selected by this configuration.
+   */
+  SPISimSlave           *slave;
+  /**
+   * @brief Modelled bus clock in Hz, zero for instant transfers.
+   */
+  uint32_t              bitrate;
+  /**
+   * @brief Modelled setup time of each exchange in microseconds.
+   * @details This is the latency of starting a transfer and serving its
+   *          completion interrupt.
+   */
+  uint32_t              latency;
+} SPIConfig;
+
+/**
+ * @brief   Structure representing a SPI driver.
+ */
+struct SPIDriver {
+  /**
+   * @brief Driver state.
+   */
+  spistate_t            state;
+  /**
+   * @brief Current configuration data.
+   */
+  const SPIConfig       *config;
+#if SPI_USE_WAIT || defined(__DOXYGEN__)
+  /**
+   * @brief Waiting thread.
+   */
+  Thread                *thread;
+#endif /* SPI_USE_WAIT */
+#if SPI_USE_MUTUAL_EXCLUSION || defined(__DOXYGEN__)
+#if CH_USE_MUTEXES || defined(__DOXYGEN__)
+  /**
+   * @brief Mutex protecting the bus.
+   */
+  Mutex                 mutex;
+#elif CH_USE_SEMAPHORES
+  Semaphore             semaphore;
+#endif
+#endif /* SPI_USE_MUTUAL_EXCLUSION */
+#if defined(SPI_DRIVER_EXT_FIELDS)
+  SPI_DRIVER_EXT_FIELDS
+#endif
+  /* End of the mandatory fields.*/
+  /**
+   * @brief An exchange is waiting for the simulated interrupt.
+   */
+  bool_t                pending;
+  /**
+   * @brief Number of frames of the pending exchange.
+   */
+  size_t                n;
+  /**
+   * @brief Transmit buffer of the pending exchange or @p NULL.
+   */
+  const uint8_t         *txbuf;
+  /**
+   * @brief Receive buffer of the pending exchange or @p NULL.
+   */
+  uint8_t               *rxbuf;
+  /**
+   * @brief Host time of the end of the pending exchange.
+   */
+  struct timeval        deadline;
+  /**
+   * @brief Number of completed exchanges.
+   */
+  uint32_t              exchanges;
+  /**
+   * @brief Number of transferred frames.
+   */
+  uint32_t              frames;
+  /**
+   * @brief Modelled bus busy time in microseconds.
+   */
+  uint32_t              busy_time;
+};
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#if USE_SIM_SPI1 && !defined(__DOXYGEN__)
+extern SPIDriver SPID1;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void spi_lld_init(void);
+  void spi_lld_start(SPIDriver *spip);
+  void spi_lld_stop(SPIDriver *spip);
+  void spi_lld_select(SPIDriver *spip);
+  void spi_lld_unselect(SPIDriver *spip);
+  void spi_lld_ignore(SPIDriver *spip, size_t n);
+  void spi_lld_exchange(SPIDriver *spip, size_t n,
+                        const void *txbuf, void *rxbuf);
+  void spi_lld_send(SPIDriver *spip, size_t n, const void *txbuf);
+  void spi_lld_receive(SPIDriver *spip, size_t n, void *rxbuf);
+  uint16_t spi_lld_polled_exchange(SPIDriver *spip, uint16_t frame);
+  bool_t spi_lld_interrupt_pending(void);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HAL_USE_SPI */
+
+#endif /* _SPI_LLD_H_ */
+
+/** @} */
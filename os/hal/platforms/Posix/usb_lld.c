@@ -0,0 +1,840 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    Posix/usb_lld.c
+ * @brief   Posix simulated USB Driver subsystem low level driver code.
+ *
+ * @addtogroup POSIX_USB
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_USB || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/** @brief USB1 driver identifier.*/
+#if USE_SIM_USB1 || defined(__DOXYGEN__)
+USBDriver USBD1;
+#endif
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   EP0 state.
+ * @note    It is an union because IN and OUT endpoints are never used at the
+ *          same time for EP0.
+ */
+static union {
+  /**
+   * @brief   IN EP0 state.
+   */
+  USBInEndpointState in;
+  /**
+   * @brief   OUT EP0 state.
+   */
+  USBOutEndpointState out;
+} ep0_state;
+
+/**
+ * @brief   EP0 initialization structure.
+ */
+static const USBEndpointConfig ep0config = {
+  USB_EP_MODE_TYPE_CTRL,
+  _usb_ep0setup,
+  _usb_ep0in,
+  _usb_ep0out,
+  0x40,
+  0x40,
+  &ep0_state.in,
+  &ep0_state.out,
+  1,
+  NULL
+};
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Terminates an host transfer.
+ *
+ * @param[in] xp        pointer to the @p USBSimTransfer object
+ * @param[in] msg       wakeup message for the host thread
+ *
+ * @iclass
+ */
+static void xfer_done_i(USBSimTransfer *xp, msg_t msg) {
+  Thread *tp = xp->thread;
+
+  if (tp != NULL) {
+    xp->thread = NULL;
+    chSchReadyI(tp)->p_u.rdymsg = msg;
+  }
+}
+
+/**
+ * @brief   Terminates all the pending host transfers.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] msg       wakeup message for the host threads
+ *
+ * @iclass
+ */
+static void xfer_abort_all_i(USBDriver *usbp, msg_t msg) {
+  unsigned ep;
+
+  xfer_done_i(&usbp->setup_xfer, msg);
+  for (ep = 0; ep <= USB_MAX_ENDPOINTS; ep++) {
+    xfer_done_i(&usbp->in_xfer[ep], msg);
+    xfer_done_i(&usbp->out_xfer[ep], msg);
+  }
+}
+
+/**
+ * @brief   Posts an host transfer and waits for its completion.
+ *
+ * @param[in] xp        pointer to the @p USBSimTransfer object
+ * @param[in] buf       host buffer
+ * @param[in] n         transfer size
+ * @param[in] time      the number of ticks before the operation timeouts
+ * @return              The wakeup message.
+ */
+static msg_t xfer_wait(USBSimTransfer *xp, uint8_t *buf, size_t n,
+                       systime_t time) {
+  msg_t msg;
+
+  chSysLock();
+  chDbgAssert(xp->thread == NULL, "xfer_wait(), #1", "already in progress");
+  xp->buf    = buf;
+  xp->n      = n;
+  xp->cnt    = 0;
+  xp->pkts   = 0;
+  xp->thread = chThdSelf();
+  msg = chSchGoSleepTimeoutS(THD_STATE_SUSPENDED, time);
+  xp->thread = NULL;
+  chSysUnlock();
+  return msg;
+}
+
+/**
+ * @brief   Moves a packet from an IN endpoint to the host.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @return              The operation status.
+ * @retval FALSE        No packet moved, the endpoint is NAKing.
+ * @retval TRUE         A packet has been moved.
+ *
+ * @notapi
+ */
+static bool_t in_packet(USBDriver *usbp, usbep_t ep) {
+  const USBEndpointConfig *epcp = usbp->epc[ep];
+  USBSimTransfer *xp = &usbp->in_xfer[ep];
+  USBInEndpointState *isp;
+  size_t i, n, space;
+
+  if (xp->thread == NULL)
+    return FALSE;
+
+  if (usbp->stalled_in & (1 << ep)) {
+    chSysLockFromIsr();
+    xfer_done_i(xp, USB_SIM_STALLED);
+    chSysUnlockFromIsr();
+    return TRUE;
+  }
+
+  if ((epcp == NULL) || !usbGetTransmitStatusI(usbp, ep))
+    return FALSE;
+
+  isp = epcp->in_state;
+  n = isp->txsize - isp->txcnt;
+  if (n > epcp->in_maxsize)
+    n = epcp->in_maxsize;
+  space = xp->n - xp->cnt;
+
+  /* Data bytes not fitting the host buffer are dropped, this is what an
+     host does on babble.*/
+  if (isp->txqueued) {
+    OutputQueue *oqp = isp->mode.queue.txqueue;
+
+    for (i = 0; i < n; i++) {
+      if (i < space)
+        xp->buf[xp->cnt + i] = *oqp->q_rdptr;
+      if (++oqp->q_rdptr >= oqp->q_top)
+        oqp->q_rdptr = oqp->q_buffer;
+    }
+    chSysLockFromIsr();
+    oqp->q_counter += n;
+    while (notempty(&oqp->q_waiting))
+      chSchReadyI(fifo_remove(&oqp->q_waiting))->p_u.rdymsg = Q_OK;
+    chSysUnlockFromIsr();
+  }
+  else if ((n > 0) && (space > 0))
+    memcpy(&xp->buf[xp->cnt], isp->mode.linear.txbuf + isp->txcnt,
+           n < space ? n : space);
+
+  isp->txcnt += n;
+  xp->cnt    += n < space ? n : space;
+  xp->pkts++;
+  usbp->packets++;
+  usbp->bytes += n;
+
+  /* A short packet or a full host buffer terminates the host transfer.*/
+  if ((n < epcp->in_maxsize) || (xp->cnt >= xp->n)) {
+    chSysLockFromIsr();
+    xfer_done_i(xp, RDY_OK);
+    chSysUnlockFromIsr();
+  }
+
+  /* Device side transfer completion.*/
+  if (isp->txcnt >= isp->txsize)
+    _usb_isr_invoke_in_cb(usbp, ep);
+
+  return TRUE;
+}
+
+/**
+ * @brief   Moves a packet from the host to an OUT endpoint.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @return              The operation status.
+ * @retval FALSE        No packet moved, the endpoint is NAKing.
+ * @retval TRUE         A packet has been moved.
+ *
+ * @notapi
+ */
+static bool_t out_packet(USBDriver *usbp, usbep_t ep) {
+  const USBEndpointConfig *epcp = usbp->epc[ep];
+  USBSimTransfer *xp = &usbp->out_xfer[ep];
+  USBOutEndpointState *osp;
+  size_t i, n, space;
+
+  if (xp->thread == NULL)
+    return FALSE;
+
+  if (usbp->stalled_out & (1 << ep)) {
+    chSysLockFromIsr();
+    xfer_done_i(xp, USB_SIM_STALLED);
+    chSysUnlockFromIsr();
+    return TRUE;
+  }
+
+  if ((epcp == NULL) || !usbGetReceiveStatusI(usbp, ep))
+    return FALSE;
+
+  osp = epcp->out_state;
+  n = xp->n - xp->cnt;
+  if (n > epcp->out_maxsize)
+    n = epcp->out_maxsize;
+
+  /* Data exceeding the device buffer is dropped, the buffers should always
+     be sized as multiples of the packet size.*/
+  space = osp->rxsize - osp->rxcnt;
+  if (space > n)
+    space = n;
+  if (osp->rxqueued) {
+    InputQueue *iqp = osp->mode.queue.rxqueue;
+
+    for (i = 0; i < space; i++) {
+      *iqp->q_wrptr = xp->buf[xp->cnt + i];
+      if (++iqp->q_wrptr >= iqp->q_top)
+        iqp->q_wrptr = iqp->q_buffer;
+    }
+    chSysLockFromIsr();
+    iqp->q_counter += space;
+    while (notempty(&iqp->q_waiting))
+      chSchReadyI(fifo_remove(&iqp->q_waiting))->p_u.rdymsg = Q_OK;
+    chSysUnlockFromIsr();
+  }
+  else if (space > 0)
+    memcpy(osp->mode.linear.rxbuf + osp->rxcnt, &xp->buf[xp->cnt], space);
+
+  osp->rxcnt += space;
+  xp->cnt    += n;
+  xp->pkts++;
+  usbp->packets++;
+  usbp->bytes += n;
+
+  /* The host transfer is over when all the data has been sent.*/
+  if (xp->cnt >= xp->n) {
+    chSysLockFromIsr();
+    xfer_done_i(xp, RDY_OK);
+    chSysUnlockFromIsr();
+  }
+
+  /* A short packet or a full buffer terminates the device transfer.*/
+  if ((n < epcp->out_maxsize) || (osp->rxcnt >= osp->rxsize))
+    _usb_isr_invoke_out_cb(usbp, ep);
+
+  return TRUE;
+}
+
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Low level USB driver initialization.
+ *
+ * @notapi
+ */
+void usb_lld_init(void) {
+
+  /* Driver initialization.*/
+  usbObjectInit(&USBD1);
+  USBD1.connected   = FALSE;
+  USBD1.stalled_in  = 0;
+  USBD1.stalled_out = 0;
+  USBD1.packets     = 0;
+  USBD1.bytes       = 0;
+}
+
+/**
+ * @brief   Configures and activates the USB peripheral.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ *
+ * @notapi
+ */
+void usb_lld_start(USBDriver *usbp) {
+
+  if (usbp->state == USB_STOP) {
+    /* Reset procedure enforced on driver start.*/
+    _usb_reset(usbp);
+  }
+}
+
+/**
+ * @brief   Deactivates the USB peripheral.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ *
+ * @notapi
+ */
+void usb_lld_stop(USBDriver *usbp) {
+
+  /* Host transfers cannot complete anymore.*/
+  xfer_abort_all_i(usbp, RDY_RESET);
+}
+
+/**
+ * @brief   USB low level reset routine.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ *
+ * @notapi
+ */
+void usb_lld_reset(USBDriver *usbp) {
+
+  usbp->stalled_in  = 0;
+  usbp->stalled_out = 0;
+
+  /* EP0 initialization.*/
+  usbp->epc[0] = &ep0config;
+  usb_lld_init_endpoint(usbp, 0);
+}
+
+/**
+ * @brief   Sets the USB address.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ *
+ * @notapi
+ */
+void usb_lld_set_address(USBDriver *usbp) {
+
+  (void)usbp;
+}
+
+/**
+ * @brief   Enables an endpoint.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_init_endpoint(USBDriver *usbp, usbep_t ep) {
+
+  usbp->stalled_in  &= ~(1 << ep);
+  usbp->stalled_out &= ~(1 << ep);
+}
+
+/**
+ * @brief   Disables all the active endpoints except the endpoint zero.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ *
+ * @notapi
+ */
+void usb_lld_disable_endpoints(USBDriver *usbp) {
+
+  usbp->stalled_in  &= 1;
+  usbp->stalled_out &= 1;
+}
+
+/**
+ * @brief   Returns the status of an OUT endpoint.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @return              The endpoint status.
+ * @retval EP_STATUS_DISABLED The endpoint is not active.
+ * @retval EP_STATUS_STALLED  The endpoint is stalled.
+ * @retval EP_STATUS_ACTIVE   The endpoint is active.
+ *
+ * @notapi
+ */
+usbepstatus_t usb_lld_get_status_out(USBDriver *usbp, usbep_t ep) {
+
+  if ((ep > USB_MAX_ENDPOINTS) || (usbp->epc[ep] == NULL) ||
+      (usbp->epc[ep]->out_cb == NULL))
+    return EP_STATUS_DISABLED;
+  if (usbp->stalled_out & (1 << ep))
+    return EP_STATUS_STALLED;
+  return EP_STATUS_ACTIVE;
+}
+
+/**
+ * @brief   Returns the status of an IN endpoint.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @return              The endpoint status.
+ * @retval EP_STATUS_DISABLED The endpoint is not active.
+ * @retval EP_STATUS_STALLED  The endpoint is stalled.
+ * @retval EP_STATUS_ACTIVE   The endpoint is active.
+ *
+ * @notapi
+ */
+usbepstatus_t usb_lld_get_status_in(USBDriver *usbp, usbep_t ep) {
+
+  if ((ep > USB_MAX_ENDPOINTS) || (usbp->epc[ep] == NULL) ||
+      (usbp->epc[ep]->in_cb == NULL))
+    return EP_STATUS_DISABLED;
+  if (usbp->stalled_in & (1 << ep))
+    return EP_STATUS_STALLED;
+  return EP_STATUS_ACTIVE;
+}
+
+/**
+ * @brief   Reads a setup packet from the dedicated packet buffer.
+ * @details This function must be invoked in the context of the @p setup_cb
+ *          callback in order to read the received setup packet.
+ * @pre     In order to use this function the endpoint must have been
+ *          initialized as a control endpoint.
+ * @post    The endpoint is ready to accept another packet.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @param[out] buf      buffer where to copy the packet data
+ *
+ * @notapi
+ */
+void usb_lld_read_setup(USBDriver *usbp, usbep_t ep, uint8_t *buf) {
+
+  (void)ep;
+  memcpy(buf, usbp->setup_pkt, 8);
+}
+
+/**
+ * @brief   Prepares for a receive operation.
+ * @note    Packets are copied when the host sends them, nothing to do.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_prepare_receive(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+/**
+ * @brief   Prepares for a transmit operation.
+ * @note    Packets are copied when the host requests them, nothing to do.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_prepare_transmit(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+/**
+ * @brief   Starts a receive operation on an OUT endpoint.
+ * @note    The endpoint is armed by the @p receiving bit mask.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_start_out(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+/**
+ * @brief   Starts a transmit operation on an IN endpoint.
+ * @note    The endpoint is armed by the @p transmitting bit mask.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_start_in(USBDriver *usbp, usbep_t ep) {
+
+  (void)usbp;
+  (void)ep;
+}
+
+/**
+ * @brief   Brings an OUT endpoint in the stalled state.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_stall_out(USBDriver *usbp, usbep_t ep) {
+
+  usbp->stalled_out |= (1 << ep);
+}
+
+/**
+ * @brief   Brings an IN endpoint in the stalled state.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_stall_in(USBDriver *usbp, usbep_t ep) {
+
+  usbp->stalled_in |= (1 << ep);
+}
+
+/**
+ * @brief   Brings an OUT endpoint in the active state.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_clear_out(USBDriver *usbp, usbep_t ep) {
+
+  usbp->stalled_out &= ~(1 << ep);
+}
+
+/**
+ * @brief   Brings an IN endpoint in the active state.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ *
+ * @notapi
+ */
+void usb_lld_clear_in(USBDriver *usbp, usbep_t ep) {
+
+  usbp->stalled_in &= ~(1 << ep);
+}
+
+/**
+ * @brief   Simulated USB interrupt source.
+ * @details Serves, in order of priority, bus resets, SETUP packets and
+ *          then up to @p USB_SIM_PACKETS_PER_IRQ data packets scanning
+ *          the endpoints.
+ *
+ * @return              The interrupt status.
+ * @retval FALSE        No bus activity.
+ * @retval TRUE         Some bus activity has been simulated.
+ */
+bool_t usb_lld_interrupt_pending(void) {
+  USBDriver *usbp = &USBD1;
+  bool_t b = FALSE;
+  unsigned i;
+  usbep_t ep;
+
+  if (usbp->state == USB_STOP)
+    return FALSE;
+
+  CH_IRQ_PROLOGUE();
+
+  /* Bus reset, it is only seen by a connected device.*/
+  if (usbp->reset.thread != NULL) {
+    if (usbp->connected) {
+      _usb_reset(usbp);
+      _usb_isr_invoke_event_cb(usbp, USB_EVENT_RESET);
+    }
+    chSysLockFromIsr();
+    xfer_abort_all_i(usbp, RDY_RESET);
+    xfer_done_i(&usbp->reset, usbp->connected ? RDY_OK : RDY_RESET);
+    chSysUnlockFromIsr();
+    b = TRUE;
+  }
+  else if (!usbp->connected) {
+    /* Nothing happens on the bus.*/
+  }
+  else if (usbp->setup_xfer.thread != NULL) {
+    /* A SETUP packet clears the EP0 stall condition and aborts any
+       previous control transfer.*/
+    memcpy(usbp->setup_pkt, usbp->setup_xfer.buf, 8);
+    usbp->stalled_in   &= ~1;
+    usbp->stalled_out  &= ~1;
+    usbp->transmitting &= ~1;
+    usbp->receiving    &= ~1;
+    usbp->packets++;
+    usbp->bytes += 8;
+    chSysLockFromIsr();
+    xfer_done_i(&usbp->setup_xfer, RDY_OK);
+    chSysUnlockFromIsr();
+    _usb_isr_invoke_setup_cb(usbp, 0);
+    b = TRUE;
+  }
+  else {
+    for (i = 0; i < USB_SIM_PACKETS_PER_IRQ; i++) {
+      bool_t moved = FALSE;
+
+      for (ep = 0; ep <= USB_MAX_ENDPOINTS; ep++) {
+        if (in_packet(usbp, ep))
+          moved = TRUE;
+        if (out_packet(usbp, ep))
+          moved = TRUE;
+      }
+      if (!moved)
+        break;
+      b = TRUE;
+    }
+  }
+
+  CH_IRQ_EPILOGUE();
+
+  return b;
+}
+
+/**
+ * @brief   Host side bus reset.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] time      the number of ticks before the operation timeouts
+ * @return              The operation status.
+ * @retval RDY_OK       if the device has been reset.
+ * @retval RDY_RESET    if the device is not connected.
+ * @retval RDY_TIMEOUT  if the operation timed out.
+ *
+ * @api
+ */
+msg_t usbSimBusReset(USBDriver *usbp, systime_t time) {
+
+  chDbgCheck(usbp != NULL, "usbSimBusReset");
+
+  return xfer_wait(&usbp->reset, NULL, 0, time);
+}
+
+/**
+ * @brief   Host side control transfer on endpoint zero.
+ * @details The SETUP, data and status stages are performed in sequence,
+ *          the data stage direction and size are taken from the setup
+ *          packet.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] setup     pointer to the 8 bytes setup packet
+ * @param[in,out] buf   data stage buffer, it can be @p NULL if the
+ *                      @p wLength field of the setup packet is zero
+ * @param[out] np       number of bytes exchanged in the data stage, it
+ *                      can be @p NULL
+ * @param[in] time      the number of ticks before each stage timeouts
+ * @return              The operation status.
+ * @retval RDY_OK       if the transfer has been completed.
+ * @retval RDY_RESET    if the bus has been reset.
+ * @retval RDY_TIMEOUT  if a stage timed out.
+ * @retval USB_SIM_STALLED if the device stalled the request.
+ *
+ * @api
+ */
+msg_t usbSimControlTransfer(USBDriver *usbp, const uint8_t *setup,
+                            uint8_t *buf, size_t *np, systime_t time) {
+  size_t n = usbFetchWord(&setup[6]);
+  msg_t msg;
+
+  chDbgCheck((usbp != NULL) && (setup != NULL), "usbSimControlTransfer");
+
+  if (np != NULL)
+    *np = 0;
+  msg = xfer_wait(&usbp->setup_xfer, (uint8_t *)setup, 8, time);
+  if (msg != RDY_OK)
+    return msg;
+
+  if ((setup[0] & USB_RTYPE_DIR_MASK) == USB_RTYPE_DIR_DEV2HOST) {
+    if (n > 0) {
+      msg = xfer_wait(&usbp->in_xfer[0], buf, n, time);
+      if (msg != RDY_OK)
+        return msg;
+      if (np != NULL)
+        *np = usbp->in_xfer[0].cnt;
+    }
+    return xfer_wait(&usbp->out_xfer[0], NULL, 0, time);
+  }
+
+  if (n > 0) {
+    msg = xfer_wait(&usbp->out_xfer[0], buf, n, time);
+    if (msg != RDY_OK)
+      return msg;
+    if (np != NULL)
+      *np = usbp->out_xfer[0].cnt;
+  }
+  return xfer_wait(&usbp->in_xfer[0], NULL, 0, time);
+}
+
+/**
+ * @brief   Host side OUT transfer.
+ * @details The data is split in packets of the endpoint maximum size,
+ *          a zero sized transfer sends a single zero sized packet.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @param[in] buf       data to be sent
+ * @param[in] n         number of bytes to be sent
+ * @param[in] time      the number of ticks before the operation timeouts
+ * @return              The operation status.
+ * @retval RDY_OK       if the transfer has been completed.
+ * @retval RDY_RESET    if the bus has been reset.
+ * @retval RDY_TIMEOUT  if the operation timed out.
+ * @retval USB_SIM_STALLED if the endpoint is stalled.
+ *
+ * @api
+ */
+msg_t usbSimOutTransfer(USBDriver *usbp, usbep_t ep,
+                        const uint8_t *buf, size_t n, systime_t time) {
+
+  chDbgCheck((usbp != NULL) && (ep <= USB_MAX_ENDPOINTS),
+             "usbSimOutTransfer");
+
+  return xfer_wait(&usbp->out_xfer[ep], (uint8_t *)buf, n, time);
+}
+
+/**
+ * @brief   Host side IN transfer.
+ * @details The transfer is terminated by a short packet or when the
+ *          host buffer is full.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        endpoint number
+ * @param[out] buf      buffer for the received data
+ * @param[in,out] np    size of the buffer on entry, number of received
+ *                      bytes on exit
+ * @param[in] time      the number of ticks before the operation timeouts
+ * @return              The operation status.
+ * @retval RDY_OK       if the transfer has been completed.
+ * @retval RDY_RESET    if the bus has been reset.
+ * @retval RDY_TIMEOUT  if the operation timed out, partial data may have
+ *                      been received.
+ * @retval USB_SIM_STALLED if the endpoint is stalled.
+ *
+ * @api
+ */
+msg_t usbSimInTransfer(USBDriver *usbp, usbep_t ep,
+                       uint8_t *buf, size_t *np, systime_t time) {
+  msg_t msg;
+
+  chDbgCheck((usbp != NULL) && (ep <= USB_MAX_ENDPOINTS) && (np != NULL),
+             "usbSimInTransfer");
+
+  msg = xfer_wait(&usbp->in_xfer[ep], buf, *np, time);
+  *np = usbp->in_xfer[ep].cnt;
+  return msg;
+}
+
+/**
+ * @brief   Host side enumeration.
+ * @details Performs the minimal enumeration sequence: bus reset,
+ *          GET_DESCRIPTOR(DEVICE), SET_ADDRESS and SET_CONFIGURATION.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] address   address to be assigned
+ * @param[in] configuration configuration to be selected
+ * @param[in] time      the number of ticks before each stage timeouts
+ * @return              The operation status.
+ * @retval RDY_OK       if the device has been configured.
+ *
+ * @api
+ */
+msg_t usbSimEnumerate(USBDriver *usbp, uint8_t address,
+                      uint8_t configuration, systime_t time) {
+  static const uint8_t get_device[8] = {
+    USB_RTYPE_DIR_DEV2HOST, USB_REQ_GET_DESCRIPTOR,
+    0x00, USB_DESCRIPTOR_DEVICE, 0x00, 0x00, 18, 0x00
+  };
+  uint8_t setup[8], desc[18];
+  msg_t msg;
+
+  msg = usbSimBusReset(usbp, time);
+  if (msg != RDY_OK)
+    return msg;
+
+  memcpy(setup, get_device, sizeof setup);
+  msg = usbSimControlTransfer(usbp, setup, desc, NULL, time);
+  if (msg != RDY_OK)
+    return msg;
+
+  memset(setup, 0, sizeof setup);
+  setup[1] = USB_REQ_SET_ADDRESS;
+  setup[2] = address;
+  msg = usbSimControlTransfer(usbp, setup, NULL, NULL, time);
+  if (msg != RDY_OK)
+    return msg;
+
+  setup[1] = USB_REQ_SET_CONFIGURATION;
+  setup[2] = configuration;
+  return usbSimControlTransfer(usbp, setup, NULL, NULL, time);
+}
+
+#endif /* HAL_USE_USB */
+
+/** @} */
@@ -153,6 +153,18 @@ static void can_lld_rx0_handler(CANDriver *canp) {
 
   rf0r = canp->can->RF0R;
   if ((rf0r & CAN_RF0R_FMP0) > 0) {
+#if CAN_USE_RX_FIFO
+    CANRxFrame crf;
+
+    /* The hardware queue is moved into the software FIFO, the interrupt
+       stays enabled.*/
+    chSysLockFromIsr();
+    do {
+      can_lld_receive(canp, 1, &crf);
+      canRxIncomingI(canp, &crf);
+    } while ((canp->can->RF0R & CAN_RF0R_FMP0) > 0);
+    chSysUnlockFromIsr();
+#else /* !CAN_USE_RX_FIFO */
     /* No more receive events until the queue 0 has been emptied.*/
     canp->can->IER &= ~CAN_IER_FMPIE0;
     chSysLockFromIsr();
@@ -160,6 +172,7 @@ static void can_lld_rx0_handler(CANDriver *canp) {
       chSemSignalI(&canp->rxsem);
     chEvtBroadcastFlagsI(&canp->rxfull_event, CAN_MAILBOX_TO_MASK(1));
     chSysUnlockFromIsr();
+#endif /* !CAN_USE_RX_FIFO */
   }
   if ((rf0r & CAN_RF0R_FOVR0) > 0) {
     /* Overflow events handling.*/
@@ -182,6 +195,18 @@ static void can_lld_rx1_handler(CANDriver *canp) {
 
   rf1r = canp->can->RF1R;
   if ((rf1r & CAN_RF1R_FMP1) > 0) {
+#if CAN_USE_RX_FIFO
+    CANRxFrame crf;
+
+    /* The hardware queue is moved into the software FIFO, the interrupt
+       stays enabled.*/
+    chSysLockFromIsr();
+    do {
+      can_lld_receive(canp, 2, &crf);
+      canRxIncomingI(canp, &crf);
+    } while ((canp->can->RF1R & CAN_RF1R_FMP1) > 0);
+    chSysUnlockFromIsr();
+#else /* !CAN_USE_RX_FIFO */
     /* No more receive events until the queue 0 has been emptied.*/
     canp->can->IER &= ~CAN_IER_FMPIE1;
     chSysLockFromIsr();
@@ -189,6 +214,7 @@ static void can_lld_rx1_handler(CANDriver *canp) {
       chSemSignalI(&canp->rxsem);
     chEvtBroadcastFlagsI(&canp->rxfull_event, CAN_MAILBOX_TO_MASK(1));
     chSysUnlockFromIsr();
+#endif /* !CAN_USE_RX_FIFO */
   }
   if ((rf1r & CAN_RF1R_FOVR1) > 0) {
     /* Overflow events handling.*/
@@ -312,6 +312,8 @@ typedef struct {
    */
   EventSource               wakeup_event;
 #endif /* CAN_USE_SLEEP_MODE */
+  /* Software receive FIFO, empty if CAN_USE_RX_FIFO is disabled.*/
+  _can_driver_rx_data
   /* End of the mandatory fields.*/
   /**
    * @brief   Pointer to the CAN registers.
@@ -0,0 +1,741 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    adc_stream.c
+ * @brief   ADC streaming pipeline code.
+ *
+ * @addtogroup ADC_STREAM
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_ADC_STREAM || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the stream owning a conversion group.
+ */
+#define stream_of(grpp)                                                     \
+  ((ADCStream *)((uint8_t *)(grpp) - offsetof(ADCStream, group)))
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static void cic_reset(void *instance, adc_channels_num_t channels);
+static void cic_process(void *instance, ADCStreamData *dp);
+static void fir_reset(void *instance, adc_channels_num_t channels);
+static void fir_process(void *instance, ADCStreamData *dp);
+static void stats_reset(void *instance, adc_channels_num_t channels);
+static void stats_process(void *instance, ADCStreamData *dp);
+static void trigger_reset(void *instance, adc_channels_num_t channels);
+static void trigger_process(void *instance, ADCStreamData *dp);
+static void sink_reset(void *instance, adc_channels_num_t channels);
+static void sink_process(void *instance, ADCStreamData *dp);
+
+/**
+ * @brief   CIC stage virtual methods table.
+ */
+static const struct ADCStageVMT cic_vmt = {cic_reset, cic_process};
+
+/**
+ * @brief   FIR stage virtual methods table.
+ */
+static const struct ADCStageVMT fir_vmt = {fir_reset, fir_process};
+
+/**
+ * @brief   Statistics stage virtual methods table.
+ */
+static const struct ADCStageVMT stats_vmt = {stats_reset, stats_process};
+
+/**
+ * @brief   Trigger stage virtual methods table.
+ */
+static const struct ADCStageVMT trigger_vmt = {trigger_reset,
+                                               trigger_process};
+
+/**
+ * @brief   Sink stage virtual methods table.
+ */
+static const struct ADCStageVMT sink_vmt = {sink_reset, sink_process};
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Returns the current time in @p ADC_STREAM_TIME_FREQUENCY units.
+ */
+static inline uint32_t stream_now(void) {
+
+#if HAL_IMPLEMENTS_COUNTERS
+  return (uint32_t)halGetCounterValue();
+#else
+  return (uint32_t)chTimeNow();
+#endif
+}
+
+/**
+ * @brief   Integer square root.
+ */
+static uint32_t isqrt64(uint64_t x) {
+  uint64_t r = 0, bit = (uint64_t)1 << 62;
+
+  while (bit > x)
+    bit >>= 2;
+  while (bit != 0) {
+    if (x >= r + bit) {
+      x -= r + bit;
+      r = (r >> 1) + bit;
+    }
+    else
+      r >>= 1;
+    bit >>= 2;
+  }
+  return (uint32_t)r;
+}
+
+/**
+ * @brief   Conversion callback, hands a block to the stream thread.
+ * @details The block is dropped if the pool is full.
+ */
+static void stream_end_cb(ADCDriver *adcp, adcsample_t *buffer, size_t n) {
+  ADCStream *asp = stream_of(adcp->grpp);
+  const ADCStreamConfig *config = asp->config;
+  size_t size = asp->rows * asp->group.num_channels;
+  uint32_t wr = asp->wr;
+  uint32_t queued = wr - asp->rd;
+  unsigned slot;
+
+  (void)n;
+  asp->converted++;
+  if (queued >= config->nblocks) {
+    asp->dropped++;
+    asp->dropping = TRUE;
+    chSysLockFromIsr();
+    chEvtBroadcastFlagsI(&asp->event, ADC_STREAM_OVERRUN);
+    chSysUnlockFromIsr();
+    return;
+  }
+
+  /* The free block is owned by the callback until the counter is advanced,
+     the thread is not involved in the copy.*/
+  slot = wr & (config->nblocks - 1);
+  memcpy(config->pool + slot * size, buffer, size * sizeof(adcsample_t));
+  asp->index[slot] = (asp->converted - 1) * asp->rows;
+  asp->gap[slot]   = asp->dropping;
+  asp->dropping    = FALSE;
+  if (queued + 1 > asp->peak)
+    asp->peak = queued + 1;
+
+  chSysLockFromIsr();
+  asp->wr = wr + 1;
+  if (asp->idle) {
+    asp->idle = FALSE;
+    asp->thread->p_u.rdymsg = RDY_OK;
+    chSchReadyI(asp->thread);
+  }
+  chSysUnlockFromIsr();
+}
+
+/**
+ * @brief   Conversion error callback.
+ */
+static void stream_error_cb(ADCDriver *adcp, adcerror_t err) {
+  ADCStream *asp = stream_of(adcp->grpp);
+
+  (void)err;
+  asp->errors++;
+  chSysLockFromIsr();
+  chEvtBroadcastFlagsI(&asp->event, ADC_STREAM_ERROR);
+  chSysUnlockFromIsr();
+}
+
+/**
+ * @brief   Loads a block into the work buffer, one array per channel.
+ */
+static void stream_load(ADCStreamData *dp, const adcsample_t *sp) {
+  adc_channels_num_t ch;
+
+  for (ch = 0; ch < dp->channels; ch++) {
+    adcstreamsample_t *dst = adcStreamChannel(dp, ch);
+    const adcsample_t *src = sp + ch;
+    size_t i;
+
+    for (i = 0; i < dp->n; i++)
+      dst[i] = (adcstreamsample_t)src[i * dp->channels];
+  }
+}
+
+/**
+ * @brief   Stream thread.
+ */
+static msg_t stream_thread(void *arg) {
+  ADCStream *asp = (ADCStream *)arg;
+  const ADCStreamConfig *config = asp->config;
+  adc_channels_num_t channels = asp->group.num_channels;
+  size_t size = asp->rows * channels;
+  ADCStreamData data;
+
+  chRegSetThreadName("adc_stream");
+
+  data.stride   = ADC_STREAM_HEADROOM + asp->rows;
+  data.channels = channels;
+  while (TRUE) {
+    unsigned slot;
+    uint32_t t;
+
+    chSysLock();
+    while (asp->rd == asp->wr) {
+      if (chThdShouldTerminate()) {
+        chSysUnlock();
+        return 0;
+      }
+      asp->idle = TRUE;
+      chSchGoSleepS(THD_STATE_SUSPENDED);
+    }
+    chSysUnlock();
+
+    t = stream_now();
+    slot         = asp->rd & (config->nblocks - 1);
+    data.data    = config->work;
+    data.scratch = config->work + channels * data.stride;
+    data.n       = asp->rows;
+    data.index   = asp->index[slot];
+    data.gap     = asp->gap[slot];
+    stream_load(&data, config->pool + slot * size);
+
+    /* The block is returned to the callback as soon as it has been
+       copied out.*/
+    chSysLock();
+    asp->rd++;
+    chSysUnlock();
+
+    adcStreamRun(config->stages, &data);
+
+    t = stream_now() - t;
+    asp->busy_total += t;
+    if (t > asp->busy_worst)
+      asp->busy_worst = t;
+  }
+  return 0;
+}
+
+static void cic_reset(void *instance, adc_channels_num_t channels) {
+  ADCStageCIC *csp = (ADCStageCIC *)instance;
+
+  (void)channels;
+  memset(csp->integ, 0, sizeof(csp->integ));
+  memset(csp->comb, 0, sizeof(csp->comb));
+  csp->phase = csp->ratio;
+}
+
+static void cic_process(void *instance, ADCStreamData *dp) {
+  ADCStageCIC *csp = (ADCStageCIC *)instance;
+  unsigned order = csp->order, ratio = csp->ratio, shift = csp->shift;
+  unsigned phase = csp->phase;
+  adc_channels_num_t ch;
+  size_t out = 0;
+
+  for (ch = 0; ch < dp->channels; ch++) {
+    adcstreamsample_t *x = adcStreamChannel(dp, ch);
+    uint32_t *integ = csp->integ[ch];
+    uint32_t *comb = csp->comb[ch];
+    size_t i;
+    unsigned k;
+
+    /* The outputs are written in place, behind the inputs.*/
+    phase = csp->phase;
+    out = 0;
+    for (i = 0; i < dp->n; i++) {
+      uint32_t v = (uint32_t)x[i];
+
+      for (k = 0; k < order; k++)
+        v = integ[k] += v;
+      if (--phase == 0) {
+        phase = ratio;
+        for (k = 0; k < order; k++) {
+          uint32_t d = v - comb[k];
+
+          comb[k] = v;
+          v = d;
+        }
+        x[out++] = (adcstreamsample_t)v >> shift;
+      }
+    }
+  }
+  csp->phase = phase;
+  dp->n = out;
+}
+
+static void fir_reset(void *instance, adc_channels_num_t channels) {
+  ADCStageFIR *fsp = (ADCStageFIR *)instance;
+
+  (void)channels;
+  memset(fsp->history, 0, sizeof(fsp->history));
+  fsp->phase = 0;
+}
+
+static void fir_process(void *instance, ADCStreamData *dp) {
+  ADCStageFIR *fsp = (ADCStageFIR *)instance;
+  const int32_t *coeffs = fsp->coeffs;
+  unsigned ntaps = fsp->ntaps, hist = fsp->ntaps - 1;
+  adcstreamsample_t *tmp;
+  adc_channels_num_t ch;
+  size_t p = fsp->phase, out = 0;
+
+  for (ch = 0; ch < dp->channels; ch++) {
+    adcstreamsample_t *x = adcStreamChannel(dp, ch);
+    adcstreamsample_t *y = dp->scratch + ch * dp->stride + ADC_STREAM_HEADROOM;
+
+    /* The history is placed in the headroom so that every window is
+       contiguous.*/
+    memcpy(x - hist, fsp->history[ch], hist * sizeof(adcstreamsample_t));
+    out = 0;
+    for (p = fsp->phase; p < dp->n; p += fsp->ratio) {
+      const adcstreamsample_t *w = x + p - hist;
+      int64_t acc = 0;
+      unsigned k;
+
+      for (k = 0; k < ntaps; k++)
+        acc += (int64_t)w[k] * coeffs[k];
+      y[out++] = (adcstreamsample_t)((acc + 0x4000) >> 15);
+    }
+    memcpy(fsp->history[ch], x + dp->n - hist,
+           hist * sizeof(adcstreamsample_t));
+  }
+  fsp->phase = (unsigned)(p - dp->n);
+  dp->n = out;
+  tmp = dp->data;
+  dp->data = dp->scratch;
+  dp->scratch = tmp;
+}
+
+static void stats_reset(void *instance, adc_channels_num_t channels) {
+  ADCStageStats *ssp = (ADCStageStats *)instance;
+  unsigned ch;
+
+  (void)channels;
+  for (ch = 0; ch < ADC_STREAM_MAX_CHANNELS; ch++) {
+    ssp->acc[ch].min   = INT32_MAX;
+    ssp->acc[ch].max   = INT32_MIN;
+    ssp->acc[ch].sum   = 0;
+    ssp->acc[ch].sumsq = 0;
+  }
+  ssp->count   = 0;
+  ssp->windows = 0;
+}
+
+static void stats_process(void *instance, ADCStreamData *dp) {
+  ADCStageStats *ssp = (ADCStageStats *)instance;
+  adc_channels_num_t ch;
+  size_t i = 0;
+
+  while (i < dp->n) {
+    size_t chunk = dp->n - i;
+
+    if (chunk > ssp->window - ssp->count)
+      chunk = ssp->window - ssp->count;
+
+    for (ch = 0; ch < dp->channels; ch++) {
+      const adcstreamsample_t *x = adcStreamChannel(dp, ch) + i;
+      adcstreamsample_t min = ssp->acc[ch].min, max = ssp->acc[ch].max;
+      int64_t sum = 0;
+      uint64_t sumsq = 0;
+      size_t k;
+
+      for (k = 0; k < chunk; k++) {
+        adcstreamsample_t v = x[k];
+
+        min = v < min ? v : min;
+        max = v > max ? v : max;
+        sum += v;
+        sumsq += (uint64_t)((int64_t)v * v);
+      }
+      ssp->acc[ch].min    = min;
+      ssp->acc[ch].max    = max;
+      ssp->acc[ch].sum   += sum;
+      ssp->acc[ch].sumsq += sumsq;
+    }
+    ssp->count += chunk;
+    i += chunk;
+
+    if (ssp->count >= ssp->window) {
+      for (ch = 0; ch < dp->channels; ch++) {
+        ssp->last[ch].min  = ssp->acc[ch].min;
+        ssp->last[ch].max  = ssp->acc[ch].max;
+        ssp->last[ch].mean = (adcstreamsample_t)(ssp->acc[ch].sum /
+                                                 (int64_t)ssp->window);
+        ssp->last[ch].rms  = isqrt64(ssp->acc[ch].sumsq / ssp->window);
+        ssp->acc[ch].min   = INT32_MAX;
+        ssp->acc[ch].max   = INT32_MIN;
+        ssp->acc[ch].sum   = 0;
+        ssp->acc[ch].sumsq = 0;
+      }
+      ssp->count = 0;
+      ssp->windows++;
+      if (ssp->callback != NULL)
+        ssp->callback(ssp);
+    }
+  }
+}
+
+static void trigger_reset(void *instance, adc_channels_num_t channels) {
+  ADCStageTrigger *tsp = (ADCStageTrigger *)instance;
+
+  (void)channels;
+  tsp->above   = FALSE;
+  tsp->unknown = TRUE;
+  tsp->samples = 0;
+  tsp->rising  = 0;
+  tsp->falling = 0;
+}
+
+static void trigger_process(void *instance, ADCStreamData *dp) {
+  ADCStageTrigger *tsp = (ADCStageTrigger *)instance;
+  const adcstreamsample_t *x;
+  adcstreamsample_t high = tsp->level + tsp->hysteresis;
+  adcstreamsample_t low = tsp->level - tsp->hysteresis;
+  size_t i = 0;
+
+  chDbgAssert(tsp->channel < dp->channels,
+              "trigger_process(), #1", "invalid channel");
+
+  x = adcStreamChannel(dp, tsp->channel);
+  if (tsp->unknown && (dp->n > 0)) {
+    tsp->unknown = FALSE;
+    tsp->above = x[0] > tsp->level;
+  }
+  while (i < dp->n) {
+    /* Scans for the next crossing.*/
+    if (tsp->above) {
+      while ((i < dp->n) && (x[i] >= low))
+        i++;
+      if (i < dp->n) {
+        tsp->above = FALSE;
+        tsp->falling++;
+        if ((tsp->callback != NULL) && (tsp->edges & ADC_TRIGGER_FALLING))
+          tsp->callback(tsp, ADC_TRIGGER_FALLING, tsp->samples + i);
+      }
+    }
+    else {
+      while ((i < dp->n) && (x[i] <= high))
+        i++;
+      if (i < dp->n) {
+        tsp->above = TRUE;
+        tsp->rising++;
+        if ((tsp->callback != NULL) && (tsp->edges & ADC_TRIGGER_RISING))
+          tsp->callback(tsp, ADC_TRIGGER_RISING, tsp->samples + i);
+      }
+    }
+  }
+  tsp->samples += dp->n;
+}
+
+static void sink_reset(void *instance, adc_channels_num_t channels) {
+
+  (void)instance;
+  (void)channels;
+}
+
+static void sink_process(void *instance, ADCStreamData *dp) {
+  ADCStageSink *skp = (ADCStageSink *)instance;
+
+  skp->callback(skp, dp);
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes an ADC stream object.
+ *
+ * @param[out] asp      pointer to the @p ADCStream object
+ *
+ * @init
+ */
+void adcStreamObjectInit(ADCStream *asp) {
+
+  asp->state      = ADC_STREAM_STOP;
+  asp->config     = NULL;
+  asp->rows       = 0;
+  asp->wr         = 0;
+  asp->rd         = 0;
+  asp->converted  = 0;
+  asp->dropped    = 0;
+  asp->dropping   = FALSE;
+  asp->peak       = 0;
+  asp->errors     = 0;
+  asp->busy_worst = 0;
+  asp->busy_total = 0;
+  asp->thread     = NULL;
+  asp->idle       = FALSE;
+  chEvtInit(&asp->event);
+}
+
+/**
+ * @brief   Starts streaming.
+ * @details The stages are reset, the stream thread is started and a
+ *          circular conversion is started on the configured buffer.
+ * @note    The statistics counters are cleared.
+ *
+ * @param[in] asp       pointer to the @p ADCStream object
+ * @param[in] config    pointer to the @p ADCStreamConfig object
+ *
+ * @api
+ */
+void adcStreamStart(ADCStream *asp, const ADCStreamConfig *config) {
+  ADCStage * const *spp;
+
+  chDbgCheck((asp != NULL) && (config != NULL) && (config->adcp != NULL) &&
+             (config->grpp != NULL) && (config->buffer != NULL) &&
+             (config->depth >= 2) && ((config->depth & 1) == 0) &&
+             (config->pool != NULL) && (config->work != NULL) &&
+             (config->stages != NULL) &&
+             (config->nblocks >= 2) &&
+             (config->nblocks <= ADC_STREAM_MAX_BLOCKS) &&
+             ((config->nblocks & (config->nblocks - 1)) == 0) &&
+             (config->grpp->num_channels > 0) &&
+             (config->grpp->num_channels <= ADC_STREAM_MAX_CHANNELS),
+             "adcStreamStart");
+  chDbgAssert(asp->state == ADC_STREAM_STOP,
+              "adcStreamStart(), #1", "invalid state");
+
+  asp->config          = config;
+  asp->group           = *config->grpp;
+  asp->group.circular  = TRUE;
+  asp->group.end_cb    = stream_end_cb;
+  asp->group.error_cb  = stream_error_cb;
+  asp->rows            = config->depth / 2;
+  asp->wr              = 0;
+  asp->rd              = 0;
+  asp->converted       = 0;
+  asp->dropped         = 0;
+  asp->dropping        = FALSE;
+  asp->peak            = 0;
+  asp->errors          = 0;
+  asp->busy_worst      = 0;
+  asp->busy_total      = 0;
+  asp->idle            = FALSE;
+  for (spp = config->stages; *spp != NULL; spp++)
+    adcStageReset(*spp, asp->group.num_channels);
+
+  asp->state  = ADC_STREAM_ACTIVE;
+  asp->thread = chThdCreateStatic(asp->wa, sizeof(asp->wa), config->prio,
+                                  stream_thread, asp);
+  adcStartConversion(config->adcp, &asp->group, config->buffer,
+                     config->depth);
+}
+
+/**
+ * @brief   Stops streaming.
+ * @details The conversion is stopped, the blocks already in the pool are
+ *          processed before the thread terminates.
+ *
+ * @param[in] asp       pointer to the @p ADCStream object
+ *
+ * @api
+ */
+void adcStreamStop(ADCStream *asp) {
+
+  chDbgCheck(asp != NULL, "adcStreamStop");
+  chDbgAssert(asp->state == ADC_STREAM_ACTIVE,
+              "adcStreamStop(), #1", "invalid state");
+
+  adcStopConversion(asp->config->adcp);
+  chSysLock();
+  chThdTerminate(asp->thread);
+  if (asp->idle) {
+    asp->idle = FALSE;
+    chSchWakeupS(asp->thread, RDY_OK);
+  }
+  chSysUnlock();
+  chThdWait(asp->thread);
+  asp->thread = NULL;
+  asp->state  = ADC_STREAM_STOP;
+}
+
+/**
+ * @brief   Processes a block of samples through a chain of stages.
+ * @details This is the function used by the stream thread, it can be
+ *          used directly in order to run the stages on samples not
+ *          coming from an ADC.
+ * @note    The data buffers must have @p ADC_STREAM_HEADROOM samples in
+ *          front of each channel.
+ *
+ * @param[in] stages    @p NULL terminated array of stages
+ * @param[in,out] dp    pointer to the @p ADCStreamData object
+ *
+ * @api
+ */
+void adcStreamRun(ADCStage * const *stages, ADCStreamData *dp) {
+
+  while (*stages != NULL) {
+    adcStageProcess(*stages, dp);
+    stages++;
+  }
+}
+
+/**
+ * @brief   Initializes a CIC decimator stage.
+ * @details The output is shifted right by @p order times log2(@p ratio),
+ *          rounded up, so the gain is unitary when @p ratio is a power of
+ *          two and smaller otherwise.
+ *
+ * @param[out] csp      pointer to the @p ADCStageCIC object
+ * @param[in] order     number of sections, 1..@p ADC_CIC_MAX_ORDER
+ * @param[in] ratio     decimation ratio
+ *
+ * @init
+ */
+void adcStageCICObjectInit(ADCStageCIC *csp, unsigned order,
+                           unsigned ratio) {
+  unsigned bits = 0;
+
+  chDbgCheck((csp != NULL) && (order >= 1) &&
+             (order <= ADC_CIC_MAX_ORDER) && (ratio >= 1),
+             "adcStageCICObjectInit");
+
+  while ((1U << bits) < ratio)
+    bits++;
+  chDbgAssert(order * bits < 32, "adcStageCICObjectInit(), #1",
+              "gain too large");
+
+  csp->vmt   = &cic_vmt;
+  csp->order = order;
+  csp->ratio = ratio;
+  csp->shift = order * bits;
+  cic_reset(csp, ADC_STREAM_MAX_CHANNELS);
+}
+
+/**
+ * @brief   Initializes a FIR decimator stage.
+ *
+ * @param[out] fsp      pointer to the @p ADCStageFIR object
+ * @param[in] coeffs    Q15 coefficients, copied in the stage
+ * @param[in] ntaps     number of taps, 1..@p ADC_FIR_MAX_TAPS
+ * @param[in] ratio     decimation ratio, one for plain filtering
+ *
+ * @init
+ */
+void adcStageFIRObjectInit(ADCStageFIR *fsp, const int16_t *coeffs,
+                           unsigned ntaps, unsigned ratio) {
+  unsigned k;
+
+  chDbgCheck((fsp != NULL) && (coeffs != NULL) && (ntaps >= 1) &&
+             (ntaps <= ADC_FIR_MAX_TAPS) && (ratio >= 1),
+             "adcStageFIRObjectInit");
+
+  fsp->vmt   = &fir_vmt;
+  fsp->ntaps = ntaps;
+  fsp->ratio = ratio;
+  for (k = 0; k < ntaps; k++)
+    fsp->coeffs[k] = coeffs[ntaps - 1 - k];
+  fir_reset(fsp, ADC_STREAM_MAX_CHANNELS);
+}
+
+/**
+ * @brief   Initializes a statistics stage.
+ *
+ * @param[out] ssp      pointer to the @p ADCStageStats object
+ * @param[in] window    window length in samples
+ * @param[in] callback  window callback or @p NULL
+ *
+ * @init
+ */
+void adcStageStatsObjectInit(ADCStageStats *ssp, uint32_t window,
+                             adcstatscallback_t callback) {
+
+  chDbgCheck((ssp != NULL) && (window > 0), "adcStageStatsObjectInit");
+
+  ssp->vmt      = &stats_vmt;
+  ssp->window   = window;
+  ssp->callback = callback;
+  memset(ssp->last, 0, sizeof(ssp->last));
+  stats_reset(ssp, ADC_STREAM_MAX_CHANNELS);
+}
+
+/**
+ * @brief   Initializes a threshold trigger stage.
+ *
+ * @param[out] tsp      pointer to the @p ADCStageTrigger object
+ * @param[in] channel   monitored channel
+ * @param[in] level     trigger level
+ * @param[in] hysteresis hysteresis around the level
+ * @param[in] edges     edges reported to the callback, a mask of
+ *                      @p ADC_TRIGGER_RISING and @p ADC_TRIGGER_FALLING
+ * @param[in] callback  trigger callback or @p NULL
+ *
+ * @init
+ */
+void adcStageTriggerObjectInit(ADCStageTrigger *tsp,
+                               adc_channels_num_t channel,
+                               adcstreamsample_t level,
+                               adcstreamsample_t hysteresis,
+                               unsigned edges,
+                               adctriggercallback_t callback) {
+
+  chDbgCheck((tsp != NULL) && (channel < ADC_STREAM_MAX_CHANNELS) &&
+             (hysteresis >= 0), "adcStageTriggerObjectInit");
+
+  tsp->vmt        = &trigger_vmt;
+  tsp->channel    = channel;
+  tsp->level      = level;
+  tsp->hysteresis = hysteresis;
+  tsp->edges      = edges;
+  tsp->callback   = callback;
+  trigger_reset(tsp, ADC_STREAM_MAX_CHANNELS);
+}
+
+/**
+ * @brief   Initializes a sink stage.
+ *
+ * @param[out] skp      pointer to the @p ADCStageSink object
+ * @param[in] callback  sink callback
+ * @param[in] arg       callback argument
+ *
+ * @init
+ */
+void adcStageSinkObjectInit(ADCStageSink *skp, adcsinkcallback_t callback,
+                            void *arg) {
+
+  chDbgCheck((skp != NULL) && (callback != NULL), "adcStageSinkObjectInit");
+
+  skp->vmt      = &sink_vmt;
+  skp->callback = callback;
+  skp->arg      = arg;
+}
+
+#endif /* HAL_USE_ADC_STREAM */
+
+/** @} */
@@ -0,0 +1,520 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    blk_queue.c
+ * @brief   Block I/O request queue code.
+ *
+ * @addtogroup BLK_QUEUE
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+
+#if HAL_USE_BLOCK_QUEUE || defined(__DOXYGEN__)
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables and types.                                         */
+/*===========================================================================*/
+
+static bool_t bq_is_inserted(void *instance);
+static bool_t bq_is_protected(void *instance);
+static bool_t bq_connect(void *instance);
+static bool_t bq_disconnect(void *instance);
+static bool_t bq_read(void *instance, uint32_t startblk,
+                      uint8_t *buffer, uint32_t n);
+static bool_t bq_write(void *instance, uint32_t startblk,
+                       const uint8_t *buffer, uint32_t n);
+static bool_t bq_sync(void *instance);
+static bool_t bq_get_info(void *instance, BlockDeviceInfo *bdip);
+
+/**
+ * @brief   Virtual methods table.
+ */
+static const struct BlockQueueVMT bq_vmt = {
+  bq_is_inserted,
+  bq_is_protected,
+  bq_connect,
+  bq_disconnect,
+  bq_read,
+  bq_write,
+  bq_sync,
+  bq_get_info
+};
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+/**
+ * @brief   Checks if two requests must be executed in submission order.
+ * @details Reads never conflict with each other, a write conflicts with
+ *          any overlapping request and a synchronization with everything.
+ */
+static bool_t bq_conflict(const BlockRequest *a, const BlockRequest *b) {
+
+  if ((a->op == BQ_OP_SYNC) || (b->op == BQ_OP_SYNC))
+    return TRUE;
+  if ((a->op == BQ_OP_READ) && (b->op == BQ_OP_READ))
+    return FALSE;
+  return (a->startblk < b->startblk + b->n) &&
+         (b->startblk < a->startblk + a->n);
+}
+
+/**
+ * @brief   Checks a request against all the requests in a list.
+ */
+static bool_t bq_conflict_list(const BlockRequest *brp,
+                               const BlockRequest *list) {
+
+  while (list != NULL) {
+    if (bq_conflict(brp, list))
+      return TRUE;
+    list = list->next;
+  }
+  return FALSE;
+}
+
+/**
+ * @brief   Inserts a request in the pending list, ordered by address.
+ */
+static void bq_insert_pending(BlockQueue *bqp, BlockRequest *brp) {
+  BlockRequest **pp = &bqp->pending;
+
+  while ((*pp != NULL) && ((*pp)->startblk <= brp->startblk))
+    pp = &(*pp)->next;
+  brp->state = BQ_REQ_PENDING;
+  brp->next = *pp;
+  *pp = brp;
+}
+
+/**
+ * @brief   Moves the waiting requests no more in conflict to the pending
+ *          list.
+ * @details The waiting list is served in FIFO order, a request is never
+ *          moved before an older waiting one.
+ */
+static void bq_promote(BlockQueue *bqp) {
+
+  while ((bqp->waiting != NULL) &&
+         !bq_conflict_list(bqp->waiting, bqp->pending)) {
+    BlockRequest *brp = bqp->waiting;
+
+    bqp->waiting = brp->next;
+    bq_insert_pending(bqp, brp);
+  }
+}
+
+/**
+ * @brief   Moves the next batch of requests from the pending list to the
+ *          active list.
+ * @details The elevator serves the request following the current position,
+ *          wrapping to the lowest address when the end is reached. Pending
+ *          requests of the same kind addressing the following blocks with
+ *          a contiguous buffer are merged into a single device transfer.
+ *
+ * @return              The number of blocks of the batch.
+ */
+static uint32_t bq_select(BlockQueue *bqp) {
+  BlockRequest **pp = &bqp->pending;
+  BlockRequest *brp, *last;
+  uint32_t n;
+
+  while ((*pp != NULL) && ((*pp)->startblk < bqp->position))
+    pp = &(*pp)->next;
+  if (*pp == NULL)
+    pp = &bqp->pending;
+
+  brp = *pp;
+  *pp = brp->next;
+  brp->state = BQ_REQ_ACTIVE;
+  bqp->active = last = brp;
+  n = brp->n;
+
+  /* The successor in address order is now at the same link.*/
+  while ((brp->op != BQ_OP_SYNC) && (bqp->blk_size > 0) && (*pp != NULL)) {
+    BlockRequest *nextp = *pp;
+
+    if ((nextp->op != brp->op) ||
+        (nextp->startblk != brp->startblk + n) ||
+        (nextp->buf != brp->buf + n * bqp->blk_size) ||
+        (n + nextp->n > BQ_MAX_MERGE_BLOCKS))
+      break;
+    *pp = nextp->next;
+    nextp->state = BQ_REQ_ACTIVE;
+    last->next = nextp;
+    last = nextp;
+    n += nextp->n;
+  }
+  last->next = NULL;
+  return n;
+}
+
+/**
+ * @brief   Completes a request.
+ * @details The callback is invoked first, then the waiting thread is
+ *          resumed and the completion event is broadcast.
+ */
+static void bq_complete(BlockQueue *bqp, BlockRequest *brp, bool_t result) {
+
+  brp->result = result;
+  if (brp->callback != NULL)
+    brp->callback(bqp, brp);
+
+  chSysLock();
+  bqp->requests++;
+  /* The callback could have resubmitted the request.*/
+  if (brp->state == BQ_REQ_ACTIVE) {
+    brp->state = BQ_REQ_DONE;
+    if (brp->thread != NULL) {
+      Thread *tp = brp->thread;
+
+      brp->thread = NULL;
+      chSchReadyI(tp)->p_u.rdymsg = RDY_OK;
+    }
+  }
+  chEvtBroadcastI(&bqp->event);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Queue thread.
+ */
+static msg_t bq_thread(void *arg) {
+  BlockQueue *bqp = (BlockQueue *)arg;
+  BaseBlockDevice *bbdp = bqp->config->bbdp;
+
+  chRegSetThreadName("blk_queue");
+
+  while (TRUE) {
+    BlockRequest *brp;
+    uint32_t n;
+    bool_t result;
+
+    chSysLock();
+    while (bqp->pending == NULL) {
+      if (chThdShouldTerminate()) {
+        chSysUnlock();
+        return 0;
+      }
+      bqp->idle = TRUE;
+      chSchGoSleepS(THD_STATE_SUSPENDED);
+    }
+    n = bq_select(bqp);
+    brp = bqp->active;
+    chSysUnlock();
+
+    /* The block size is required for merging, it is retrieved as soon as
+       the device is able to report it.*/
+    if (bqp->blk_size == 0) {
+      BlockDeviceInfo bdi;
+
+      if (blkGetInfo(bbdp, &bdi) == CH_SUCCESS)
+        bqp->blk_size = bdi.blk_size;
+    }
+
+    switch (brp->op) {
+    case BQ_OP_READ:
+      bqp->state = BLK_READING;
+      result = blkRead(bbdp, brp->startblk, brp->buf, n);
+      break;
+    case BQ_OP_WRITE:
+      bqp->state = BLK_WRITING;
+      result = blkWrite(bbdp, brp->startblk, brp->buf, n);
+      break;
+    default:
+      bqp->state = BLK_SYNCING;
+      result = blkSync(bbdp);
+      break;
+    }
+    bqp->state = BLK_READY;
+    bqp->transfers++;
+    if (brp->op != BQ_OP_SYNC)
+      bqp->position = brp->startblk + n;
+
+    /* The completed requests no more hold back the waiting ones.*/
+    chSysLock();
+    bqp->active = NULL;
+    bq_promote(bqp);
+    chSysUnlock();
+
+    while (brp != NULL) {
+      BlockRequest *nextp = brp->next;
+
+      bq_complete(bqp, brp, result);
+      brp = nextp;
+    }
+  }
+  return 0;
+}
+
+static bool_t bq_is_inserted(void *instance) {
+
+  return blkIsInserted(((BlockQueue *)instance)->config->bbdp);
+}
+
+static bool_t bq_is_protected(void *instance) {
+
+  return blkIsWriteProtected(((BlockQueue *)instance)->config->bbdp);
+}
+
+static bool_t bq_connect(void *instance) {
+
+  return blkConnect(((BlockQueue *)instance)->config->bbdp);
+}
+
+static bool_t bq_disconnect(void *instance) {
+
+  return blkDisconnect(((BlockQueue *)instance)->config->bbdp);
+}
+
+static bool_t bq_read(void *instance, uint32_t startblk,
+                      uint8_t *buffer, uint32_t n) {
+  BlockRequest req;
+
+  bqStartRead((BlockQueue *)instance, &req, startblk, buffer, n, NULL);
+  return bqWait(&req);
+}
+
+static bool_t bq_write(void *instance, uint32_t startblk,
+                       const uint8_t *buffer, uint32_t n) {
+  BlockRequest req;
+
+  bqStartWrite((BlockQueue *)instance, &req, startblk, buffer, n, NULL);
+  return bqWait(&req);
+}
+
+static bool_t bq_sync(void *instance) {
+  BlockRequest req;
+
+  bqStartSync((BlockQueue *)instance, &req, NULL);
+  return bqWait(&req);
+}
+
+static bool_t bq_get_info(void *instance, BlockDeviceInfo *bdip) {
+
+  return blkGetInfo(((BlockQueue *)instance)->config->bbdp, bdip);
+}
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   Initializes a generic block queue object.
+ *
+ * @param[out] bqp      pointer to the @p BlockQueue object
+ *
+ * @init
+ */
+void bqObjectInit(BlockQueue *bqp) {
+
+  bqp->vmt       = &bq_vmt;
+  bqp->state     = BLK_STOP;
+  bqp->config    = NULL;
+  bqp->pending   = NULL;
+  bqp->waiting   = NULL;
+  bqp->active    = NULL;
+  bqp->blk_size  = 0;
+  bqp->position  = 0;
+  bqp->thread    = NULL;
+  bqp->idle      = FALSE;
+  bqp->requests  = 0;
+  bqp->transfers = 0;
+  chEvtInit(&bqp->event);
+}
+
+/**
+ * @brief   Starts the queue thread.
+ * @details The block device is not connected by this function, the
+ *          application can connect it before or after starting the queue
+ *          using @p blkConnect() on either object.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[in] config    pointer to the @p BlockQueueConfig object
+ *
+ * @api
+ */
+void bqStart(BlockQueue *bqp, const BlockQueueConfig *config) {
+
+  chDbgCheck((bqp != NULL) && (config != NULL), "bqStart");
+  chDbgAssert(bqp->state == BLK_STOP, "bqStart(), #1", "invalid state");
+
+  bqp->config   = config;
+  bqp->blk_size = 0;
+  bqp->position = 0;
+  bqp->idle     = FALSE;
+  bqp->state    = BLK_READY;
+  bqp->thread   = chThdCreateStatic(bqp->wa, sizeof(bqp->wa), config->prio,
+                                    bq_thread, bqp);
+}
+
+/**
+ * @brief   Stops the queue thread.
+ * @details The already submitted requests are completed before the thread
+ *          terminates.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ *
+ * @api
+ */
+void bqStop(BlockQueue *bqp) {
+
+  chDbgCheck(bqp != NULL, "bqStop");
+  chDbgAssert(bqp->state == BLK_READY, "bqStop(), #1", "invalid state");
+
+  chSysLock();
+  chThdTerminate(bqp->thread);
+  if (bqp->idle) {
+    bqp->idle = FALSE;
+    chSchWakeupS(bqp->thread, RDY_OK);
+  }
+  chSysUnlock();
+  chThdWait(bqp->thread);
+  bqp->thread = NULL;
+  bqp->state  = BLK_STOP;
+}
+
+/**
+ * @brief   Submits a request.
+ * @details The request fields @p op, @p startblk, @p n, @p buf and
+ *          @p callback must be already initialized. The request is
+ *          dispatched when it cannot change the result of the requests
+ *          submitted before it, overlapping requests are executed in
+ *          submission order.
+ * @note    The request descriptor must not be modified until completion.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[in] brp       pointer to the @p BlockRequest object
+ *
+ * @iclass
+ */
+void bqSubmitI(BlockQueue *bqp, BlockRequest *brp) {
+
+  chDbgCheckClassI();
+  chDbgCheck((bqp != NULL) && (brp != NULL), "bqSubmitI");
+  chDbgAssert(bqp->state != BLK_STOP, "bqSubmitI(), #1", "not started");
+
+  brp->thread = NULL;
+  if (bq_conflict_list(brp, bqp->pending) ||
+      bq_conflict_list(brp, bqp->waiting)) {
+    BlockRequest **pp = &bqp->waiting;
+
+    while (*pp != NULL)
+      pp = &(*pp)->next;
+    brp->state = BQ_REQ_WAITING;
+    brp->next = NULL;
+    *pp = brp;
+  }
+  else
+    bq_insert_pending(bqp, brp);
+
+  if (bqp->idle) {
+    bqp->idle = FALSE;
+    chSchReadyI(bqp->thread);
+  }
+}
+
+/**
+ * @brief   Initializes and submits a request.
+ * @note    The queue thread is not preempting the caller if it has the
+ *          same priority, requests submitted in a burst can be merged.
+ *
+ * @param[in] bqp       pointer to the @p BlockQueue object
+ * @param[out] brp      pointer to the @p BlockRequest object
+ * @param[in] op        request operation
+ * @param[in] startblk  first block
+ * @param[in] buf       pointer to the data buffer
+ * @param[in] n         number of blocks
+ * @param[in] callback  completion callback or @p NULL
+ *
+ * @api
+ */
+void bqSubmit(BlockQueue *bqp, BlockRequest *brp, uint8_t op,
+              uint32_t startblk, uint8_t *buf, uint32_t n,
+              bqcallback_t callback) {
+
+  chDbgCheck((op == BQ_OP_SYNC) || ((buf != NULL) && (n > 0)), "bqSubmit");
+
+  brp->op       = op;
+  brp->startblk = startblk;
+  brp->n        = n;
+  brp->buf      = buf;
+  brp->callback = callback;
+  chSysLock();
+  bqSubmitI(bqp, brp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Waits for the completion of a request.
+ *
+ * @param[in] brp       pointer to the @p BlockRequest object
+ * @return              The operation status.
+ * @retval CH_SUCCESS   operation succeeded.
+ * @retval CH_FAILED    operation failed.
+ *
+ * @sclass
+ */
+bool_t bqWaitS(BlockRequest *brp) {
+
+  chDbgCheckClassS();
+  chDbgAssert(brp->thread == NULL, "bqWaitS(), #1", "already waited");
+
+  if (brp->state != BQ_REQ_DONE) {
+    brp->thread = chThdSelf();
+    chSchGoSleepS(THD_STATE_SUSPENDED);
+  }
+  return brp->result;
+}
+
+/**
+ * @brief   Waits for the completion of a request.
+ *
+ * @param[in] brp       pointer to the @p BlockRequest object
+ * @return              The operation status.
+ * @retval CH_SUCCESS   operation succeeded.
+ * @retval CH_FAILED    operation failed.
+ *
+ * @api
+ */
+bool_t bqWait(BlockRequest *brp) {
+  bool_t result;
+
+  chSysLock();
+  result = bqWaitS(brp);
+  chSysUnlock();
+  return result;
+}
+
+#endif /* HAL_USE_BLOCK_QUEUE */
+
+/** @} */
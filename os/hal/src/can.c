@@ -47,6 +47,88 @@
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#if CAN_USE_RX_FIFO || defined(__DOXYGEN__)
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+#define can_timestamp() halGetCounterValue()
+#else
+#define can_timestamp() chTimeNow()
+#endif
+
+/**
+ * @brief   Waits for the receive FIFO to become non-empty.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] timeout   the number of ticks before the operation timeouts
+ * @return              The operation result.
+ *
+ * @sclass
+ */
+static msg_t rx_fifo_wait(CANDriver *canp, systime_t timeout) {
+
+  while ((canp->state == CAN_SLEEP) || (canp->rxwr == canp->rxrd)) {
+    msg_t msg = chSemWaitTimeoutS(&canp->rxsem, timeout);
+    if (msg != RDY_OK)
+      return msg;
+  }
+  return RDY_OK;
+}
+#endif /* CAN_USE_RX_FIFO */
+
+#if CAN_USE_RX_FILTER || defined(__DOXYGEN__)
+/**
+ * @brief   Hash table bucket of a route key.
+ */
+#define key_bucket(key)                                                     \
+  ((((key) * 2654435761U) >> 16) & (CAN_RX_FILTER_BUCKETS - 1))
+
+/**
+ * @brief   Route key of a received frame.
+ */
+#define frame_key(crfp)                                                     \
+  ((crfp)->IDE ? (uint32_t)(crfp)->EID | 0x80000000U : (uint32_t)(crfp)->SID)
+
+/**
+ * @brief   Looks up a route.
+ *
+ * @param[in] cfp       pointer to the @p CANRxFilter object
+ * @param[in] key       route key
+ * @return              The route or @p NULL if not found.
+ *
+ * @notapi
+ */
+static CANRxRoute *route_lookup(CANRxFilter *cfp, uint32_t key) {
+  CANRxRoute *crp = cfp->buckets[key_bucket(key)];
+
+  while ((crp != NULL) && (crp->key != key))
+    crp = crp->next;
+  return crp;
+}
+
+/**
+ * @brief   Posts a timestamped copy of a frame to a route mailbox.
+ *
+ * @param[in] crp       pointer to the @p CANRxRoute object
+ * @param[in] crfp      pointer to the received frame
+ * @param[in] time      arrival timestamp
+ *
+ * @iclass
+ */
+static void route_postI(CANRxRoute *crp, const CANRxFrame *crfp,
+                        cantime_t time) {
+  CANRxStamped *csp;
+
+  if ((chMBGetFreeCountI(crp->mbp) <= 0) ||
+      ((csp = chPoolAllocI(crp->mp)) == NULL)) {
+    crp->dropped++;
+    return;
+  }
+  csp->time  = time;
+  csp->frame = *crfp;
+  (void)chMBPostI(crp->mbp, (msg_t)csp);
+  crp->frames++;
+}
+#endif /* CAN_USE_RX_FILTER */
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -83,6 +165,16 @@ void canObjectInit(CANDriver *canp) {
   chEvtInit(&canp->sleep_event);
   chEvtInit(&canp->wakeup_event);
 #endif /* CAN_USE_SLEEP_MODE */
+#if CAN_USE_RX_FIFO
+  canp->rxwr        = 0;
+  canp->rxrd        = 0;
+  canp->rxpeak      = 0;
+  canp->rxoverflows = 0;
+#endif /* CAN_USE_RX_FIFO */
+#if CAN_USE_RX_FILTER
+  canp->rxfilter    = NULL;
+  canp->rxrejected  = 0;
+#endif /* CAN_USE_RX_FILTER */
 }
 
 /**
@@ -131,6 +223,9 @@ void canStop(CANDriver *canp) {
   chDbgAssert((canp->state == CAN_STOP) || (canp->state == CAN_READY),
               "canStop(), #1", "invalid state");
   can_lld_stop(canp);
+#if CAN_USE_RX_FIFO
+  canp->rxrd = canp->rxwr;
+#endif /* CAN_USE_RX_FIFO */
   chSemResetI(&canp->rxsem, 0);
   chSemResetI(&canp->txsem, 0);
   chSchRescheduleS();
@@ -186,6 +281,9 @@ msg_t canTransmit(CANDriver *canp,
  * @brief   Can frame receive.
  * @details The function waits until a frame is received.
  * @note    Trying to receive while in sleep mode simply enqueues the thread.
+ * @note    If @p CAN_USE_RX_FIFO is enabled the frames are taken from the
+ *          software FIFO in arrival order and the @p mailbox parameter is
+ *          ignored.
  *
  * @param[in] canp      pointer to the @p CANDriver object
  * @param[in] mailbox   mailbox number, @p CAN_ANY_MAILBOX for any mailbox
@@ -215,6 +313,16 @@ msg_t canReceive(CANDriver *canp,
   chSysLock();
   chDbgAssert((canp->state == CAN_READY) || (canp->state == CAN_SLEEP),
               "canReceive(), #1", "invalid state");
+#if CAN_USE_RX_FIFO
+  (void)mailbox;
+  {
+    msg_t msg = rx_fifo_wait(canp, timeout);
+    if (msg == RDY_OK)
+      *crfp = canp->rxfifo[canp->rxrd++ & (CAN_RX_FIFO_SIZE - 1)];
+    chSysUnlock();
+    return msg;
+  }
+#else /* !CAN_USE_RX_FIFO */
   while ((canp->state == CAN_SLEEP) || !can_lld_is_rx_nonempty(canp, mailbox)) {
     msg_t msg = chSemWaitTimeoutS(&canp->rxsem, timeout);
     if (msg != RDY_OK) {
@@ -225,6 +333,7 @@ msg_t canReceive(CANDriver *canp,
   can_lld_receive(canp, mailbox, crfp);
   chSysUnlock();
   return RDY_OK;
+#endif /* !CAN_USE_RX_FIFO */
 }
 
 #if CAN_USE_SLEEP_MODE || defined(__DOXYGEN__)
@@ -280,6 +389,313 @@ void canWakeup(CANDriver *canp) {
 }
 #endif /* CAN_USE_SLEEP_MODE */
 
+#if CAN_USE_RX_FIFO || defined(__DOXYGEN__)
+/**
+ * @brief   Multiple frames receive.
+ * @details The function waits until at least a frame is available in the
+ *          receive FIFO then returns all the buffered frames, up to @p n,
+ *          without waiting further.
+ * @pre     In order to use this function the option @p CAN_USE_RX_FIFO must
+ *          be enabled.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[out] crfp     pointer to an array of @p n frames
+ * @param[out] tsp      pointer to an array of @p n timestamps or @p NULL
+ * @param[in] n         maximum number of frames to be received
+ * @param[in] timeout   the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              The number of frames received, zero if the
+ *                      operation timed out or the driver has been stopped.
+ *
+ * @api
+ */
+size_t canReceiveN(CANDriver *canp,
+                   CANRxFrame *crfp,
+                   cantime_t *tsp,
+                   size_t n,
+                   systime_t timeout) {
+  size_t i = 0;
+
+  chDbgCheck((canp != NULL) && (crfp != NULL) && (n > 0), "canReceiveN");
+
+  chSysLock();
+  chDbgAssert((canp->state == CAN_READY) || (canp->state == CAN_SLEEP),
+              "canReceiveN(), #1", "invalid state");
+  if (rx_fifo_wait(canp, timeout) == RDY_OK) {
+    while ((i < n) && (canp->rxrd != canp->rxwr)) {
+      uint32_t idx = canp->rxrd++ & (CAN_RX_FIFO_SIZE - 1);
+
+      crfp[i] = canp->rxfifo[idx];
+      if (tsp != NULL)
+        tsp[i] = canp->rxtime[idx];
+      i++;
+    }
+  }
+  chSysUnlock();
+  return i;
+}
+
+/**
+ * @brief   Handles a received frame.
+ * @details This function is meant to be invoked by the low level driver
+ *          from its receive interrupt handler. The frame is timestamped,
+ *          matched against the software filter, if any, then either
+ *          posted to its route or buffered in the receive FIFO.
+ * @note    If the FIFO is full the frame is discarded, the overflows
+ *          counter is incremented and @p CAN_OVERFLOW_ERROR is broadcasted
+ *          on the @p error_event event source.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] crfp      pointer to the received frame
+ *
+ * @iclass
+ */
+void canRxIncomingI(CANDriver *canp, const CANRxFrame *crfp) {
+  cantime_t time = can_timestamp();
+  uint32_t n, idx;
+
+  chDbgCheckClassI();
+  chDbgCheck((canp != NULL) && (crfp != NULL), "canRxIncomingI");
+
+#if CAN_USE_RX_FILTER
+  if (canp->rxfilter != NULL) {
+    CANRxFilter *cfp = canp->rxfilter;
+    CANRxRoute *crp = NULL;
+
+    if (crfp->IDE) {
+      crp = route_lookup(cfp, frame_key(crfp));
+      if (crp == NULL) {
+        canp->rxrejected++;
+        return;
+      }
+    }
+    else {
+      if ((cfp->stdmap[crfp->SID >> 5] & (1U << (crfp->SID & 31))) == 0) {
+        canp->rxrejected++;
+        return;
+      }
+      if (cfp->routes > 0)
+        crp = route_lookup(cfp, frame_key(crfp));
+    }
+    if ((crp != NULL) && (crp->mbp != NULL)) {
+      route_postI(crp, crfp, time);
+      return;
+    }
+  }
+#endif /* CAN_USE_RX_FILTER */
+
+  n = canp->rxwr - canp->rxrd;
+  if (n >= CAN_RX_FIFO_SIZE) {
+    canp->rxoverflows++;
+    chEvtBroadcastFlagsI(&canp->error_event, CAN_OVERFLOW_ERROR);
+    return;
+  }
+  idx = canp->rxwr & (CAN_RX_FIFO_SIZE - 1);
+  canp->rxfifo[idx] = *crfp;
+  canp->rxtime[idx] = time;
+  canp->rxwr++;
+  if (++n > canp->rxpeak)
+    canp->rxpeak = n;
+
+  while (chSemGetCounterI(&canp->rxsem) < 0)
+    chSemSignalI(&canp->rxsem);
+  /* The event is only broadcasted when the FIFO becomes non-empty.*/
+  if (n == 1)
+    chEvtBroadcastFlagsI(&canp->rxfull_event, CAN_MAILBOX_TO_MASK(1));
+}
+#endif /* CAN_USE_RX_FIFO */
+
+#if CAN_USE_RX_FILTER || defined(__DOXYGEN__)
+/**
+ * @brief   Initializes a @p CANRxFilter object.
+ * @details The filter is initialized without routes, so no extended
+ *          identifiers are accepted.
+ *
+ * @param[out] cfp      pointer to the @p CANRxFilter object
+ * @param[in] acceptstd if @p TRUE all the standard identifiers are accepted
+ *
+ * @init
+ */
+void canFilterObjectInit(CANRxFilter *cfp, bool_t acceptstd) {
+  unsigned i;
+
+  chDbgCheck(cfp != NULL, "canFilterObjectInit");
+
+  for (i = 0; i < sizeof cfp->stdmap / sizeof cfp->stdmap[0]; i++)
+    cfp->stdmap[i] = acceptstd ? 0xFFFFFFFFU : 0;
+  for (i = 0; i < CAN_RX_FILTER_BUCKETS; i++)
+    cfp->buckets[i] = NULL;
+  cfp->routes = 0;
+}
+
+/**
+ * @brief   Accepts a range of standard identifiers.
+ * @details The accepted frames are buffered in the receive FIFO unless
+ *          a route exists for their identifier.
+ *
+ * @param[in] cfp       pointer to the @p CANRxFilter object
+ * @param[in] first     first identifier of the range
+ * @param[in] last      last identifier of the range, inclusive
+ *
+ * @api
+ */
+void canFilterAcceptStd(CANRxFilter *cfp, uint32_t first, uint32_t last) {
+
+  chDbgCheck((cfp != NULL) && (first <= last) && (last < 2048),
+             "canFilterAcceptStd");
+
+  chSysLock();
+  while (first <= last) {
+    cfp->stdmap[first >> 5] |= 1U << (first & 31);
+    first++;
+  }
+  chSysUnlock();
+}
+
+/**
+ * @brief   Initializes a @p CANRxRoute object.
+ *
+ * @param[out] crp      pointer to the @p CANRxRoute object
+ * @param[in] ide       @p TRUE for an extended identifier
+ * @param[in] id        routed identifier
+ * @param[in] mbp       destination mailbox, @p NULL if the frames just have
+ *                      to be accepted into the receive FIFO
+ * @param[in] mp        pool of @p CANRxStamped objects, it is required if
+ *                      a mailbox is specified
+ *
+ * @init
+ */
+void canRouteObjectInit(CANRxRoute *crp, bool_t ide, uint32_t id,
+                        Mailbox *mbp, MemoryPool *mp) {
+
+  chDbgCheck((crp != NULL) && (id < (ide ? 0x20000000U : 2048U)) &&
+             ((mbp == NULL) || (mp != NULL)), "canRouteObjectInit");
+
+  crp->next    = NULL;
+  crp->key     = ide ? id | 0x80000000U : id;
+  crp->mbp     = mbp;
+  crp->mp      = mp;
+  crp->frames  = 0;
+  crp->dropped = 0;
+}
+
+/**
+ * @brief   Adds a route to a filter.
+ * @note    A route for a standard identifier also accepts the identifier.
+ * @note    The filter can be attached to a running driver.
+ *
+ * @param[in] cfp       pointer to the @p CANRxFilter object
+ * @param[in] crp       pointer to the @p CANRxRoute object
+ *
+ * @api
+ */
+void canFilterAddRoute(CANRxFilter *cfp, CANRxRoute *crp) {
+  CANRxRoute **crpp;
+
+  chDbgCheck((cfp != NULL) && (crp != NULL), "canFilterAddRoute");
+
+  chSysLock();
+  crpp = &cfp->buckets[key_bucket(crp->key)];
+  chDbgAssert(route_lookup(cfp, crp->key) == NULL,
+              "canFilterAddRoute(), #1", "already routed");
+  crp->next = *crpp;
+  *crpp = crp;
+  if (crp->mbp != NULL)
+    cfp->routes++;
+  if ((crp->key & 0x80000000U) == 0)
+    cfp->stdmap[crp->key >> 5] |= 1U << (crp->key & 31);
+  chSysUnlock();
+}
+
+/**
+ * @brief   Removes a route from a filter.
+ * @note    A standard identifier stays accepted into the receive FIFO.
+ *
+ * @param[in] cfp       pointer to the @p CANRxFilter object
+ * @param[in] crp       pointer to the @p CANRxRoute object
+ *
+ * @api
+ */
+void canFilterRemoveRoute(CANRxFilter *cfp, CANRxRoute *crp) {
+  CANRxRoute **crpp;
+
+  chDbgCheck((cfp != NULL) && (crp != NULL), "canFilterRemoveRoute");
+
+  chSysLock();
+  crpp = &cfp->buckets[key_bucket(crp->key)];
+  while ((*crpp != NULL) && (*crpp != crp))
+    crpp = &(*crpp)->next;
+  chDbgAssert(*crpp != NULL, "canFilterRemoveRoute(), #1", "not routed");
+  if (*crpp != NULL) {
+    *crpp = crp->next;
+    if (crp->mbp != NULL)
+      cfp->routes--;
+  }
+  chSysUnlock();
+}
+
+/**
+ * @brief   Attaches a software filter to a driver.
+ *
+ * @param[in] canp      pointer to the @p CANDriver object
+ * @param[in] cfp       pointer to the @p CANRxFilter object, @p NULL
+ *                      accepts all the frames into the receive FIFO
+ *
+ * @api
+ */
+void canSetFilter(CANDriver *canp, CANRxFilter *cfp) {
+
+  chDbgCheck(canp != NULL, "canSetFilter");
+
+  chSysLock();
+  canp->rxfilter = cfp;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Receives a frame from a route.
+ * @details The frame and its timestamp are copied and the object posted
+ *          by the interrupt handler is returned to the route pool.
+ *
+ * @param[in] crp       pointer to the @p CANRxRoute object
+ * @param[out] crfp     pointer to the buffer where the CAN frame is copied
+ * @param[out] tsp      pointer to the timestamp or @p NULL
+ * @param[in] timeout   the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              The operation result.
+ * @retval RDY_OK       a frame has been received.
+ * @retval RDY_TIMEOUT  The operation has timed out.
+ * @retval RDY_RESET    The route mailbox has been reset.
+ *
+ * @api
+ */
+msg_t canRouteReceive(CANRxRoute *crp,
+                      CANRxFrame *crfp,
+                      cantime_t *tsp,
+                      systime_t timeout) {
+  CANRxStamped *csp;
+  msg_t msg;
+
+  chDbgCheck((crp != NULL) && (crp->mbp != NULL) && (crfp != NULL),
+             "canRouteReceive");
+
+  msg = chMBFetch(crp->mbp, (msg_t *)&csp, timeout);
+  if (msg == RDY_OK) {
+    *crfp = csp->frame;
+    if (tsp != NULL)
+      *tsp = csp->time;
+    chPoolFree(crp->mp, csp);
+  }
+  return msg;
+}
+#endif /* CAN_USE_RX_FILTER */
+
 #endif /* HAL_USE_CAN */
 
 /** @} */
@@ -31,6 +31,8 @@
 
 #include <string.h>
 
+#include <string.h>
+
 #include "ch.h"
 #include "hal.h"
 
@@ -96,6 +98,46 @@ static const uint8_t crc7_lookup_table[256] = {
   0x62, 0x6b, 0x70, 0x79
 };
 
+#if MMC_USE_CRC || defined(__DOXYGEN__)
+/**
+ * @brief   Lookup table for CRC-16 (based on polynomial x^16 + x^12 + x^5 + 1).
+ */
+static const uint16_t crc16_lookup_table[256] = {
+  0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50a5, 0x60c6, 0x70e7,
+  0x8108, 0x9129, 0xa14a, 0xb16b, 0xc18c, 0xd1ad, 0xe1ce, 0xf1ef,
+  0x1231, 0x0210, 0x3273, 0x2252, 0x52b5, 0x4294, 0x72f7, 0x62d6,
+  0x9339, 0x8318, 0xb37b, 0xa35a, 0xd3bd, 0xc39c, 0xf3ff, 0xe3de,
+  0x2462, 0x3443, 0x0420, 0x1401, 0x64e6, 0x74c7, 0x44a4, 0x5485,
+  0xa56a, 0xb54b, 0x8528, 0x9509, 0xe5ee, 0xf5cf, 0xc5ac, 0xd58d,
+  0x3653, 0x2672, 0x1611, 0x0630, 0x76d7, 0x66f6, 0x5695, 0x46b4,
+  0xb75b, 0xa77a, 0x9719, 0x8738, 0xf7df, 0xe7fe, 0xd79d, 0xc7bc,
+  0x48c4, 0x58e5, 0x6886, 0x78a7, 0x0840, 0x1861, 0x2802, 0x3823,
+  0xc9cc, 0xd9ed, 0xe98e, 0xf9af, 0x8948, 0x9969, 0xa90a, 0xb92b,
+  0x5af5, 0x4ad4, 0x7ab7, 0x6a96, 0x1a71, 0x0a50, 0x3a33, 0x2a12,
+  0xdbfd, 0xcbdc, 0xfbbf, 0xeb9e, 0x9b79, 0x8b58, 0xbb3b, 0xab1a,
+  0x6ca6, 0x7c87, 0x4ce4, 0x5cc5, 0x2c22, 0x3c03, 0x0c60, 0x1c41,
+  0xedae, 0xfd8f, 0xcdec, 0xddcd, 0xad2a, 0xbd0b, 0x8d68, 0x9d49,
+  0x7e97, 0x6eb6, 0x5ed5, 0x4ef4, 0x3e13, 0x2e32, 0x1e51, 0x0e70,
+  0xff9f, 0xefbe, 0xdfdd, 0xcffc, 0xbf1b, 0xaf3a, 0x9f59, 0x8f78,
+  0x9188, 0x81a9, 0xb1ca, 0xa1eb, 0xd10c, 0xc12d, 0xf14e, 0xe16f,
+  0x1080, 0x00a1, 0x30c2, 0x20e3, 0x5004, 0x4025, 0x7046, 0x6067,
+  0x83b9, 0x9398, 0xa3fb, 0xb3da, 0xc33d, 0xd31c, 0xe37f, 0xf35e,
+  0x02b1, 0x1290, 0x22f3, 0x32d2, 0x4235, 0x5214, 0x6277, 0x7256,
+  0xb5ea, 0xa5cb, 0x95a8, 0x8589, 0xf56e, 0xe54f, 0xd52c, 0xc50d,
+  0x34e2, 0x24c3, 0x14a0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+  0xa7db, 0xb7fa, 0x8799, 0x97b8, 0xe75f, 0xf77e, 0xc71d, 0xd73c,
+  0x26d3, 0x36f2, 0x0691, 0x16b0, 0x6657, 0x7676, 0x4615, 0x5634,
+  0xd94c, 0xc96d, 0xf90e, 0xe92f, 0x99c8, 0x89e9, 0xb98a, 0xa9ab,
+  0x5844, 0x4865, 0x7806, 0x6827, 0x18c0, 0x08e1, 0x3882, 0x28a3,
+  0xcb7d, 0xdb5c, 0xeb3f, 0xfb1e, 0x8bf9, 0x9bd8, 0xabbb, 0xbb9a,
+  0x4a75, 0x5a54, 0x6a37, 0x7a16, 0x0af1, 0x1ad0, 0x2ab3, 0x3a92,
+  0xfd2e, 0xed0f, 0xdd6c, 0xcd4d, 0xbdaa, 0xad8b, 0x9de8, 0x8dc9,
+  0x7c26, 0x6c07, 0x5c64, 0x4c45, 0x3ca2, 0x2c83, 0x1ce0, 0x0cc1,
+  0xef1f, 0xff3e, 0xcf5d, 0xdf7c, 0xaf9b, 0xbfba, 0x8fd9, 0x9ff8,
+  0x6e17, 0x7e36, 0x4e55, 0x5e74, 0x2e93, 0x3eb2, 0x0ed1, 0x1ef0
+};
+#endif /* MMC_USE_CRC */
+
 /*===========================================================================*/
 /* Driver local functions.                                                   */
 /*===========================================================================*/
@@ -103,33 +145,13 @@ static const uint8_t crc7_lookup_table[256] = {
 static bool_t mmc_read(void *instance, uint32_t startblk,
                 uint8_t *buffer, uint32_t n) {
 
-  if (mmcStartSequentialRead((MMCDriver *)instance, startblk))
-    return CH_FAILED;
-  while (n > 0) {
-    if (mmcSequentialRead((MMCDriver *)instance, buffer))
-      return CH_FAILED;
-    buffer += MMCSD_BLOCK_SIZE;
-    n--;
-  }
-  if (mmcStopSequentialRead((MMCDriver *)instance))
-      return CH_FAILED;
-  return CH_SUCCESS;
+  return mmcRead((MMCDriver *)instance, startblk, buffer, n);
 }
 
 static bool_t mmc_write(void *instance, uint32_t startblk,
                  const uint8_t *buffer, uint32_t n) {
 
-  if (mmcStartSequentialWrite((MMCDriver *)instance, startblk))
-      return CH_FAILED;
-  while (n > 0) {
-      if (mmcSequentialWrite((MMCDriver *)instance, buffer))
-          return CH_FAILED;
-      buffer += MMCSD_BLOCK_SIZE;
-      n--;
-  }
-  if (mmcStopSequentialWrite((MMCDriver *)instance))
-      return CH_FAILED;
-  return CH_SUCCESS;
+  return mmcWrite((MMCDriver *)instance, startblk, buffer, n);
 }
 
 /**
@@ -147,6 +169,23 @@ static uint8_t crc7(uint8_t crc, const uint8_t *buffer, size_t len) {
   return crc;
 }
 
+#if MMC_USE_CRC || defined(__DOXYGEN__)
+/**
+ * @brief Calculate the MMC standard CRC-16 based on a lookup table.
+ *
+ * @param[in] crc       start value for CRC
+ * @param[in] buffer    pointer to data buffer
+ * @param[in] len       length of data
+ * @return              Calculated CRC
+ */
+static uint16_t crc16(uint16_t crc, const uint8_t *buffer, size_t len) {
+
+  while (len--)
+    crc = (crc << 8) ^ crc16_lookup_table[(crc >> 8) ^ (*buffer++)];
+  return crc;
+}
+#endif /* MMC_USE_CRC */
+
 /**
  * @brief   Waits an idle condition.
  *
@@ -156,19 +195,21 @@ static uint8_t crc7(uint8_t crc, const uint8_t *buffer, size_t len) {
  */
 static void wait(MMCDriver *mmcp) {
   int i;
-  uint8_t buf[4];
+  uint8_t buf[MMC_POLL_CHUNK];
 
+  /* The card releases the bus when idle, the check is done on the last
+     byte of each chunk, the extra clocks are ignored by the card.*/
   for (i = 0; i < 16; i++) {
-    spiReceive(mmcp->config->spip, 1, buf);
-    if (buf[0] == 0xFF)
+    spiReceive(mmcp->config->spip, MMC_POLL_CHUNK, buf);
+    if (buf[MMC_POLL_CHUNK - 1] == 0xFF)
       return;
   }
   /* Looks like it is a long wait.*/
   while (TRUE) {
-    spiReceive(mmcp->config->spip, 1, buf);
-    if (buf[0] == 0xFF)
+    spiReceive(mmcp->config->spip, MMC_POLL_CHUNK, buf);
+    if (buf[MMC_POLL_CHUNK - 1] == 0xFF)
       break;
-#ifdef MMC_NICE_WAITING
+#if MMC_NICE_WAITING
     /* Trying to be nice with the other threads.*/
     chThdSleep(1);
 #endif
@@ -300,7 +341,7 @@ static uint8_t send_command_R3(MMCDriver *mmcp, uint8_t cmd, uint32_t arg,
  */
 static bool_t read_CxD(MMCDriver *mmcp, uint8_t cmd, uint32_t cxd[4]) {
   unsigned i;
-  uint8_t *bp, buf[16];
+  uint8_t *bp, buf[18];
 
   spiSelect(mmcp->config->spip);
   send_hdr(mmcp, cmd, 0);
@@ -315,7 +356,17 @@ static bool_t read_CxD(MMCDriver *mmcp, uint8_t cmd, uint32_t cxd[4]) {
     if (buf[0] == 0xFE) {
       uint32_t *wp;
 
-      spiReceive(mmcp->config->spip, 16, buf);
+      /* Register and CRC, then end of transaction.*/
+      spiReceive(mmcp->config->spip, 18, buf);
+      spiUnselect(mmcp->config->spip);
+
+#if MMC_USE_CRC
+      if (crc16(0, buf, 16) != (((uint16_t)buf[16] << 8) | buf[17])) {
+        mmcp->crc_errors++;
+        return CH_FAILED;
+      }
+#endif
+
       bp = buf;
       for (wp = &cxd[3]; wp >= cxd; wp--) {
         *wp = ((uint32_t)bp[0] << 24) | ((uint32_t)bp[1] << 16) |
@@ -323,13 +374,10 @@ static bool_t read_CxD(MMCDriver *mmcp, uint8_t cmd, uint32_t cxd[4]) {
         bp += 4;
       }
 
-      /* CRC ignored then end of transaction. */
-      spiIgnore(mmcp->config->spip, 2);
-      spiUnselect(mmcp->config->spip);
-
       return CH_SUCCESS;
     }
   }
+  spiUnselect(mmcp->config->spip);
   return CH_FAILED;
 }
 
@@ -348,13 +396,162 @@ static void sync(MMCDriver *mmcp) {
     spiReceive(mmcp->config->spip, 1, buf);
     if (buf[0] == 0xFF)
       break;
-#ifdef MMC_NICE_WAITING
+#if MMC_NICE_WAITING
     chThdSleep(1);      /* Trying to be nice with the other threads.*/
 #endif
   }
   spiUnselect(mmcp->config->spip);
 }
 
+/**
+ * @brief   Starts a data transfer command.
+ * @details The card is left selected if the command is accepted.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ * @param[in] state     driver state during the transfer
+ * @param[in] cmd       the command id
+ * @param[in] startblk  first block of the transfer
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    the operation failed.
+ *
+ * @notapi
+ */
+static bool_t start_transfer(MMCDriver *mmcp, blkstate_t state,
+                             uint8_t cmd, uint32_t startblk) {
+
+  mmcp->state = state;
+
+  /* (Re)starting the SPI in case it has been reprogrammed externally, it can
+     happen if the SPI bus is shared among multiple peripherals.*/
+  spiStart(mmcp->config->spip, mmcp->config->hscfg);
+  spiSelect(mmcp->config->spip);
+
+  if (mmcp->block_addresses)
+    send_hdr(mmcp, cmd, startblk);
+  else
+    send_hdr(mmcp, cmd, startblk * MMCSD_BLOCK_SIZE);
+
+  if (recvr1(mmcp) != 0x00) {
+    spiUnselect(mmcp->config->spip);
+    spiStop(mmcp->config->spip);
+    mmcp->state = BLK_READY;
+    return CH_FAILED;
+  }
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Receives a data block.
+ * @details The start token is polled in chunks, the bytes following the
+ *          token in the last chunk are already part of the block, the rest
+ *          of the block is received with a single exchange.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ * @param[out] buffer   pointer to the block buffer
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    timeout, error token or CRC error.
+ *
+ * @notapi
+ */
+static bool_t read_block(MMCDriver *mmcp, uint8_t *buffer) {
+  unsigned i, k, cnt;
+  uint8_t buf[MMC_POLL_CHUNK];
+
+  for (i = 0; i < MMC_WAIT_DATA; i += MMC_POLL_CHUNK) {
+    spiReceive(mmcp->config->spip, MMC_POLL_CHUNK, buf);
+    for (k = 0; k < MMC_POLL_CHUNK; k++) {
+      if (buf[k] != 0xFF)
+        break;
+    }
+    if (k >= MMC_POLL_CHUNK)
+      continue;
+
+    /* Anything else than a start token is an error token.*/
+    if (buf[k] != 0xFE)
+      return CH_FAILED;
+
+    cnt = MMC_POLL_CHUNK - 1 - k;
+    memcpy(buffer, &buf[k + 1], cnt);
+    spiReceive(mmcp->config->spip, MMCSD_BLOCK_SIZE - cnt, buffer + cnt);
+    spiReceive(mmcp->config->spip, 2, buf);
+#if MMC_USE_CRC
+    if (crc16(0, buffer, MMCSD_BLOCK_SIZE) !=
+        (((uint16_t)buf[0] << 8) | buf[1])) {
+      mmcp->crc_errors++;
+      return CH_FAILED;
+    }
+#endif
+    return CH_SUCCESS;
+  }
+  return CH_FAILED;
+}
+
+/**
+ * @brief   Terminates a multiple blocks read.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ *
+ * @notapi
+ */
+static void stop_read(MMCDriver *mmcp) {
+  /* The CRC7 is valid, it is checked if the card is in CRC mode.*/
+  static const uint8_t stopcmd[] = {0x40 | MMCSD_CMD_STOP_TRANSMISSION,
+                                    0, 0, 0, 0, 0x61, 0xFF};
+
+  spiSend(mmcp->config->spip, sizeof(stopcmd), stopcmd);
+/*  result = recvr1(mmcp) != 0x00;*/
+  /* Note, ignored r1 response, it can be not zero, unknown issue.*/
+  (void) recvr1(mmcp);
+}
+
+/**
+ * @brief   Transmits a data block.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ * @param[in] token     start token
+ * @param[in] buffer    pointer to the block buffer
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    the block has been rejected by the card.
+ *
+ * @notapi
+ */
+static bool_t write_block(MMCDriver *mmcp, uint8_t token,
+                          const uint8_t *buffer) {
+  uint8_t prologue[2], epilogue[3], response[3];
+
+  prologue[0] = 0xFF;
+  prologue[1] = token;
+#if MMC_USE_CRC
+  {
+    uint16_t crc = crc16(0, buffer, MMCSD_BLOCK_SIZE);
+
+    epilogue[0] = (uint8_t)(crc >> 8);
+    epilogue[1] = (uint8_t)crc;
+  }
+#else
+  epilogue[0] = 0xFF;                                   /* CRC ignored.     */
+  epilogue[1] = 0xFF;
+#endif
+  epilogue[2] = 0xFF;
+
+  spiSend(mmcp->config->spip, sizeof(prologue), prologue);  /* Prologue.    */
+  spiSend(mmcp->config->spip, MMCSD_BLOCK_SIZE, buffer);    /* Data.        */
+  spiExchange(mmcp->config->spip, sizeof(epilogue),         /* CRC and data */
+              epilogue, response);                          /* response.    */
+  if ((response[2] & 0x1F) == 0x05) {
+    wait(mmcp);
+    return CH_SUCCESS;
+  }
+#if MMC_USE_CRC
+  if ((response[2] & 0x1F) == 0x0B)
+    mmcp->crc_errors++;
+#endif
+  return CH_FAILED;
+}
+
 /*===========================================================================*/
 /* Driver exported functions.                                                */
 /*===========================================================================*/
@@ -383,6 +580,9 @@ void mmcObjectInit(MMCDriver *mmcp) {
   mmcp->state = BLK_STOP;
   mmcp->config = NULL;
   mmcp->block_addresses = FALSE;
+#if MMC_USE_CRC
+  mmcp->crc_errors = 0;
+#endif
 }
 
 /**
@@ -512,6 +712,12 @@ bool_t mmcConnect(MMCDriver *mmcp) {
                       MMCSD_BLOCK_SIZE) != 0x00)
     goto failed;
 
+#if MMC_USE_CRC
+  /* Enabling the CRC verification on the card side.*/
+  if (send_command_R1(mmcp, MMCSD_CMD_CRC_ON_OFF, 1) != 0x00)
+    goto failed;
+#endif
+
   /* Determine capacity.*/
   if (read_CxD(mmcp, MMCSD_CMD_SEND_CSD, mmcp->csd))
     goto failed;
@@ -586,24 +792,8 @@ bool_t mmcStartSequentialRead(MMCDriver *mmcp, uint32_t startblk) {
               "mmcStartSequentialRead(), #1", "invalid state");
 
   /* Read operation in progress.*/
-  mmcp->state = BLK_READING;
-
-  /* (Re)starting the SPI in case it has been reprogrammed externally, it can
-     happen if the SPI bus is shared among multiple peripherals.*/
-  spiStart(mmcp->config->spip, mmcp->config->hscfg);
-  spiSelect(mmcp->config->spip);
-
-  if (mmcp->block_addresses)
-    send_hdr(mmcp, MMCSD_CMD_READ_MULTIPLE_BLOCK, startblk);
-  else
-    send_hdr(mmcp, MMCSD_CMD_READ_MULTIPLE_BLOCK, startblk * MMCSD_BLOCK_SIZE);
-
-  if (recvr1(mmcp) != 0x00) {
-    spiStop(mmcp->config->spip);
-    mmcp->state = BLK_READY;
-    return CH_FAILED;
-  }
-  return CH_SUCCESS;
+  return start_transfer(mmcp, BLK_READING,
+                        MMCSD_CMD_READ_MULTIPLE_BLOCK, startblk);
 }
 
 /**
@@ -619,23 +809,17 @@ bool_t mmcStartSequentialRead(MMCDriver *mmcp, uint32_t startblk) {
  * @api
  */
 bool_t mmcSequentialRead(MMCDriver *mmcp, uint8_t *buffer) {
-  int i;
 
   chDbgCheck((mmcp != NULL) && (buffer != NULL), "mmcSequentialRead");
 
   if (mmcp->state != BLK_READING)
     return CH_FAILED;
 
-  for (i = 0; i < MMC_WAIT_DATA; i++) {
-    spiReceive(mmcp->config->spip, 1, buffer);
-    if (buffer[0] == 0xFE) {
-      spiReceive(mmcp->config->spip, MMCSD_BLOCK_SIZE, buffer);
-      /* CRC ignored. */
-      spiIgnore(mmcp->config->spip, 2);
-      return CH_SUCCESS;
-    }
-  }
-  /* Timeout.*/
+  if (read_block(mmcp, buffer) == CH_SUCCESS)
+    return CH_SUCCESS;
+
+  /* Timeout or data error.*/
+  stop_read(mmcp);
   spiUnselect(mmcp->config->spip);
   spiStop(mmcp->config->spip);
   mmcp->state = BLK_READY;
@@ -654,18 +838,13 @@ bool_t mmcSequentialRead(MMCDriver *mmcp, uint8_t *buffer) {
  * @api
  */
 bool_t mmcStopSequentialRead(MMCDriver *mmcp) {
-  static const uint8_t stopcmd[] = {0x40 | MMCSD_CMD_STOP_TRANSMISSION,
-                                    0, 0, 0, 0, 1, 0xFF};
 
   chDbgCheck(mmcp != NULL, "mmcStopSequentialRead");
 
   if (mmcp->state != BLK_READING)
     return CH_FAILED;
 
-  spiSend(mmcp->config->spip, sizeof(stopcmd), stopcmd);
-/*  result = recvr1(mmcp) != 0x00;*/
-  /* Note, ignored r1 response, it can be not zero, unknown issue.*/
-  (void) recvr1(mmcp);
+  stop_read(mmcp);
 
   /* Read operation finished.*/
   spiUnselect(mmcp->config->spip);
@@ -692,22 +871,8 @@ bool_t mmcStartSequentialWrite(MMCDriver *mmcp, uint32_t startblk) {
               "mmcStartSequentialWrite(), #1", "invalid state");
 
   /* Write operation in progress.*/
-  mmcp->state = BLK_WRITING;
-
-  spiStart(mmcp->config->spip, mmcp->config->hscfg);
-  spiSelect(mmcp->config->spip);
-  if (mmcp->block_addresses)
-    send_hdr(mmcp, MMCSD_CMD_WRITE_MULTIPLE_BLOCK, startblk);
-  else
-    send_hdr(mmcp, MMCSD_CMD_WRITE_MULTIPLE_BLOCK,
-             startblk * MMCSD_BLOCK_SIZE);
-
-  if (recvr1(mmcp) != 0x00) {
-    spiStop(mmcp->config->spip);
-    mmcp->state = BLK_READY;
-    return CH_FAILED;
-  }
-  return CH_SUCCESS;
+  return start_transfer(mmcp, BLK_WRITING,
+                        MMCSD_CMD_WRITE_MULTIPLE_BLOCK, startblk);
 }
 
 /**
@@ -723,22 +888,14 @@ bool_t mmcStartSequentialWrite(MMCDriver *mmcp, uint32_t startblk) {
  * @api
  */
 bool_t mmcSequentialWrite(MMCDriver *mmcp, const uint8_t *buffer) {
-  static const uint8_t start[] = {0xFF, 0xFC};
-  uint8_t b[1];
 
   chDbgCheck((mmcp != NULL) && (buffer != NULL), "mmcSequentialWrite");
 
   if (mmcp->state != BLK_WRITING)
     return CH_FAILED;
 
-  spiSend(mmcp->config->spip, sizeof(start), start);    /* Data prologue.   */
-  spiSend(mmcp->config->spip, MMCSD_BLOCK_SIZE, buffer);/* Data.            */
-  spiIgnore(mmcp->config->spip, 2);                     /* CRC ignored.     */
-  spiReceive(mmcp->config->spip, 1, b);
-  if ((b[0] & 0x1F) == 0x05) {
-    wait(mmcp);
+  if (write_block(mmcp, 0xFC, buffer) == CH_SUCCESS)
     return CH_SUCCESS;
-  }
 
   /* Error.*/
   spiUnselect(mmcp->config->spip);
@@ -774,6 +931,99 @@ bool_t mmcStopSequentialWrite(MMCDriver *mmcp) {
   return CH_SUCCESS;
 }
 
+/**
+ * @brief   Reads one or more blocks.
+ * @details A single block is read using a single block command, multiple
+ *          blocks are streamed using a multiple blocks command.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ * @param[in] startblk  first block to read
+ * @param[out] buffer   pointer to the read buffer
+ * @param[in] n         number of blocks to read
+ *
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    the operation failed.
+ *
+ * @api
+ */
+bool_t mmcRead(MMCDriver *mmcp, uint32_t startblk,
+               uint8_t *buffer, uint32_t n) {
+  bool_t result = CH_SUCCESS;
+  uint32_t i;
+
+  chDbgCheck((mmcp != NULL) && (buffer != NULL) && (n > 0), "mmcRead");
+  chDbgAssert(mmcp->state == BLK_READY, "mmcRead(), #1", "invalid state");
+
+  if (start_transfer(mmcp, BLK_READING,
+                     n == 1 ? MMCSD_CMD_READ_SINGLE_BLOCK :
+                              MMCSD_CMD_READ_MULTIPLE_BLOCK,
+                     startblk))
+    return CH_FAILED;
+
+  for (i = 0; i < n; i++) {
+    if (read_block(mmcp, buffer)) {
+      result = CH_FAILED;
+      break;
+    }
+    buffer += MMCSD_BLOCK_SIZE;
+  }
+  if (n > 1)
+    stop_read(mmcp);
+
+  /* Read operation finished.*/
+  spiUnselect(mmcp->config->spip);
+  mmcp->state = BLK_READY;
+  return result;
+}
+
+/**
+ * @brief   Writes one or more blocks.
+ * @details A single block is written using a single block command, multiple
+ *          blocks are streamed using a multiple blocks command.
+ *
+ * @param[in] mmcp      pointer to the @p MMCDriver object
+ * @param[in] startblk  first block to write
+ * @param[in] buffer    pointer to the write buffer
+ * @param[in] n         number of blocks to write
+ *
+ * @return              The operation status.
+ * @retval CH_SUCCESS   the operation succeeded.
+ * @retval CH_FAILED    the operation failed.
+ *
+ * @api
+ */
+bool_t mmcWrite(MMCDriver *mmcp, uint32_t startblk,
+                const uint8_t *buffer, uint32_t n) {
+  static const uint8_t stop[] = {0xFD, 0xFF};
+  bool_t result = CH_SUCCESS;
+  uint32_t i;
+
+  chDbgCheck((mmcp != NULL) && (buffer != NULL) && (n > 0), "mmcWrite");
+  chDbgAssert(mmcp->state == BLK_READY, "mmcWrite(), #1", "invalid state");
+
+  if (start_transfer(mmcp, BLK_WRITING,
+                     n == 1 ? MMCSD_CMD_WRITE_BLOCK :
+                              MMCSD_CMD_WRITE_MULTIPLE_BLOCK,
+                     startblk))
+    return CH_FAILED;
+
+  for (i = 0; i < n; i++) {
+    if (write_block(mmcp, n == 1 ? 0xFE : 0xFC, buffer)) {
+      result = CH_FAILED;
+      break;
+    }
+    buffer += MMCSD_BLOCK_SIZE;
+  }
+  if (n > 1)
+    spiSend(mmcp->config->spip, sizeof(stop), stop);
+
+  /* Write operation finished.*/
+  spiUnselect(mmcp->config->spip);
+  mmcp->state = BLK_READY;
+  return result;
+}
+
 /**
  * @brief   Waits for card idle condition.
  *
@@ -26,6 +26,8 @@
  * @{
  */
 
+#include <string.h>
+
 #include "ch.h"
 #include "hal.h"
 
@@ -37,6 +39,12 @@
 /* Driver local definitions.                                                 */
 /*===========================================================================*/
 
+/**
+ * @brief   Maximum amount of data copied into a transmit buffer within a
+ *          single critical zone.
+ */
+#define TX_COPY_CHUNK               64
+
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
@@ -57,14 +65,138 @@ static cdc_linecoding_t linecoding = {
 /* Driver local functions.                                                   */
 /*===========================================================================*/
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER || defined(__DOXYGEN__)
+/**
+ * @brief   Wakes up all the threads waiting for transmit buffer space.
+ *
+ * @param[in] sdup      pointer to a @p SerialUSBDriver object
+ * @param[in] msg       wakeup message
+ *
+ * @iclass
+ */
+static void tx_wakeup_i(SerialUSBDriver *sdup, msg_t msg) {
+
+  while (notempty(&sdup->tbwaiting))
+    chSchReadyI(fifo_remove(&sdup->tbwaiting))->p_u.rdymsg = msg;
+}
+
+/**
+ * @brief   Starts the transmission of the buffer being filled.
+ * @details The buffers are swapped so that writers can continue filling
+ *          the other buffer while this one is in flight.
+ * @pre     The IN endpoint must be idle, this implies that the other
+ *          buffer is empty.
+ * @note    Setting up a linear transfer is short so it is performed
+ *          without leaving the critical zone.
+ *
+ * @param[in] sdup      pointer to a @p SerialUSBDriver object
+ *
+ * @iclass
+ */
+static void tx_flush_i(SerialUSBDriver *sdup) {
+  USBDriver *usbp = sdup->config->usbp;
+  unsigned i = sdup->tbfill;
+
+  if (chVTIsArmedI(&sdup->tbvt))
+    chVTResetI(&sdup->tbvt);
+
+  sdup->tbfill = i ^ 1;
+  usbPrepareTransmit(usbp, USB_CDC_DATA_REQUEST_EP,
+                     sdup->tb[i], sdup->tbcnt[i]);
+  usbStartTransmitI(usbp, USB_CDC_DATA_REQUEST_EP);
+}
+
+/**
+ * @brief   Coalescing timer callback.
+ *
+ * @param[in] p         pointer to a @p SerialUSBDriver object
+ */
+static void tx_timer_cb(void *p) {
+  SerialUSBDriver *sdup = p;
+  USBDriver *usbp = sdup->config->usbp;
+
+  chSysLockFromIsr();
+  if ((usbGetDriverStateI(usbp) == USB_ACTIVE) &&
+      !usbGetTransmitStatusI(usbp, USB_CDC_DATA_REQUEST_EP) &&
+      (sdup->tbcnt[sdup->tbfill] > 0))
+    tx_flush_i(sdup);
+  chSysUnlockFromIsr();
+}
+
+/**
+ * @brief   Writes data into the transmit buffers.
+ * @details Data is copied in chunks of @p TX_COPY_CHUNK bytes so that the
+ *          critical zone is bounded, a transfer is started immediately if
+ *          the buffer is full, else the coalescing timer is armed.
+ *
+ * @param[in] sdup      pointer to a @p SerialUSBDriver object
+ * @param[in] bp        pointer to the data buffer
+ * @param[in] n         the maximum amount of data to be transferred
+ * @param[in] time      the number of ticks before the operation timeouts
+ * @return              The number of bytes effectively transferred.
+ */
+static size_t tx_write(SerialUSBDriver *sdup, const uint8_t *bp,
+                       size_t n, systime_t time) {
+  USBDriver *usbp = sdup->config->usbp;
+  size_t w = 0;
+
+  chSysLock();
+  while (w < n) {
+    unsigned i = sdup->tbfill;
+    size_t chunk = SERIAL_USB_TX_BUFFER_SIZE - sdup->tbcnt[i];
+
+    if (chunk == 0) {
+      /* Both buffers in use, waiting for the in-flight one.*/
+      if (TIME_IMMEDIATE == time)
+        break;
+      currp->p_u.wtobjp = &sdup->tbwaiting;
+      queue_insert(currp, &sdup->tbwaiting);
+      if (chSchGoSleepTimeoutS(THD_STATE_WTQUEUE, time) != Q_OK)
+        break;
+      continue;
+    }
+
+    if (chunk > n - w)
+      chunk = n - w;
+    if (chunk > TX_COPY_CHUNK)
+      chunk = TX_COPY_CHUNK;
+    memcpy(&sdup->tb[i][sdup->tbcnt[i]], bp + w, chunk);
+    sdup->tbcnt[i] += chunk;
+    w += chunk;
+
+    /* If the endpoint is busy the data is picked up by the transmitted
+       callback, else the transfer starts now or after the coalescing
+       time.*/
+    if ((usbGetDriverStateI(usbp) == USB_ACTIVE) &&
+        !usbGetTransmitStatusI(usbp, USB_CDC_DATA_REQUEST_EP)) {
+      if ((SERIAL_USB_TX_COALESCE_TIME == 0) ||
+          (sdup->tbcnt[i] >= SERIAL_USB_TX_BUFFER_SIZE))
+        tx_flush_i(sdup);
+      else if (!chVTIsArmedI(&sdup->tbvt))
+        chVTSetI(&sdup->tbvt, SERIAL_USB_TX_COALESCE_TIME,
+                 tx_timer_cb, sdup);
+    }
+
+    chSysUnlock(); /* Gives a preemption chance in a controlled point.*/
+    chSysLock();
+  }
+  chSysUnlock();
+  return w;
+}
+#endif /* SERIAL_USB_USE_TX_DOUBLE_BUFFER */
+
 /*
  * Interface implementation.
  */
 
 static size_t write(void *ip, const uint8_t *bp, size_t n) {
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  return tx_write((SerialUSBDriver *)ip, bp, n, TIME_INFINITE);
+#else
   return chOQWriteTimeout(&((SerialUSBDriver *)ip)->oqueue, bp,
                           n, TIME_INFINITE);
+#endif
 }
 
 static size_t read(void *ip, uint8_t *bp, size_t n) {
@@ -75,7 +207,12 @@ static size_t read(void *ip, uint8_t *bp, size_t n) {
 
 static msg_t put(void *ip, uint8_t b) {
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  return tx_write((SerialUSBDriver *)ip, &b, 1, TIME_INFINITE) == 1 ?
+         Q_OK : Q_RESET;
+#else
   return chOQPutTimeout(&((SerialUSBDriver *)ip)->oqueue, b, TIME_INFINITE);
+#endif
 }
 
 static msg_t get(void *ip) {
@@ -85,7 +222,12 @@ static msg_t get(void *ip) {
 
 static msg_t putt(void *ip, uint8_t b, systime_t timeout) {
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  return tx_write((SerialUSBDriver *)ip, &b, 1, timeout) == 1 ?
+         Q_OK : Q_TIMEOUT;
+#else
   return chOQPutTimeout(&((SerialUSBDriver *)ip)->oqueue, b, timeout);
+#endif
 }
 
 static msg_t gett(void *ip, systime_t timeout) {
@@ -95,7 +237,11 @@ static msg_t gett(void *ip, systime_t timeout) {
 
 static size_t writet(void *ip, const uint8_t *bp, size_t n, systime_t time) {
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  return tx_write((SerialUSBDriver *)ip, bp, n, time);
+#else
   return chOQWriteTimeout(&((SerialUSBDriver *)ip)->oqueue, bp, n, time);
+#endif
 }
 
 static size_t readt(void *ip, uint8_t *bp, size_t n, systime_t time) {
@@ -138,6 +284,7 @@ static void inotify(GenericQueue *qp) {
   }
 }
 
+#if !SERIAL_USB_USE_TX_DOUBLE_BUFFER || defined(__DOXYGEN__)
 /**
  * @brief   Notification of data inserted into the output queue.
  */
@@ -164,6 +311,7 @@ static void onotify(GenericQueue *qp) {
     usbStartTransmitI(sdup->config->usbp, USB_CDC_DATA_REQUEST_EP);
   }
 }
+#endif /* !SERIAL_USB_USE_TX_DOUBLE_BUFFER */
 
 /*===========================================================================*/
 /* Driver exported functions.                                                */
@@ -194,7 +342,15 @@ void sduObjectInit(SerialUSBDriver *sdup) {
   chEvtInit(&sdup->event);
   sdup->state = SDU_STOP;
   chIQInit(&sdup->iqueue, sdup->ib, SERIAL_USB_BUFFERS_SIZE, inotify, sdup);
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  sdup->tbcnt[0] = 0;
+  sdup->tbcnt[1] = 0;
+  sdup->tbfill = 0;
+  queue_init(&sdup->tbwaiting);
+  sdup->tbvt.vt_func = NULL;
+#else
   chOQInit(&sdup->oqueue, sdup->ob, SERIAL_USB_BUFFERS_SIZE, onotify, sdup);
+#endif
 }
 
 /**
@@ -251,7 +407,16 @@ void sduConfigureHookI(USBDriver *usbp) {
   SerialUSBDriver *sdup = usbp->param;
 
   chIQResetI(&sdup->iqueue);
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  if (chVTIsArmedI(&sdup->tbvt))
+    chVTResetI(&sdup->tbvt);
+  sdup->tbcnt[0] = 0;
+  sdup->tbcnt[1] = 0;
+  sdup->tbfill = 0;
+  tx_wakeup_i(sdup, Q_RESET);
+#else
   chOQResetI(&sdup->oqueue);
+#endif
   chnAddFlagsI(sdup, CHN_CONNECTED);
 
   /* Starts the first OUT transaction immediately.*/
@@ -305,7 +470,9 @@ bool_t sduRequestsHook(USBDriver *usbp) {
  * @param[in] ep        endpoint number
  */
 void sduDataTransmitted(USBDriver *usbp, usbep_t ep) {
+#if !SERIAL_USB_USE_TX_DOUBLE_BUFFER
   size_t n;
+#endif
   SerialUSBDriver *sdup = usbp->param;
 
   (void)ep;
@@ -313,6 +480,24 @@ void sduDataTransmitted(USBDriver *usbp, usbep_t ep) {
   chSysLockFromIsr();
   chnAddFlagsI(sdup, CHN_OUTPUT_EMPTY);
 
+#if SERIAL_USB_USE_TX_DOUBLE_BUFFER
+  /* The in-flight buffer has been released.*/
+  sdup->tbcnt[sdup->tbfill ^ 1] = 0;
+  tx_wakeup_i(sdup, Q_OK);
+
+  if (sdup->tbcnt[sdup->tbfill] > 0) {
+    /* Data accumulated while the previous transfer was in flight, it is
+       sent immediately without waiting for the coalescing time.*/
+    tx_flush_i(sdup);
+  }
+  else if ((usbp->epc[ep]->in_state->txsize > 0) &&
+           !(usbp->epc[ep]->in_state->txsize &
+             (usbp->epc[ep]->in_maxsize - 1))) {
+    /* Zero sized packet after a transfer ending on a packet boundary.*/
+    usbPrepareTransmit(usbp, ep, NULL, 0);
+    usbStartTransmitI(usbp, ep);
+  }
+#else
   if ((n = chOQGetFullI(&sdup->oqueue)) > 0) {
     /* The endpoint cannot be busy, we are in the context of the callback,
        so it is safe to transmit without a check.*/
@@ -337,6 +522,7 @@ void sduDataTransmitted(USBDriver *usbp, usbep_t ep) {
     chSysLockFromIsr();
     usbStartTransmitI(usbp, ep);
   }
+#endif /* !SERIAL_USB_USE_TX_DOUBLE_BUFFER */
 
   chSysUnlockFromIsr();
 }
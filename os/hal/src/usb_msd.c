@@ -29,8 +29,6 @@
 #include "ch.h"
 #include "hal.h"
 #include "usb_msd.h"
-#include "chprintf.h"
-
 
 #if HAL_USE_MASS_STORAGE_USB || defined(__DOXYGEN__)
 
@@ -38,13 +36,6 @@
 /* Driver local definitions.                                                 */
 /*===========================================================================*/
 
-#define MSD_ENABLE_PERF_DEBUG_GPIOS    FALSE
-
-#define MSD_DEBUG   FALSE
-#define msd_debug_print(args ...) if (MSD_DEBUG) { chprintf(args); }
-
-
-
 #if HAL_USE_SERIAL_USB
 #  ifndef MSD_USB_DRIVER_EXT_FIELDS_NAME
 #    error "The serial usb driver and the mass storage driver both use the \
@@ -53,887 +44,1152 @@
 #  endif
 #endif
 
+/**
+ * @brief   Number of attempts on a failed block device read.
+ */
+#define MSD_READ_RETRIES            3
 
-
-#if !defined(MSD_RW_LED_ON)
-#define MSD_RW_LED_ON()
-#endif
-
-#if !defined(MSD_RW_LED_OFF)
-#define MSD_RW_LED_OFF()
-#endif
-
-
+/**
+ * @brief   Maximum number of ring buffers filled by a single block device
+ *          read.
+ * @details Half of the ring is left to the USB side so that the first
+ *          buffers are transmitted while the rest is still being read.
+ */
+#define MSD_READ_MAX_BUFFERS        ((MSD_NUM_BUFFERS + 1) / 2)
 
 /*===========================================================================*/
 /* Driver exported variables.                                                */
 /*===========================================================================*/
 
-extern const USBConfig msd_usb_config;
-
 /*===========================================================================*/
 /* Driver local variables and types.                                         */
 /*===========================================================================*/
 
-static BaseSequentialStream *chp = (BaseSequentialStream *)&SD2;
-
-static WORKING_AREA(waMassStorage, 1024);
-static WORKING_AREA(waMassStorageUSBTransfer, 1024);
-
-static msg_t MassStorageUSBTransferThd(void *arg);
-static msg_t MassStorageThd(void *arg);
-
-static Thread *msdThd = NULL;
-static Thread *msdUSBTransferThd = NULL;
-
-#define WAIT_ISR_SUCCESS                     0
-#define WAIT_ISR_BUSS_RESET_OR_RECONNECT     1
-static uint8_t WaitForISR(USBMassStorageDriver *msdp, const bool_t check_reset);
+static inline uint32_t swap_uint32(uint32_t val) {
 
-#define BLOCK_SIZE_INCREMENT        512
-#define BLOCK_WRITE_ITTERATION_COUNT    32
-
-typedef struct {
-  uint8_t is_transfer_done;
-  /*Number of blocks actually read from USB IN endpont that should be written to SD card*/
-  int num_blocks_to_write;
-  /*Number of blocks to read from USB IN endpoint*/
-  int max_blocks_to_read;
-  uint8_t buf[(BLOCK_SIZE_INCREMENT * BLOCK_WRITE_ITTERATION_COUNT)];
-} rw_usb_sd_buffer_t;
-
-static volatile rw_usb_sd_buffer_t rw_ping_pong_buffer[2];
-static uint8_t read_buffer[2][BLOCK_SIZE_INCREMENT];
-
-inline uint32_t swap_uint32( uint32_t val ) {
-    val = ((val << 8) & 0xFF00FF00 ) | ((val >> 8) & 0xFF00FF );
-    return ((val << 16) & 0xFFFF0000) | ((val >> 16) & 0x0000FFFF);
+  val = ((val << 8) & 0xFF00FF00) | ((val >> 8) & 0xFF00FF);
+  return ((val << 16) & 0xFFFF0000) | ((val >> 16) & 0x0000FFFF);
 }
 
 #define swap_uint16(x) ((((x) >> 8) & 0xff) | (((x) & 0xff) << 8))
 
-
-
-
-
 /*===========================================================================*/
-/* Driver exported functions.                                                */
+/* Driver local functions.                                                   */
 /*===========================================================================*/
 
+static inline void SCSISetSense(USBMassStorageDriver *msdp, uint8_t key,
+                                uint8_t acode, uint8_t aqual) {
 
+  msdp->lunp->sense.byte[2] = key;
+  msdp->lunp->sense.byte[12] = acode;
+  msdp->lunp->sense.byte[13] = aqual;
+}
+
+#if MSD_USE_LATENCY_HISTOGRAM || defined(__DOXYGEN__)
 /**
- * @brief
- *
- * @param[in] usbp            pointer to the @p USBDriver object
- * @param[in] bbdp            pointer to the @p BaseBlockDevice object, such as an SDCDriver object
- * @param[in] msdp            pointer to the @p USBMassStorageDriver object
- * @param[in] ms_ep_number    USB Endpoint Number to be used by the mass storage endpoint
+ * @brief   Returns the current time in @p MSD_LATENCY_FREQUENCY units.
  */
-void msdInit(USBDriver *usbp, BaseBlockDevice *bbdp, USBMassStorageDriver *msdp,
-             const usbep_t  ms_ep_number)
-{
-    uint8_t i;
-
-    msdp->usbp = usbp;
-    msdp->state = idle;
-    msdp->trigger_transfer_index = UINT32_MAX;
-    msdp->bbdp = bbdp;
-    msdp->ms_ep_number = ms_ep_number;
-
-    chEvtInit(&msdp->evt_connected);
-    chEvtInit(&msdp->evt_ejected);
-
-    /* Initialize binary semaphore as taken, will cause the thread to initially
-     * wait on the  */
-    chBSemInit(&msdp->bsem, TRUE);
-    /* Initialize binary semaphore as NOT taken */
-    chBSemInit(&msdp->usb_transfer_thread_bsem, FALSE);
-    chBSemInit(&msdp->mass_sorage_thd_bsem, FALSE);
-
-    /* Initialize sense values to zero */
-    for(i = 0; i < sizeof(scsi_sense_response_t); i++)
-        msdp->sense.byte[i] = 0x00;
-
-    /* Response code = 0x70, additional sense length = 0x0A */
-    msdp->sense.byte[0] = 0x70;
-    msdp->sense.byte[7] = 0x0A;
+static inline uint32_t msd_latency_now(void) {
 
-    /* make sure block device is working and get info */
-    while(TRUE) {
-        blkstate_t state = blkGetDriverState(bbdp);
-        if(state == BLK_READY)
-            break;
+#if HAL_IMPLEMENTS_COUNTERS
+  return (uint32_t)halGetCounterValue();
+#else
+  return (uint32_t)chTimeNow();
+#endif
+}
 
-        chThdSleepMilliseconds(50);
-    }
+/**
+ * @brief   Accounts a completed command into a latency histogram.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] hclass    histogram class, one of the @p MSD_HIST_xxx values
+ * @param[in] start     command start time as returned by
+ *                      @p msd_latency_now()
+ */
+static void msd_latency_account(USBMassStorageDriver *msdp,
+                                unsigned hclass, uint32_t start) {
+  msd_histogram_t *hp = &msdp->latency[hclass];
+  uint32_t delta = msd_latency_now() - start;
+  uint32_t v = delta;
+  unsigned bin = 0;
+
+  while ((v >>= 1) != 0)
+    bin++;
+  if (bin >= MSD_HISTOGRAM_BINS)
+    bin = MSD_HISTOGRAM_BINS - 1;
+
+  chSysLock();
+  hp->count++;
+  hp->bins[bin]++;
+  if (delta > hp->max)
+    hp->max = delta;
+  chSysUnlock();
+}
+#endif /* MSD_USE_LATENCY_HISTOGRAM */
 
-    blkGetInfo(bbdp, &msdp->block_dev_info);
+/**
+ * @brief   Waits for the USB ISR to signal the driver.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @return              The wait outcome.
+ * @retval FALSE        the ISR signaled the driver.
+ * @retval TRUE         a bus reset or reconfiguration happened meanwhile.
+ *
+ * @sclass
+ */
+static bool_t msd_wait_s(USBMassStorageDriver *msdp) {
 
-    usbp->USBD_PARAM_NAME = (void *)msdp;
+  while (chBSemWaitTimeoutS(&msdp->bsem, MS2ST(1)) != RDY_OK) {
+    if (msdp->reconfigured_or_reset_event)
+      return TRUE;
+  }
+  return FALSE;
 }
 
 /**
- * @brief Starts data handling threads for USB mass storage driver
+ * @brief   Waits for the USB ISR to signal the driver.
  *
  * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @return              The wait outcome.
+ * @retval FALSE        the ISR signaled the driver.
+ * @retval TRUE         a bus reset or reconfiguration happened meanwhile.
  */
+static bool_t msd_wait(USBMassStorageDriver *msdp) {
+  bool_t reset;
 
-void msdStart(USBMassStorageDriver *msdp) {
-    /*upon entry, USB bus should be disconnected*/
-
-    if(msdThd == NULL) {
-        msdThd = chThdCreateStatic(waMassStorage, sizeof(waMassStorage),
-                NORMALPRIO, MassStorageThd, msdp);
-    }
+  chSysLock();
+  reset = msd_wait_s(msdp);
+  chSysUnlock();
+  return reset;
+}
 
-    if(msdUSBTransferThd == NULL) {
-        msdUSBTransferThd = chThdCreateStatic(waMassStorageUSBTransfer,
-                                              sizeof(waMassStorageUSBTransfer),
-                NORMALPRIO, MassStorageUSBTransferThd, msdp);
-    }
+/**
+ * @brief   Starts the next USB transfer of the data pipeline, if possible.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ *
+ * @iclass
+ */
+static void msd_pipe_kick_i(USBMassStorageDriver *msdp) {
+  msd_pipeline_t *pp = &msdp->pipe;
 
+  if (pp->busy || pp->error)
+    return;
 
+  if (pp->dir == MSD_PIPE_OUT) {
+    uint32_t n;
 
+    /* The buffer at head is free as long as the ring is not full.*/
+    if ((pp->usb_blocks == 0) || (pp->full >= MSD_NUM_BUFFERS))
+      return;
+    n = pp->usb_blocks < MSD_BUFFER_BLOCKS ? pp->usb_blocks :
+                                             MSD_BUFFER_BLOCKS;
+    pp->blocks[pp->head] = (uint16_t)n;
+    usbPrepareReceive(msdp->usbp, msdp->ms_ep_number,
+                      msdp->buffers[pp->head], n * MSD_BLOCK_SIZE);
+    usbStartReceiveI(msdp->usbp, msdp->ms_ep_number);
+  }
+  else if (pp->dir == MSD_PIPE_IN) {
+    if (pp->full == 0)
+      return;
+    usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number,
+                       msdp->buffers[pp->tail],
+                       pp->blocks[pp->tail] * MSD_BLOCK_SIZE);
+    usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
+  }
+  else
+    return;
+  pp->busy = TRUE;
 }
 
 /**
- * @brief USB Event handler calback
+ * @brief   Handles the completion of a data pipeline USB transfer.
+ * @details The next transfer is chained immediately, if a buffer is
+ *          available, then the driver thread is notified.
  *
- * @param[in] usbp      pointer to the @p USBDriver object
- * @param[in] ep        USB Endpoint Number
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ *
+ * @iclass
  */
+static void msd_pipe_done_i(USBMassStorageDriver *msdp) {
+  msd_pipeline_t *pp = &msdp->pipe;
+
+  pp->busy = FALSE;
+  if (pp->dir == MSD_PIPE_OUT) {
+    size_t n = usbGetReceiveTransactionSizeI(msdp->usbp, msdp->ms_ep_number);
+
+    if (n != (size_t)pp->blocks[pp->head] * MSD_BLOCK_SIZE)
+      pp->error = TRUE;
+    else {
+      pp->usb_blocks -= pp->blocks[pp->head];
+      pp->head = (pp->head + 1) % MSD_NUM_BUFFERS;
+      pp->full++;
+      msdp->data_transferred += n;
+    }
+  }
+  else {
+    pp->usb_blocks -= pp->blocks[pp->tail];
+    msdp->data_transferred += pp->blocks[pp->tail] * MSD_BLOCK_SIZE;
+    pp->tail = (pp->tail + 1) % MSD_NUM_BUFFERS;
+    pp->full--;
+  }
+  msd_pipe_kick_i(msdp);
+  chBSemSignalI(&msdp->bsem);
+}
 
-void msdUsbEvent(USBDriver *usbp, usbep_t ep) {
-    (void)usbp;
-    (void)ep;
-
-    chSysLockFromIsr();
-    chBSemSignalI(&((USBMassStorageDriver *)usbp->USBD_PARAM_NAME)->bsem);
-    chSysUnlockFromIsr();
+/**
+ * @brief   Initializes the data pipeline for a new data phase.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] dir       data phase direction
+ * @param[in] n         number of blocks to be transferred
+ */
+static void msd_pipe_open(USBMassStorageDriver *msdp, msd_pipe_t dir,
+                          uint32_t n) {
+  msd_pipeline_t *pp = &msdp->pipe;
+
+  chSysLock();
+  pp->head       = 0;
+  pp->tail       = 0;
+  pp->full       = 0;
+  pp->busy       = FALSE;
+  pp->error      = FALSE;
+  pp->usb_blocks = n;
+  pp->dir        = dir;
+  msd_pipe_kick_i(msdp);
+  chSysUnlock();
 }
 
+/**
+ * @brief   Terminates the data phase.
+ * @details Waits for the in-flight USB transfer, if any, then detaches the
+ *          pipeline from the endpoint callbacks.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @return              The operation status.
+ * @retval FALSE        pipeline closed normally.
+ * @retval TRUE         a bus reset happened while waiting.
+ */
+static bool_t msd_pipe_close(USBMassStorageDriver *msdp) {
+  msd_pipeline_t *pp = &msdp->pipe;
+  bool_t reset = FALSE;
+
+  chSysLock();
+  while (pp->busy && !reset)
+    reset = msd_wait_s(msdp);
+  pp->dir = MSD_PIPE_IDLE;
+  /* Discarding completion signals already accounted by the pipeline.*/
+  chBSemResetI(&msdp->bsem, TRUE);
+  chSysUnlock();
+  return reset;
+}
 
 /**
- * @brief   Default requests hook.
+ * @brief   Host to device data phase of a WRITE(10) command.
+ * @details The USB ISR fills the ring buffers while the thread writes the
+ *          full ones to the block device, all the contiguous full buffers
+ *          are written with a single multi-block operation. On a device
+ *          error the remaining data is still received but discarded.
  *
- * @param[in] usbp      pointer to the @p USBDriver object
- * @return              The hook status.
- * @retval TRUE         Message handled internally.
- * @retval FALSE        Message not handled.
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] lba       first block on the block device
+ * @param[in] n         number of blocks
+ * @return              The operation status.
+ * @retval TRUE         the data has been written.
+ * @retval FALSE        the operation failed.
  */
-bool_t msdRequestsHook(USBDriver *usbp) {
+static bool_t msd_write_blocks(USBMassStorageDriver *msdp,
+                               uint32_t lba, uint32_t n) {
+  msd_pipeline_t *pp = &msdp->pipe;
+  BaseBlockDevice *bbdp = msdp->lunp->config->bbdp;
+  bool_t ok = TRUE;
 
-    if (((usbp->setup[0] & USB_RTYPE_TYPE_MASK) == USB_RTYPE_TYPE_CLASS) &&
-        ((usbp->setup[0] & USB_RTYPE_RECIPIENT_MASK) == USB_RTYPE_RECIPIENT_INTERFACE))
-    {
-        /* check that the request is for interface 0.*/
-        if(MSD_SETUP_INDEX(usbp->setup) != 0)
-            return FALSE;
-
-        /* act depending on bRequest = setup[1] */
-        switch(usbp->setup[1]) {
-        case MSD_REQ_RESET:
-            /* check that it is a HOST2DEV request */
-            if(((usbp->setup[0] & USB_RTYPE_DIR_MASK) != USB_RTYPE_DIR_HOST2DEV) ||
-               (MSD_SETUP_LENGTH(usbp->setup) != 0) ||
-               (MSD_SETUP_VALUE(usbp->setup) != 0))
-                return FALSE;
-
-            /* reset all endpoints */
-            /* TODO!*/
-            /* The device shall NAK the status stage of the device request until
-             * the Bulk-Only Mass Storage Reset is complete.
-             */
-            return TRUE;
-        case MSD_GET_MAX_LUN:
-            /* check that it is a DEV2HOST request */
-            if(((usbp->setup[0] & USB_RTYPE_DIR_MASK) != USB_RTYPE_DIR_DEV2HOST) ||
-               (MSD_SETUP_LENGTH(usbp->setup) != 1) ||
-               (MSD_SETUP_VALUE(usbp->setup) != 0))
-                return FALSE;
-
-            static uint8_t len_buf[1] = {0};
-            /* stall to indicate that we don't support LUN */
-            usbSetupTransfer(usbp, len_buf, 1, NULL);
-            return TRUE;
-        default:
-            return FALSE;
-            break;
-        }
+  msd_pipe_open(msdp, MSD_PIPE_OUT, n);
+  while (n > 0) {
+    unsigned i, tail, cnt;
+    uint32_t nblk;
+
+    chSysLock();
+    while ((pp->full == 0) && !pp->error) {
+      if (msd_wait_s(msdp)) {
+        chSysUnlock();
+        msd_pipe_close(msdp);
+        return FALSE;
+      }
     }
-  return FALSE;
-}
+    if (pp->error) {
+      chSysUnlock();
+      ok = FALSE;
+      break;
+    }
+    tail = pp->tail;
+    cnt = pp->full;
+    if (tail + cnt > MSD_NUM_BUFFERS)
+      cnt = MSD_NUM_BUFFERS - tail;
+    chSysUnlock();
 
+    nblk = 0;
+    for (i = tail; i < tail + cnt; i++)
+      nblk += pp->blocks[i];
+    if (ok && (blkWrite(bbdp, lba, msdp->buffers[tail],
+                        nblk) == CH_FAILED)) {
+      msdp->write_error_count++;
+      ok = FALSE;
+    }
+    lba += nblk;
+    n -= nblk;
 
+    chSysLock();
+    pp->tail = (tail + cnt) % MSD_NUM_BUFFERS;
+    pp->full -= cnt;
+    msd_pipe_kick_i(msdp);
+    chSysUnlock();
+  }
+  msd_pipe_close(msdp);
+
+  if (!ok)
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_MEDIUM_ERROR,
+                 SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+  return ok;
+}
 
-/*===========================================================================*/
-/* Driver local functions.                                                   */
-/*===========================================================================*/
+/**
+ * @brief   Device to host data phase of a READ(10) command.
+ * @details The thread reads free ring buffers from the block device with
+ *          multi-block operations while the USB ISR transmits the full
+ *          ones.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] lba       first block on the block device
+ * @param[in] n         number of blocks
+ * @return              The operation status.
+ * @retval TRUE         the data has been transmitted.
+ * @retval FALSE        the operation failed.
+ */
+static bool_t msd_read_blocks(USBMassStorageDriver *msdp,
+                              uint32_t lba, uint32_t n) {
+  msd_pipeline_t *pp = &msdp->pipe;
+  BaseBlockDevice *bbdp = msdp->lunp->config->bbdp;
+  bool_t ok = TRUE;
 
-static inline void SCSISetSense(USBMassStorageDriver *msdp, uint8_t key,
-                                uint8_t acode, uint8_t aqual)
-{
-    msdp->sense.byte[2] = key;
-    msdp->sense.byte[12] = acode;
-    msdp->sense.byte[13] = aqual;
-}
+  msd_pipe_open(msdp, MSD_PIPE_IN, n);
+  while (n > 0) {
+    unsigned i, head, cnt, retry;
+    uint32_t nblk;
 
-static uint8_t WaitForISR(USBMassStorageDriver *msdp, const bool_t check_reset)
-{
-  uint8_t ret = WAIT_ISR_SUCCESS;
-    /* sleep until it completes */
     chSysLock();
-    if( check_reset ) {
-      for(;;) {
-        const msg_t m = chBSemWaitTimeoutS(&msdp->bsem, 1);
-        if( m == RDY_OK ) {
-          break;
-        }
-
-        if( msdp->reconfigured_or_reset_event ) {
-          ret = WAIT_ISR_BUSS_RESET_OR_RECONNECT;
-          break;
-        }
+    while (pp->full >= MSD_NUM_BUFFERS) {
+      if (msd_wait_s(msdp)) {
+        chSysUnlock();
+        msd_pipe_close(msdp);
+        return FALSE;
       }
-    } else {
-      chBSemWaitS(&msdp->bsem);
     }
-
+    head = pp->head;
+    cnt = MSD_NUM_BUFFERS - pp->full;
     chSysUnlock();
-    return(ret);
-}
 
+    if (head + cnt > MSD_NUM_BUFFERS)
+      cnt = MSD_NUM_BUFFERS - head;
+    if (cnt > MSD_READ_MAX_BUFFERS)
+      cnt = MSD_READ_MAX_BUFFERS;
+    nblk = cnt * MSD_BUFFER_BLOCKS;
+    if (nblk > n) {
+      nblk = n;
+      cnt = (nblk + MSD_BUFFER_BLOCKS - 1) / MSD_BUFFER_BLOCKS;
+    }
 
+    for (retry = 0; retry < MSD_READ_RETRIES; retry++) {
+      if (blkRead(bbdp, lba, msdp->buffers[head], nblk) == CH_SUCCESS)
+        break;
+      msdp->read_error_count++;
+    }
+    if (retry >= MSD_READ_RETRIES) {
+      ok = FALSE;
+      break;
+    }
 
+    for (i = head; i < head + cnt; i++)
+      pp->blocks[i] = (uint16_t)(i < head + cnt - 1 ?
+                                 MSD_BUFFER_BLOCKS :
+                                 nblk - (cnt - 1) * MSD_BUFFER_BLOCKS);
+    lba += nblk;
+    n -= nblk;
 
+    chSysLock();
+    pp->head = (head + cnt) % MSD_NUM_BUFFERS;
+    pp->full += cnt;
+    msd_pipe_kick_i(msdp);
+    chSysUnlock();
+  }
 
+  /* Draining the buffers still to be transmitted.*/
+  chSysLock();
+  while (pp->full > 0) {
+    if (msd_wait_s(msdp))
+      break;
+  }
+  chSysUnlock();
+  if (msd_pipe_close(msdp))
+    return FALSE;
+
+  if (!ok)
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_MEDIUM_ERROR,
+                 SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+  return ok && (pp->usb_blocks == 0);
+}
 
+/**
+ * @brief   Host to device data phase of a WRITE(10) command on a queued
+ *          logical unit.
+ * @details The data is received directly into the write-behind slots, the
+ *          unit thread writes them to the block device meanwhile. Device
+ *          errors are reported on the next synchronizing command.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] lba       first block on the block device
+ * @param[in] n         number of blocks
+ * @return              The operation status.
+ * @retval TRUE         the data has been queued.
+ * @retval FALSE        the operation failed.
+ */
+static bool_t msd_write_queued(USBMassStorageDriver *msdp,
+                               uint32_t lba, uint32_t n) {
+  msd_lun_t *lunp = msdp->lunp;
+  const MSDLunConfig *cfg = lunp->config;
+
+  while (n > 0) {
+    msd_slot_t *slotp;
+    uint32_t nblk = n < MSD_BUFFER_BLOCKS ? n : MSD_BUFFER_BLOCKS;
+    size_t size;
+
+    while (chSemWaitTimeout(&lunp->free_slots, MS2ST(1)) != RDY_OK) {
+      if (msdp->reconfigured_or_reset_event)
+        return FALSE;
+    }
 
+    slotp = &cfg->slots[lunp->head];
+    slotp->lba = lba;
+    slotp->n   = nblk;
+    usbPrepareReceive(msdp->usbp, msdp->ms_ep_number,
+                      slotp->data, nblk * MSD_BLOCK_SIZE);
+    chSysLock();
+    usbStartReceiveI(msdp->usbp, msdp->ms_ep_number);
+    if (msd_wait_s(msdp)) {
+      chSemSignalI(&lunp->free_slots);
+      chSchRescheduleS();
+      chSysUnlock();
+      return FALSE;
+    }
+    size = usbGetReceiveTransactionSizeI(msdp->usbp, msdp->ms_ep_number);
+    if (size != nblk * MSD_BLOCK_SIZE) {
+      chSemSignalI(&lunp->free_slots);
+      chSchRescheduleS();
+      chSysUnlock();
+      return FALSE;
+    }
+    lunp->head = (lunp->head + 1) % cfg->depth;
+    chSemSignalI(&lunp->full_slots);
+    chSchRescheduleS();
+    chSysUnlock();
 
+    msdp->data_transferred += size;
+    lba += nblk;
+    n -= nblk;
+  }
+  return TRUE;
+}
 
+/**
+ * @brief   Waits for the write-behind queue of a logical unit to drain.
+ * @details Reports the errors of the queued writes, if any.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @return              The operation status.
+ * @retval TRUE         all the queued data has been written.
+ * @retval FALSE        one or more queued writes failed.
+ */
+static bool_t msd_lun_sync(USBMassStorageDriver *msdp) {
+  msd_lun_t *lunp = msdp->lunp;
+  unsigned i;
 
+  if (lunp->config->depth == 0)
+    return TRUE;
 
-static bool_t SCSICommandInquiry(USBMassStorageDriver *msdp) {
-	msd_cbw_t *cbw = &(msdp->cbw);
-
-	static const scsi_inquiry_response_t inquiry = {
-		0x00,						/* direct access block device */
-		0x80,						/* removable */
-		0x04, 						/* SPC-2 */
-		0x02,						/* response data format */
-		0x20,						/* response has 0x20 + 4 bytes */
-		0x00,
-		0x00,
-		0x00,
-		"Chibios",
-		"Mass Storage",
-		{'v',CH_KERNEL_MAJOR+'0','.',CH_KERNEL_MINOR+'0'},
-	};
-
-	if((cbw->scsi_cmd_data[1] & ((1 << 0) | (1 << 1))) ||
-			cbw->scsi_cmd_data[2]) {
-		/* Optional but unsupported bits set - update the SENSE key and fail
-		 * the request */
-		SCSISetSense(	msdp,
-						SCSI_SENSE_KEY_ILLEGAL_REQUEST,
-		               	SCSI_ASENSE_INVALID_FIELD_IN_CDB,
-		               	SCSI_ASENSEQ_NO_QUALIFIER);
-
-		return FALSE;
-	}
-
-	usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, (uint8_t *)&inquiry,
-			sizeof(scsi_inquiry_response_t));
-
-	chSysLock();
-	usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-	chSysUnlock();
-
-	msdp->result = TRUE;
-
-	/* wait for ISR */
-	return TRUE;
+  /* Owning all the slots means that the unit thread is idle.*/
+  for (i = 0; i < lunp->config->depth; i++)
+    chSemWait(&lunp->free_slots);
+  chSysLock();
+  chSemAddCounterI(&lunp->free_slots, (cnt_t)lunp->config->depth);
+  chSchRescheduleS();
+  chSysUnlock();
+
+  if (lunp->deferred_error) {
+    lunp->deferred_error = FALSE;
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_MEDIUM_ERROR,
+                 SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    msdp->result = FALSE;
+    return FALSE;
+  }
+  return TRUE;
 }
 
-static bool_t SCSICommandRequestSense(USBMassStorageDriver *msdp) {
-	usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, (uint8_t *)&msdp->sense,
-			sizeof(scsi_sense_response_t));
-
-	chSysLock();
-	usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-	chSysUnlock();
+/**
+ * @brief   Transmits a small response buffer on the IN endpoint.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ * @param[in] buf       response buffer
+ * @param[in] n         response size
+ */
+static void msd_transmit(USBMassStorageDriver *msdp,
+                         const uint8_t *buf, size_t n) {
 
-	msdp->result = TRUE;
+  usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, buf, n);
 
-	/* wait for ISR */
-	return TRUE;
+  chSysLock();
+  usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
+  chSysUnlock();
 }
 
-static bool_t SCSICommandReadCapacity10(USBMassStorageDriver *msdp) {
-	static SCSIReadCapacity10Response_t response;
+static bool_t SCSICommandInquiry(USBMassStorageDriver *msdp) {
+  msd_cbw_t *cbw = &(msdp->cbw);
+
+  static const scsi_inquiry_response_t inquiry = {
+    0x00,                       /* direct access block device */
+    0x80,                       /* removable */
+    0x04,                       /* SPC-2 */
+    0x02,                       /* response data format */
+    0x20,                       /* response has 0x20 + 4 bytes */
+    0x00,
+    0x00,
+    0x00,
+    "Chibios",
+    "Mass Storage",
+    {'v',CH_KERNEL_MAJOR+'0','.',CH_KERNEL_MINOR+'0'},
+  };
+
+  if ((cbw->scsi_cmd_data[1] & ((1 << 0) | (1 << 1))) ||
+      cbw->scsi_cmd_data[2]) {
+    /* Optional but unsupported bits set - update the SENSE key and fail
+     * the request */
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_ILLEGAL_REQUEST,
+                 SCSI_ASENSE_INVALID_FIELD_IN_CDB,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    msdp->result = FALSE;
+    return FALSE;
+  }
 
-	response.block_size = swap_uint32(msdp->block_dev_info.blk_size);
-	response.last_block_addr = swap_uint32(msdp->block_dev_info.blk_num-1);
+  msd_transmit(msdp, (const uint8_t *)&inquiry,
+               sizeof(scsi_inquiry_response_t));
+  msdp->result = TRUE;
 
-	usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, (uint8_t *)&response,
-			sizeof(SCSIReadCapacity10Response_t));
+  /* wait for ISR */
+  return TRUE;
+}
 
-	chSysLock();
-	usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-	chSysUnlock();
+static bool_t SCSICommandRequestSense(USBMassStorageDriver *msdp) {
 
-	msdp->result = TRUE;
+  msd_transmit(msdp, (const uint8_t *)&msdp->lunp->sense,
+               sizeof(scsi_sense_response_t));
+  msdp->result = TRUE;
 
-	/* wait for ISR */
-	return TRUE;
+  /* wait for ISR */
+  return TRUE;
 }
 
-static bool_t SCSICommandSendDiagnostic(USBMassStorageDriver *msdp) {
-	msd_cbw_t *cbw = &(msdp->cbw);
-
-	if( (!cbw->scsi_cmd_data[1]) & (1 << 2)) {
-		/* Only self-test supported - update SENSE key and fail the command */
-		SCSISetSense(	msdp,
-						SCSI_SENSE_KEY_ILLEGAL_REQUEST,
-		                SCSI_ASENSE_INVALID_FIELD_IN_CDB,
-		                SCSI_ASENSEQ_NO_QUALIFIER);
+static bool_t SCSICommandReadCapacity10(USBMassStorageDriver *msdp) {
+  SCSIReadCapacity10Response_t *response =
+    (SCSIReadCapacity10Response_t *)msdp->response;
 
-		return FALSE;
-	}
+  response->block_size = swap_uint32(MSD_BLOCK_SIZE);
+  response->last_block_addr = swap_uint32(msdp->lunp->blk_num - 1);
 
-	/* TODO: actually perform the test */
-	msdp->result = TRUE;
+  msd_transmit(msdp, (const uint8_t *)response,
+               sizeof(SCSIReadCapacity10Response_t));
+  msdp->result = TRUE;
 
-	/* don't wait for ISR */
-	return FALSE;
+  /* wait for ISR */
+  return TRUE;
 }
 
-static void SCSIWriteTransferPingPong(USBMassStorageDriver *msdp,
-                                      volatile rw_usb_sd_buffer_t *dest_buffer)
-{
-  int cnt;
-  dest_buffer->is_transfer_done = FALSE;
-  dest_buffer->num_blocks_to_write = 0;
-
-#if MSD_ENABLE_PERF_DEBUG_GPIOS
-  palSetPad(GPIOH, GPIOH_LED2);
-#endif
-  for(cnt = 0; cnt < BLOCK_WRITE_ITTERATION_COUNT && cnt < dest_buffer->max_blocks_to_read; cnt++ ) {
-    usbPrepareReceive(msdp->usbp, msdp->ms_ep_number,
-       (uint8_t*)&dest_buffer->buf[cnt * BLOCK_SIZE_INCREMENT],
-       (msdp->block_dev_info.blk_size));
+static bool_t SCSICommandSendDiagnostic(USBMassStorageDriver *msdp) {
+  msd_cbw_t *cbw = &(msdp->cbw);
+
+  if (!(cbw->scsi_cmd_data[1] & (1 << 2))) {
+    /* Only self-test supported - update SENSE key and fail the command */
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_ILLEGAL_REQUEST,
+                 SCSI_ASENSE_INVALID_FIELD_IN_CDB,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    msdp->result = FALSE;
+    return FALSE;
+  }
 
-    chSysLock();
-    usbStartReceiveI(msdp->usbp, msdp->ms_ep_number);
-    chSysUnlock();
+  /* TODO: actually perform the test */
+  msdp->result = TRUE;
 
-    WaitForISR(msdp, FALSE);
-    dest_buffer->num_blocks_to_write++;
-  }
-  dest_buffer->is_transfer_done = TRUE;
-#if MSD_ENABLE_PERF_DEBUG_GPIOS
-  palClearPad(GPIOH, GPIOH_LED2);
-#endif
+  /* don't wait for ISR */
+  return FALSE;
 }
 
-static void WaitForUSBTransferComplete(USBMassStorageDriver *msdp,
-                                       const int ping_pong_buffer_index)
-{
-  while(TRUE) {
-    chBSemWaitTimeout(&msdp->mass_sorage_thd_bsem, MS2ST(1));
+/**
+ * @brief   Checks if the current logical unit is write protected.
+ */
+static bool_t msd_lun_protected(USBMassStorageDriver *msdp) {
+  const MSDLunConfig *cfg = msdp->lunp->config;
 
-    if( rw_ping_pong_buffer[ping_pong_buffer_index].is_transfer_done ) {
-      break;
-    } else {
-      chThdSleepMilliseconds(1);
-    }
-  }
+  return cfg->read_only || blkIsWriteProtected(cfg->bbdp);
 }
 
 static bool_t SCSICommandStartReadWrite10(USBMassStorageDriver *msdp) {
-	msd_cbw_t *cbw = &(msdp->cbw);
-	int read_success;
-	int retry_count;
-
-	if((cbw->scsi_cmd_data[0] == SCSI_CMD_WRITE_10) &&
-			blkIsWriteProtected(msdp->bbdp)) {
-		/* device is write protected and a write has been issued */
-		/* Block address is invalid, update SENSE key and return command fail */
-		SCSISetSense(	msdp,
-						SCSI_SENSE_KEY_DATA_PROTECT,
-		               	SCSI_ASENSE_WRITE_PROTECTED,
-		                SCSI_ASENSEQ_NO_QUALIFIER);
-		msdp->result = FALSE;
-		return FALSE;
-	}
-
-	uint32_t rw_block_address = swap_uint32(*(uint32_t *)&cbw->scsi_cmd_data[2]);
-	const uint16_t total_blocks = swap_uint16(*(uint16_t *)&cbw->scsi_cmd_data[7]);
-	uint16_t i = 0;
-
-	if(rw_block_address >= msdp->block_dev_info.blk_num) {
-		/* Block address is invalid, update SENSE key and return command fail */
-		SCSISetSense(	msdp,
-						SCSI_SENSE_KEY_DATA_PROTECT,
-	               	    SCSI_ASENSE_WRITE_PROTECTED,
-	               	    SCSI_ASENSEQ_NO_QUALIFIER);
-		msdp->result = FALSE;
-
-		/* don't wait for ISR */
-		return FALSE;
-	}
-
-	for(i = 0; i < 2; i++ ) {
-	  /*initialized ping pong buffer*/
-	  rw_ping_pong_buffer[i].max_blocks_to_read = 0;
-	  rw_ping_pong_buffer[i].num_blocks_to_write = 0;
-	  rw_ping_pong_buffer[i].is_transfer_done = FALSE;
-	}
-
-
-	if(cbw->scsi_cmd_data[0] == SCSI_CMD_WRITE_10) {
-      /* loop over each block */
-
-	  int ping_pong_buffer_index = 0;
-	  /*initiate a transfer*/
-	  rw_ping_pong_buffer[ping_pong_buffer_index].is_transfer_done = FALSE;
-	  rw_ping_pong_buffer[ping_pong_buffer_index].max_blocks_to_read = total_blocks;
-
-	  /*Trigger the transfer in the other thread*/
-	  msdp->trigger_transfer_index = ping_pong_buffer_index;
-
-
-	  /*wake other thread on semaphore to trigger the transfer*/
-	  chBSemSignal(&msdp->usb_transfer_thread_bsem);
-
-	  WaitForUSBTransferComplete(msdp, ping_pong_buffer_index);
-
-      for(i = 0; i < total_blocks; ) {
-        const int done_buffer_index = ping_pong_buffer_index;
-        const int empty_buffer_index = ((ping_pong_buffer_index + 1) % 2);
-
-        /*initiate another transfer in the other ping pong buffer*/
-        int queue_another_transfer = FALSE;
-        if( (i + BLOCK_WRITE_ITTERATION_COUNT) < total_blocks ) {
-          queue_another_transfer = TRUE;
-        }
-
-        if( queue_another_transfer ) {
-          while( TRUE ) {
-            if(msdp->trigger_transfer_index == UINT32_MAX) {
-              rw_ping_pong_buffer[empty_buffer_index].max_blocks_to_read = total_blocks - i - BLOCK_WRITE_ITTERATION_COUNT;
-
-              msdp->trigger_transfer_index = empty_buffer_index;
-
-              /*wake other thread on semaphore to trigger the transfer*/
-              chBSemSignal(&msdp->usb_transfer_thread_bsem);
-              break;
-            } else {
-              chThdSleepMilliseconds(1);
-            }
-          }
-        }
+  msd_cbw_t *cbw = &(msdp->cbw);
+  msd_lun_t *lunp = msdp->lunp;
+  uint32_t lba;
+  uint32_t n;
+
+  if ((cbw->scsi_cmd_data[0] == SCSI_CMD_WRITE_10) &&
+      msd_lun_protected(msdp)) {
+    /* device is write protected and a write has been issued */
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_DATA_PROTECT,
+                 SCSI_ASENSE_WRITE_PROTECTED,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    msdp->result = FALSE;
+    return FALSE;
+  }
 
+  lba = ((uint32_t)cbw->scsi_cmd_data[2] << 24) |
+        ((uint32_t)cbw->scsi_cmd_data[3] << 16) |
+        ((uint32_t)cbw->scsi_cmd_data[4] << 8) |
+        (uint32_t)cbw->scsi_cmd_data[5];
+  n = ((uint32_t)cbw->scsi_cmd_data[7] << 8) | cbw->scsi_cmd_data[8];
+
+  if ((lba >= lunp->blk_num) || (n > lunp->blk_num - lba)) {
+    /* Block address is invalid, update SENSE key and return command fail */
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_ILLEGAL_REQUEST,
+                 SCSI_ASENSE_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    msdp->result = FALSE;
+
+    /* don't wait for ISR */
+    return FALSE;
+  }
 
+  /* Translation to the block device address space.*/
+  lba += lunp->config->start;
 
+  if (n == 0)
+    msdp->result = TRUE;
+  else if (cbw->scsi_cmd_data[0] == SCSI_CMD_WRITE_10) {
+    if (lunp->config->depth > 0)
+      msdp->result = msd_write_queued(msdp, lba, n);
+    else
+      msdp->result = msd_write_blocks(msdp, lba, n);
+  }
+  else if (msd_lun_sync(msdp))
+    msdp->result = msd_read_blocks(msdp, lba, n);
 
-         if( rw_ping_pong_buffer[done_buffer_index].num_blocks_to_write <= 0 ) {
-           /*This should never happen!!! Something is seriously wrong!*/
-           msd_debug_print(chp, "\r\nCant write 0 blocks, this should not happen, halting\r\n");
-           chThdSleepMilliseconds(50);
-           chSysHalt();
-         }
+  /* don't wait for ISR */
+  return FALSE;
+}
 
-         /* now write the block to the block device */
-         if(blkWrite(msdp->bbdp, rw_block_address,
-                     (uint8_t*)rw_ping_pong_buffer[done_buffer_index].buf,
-                     rw_ping_pong_buffer[done_buffer_index].num_blocks_to_write) == CH_FAILED )
-         {
+static bool_t SCSICommandStartStopUnit(USBMassStorageDriver *msdp) {
+  SCSIStartStopUnitRequest_t *ssu = (SCSIStartStopUnitRequest_t *)&(msdp->cbw.scsi_cmd_data);
 
-             msd_debug_print(chp, "\r\nSD Block Write Error, halting\r\n");
-             chThdSleepMilliseconds(50);
-             msdp->write_error_count++;
-             msdp->result = FALSE;
-             SCSISetSense(   msdp,
-                             SCSI_SENSE_KEY_MEDIUM_ERROR,
-                             SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
-                             SCSI_ASENSEQ_NO_QUALIFIER);
+  if (!msd_lun_sync(msdp))
+    return FALSE;
 
-             if( queue_another_transfer ) {
-               /*Let the previous queued transfer finish and ignore it.*/
-               WaitForUSBTransferComplete(msdp, empty_buffer_index);
-             }
+  if ((ssu->loej_start & 0x03) == 0x02) {
+    /* device has been ejected */
+    if (!msdp->disable_usb_bus_disconnect_on_eject) {
+      chEvtBroadcast(&msdp->evt_ejected);
+      msdp->state = ejected;
+    }
+  }
 
-             return(FALSE);
-         }
-         rw_block_address += rw_ping_pong_buffer[done_buffer_index].num_blocks_to_write;
-         i += rw_ping_pong_buffer[done_buffer_index].num_blocks_to_write;
-         rw_ping_pong_buffer[done_buffer_index].is_transfer_done = FALSE;
-         rw_ping_pong_buffer[done_buffer_index].num_blocks_to_write = 0;
+  msdp->result = TRUE;
 
+  /* don't wait for ISR */
+  return FALSE;
+}
 
-         if( queue_another_transfer ) {
-           WaitForUSBTransferComplete(msdp, empty_buffer_index);
-         }
+static bool_t SCSICommandSynchronizeCache10(USBMassStorageDriver *msdp) {
 
-         /*Swap the ping pong buffers*/
-         ping_pong_buffer_index = empty_buffer_index;
-      }
+  if (msd_lun_sync(msdp))
+    msdp->result = blkSync(msdp->lunp->config->bbdp) == CH_SUCCESS;
 
-	} else {
-		i = 0;
-		/* read the first block from block device */
-		read_success = FALSE;
-		for(retry_count = 0; retry_count < 3; retry_count++ ) {
-          if(blkRead(msdp->bbdp, rw_block_address, read_buffer[i % 2], 1) == CH_FAILED) {
-              msd_debug_print(chp, "\r\nSD Block Read Error\r\n");
-              msdp->read_error_count++;
-          } else {
-            read_success = TRUE;
-            break;
-          }
-		}
-		if( (!read_success) ) {
-		  msd_debug_print(chp, "\r\nSD Block Read Error 1, halting\r\n");
-		  /*wait for printing to finish*/
-		  chThdSleepMilliseconds(70);
-		  msdp->result = FALSE;
-
-		  msd_debug_print(chp, "\r\nSetting sense code %u\r\n", SCSI_SENSE_KEY_MEDIUM_ERROR);
-          SCSISetSense(   msdp,
-                          SCSI_SENSE_KEY_MEDIUM_ERROR,
-                          SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
-                          SCSI_ASENSEQ_NO_QUALIFIER);
-          return FALSE;
-		}
-		rw_block_address++;
-
-		/* loop over each block */
-		for(i = 0; i < total_blocks; i++) {
-			/* transmit the block */
-			usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, read_buffer[i % 2],
-					msdp->block_dev_info.blk_size);
-
-			chSysLock();
-			usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-			chSysUnlock();
-
-			if(i < (total_blocks - 1)) {
-				/* there is at least one more block to be read from device */
-				/* so read that while the USB transfer takes place */
-			    read_success = FALSE;
-                for(retry_count = 0; retry_count < 3; retry_count++ ) {
-                  if(blkRead(msdp->bbdp, rw_block_address, read_buffer[(i+1) % 2], 1) == CH_FAILED ) {
-                      msd_debug_print(chp, "\r\nSD Block Read Error 2\r\n");
-                      msdp->read_error_count++;
-                  } else {
-                    read_success = TRUE;
-                    break;
-                  }
-                }
-
-                if( (! read_success) ) {
-                  msd_debug_print(chp, "\r\nSD Block Read Error 22, addr=%d, halting\r\n", rw_block_address);
-                  /*wait for printing to finish*/
-                  chThdSleepMilliseconds(70);
-                  msdp->result = FALSE;
-
-                  msd_debug_print(chp, "\r\nSetting sense code %u\r\n", SCSI_SENSE_KEY_MEDIUM_ERROR);
-                  SCSISetSense(   msdp,
-                                  SCSI_SENSE_KEY_MEDIUM_ERROR,
-                                  SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
-                                  SCSI_ASENSEQ_NO_QUALIFIER);
-                  return FALSE;
-                }
-
-                rw_block_address++;
-			}
-
-			/*FIXME In the event that the USB connection is unplugged while we're waiting for a bulk
-			 * endpoint ISR, this will never return, and when re-plugged into the host, the drive will
-			 * not show back up on the host. We need a way to break out of this loop when disconnected from the bus.
-			 */
-			if( WaitForISR(msdp, TRUE) == WAIT_ISR_BUSS_RESET_OR_RECONNECT ) {
-              msdp->result = FALSE;
-              return FALSE;
-			}
-		}
-	}
-
-	msdp->result = TRUE;
-
-	/* don't wait for ISR */
-	return FALSE;
+  /* don't wait for ISR */
+  return FALSE;
 }
 
-static bool_t SCSICommandStartStopUnit(USBMassStorageDriver *msdp) {
-	SCSIStartStopUnitRequest_t *ssu = (SCSIStartStopUnitRequest_t *)&(msdp->cbw.scsi_cmd_data);
+static bool_t SCSICommandModeSense6(USBMassStorageDriver *msdp) {
 
-	if((ssu->loej_start & 0b00000011) == 0b00000010) {
-		/* device has been ejected */
-	    if( ! msdp->disable_usb_bus_disconnect_on_eject ) {
-          chEvtBroadcast(&msdp->evt_ejected);
-          msdp->state = ejected;
-	    }
-	}
+  /* Send an empty header response with the Write Protect flag status */
+  msdp->response[0] = 0x03;
+  msdp->response[1] = 0x00;
+  msdp->response[2] = msd_lun_protected(msdp) ? 0x80 : 0x00;
+  msdp->response[3] = 0x00;
 
-	msdp->result = TRUE;
+  msd_transmit(msdp, msdp->response, 4);
+  msdp->result = TRUE;
 
-	/* don't wait for ISR */
-	return FALSE;
+  /* wait for ISR */
+  return TRUE;
 }
 
-static bool_t SCSICommandModeSense6(USBMassStorageDriver *msdp) {
-	/* Send an empty header response with the Write Protect flag status */
-	/* TODO set byte3 to 0x80 if disk is read only */
-	static uint8_t response[4] = {0x00, 0x00, 0x00, 0x00};
+static bool_t msdWaitForCommandBlock(USBMassStorageDriver *msdp) {
 
-	usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, response, 4);
+  usbPrepareReceive(msdp->usbp, msdp->ms_ep_number,
+                    (uint8_t *)&msdp->cbw, sizeof(msd_cbw_t));
 
-	chSysLock();
-	usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-	chSysUnlock();
+  chSysLock();
+  usbStartReceiveI(msdp->usbp, msdp->ms_ep_number);
+  chSysUnlock();
 
-	msdp->result = TRUE;
+  msdp->state = read_cmd_block;
 
-	/* wait for ISR */
-	return TRUE;
+  /* wait for ISR */
+  return TRUE;
 }
 
-static bool_t msdWaitForCommandBlock(USBMassStorageDriver *msdp) {
-    usbPrepareReceive(msdp->usbp, msdp->ms_ep_number,
-            (uint8_t *)&msdp->cbw, sizeof(msd_cbw_t));
+/* A command block has been received */
+static bool_t msdReadCommandBlock(USBMassStorageDriver *msdp) {
+  msd_cbw_t *cbw = &(msdp->cbw);
+  msd_csw_t *csw = &(msdp->csw);
+  bool_t sleep = FALSE;
+  uint32_t residue;
+#if MSD_USE_LATENCY_HISTOGRAM
+  uint32_t start = msd_latency_now();
+  unsigned hclass = MSD_HIST_OTHER;
+#endif
 
-    chSysLock();
-    usbStartReceiveI(msdp->usbp, msdp->ms_ep_number);
-    chSysUnlock();
+  /* by default transition back to the idle state */
+  msdp->state = idle;
+  msdp->data_transferred = 0;
 
-    msdp->state = read_cmd_block;
+  /* check the command */
+  if ((cbw->signature != MSD_CBW_SIGNATURE) ||
+      (cbw->lun > msdp->max_lun) ||
+      ((cbw->data_len > 0) && (cbw->flags & 0x1F)) ||
+      (cbw->scsi_cmd_len == 0) ||
+      (cbw->scsi_cmd_len > 16)) {
 
-    /* wait for ISR */
-    return TRUE;
-}
+    /* stall both IN and OUT endpoints */
+    chSysLock();
+    usbStallReceiveI(msdp->usbp, msdp->ms_ep_number);
+    chSysUnlock();
 
+    /* don't wait for ISR */
+    return FALSE;
+  }
+  msdp->lunp = &msdp->luns[cbw->lun];
+
+  switch (cbw->scsi_cmd_data[0]) {
+  case SCSI_CMD_INQUIRY:
+    sleep = SCSICommandInquiry(msdp);
+    break;
+  case SCSI_CMD_REQUEST_SENSE:
+    sleep = SCSICommandRequestSense(msdp);
+    break;
+  case SCSI_CMD_READ_CAPACITY_10:
+    sleep = SCSICommandReadCapacity10(msdp);
+    break;
+  case SCSI_CMD_READ_10:
+  case SCSI_CMD_WRITE_10:
+#if MSD_USE_LATENCY_HISTOGRAM
+    hclass = cbw->scsi_cmd_data[0] == SCSI_CMD_READ_10 ? MSD_HIST_READ :
+                                                         MSD_HIST_WRITE;
+#endif
+    MSD_RW_LED_ON();
+    sleep = SCSICommandStartReadWrite10(msdp);
+    MSD_RW_LED_OFF();
+    break;
+  case SCSI_CMD_SEND_DIAGNOSTIC:
+    sleep = SCSICommandSendDiagnostic(msdp);
+    break;
+  case SCSI_CMD_TEST_UNIT_READY:
+  case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
+    /* don't handle */
+    msdp->result = TRUE;
+    break;
+  case SCSI_CMD_VERIFY_10:
+    msdp->result = msd_lun_sync(msdp);
+    break;
+  case SCSI_CMD_SYNCHRONIZE_CACHE_10:
+    sleep = SCSICommandSynchronizeCache10(msdp);
+    break;
+  case SCSI_CMD_MODE_SENSE_6:
+    sleep = SCSICommandModeSense6(msdp);
+    break;
+  case SCSI_CMD_START_STOP_UNIT:
+    sleep = SCSICommandStartStopUnit(msdp);
+    break;
+  default:
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_ILLEGAL_REQUEST,
+                 SCSI_ASENSE_INVALID_COMMAND,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+
+    msdp->result = FALSE;
+    break;
+  }
 
+  if (msdp->result) {
+    if (sleep) {
+      if (msd_wait(msdp))
+        return FALSE;
+    }
 
-/* A command block has been received */
-static bool_t msdReadCommandBlock(USBMassStorageDriver *msdp) {
-	msd_cbw_t *cbw = &(msdp->cbw);
-
-	/* by default transition back to the idle state */
-	msdp->state = idle;
-
-	/* check the command */
-	if((cbw->signature != MSD_CBW_SIGNATURE) ||
-		(cbw->lun > 0) ||
-		((cbw->data_len > 0) && (cbw->flags & 0x1F)) ||
-		(cbw->scsi_cmd_len == 0) ||
-		(cbw->scsi_cmd_len > 16)) {
-
-		/* stall both IN and OUT endpoints */
-		chSysLockFromIsr();
-		usbStallReceiveI(msdp->usbp, msdp->ms_ep_number);
-		chSysUnlockFromIsr();
-
-		/* don't wait for ISR */
-		return FALSE;
-	}
-
-	bool_t sleep = FALSE;
-	switch(cbw->scsi_cmd_data[0]) {
-	case SCSI_CMD_INQUIRY:
-	    msd_debug_print(chp, "CMD_INQ\r\n");
-		sleep = SCSICommandInquiry(msdp);
-		break;
-	case SCSI_CMD_REQUEST_SENSE:
-	    msd_debug_print(chp, "\r\nCMD_RS\r\n");
-		sleep = SCSICommandRequestSense(msdp);
-		break;
-	case SCSI_CMD_READ_CAPACITY_10:
-	    msd_debug_print(chp, "CMD_RC10\r\n");
-		sleep = SCSICommandReadCapacity10(msdp);
-		break;
-	case SCSI_CMD_READ_10:
-	case SCSI_CMD_WRITE_10:
-	    msd_debug_print(chp, "CMD_RW\r\n");
-		MSD_RW_LED_ON();
-		sleep = SCSICommandStartReadWrite10(msdp);
-		MSD_RW_LED_OFF();
-		break;
-	case SCSI_CMD_SEND_DIAGNOSTIC:
-	  msd_debug_print(chp, "CMD_DIA\r\n");
-		sleep = SCSICommandSendDiagnostic(msdp);
-		break;
-	case SCSI_CMD_TEST_UNIT_READY:
-	case SCSI_CMD_PREVENT_ALLOW_MEDIUM_REMOVAL:
-	case SCSI_CMD_VERIFY_10:
-		/* don't handle */
-		msdp->result = TRUE;
-		break;
-	case SCSI_CMD_MODE_SENSE_6:
-	  msd_debug_print(chp, "\r\nCMD_S6\r\n");
-		sleep = SCSICommandModeSense6(msdp);
-		break;
-	case SCSI_CMD_START_STOP_UNIT:
-	    msd_debug_print(chp, "CMD_STOP\r\n");
-		sleep = SCSICommandStartStopUnit(msdp);
-		break;
-	default:
-		SCSISetSense(	msdp,
-						SCSI_SENSE_KEY_ILLEGAL_REQUEST,
-						SCSI_ASENSE_INVALID_COMMAND,
-						SCSI_ASENSEQ_NO_QUALIFIER);
-
-		/* stall IN endpoint */
-		chSysLockFromIsr();
-		usbStallTransmitI(msdp->usbp, msdp->ms_ep_number);
-		chSysUnlockFromIsr();
-
-		cbw->data_len = 0;
-		return FALSE;
-	}
-
-	cbw->data_len = 0;
-
-	if(msdp->result) {
-        /* update sense with success status */
-        SCSISetSense(   msdp,
-                        SCSI_SENSE_KEY_GOOD,
-                        SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
-                        SCSI_ASENSEQ_NO_QUALIFIER);
-	} else {
-        /* stall IN endpoint */
-        chSysLockFromIsr();
+    /* update sense with success status, after the data phase because the
+       sense itself could have been the data */
+    SCSISetSense(msdp,
+                 SCSI_SENSE_KEY_GOOD,
+                 SCSI_ASENSE_NO_ADDITIONAL_INFORMATION,
+                 SCSI_ASENSEQ_NO_QUALIFIER);
+    residue = 0;
+  }
+  else {
+    /* If the data phase has not been completed then the endpoint of the
+       data direction is stalled, the CSW is sent after the host clears
+       the stall condition */
+    residue = cbw->data_len > msdp->data_transferred ?
+              cbw->data_len - msdp->data_transferred : 0;
+    if (residue > 0) {
+      chSysLock();
+      if (cbw->flags & MSD_COMMAND_DIR_DATA_IN)
         usbStallTransmitI(msdp->usbp, msdp->ms_ep_number);
-        chSysUnlockFromIsr();
+      else
+        usbStallReceiveI(msdp->usbp, msdp->ms_ep_number);
+      chSysUnlock();
+    }
+  }
 
-        cbw->data_len = 0;
-        return FALSE;
-	}
+  csw->status = msdp->result ? MSD_COMMAND_PASSED : MSD_COMMAND_FAILED;
+  csw->signature = MSD_CSW_SIGNATURE;
+  csw->data_residue = residue;
+  csw->tag = cbw->tag;
 
-	if(sleep) {
-        if( WaitForISR(msdp, TRUE) == WAIT_ISR_BUSS_RESET_OR_RECONNECT ) {
-          return(FALSE);
-        }
-	}
+  msd_transmit(msdp, (const uint8_t *)csw, sizeof(msd_csw_t));
 
-	msd_csw_t *csw = &(msdp->csw);
+#if MSD_USE_LATENCY_HISTOGRAM
+  msd_latency_account(msdp, hclass, start);
+#endif
 
-	if( (!msdp->result) && cbw->data_len ) {
-		/* still bytes left to send, this is too early to send CSW? */
-		chSysLockFromIsr();
-		usbStallReceiveI(msdp->usbp, msdp->ms_ep_number);
-		usbStallTransmitI(msdp->usbp, msdp->ms_ep_number);
-		chSysUnlockFromIsr();
+  /* wait on ISR */
+  return TRUE;
+}
 
-	    return FALSE;
-	}
+static msg_t MassStorageLunThd(void *arg) {
+  msd_lun_t *lunp = (msd_lun_t *)arg;
+  const MSDLunConfig *cfg = lunp->config;
 
-	csw->status = (msdp->result) ? MSD_COMMAND_PASSED : MSD_COMMAND_FAILED;
-	csw->signature = MSD_CSW_SIGNATURE;
-	csw->data_residue = cbw->data_len;
-	csw->tag = cbw->tag;
+  chRegSetThreadName("USB-MSD-LUN");
 
-	usbPrepareTransmit(msdp->usbp, msdp->ms_ep_number, (uint8_t *)csw,
-			sizeof(msd_csw_t));
+  while (TRUE) {
+    msd_slot_t *slotp;
 
-	chSysLock();
-	usbStartTransmitI(msdp->usbp, msdp->ms_ep_number);
-	chSysUnlock();
+    chSemWait(&lunp->full_slots);
+    slotp = &cfg->slots[lunp->tail];
+    if (blkWrite(cfg->bbdp, slotp->lba, slotp->data, slotp->n) == CH_FAILED) {
+      lunp->msdp->write_error_count++;
+      lunp->deferred_error = TRUE;
+    }
+    lunp->tail = (lunp->tail + 1) % cfg->depth;
+    chSemSignal(&lunp->free_slots);
+  }
 
-	/* wait on ISR */
-	return TRUE;
+  return 0;
 }
 
-static msg_t MassStorageUSBTransferThd(void *arg) {
+static msg_t MassStorageThd(void *arg) {
   USBMassStorageDriver *msdp = (USBMassStorageDriver *)arg;
+  bool_t wait_for_isr;
+
+  chRegSetThreadName("USB-MSD");
+
+  /* wait for the usb to be initialized */
+  msd_wait(msdp);
 
-  chRegSetThreadName("USB-MSD-Transfer");
+  while (TRUE) {
+    wait_for_isr = FALSE;
+
+    if (msdp->reconfigured_or_reset_event) {
+      /* If the devices is unplugged and re-plugged but did not have a CPU
+         reset, we must set the state back to idle.*/
+      msdp->reconfigured_or_reset_event = FALSE;
+      msdp->state = idle;
+    }
 
-  for(;;) {
-    if( msdp->trigger_transfer_index != UINT32_MAX ) {
-      SCSIWriteTransferPingPong(msdp, &rw_ping_pong_buffer[msdp->trigger_transfer_index]);
-      msdp->trigger_transfer_index = UINT32_MAX;
-      /*notify other thread*/
-      chBSemSignal(&msdp->mass_sorage_thd_bsem);
+    bool_t enable_msd = TRUE;
+    if (msdp->enable_msd_callback != NULL)
+      enable_msd = msdp->enable_msd_callback();
+
+    if (enable_msd) {
+      /* wait on data depending on the current state */
+      switch (msdp->state) {
+      case idle:
+        wait_for_isr = msdWaitForCommandBlock(msdp);
+        break;
+      case read_cmd_block:
+        wait_for_isr = msdReadCommandBlock(msdp);
+        break;
+      case ejected:
+        /* disconnect usb device */
+        if (!msdp->disable_usb_bus_disconnect_on_eject) {
+          chThdSleepMilliseconds(70);
+          usbDisconnectBus(msdp->usbp);
+          usbStop(msdp->usbp);
+        }
+        return 0;
+      }
     }
+    else
+      chThdSleepMilliseconds(1);
 
-    chBSemWaitTimeout(&msdp->usb_transfer_thread_bsem, MS2ST(1));
+    /* wait until the ISR wakes thread */
+    if (wait_for_isr && !msdp->reconfigured_or_reset_event)
+      msd_wait(msdp);
   }
 
-  return(0);
+  return 0;
 }
 
+/*===========================================================================*/
+/* Driver interrupt handlers.                                                */
+/*===========================================================================*/
 
-static msg_t MassStorageThd(void *arg) {
-	USBMassStorageDriver *msdp = (USBMassStorageDriver *)arg;
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
 
-	chRegSetThreadName("USB-MSD");
+/**
+ * @brief   Initializes a single unit mass storage driver instance.
+ * @note    The function waits for the block device to become ready.
+ *
+ * @param[in] usbp            pointer to the @p USBDriver object
+ * @param[in] bbdp            pointer to the @p BaseBlockDevice object, such as an SDCDriver object
+ * @param[in] msdp            pointer to the @p USBMassStorageDriver object
+ * @param[in] ms_ep_number    USB Endpoint Number to be used by the mass storage endpoint
+ */
+void msdInit(USBDriver *usbp, BaseBlockDevice *bbdp, USBMassStorageDriver *msdp,
+             const usbep_t ms_ep_number) {
+
+  msdp->lun0cfg.bbdp      = bbdp;
+  msdp->lun0cfg.start     = 0;
+  msdp->lun0cfg.blocks    = 0;
+  msdp->lun0cfg.read_only = FALSE;
+  msdp->lun0cfg.slots     = NULL;
+  msdp->lun0cfg.depth     = 0;
+  msdp->lun0cfg.wsp       = NULL;
+  msdp->lun0cfg.wsize     = 0;
+  msdInitLuns(usbp, msdp, ms_ep_number, &msdp->lun0cfg, 1);
+}
+
+/**
+ * @brief   Initializes a multiple units mass storage driver instance.
+ * @note    The function waits for the block devices to become ready.
+ *
+ * @param[in] usbp            pointer to the @p USBDriver object
+ * @param[in] msdp            pointer to the @p USBMassStorageDriver object
+ * @param[in] ms_ep_number    USB Endpoint Number to be used by the mass storage endpoint
+ * @param[in] luns            array of logical unit configurations, the
+ *                            array must be kept available while the driver
+ *                            is in use
+ * @param[in] n               number of logical units
+ */
+void msdInitLuns(USBDriver *usbp, USBMassStorageDriver *msdp,
+                 const usbep_t ms_ep_number,
+                 const MSDLunConfig *luns, unsigned n) {
+  unsigned i, j;
+
+  chDbgCheck((n > 0) && (n <= MSD_MAX_LUNS), "msdInitLuns");
+
+  msdp->usbp = usbp;
+  msdp->state = idle;
+  msdp->ms_ep_number = ms_ep_number;
+  msdp->thdp = NULL;
+  msdp->pipe.dir = MSD_PIPE_IDLE;
+  msdp->pipe.busy = FALSE;
+  msdp->reconfigured_or_reset_event = FALSE;
+  msdp->enable_msd_callback = NULL;
+  msdp->disable_usb_bus_disconnect_on_eject = FALSE;
+  msdp->read_error_count = 0;
+  msdp->write_error_count = 0;
+
+  chEvtInit(&msdp->evt_connected);
+  chEvtInit(&msdp->evt_ejected);
+
+  /* Initialize binary semaphore as taken, will cause the thread to initially
+   * wait on the  */
+  chBSemInit(&msdp->bsem, TRUE);
+
+#if MSD_USE_LATENCY_HISTOGRAM
+  msdResetLatency(msdp);
+#endif
+
+  msdp->max_lun = (uint8_t)(n - 1);
+  msdp->lunp = &msdp->luns[0];
+  for (i = 0; i < n; i++) {
+    msd_lun_t *lunp = &msdp->luns[i];
+    const MSDLunConfig *cfg = &luns[i];
+    BlockDeviceInfo bdi;
+
+    chDbgAssert((cfg->depth == 0) ||
+                ((cfg->slots != NULL) && (cfg->wsp != NULL)),
+                "msdInitLuns(), #1", "missing write-behind resources");
+
+    lunp->msdp = msdp;
+    lunp->config = cfg;
+    lunp->head = 0;
+    lunp->tail = 0;
+    lunp->deferred_error = FALSE;
+    lunp->thdp = NULL;
+    chSemInit(&lunp->free_slots, (cnt_t)cfg->depth);
+    chSemInit(&lunp->full_slots, 0);
+
+    /* Initialize sense values to zero */
+    for (j = 0; j < sizeof(scsi_sense_response_t); j++)
+      lunp->sense.byte[j] = 0x00;
 
-	bool_t wait_for_isr = FALSE;
+    /* Response code = 0x70, additional sense length = 0x0A */
+    lunp->sense.byte[0] = 0x70;
+    lunp->sense.byte[7] = 0x0A;
 
-	/* wait for the usb to be initialized */
-	msd_debug_print(chp, "Y");
-	WaitForISR(msdp, FALSE);
-	msd_debug_print(chp, "y");
+    /* make sure block device is working and get info */
+    while (blkGetDriverState(cfg->bbdp) != BLK_READY)
+      chThdSleepMilliseconds(50);
+
+    blkGetInfo(cfg->bbdp, &bdi);
+    chDbgAssert(bdi.blk_size == MSD_BLOCK_SIZE,
+                "msdInitLuns(), #2", "unsupported block size");
+    chDbgAssert(cfg->start + cfg->blocks <= bdi.blk_num,
+                "msdInitLuns(), #3", "unit outside the device");
+    lunp->blk_num = cfg->blocks > 0 ? cfg->blocks : bdi.blk_num - cfg->start;
+  }
 
+  usbp->USBD_PARAM_NAME = (void *)msdp;
+}
 
-	while (TRUE) {
-		wait_for_isr = FALSE;
+/**
+ * @brief   Starts the data handling threads of a mass storage instance.
+ * @note    Upon entry, USB bus should be disconnected.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ */
+void msdStart(USBMassStorageDriver *msdp) {
+  unsigned i;
 
-		if( msdp->reconfigured_or_reset_event ) {
-		  /*If the devices is unplugged and re-plugged but did not have a CPU reset,
-		   * we must set the state back to idle.*/
-		  msdp->reconfigured_or_reset_event = FALSE;
-		  msdp->state = idle;
-		}
+  for (i = 0; i <= msdp->max_lun; i++) {
+    msd_lun_t *lunp = &msdp->luns[i];
 
+    if ((lunp->config->depth > 0) && (lunp->thdp == NULL))
+      lunp->thdp = chThdCreateStatic(lunp->config->wsp, lunp->config->wsize,
+                                     MSD_LUN_THREAD_PRIORITY,
+                                     MassStorageLunThd, lunp);
+  }
 
+  if (msdp->thdp == NULL)
+    msdp->thdp = chThdCreateStatic(msdp->wa, sizeof(msdp->wa),
+                                   MSD_THREAD_PRIORITY, MassStorageThd, msdp);
+}
 
-		bool_t enable_msd = true;
-		if( msdp->enable_msd_callback != NULL ) {
-		  enable_msd = msdp->enable_msd_callback();
-		}
+/**
+ * @brief   USB Event handler calback.
+ * @details To be used as both IN and OUT callback of the mass storage
+ *          endpoint.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @param[in] ep        USB Endpoint Number
+ */
+void msdUsbEvent(USBDriver *usbp, usbep_t ep) {
+  USBMassStorageDriver *msdp = (USBMassStorageDriver *)usbp->USBD_PARAM_NAME;
 
+  (void)ep;
 
-		if( enable_msd ) {
-          msd_debug_print(chp, "state=%d\r\n", msdp->state);
-          /* wait on data depending on the current state */
-          switch(msdp->state) {
-          case idle:
-              msd_debug_print(chp, "IDL");
-              wait_for_isr = msdWaitForCommandBlock(msdp);
-              msd_debug_print(chp, "x\r\n");
-              break;
-          case read_cmd_block:
-              msd_debug_print(chp, "RCB");
-              wait_for_isr = msdReadCommandBlock(msdp);
-              msd_debug_print(chp, "x\r\n");
-              break;
-          case ejected:
-              /* disconnect usb device */
-              msd_debug_print(chp, "ejected\r\n");
-              if( ! msdp->disable_usb_bus_disconnect_on_eject ) {
-                chThdSleepMilliseconds(70);
-                usbDisconnectBus(msdp->usbp);
-                usbStop(msdp->usbp);
-                chThdExit(0);
-              }
-              return 0;
-          }
-		}
+  chSysLockFromIsr();
+  if (msdp->pipe.dir != MSD_PIPE_IDLE)
+    msd_pipe_done_i(msdp);
+  else
+    chBSemSignalI(&msdp->bsem);
+  chSysUnlockFromIsr();
+}
 
+/**
+ * @brief   Default requests hook.
+ *
+ * @param[in] usbp      pointer to the @p USBDriver object
+ * @return              The hook status.
+ * @retval TRUE         Message handled internally.
+ * @retval FALSE        Message not handled.
+ */
+bool_t msdRequestsHook(USBDriver *usbp) {
+  USBMassStorageDriver *msdp = (USBMassStorageDriver *)usbp->USBD_PARAM_NAME;
+
+  if (((usbp->setup[0] & USB_RTYPE_TYPE_MASK) == USB_RTYPE_TYPE_CLASS) &&
+      ((usbp->setup[0] & USB_RTYPE_RECIPIENT_MASK) == USB_RTYPE_RECIPIENT_INTERFACE)) {
+    /* check that the request is for interface 0.*/
+    if (MSD_SETUP_INDEX(usbp->setup) != 0)
+      return FALSE;
+
+    /* act depending on bRequest = setup[1] */
+    switch (usbp->setup[1]) {
+    case MSD_REQ_RESET:
+      /* check that it is a HOST2DEV request */
+      if (((usbp->setup[0] & USB_RTYPE_DIR_MASK) != USB_RTYPE_DIR_HOST2DEV) ||
+          (MSD_SETUP_LENGTH(usbp->setup) != 0) ||
+          (MSD_SETUP_VALUE(usbp->setup) != 0))
+        return FALSE;
 
-		/* wait until the ISR wakes thread */
-		if( wait_for_isr && (!msdp->reconfigured_or_reset_event) ) {
-		    msd_debug_print(chp, "W");
-			WaitForISR(msdp, FALSE);
-			msd_debug_print(chp, "w");
-		}
-	}
+      /* reset all endpoints */
+      /* TODO!*/
+      /* The device shall NAK the status stage of the device request until
+       * the Bulk-Only Mass Storage Reset is complete.
+       */
+      return TRUE;
+    case MSD_GET_MAX_LUN:
+      /* check that it is a DEV2HOST request */
+      if (((usbp->setup[0] & USB_RTYPE_DIR_MASK) != USB_RTYPE_DIR_DEV2HOST) ||
+          (MSD_SETUP_LENGTH(usbp->setup) != 1) ||
+          (MSD_SETUP_VALUE(usbp->setup) != 0))
+        return FALSE;
 
-	return 0;
+      usbSetupTransfer(usbp, &msdp->max_lun, 1, NULL);
+      return TRUE;
+    default:
+      return FALSE;
+    }
+  }
+  return FALSE;
 }
 
+#if MSD_USE_LATENCY_HISTOGRAM || defined(__DOXYGEN__)
+/**
+ * @brief   Clears the latency histograms of a mass storage instance.
+ *
+ * @param[in] msdp      pointer to the @p USBMassStorageDriver object
+ */
+void msdResetLatency(USBMassStorageDriver *msdp) {
+  unsigned i, j;
+
+  chSysLock();
+  for (i = 0; i < MSD_HIST_CLASSES; i++) {
+    msdp->latency[i].count = 0;
+    msdp->latency[i].max = 0;
+    for (j = 0; j < MSD_HISTOGRAM_BINS; j++)
+      msdp->latency[i].bins[j] = 0;
+  }
+  chSysUnlock();
+}
+#endif /* MSD_USE_LATENCY_HISTOGRAM */
 
 #endif /* HAL_USE_MASS_STORAGE_USB */
+
+/** @} */
@@ -58,6 +58,20 @@
 #define HAL_USE_ADC                 TRUE
 #endif
 
+/**
+ * @brief   Enables the ADC streaming pipeline subsystem.
+ */
+#if !defined(HAL_USE_ADC_STREAM) || defined(__DOXYGEN__)
+#define HAL_USE_ADC_STREAM          FALSE
+#endif
+
+/**
+ * @brief   Enables the block I/O queue subsystem.
+ */
+#if !defined(HAL_USE_BLOCK_QUEUE) || defined(__DOXYGEN__)
+#define HAL_USE_BLOCK_QUEUE         FALSE
+#endif
+
 /**
  * @brief   Enables the CAN subsystem.
  */
@@ -201,6 +215,27 @@
 #if !defined(CAN_USE_SLEEP_MODE) || defined(__DOXYGEN__)
 #define CAN_USE_SLEEP_MODE          TRUE
 #endif
+
+/**
+ * @brief   Software receive FIFO switch.
+ */
+#if !defined(CAN_USE_RX_FIFO) || defined(__DOXYGEN__)
+#define CAN_USE_RX_FIFO             FALSE
+#endif
+
+/**
+ * @brief   Software receive FIFO size in frames, must be a power of two.
+ */
+#if !defined(CAN_RX_FIFO_SIZE) || defined(__DOXYGEN__)
+#define CAN_RX_FIFO_SIZE            32
+#endif
+
+/**
+ * @brief   Software acceptance filter and routes switch.
+ */
+#if !defined(CAN_USE_RX_FILTER) || defined(__DOXYGEN__)
+#define CAN_USE_RX_FILTER           FALSE
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -340,6 +375,29 @@
 #if !defined(SERIAL_USB_BUFFERS_SIZE) || defined(__DOXYGEN__)
 #define SERIAL_USB_BUFFERS_SIZE     64
 #endif
+
+/**
+ * @brief   Double buffered transmit mode.
+ * @details If enabled writers fill a linear buffer while the other one is
+ *          in flight on the IN data endpoint.
+ */
+#if !defined(SERIAL_USB_USE_TX_DOUBLE_BUFFER) || defined(__DOXYGEN__)
+#define SERIAL_USB_USE_TX_DOUBLE_BUFFER     FALSE
+#endif
+
+/**
+ * @brief   Size of each transmit buffer in double buffered mode.
+ */
+#if !defined(SERIAL_USB_TX_BUFFER_SIZE) || defined(__DOXYGEN__)
+#define SERIAL_USB_TX_BUFFER_SIZE           512
+#endif
+
+/**
+ * @brief   Transmit coalescing time in double buffered mode.
+ */
+#if !defined(SERIAL_USB_TX_COALESCE_TIME) || defined(__DOXYGEN__)
+#define SERIAL_USB_TX_COALESCE_TIME         1
+#endif
 /** @} */
 
 /*===========================================================================*/
@@ -115,8 +115,12 @@
 #include "chmsg.h"
 #include "chmboxes.h"
 #include "chmemcore.h"
+#include "chmemacct.h"
 #include "chheap.h"
 #include "chmempools.h"
+#include "chmemarena.h"
+#include "chbudget.h"
+#include "chlatency.h"
 #include "chthreads.h"
 #include "chdynamic.h"
 #include "chregistry.h"
@@ -0,0 +1,112 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chbudget.h
+ * @brief   CPU budget servers macros and structures.
+ *
+ * @addtogroup budgets
+ * @{
+ */
+
+#ifndef _CHBUDGET_H_
+#define _CHBUDGET_H_
+
+/**
+ * @brief   CPU budget servers APIs.
+ * @details If enabled then the CPU budget servers APIs are included in the
+ *          kernel and the system tick charges the running thread to its
+ *          server.
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_BUDGETS) || defined(__DOXYGEN__)
+#define CH_USE_BUDGETS                  FALSE
+#endif
+
+#if CH_USE_BUDGETS || defined(__DOXYGEN__)
+
+/**
+ * @brief   Structure representing a CPU budget server.
+ */
+typedef struct {
+  Thread                *bs_threads;    /**< @brief First thread of the
+                                                    group.                  */
+  systime_t             bs_budget;      /**< @brief Budget in ticks for each
+                                                    period.                 */
+  systime_t             bs_period;      /**< @brief Replenishment period in
+                                                    ticks.                  */
+  systime_t             bs_remaining;   /**< @brief Budget left in the
+                                                    current period.         */
+  tprio_t               bs_lowprio;     /**< @brief Priority of the group
+                                                    while depleted.         */
+  bool_t                bs_depleted;    /**< @brief The group is demoted.   */
+  VirtualTimer          bs_vt;          /**< @brief Replenishment timer.    */
+  uint32_t              bs_consumed;    /**< @brief Total charged ticks.    */
+  uint32_t              bs_depletions;  /**< @brief Budget depletions.      */
+} BudgetServer;
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Returns the budget left in the current period.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ * @return              The remaining budget in ticks.
+ *
+ * @iclass
+ */
+#define chBudgetGetRemainingI(bsp) ((bsp)->bs_remaining)
+
+/**
+ * @brief   Returns @p TRUE if the group of a budget server is demoted.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ * @return              The depletion state.
+ *
+ * @iclass
+ */
+#define chBudgetIsDepletedI(bsp) ((bool_t)(bsp)->bs_depleted)
+/** @} */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void chBudgetObjectInit(BudgetServer *bsp, systime_t budget,
+                          systime_t period, tprio_t lowprio);
+  void chBudgetStartI(BudgetServer *bsp);
+  void chBudgetStart(BudgetServer *bsp);
+  void chBudgetStopI(BudgetServer *bsp);
+  void chBudgetStop(BudgetServer *bsp);
+  void chBudgetAddI(BudgetServer *bsp, Thread *tp);
+  void chBudgetAdd(BudgetServer *bsp, Thread *tp);
+  void chBudgetRemoveI(Thread *tp);
+  void chBudgetRemove(Thread *tp);
+  void _budget_tickI(BudgetServer *bsp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CH_USE_BUDGETS */
+
+#endif /* _CHBUDGET_H_ */
+
+/** @} */
@@ -41,6 +41,13 @@
 #error "CH_USE_DYNAMIC requires CH_USE_HEAP and/or CH_USE_MEMPOOLS"
 #endif
 
+/*
+ * Optional settings, the cache is disabled if not specified in chconf.h.
+ */
+#if !defined(CH_THD_CACHE_SIZE) || defined(__DOXYGEN__)
+#define CH_THD_CACHE_SIZE               0
+#endif
+
 /*
  * Dynamic threads APIs.
  */
@@ -57,6 +64,9 @@ extern "C" {
   Thread *chThdCreateFromMemoryPool(MemoryPool *mp, tprio_t prio,
                                     tfunc_t pf, void *arg);
 #endif
+#if CH_THD_CACHE_SIZE > 0
+  void chThdCacheFlush(void);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -55,6 +55,10 @@ union heap_header {
       MemoryHeap        *heap;      /**< @brief Block owner heap.           */
     } u;                            /**< @brief Overlapped fields.          */
     size_t              size;       /**< @brief Size of the memory block.   */
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+    MemTag              tag;        /**< @brief Owner and call site of an
+                                                allocated block.            */
+#endif
   } h;
 };
 
@@ -70,6 +74,9 @@ struct memory_heap {
 #else
   Semaphore             h_sem;      /**< @brief Heap access semaphore.      */
 #endif
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+  MemAccount            h_acct;     /**< @brief Heap memory account.        */
+#endif
 };
 
 #ifdef __cplusplus
@@ -82,6 +89,9 @@ extern "C" {
   void *chHeapAlloc(MemoryHeap *heapp, size_t size);
   void chHeapFree(void *p);
   size_t chHeapStatus(MemoryHeap *heapp, size_t *sizep);
+#if CH_USE_MEMACCT && !CH_USE_MALLOC_HEAP
+  void chHeapGetAccount(MemoryHeap *heapp, MemAccount *ap);
+#endif
 #ifdef __cplusplus
 }
 #endif
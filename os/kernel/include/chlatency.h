@@ -0,0 +1,180 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chlatency.h
+ * @brief   Latency histograms macros and structures.
+ *
+ * @addtogroup latency
+ * @{
+ */
+
+#ifndef _CHLATENCY_H_
+#define _CHLATENCY_H_
+
+/**
+ * @brief   Latency histograms.
+ * @details If enabled then the scheduler records the time each thread spends
+ *          in the ready list before running and the system tick records how
+ *          late the virtual timers callbacks are invoked.
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_LATENCY) || defined(__DOXYGEN__)
+#define CH_USE_LATENCY                  FALSE
+#endif
+
+/**
+ * @brief   Number of bins in a latency histogram.
+ * @details The bin @p n counts the samples in the range
+ *          <tt>[2^(n-1), 2^n)</tt>, the bin zero counts zero samples and
+ *          the last bin also counts all the samples exceeding its range.
+ */
+#if !defined(CH_LATENCY_BINS) || defined(__DOXYGEN__)
+#define CH_LATENCY_BINS                 16
+#endif
+
+#if CH_USE_LATENCY || defined(__DOXYGEN__)
+
+#if (CH_LATENCY_BINS < 2) || (CH_LATENCY_BINS > 33)
+#error "invalid CH_LATENCY_BINS value"
+#endif
+
+/**
+ * @brief   Latency clock.
+ * @details The port realtime counter is used if available, the system time
+ *          otherwise.
+ */
+#if defined(PORT_RT_FREQUENCY) || defined(__DOXYGEN__)
+#define CH_LATENCY_CLOCK()              port_rt_get_counter_value()
+#define CH_LATENCY_FREQUENCY            PORT_RT_FREQUENCY
+#else
+#define CH_LATENCY_CLOCK()              ((uint32_t)chTimeNow())
+#define CH_LATENCY_FREQUENCY            CH_FREQUENCY
+#endif
+
+/**
+ * @brief   Structure representing a latency histogram.
+ */
+typedef struct LatencyHistogram LatencyHistogram;
+
+struct LatencyHistogram {
+  LatencyHistogram      *lh_next;       /**< @brief Next monitored
+                                                    histogram.              */
+  Thread                *lh_thread;     /**< @brief Monitored thread or
+                                                    @p NULL.                */
+  uint32_t              lh_budget;      /**< @brief Latency budget in clock
+                                                    units, zero if none.    */
+  uint32_t              lh_samples;     /**< @brief Recorded samples.       */
+  uint32_t              lh_max;         /**< @brief Worst recorded latency. */
+  uint32_t              lh_overruns;    /**< @brief Samples exceeding the
+                                                    budget.                 */
+  uint32_t              lh_reported;    /**< @brief Overruns already
+                                                    reported.               */
+  uint32_t              lh_last;        /**< @brief Latency of the last
+                                                    overrun.                */
+  uint32_t              lh_stalls;      /**< @brief Stalls detected by the
+                                                    monitor.                */
+  uint32_t              lh_stallts;     /**< @brief Ready timestamp of the
+                                                    last detected stall.    */
+  uint32_t              lh_bins[CH_LATENCY_BINS]; /**< @brief Log2 bins.    */
+};
+
+/**
+ * @brief   Latency monitor alarm callback.
+ * @details The callback is invoked outside the kernel lock.
+ *
+ * @param[in] lhp       the histogram exceeding its budget
+ * @param[in] latency   the overrun latency or the time spent in the ready
+ *                      list by a stalled thread, in clock units
+ */
+typedef void (*latalarm_t)(LatencyHistogram *lhp, uint32_t latency);
+
+/**
+ * @brief   Latency monitor thread configuration.
+ */
+typedef struct {
+  systime_t             lmc_interval;   /**< @brief Checks interval.        */
+  latalarm_t            lmc_alarm;      /**< @brief Alarm callback.         */
+} LatencyMonitorConfig;
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Converts a latency from clock units to microseconds.
+ *
+ * @param[in] n         the latency in clock units
+ * @return              The latency in microseconds.
+ *
+ * @api
+ */
+#define LAT2US(n) ((uint32_t)(((uint64_t)(n) * 1000000) /                   \
+                              CH_LATENCY_FREQUENCY))
+
+/**
+ * @brief   Lower bound of a histogram bin.
+ *
+ * @param[in] n         the bin index
+ * @return              The lowest latency counted in the bin.
+ *
+ * @api
+ */
+#define chLatencyBinBase(n) ((n) == 0 ? (uint32_t)0 : (uint32_t)1 << ((n) - 1))
+/** @} */
+
+#if !defined(__DOXYGEN__)
+extern LatencyHistogram _latency_threads, _latency_timers;
+#endif
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void _latency_readyI(Thread *tp);
+  void _latency_switchI(Thread *ntp);
+  void _latency_tickI(void);
+  void _latency_timerI(void);
+  void _latency_exitI(Thread *tp);
+  void chLatencyObjectInit(LatencyHistogram *lhp);
+  void chLatencyAttach(LatencyHistogram *lhp, Thread *tp, uint32_t budget);
+  void chLatencyDetach(LatencyHistogram *lhp);
+  void chLatencySnapshot(LatencyHistogram *threads, LatencyHistogram *timers);
+  void chLatencyReset(void);
+  unsigned chLatencyCheck(latalarm_t alarm);
+  Thread *chLatencyMonitorStart(void *wsp, size_t size, tprio_t prio,
+                                const LatencyMonitorConfig *lmcp);
+#ifdef __cplusplus
+}
+#endif
+
+#else /* !CH_USE_LATENCY */
+/* When the latency histograms are disabled the hooks invoked by the
+   scheduler, by the system tick and by the threads termination are
+   replaced by empty macros.*/
+#define _latency_readyI(tp)
+#define _latency_switchI(ntp)
+#define _latency_tickI()
+#define _latency_timerI()
+#define _latency_exitI(tp)
+#endif /* !CH_USE_LATENCY */
+
+#endif /* _CHLATENCY_H_ */
+
+/** @} */
@@ -0,0 +1,174 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chmemacct.h
+ * @brief   Memory accounting macros and structures.
+ *
+ * @addtogroup memacct
+ * @{
+ */
+
+#ifndef _CHMEMACCT_H_
+#define _CHMEMACCT_H_
+
+/**
+ * @brief   Memory accounting.
+ * @details If enabled then the core allocator, the heaps and the memory
+ *          pools keep track of the live memory and of its peaks, the heap
+ *          blocks are also tagged with the allocating thread and call site.
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_MEMACCT) || defined(__DOXYGEN__)
+#define CH_USE_MEMACCT                  FALSE
+#endif
+
+/**
+ * @brief   Number of entries in the owners table.
+ * @note    The entry zero collects the allocations performed when the
+ *          table is full.
+ */
+#if !defined(CH_MEMACCT_OWNERS) || defined(__DOXYGEN__)
+#define CH_MEMACCT_OWNERS               16
+#endif
+
+/**
+ * @brief   Number of entries in the call sites table.
+ * @note    The entry zero collects the allocations performed when the
+ *          table is full.
+ */
+#if !defined(CH_MEMACCT_SITES) || defined(__DOXYGEN__)
+#define CH_MEMACCT_SITES                32
+#endif
+
+/**
+ * @brief   Number of size classes.
+ * @details The first class contains the blocks up to 8 bytes, each
+ *          following class doubles the size, the last class contains all
+ *          the bigger blocks.
+ */
+#if !defined(CH_MEMACCT_CLASSES) || defined(__DOXYGEN__)
+#define CH_MEMACCT_CLASSES              12
+#endif
+
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+
+#if (CH_MEMACCT_OWNERS < 2) || (CH_MEMACCT_OWNERS > 256)
+#error "invalid CH_MEMACCT_OWNERS value"
+#endif
+
+#if (CH_MEMACCT_SITES < 2) || (CH_MEMACCT_SITES > 256)
+#error "invalid CH_MEMACCT_SITES value"
+#endif
+
+/**
+ * @brief   Returns the call site of the invoking function.
+ */
+#if defined(__GNUC__) || defined(__DOXYGEN__)
+#define MEMACCT_SITE() ((const void *)__builtin_return_address(0))
+#else
+#define MEMACCT_SITE() ((const void *)0)
+#endif
+
+/**
+ * @brief   Memory account.
+ */
+typedef struct {
+  size_t                ma_live;        /**< @brief Live bytes.             */
+  size_t                ma_peak;        /**< @brief Live bytes peak.        */
+  uint32_t              ma_allocs;      /**< @brief Allocations.            */
+  uint32_t              ma_frees;       /**< @brief Releases.               */
+  uint32_t              ma_failures;    /**< @brief Failed allocations.     */
+} MemAccount;
+
+/**
+ * @brief   Tag of an accounted memory block.
+ */
+typedef struct {
+  uint8_t               mt_owner;       /**< @brief Owners table entry.     */
+  uint8_t               mt_site;        /**< @brief Sites table entry.      */
+} MemTag;
+
+/**
+ * @brief   Owners table entry.
+ * @details An entry whose thread terminated keeps the memory not yet
+ *          released, this is memory leaked by the thread.
+ */
+typedef struct {
+  Thread                *mo_thread;     /**< @brief Owner thread or @p NULL
+                                                    if terminated.          */
+  const char            *mo_name;       /**< @brief Owner thread name.      */
+  MemAccount            mo_acct;        /**< @brief Heap memory owned.      */
+} MemOwner;
+
+/**
+ * @brief   Call sites table entry.
+ */
+typedef struct {
+  const void            *ms_site;       /**< @brief Call site address.      */
+  MemAccount            ms_acct;        /**< @brief Heap and core memory
+                                                    allocated at the site.  */
+} MemSite;
+
+/**
+ * @brief   Memory accounting snapshot.
+ */
+typedef struct {
+  /**
+   * @brief Core allocator account.
+   */
+  MemAccount            core;
+  /**
+   * @brief Owners table.
+   */
+  MemOwner              owners[CH_MEMACCT_OWNERS];
+  /**
+   * @brief Call sites table.
+   */
+  MemSite               sites[CH_MEMACCT_SITES];
+  /**
+   * @brief Allocations in each size class.
+   */
+  uint32_t              class_allocs[CH_MEMACCT_CLASSES];
+  /**
+   * @brief Live blocks in each size class.
+   */
+  uint32_t              class_live[CH_MEMACCT_CLASSES];
+} MemAcctSnapshot;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void _memacct_allocI(MemAccount *ap, size_t size);
+  void _memacct_freeI(MemAccount *ap, size_t size);
+  void _memacct_tagI(MemTag *tp, const void *site, size_t size);
+  void _memacct_untagI(const MemTag *tp, size_t size);
+  void _memacct_coreI(size_t size, const void *site);
+  void _memacct_exitI(Thread *tp);
+  void chMemAcctSnapshot(MemAcctSnapshot *sp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CH_USE_MEMACCT */
+
+#endif /* _CHMEMACCT_H_ */
+
+/** @} */
@@ -0,0 +1,127 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chmemarena.h
+ * @brief   Memory arenas macros and structures.
+ *
+ * @addtogroup arenas
+ * @{
+ */
+
+#ifndef _CHMEMARENA_H_
+#define _CHMEMARENA_H_
+
+/**
+ * @brief   Memory arenas APIs.
+ * @details If enabled then the memory arenas APIs are included in the
+ *          kernel and each thread gets a pointer to its current arena.
+ * @note    The default is @p FALSE.
+ * @note    Requires @p CH_USE_MEMCORE.
+ */
+#if !defined(CH_USE_MEMARENAS) || defined(__DOXYGEN__)
+#define CH_USE_MEMARENAS                FALSE
+#endif
+
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+
+#if !CH_USE_MEMCORE
+#error "CH_USE_MEMARENAS requires CH_USE_MEMCORE"
+#endif
+
+/**
+ * @brief   Arena chunk header.
+ */
+struct arena_chunk {
+  struct arena_chunk    *ac_next;       /**< @brief Next chunk.             */
+  uint8_t               *ac_end;        /**< @brief Chunk end.              */
+};
+
+/**
+ * @brief   Structure representing a memory arena.
+ */
+typedef struct {
+  struct arena_chunk    *ma_first;      /**< @brief First chunk.            */
+  struct arena_chunk    *ma_current;    /**< @brief Chunk in use.           */
+  uint8_t               *ma_nextmem;    /**< @brief Next free byte.         */
+  uint8_t               *ma_endmem;     /**< @brief End of the chunk in
+                                                    use.                    */
+  size_t                ma_chunk;       /**< @brief Refill size.            */
+  memgetfunc_t          ma_provider;    /**< @brief Chunks provider, I-class
+                                                    function.               */
+  size_t                ma_reserved;    /**< @brief Memory obtained from the
+                                                    provider.               */
+  uint32_t              ma_refills;     /**< @brief Number of chunks
+                                                    obtained from the
+                                                    provider.               */
+} MemoryArena;
+
+/**
+ * @brief   Arena position saved by @p chArenaGetMark().
+ */
+typedef struct {
+  struct arena_chunk    *am_chunk;      /**< @brief Chunk in use.           */
+  uint8_t               *am_nextmem;    /**< @brief Next free byte.         */
+} ArenaMark;
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Saves the current position of an arena.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure
+ * @param[out] mp       pointer to an @p ArenaMark structure
+ */
+#define chArenaGetMark(map, mp) {                                           \
+  (mp)->am_chunk = (map)->ma_current;                                       \
+  (mp)->am_nextmem = (map)->ma_nextmem;                                     \
+}
+
+/**
+ * @brief   Returns the arena of the current thread.
+ *
+ * @return              A pointer to the @p MemoryArena structure.
+ * @retval NULL         if the thread has no arena.
+ */
+#define chArenaGetSelf() (currp->p_arena)
+/** @} */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void chArenaInit(MemoryArena *map, size_t chunk, memgetfunc_t provider);
+  void *chArenaAllocFromI(MemoryArena *map, size_t size);
+  void *chArenaAllocFrom(MemoryArena *map, size_t size);
+  void chArenaRelease(MemoryArena *map, const ArenaMark *mp);
+  void chArenaReset(MemoryArena *map);
+  MemoryArena *chArenaSetSelf(MemoryArena *map);
+  void *chArenaAllocI(size_t size);
+  void *chArenaAlloc(size_t size);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* CH_USE_MEMARENAS */
+
+#endif /* _CHMEMARENA_H_ */
+
+/** @} */
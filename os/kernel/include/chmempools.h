@@ -48,6 +48,9 @@ typedef struct {
                                                     size.                   */
   memgetfunc_t          mp_provider;    /**< @brief Memory blocks provider for
                                                     this pool.              */
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+  MemAccount            mp_acct;        /**< @brief Memory pool account.    */
+#endif
 } MemoryPool;
 
 /**
@@ -59,8 +62,13 @@ typedef struct {
  * @param[in] size      size of the memory pool contained objects
  * @param[in] provider  memory provider function for the memory pool
  */
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+#define _MEMORYPOOL_DATA(name, size, provider)                              \
+  {NULL, size, provider, {0, 0, 0, 0, 0}}
+#else
 #define _MEMORYPOOL_DATA(name, size, provider)                              \
   {NULL, size, provider}
+#endif
 
 /**
  * @brief Static memory pool initializer in hungry mode.
@@ -75,6 +83,7 @@ typedef struct {
 #define MEMORYPOOL_DECL(name, size, provider)                               \
   MemoryPool name = _MEMORYPOOL_DATA(name, size, provider)
 
+#if !CH_USE_MEMACCT || defined(__DOXYGEN__)
 /**
  * @name    Macro Functions
  * @{
@@ -113,6 +122,7 @@ typedef struct {
  */
 #define chPoolAddI(mp, objp) chPoolFreeI(mp, objp)
 /** @} */
+#endif /* !CH_USE_MEMACCT */
 
 #ifdef __cplusplus
 extern "C" {
@@ -123,6 +133,11 @@ extern "C" {
   void *chPoolAlloc(MemoryPool *mp);
   void chPoolFreeI(MemoryPool *mp, void *objp);
   void chPoolFree(MemoryPool *mp, void *objp);
+#if CH_USE_MEMACCT
+  void chPoolAddI(MemoryPool *mp, void *objp);
+  void chPoolAdd(MemoryPool *mp, void *objp);
+  void chPoolGetAccount(MemoryPool *mp, MemAccount *ap);
+#endif
 #ifdef __cplusplus
 }
 #endif
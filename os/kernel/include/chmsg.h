@@ -74,6 +74,7 @@ extern "C" {
   msg_t chMsgSend(Thread *tp, msg_t msg);
   Thread * chMsgWait(void);
   void chMsgRelease(Thread *tp, msg_t msg);
+  Thread *chMsgReplyAndWait(Thread *tp, msg_t msg);
 #ifdef __cplusplus
 }
 #endif
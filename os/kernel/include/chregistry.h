@@ -57,6 +57,52 @@ typedef struct {
   uint8_t   cf_off_time;            /**< @brief Offset of @p p_time field.  */
 } chdebug_t;
 
+/**
+ * @brief   Thread snapshot record.
+ * @details Copy of the thread status taken by @p chRegSnapshot().
+ */
+typedef struct {
+  /**
+   * @brief Thread identifier, only valid for comparison because the thread
+   *        could have terminated after the snapshot.
+   */
+  Thread                *ts_thread;
+  /**
+   * @brief Thread name or @p NULL.
+   */
+  const char            *ts_name;
+  /**
+   * @brief Thread priority.
+   */
+  tprio_t               ts_prio;
+  /**
+   * @brief Thread state.
+   */
+  tstate_t              ts_state;
+  /**
+   * @brief Thread flags.
+   */
+  tmode_t               ts_flags;
+#if CH_USE_DYNAMIC || defined(__DOXYGEN__)
+  /**
+   * @brief References to the thread, not including the snapshot ones.
+   */
+  trefs_t               ts_refs;
+#endif
+#if CH_DBG_THREADS_PROFILING || defined(__DOXYGEN__)
+  /**
+   * @brief Thread consumed time in ticks.
+   */
+  systime_t             ts_time;
+#endif
+#if CH_DBG_FILL_THREADS || defined(__DOXYGEN__)
+  /**
+   * @brief Stack space never used by the thread, in bytes.
+   */
+  size_t                ts_stkfree;
+#endif
+} ThreadSnapshot;
+
 /**
  * @name    Macro Functions
  * @{
@@ -119,6 +165,7 @@ extern "C" {
   extern ROMCONST chdebug_t ch_debug;
   Thread *chRegFirstThread(void);
   Thread *chRegNextThread(Thread *tp);
+  cnt_t chRegSnapshot(ThreadSnapshot *tsp, cnt_t n);
 #ifdef __cplusplus
 }
 #endif
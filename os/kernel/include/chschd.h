@@ -52,6 +52,30 @@
 #define ABSPRIO         255         /**< @brief Greatest possible priority. */
 /** @} */
 
+/**
+ * @brief   EDF scheduling class.
+ * @details If enabled then the threads at the @p CH_EDF_PRIO priority level
+ *          are ordered by absolute deadline instead of by arrival and are
+ *          not subject to the round robin.
+ * @note    The default is @p FALSE.
+ */
+#if !defined(CH_USE_EDF) || defined(__DOXYGEN__)
+#define CH_USE_EDF                      FALSE
+#endif
+
+/**
+ * @brief   Priority level reserved to the EDF scheduling class.
+ * @details All the threads at this priority level must have declared their
+ *          timing using @p chThdSetPeriodic().
+ */
+#if !defined(CH_EDF_PRIO) || defined(__DOXYGEN__)
+#define CH_EDF_PRIO                     (NORMALPRIO + 8)
+#endif
+
+#if CH_USE_EDF && ((CH_EDF_PRIO <= IDLEPRIO) || (CH_EDF_PRIO > HIGHPRIO))
+#error "invalid CH_EDF_PRIO value"
+#endif
+
 /**
  * @name    Special time constants
  * @{
@@ -78,6 +102,32 @@
  */
 #define firstprio(rlp)  ((rlp)->p_next->p_prio)
 
+/**
+ * @brief   Returns @p TRUE if the deadline @p d1 comes before @p d2.
+ * @note    The comparison is valid across the system time wrap around as
+ *          long as the two deadlines are less than half the system time
+ *          range apart.
+ *
+ * @notapi
+ */
+#define edf_before(d1, d2) ((systime_t)((d1) - (d2)) > ((systime_t)-1 >> 1))
+
+/**
+ * @brief   Returns @p TRUE if the thread @p tp1 must run before @p tp2.
+ * @details The thread with higher priority comes first, threads in the EDF
+ *          band are ordered by absolute deadline.
+ *
+ * @notapi
+ */
+#if CH_USE_EDF || defined(__DOXYGEN__)
+#define precedes(tp1, tp2)                                                  \
+  (((tp1)->p_prio > (tp2)->p_prio) ||                                       \
+   (((tp1)->p_prio == CH_EDF_PRIO) && ((tp2)->p_prio == CH_EDF_PRIO) &&     \
+    edf_before((tp1)->p_deadline, (tp2)->p_deadline)))
+#else
+#define precedes(tp1, tp2) ((tp1)->p_prio > (tp2)->p_prio)
+#endif
+
 /**
  * @extends ThreadsQueue
  *
@@ -139,6 +189,9 @@ extern "C" {
 #if !defined(PORT_OPTIMIZED_GOSLEEPS)
   void chSchGoSleepS(tstate_t newstate);
 #endif
+#if !defined(PORT_OPTIMIZED_GOSLEEPHANDOFFS)
+  void chSchGoSleepHandoffS(tstate_t newstate, Thread *ntp);
+#endif
 #if !defined(PORT_OPTIMIZED_GOSLEEPTIMEOUTS)
   msg_t chSchGoSleepTimeoutS(tstate_t newstate, systime_t time);
 #endif
@@ -171,14 +224,28 @@ extern "C" {
 /**
  * @brief   Determines if the current thread must reschedule.
  * @details This function returns @p TRUE if there is a ready thread with
- *          higher priority.
+ *          higher priority or, in the EDF band, with an earlier deadline.
  *
  * @iclass
  */
 #if !defined(PORT_OPTIMIZED_ISRESCHREQUIREDI) || defined(__DOXYGEN__)
-#define chSchIsRescRequiredI() (firstprio(&rlist.r_queue) > currp->p_prio)
+#define chSchIsRescRequiredI() precedes(rlist.r_queue.p_next, currp)
 #endif /* !defined(PORT_OPTIMIZED_ISRESCHREQUIREDI) */
 
+/**
+ * @brief   Determines if a sleeping thread can be handed over directly.
+ * @details This function returns @p TRUE if the thread has a priority
+ *          higher than all the ready threads, so that it would be the next
+ *          thread picked from the ready list.
+ *
+ * @param[in] tp        the sleeping thread
+ *
+ * @iclass
+ */
+#if !defined(PORT_OPTIMIZED_CANHANDOFFI) || defined(__DOXYGEN__)
+#define chSchCanHandoffI(tp) precedes(tp, rlist.r_queue.p_next)
+#endif /* !defined(PORT_OPTIMIZED_CANHANDOFFI) */
+
 /**
  * @brief   Determines if yielding is possible.
  * @details This function returns @p TRUE if there is a ready thread with
@@ -187,7 +254,7 @@ extern "C" {
  * @sclass
  */
 #if !defined(PORT_OPTIMIZED_CANYIELDS) || defined(__DOXYGEN__)
-#define chSchCanYieldS() (firstprio(&rlist.r_queue) >= currp->p_prio)
+#define chSchCanYieldS() (!precedes(currp, rlist.r_queue.p_next))
 #endif /* !defined(PORT_OPTIMIZED_CANYIELDS) */
 
 /**
@@ -74,6 +74,8 @@
 #define THD_MEM_MODE_MEMPOOL    2   /**< @brief Thread allocated from a
                                          Memory Pool.                       */
 #define THD_TERMINATE           4   /**< @brief Termination requested flag. */
+#define THD_STACK_EXTERNAL      8   /**< @brief Stack not adjacent to the
+                                         Thread structure.                  */
 /** @} */
 
 /**
@@ -127,6 +129,10 @@ struct Thread {
    */
 #if (CH_TIME_QUANTUM > 0) || defined(__DOXYGEN__)
   tslices_t             p_preempt;
+  /**
+   * @brief Round robin time quantum of this thread.
+   */
+  tslices_t             p_quantum;
 #endif
 #if CH_DBG_THREADS_PROFILING || defined(__DOXYGEN__)
   /**
@@ -210,6 +216,78 @@ struct Thread {
    */
   void                  *p_mpool;
 #endif
+#if (CH_USE_DYNAMIC && (CH_THD_CACHE_SIZE > 0)) || defined(__DOXYGEN__)
+  /**
+   * @brief Size of the thread working area.
+   */
+  size_t                p_wasize;
+  /**
+   * @brief Heap or Memory Pool owning the thread working area.
+   */
+  void                  *p_wsowner;
+#endif
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+  /**
+   * @brief Memory arena of the thread or @p NULL.
+   */
+  MemoryArena           *p_arena;
+#endif
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+  /**
+   * @brief Memory accounting owners table entry, zero if not assigned.
+   */
+  uint8_t               p_memowner;
+#endif
+#if CH_USE_EDF || defined(__DOXYGEN__)
+  /**
+   * @brief Absolute deadline of the current job.
+   */
+  systime_t             p_deadline;
+  /**
+   * @brief Release time of the current job.
+   */
+  systime_t             p_release;
+  /**
+   * @brief Release period.
+   */
+  systime_t             p_period;
+  /**
+   * @brief Deadline relative to the release time.
+   */
+  systime_t             p_reldeadline;
+  /**
+   * @brief Completed jobs.
+   */
+  uint32_t              p_jobs;
+  /**
+   * @brief Jobs completed after their deadline.
+   */
+  uint32_t              p_misses;
+#endif
+#if CH_USE_BUDGETS || defined(__DOXYGEN__)
+  /**
+   * @brief CPU budget server of the thread or @p NULL.
+   */
+  BudgetServer          *p_server;
+  /**
+   * @brief Next thread in the budget server group.
+   */
+  Thread                *p_bsnext;
+  /**
+   * @brief Own priority of the thread while its group is demoted.
+   */
+  tprio_t               p_bsprio;
+#endif
+#if CH_USE_LATENCY || defined(__DOXYGEN__)
+  /**
+   * @brief Latency clock when the thread entered the ready list.
+   */
+  uint32_t              p_readyts;
+  /**
+   * @brief Latency histogram of the thread or @p NULL.
+   */
+  LatencyHistogram      *p_latency;
+#endif
 #if defined(THREAD_EXT_FIELDS)
   /* Extra fields defined in chconf.h.*/
   THREAD_EXT_FIELDS
@@ -253,6 +331,31 @@ typedef msg_t (*tfunc_t)(void *);
  */
 #define chThdGetTicks(tp) ((tp)->p_time)
 
+/**
+ * @brief   Returns the number of jobs completed by a periodic thread.
+ * @note    This function is only available when the @p CH_USE_EDF
+ *          configuration option is enabled.
+ * @note    Can be invoked in any context.
+ *
+ * @param[in] tp        pointer to the thread
+ *
+ * @special
+ */
+#define chThdGetJobs(tp) ((tp)->p_jobs)
+
+/**
+ * @brief   Returns the number of deadline misses of a periodic thread.
+ * @details A deadline miss is a job completed after its absolute deadline.
+ * @note    This function is only available when the @p CH_USE_EDF
+ *          configuration option is enabled.
+ * @note    Can be invoked in any context.
+ *
+ * @param[in] tp        pointer to the thread
+ *
+ * @special
+ */
+#define chThdGetDeadlineMisses(tp) ((tp)->p_misses)
+
 /**
  * @brief   Returns the pointer to the @p Thread local storage area, if any.
  * @note    Can be invoked in any context.
@@ -355,16 +458,24 @@ extern "C" {
   Thread *_thread_init(Thread *tp, tprio_t prio);
 #if CH_DBG_FILL_THREADS
   void _thread_memfill(uint8_t *startp, uint8_t *endp, uint8_t v);
+  size_t chThdGetStackUnused(Thread *tp);
 #endif
   Thread *chThdCreateI(void *wsp, size_t size,
                        tprio_t prio, tfunc_t pf, void *arg);
   Thread *chThdCreateStatic(void *wsp, size_t size,
                             tprio_t prio, tfunc_t pf, void *arg);
   tprio_t chThdSetPriority(tprio_t newprio);
+#if CH_TIME_QUANTUM > 0
+  tslices_t chThdSetQuantum(tslices_t quantum);
+#endif
   Thread *chThdResume(Thread *tp);
   void chThdTerminate(Thread *tp);
   void chThdSleep(systime_t time);
   void chThdSleepUntil(systime_t time);
+#if CH_USE_EDF
+  void chThdSetPeriodic(systime_t period, systime_t deadline);
+  void chThdWaitNextPeriod(void);
+#endif
   void chThdYield(void);
   void chThdExit(msg_t msg);
   void chThdExitS(msg_t msg);
@@ -138,6 +138,7 @@ typedef struct {
       vtp->vt_func = (vtfunc_t)NULL;                                        \
       vtp->vt_next->vt_prev = (void *)&vtlist;                              \
       (&vtlist)->vt_next = vtp->vt_next;                                    \
+      _latency_timerI();                                                    \
       chSysUnlockFromIsr();                                                 \
       fn(vtp->vt_par);                                                      \
       chSysLockFromIsr();                                                   \
@@ -5,6 +5,8 @@ KERNSRC = ${CHIBIOS}/os/kernel/src/chsys.c \
           ${CHIBIOS}/os/kernel/src/chlists.c \
           ${CHIBIOS}/os/kernel/src/chvt.c \
           ${CHIBIOS}/os/kernel/src/chschd.c \
+          ${CHIBIOS}/os/kernel/src/chbudget.c \
+          ${CHIBIOS}/os/kernel/src/chlatency.c \
           ${CHIBIOS}/os/kernel/src/chthreads.c \
           ${CHIBIOS}/os/kernel/src/chdynamic.c \
           ${CHIBIOS}/os/kernel/src/chregistry.c \
@@ -16,8 +18,10 @@ KERNSRC = ${CHIBIOS}/os/kernel/src/chsys.c \
           ${CHIBIOS}/os/kernel/src/chmboxes.c \
           ${CHIBIOS}/os/kernel/src/chqueues.c \
           ${CHIBIOS}/os/kernel/src/chmemcore.c \
+          ${CHIBIOS}/os/kernel/src/chmemacct.c \
           ${CHIBIOS}/os/kernel/src/chheap.c \
-          ${CHIBIOS}/os/kernel/src/chmempools.c
+          ${CHIBIOS}/os/kernel/src/chmempools.c \
+          ${CHIBIOS}/os/kernel/src/chmemarena.c
 
 # Required include directories
 KERNINC = ${CHIBIOS}/os/kernel/include
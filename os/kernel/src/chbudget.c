@@ -0,0 +1,365 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chbudget.c
+ * @brief   CPU budget servers code.
+ *
+ * @addtogroup budgets
+ * @details CPU budget servers limit the processor time of a group of
+ *          threads.
+ *          <h2>Operation mode</h2>
+ *          A server grants its group of threads a budget of system ticks
+ *          every period. Each system tick is charged to the server of the
+ *          running thread. When the budget is exhausted all the threads of
+ *          the group are demoted to the server low priority and are
+ *          restored to their own priority when the budget is replenished
+ *          at the start of the next period. The unused budget is not
+ *          carried over the period boundary, the server is of the
+ *          deferrable kind.<br>
+ *          A thread can belong to a single server and leaves it
+ *          automatically on termination. A priority change of a demoted
+ *          thread becomes effective on the budget replenishment. The
+ *          priority inheritance is not affected, a demoted thread owning
+ *          a mutex still inherits the priority of the waiting threads.
+ * @pre     In order to use the CPU budget servers APIs the
+ *          @p CH_USE_BUDGETS option must be enabled in @p chconf.h.
+ * @{
+ */
+
+#include "ch.h"
+
+#if CH_USE_BUDGETS || defined(__DOXYGEN__)
+
+/*
+ * Changes the priority of a thread, the thread is re-enqueued if it is
+ * waiting in a priority ordered queue.
+ */
+static void set_prio(Thread *tp, tprio_t prio) {
+  tprio_t newprio = prio;
+
+#if CH_USE_MUTEXES
+  /* An inherited priority is retained until the mutexes are released.*/
+  if ((tp->p_prio != tp->p_realprio) && (prio < tp->p_prio))
+    newprio = tp->p_prio;
+  tp->p_realprio = prio;
+#endif
+  if (newprio == tp->p_prio)
+    return;
+  tp->p_prio = newprio;
+  switch (tp->p_state) {
+#if CH_USE_MUTEXES
+  case THD_STATE_WTMTX:
+#endif
+#if CH_USE_CONDVARS
+  case THD_STATE_WTCOND:
+#endif
+#if CH_USE_SEMAPHORES && CH_USE_SEMAPHORES_PRIORITY
+  case THD_STATE_WTSEM:
+#endif
+#if CH_USE_MESSAGES && CH_USE_MESSAGES_PRIORITY
+  case THD_STATE_SNDMSGQ:
+#endif
+#if CH_USE_MUTEXES | CH_USE_CONDVARS |                                      \
+    (CH_USE_SEMAPHORES && CH_USE_SEMAPHORES_PRIORITY) |                     \
+    (CH_USE_MESSAGES && CH_USE_MESSAGES_PRIORITY)
+    /* Re-enqueues tp with its new priority on the queue.*/
+    prio_insert(dequeue(tp), (ThreadsQueue *)tp->p_u.wtobjp);
+    break;
+#endif
+  case THD_STATE_READY:
+#if CH_DBG_ENABLE_ASSERTS
+    /* Prevents an assertion in chSchReadyI().*/
+    tp->p_state = THD_STATE_CURRENT;
+#endif
+    /* Re-enqueues tp with its new priority on the ready list.*/
+    chSchReadyI(dequeue(tp));
+    break;
+  }
+}
+
+/*
+ * Lowers a thread to the server low priority, its own priority is saved.
+ */
+static void demote(BudgetServer *bsp, Thread *tp) {
+
+#if CH_USE_MUTEXES
+  tp->p_bsprio = tp->p_realprio;
+#else
+  tp->p_bsprio = tp->p_prio;
+#endif
+  if (tp->p_bsprio > bsp->bs_lowprio)
+    set_prio(tp, bsp->bs_lowprio);
+}
+
+/*
+ * Demotes the whole group.
+ */
+static void deplete(BudgetServer *bsp) {
+  Thread *tp;
+
+  bsp->bs_depleted = TRUE;
+  bsp->bs_depletions++;
+  for (tp = bsp->bs_threads; tp != NULL; tp = tp->p_bsnext)
+    demote(bsp, tp);
+}
+
+/*
+ * Restores the whole group to its own priorities.
+ */
+static void restore(BudgetServer *bsp) {
+  Thread *tp;
+
+  bsp->bs_depleted = FALSE;
+  for (tp = bsp->bs_threads; tp != NULL; tp = tp->p_bsnext)
+    set_prio(tp, tp->p_bsprio);
+}
+
+/*
+ * Replenishment timer callback.
+ */
+static void replenish(void *p) {
+  BudgetServer *bsp = (BudgetServer *)p;
+
+  chSysLockFromIsr();
+  chVTSetI(&bsp->bs_vt, bsp->bs_period, replenish, bsp);
+  bsp->bs_remaining = bsp->bs_budget;
+  if (bsp->bs_depleted)
+    restore(bsp);
+  chSysUnlockFromIsr();
+}
+
+/**
+ * @brief   Initializes a @p BudgetServer object.
+ * @note    The server is created stopped, the group is not limited until
+ *          the server is started.
+ *
+ * @param[out] bsp      pointer to the @p BudgetServer object
+ * @param[in] budget    budget in ticks for each period
+ * @param[in] period    replenishment period in ticks, it must be greater
+ *                      than or equal to the budget
+ * @param[in] lowprio   priority of the group threads while the budget is
+ *                      exhausted, threads with a lower own priority are
+ *                      not affected
+ *
+ * @init
+ */
+void chBudgetObjectInit(BudgetServer *bsp, systime_t budget,
+                        systime_t period, tprio_t lowprio) {
+
+  chDbgCheck((bsp != NULL) && (budget > 0) && (period >= budget) &&
+             (lowprio <= HIGHPRIO), "chBudgetObjectInit");
+
+  bsp->bs_threads = NULL;
+  bsp->bs_budget = budget;
+  bsp->bs_period = period;
+  bsp->bs_remaining = budget;
+  bsp->bs_lowprio = lowprio;
+  bsp->bs_depleted = FALSE;
+  bsp->bs_vt.vt_func = NULL;
+  bsp->bs_consumed = 0;
+  bsp->bs_depletions = 0;
+}
+
+/**
+ * @brief   Starts a budget server.
+ * @details The first period starts with a full budget.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ *
+ * @iclass
+ */
+void chBudgetStartI(BudgetServer *bsp) {
+
+  chDbgCheckClassI();
+  chDbgCheck(bsp != NULL, "chBudgetStartI");
+
+  if (chVTIsArmedI(&bsp->bs_vt))
+    chVTResetI(&bsp->bs_vt);
+  chVTSetI(&bsp->bs_vt, bsp->bs_period, replenish, bsp);
+  bsp->bs_remaining = bsp->bs_budget;
+  if (bsp->bs_depleted)
+    restore(bsp);
+}
+
+/**
+ * @brief   Starts a budget server.
+ * @details The first period starts with a full budget.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ *
+ * @api
+ */
+void chBudgetStart(BudgetServer *bsp) {
+
+  chSysLock();
+  chBudgetStartI(bsp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Stops a budget server.
+ * @details The group threads are restored to their own priorities and
+ *          are no more limited.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ *
+ * @iclass
+ */
+void chBudgetStopI(BudgetServer *bsp) {
+
+  chDbgCheckClassI();
+  chDbgCheck(bsp != NULL, "chBudgetStopI");
+
+  if (chVTIsArmedI(&bsp->bs_vt))
+    chVTResetI(&bsp->bs_vt);
+  bsp->bs_remaining = bsp->bs_budget;
+  if (bsp->bs_depleted)
+    restore(bsp);
+}
+
+/**
+ * @brief   Stops a budget server.
+ * @details The group threads are restored to their own priorities and
+ *          are no more limited.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ *
+ * @api
+ */
+void chBudgetStop(BudgetServer *bsp) {
+
+  chSysLock();
+  chBudgetStopI(bsp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Adds a thread to the group of a budget server.
+ * @details If the budget is exhausted the thread is immediately demoted.
+ * @pre     The thread must not belong to a budget server.
+ * @note    This function does not reschedule.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ * @param[in] tp        pointer to the thread
+ *
+ * @iclass
+ */
+void chBudgetAddI(BudgetServer *bsp, Thread *tp) {
+
+  chDbgCheckClassI();
+  chDbgCheck((bsp != NULL) && (tp != NULL), "chBudgetAddI");
+  chDbgAssert(tp->p_server == NULL,
+              "chBudgetAddI(), #1",
+              "already in a group");
+
+  tp->p_server = bsp;
+  tp->p_bsnext = bsp->bs_threads;
+  bsp->bs_threads = tp;
+  if (bsp->bs_depleted)
+    demote(bsp, tp);
+}
+
+/**
+ * @brief   Adds a thread to the group of a budget server.
+ * @details If the budget is exhausted the thread is immediately demoted.
+ * @pre     The thread must not belong to a budget server.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ * @param[in] tp        pointer to the thread
+ *
+ * @api
+ */
+void chBudgetAdd(BudgetServer *bsp, Thread *tp) {
+
+  chSysLock();
+  chBudgetAddI(bsp, tp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Removes a thread from the group of its budget server.
+ * @details A demoted thread is restored to its own priority, the function
+ *          does nothing if the thread does not belong to a server.
+ * @note    This function does not reschedule.
+ *
+ * @param[in] tp        pointer to the thread
+ *
+ * @iclass
+ */
+void chBudgetRemoveI(Thread *tp) {
+  BudgetServer *bsp;
+  Thread **tpp;
+
+  chDbgCheckClassI();
+  chDbgCheck(tp != NULL, "chBudgetRemoveI");
+
+  if ((bsp = tp->p_server) == NULL)
+    return;
+  tpp = &bsp->bs_threads;
+  while (*tpp != tp)
+    tpp = &(*tpp)->p_bsnext;
+  *tpp = tp->p_bsnext;
+  tp->p_server = NULL;
+  if (bsp->bs_depleted)
+    set_prio(tp, tp->p_bsprio);
+}
+
+/**
+ * @brief   Removes a thread from the group of its budget server.
+ * @details A demoted thread is restored to its own priority, the function
+ *          does nothing if the thread does not belong to a server.
+ *
+ * @param[in] tp        pointer to the thread
+ *
+ * @api
+ */
+void chBudgetRemove(Thread *tp) {
+
+  chSysLock();
+  chBudgetRemoveI(tp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Charges a system tick to a budget server.
+ * @note    Not a user function, it is invoked by @p chSysTimerHandlerI()
+ *          when the running thread belongs to a server.
+ *
+ * @param[in] bsp       pointer to the @p BudgetServer object
+ *
+ * @notapi
+ */
+void _budget_tickI(BudgetServer *bsp) {
+
+  bsp->bs_consumed++;
+  if ((bsp->bs_remaining > 0) && chVTIsArmedI(&bsp->bs_vt)) {
+    if (--bsp->bs_remaining == 0)
+      deplete(bsp);
+  }
+}
+
+#endif /* CH_USE_BUDGETS */
+
+/** @} */
@@ -31,6 +31,127 @@
 
 #if CH_USE_DYNAMIC || defined(__DOXYGEN__)
 
+#if (CH_THD_CACHE_SIZE > 0) || defined(__DOXYGEN__)
+/**
+ * @brief   Working areas of terminated threads available for reuse.
+ * @details The cached threads are linked through their @p p_next field.
+ */
+static Thread *cache_list;
+
+/**
+ * @brief   Number of cached working areas.
+ */
+static cnt_t cache_cnt;
+
+/**
+ * @brief   Puts the working area of a terminated thread into the cache.
+ *
+ * @param[in] tp        pointer to the thread
+ * @return              The operation status.
+ * @retval FALSE        if the cache is full.
+ * @retval TRUE         if the working area has been cached.
+ *
+ * @notapi
+ */
+static bool_t cache_put(Thread *tp) {
+
+  chSysLock();
+  if (cache_cnt >= CH_THD_CACHE_SIZE) {
+    chSysUnlock();
+    return FALSE;
+  }
+  tp->p_next = cache_list;
+  cache_list = tp;
+  cache_cnt++;
+  chSysUnlock();
+  return TRUE;
+}
+
+/**
+ * @brief   Gets a cached working area.
+ *
+ * @param[in] mode      allocation mode of the working area
+ * @param[in] owner     heap or memory pool owning the working area
+ * @param[in] size      size of the working area
+ * @return              The pointer to the working area.
+ * @retval NULL         if there is no matching working area in the cache.
+ *
+ * @notapi
+ */
+static void *cache_get(tmode_t mode, void *owner, size_t size) {
+  Thread *tp, **tpp;
+
+  chSysLock();
+  tpp = &cache_list;
+  while ((tp = *tpp) != NULL) {
+    if (((tp->p_flags & THD_MEM_MODE_MASK) == mode) &&
+        (tp->p_wsowner == owner) && (tp->p_wasize == size)) {
+      *tpp = tp->p_next;
+      cache_cnt--;
+      break;
+    }
+    tpp = &tp->p_next;
+  }
+  chSysUnlock();
+  return tp;
+}
+#endif /* CH_THD_CACHE_SIZE > 0 */
+
+/**
+ * @brief   Starts a dynamic thread into an allocated working area.
+ *
+ * @param[in] wsp       pointer to the working area
+ * @param[in] size      size of the working area
+ * @param[in] mode      allocation mode of the working area
+ * @param[in] owner     heap or memory pool owning the working area
+ * @param[in] cached    the working area comes from the cache
+ * @param[in] prio      the priority level for the new thread
+ * @param[in] pf        the thread function
+ * @param[in] arg       an argument passed to the thread function
+ * @return              The pointer to the @p Thread structure.
+ *
+ * @notapi
+ */
+static Thread *thread_start(void *wsp, size_t size, tmode_t mode,
+                            void *owner, bool_t cached,
+                            tprio_t prio, tfunc_t pf, void *arg) {
+  Thread *tp;
+
+#if CH_DBG_FILL_THREADS
+  {
+    uint8_t *p = (uint8_t *)wsp + sizeof(Thread);
+
+    /* The stack of a recycled working area is still filled below the
+       high-water mark of the previous thread, only the used part needs
+       to be filled again.*/
+    if (cached)
+      p += chThdGetStackUnused((Thread *)wsp);
+    _thread_memfill((uint8_t *)wsp, (uint8_t *)wsp + sizeof(Thread),
+                    CH_THREAD_FILL_VALUE);
+    _thread_memfill(p, (uint8_t *)wsp + size, CH_STACK_FILL_VALUE);
+  }
+#else
+  (void)cached;
+#endif
+
+  chSysLock();
+  tp = chThdCreateI(wsp, size, prio, pf, arg);
+  tp->p_flags = mode;
+#if CH_USE_MEMPOOLS
+  if (mode == THD_MEM_MODE_MEMPOOL)
+    tp->p_mpool = owner;
+#endif
+#if CH_THD_CACHE_SIZE > 0
+  tp->p_wasize = size;
+  tp->p_wsowner = owner;
+#else
+  (void)owner;
+#endif
+  chSchWakeupS(tp, RDY_OK);
+  chSysUnlock();
+  return tp;
+}
+
 /**
  * @brief   Adds a reference to a thread object.
  * @pre     The configuration option @p CH_USE_DYNAMIC must be enabled in order
@@ -59,6 +180,10 @@ Thread *chThdAddRef(Thread *tp) {
  * @pre     The configuration option @p CH_USE_DYNAMIC must be enabled in order
  *          to use this function.
  * @note    Static threads are not affected.
+ * @note    If @p CH_THD_CACHE_SIZE is greater than zero the memory is kept
+ *          for reuse by the next dynamic thread created with the same
+ *          allocator and working area size, the cache is emptied using
+ *          @p chThdCacheFlush().
  *
  * @param[in] tp        pointer to the thread
  *
@@ -81,6 +206,10 @@ void chThdRelease(Thread *tp) {
     case THD_MEM_MODE_HEAP:
 #if CH_USE_REGISTRY
       REG_REMOVE(tp);
+#endif
+#if CH_THD_CACHE_SIZE > 0
+      if (cache_put(tp))
+        break;
 #endif
       chHeapFree(tp);
       break;
@@ -89,6 +218,10 @@ void chThdRelease(Thread *tp) {
     case THD_MEM_MODE_MEMPOOL:
 #if CH_USE_REGISTRY
       REG_REMOVE(tp);
+#endif
+#if CH_THD_CACHE_SIZE > 0
+      if (cache_put(tp))
+        break;
 #endif
       chPoolFree(tp->p_mpool, tp);
       break;
@@ -123,27 +256,26 @@ void chThdRelease(Thread *tp) {
 Thread *chThdCreateFromHeap(MemoryHeap *heapp, size_t size,
                             tprio_t prio, tfunc_t pf, void *arg) {
   void *wsp;
-  Thread *tp;
+
+#if CH_THD_CACHE_SIZE > 0
+  wsp = cache_get(THD_MEM_MODE_HEAP, heapp, size);
+  if (wsp != NULL)
+    return thread_start(wsp, size, THD_MEM_MODE_HEAP, heapp, TRUE,
+                        prio, pf, arg);
+#endif
 
   wsp = chHeapAlloc(heapp, size);
+#if CH_THD_CACHE_SIZE > 0
+  if (wsp == NULL) {
+    /* The cached working areas could be fragmenting the heap.*/
+    chThdCacheFlush();
+    wsp = chHeapAlloc(heapp, size);
+  }
+#endif
   if (wsp == NULL)
     return NULL;
-  
-#if CH_DBG_FILL_THREADS
-  _thread_memfill((uint8_t *)wsp,
-                  (uint8_t *)wsp + sizeof(Thread),
-                  CH_THREAD_FILL_VALUE);
-  _thread_memfill((uint8_t *)wsp + sizeof(Thread),
-                  (uint8_t *)wsp + size,
-                  CH_STACK_FILL_VALUE);
-#endif
-  
-  chSysLock();
-  tp = chThdCreateI(wsp, size, prio, pf, arg);
-  tp->p_flags = THD_MEM_MODE_HEAP;
-  chSchWakeupS(tp, RDY_OK);
-  chSysUnlock();
-  return tp;
+  return thread_start(wsp, size, THD_MEM_MODE_HEAP, heapp, FALSE,
+                      prio, pf, arg);
 }
 #endif /* CH_USE_HEAP */
 
@@ -172,32 +304,63 @@ Thread *chThdCreateFromHeap(MemoryHeap *heapp, size_t size,
 Thread *chThdCreateFromMemoryPool(MemoryPool *mp, tprio_t prio,
                                   tfunc_t pf, void *arg) {
   void *wsp;
-  Thread *tp;
+  bool_t cached = FALSE;
 
   chDbgCheck(mp != NULL, "chThdCreateFromMemoryPool");
 
+#if CH_THD_CACHE_SIZE > 0
+  wsp = cache_get(THD_MEM_MODE_MEMPOOL, mp, mp->mp_object_size);
+  if (wsp != NULL)
+    cached = TRUE;
+  else
+#endif
   wsp = chPoolAlloc(mp);
   if (wsp == NULL)
     return NULL;
-  
-#if CH_DBG_FILL_THREADS
-  _thread_memfill((uint8_t *)wsp,
-                  (uint8_t *)wsp + sizeof(Thread),
-                  CH_THREAD_FILL_VALUE);
-  _thread_memfill((uint8_t *)wsp + sizeof(Thread),
-                  (uint8_t *)wsp + mp->mp_object_size,
-                  CH_STACK_FILL_VALUE);
-#endif
+  return thread_start(wsp, mp->mp_object_size, THD_MEM_MODE_MEMPOOL, mp,
+                      cached, prio, pf, arg);
+}
+#endif /* CH_USE_MEMPOOLS */
+
+#if (CH_THD_CACHE_SIZE > 0) || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the cached working areas to their allocators.
+ * @pre     The configuration option @p CH_THD_CACHE_SIZE must be greater
+ *          than zero in order to use this function.
+ * @note    The heap and memory pool status functions do not account for
+ *          the cached working areas, this function should be invoked before
+ *          checking them.
+ *
+ * @api
+ */
+void chThdCacheFlush(void) {
+  Thread *tp;
 
   chSysLock();
-  tp = chThdCreateI(wsp, mp->mp_object_size, prio, pf, arg);
-  tp->p_flags = THD_MEM_MODE_MEMPOOL;
-  tp->p_mpool = mp;
-  chSchWakeupS(tp, RDY_OK);
+  tp = cache_list;
+  cache_list = NULL;
+  cache_cnt = 0;
   chSysUnlock();
-  return tp;
+
+  while (tp != NULL) {
+    Thread *next = tp->p_next;
+
+    switch (tp->p_flags & THD_MEM_MODE_MASK) {
+#if CH_USE_HEAP
+    case THD_MEM_MODE_HEAP:
+      chHeapFree(tp);
+      break;
+#endif
+#if CH_USE_MEMPOOLS
+    case THD_MEM_MODE_MEMPOOL:
+      chPoolFree(tp->p_wsowner, tp);
+      break;
+#endif
+    }
+    tp = next;
+  }
 }
-#endif /* CH_USE_MEMPOOLS */
+#endif /* CH_THD_CACHE_SIZE > 0 */
 
 #endif /* CH_USE_DYNAMIC */
 
@@ -38,6 +38,8 @@
  * @{
  */
 
+#include <string.h>
+
 #include "ch.h"
 
 #if CH_USE_HEAP || defined(__DOXYGEN__)
@@ -55,6 +57,34 @@
 #define H_UNLOCK(h)     chSemSignal(&(h)->h_sem)
 #endif
 
+/*
+ * Memory accounting of an allocated or released block, the heap lock does
+ * not protect the accounting tables.
+ */
+#if CH_USE_MEMACCT
+#define H_ACCT_ALLOC(heapp, hp, site) {                                     \
+  chSysLock();                                                              \
+  _memacct_allocI(&(heapp)->h_acct, (hp)->h.size);                          \
+  _memacct_tagI(&(hp)->h.tag, site, (hp)->h.size);                          \
+  chSysUnlock();                                                            \
+}
+#define H_ACCT_FAIL(heapp) {                                                \
+  chSysLock();                                                              \
+  _memacct_allocI(&(heapp)->h_acct, 0);                                     \
+  chSysUnlock();                                                            \
+}
+#define H_ACCT_FREE(heapp, hp) {                                            \
+  chSysLock();                                                              \
+  _memacct_freeI(&(heapp)->h_acct, (hp)->h.size);                           \
+  _memacct_untagI(&(hp)->h.tag, (hp)->h.size);                              \
+  chSysUnlock();                                                            \
+}
+#else
+#define H_ACCT_ALLOC(heapp, hp, site)
+#define H_ACCT_FAIL(heapp)
+#define H_ACCT_FREE(heapp, hp)
+#endif
+
 /**
  * @brief   Default heap descriptor.
  */
@@ -69,6 +99,9 @@ void _heap_init(void) {
   default_heap.h_provider = chCoreAlloc;
   default_heap.h_free.h.u.next = (union heap_header *)NULL;
   default_heap.h_free.h.size = 0;
+#if CH_USE_MEMACCT
+  memset(&default_heap.h_acct, 0, sizeof (MemAccount));
+#endif
 #if CH_USE_MUTEXES || defined(__DOXYGEN__)
   chMtxInit(&default_heap.h_mtx);
 #else
@@ -99,6 +132,9 @@ void chHeapInit(MemoryHeap *heapp, void *buf, size_t size) {
   heapp->h_free.h.size = 0;
   hp->h.u.next = NULL;
   hp->h.size = size - sizeof(union heap_header);
+#if CH_USE_MEMACCT
+  memset(&heapp->h_acct, 0, sizeof (MemAccount));
+#endif
 #if CH_USE_MUTEXES || defined(__DOXYGEN__)
   chMtxInit(&heapp->h_mtx);
 #else
@@ -124,6 +160,9 @@ void chHeapInit(MemoryHeap *heapp, void *buf, size_t size) {
  */
 void *chHeapAlloc(MemoryHeap *heapp, size_t size) {
   union heap_header *qp, *hp, *fp;
+#if CH_USE_MEMACCT
+  const void *site = MEMACCT_SITE();
+#endif
 
   if (heapp == NULL)
     heapp = &default_heap;
@@ -150,6 +189,7 @@ void *chHeapAlloc(MemoryHeap *heapp, size_t size) {
         hp->h.size = size;
       }
       hp->h.u.heap = heapp;
+      H_ACCT_ALLOC(heapp, hp, site);
 
       H_UNLOCK(heapp);
       return (void *)(hp + 1);
@@ -166,10 +206,12 @@ void *chHeapAlloc(MemoryHeap *heapp, size_t size) {
     if (hp != NULL) {
       hp->h.u.heap = heapp;
       hp->h.size = size;
+      H_ACCT_ALLOC(heapp, hp, site);
       hp++;
       return (void *)hp;
     }
   }
+  H_ACCT_FAIL(heapp);
   return NULL;
 }
 
@@ -194,6 +236,7 @@ void chHeapFree(void *p) {
   heapp = hp->h.u.heap;
   qp = &heapp->h_free;
   H_LOCK(heapp);
+  H_ACCT_FREE(heapp, hp);
 
   while (TRUE) {
     chDbgAssert((hp < qp) || (hp >= LIMIT(qp)),
@@ -259,6 +302,32 @@ size_t chHeapStatus(MemoryHeap *heapp, size_t *sizep) {
   return n;
 }
 
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the memory account of a heap.
+ * @note    This function is only available when the @p CH_USE_MEMACCT
+ *          option is enabled.
+ *
+ * @param[in] heapp     pointer to a heap descriptor or @p NULL in order to
+ *                      access the default heap.
+ * @param[out] ap       pointer to a @p MemAccount structure receiving a copy
+ *                      of the account
+ *
+ * @api
+ */
+void chHeapGetAccount(MemoryHeap *heapp, MemAccount *ap) {
+
+  chDbgCheck(ap != NULL, "chHeapGetAccount");
+
+  if (heapp == NULL)
+    heapp = &default_heap;
+
+  chSysLock();
+  *ap = heapp->h_acct;
+  chSysUnlock();
+}
+#endif /* CH_USE_MEMACCT */
+
 #else /* CH_USE_MALLOC_HEAP */
 
 #include <stdlib.h>
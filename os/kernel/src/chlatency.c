@@ -0,0 +1,397 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chlatency.c
+ * @brief   Latency histograms code.
+ *
+ * @addtogroup latency
+ * @details Latency histograms record the scheduling and timers latencies
+ *          of the running system.
+ *          <h2>Operation mode</h2>
+ *          Each time a thread enters the ready list it is timestamped, on
+ *          the context switch to the thread the time it spent in the ready
+ *          list is recorded in the system threads histogram, the idle
+ *          thread is excluded. The virtual timers callbacks lateness is
+ *          measured from the entry of @p chSysTimerHandlerI(), the kernel
+ *          is tick based so this is the time the callback should have been
+ *          invoked. The lateness includes the time spent in the previous
+ *          callbacks of the same tick and in the tick processing preceding
+ *          the timers, the port interrupt prologue before
+ *          @p chSysTimerHandlerI() is not included.<br>
+ *          Histograms use log2 bins, the bin @p n counts the samples in
+ *          the range <tt>[2^(n-1), 2^n)</tt> of latency clock units, the
+ *          clock is the port realtime counter if available.<br>
+ *          A thread can also have an own histogram with a latency budget
+ *          attached, the monitor checks periodically the attached
+ *          histograms and raises an alarm for each new budget overrun and
+ *          for each thread waiting in the ready list longer than its
+ *          budget.
+ * @pre     In order to use the latency histograms the @p CH_USE_LATENCY
+ *          option must be enabled in @p chconf.h.
+ * @{
+ */
+
+#include "ch.h"
+
+#if CH_USE_LATENCY || defined(__DOXYGEN__)
+
+/**
+ * @brief   System threads ready-to-run latency histogram.
+ */
+LatencyHistogram _latency_threads;
+
+/**
+ * @brief   System virtual timers lateness histogram.
+ */
+LatencyHistogram _latency_timers;
+
+/**
+ * @brief   List of the histograms attached to threads.
+ */
+static LatencyHistogram *monitored;
+
+/**
+ * @brief   Latency clock at the entry of the current system tick.
+ */
+static uint32_t tickts;
+
+/*
+ * Records a sample into a histogram.
+ */
+static void record(LatencyHistogram *lhp, uint32_t latency) {
+  uint32_t v = latency;
+  unsigned n = 0;
+
+  while ((v != 0) && (n < CH_LATENCY_BINS - 1)) {
+    v >>= 1;
+    n++;
+  }
+  lhp->lh_bins[n]++;
+  lhp->lh_samples++;
+  if (latency > lhp->lh_max)
+    lhp->lh_max = latency;
+  if ((lhp->lh_budget > 0) && (latency > lhp->lh_budget)) {
+    lhp->lh_overruns++;
+    lhp->lh_last = latency;
+  }
+}
+
+/*
+ * Clears the counters of a histogram.
+ */
+static void clear(LatencyHistogram *lhp) {
+  unsigned n;
+
+  lhp->lh_samples  = 0;
+  lhp->lh_max      = 0;
+  lhp->lh_overruns = 0;
+  lhp->lh_reported = 0;
+  lhp->lh_last     = 0;
+  lhp->lh_stalls   = 0;
+  lhp->lh_stallts  = 0;
+  for (n = 0; n < CH_LATENCY_BINS; n++)
+    lhp->lh_bins[n] = 0;
+}
+
+/**
+ * @brief   Timestamps a thread entering the ready list.
+ * @note    Not an API, this function is invoked by the scheduler.
+ *
+ * @param[in] tp        the thread made ready
+ *
+ * @notapi
+ */
+void _latency_readyI(Thread *tp) {
+
+  tp->p_readyts = CH_LATENCY_CLOCK();
+}
+
+/**
+ * @brief   Records the ready-to-run latency of a thread.
+ * @note    Not an API, this function is invoked on context switch.
+ *
+ * @param[in] ntp       the thread being switched in
+ *
+ * @notapi
+ */
+void _latency_switchI(Thread *ntp) {
+  uint32_t latency;
+
+  if (ntp->p_prio == IDLEPRIO)
+    return;
+  latency = CH_LATENCY_CLOCK() - ntp->p_readyts;
+  record(&_latency_threads, latency);
+  if (ntp->p_latency != NULL)
+    record(ntp->p_latency, latency);
+}
+
+/**
+ * @brief   Timestamps the entry of the system tick.
+ * @note    Not an API, this function is invoked by
+ *          @p chSysTimerHandlerI().
+ *
+ * @notapi
+ */
+void _latency_tickI(void) {
+
+  tickts = CH_LATENCY_CLOCK();
+}
+
+/**
+ * @brief   Records the lateness of a virtual timer callback.
+ * @details The lateness is measured from the entry of the current system
+ *          tick.
+ * @note    Not an API, this function is invoked by @p chVTDoTickI().
+ *
+ * @notapi
+ */
+void _latency_timerI(void) {
+
+  record(&_latency_timers, CH_LATENCY_CLOCK() - tickts);
+}
+
+/**
+ * @brief   Detaches the histogram of a terminating thread.
+ * @details The histogram stays in the monitored list, its samples are
+ *          retained until @p chLatencyDetach() is invoked.
+ * @note    Not an API, this function is invoked by @p chThdExitS().
+ *
+ * @param[in] tp        the terminating thread
+ *
+ * @notapi
+ */
+void _latency_exitI(Thread *tp) {
+
+  if (tp->p_latency != NULL) {
+    tp->p_latency->lh_thread = NULL;
+    tp->p_latency = NULL;
+  }
+}
+
+/**
+ * @brief   Initializes a @p LatencyHistogram object.
+ *
+ * @param[out] lhp      pointer to a @p LatencyHistogram structure
+ *
+ * @init
+ */
+void chLatencyObjectInit(LatencyHistogram *lhp) {
+
+  chDbgCheck(lhp != NULL, "chLatencyObjectInit");
+
+  lhp->lh_next   = NULL;
+  lhp->lh_thread = NULL;
+  lhp->lh_budget = 0;
+  clear(lhp);
+}
+
+/**
+ * @brief   Attaches a histogram to a thread.
+ * @details The histogram is cleared and added to the monitored list, from
+ *          now on the ready-to-run latencies of the thread are recorded
+ *          also into it.
+ * @pre     The histogram must not be already attached and the thread must
+ *          not already have an histogram.
+ *
+ * @param[out] lhp      pointer to a @p LatencyHistogram structure
+ * @param[in] tp        the thread to be monitored
+ * @param[in] budget    the latency budget in clock units, zero if the
+ *                      thread has no budget
+ *
+ * @api
+ */
+void chLatencyAttach(LatencyHistogram *lhp, Thread *tp, uint32_t budget) {
+
+  chDbgCheck((lhp != NULL) && (tp != NULL), "chLatencyAttach");
+
+  chLatencyObjectInit(lhp);
+  lhp->lh_thread = tp;
+  lhp->lh_budget = budget;
+  chSysLock();
+  chDbgAssert(tp->p_latency == NULL,
+              "chLatencyAttach(), #1",
+              "already monitored");
+  tp->p_latency = lhp;
+  lhp->lh_next = monitored;
+  monitored = lhp;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Detaches a histogram from its thread and from the monitored list.
+ *
+ * @param[in] lhp       pointer to an attached @p LatencyHistogram structure
+ *
+ * @api
+ */
+void chLatencyDetach(LatencyHistogram *lhp) {
+  LatencyHistogram **lhpp;
+
+  chDbgCheck(lhp != NULL, "chLatencyDetach");
+
+  chSysLock();
+  lhpp = &monitored;
+  while (*lhpp != lhp) {
+    chDbgAssert(*lhpp != NULL,
+                "chLatencyDetach(), #1",
+                "not attached");
+    lhpp = &(*lhpp)->lh_next;
+  }
+  *lhpp = lhp->lh_next;
+  if (lhp->lh_thread != NULL) {
+    lhp->lh_thread->p_latency = NULL;
+    lhp->lh_thread = NULL;
+  }
+  chSysUnlock();
+}
+
+/**
+ * @brief   Takes a consistent copy of the system histograms.
+ *
+ * @param[out] threads  copy of the threads latency histogram or @p NULL
+ * @param[out] timers   copy of the timers lateness histogram or @p NULL
+ *
+ * @api
+ */
+void chLatencySnapshot(LatencyHistogram *threads, LatencyHistogram *timers) {
+
+  chSysLock();
+  if (threads != NULL)
+    *threads = _latency_threads;
+  if (timers != NULL)
+    *timers = _latency_timers;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Clears the system histograms and the attached histograms.
+ *
+ * @api
+ */
+void chLatencyReset(void) {
+  LatencyHistogram *lhp;
+
+  chSysLock();
+  clear(&_latency_threads);
+  clear(&_latency_timers);
+  for (lhp = monitored; lhp != NULL; lhp = lhp->lh_next)
+    clear(lhp);
+  chSysUnlock();
+}
+
+/**
+ * @brief   Checks the attached histograms against their budgets.
+ * @details An alarm is raised for each histogram having new budget overruns
+ *          since the previous check and for each thread that is waiting in
+ *          the ready list since longer than its budget, a stall is reported
+ *          once.
+ * @note    Histograms must not be detached while a check is in progress.
+ *
+ * @param[in] alarm     the alarm callback or @p NULL
+ * @return              The number of raised alarms.
+ *
+ * @api
+ */
+unsigned chLatencyCheck(latalarm_t alarm) {
+  LatencyHistogram *lhp;
+  unsigned alarms = 0;
+
+  chSysLock();
+  for (lhp = monitored; lhp != NULL; lhp = lhp->lh_next) {
+    Thread *tp = lhp->lh_thread;
+    uint32_t overrun = 0, stall = 0;
+
+    if (lhp->lh_overruns != lhp->lh_reported) {
+      lhp->lh_reported = lhp->lh_overruns;
+      overrun = lhp->lh_last;
+    }
+    if ((lhp->lh_budget > 0) && (tp != NULL) &&
+        (tp->p_state == THD_STATE_READY) &&
+        (tp->p_readyts != lhp->lh_stallts)) {
+      uint32_t waiting = CH_LATENCY_CLOCK() - tp->p_readyts;
+
+      if (waiting > lhp->lh_budget) {
+        lhp->lh_stalls++;
+        lhp->lh_stallts = tp->p_readyts;
+        stall = waiting;
+      }
+    }
+    if ((overrun > 0) || (stall > 0)) {
+      chSysUnlock();
+      if (overrun > 0) {
+        alarms++;
+        if (alarm != NULL)
+          alarm(lhp, overrun);
+      }
+      if (stall > 0) {
+        alarms++;
+        if (alarm != NULL)
+          alarm(lhp, stall);
+      }
+      chSysLock();
+    }
+  }
+  chSysUnlock();
+  return alarms;
+}
+
+/*
+ * Latency monitor thread.
+ */
+static msg_t monitor_thread(void *p) {
+  const LatencyMonitorConfig *lmcp = (const LatencyMonitorConfig *)p;
+
+  chRegSetThreadName("latmon");
+  while (!chThdShouldTerminate()) {
+    chThdSleep(lmcp->lmc_interval);
+    chLatencyCheck(lmcp->lmc_alarm);
+  }
+  return 0;
+}
+
+/**
+ * @brief   Starts the latency monitor thread.
+ * @details The thread invokes @p chLatencyCheck() every configured
+ *          interval until it is asked to terminate using
+ *          @p chThdTerminate().
+ *
+ * @param[out] wsp      pointer to a working area dedicated to the thread
+ * @param[in] size      size of the working area
+ * @param[in] prio      the priority level for the monitor thread, it should
+ *                      be above the priority of the monitored threads
+ * @param[in] lmcp      pointer to the monitor configuration, it must stay
+ *                      valid while the monitor is running
+ * @return              The pointer to the monitor thread.
+ *
+ * @api
+ */
+Thread *chLatencyMonitorStart(void *wsp, size_t size, tprio_t prio,
+                              const LatencyMonitorConfig *lmcp) {
+
+  chDbgCheck((lmcp != NULL) && (lmcp->lmc_interval != TIME_IMMEDIATE),
+             "chLatencyMonitorStart");
+
+  return chThdCreateStatic(wsp, size, prio, monitor_thread, (void *)lmcp);
+}
+
+#endif /* CH_USE_LATENCY */
+
+/** @} */
@@ -0,0 +1,271 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chmemacct.c
+ * @brief   Memory accounting code.
+ *
+ * @addtogroup memacct
+ * @details Memory accounting services.
+ *          <h2>Operation mode</h2>
+ *          When the accounting is enabled each allocator keeps an account
+ *          of its live memory, of the live memory peak and of the number of
+ *          allocations, releases and failures:
+ *          - The core allocator has a single global account.
+ *          - Each heap and each memory pool has its own account.
+ *          .
+ *          The heap blocks are also tagged with the allocating thread and
+ *          the call site, a block released by another thread is still
+ *          credited to its owner. When a thread terminates its entry in the
+ *          owners table is retained until all its blocks are released, the
+ *          memory still accounted to a terminated thread is leaked memory.
+ *          The call sites table also accounts the core memory, memory pool
+ *          objects carry no header so they are only accounted per pool.<br>
+ *          All the allocations are also counted into size classes.<br>
+ *          The accounting overhead is a short critical section for each
+ *          operation and two bytes in each heap block header, rounded to
+ *          the alignment.
+ * @pre     In order to use the memory accounting the @p CH_USE_MEMACCT
+ *          option must be enabled in @p chconf.h.
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+
+static MemAccount core_acct;
+static MemOwner owners[CH_MEMACCT_OWNERS];
+static MemSite sites[CH_MEMACCT_SITES];
+static uint32_t class_allocs[CH_MEMACCT_CLASSES];
+static uint32_t class_live[CH_MEMACCT_CLASSES];
+
+/*
+ * Size class of a block.
+ */
+static unsigned size_class(size_t size) {
+  unsigned c = 0;
+
+  if (size <= 8)
+    return 0;
+  size = (size - 1) >> 3;
+  while ((size != 0) && (c < CH_MEMACCT_CLASSES - 1)) {
+    size >>= 1;
+    c++;
+  }
+  return c;
+}
+
+static void acct_add(MemAccount *ap, size_t size) {
+
+  ap->ma_live += size;
+  if (ap->ma_live > ap->ma_peak)
+    ap->ma_peak = ap->ma_live;
+  ap->ma_allocs++;
+}
+
+static void acct_sub(MemAccount *ap, size_t size) {
+
+  ap->ma_live -= size;
+  ap->ma_frees++;
+}
+
+/*
+ * Owners table entry of a thread, an entry is assigned on the first
+ * allocation. Entries of terminated threads are reused once all their
+ * memory has been released.
+ */
+static unsigned owner_of(Thread *tp) {
+  unsigned i;
+
+  if (tp->p_memowner != 0)
+    return tp->p_memowner;
+  for (i = 1; i < CH_MEMACCT_OWNERS; i++) {
+    if ((owners[i].mo_thread == NULL) && (owners[i].mo_acct.ma_live == 0)) {
+      memset(&owners[i], 0, sizeof (MemOwner));
+      owners[i].mo_thread = tp;
+      tp->p_memowner = (uint8_t)i;
+      return i;
+    }
+  }
+  return 0;
+}
+
+/*
+ * Call sites table entry of a site, open addressing on the entries after
+ * the first one.
+ */
+static unsigned site_of(const void *site) {
+  unsigned i, n;
+
+  i = (unsigned)(((size_t)site >> 1) % (CH_MEMACCT_SITES - 1));
+  for (n = 0; n < CH_MEMACCT_SITES - 1; n++) {
+    if (sites[i + 1].ms_site == site)
+      return i + 1;
+    if (sites[i + 1].ms_site == NULL) {
+      sites[i + 1].ms_site = site;
+      return i + 1;
+    }
+    if (++i >= CH_MEMACCT_SITES - 1)
+      i = 0;
+  }
+  return 0;
+}
+
+/**
+ * @brief   Accounts an allocation.
+ *
+ * @param[in] ap        pointer to the allocator account or @p NULL for the
+ *                      core allocator
+ * @param[in] size      size of the allocated block, zero for a failed
+ *                      allocation
+ *
+ * @notapi
+ */
+void _memacct_allocI(MemAccount *ap, size_t size) {
+  unsigned c;
+
+  if (ap == NULL)
+    ap = &core_acct;
+  if (size == 0) {
+    ap->ma_failures++;
+    return;
+  }
+  acct_add(ap, size);
+  c = size_class(size);
+  class_allocs[c]++;
+  class_live[c]++;
+}
+
+/**
+ * @brief   Accounts a release.
+ *
+ * @param[in] ap        pointer to the allocator account
+ * @param[in] size      size of the released block
+ *
+ * @notapi
+ */
+void _memacct_freeI(MemAccount *ap, size_t size) {
+
+  acct_sub(ap, size);
+  class_live[size_class(size)]--;
+}
+
+/**
+ * @brief   Tags a block with the current thread and the call site.
+ *
+ * @param[out] tp       pointer to the block tag
+ * @param[in] site      call site address
+ * @param[in] size      size of the block
+ *
+ * @notapi
+ */
+void _memacct_tagI(MemTag *tp, const void *site, size_t size) {
+
+  tp->mt_owner = (uint8_t)owner_of(currp);
+  tp->mt_site = (uint8_t)site_of(site);
+  acct_add(&owners[tp->mt_owner].mo_acct, size);
+  acct_add(&sites[tp->mt_site].ms_acct, size);
+}
+
+/**
+ * @brief   Credits a released block to its owner and call site.
+ *
+ * @param[in] tp        pointer to the block tag
+ * @param[in] size      size of the block
+ *
+ * @notapi
+ */
+void _memacct_untagI(const MemTag *tp, size_t size) {
+
+  acct_sub(&owners[tp->mt_owner].mo_acct, size);
+  acct_sub(&sites[tp->mt_site].ms_acct, size);
+}
+
+/**
+ * @brief   Accounts a core memory allocation.
+ *
+ * @param[in] size      size of the allocated block, zero for a failed
+ *                      allocation
+ * @param[in] site      call site address
+ *
+ * @notapi
+ */
+void _memacct_coreI(size_t size, const void *site) {
+
+  _memacct_allocI(&core_acct, size);
+  if (size != 0)
+    acct_add(&sites[site_of(site)].ms_acct, size);
+}
+
+/**
+ * @brief   Detaches a terminating thread from its owners table entry.
+ *
+ * @param[in] tp        pointer to the terminating thread
+ *
+ * @notapi
+ */
+void _memacct_exitI(Thread *tp) {
+  MemOwner *op;
+
+  if (tp->p_memowner == 0)
+    return;
+  op = &owners[tp->p_memowner];
+  op->mo_thread = NULL;
+#if CH_USE_REGISTRY
+  op->mo_name = tp->p_name;
+#endif
+  tp->p_memowner = 0;
+}
+
+/**
+ * @brief   Takes a snapshot of the memory accounting tables.
+ * @details The names of the live owners are taken from the registry.
+ *
+ * @param[out] sp       pointer to the @p MemAcctSnapshot structure
+ *
+ * @api
+ */
+void chMemAcctSnapshot(MemAcctSnapshot *sp) {
+  unsigned i;
+
+  chDbgCheck(sp != NULL, "chMemAcctSnapshot");
+
+  chSysLock();
+  sp->core = core_acct;
+  memcpy(sp->owners, owners, sizeof owners);
+  memcpy(sp->sites, sites, sizeof sites);
+  memcpy(sp->class_allocs, class_allocs, sizeof class_allocs);
+  memcpy(sp->class_live, class_live, sizeof class_live);
+#if CH_USE_REGISTRY
+  for (i = 1; i < CH_MEMACCT_OWNERS; i++)
+    if (owners[i].mo_thread != NULL)
+      sp->owners[i].mo_name = owners[i].mo_thread->p_name;
+#else
+  (void)i;
+#endif
+  chSysUnlock();
+}
+
+#endif /* CH_USE_MEMACCT */
+
+/** @} */
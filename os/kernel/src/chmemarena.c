@@ -0,0 +1,277 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    chmemarena.c
+ * @brief   Memory arenas code.
+ *
+ * @addtogroup arenas
+ * @details Memory arenas related APIs and services.
+ *          <h2>Operation mode</h2>
+ *          An arena is a bump allocator that obtains large chunks of
+ *          memory from a provider, the core allocator by default, and serves
+ *          the allocations from the current chunk without entering the
+ *          kernel lock. The lock is only taken in order to obtain a new
+ *          chunk.<br>
+ *          Memory is never freed individually, the position of an arena
+ *          can be saved using @p chArenaGetMark() and restored later using
+ *          @p chArenaRelease(), @p chArenaReset() restores the arena to its
+ *          initial position. The chunks are retained and reused by the
+ *          following allocations.<br>
+ *          An arena must only be used by a single thread, usually the
+ *          thread registered it as its own arena using @p chArenaSetSelf().
+ *          The functions @p chArenaAlloc() and @p chArenaAllocI() allocate
+ *          from the arena of the current thread. @p chArenaAllocI() is
+ *          compatible with the @p memgetfunc_t type so it can be used as
+ *          provider of a memory pool, for example
+ *          <tt>chPoolInit(mp, size, chArenaAllocI)</tt>, as long as the
+ *          pool is only used by the arena owner thread and the arena is
+ *          not released below the pool objects.
+ * @pre     In order to use the memory arenas APIs the @p CH_USE_MEMARENAS
+ *          option must be enabled in @p chconf.h.
+ * @{
+ */
+
+#include "ch.h"
+
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+
+/*
+ * Size of the chunks header.
+ */
+#define CHUNK_HEADER_SIZE MEM_ALIGN_NEXT(sizeof (struct arena_chunk))
+
+/*
+ * Moves the arena to a chunk able to contain the specified aligned size,
+ * a chunk retained by a previous release is reused if large enough else a
+ * new chunk is obtained from the provider.
+ */
+static bool_t refill(MemoryArena *map, size_t size) {
+  struct arena_chunk *cp, *ncp;
+  size_t n;
+
+  cp = map->ma_current != NULL ? map->ma_current->ac_next : map->ma_first;
+  if ((cp != NULL) &&
+      ((size_t)(cp->ac_end - ((uint8_t *)cp + CHUNK_HEADER_SIZE)) >= size))
+    ncp = cp;
+  else {
+    /* Oversized allocations get a chunk of their own.*/
+    n = CHUNK_HEADER_SIZE + (size > map->ma_chunk ? size : map->ma_chunk);
+    ncp = map->ma_provider(n);
+    if (ncp == NULL)
+      return FALSE;
+    ncp->ac_next = cp;
+    ncp->ac_end = (uint8_t *)ncp + n;
+    if (map->ma_current != NULL)
+      map->ma_current->ac_next = ncp;
+    else
+      map->ma_first = ncp;
+    map->ma_reserved += n;
+    map->ma_refills++;
+  }
+  map->ma_current = ncp;
+  map->ma_nextmem = (uint8_t *)ncp + CHUNK_HEADER_SIZE;
+  map->ma_endmem = ncp->ac_end;
+  return TRUE;
+}
+
+/**
+ * @brief   Initializes an empty memory arena.
+ * @note    No memory is obtained from the provider until the first
+ *          allocation.
+ *
+ * @param[out] map      pointer to a @p MemoryArena structure
+ * @param[in] chunk     size of the chunks obtained from the provider
+ * @param[in] provider  I-class memory provider function or @p NULL for the
+ *                      core allocator
+ *
+ * @init
+ */
+void chArenaInit(MemoryArena *map, size_t chunk, memgetfunc_t provider) {
+
+  chDbgCheck((map != NULL) && (chunk > 0), "chArenaInit");
+
+  map->ma_first = map->ma_current = NULL;
+  map->ma_nextmem = map->ma_endmem = NULL;
+  map->ma_chunk = MEM_ALIGN_NEXT(chunk);
+  map->ma_provider = provider != NULL ? provider : chCoreAllocI;
+  map->ma_reserved = 0;
+  map->ma_refills = 0;
+}
+
+/**
+ * @brief   Allocates a memory block from an arena.
+ * @details The size of the returned block is aligned to the alignment
+ *          type.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure
+ * @param[in] size      the size of the block to be allocated
+ * @return              A pointer to the allocated memory block.
+ * @retval NULL         if the provider is unable to return a new chunk.
+ *
+ * @iclass
+ */
+void *chArenaAllocFromI(MemoryArena *map, size_t size) {
+  void *p;
+
+  chDbgCheckClassI();
+  chDbgCheck(map != NULL, "chArenaAllocFromI");
+
+  size = MEM_ALIGN_NEXT(size);
+  if (((size_t)(map->ma_endmem - map->ma_nextmem) < size) &&
+      !refill(map, size))
+    return NULL;
+  p = map->ma_nextmem;
+  map->ma_nextmem += size;
+  return p;
+}
+
+/**
+ * @brief   Allocates a memory block from an arena.
+ * @details The size of the returned block is aligned to the alignment
+ *          type. The kernel lock is only entered when a new chunk is
+ *          required.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure
+ * @param[in] size      the size of the block to be allocated
+ * @return              A pointer to the allocated memory block.
+ * @retval NULL         if the provider is unable to return a new chunk.
+ *
+ * @api
+ */
+void *chArenaAllocFrom(MemoryArena *map, size_t size) {
+  void *p;
+
+  chDbgCheck(map != NULL, "chArenaAllocFrom");
+
+  size = MEM_ALIGN_NEXT(size);
+  if ((size_t)(map->ma_endmem - map->ma_nextmem) < size) {
+    chSysLock();
+    p = chArenaAllocFromI(map, size);
+    chSysUnlock();
+    return p;
+  }
+  p = map->ma_nextmem;
+  map->ma_nextmem += size;
+  return p;
+}
+
+/**
+ * @brief   Releases all the blocks allocated after a mark.
+ * @details The arena is moved back to the position saved using
+ *          @p chArenaGetMark(), the chunks obtained after the mark are
+ *          retained for reuse.
+ * @pre     The mark must have been saved on the same arena and not be
+ *          older than the last @p chArenaReset() or a release to an older
+ *          mark.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure
+ * @param[in] mp        pointer to an @p ArenaMark structure
+ *
+ * @api
+ */
+void chArenaRelease(MemoryArena *map, const ArenaMark *mp) {
+
+  chDbgCheck((map != NULL) && (mp != NULL), "chArenaRelease");
+
+  if (mp->am_chunk == NULL) {
+    chArenaReset(map);
+    return;
+  }
+  map->ma_current = mp->am_chunk;
+  map->ma_nextmem = mp->am_nextmem;
+  map->ma_endmem = mp->am_chunk->ac_end;
+}
+
+/**
+ * @brief   Releases all the blocks allocated from an arena.
+ * @details The chunks are retained for reuse.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure
+ *
+ * @api
+ */
+void chArenaReset(MemoryArena *map) {
+
+  chDbgCheck(map != NULL, "chArenaReset");
+
+  map->ma_current = NULL;
+  map->ma_nextmem = map->ma_endmem = NULL;
+}
+
+/**
+ * @brief   Sets the arena of the current thread.
+ *
+ * @param[in] map       pointer to a @p MemoryArena structure or @p NULL
+ * @return              The previous arena of the current thread.
+ *
+ * @api
+ */
+MemoryArena *chArenaSetSelf(MemoryArena *map) {
+  MemoryArena *omap;
+
+  omap = currp->p_arena;
+  currp->p_arena = map;
+  return omap;
+}
+
+/**
+ * @brief   Allocates a memory block from the arena of the current thread.
+ * @details This function is compatible with the @p memgetfunc_t type and
+ *          can be used as provider of memory pools.
+ * @pre     The current thread must have an arena, see
+ *          @p chArenaSetSelf().
+ * @note    Memory pools used from interrupt handlers must not use this
+ *          provider.
+ *
+ * @param[in] size      the size of the block to be allocated
+ * @return              A pointer to the allocated memory block.
+ * @retval NULL         if the provider is unable to return a new chunk.
+ *
+ * @iclass
+ */
+void *chArenaAllocI(size_t size) {
+
+  chDbgAssert(currp->p_arena != NULL, "chArenaAllocI(), #1", "no arena");
+
+  return chArenaAllocFromI(currp->p_arena, size);
+}
+
+/**
+ * @brief   Allocates a memory block from the arena of the current thread.
+ * @pre     The current thread must have an arena, see
+ *          @p chArenaSetSelf().
+ *
+ * @param[in] size      the size of the block to be allocated
+ * @return              A pointer to the allocated memory block.
+ * @retval NULL         if the provider is unable to return a new chunk.
+ *
+ * @api
+ */
+void *chArenaAlloc(size_t size) {
+
+  chDbgAssert(currp->p_arena != NULL, "chArenaAlloc(), #1", "no arena");
+
+  return chArenaAllocFrom(currp->p_arena, size);
+}
+
+#endif /* CH_USE_MEMARENAS */
+
+/** @} */
@@ -69,6 +69,29 @@ void _core_init(void) {
 #endif
 }
 
+/*
+ * Bump allocation, the call site is only used by the memory accounting.
+ */
+static void *core_alloc(size_t size, const void *site) {
+  void *p;
+
+  size = MEM_ALIGN_NEXT(size);
+  if ((size_t)(endmem - nextmem) < size) {
+#if CH_USE_MEMACCT
+    _memacct_coreI(0, site);
+#endif
+    return NULL;
+  }
+  p = nextmem;
+  nextmem += size;
+#if CH_USE_MEMACCT
+  _memacct_coreI(size, site);
+#else
+  (void)site;
+#endif
+  return p;
+}
+
 /**
  * @brief   Allocates a memory block.
  * @details The size of the returned block is aligned to the alignment
@@ -85,7 +108,11 @@ void *chCoreAlloc(size_t size) {
   void *p;
 
   chSysLock();
-  p = chCoreAllocI(size);
+#if CH_USE_MEMACCT
+  p = core_alloc(size, MEMACCT_SITE());
+#else
+  p = core_alloc(size, NULL);
+#endif
   chSysUnlock();
   return p;
 }
@@ -103,16 +130,14 @@ void *chCoreAlloc(size_t size) {
  * @iclass
  */
 void *chCoreAllocI(size_t size) {
-  void *p;
 
   chDbgCheckClassI();
 
-  size = MEM_ALIGN_NEXT(size);
-  if ((size_t)(endmem - nextmem) < size)
-    return NULL;
-  p = nextmem;
-  nextmem += size;
-  return p;
+#if CH_USE_MEMACCT
+  return core_alloc(size, MEMACCT_SITE());
+#else
+  return core_alloc(size, NULL);
+#endif
 }
 
 /**
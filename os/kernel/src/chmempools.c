@@ -36,6 +36,8 @@
  * @{
  */
 
+#include <string.h>
+
 #include "ch.h"
 
 #if CH_USE_MEMPOOLS || defined(__DOXYGEN__)
@@ -59,6 +61,9 @@ void chPoolInit(MemoryPool *mp, size_t size, memgetfunc_t provider) {
   mp->mp_next = NULL;
   mp->mp_object_size = size;
   mp->mp_provider = provider;
+#if CH_USE_MEMACCT
+  memset(&mp->mp_acct, 0, sizeof (MemAccount));
+#endif
 }
 
 /**
@@ -105,6 +110,9 @@ void *chPoolAllocI(MemoryPool *mp) {
     mp->mp_next = mp->mp_next->ph_next;
   else if (mp->mp_provider != NULL)
     objp = mp->mp_provider(mp->mp_object_size);
+#if CH_USE_MEMACCT
+  _memacct_allocI(&mp->mp_acct, objp != NULL ? mp->mp_object_size : 0);
+#endif
   return objp;
 }
 
@@ -133,6 +141,9 @@ void *chPoolAlloc(MemoryPool *mp) {
  * @pre     The freed object must be of the right size for the specified
  *          memory pool.
  * @pre     The object must be properly aligned to contain a pointer to void.
+ * @pre     When @p CH_USE_MEMACCT is enabled the object must have been
+ *          allocated from the pool, objects loaded into the pool must be
+ *          added using @p chPoolAddI() instead.
  *
  * @param[in] mp        pointer to a @p MemoryPool structure
  * @param[in] objp      the pointer to the object to be released
@@ -145,6 +156,12 @@ void chPoolFreeI(MemoryPool *mp, void *objp) {
   chDbgCheckClassI();
   chDbgCheck((mp != NULL) && (objp != NULL), "chPoolFreeI");
 
+#if CH_USE_MEMACCT
+  chDbgAssert(mp->mp_acct.ma_live >= mp->mp_object_size,
+              "chPoolFreeI(), #1",
+              "object not allocated, use chPoolAddI()");
+  _memacct_freeI(&mp->mp_acct, mp->mp_object_size);
+#endif
   php->ph_next = mp->mp_next;
   mp->mp_next = php;
 }
@@ -168,6 +185,73 @@ void chPoolFree(MemoryPool *mp, void *objp) {
   chSysUnlock();
 }
 
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+/**
+ * @brief   Adds an object to a memory pool.
+ * @details The object becomes part of the pool storage, it is not accounted
+ *          as a released allocation.
+ * @pre     The memory pool must be already been initialized.
+ * @pre     The added object must be of the right size for the specified
+ *          memory pool.
+ * @pre     The added object must be memory aligned to the size of
+ *          @p stkalign_t type.
+ *
+ * @param[in] mp        pointer to a @p MemoryPool structure
+ * @param[in] objp      the pointer to the object to be added
+ *
+ * @iclass
+ */
+void chPoolAddI(MemoryPool *mp, void *objp) {
+  struct pool_header *php = objp;
+
+  chDbgCheckClassI();
+  chDbgCheck((mp != NULL) && (objp != NULL), "chPoolAddI");
+
+  php->ph_next = mp->mp_next;
+  mp->mp_next = php;
+}
+
+/**
+ * @brief   Adds an object to a memory pool.
+ * @details The object becomes part of the pool storage, it is not accounted
+ *          as a released allocation.
+ * @pre     The memory pool must be already been initialized.
+ * @pre     The added object must be of the right size for the specified
+ *          memory pool.
+ * @pre     The added object must be memory aligned to the size of
+ *          @p stkalign_t type.
+ *
+ * @param[in] mp        pointer to a @p MemoryPool structure
+ * @param[in] objp      the pointer to the object to be added
+ *
+ * @api
+ */
+void chPoolAdd(MemoryPool *mp, void *objp) {
+
+  chSysLock();
+  chPoolAddI(mp, objp);
+  chSysUnlock();
+}
+
+/**
+ * @brief   Returns the memory account of a memory pool.
+ *
+ * @param[in] mp        pointer to a @p MemoryPool structure
+ * @param[out] ap       pointer to a @p MemAccount structure receiving a copy
+ *                      of the account
+ *
+ * @api
+ */
+void chPoolGetAccount(MemoryPool *mp, MemAccount *ap) {
+
+  chDbgCheck((mp != NULL) && (ap != NULL), "chPoolGetAccount");
+
+  chSysLock();
+  *ap = mp->mp_acct;
+  chSysUnlock();
+}
+#endif /* CH_USE_MEMACCT */
+
 #endif /* CH_USE_MEMPOOLS */
 
 /** @} */
@@ -37,6 +37,12 @@
  *          Messages are usually processed in FIFO order but it is possible to
  *          process them in priority order by enabling the
  *          @p CH_USE_MESSAGES_PRIORITY option in @p chconf.h.<br>
+ *          When the receiving thread is waiting and its priority is higher
+ *          than any ready thread the exchange is performed as a direct
+ *          handoff, the control is passed to the receiver without going
+ *          through the ready list. Server threads should use
+ *          @p chMsgReplyAndWait() in their loop in order to answer a message
+ *          and wait for the next one in a single operation.<br>
  * @pre     In order to use the message APIs the @p CH_USE_MESSAGES option
  *          must be enabled in @p chconf.h.
  * @post    Enabling messages requires 6-12 (depending on the architecture)
@@ -74,8 +80,17 @@ msg_t chMsgSend(Thread *tp, msg_t msg) {
   ctp->p_msg = msg;
   ctp->p_u.wtobjp = &tp->p_msgqueue;
   msg_insert(ctp, &tp->p_msgqueue);
-  if (tp->p_state == THD_STATE_WTMSG)
+  if (tp->p_state == THD_STATE_WTMSG) {
+    /* Fast path, the receiver would be the next thread to run anyway so the
+       control is passed to it directly.*/
+    if (chSchCanHandoffI(tp)) {
+      chSchGoSleepHandoffS(THD_STATE_SNDMSGQ, tp);
+      msg = ctp->p_u.rdymsg;
+      chSysUnlock();
+      return msg;
+    }
     chSchReadyI(tp);
+  }
   chSchGoSleepS(THD_STATE_SNDMSGQ);
   msg = ctp->p_u.rdymsg;
   chSysUnlock();
@@ -127,6 +142,47 @@ void chMsgRelease(Thread *tp, msg_t msg) {
   chSysUnlock();
 }
 
+/**
+ * @brief   Releases a sender thread and waits for the next message.
+ * @details This function is equivalent to a @p chMsgRelease() followed by
+ *          a @p chMsgWait() but it is more efficient, if there are no
+ *          pending messages and the sender has a priority higher than any
+ *          ready thread then the control is passed directly to the sender.
+ * @pre     Invoke this function only after a message has been received
+ *          using @p chMsgWait() or @p chMsgReplyAndWait().
+ * @post    After receiving a message the function @p chMsgGet() must be
+ *          called in order to retrieve the message.
+ *
+ * @param[in] tp        pointer to the thread to be released
+ * @param[in] msg       message to be returned to the sender
+ * @return              A reference to the thread carrying the next message.
+ *
+ * @api
+ */
+Thread *chMsgReplyAndWait(Thread *tp, msg_t msg) {
+
+  chDbgCheck(tp != NULL, "chMsgReplyAndWait");
+
+  chSysLock();
+  chDbgAssert(tp->p_state == THD_STATE_SNDMSG,
+              "chMsgReplyAndWait(), #1", "invalid state");
+  if (!chMsgIsPendingI(currp)) {
+    tp->p_u.rdymsg = msg;
+    if (chSchCanHandoffI(tp))
+      chSchGoSleepHandoffS(THD_STATE_WTMSG, tp);
+    else {
+      chSchReadyI(tp);
+      chSchGoSleepS(THD_STATE_WTMSG);
+    }
+  }
+  else
+    chMsgReleaseS(tp, msg);
+  tp = fifo_remove(&currp->p_msgqueue);
+  tp->p_state = THD_STATE_SNDMSG;
+  chSysUnlock();
+  return tp;
+}
+
 #endif /* CH_USE_MESSAGES */
 
 /** @} */
@@ -33,6 +33,8 @@
  *            in the system.
  *          - <b>Next</b>, returns the next, in creation order, active thread
  *            in the system.
+ *          - <b>Snapshot</b>, copies the status of all the active threads
+ *            into an array within a single critical section.
  *          .
  *          The registry is meant to be mainly a debug feature, for example,
  *          using the registry a debugger can enumerate the active threads
@@ -151,6 +153,72 @@ Thread *chRegNextThread(Thread *tp) {
   return ntp;
 }
 
+/**
+ * @brief   Takes a snapshot of the threads in the system.
+ * @details The status of the registered threads is copied, in creation
+ *          order, into the specified array within a single critical
+ *          section, the returned table is consistent and, unlike the
+ *          @p chRegFirstThread() / @p chRegNextThread() iteration, no
+ *          thread references are required.
+ * @note    If @p CH_DBG_FILL_THREADS is enabled the unused stack space is
+ *          measured after the critical section, the copied threads are
+ *          referenced during the measurement in order to make sure their
+ *          memory is not released.
+ *
+ * @param[out] tsp      pointer to an array of @p ThreadSnapshot records
+ * @param[in] n         number of records in the array
+ * @return              The number of threads in the system, if greater
+ *                      than @p n then only the first @p n threads have
+ *                      been copied.
+ *
+ * @api
+ */
+cnt_t chRegSnapshot(ThreadSnapshot *tsp, cnt_t n) {
+  Thread *tp;
+  cnt_t i = 0;
+
+  chDbgCheck((tsp != NULL) || (n == 0), "chRegSnapshot");
+
+  chSysLock();
+  for (tp = rlist.r_newer; tp != (Thread *)&rlist; tp = tp->p_newer) {
+    if (i < n) {
+      tsp[i].ts_thread = tp;
+      tsp[i].ts_name   = tp->p_name;
+      tsp[i].ts_prio   = tp->p_prio;
+      tsp[i].ts_state  = tp->p_state;
+      tsp[i].ts_flags  = tp->p_flags;
+#if CH_USE_DYNAMIC
+      tsp[i].ts_refs   = tp->p_refs;
+#if CH_DBG_FILL_THREADS
+      chDbgAssert(tp->p_refs < 255, "chRegSnapshot(), #1",
+                  "too many references");
+      tp->p_refs++;
+#endif
+#endif
+#if CH_DBG_THREADS_PROFILING
+      tsp[i].ts_time   = tp->p_time;
+#endif
+    }
+    i++;
+  }
+  chSysUnlock();
+
+#if CH_DBG_FILL_THREADS
+  {
+    cnt_t j;
+
+    for (j = 0; j < ((i < n) ? i : n); j++) {
+      tsp[j].ts_stkfree = chThdGetStackUnused(tsp[j].ts_thread);
+#if CH_USE_DYNAMIC
+      chThdRelease(tsp[j].ts_thread);
+#endif
+    }
+  }
+#endif
+
+  return i;
+}
+
 #endif /* CH_USE_REGISTRY */
 
 /** @} */
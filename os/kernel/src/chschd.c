@@ -83,10 +83,11 @@ Thread *chSchReadyI(Thread *tp) {
               "invalid state");
 
   tp->p_state = THD_STATE_READY;
+  _latency_readyI(tp);
   cp = (Thread *)&rlist.r_queue;
   do {
     cp = cp->p_next;
-  } while (cp->p_prio >= tp->p_prio);
+  } while (!precedes(tp, cp));
   /* Insertion on p_prev.*/
   tp->p_next = cp;
   tp->p_prev = cp->p_prev;
@@ -114,7 +115,7 @@ void chSchGoSleepS(tstate_t newstate) {
 #if CH_TIME_QUANTUM > 0
   /* The thread is renouncing its remaining time slices so it will have a new
      time quantum when it will wakeup.*/
-  otp->p_preempt = CH_TIME_QUANTUM;
+  otp->p_preempt = otp->p_quantum;
 #endif
   setcurrp(fifo_remove(&rlist.r_queue));
   currp->p_state = THD_STATE_CURRENT;
@@ -122,6 +123,42 @@ void chSchGoSleepS(tstate_t newstate) {
 }
 #endif /* !defined(PORT_OPTIMIZED_GOSLEEPS) */
 
+/**
+ * @brief   Puts the current thread to sleep and hands over to a thread.
+ * @details The current thread goes into a sleeping state and the specified
+ *          thread is made running without passing through the ready list.
+ *          It is equivalent to a @p chSchReadyI() on the specified thread
+ *          followed by a @p chSchGoSleepS() but much more efficient.
+ * @pre     The thread must not be already inserted in any list through its
+ *          @p p_next and @p p_prev and must be the thread that would be
+ *          picked from the ready list, see @p chSchCanHandoffI().
+ *
+ * @param[in] newstate  the new thread state
+ * @param[in] ntp       the thread to be made running
+ *
+ * @sclass
+ */
+#if !defined(PORT_OPTIMIZED_GOSLEEPHANDOFFS) || defined(__DOXYGEN__)
+void chSchGoSleepHandoffS(tstate_t newstate, Thread *ntp) {
+  Thread *otp;
+
+  chDbgCheckClassS();
+  chDbgAssert(chSchCanHandoffI(ntp),
+              "chSchGoSleepHandoffS(), #1",
+              "not the highest priority thread");
+
+  (otp = currp)->p_state = newstate;
+#if CH_TIME_QUANTUM > 0
+  otp->p_preempt = otp->p_quantum;
+#endif
+  /* The thread does not pass through the ready list.*/
+  _latency_readyI(ntp);
+  setcurrp(ntp);
+  ntp->p_state = THD_STATE_CURRENT;
+  chSysSwitch(ntp, otp);
+}
+#endif /* !defined(PORT_OPTIMIZED_GOSLEEPHANDOFFS) */
+
 #if !defined(PORT_OPTIMIZED_GOSLEEPTIMEOUTS) || defined(__DOXYGEN__)
 /*
  * Timeout wakeup callback.
@@ -224,10 +261,11 @@ void chSchWakeupS(Thread *ntp, msg_t msg) {
      one then it is just inserted in the ready list else it made
      running immediately and the invoking thread goes in the ready
      list instead.*/
-  if (ntp->p_prio <= currp->p_prio)
+  if (!precedes(ntp, currp))
     chSchReadyI(ntp);
   else {
     Thread *otp = chSchReadyI(currp);
+    _latency_readyI(ntp);
     setcurrp(ntp);
     ntp->p_state = THD_STATE_CURRENT;
     chSysSwitch(ntp, otp);
@@ -269,6 +307,12 @@ void chSchRescheduleS(void) {
 bool_t chSchIsPreemptionRequired(void) {
   tprio_t p1 = firstprio(&rlist.r_queue);
   tprio_t p2 = currp->p_prio;
+#if CH_USE_EDF
+  /* Threads in the EDF band are not subject to the round robin, a thread
+     preempts another one only if it has an earlier deadline.*/
+  if ((p1 == CH_EDF_PRIO) && (p2 == CH_EDF_PRIO))
+    return edf_before(rlist.r_queue.p_next->p_deadline, currp->p_deadline);
+#endif
 #if CH_TIME_QUANTUM > 0
   /* If the running thread has not reached its time quantum, reschedule only
      if the first thread on the ready queue has a higher priority.
@@ -302,7 +346,7 @@ void chSchDoRescheduleBehind(void) {
   setcurrp(fifo_remove(&rlist.r_queue));
   currp->p_state = THD_STATE_CURRENT;
 #if CH_TIME_QUANTUM > 0
-  otp->p_preempt = CH_TIME_QUANTUM;
+  otp->p_preempt = otp->p_quantum;
 #endif
   chSchReadyI(otp);
   chSysSwitch(currp, otp);
@@ -328,10 +372,11 @@ void chSchDoRescheduleAhead(void) {
   currp->p_state = THD_STATE_CURRENT;
 
   otp->p_state = THD_STATE_READY;
+  _latency_readyI(otp);
   cp = (Thread *)&rlist.r_queue;
   do {
     cp = cp->p_next;
-  } while (cp->p_prio > otp->p_prio);
+  } while (precedes(cp, otp));
   /* Insertion on p_prev.*/
   otp->p_next = cp;
   otp->p_prev = cp->p_prev;
@@ -96,6 +96,8 @@ void chSysInit(void) {
   /* Now this instructions flow becomes the main thread.*/
   setcurrp(_thread_init(&mainthread, NORMALPRIO));
   currp->p_state = THD_STATE_CURRENT;
+  /* The main thread runs on the C runtime stack.*/
+  currp->p_flags |= THD_STACK_EXTERNAL;
 #if CH_DBG_ENABLE_STACK_CHECK
   /* This is a special case because the main thread Thread structure is not
      adjacent to its stack area.*/
@@ -131,12 +133,19 @@ void chSysTimerHandlerI(void) {
 
   chDbgCheckClassI();
 
+  /* Virtual timers lateness is measured from here.*/
+  _latency_tickI();
 #if CH_TIME_QUANTUM > 0
   /* Running thread has not used up quantum yet? */
   if (currp->p_preempt > 0)
     /* Decrement remaining quantum.*/
     currp->p_preempt--;
 #endif
+#if CH_USE_BUDGETS
+  /* Running thread charged to its CPU budget server.*/
+  if (currp->p_server != NULL)
+    _budget_tickI(currp->p_server);
+#endif
 #if CH_DBG_THREADS_PROFILING
   currp->p_time++;
 #endif
@@ -73,6 +73,7 @@ Thread *_thread_init(Thread *tp, tprio_t prio) {
   tp->p_flags = THD_MEM_MODE_STATIC;
 #if CH_TIME_QUANTUM > 0
   tp->p_preempt = CH_TIME_QUANTUM;
+  tp->p_quantum = CH_TIME_QUANTUM;
 #endif
 #if CH_USE_MUTEXES
   tp->p_realprio = prio;
@@ -87,6 +88,27 @@ Thread *_thread_init(Thread *tp, tprio_t prio) {
 #if CH_USE_DYNAMIC
   tp->p_refs = 1;
 #endif
+#if CH_USE_MEMARENAS
+  tp->p_arena = NULL;
+#endif
+#if CH_USE_MEMACCT
+  tp->p_memowner = 0;
+#endif
+#if CH_USE_EDF
+  tp->p_deadline = 0;
+  tp->p_release = 0;
+  tp->p_period = 0;
+  tp->p_reldeadline = 0;
+  tp->p_jobs = 0;
+  tp->p_misses = 0;
+#endif
+#if CH_USE_BUDGETS
+  tp->p_server = NULL;
+#endif
+#if CH_USE_LATENCY
+  tp->p_readyts = 0;
+  tp->p_latency = NULL;
+#endif
 #if CH_USE_REGISTRY
   tp->p_name = NULL;
   REG_INSERT(tp);
@@ -121,6 +143,57 @@ void _thread_memfill(uint8_t *startp, uint8_t *endp, uint8_t v) {
   while (startp < endp)
     *startp++ = v;
 }
+
+/**
+ * @brief   Returns the stack space never used by a thread.
+ * @details The stack is scanned from its bottom for bytes still holding
+ *          the @p CH_STACK_FILL_VALUE value written when the thread was
+ *          created, the result is the margin left by the deepest stack
+ *          usage so far (the high-water mark).
+ * @pre     The configuration option @p CH_DBG_FILL_THREADS must be enabled
+ *          in order to use this function.
+ * @note    The thread working area must have been filled at creation,
+ *          this is done by @p chThdCreateStatic() and by the dynamic threads
+ *          APIs when @p CH_DBG_FILL_THREADS is enabled. Threads created
+ *          using @p chThdCreateI() are not filled.
+ * @note    The main thread stack is not adjacent to its @p Thread structure
+ *          and is not measured, zero is returned.
+ *
+ * @param[in] tp        pointer to the thread
+ * @return              The never used stack space in bytes.
+ *
+ * @api
+ */
+size_t chThdGetStackUnused(Thread *tp) {
+  const uint32_t pattern = (uint32_t)CH_STACK_FILL_VALUE * 0x01010101U;
+  uint8_t *base, *p;
+
+  if ((tp->p_flags & THD_STACK_EXTERNAL) != 0)
+    return 0;
+
+#if defined(PORT_THREAD_STACK_BASE)
+  base = PORT_THREAD_STACK_BASE(tp);
+#else
+  base = (uint8_t *)(tp + 1);
+#endif
+
+  /* Bytes scan up to a word boundary then words scan, the top of the stack
+     always contains the initial context so the loops are bounded.*/
+  p = base;
+  while ((((size_t)p & (sizeof (uint32_t) - 1)) != 0) &&
+         (*p == CH_STACK_FILL_VALUE))
+    p++;
+  if (((size_t)p & (sizeof (uint32_t) - 1)) == 0) {
+    uint32_t *wp = (uint32_t *)p;
+
+    while (*wp == pattern)
+      wp++;
+    p = (uint8_t *)wp;
+  }
+  while (*p == CH_STACK_FILL_VALUE)
+    p++;
+  return (size_t)(p - base);
+}
 #endif /* CH_DBG_FILL_THREADS */
 
 /**
@@ -215,11 +288,24 @@ tprio_t chThdSetPriority(tprio_t newprio) {
   chSysLock();
 #if CH_USE_MUTEXES
   oldprio = currp->p_realprio;
+#else
+  oldprio = currp->p_prio;
+#endif
+#if CH_USE_BUDGETS
+  if ((currp->p_server != NULL) && currp->p_server->bs_depleted) {
+    /* The group is demoted, the new priority becomes effective on the
+       budget replenishment.*/
+    oldprio = currp->p_bsprio;
+    currp->p_bsprio = newprio;
+    if (newprio > currp->p_server->bs_lowprio)
+      newprio = currp->p_server->bs_lowprio;
+  }
+#endif
+#if CH_USE_MUTEXES
   if ((currp->p_prio == currp->p_realprio) || (newprio > currp->p_prio))
     currp->p_prio = newprio;
   currp->p_realprio = newprio;
 #else
-  oldprio = currp->p_prio;
   currp->p_prio = newprio;
 #endif
   chSchRescheduleS();
@@ -227,6 +313,34 @@ tprio_t chThdSetPriority(tprio_t newprio) {
   return oldprio;
 }
 
+#if (CH_TIME_QUANTUM > 0) || defined(__DOXYGEN__)
+/**
+ * @brief   Changes the running thread round robin time quantum.
+ * @details The new quantum is effective immediately, the running thread
+ *          is granted a full new quantum. Larger quanta reduce the context
+ *          switches among threads of equal priority, smaller quanta reduce
+ *          their latency.
+ *
+ * @param[in] quantum   the new time quantum in system ticks, it must be
+ *                      greater than zero
+ * @return              The old time quantum.
+ *
+ * @api
+ */
+tslices_t chThdSetQuantum(tslices_t quantum) {
+  tslices_t oldquantum;
+
+  chDbgCheck(quantum > 0, "chThdSetQuantum");
+
+  chSysLock();
+  oldquantum = currp->p_quantum;
+  currp->p_quantum = quantum;
+  currp->p_preempt = quantum;
+  chSysUnlock();
+  return oldquantum;
+}
+#endif /* CH_TIME_QUANTUM > 0 */
+
 /**
  * @brief   Resumes a suspended thread.
  * @pre     The specified thread pointer must refer to an initialized thread
@@ -307,6 +421,75 @@ void chThdSleepUntil(systime_t time) {
   chSysUnlock();
 }
 
+#if CH_USE_EDF || defined(__DOXYGEN__)
+/**
+ * @brief   Declares the running thread periodic.
+ * @details The first job is released immediately, its absolute deadline is
+ *          the current system time plus the relative deadline. The jobs
+ *          are then delimited by calls to @p chThdWaitNextPeriod().<br>
+ *          A periodic thread running at the @p CH_EDF_PRIO priority level
+ *          is scheduled by earliest deadline first, at any other priority
+ *          level the timing is only used for the deadline misses
+ *          accounting.
+ * @note    A non periodic thread raised into the EDF band by the priority
+ *          inheritance competes with its last deadline.
+ *
+ * @param[in] period    release period in system ticks
+ * @param[in] deadline  relative deadline in system ticks, it must not be
+ *                      greater than the period
+ *
+ * @api
+ */
+void chThdSetPeriodic(systime_t period, systime_t deadline) {
+
+  chDbgCheck((period > 0) && (deadline > 0) && (deadline <= period),
+             "chThdSetPeriodic");
+
+  chSysLock();
+  currp->p_period = period;
+  currp->p_reldeadline = deadline;
+  currp->p_release = chTimeNow();
+  currp->p_deadline = currp->p_release + deadline;
+  currp->p_jobs = 0;
+  currp->p_misses = 0;
+  /* A later deadline can make another thread of the EDF band the first.*/
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Completes the current job and waits for the next release.
+ * @details The job is accounted as a deadline miss if it completes after
+ *          its absolute deadline. The next job is released one period after
+ *          the current one, if that time is already past then the thread
+ *          does not sleep and the next job starts late with its own
+ *          deadline, the periods are never skipped.
+ * @pre     The thread must have been declared periodic using
+ *          @p chThdSetPeriodic().
+ *
+ * @api
+ */
+void chThdWaitNextPeriod(void) {
+  Thread *tp = currp;
+  systime_t now;
+
+  chDbgCheck(tp->p_period > 0, "chThdWaitNextPeriod");
+
+  chSysLock();
+  now = chTimeNow();
+  tp->p_jobs++;
+  if (edf_before(tp->p_deadline, now))
+    tp->p_misses++;
+  tp->p_release += tp->p_period;
+  tp->p_deadline = tp->p_release + tp->p_reldeadline;
+  if (edf_before(now, tp->p_release))
+    chThdSleepS(tp->p_release - now);
+  else
+    chSchRescheduleS();
+  chSysUnlock();
+}
+#endif /* CH_USE_EDF */
+
 /**
  * @brief   Yields the time slot.
  * @details Yields the CPU control to the next thread in the ready list with
@@ -363,10 +546,20 @@ void chThdExitS(msg_t msg) {
 #if defined(THREAD_EXT_EXIT_HOOK)
   THREAD_EXT_EXIT_HOOK(tp);
 #endif
+#if defined(PORT_THREAD_EXIT_HOOK)
+  PORT_THREAD_EXIT_HOOK(tp);
+#endif
 #if CH_USE_WAITEXIT
   while (notempty(&tp->p_waiting))
     chSchReadyI(list_remove(&tp->p_waiting));
 #endif
+#if CH_USE_MEMACCT
+  _memacct_exitI(tp);
+#endif
+#if CH_USE_BUDGETS
+  chBudgetRemoveI(tp);
+#endif
+  _latency_exitI(tp);
 #if CH_USE_REGISTRY
   /* Static threads are immediately removed from the registry because
      there is no memory to recover.*/
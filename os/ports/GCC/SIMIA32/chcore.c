@@ -25,9 +25,114 @@
 
 #include <stdlib.h>
 
+#if !defined(WIN32)
+#include <string.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <time.h>
+#endif
+
 #include "ch.h"
 #include "hal.h"
 
+#if PORT_STACK_GUARD_PAGES || defined(__DOXYGEN__)
+/**
+ * Host memory page size.
+ */
+size_t _port_page_size;
+
+/**
+ * Alternate signal stack, the faulting thread stack cannot be used by the
+ * overflow handler.
+ */
+static uint8_t altstack[65536];
+
+static void guard_puts(const char *s) {
+
+  if (write(2, s, strlen(s)) < 0)
+    return;
+}
+
+/**
+ * Reports an access to a guard page then lets the default action of the
+ * signal terminate the simulation.
+ */
+static void guard_handler(int sig, siginfo_t *info, void *ctx) {
+  Thread *tp = currp;
+  uint8_t *addr = (uint8_t *)info->si_addr;
+
+  (void)ctx;
+  if ((tp->p_ctx.guard != NULL) && (addr >= tp->p_ctx.guard) &&
+      (addr < tp->p_ctx.guard + _port_page_size)) {
+    guard_puts("stack overflow in thread ");
+#if CH_USE_REGISTRY
+    if (tp->p_name != NULL)
+      guard_puts(tp->p_name);
+    else
+#endif
+      guard_puts("<unnamed>");
+    guard_puts("\n");
+  }
+  signal(sig, SIG_DFL);
+}
+
+/**
+ * Simulator initialization, installs the guard pages fault handler.
+ */
+void _port_init(void) {
+  stack_t ss;
+  struct sigaction sa;
+
+  _port_page_size = (size_t)sysconf(_SC_PAGESIZE);
+
+  ss.ss_sp = altstack;
+  ss.ss_size = sizeof altstack;
+  ss.ss_flags = 0;
+  sigaltstack(&ss, NULL);
+
+  memset(&sa, 0, sizeof sa);
+  sa.sa_sigaction = guard_handler;
+  sa.sa_flags = SA_SIGINFO | SA_ONSTACK;
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGSEGV, &sa, NULL);
+  sigaction(SIGBUS, &sa, NULL);
+}
+
+/**
+ * Protects the first whole page of a thread stack. The page is not
+ * installed if it does not fit into the interrupts stack reserve of the
+ * working area.
+ *
+ * @param tp the new thread
+ * @param end the end of the thread working area
+ */
+void _port_guard_setup(Thread *tp, uint8_t *end) {
+  uint8_t *guard = (uint8_t *)(((uintptr_t)(tp + 1) + _port_page_size - 1) &
+                               ~(uintptr_t)(_port_page_size - 1));
+
+  tp->p_ctx.guard = NULL;
+  if ((guard + _port_page_size <= end) &&
+      ((size_t)(guard + _port_page_size - (uint8_t *)(tp + 1)) <=
+       PORT_INT_REQUIRED_STACK) &&
+      (mprotect(guard, _port_page_size, PROT_NONE) == 0))
+    tp->p_ctx.guard = guard;
+}
+
+/**
+ * Makes the guard page of a terminating thread accessible again.
+ *
+ * @param tp the terminating thread
+ */
+void _port_guard_release(Thread *tp) {
+
+  if (tp->p_ctx.guard != NULL) {
+    mprotect(tp->p_ctx.guard, _port_page_size, PROT_READ | PROT_WRITE);
+    tp->p_ctx.guard = NULL;
+  }
+}
+#endif /* PORT_STACK_GUARD_PAGES */
+
 /**
  * Performs a context switch between two threads.
  * @param otp the thread to be switched out
@@ -61,6 +166,21 @@ static void __dummy(Thread *ntp, Thread *otp) {
                 "ret");
 }
 
+#if defined(PORT_RT_FREQUENCY) || defined(__DOXYGEN__)
+/**
+ * @brief   Returns the realtime counter value.
+ *
+ * @return              The host monotonic clock in nanoseconds, truncated
+ *                      to 32 bits.
+ */
+uint32_t port_rt_get_counter_value(void) {
+  struct timespec ts;
+
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint32_t)ts.tv_sec * 1000000000U + (uint32_t)ts.tv_nsec;
+}
+#endif
+
 /**
  * Halts the system. In this implementation it just exits the simulation.
  */
@@ -30,6 +30,22 @@
 #error "option CH_DBG_ENABLE_STACK_CHECK not supported by this port"
 #endif
 
+/**
+ * Enables the stack guard pages.
+ * If enabled then the lowest memory page of each thread stack is made
+ * inaccessible using mprotect(), a stack overflow is trapped immediately
+ * and the faulting thread is reported. The guard page is taken from the
+ * @p PORT_INT_REQUIRED_STACK reserve of the working area.
+ * @note Only supported on Posix hosts.
+ */
+#ifndef PORT_STACK_GUARD_PAGES
+#define PORT_STACK_GUARD_PAGES          FALSE
+#endif
+
+#if PORT_STACK_GUARD_PAGES && defined(WIN32)
+#error "PORT_STACK_GUARD_PAGES not supported on Win32 hosts"
+#endif
+
 /**
  * Macro defining the a simulated architecture into x86.
  */
@@ -94,6 +110,9 @@ struct intctx {
  */
 struct context {
   struct intctx volatile *esp;
+#if PORT_STACK_GUARD_PAGES
+  uint8_t *guard;           /* Protected stack page or NULL.            */
+#endif
 };
 
 #define APUSH(p, a) (p) -= sizeof(void *), *(void **)(p) = (void*)(a)
@@ -124,8 +143,33 @@ struct context {
   ((struct intctx *)esp)->esi = 0;                                      \
   ((struct intctx *)esp)->ebp = savebp;                                 \
   tp->p_ctx.esp = (struct intctx *)esp;                                 \
+  PORT_SETUP_GUARD(tp, workspace, wsize);                               \
 }
 
+#if PORT_STACK_GUARD_PAGES
+/**
+ * Protects the guard page at the bottom of a new thread stack.
+ */
+#define PORT_SETUP_GUARD(tp, workspace, wsize)                          \
+  _port_guard_setup(tp, (uint8_t *)(workspace) + (wsize))
+
+/**
+ * Releases the guard page of a terminating thread, the working area
+ * memory can be reused after the thread exit.
+ */
+#define PORT_THREAD_EXIT_HOOK(tp) _port_guard_release(tp)
+
+/**
+ * First accessible byte of a thread stack, the guard page is skipped by
+ * the stack usage measurement.
+ */
+#define PORT_THREAD_STACK_BASE(tp)                                      \
+  ((tp)->p_ctx.guard != NULL ? (tp)->p_ctx.guard + _port_page_size :    \
+                               (uint8_t *)((tp) + 1))
+#else
+#define PORT_SETUP_GUARD(tp, workspace, wsize)
+#endif
+
 /**
  * Stack size for the system idle thread.
  */
@@ -183,7 +227,11 @@ struct context {
 /**
  * Simulator initialization.
  */
+#if PORT_STACK_GUARD_PAGES
+#define port_init() _port_init()
+#else
 #define port_init()
+#endif
 
 /**
  * Does nothing in this simulator.
@@ -226,6 +274,15 @@ struct context {
  */
 #define port_wait_for_interrupt() ChkIntSources()
 
+#if !defined(WIN32) || defined(__DOXYGEN__)
+/**
+ * @brief   Realtime counter frequency.
+ * @details The realtime counter is the host monotonic clock in nanoseconds,
+ *          it wraps about every four seconds.
+ */
+#define PORT_RT_FREQUENCY               1000000000
+#endif
+
 #ifdef __cplusplus
 extern "C" {
 #endif
@@ -234,6 +291,15 @@ extern "C" {
   __attribute__((cdecl, noreturn)) void _port_thread_start(msg_t (*pf)(void *),
                                                            void *p);
   void ChkIntSources(void);
+#if defined(PORT_RT_FREQUENCY)
+  uint32_t port_rt_get_counter_value(void);
+#endif
+#if PORT_STACK_GUARD_PAGES
+  extern size_t _port_page_size;
+  void _port_init(void);
+  void _port_guard_setup(Thread *tp, uint8_t *end);
+  void _port_guard_release(Thread *tp);
+#endif
 #ifdef __cplusplus
 }
 #endif
@@ -165,6 +165,8 @@ struct intctx {};
 
 #endif /* defined(__DOXYGEN__) */
 
+/* The EDF scheduling class requires the kernel implementation.*/
+#if !CH_USE_EDF || defined(__DOXYGEN__)
 /**
  * @brief   Excludes the default @p chSchIsPreemptionRequired()implementation.
  */
@@ -181,6 +183,7 @@ struct intctx {};
 #define chSchIsPreemptionRequired()                                         \
   (firstprio(&rlist.r_queue) > currp->p_prio)
 #endif /* CH_TIME_QUANTUM == 0 */
+#endif /* !CH_USE_EDF */
 
 #endif /* _FROM_ASM_ */
 
@@ -230,6 +230,16 @@ namespace chibios_rt {
 
     chMsgRelease(thread_ref, msg);
   }
+
+  ThreadReference ThreadReference::releaseMessageAndWait(msg_t msg) {
+
+    chDbgAssert(thread_ref != NULL,
+                "ThreadReference, #12",
+                "not referenced");
+
+    ThreadReference tr(chMsgReplyAndWait(thread_ref, msg));
+    return tr;
+  }
 #endif /* CH_USE_MESSAGES */
 
 #if CH_USE_EVENTS
@@ -289,6 +299,13 @@ namespace chibios_rt {
     return chThdSetPriority(newprio);
   }
 
+#if CH_TIME_QUANTUM > 0
+  tslices_t BaseThread::setQuantum(tslices_t quantum) {
+
+    return chThdSetQuantum(quantum);
+  }
+#endif /* CH_TIME_QUANTUM > 0 */
+
   void BaseThread::exit(msg_t msg) {
 
     chThdExit(msg);
@@ -814,6 +831,63 @@ namespace chibios_rt {
   }
 #endif /* CH_USE_MAILBOXES */
 
+#if (__cplusplus >= 201103L) && CH_USE_SEMAPHORES
+  /*------------------------------------------------------------------------*
+   * chibios_rt::ChannelBase                                                *
+   *------------------------------------------------------------------------*/
+  ChannelBase::ChannelBase(cnt_t n) {
+
+    chSemInit(&ch_emptysem, n);
+    chSemInit(&ch_fullsem, 0);
+#if CH_USE_EVENTS
+    chEvtInit(&ch_event);
+#endif
+  }
+
+  void ChannelBase::notifyI(void) {
+
+    chSemSignalI(&ch_fullsem);
+#if CH_USE_EVENTS
+    chEvtBroadcastI(&ch_event);
+#endif
+  }
+
+  cnt_t ChannelBase::getUsedCountI(void) {
+    cnt_t n = chSemGetCounterI(&ch_fullsem);
+
+    return n > 0 ? n : 0;
+  }
+
+  cnt_t ChannelBase::getFreeCountI(void) {
+    cnt_t n = chSemGetCounterI(&ch_emptysem);
+
+    return n > 0 ? n : 0;
+  }
+
+#if CH_USE_EVENTS
+  int ChannelBase::waitAny(ChannelBase * const *chans, int n,
+                           systime_t time) {
+    eventmask_t mask = (eventmask_t)(n >= (int)(sizeof (eventmask_t) * 8) ?
+                                     ALL_EVENTS : EVENT_MASK(n) - 1);
+    int i;
+
+    while (true) {
+      chSysLock();
+      for (i = 0; i < n; i++) {
+        if (chSemGetCounterI(&chans[i]->ch_fullsem) > 0) {
+          chSysUnlock();
+          chEvtGetAndClearEvents(mask);
+          return i;
+        }
+      }
+      chSysUnlock();
+      if (chEvtWaitAnyTimeout(mask, time) == 0)
+        return -1;
+    }
+  }
+#endif /* CH_USE_EVENTS */
+#endif /* (__cplusplus >= 201103L) && CH_USE_SEMAPHORES */
+
 #if CH_USE_MEMPOOLS
   /*------------------------------------------------------------------------*
    * chibios_rt::MemoryPool                                                 *
@@ -855,6 +929,41 @@ namespace chibios_rt {
     chPoolFreeI(&pool, objp);
   }
 #endif /* CH_USE_MEMPOOLS */
+
+#if CH_USE_MEMARENAS
+  /*------------------------------------------------------------------------*
+   * chibios_rt::MemoryArena                                                *
+   *------------------------------------------------------------------------*/
+  MemoryArena::MemoryArena(size_t chunk, memgetfunc_t provider) {
+
+    chArenaInit(&arena, chunk, provider);
+  }
+
+  void *MemoryArena::alloc(size_t size) {
+
+    return chArenaAllocFrom(&arena, size);
+  }
+
+  void MemoryArena::getMark(ArenaMark *mp) {
+
+    chArenaGetMark(&arena, mp);
+  }
+
+  void MemoryArena::release(const ArenaMark *mp) {
+
+    chArenaRelease(&arena, mp);
+  }
+
+  void MemoryArena::reset(void) {
+
+    chArenaReset(&arena);
+  }
+
+  ::MemoryArena *MemoryArena::setSelf(void) {
+
+    return chArenaSetSelf(&arena);
+  }
+#endif /* CH_USE_MEMARENAS */
 }
 
 /** @} */
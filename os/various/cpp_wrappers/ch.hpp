@@ -31,6 +31,12 @@
 #ifndef _CH_HPP_
 #define _CH_HPP_
 
+#if __cplusplus >= 201103L
+#include <new>
+#include <utility>
+#include <type_traits>
+#endif
+
 /**
  * @brief   ChibiOS kernel-related classes and interfaces.
  */
@@ -390,6 +396,19 @@ namespace chibios_rt {
      * @api
      */
     void releaseMessage(msg_t msg);
+
+    /**
+     * @brief   Releases the message with a reply and waits for the next one.
+     * @details The control is handed over directly to the sender when
+     *          possible, see @p chMsgReplyAndWait().
+     *
+     * @param[in] msg           the answer message
+     * @return                  A reference to the thread carrying the next
+     *                          message.
+     *
+     * @api
+     */
+    ThreadReference releaseMessageAndWait(msg_t msg);
 #endif /* CH_USE_MESSAGES */
 
 #if CH_USE_EVENTS || defined(__DOXYGEN__)
@@ -477,6 +496,18 @@ namespace chibios_rt {
      */
     static tprio_t setPriority(tprio_t newprio);
 
+#if (CH_TIME_QUANTUM > 0) || defined(__DOXYGEN__)
+    /**
+     * @brief   Changes the running thread round robin time quantum.
+     *
+     * @param[in] quantum   the new time quantum in system ticks
+     * @return              The old time quantum.
+     *
+     * @api
+     */
+    static tslices_t setQuantum(tslices_t quantum);
+#endif /* CH_TIME_QUANTUM > 0 */
+
     /**
      * @brief   Terminates the current thread.
      * @details The thread goes in the @p THD_STATE_FINAL state holding the
@@ -2046,6 +2077,566 @@ namespace chibios_rt {
   };
 #endif /* CH_USE_MAILBOXES */
 
+#if ((__cplusplus >= 201103L) && CH_USE_SEMAPHORES) || defined(__DOXYGEN__)
+  /*------------------------------------------------------------------------*
+   * chibios_rt::ChannelBase                                                *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Maximum size of the objects using the fast channel path.
+   * @details Trivially copyable objects up to this size are copied into and
+   *          out of the channel inside the kernel critical zone, larger or
+   *          non trivially copyable objects are moved outside the critical
+   *          zone under the protection of a mutex.
+   */
+#if !defined(CH_CHANNEL_FAST_SIZE) || defined(__DOXYGEN__)
+#define CH_CHANNEL_FAST_SIZE            16
+#endif
+
+  /**
+   * @brief   Type independent part of a typed channel.
+   */
+  class ChannelBase {
+  protected:
+    /**
+     * @brief   Empty slots semaphore.
+     */
+    ::Semaphore         ch_emptysem;
+    /**
+     * @brief   Full slots semaphore.
+     */
+    ::Semaphore         ch_fullsem;
+#if CH_USE_EVENTS || defined(__DOXYGEN__)
+    /**
+     * @brief   Event source broadcasted when an object is sent.
+     */
+    ::EventSource       ch_event;
+#endif
+
+    /**
+     * @brief   ChannelBase constructor.
+     *
+     * @param[in] n             number of slots in the channel
+     *
+     * @init
+     */
+    ChannelBase(cnt_t n);
+
+    /**
+     * @brief   Signals that a slot has been filled.
+     *
+     * @iclass
+     */
+    void notifyI(void);
+
+#if CH_USE_EVENTS || defined(__DOXYGEN__)
+    /**
+     * @brief   Waits for an object in any of the specified channels.
+     * @pre     The invoking thread must be listening the channels event
+     *          sources, the channel in position @p i on the event flag
+     *          @p i.
+     *
+     * @param[in] chans         array of pointers to the channels
+     * @param[in] n             number of channels in the array
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the timeout is restarted if the
+     *                          thread is woken up but the object has been
+     *                          already received by another thread
+     * @return                  The index of a ready channel.
+     * @retval -1               if the operation has timed out.
+     *
+     * @api
+     */
+    static int waitAny(ChannelBase * const *chans, int n, systime_t time);
+#endif
+
+  public:
+    /**
+     * @brief   Returns the number of objects in the channel.
+     *
+     * @return                  The number of objects.
+     *
+     * @iclass
+     */
+    cnt_t getUsedCountI(void);
+
+    /**
+     * @brief   Returns the number of free slots in the channel.
+     *
+     * @return                  The number of free slots.
+     *
+     * @iclass
+     */
+    cnt_t getFreeCountI(void);
+
+#if CH_USE_EVENTS || defined(__DOXYGEN__)
+    /**
+     * @brief   Waits for an object in any of the specified channels.
+     * @details The listeners are allocated on the stack of the invoking
+     *          thread, no memory is allocated. The object is not received,
+     *          the caller is supposed to receive it from the returned
+     *          channel using a @p TIME_IMMEDIATE timeout because another
+     *          thread could receive it first.
+     * @note    The function uses and clears the event flags from zero to
+     *          @p N - 1 of the invoking thread.
+     *
+     * @param[in] chans         array of pointers to the channels
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The index of a ready channel.
+     * @retval -1               if the operation has timed out.
+     *
+     * @api
+     */
+    template <int N>
+    static int select(ChannelBase * const (&chans)[N], systime_t time) {
+      ::EventListener els[N];
+      int i;
+
+      static_assert(N <= (int)(sizeof (eventmask_t) * 8),
+                    "too many channels");
+
+      for (i = 0; i < N; i++)
+        chEvtRegisterMask(&chans[i]->ch_event, &els[i], EVENT_MASK(i));
+      i = waitAny(chans, N, time);
+      for (int j = 0; j < N; j++)
+        chEvtUnregister(&chans[j]->ch_event, &els[j]);
+      return i;
+    }
+#endif /* CH_USE_EVENTS */
+  };
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::Channel                                                    *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Template class encapsulating a typed channel.
+   * @details The objects are stored by value in an inline ring buffer.
+   *          Trivially copyable objects not larger than
+   *          @p CH_CHANNEL_FAST_SIZE are copied inside the kernel critical
+   *          zone, the I-class and S-class functions are only available for
+   *          those types. Other types are moved outside the critical zone,
+   *          senders and receivers are serialized by two mutexes.
+   *
+   * @param T                   type of the objects
+   * @param N                   number of slots in the channel
+   */
+  template <typename T, int N>
+  class Channel : public ChannelBase {
+  public:
+    /**
+     * @brief   @p true if the channel uses the fast path.
+     */
+    static constexpr bool fast = std::is_trivially_copyable<T>::value &&
+                                 (sizeof (T) <= CH_CHANNEL_FAST_SIZE);
+
+  private:
+    static_assert(N > 0, "invalid channel size");
+#if !CH_USE_MUTEXES
+    static_assert(fast, "CH_USE_MUTEXES required for this type");
+#else
+    ::Mutex             ch_wrmtx;
+    ::Mutex             ch_rdmtx;
+#endif
+    cnt_t               ch_wridx;
+    cnt_t               ch_rdidx;
+    alignas(T) uint8_t  ch_buf[N * sizeof (T)];
+
+    T *slot(cnt_t i) {
+
+      return reinterpret_cast<T *>(ch_buf) + i;
+    }
+
+    static cnt_t next(cnt_t i) {
+
+      return ++i >= N ? 0 : i;
+    }
+
+    template <typename U>
+    void putS(U &&v) {
+
+      *slot(ch_wridx) = std::forward<U>(v);
+      ch_wridx = next(ch_wridx);
+      notifyI();
+    }
+
+    void getS(T &v) {
+
+      v = std::move(*slot(ch_rdidx));
+      ch_rdidx = next(ch_rdidx);
+      chSemSignalI(&ch_emptysem);
+    }
+
+    template <typename U>
+    msg_t put(U &&v, systime_t time) {
+      msg_t msg;
+
+      if (fast) {
+        chSysLock();
+        msg = chSemWaitTimeoutS(&ch_emptysem, time);
+        if (msg == RDY_OK) {
+          putS(std::forward<U>(v));
+          chSchRescheduleS();
+        }
+        chSysUnlock();
+        return msg;
+      }
+#if CH_USE_MUTEXES
+      chMtxLock(&ch_wrmtx);
+      msg = chSemWaitTimeout(&ch_emptysem, time);
+      if (msg == RDY_OK) {
+        new (slot(ch_wridx)) T(std::forward<U>(v));
+        ch_wridx = next(ch_wridx);
+        chSysLock();
+        notifyI();
+        chSchRescheduleS();
+        chSysUnlock();
+      }
+      chMtxUnlock();
+#endif
+      return msg;
+    }
+
+    msg_t get(T &v, systime_t time) {
+      msg_t msg;
+
+      if (fast) {
+        chSysLock();
+        msg = chSemWaitTimeoutS(&ch_fullsem, time);
+        if (msg == RDY_OK) {
+          getS(v);
+          chSchRescheduleS();
+        }
+        chSysUnlock();
+        return msg;
+      }
+#if CH_USE_MUTEXES
+      chMtxLock(&ch_rdmtx);
+      msg = chSemWaitTimeout(&ch_fullsem, time);
+      if (msg == RDY_OK) {
+        T *p = slot(ch_rdidx);
+
+        v = std::move(*p);
+        p->~T();
+        ch_rdidx = next(ch_rdidx);
+        chSemSignal(&ch_emptysem);
+      }
+      chMtxUnlock();
+#endif
+      return msg;
+    }
+
+  public:
+    /**
+     * @brief   Channel constructor.
+     *
+     * @init
+     */
+    Channel(void) : ChannelBase(N), ch_wridx(0), ch_rdidx(0) {
+
+#if CH_USE_MUTEXES
+      chMtxInit(&ch_wrmtx);
+      chMtxInit(&ch_rdmtx);
+#endif
+    }
+
+    /**
+     * @brief   Channel destructor.
+     * @details The objects still in the channel are destroyed.
+     */
+    ~Channel() {
+
+      if (!fast) {
+        cnt_t n = chSemGetCounterI(&ch_fullsem);
+
+        while (n-- > 0) {
+          slot(ch_rdidx)->~T();
+          ch_rdidx = next(ch_rdidx);
+        }
+      }
+    }
+
+    Channel(const Channel &) = delete;
+    Channel &operator=(const Channel &) = delete;
+
+    /**
+     * @brief   Resets the channel.
+     * @details All the waiting threads are resumed with status
+     *          @p RDY_RESET and the queued objects are lost.
+     *
+     * @api
+     */
+    void reset(void) {
+
+      static_assert(fast, "reset() requires a fast channel type");
+      chSysLock();
+      ch_wridx = ch_rdidx = 0;
+      chSemResetI(&ch_emptysem, N);
+      chSemResetI(&ch_fullsem, 0);
+      chSchRescheduleS();
+      chSysUnlock();
+    }
+
+    /**
+     * @brief   Sends a copy of an object.
+     * @details The invoking thread waits until a empty slot becomes
+     *          available or the specified time runs out.
+     *
+     * @param[in] v             the object to be sent
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The operation status.
+     * @retval RDY_OK           if the object has been sent.
+     * @retval RDY_RESET        if the channel has been reset while waiting.
+     * @retval RDY_TIMEOUT      if the operation has timed out.
+     *
+     * @api
+     */
+    msg_t send(const T &v, systime_t time = TIME_INFINITE) {
+
+      return put(v, time);
+    }
+
+    /**
+     * @brief   Moves an object into the channel.
+     * @details The invoking thread waits until a empty slot becomes
+     *          available or the specified time runs out. The object is
+     *          left in a moved-from state only if it has been sent.
+     *
+     * @param[in] v             the object to be sent
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The operation status.
+     * @retval RDY_OK           if the object has been sent.
+     * @retval RDY_RESET        if the channel has been reset while waiting.
+     * @retval RDY_TIMEOUT      if the operation has timed out.
+     *
+     * @api
+     */
+    msg_t send(T &&v, systime_t time = TIME_INFINITE) {
+
+      return put(std::move(v), time);
+    }
+
+    /**
+     * @brief   Sends a copy of an object.
+     * @details The invoking thread waits until a empty slot becomes
+     *          available or the specified time runs out.
+     *
+     * @param[in] v             the object to be sent
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The operation status.
+     * @retval RDY_OK           if the object has been sent.
+     * @retval RDY_RESET        if the channel has been reset while waiting.
+     * @retval RDY_TIMEOUT      if the operation has timed out.
+     *
+     * @sclass
+     */
+    msg_t sendS(const T &v, systime_t time) {
+      msg_t msg;
+
+      static_assert(fast, "sendS() requires a fast channel type");
+      msg = chSemWaitTimeoutS(&ch_emptysem, time);
+      if (msg == RDY_OK) {
+        putS(v);
+        chSchRescheduleS();
+      }
+      return msg;
+    }
+
+    /**
+     * @brief   Sends a copy of an object.
+     * @details This variant is non-blocking, the function returns a timeout
+     *          condition if the channel is full.
+     *
+     * @param[in] v             the object to be sent
+     * @return                  The operation status.
+     * @retval RDY_OK           if the object has been sent.
+     * @retval RDY_TIMEOUT      if the channel is full.
+     *
+     * @iclass
+     */
+    msg_t sendI(const T &v) {
+
+      static_assert(fast, "sendI() requires a fast channel type");
+      if (chSemGetCounterI(&ch_emptysem) <= 0)
+        return RDY_TIMEOUT;
+      chSemFastWaitI(&ch_emptysem);
+      putS(v);
+      return RDY_OK;
+    }
+
+    /**
+     * @brief   Receives an object.
+     * @details The invoking thread waits until an object is available or
+     *          the specified time runs out.
+     *
+     * @param[out] v            the object receiving the value
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The operation status.
+     * @retval RDY_OK           if an object has been received.
+     * @retval RDY_RESET        if the channel has been reset while waiting.
+     * @retval RDY_TIMEOUT      if the operation has timed out.
+     *
+     * @api
+     */
+    msg_t receive(T &v, systime_t time = TIME_INFINITE) {
+
+      return get(v, time);
+    }
+
+    /**
+     * @brief   Receives an object.
+     * @details The invoking thread waits until an object is available or
+     *          the specified time runs out.
+     *
+     * @param[out] v            the object receiving the value
+     * @param[in] time          the number of ticks before the operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The operation status.
+     * @retval RDY_OK           if an object has been received.
+     * @retval RDY_RESET        if the channel has been reset while waiting.
+     * @retval RDY_TIMEOUT      if the operation has timed out.
+     *
+     * @sclass
+     */
+    msg_t receiveS(T &v, systime_t time) {
+      msg_t msg;
+
+      static_assert(fast, "receiveS() requires a fast channel type");
+      msg = chSemWaitTimeoutS(&ch_fullsem, time);
+      if (msg == RDY_OK) {
+        getS(v);
+        chSchRescheduleS();
+      }
+      return msg;
+    }
+
+    /**
+     * @brief   Receives an object.
+     * @details This variant is non-blocking, the function returns a timeout
+     *          condition if the channel is empty.
+     *
+     * @param[out] v            the object receiving the value
+     * @return                  The operation status.
+     * @retval RDY_OK           if an object has been received.
+     * @retval RDY_TIMEOUT      if the channel is empty.
+     *
+     * @iclass
+     */
+    msg_t receiveI(T &v) {
+
+      static_assert(fast, "receiveI() requires a fast channel type");
+      if (chSemGetCounterI(&ch_fullsem) <= 0)
+        return RDY_TIMEOUT;
+      chSemFastWaitI(&ch_fullsem);
+      getS(v);
+      return RDY_OK;
+    }
+
+    /**
+     * @brief   Sends copies of an array of objects.
+     * @details The invoking thread waits for each empty slot up to the
+     *          specified time. On the fast path the receivers are only
+     *          rescheduled when the sender blocks or at the end of the
+     *          batch.
+     *
+     * @param[in] p             pointer to the objects array
+     * @param[in] n             number of objects to be sent
+     * @param[in] time          the number of ticks before each operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The number of objects sent.
+     *
+     * @api
+     */
+    size_t sendBatch(const T *p, size_t n, systime_t time = TIME_INFINITE) {
+      size_t i;
+
+      if (fast) {
+        chSysLock();
+        for (i = 0; i < n; i++) {
+          if (chSemWaitTimeoutS(&ch_emptysem, time) != RDY_OK)
+            break;
+          putS(p[i]);
+        }
+        chSchRescheduleS();
+        chSysUnlock();
+        return i;
+      }
+      for (i = 0; i < n; i++)
+        if (put(p[i], time) != RDY_OK)
+          break;
+      return i;
+    }
+
+    /**
+     * @brief   Receives an array of objects.
+     * @details The invoking thread waits for each object up to the
+     *          specified time.
+     *
+     * @param[out] p            pointer to the objects array
+     * @param[in] n             number of objects to be received
+     * @param[in] time          the number of ticks before each operation
+     *                          timeouts, the following special values are
+     *                          allowed:
+     *                          - @a TIME_IMMEDIATE immediate timeout.
+     *                          - @a TIME_INFINITE no timeout.
+     *                          .
+     * @return                  The number of objects received.
+     *
+     * @api
+     */
+    size_t receiveBatch(T *p, size_t n, systime_t time = TIME_INFINITE) {
+      size_t i;
+
+      if (fast) {
+        chSysLock();
+        for (i = 0; i < n; i++) {
+          if (chSemWaitTimeoutS(&ch_fullsem, time) != RDY_OK)
+            break;
+          getS(p[i]);
+        }
+        chSchRescheduleS();
+        chSysUnlock();
+        return i;
+      }
+      for (i = 0; i < n; i++)
+        if (get(p[i], time) != RDY_OK)
+          break;
+      return i;
+    }
+  };
+#endif /* (__cplusplus >= 201103L) && CH_USE_SEMAPHORES */
+
 #if CH_USE_MEMPOOLS || defined(__DOXYGEN__)
   /*------------------------------------------------------------------------*
    * chibios_rt::MemoryPool                                                 *
@@ -2187,6 +2778,165 @@ namespace chibios_rt {
   };
 #endif /* CH_USE_MEMPOOLS */
 
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+  /*------------------------------------------------------------------------*
+   * chibios_rt::MemoryArena                                                *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Class encapsulating a memory arena.
+   */
+  class MemoryArena {
+  public:
+    /**
+     * @brief   Embedded @p ::MemoryArena structure.
+     */
+    ::MemoryArena arena;
+
+    /**
+     * @brief   MemoryArena constructor.
+     *
+     * @param[in] chunk     size of the chunks obtained from the provider
+     * @param[in] provider  I-class memory provider function or @p NULL for
+     *                      the core allocator
+     *
+     * @init
+     */
+    MemoryArena(size_t chunk, memgetfunc_t provider);
+
+    /**
+     * @brief   Allocates a memory block from the arena.
+     *
+     * @param[in] size      the size of the block to be allocated
+     * @return              A pointer to the allocated memory block.
+     * @retval NULL         if the provider is unable to return a new chunk.
+     *
+     * @api
+     */
+    void *alloc(size_t size);
+
+    /**
+     * @brief   Saves the current position of the arena.
+     *
+     * @param[out] mp       pointer to an @p ArenaMark structure
+     *
+     * @api
+     */
+    void getMark(ArenaMark *mp);
+
+    /**
+     * @brief   Releases all the blocks allocated after a mark.
+     *
+     * @param[in] mp        pointer to an @p ArenaMark structure
+     *
+     * @api
+     */
+    void release(const ArenaMark *mp);
+
+    /**
+     * @brief   Releases all the blocks allocated from the arena.
+     *
+     * @api
+     */
+    void reset(void);
+
+    /**
+     * @brief   Sets the arena as arena of the current thread.
+     *
+     * @return              The previous arena of the current thread.
+     *
+     * @api
+     */
+    ::MemoryArena *setSelf(void);
+  };
+
+#if (__cplusplus >= 201103L) || defined(__DOXYGEN__)
+  /*------------------------------------------------------------------------*
+   * chibios_rt::ArenaAllocator                                             *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Standard allocator serving memory from a memory arena.
+   * @details The deallocation is a no-operation, the memory is recovered
+   *          by releasing or resetting the arena, this makes the allocator
+   *          suitable for containers built and dropped in a scope.
+   *
+   * @tparam T          type of the allocated objects
+   */
+  template <typename T>
+  class ArenaAllocator {
+  public:
+    /**
+     * @brief   Type of the allocated objects.
+     */
+    typedef T value_type;
+
+    /**
+     * @brief   Arena serving the allocations.
+     */
+    MemoryArena *arena;
+
+    /**
+     * @brief   ArenaAllocator constructor.
+     *
+     * @param[in] a         the arena serving the allocations
+     */
+    ArenaAllocator(MemoryArena &a) : arena(&a) {
+    }
+
+    /**
+     * @brief   Rebinding constructor.
+     *
+     * @param[in] other     allocator of another type
+     */
+    template <typename U>
+    ArenaAllocator(const ArenaAllocator<U> &other) : arena(other.arena) {
+    }
+
+    /**
+     * @brief   Allocates an array of objects.
+     * @note    The allocation failure is fatal if the debug assertions are
+     *          enabled else @p NULL is returned.
+     *
+     * @param[in] n         number of objects
+     * @return              A pointer to the allocated memory.
+     */
+    T *allocate(size_t n) {
+      void *p = arena->alloc(n * sizeof (T));
+
+      chDbgAssert(p != NULL, "ArenaAllocator, #1", "arena exhausted");
+
+      return static_cast<T *>(p);
+    }
+
+    /**
+     * @brief   Deallocation, no operation.
+     */
+    void deallocate(T *p, size_t n) {
+
+      (void)p;
+      (void)n;
+    }
+
+    /**
+     * @brief   Allocators comparison.
+     */
+    template <typename U>
+    bool operator==(const ArenaAllocator<U> &other) const {
+
+      return arena == other.arena;
+    }
+
+    /**
+     * @brief   Allocators comparison.
+     */
+    template <typename U>
+    bool operator!=(const ArenaAllocator<U> &other) const {
+
+      return arena != other.arena;
+    }
+  };
+#endif /* __cplusplus >= 201103L */
+#endif /* CH_USE_MEMARENAS */
+
   /*------------------------------------------------------------------------*
    * chibios_rt::BaseSequentialStreamInterface                              *
    *------------------------------------------------------------------------*/
@@ -0,0 +1,207 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    coro.cpp
+ * @brief   C++20 coroutines executor code.
+ *
+ * @addtogroup cpp_library
+ * @{
+ */
+
+#include "coro.hpp"
+
+#if (__cplusplus >= 202002L) && CH_USE_HEAP && CH_USE_EVENTS
+
+namespace chibios_rt {
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::CoroutineExecutor                                          *
+   *------------------------------------------------------------------------*/
+  CoroutineExecutor::CoroutineExecutor(void) : carrier(NULL),
+                                               ready_head(NULL),
+                                               ready_tail(NULL),
+                                               parked(NULL),
+                                               pending(0),
+                                               free_events(ALL_EVENTS &
+                                                           ~CORO_READY_EVENT),
+                                               tasks(0) {
+  }
+
+  CoNode *CoroutineExecutor::dequeue(void) {
+    CoNode *np;
+
+    chSysLock();
+    np = ready_head;
+    if (np != NULL) {
+      ready_head = np->next;
+      if (ready_head == NULL)
+        ready_tail = NULL;
+    }
+    chSysUnlock();
+    return np;
+  }
+
+  /*
+   * Polls the parked nodes, the ready ones are moved in the ready queue.
+   * Returns true if any of the remaining nodes requires periodic polling.
+   */
+  bool CoroutineExecutor::pollParked(void) {
+    CoNode *np, **npp = &parked;
+    bool periodic = false;
+
+    while ((np = *npp) != NULL) {
+      if (np->poll(np)) {
+        *npp = np->next;
+        chSysLock();
+        scheduleI(np);
+        chSysUnlock();
+      }
+      else {
+        periodic = periodic || np->periodic;
+        npp = &np->next;
+      }
+    }
+    return periodic;
+  }
+
+  bool CoroutineExecutor::spawn(Task &&task) {
+    TaskHandle h = task.handle;
+
+    if (!h)
+      return false;
+    task.handle = nullptr;
+    h.promise().exec = this;
+    h.promise().node.handle = h;
+    h.promise().node.poll = NULL;
+    chSysLock();
+    tasks++;
+    scheduleI(&h.promise().node);
+    chSchRescheduleS();
+    chSysUnlock();
+    return true;
+  }
+
+  void CoroutineExecutor::scheduleI(CoNode *np) {
+
+    chDbgCheckClassI();
+
+    np->next = NULL;
+    if (ready_tail != NULL)
+      ready_tail->next = np;
+    else
+      ready_head = np;
+    ready_tail = np;
+    if (carrier != NULL)
+      chEvtSignalI(carrier, CORO_READY_EVENT);
+  }
+
+  void CoroutineExecutor::park(CoNode *np) {
+
+    chDbgAssert(chThdSelf() == carrier,
+                "CoroutineExecutor::park(), #1",
+                "not the carrier thread");
+
+    np->next = parked;
+    parked = np;
+  }
+
+  eventmask_t CoroutineExecutor::allocEvent(void) {
+    eventmask_t ev;
+
+    chSysLock();
+    ev = free_events & -free_events;
+    free_events &= ~ev;
+    chSysUnlock();
+
+    chDbgAssert(ev != 0,
+                "CoroutineExecutor::allocEvent(), #1",
+                "no free event flags");
+
+    return ev;
+  }
+
+  void CoroutineExecutor::freeEvent(eventmask_t ev) {
+
+    /* Discards a broadcast not yet collected by the carrier thread.*/
+    chEvtGetAndClearEvents(ev);
+    chSysLock();
+    free_events |= ev;
+    pending &= ~ev;
+    chSysUnlock();
+  }
+
+  bool CoroutineExecutor::takeEvents(eventmask_t ev) {
+    bool taken;
+
+    chSysLock();
+    taken = (pending & ev) != 0;
+    pending &= ~ev;
+    chSysUnlock();
+    return taken;
+  }
+
+  void CoroutineExecutor::taskExit(void) {
+
+    chSysLock();
+    tasks--;
+    chSysUnlock();
+  }
+
+  cnt_t CoroutineExecutor::getTaskCount(void) {
+    cnt_t n;
+
+    chSysLock();
+    n = tasks;
+    chSysUnlock();
+    return n;
+  }
+
+  void CoroutineExecutor::run(void) {
+    CoNode *np;
+    eventmask_t ev;
+    bool periodic;
+
+    chSysLock();
+    carrier = chThdSelf();
+    chSysUnlock();
+
+    while (true) {
+      /* Resumes the ready coroutines, a coroutine can make other
+         coroutines ready or park itself.*/
+      while ((np = dequeue()) != NULL)
+        np->handle.resume();
+
+      periodic = pollParked();
+      if (ready_head != NULL)
+        continue;
+
+      ev = chEvtWaitAnyTimeout(ALL_EVENTS,
+                               periodic ? CORO_POLL_INTERVAL : TIME_INFINITE);
+      chSysLock();
+      pending |= ev & ~CORO_READY_EVENT;
+      chSysUnlock();
+    }
+  }
+}
+
+#endif /* (__cplusplus >= 202002L) && CH_USE_HEAP && CH_USE_EVENTS */
+
+/** @} */
@@ -0,0 +1,599 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    coro.hpp
+ * @brief   C++20 coroutines executor.
+ * @details Stackless tasks executed by a carrier thread. A suspended task
+ *          only uses its coroutine frame, allocated from the default heap,
+ *          instead of a whole thread working area.
+ *
+ * @addtogroup cpp_library
+ * @{
+ */
+
+#ifndef _CORO_HPP_
+#define _CORO_HPP_
+
+#include "ch.hpp"
+
+#if ((__cplusplus >= 202002L) && CH_USE_HEAP && CH_USE_EVENTS) ||           \
+    defined(__DOXYGEN__)
+
+#include <coroutine>
+
+/**
+ * @brief   Polling interval of the parked awaiters.
+ * @details Awaiters on kernel objects not able to notify the executor, like
+ *          semaphores, mailboxes and queues, and awaiters with a timeout
+ *          are polled by the carrier thread with this interval.
+ */
+#if !defined(CORO_POLL_INTERVAL) || defined(__DOXYGEN__)
+#define CORO_POLL_INTERVAL              1
+#endif
+
+/**
+ * @brief   Event flag used to wake up the carrier thread.
+ * @details The other event flags of the carrier thread are allocated to
+ *          the tasks waiting on event sources.
+ */
+#define CORO_READY_EVENT                EVENT_MASK(0)
+
+namespace chibios_rt {
+
+  class CoroutineExecutor;
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::CoNode                                                     *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Suspended coroutine descriptor.
+   * @details Nodes are embedded in the awaiters so they live in the frame
+   *          of the suspended coroutine, no memory is allocated in order to
+   *          suspend a task.
+   */
+  struct CoNode {
+    /**
+     * @brief   Next node in the executor lists.
+     */
+    CoNode                      *next;
+    /**
+     * @brief   Suspended coroutine.
+     */
+    std::coroutine_handle<>     handle;
+    /**
+     * @brief   Readiness check of a parked node.
+     * @details The function is invoked by the carrier thread and returns
+     *          @p true when the coroutine can be resumed.
+     */
+    bool                        (*poll)(CoNode *np);
+    /**
+     * @brief   The node must be polled periodically.
+     */
+    bool                        periodic;
+  };
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::Task                                                       *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Stackless task.
+   * @details Return type of the coroutines executed by a
+   *          @p CoroutineExecutor. The coroutine is created suspended and
+   *          starts when spawned, its frame is released when it returns.
+   */
+  class Task {
+  public:
+    /**
+     * @brief   Coroutine promise.
+     */
+    struct promise_type {
+      /**
+       * @brief   Executor of the task.
+       */
+      CoroutineExecutor         *exec;
+      /**
+       * @brief   Node used when spawning the task.
+       */
+      CoNode                    node;
+
+      Task get_return_object(void) {
+
+        return Task(std::coroutine_handle<promise_type>::from_promise(*this));
+      }
+
+      static Task get_return_object_on_allocation_failure(void) {
+
+        return Task();
+      }
+
+      std::suspend_always initial_suspend(void) noexcept {
+
+        return {};
+      }
+
+      std::suspend_never final_suspend(void) noexcept {
+
+        return {};
+      }
+
+      void return_void(void);
+
+      void unhandled_exception(void) {
+      }
+
+      static void *operator new(size_t size) noexcept {
+
+        return chHeapAlloc(NULL, size);
+      }
+
+      static void operator delete(void *p) {
+
+        chHeapFree(p);
+      }
+    };
+
+    Task(Task &&task) : handle(task.handle) {
+
+      task.handle = nullptr;
+    }
+
+    /**
+     * @brief   Task destructor.
+     * @details A task never spawned is destroyed.
+     */
+    ~Task() {
+
+      if (handle)
+        handle.destroy();
+    }
+
+    Task(const Task &) = delete;
+    Task &operator=(const Task &) = delete;
+
+  private:
+    friend class CoroutineExecutor;
+
+    std::coroutine_handle<promise_type> handle;
+
+    Task(void) : handle(nullptr) {
+    }
+
+    explicit Task(std::coroutine_handle<promise_type> h) : handle(h) {
+    }
+  };
+
+  /**
+   * @brief   Handle of a running task.
+   */
+  typedef std::coroutine_handle<Task::promise_type> TaskHandle;
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::CoroutineExecutor                                          *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Coroutines executor.
+   * @details The executor resumes its tasks from the @p run() function,
+   *          the tasks are always resumed by the same carrier thread.
+   *          Ready tasks are queued by the awaiters, from any context,
+   *          while the tasks waiting on kernel objects are parked and polled
+   *          by the carrier thread.
+   */
+  class CoroutineExecutor {
+  private:
+    ::Thread                    *carrier;
+    CoNode                      *ready_head;
+    CoNode                      *ready_tail;
+    CoNode                      *parked;
+    eventmask_t                 pending;
+    eventmask_t                 free_events;
+    cnt_t                       tasks;
+
+    CoNode *dequeue(void);
+    bool pollParked(void);
+
+  public:
+    /**
+     * @brief   CoroutineExecutor constructor.
+     *
+     * @init
+     */
+    CoroutineExecutor(void);
+
+    /**
+     * @brief   Starts a task.
+     * @details The task ownership is transferred to the executor.
+     *
+     * @param[in] task          the task to be started
+     * @return                  The operation status.
+     * @retval false            if the coroutine frame allocation failed.
+     *
+     * @api
+     */
+    bool spawn(Task &&task);
+
+    /**
+     * @brief   Makes a suspended coroutine ready.
+     *
+     * @param[in] np            the node of the suspended coroutine
+     *
+     * @iclass
+     */
+    void scheduleI(CoNode *np);
+
+    /**
+     * @brief   Parks a suspended coroutine.
+     * @note    Must be invoked by the carrier thread.
+     *
+     * @param[in] np            the node of the suspended coroutine
+     */
+    void park(CoNode *np);
+
+    /**
+     * @brief   Allocates an event flag of the carrier thread.
+     *
+     * @return                  The event flag.
+     *
+     * @api
+     */
+    eventmask_t allocEvent(void);
+
+    /**
+     * @brief   Releases an event flag of the carrier thread.
+     * @note    Must be invoked by the carrier thread.
+     *
+     * @param[in] ev            the event flag
+     */
+    void freeEvent(eventmask_t ev);
+
+    /**
+     * @brief   Consumes pending event flags.
+     *
+     * @param[in] ev            the event flags
+     * @return                  @p true if any of the flags was pending.
+     */
+    bool takeEvents(eventmask_t ev);
+
+    /**
+     * @brief   Called by the tasks on termination.
+     *
+     * @api
+     */
+    void taskExit(void);
+
+    /**
+     * @brief   Returns the number of running tasks.
+     *
+     * @return                  The number of tasks.
+     *
+     * @api
+     */
+    cnt_t getTaskCount(void);
+
+    /**
+     * @brief   Executor loop.
+     * @details The invoking thread becomes the carrier thread, the
+     *          function never returns.
+     *
+     * @api
+     */
+    void run(void);
+  };
+
+  inline void Task::promise_type::return_void(void) {
+
+    exec->taskExit();
+  }
+
+  /*------------------------------------------------------------------------*
+   * chibios_rt::Executor                                                   *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Executor with a static carrier thread.
+   *
+   * @param N               the working area size for the carrier thread
+   */
+  template <int N>
+  class Executor : public CoroutineExecutor, public BaseStaticThread<N> {
+  protected:
+    virtual msg_t main(void) {
+
+      BaseThread::setName("executor");
+      run();
+      return 0;
+    }
+  };
+
+  /*------------------------------------------------------------------------*
+   * Awaitables                                                             *
+   *------------------------------------------------------------------------*/
+  /**
+   * @brief   Awaiter yielding to the other ready tasks.
+   */
+  class CoYield : public CoNode {
+  public:
+    bool await_ready(void) {
+
+      return false;
+    }
+
+    void await_suspend(TaskHandle h) {
+
+      handle = h;
+      poll = NULL;
+      chSysLock();
+      h.promise().exec->scheduleI(this);
+      chSysUnlock();
+    }
+
+    void await_resume(void) {
+    }
+  };
+
+  /**
+   * @brief   Awaiter suspending the task for a time interval.
+   * @details The task is resumed from the callback of a virtual timer
+   *          embedded in the awaiter.
+   */
+  class CoSleep : public CoNode {
+  private:
+    ::VirtualTimer              vt;
+    CoroutineExecutor           *exec;
+    systime_t                   time;
+
+    static void wakeup(void *p) {
+      CoSleep *sp = static_cast<CoSleep *>(p);
+
+      chSysLockFromIsr();
+      sp->exec->scheduleI(sp);
+      chSysUnlockFromIsr();
+    }
+
+  public:
+    CoSleep(systime_t t) : time(t) {
+    }
+
+    bool await_ready(void) {
+
+      return time == TIME_IMMEDIATE;
+    }
+
+    void await_suspend(TaskHandle h) {
+
+      handle = h;
+      poll = NULL;
+      exec = h.promise().exec;
+      chSysLock();
+      chVTSetI(&vt, time, wakeup, this);
+      chSysUnlock();
+    }
+
+    void await_resume(void) {
+    }
+  };
+
+  /**
+   * @brief   Awaiter polling a non-blocking operation.
+   * @details The operation is a function object returning @p RDY_TIMEOUT
+   *          if it would block, any other value completes the wait.
+   *
+   * @param Op              type of the operation
+   */
+  template <typename Op>
+  class CoPoll : public CoNode {
+  private:
+    Op                          op;
+    systime_t                   start;
+    systime_t                   time;
+    msg_t                       result;
+
+    static bool pollfn(CoNode *np) {
+      CoPoll *pp = static_cast<CoPoll *>(np);
+
+      pp->result = pp->op();
+      return (pp->result != RDY_TIMEOUT) ||
+             ((pp->time != TIME_INFINITE) &&
+              ((systime_t)(chTimeNow() - pp->start) >= pp->time));
+    }
+
+  public:
+    CoPoll(const Op &o, systime_t t) : op(o), time(t) {
+    }
+
+    bool await_ready(void) {
+
+      result = op();
+      return (result != RDY_TIMEOUT) || (time == TIME_IMMEDIATE);
+    }
+
+    void await_suspend(TaskHandle h) {
+
+      handle = h;
+      poll = pollfn;
+      periodic = true;
+      start = chTimeNow();
+      h.promise().exec->park(this);
+    }
+
+    msg_t await_resume(void) {
+
+      return result;
+    }
+  };
+
+  /**
+   * @brief   Awaiter waiting on an event source.
+   * @details An event flag of the carrier thread is allocated for the
+   *          duration of the wait so the task is resumed without polling.
+   */
+  class CoEvent : public CoNode {
+  private:
+    EvtSource                   &src;
+    EvtListener                 el;
+    CoroutineExecutor           *exec;
+    eventmask_t                 ev;
+    systime_t                   start;
+    systime_t                   time;
+    flagsmask_t                 flags;
+
+    static bool pollfn(CoNode *np) {
+      CoEvent *ep = static_cast<CoEvent *>(np);
+
+      if (ep->exec->takeEvents(ep->ev))
+        ep->flags = ep->el.getAndClearFlags();
+      else if ((ep->time == TIME_INFINITE) ||
+               ((systime_t)(chTimeNow() - ep->start) < ep->time))
+        return false;
+      ep->src.unregister(&ep->el);
+      ep->exec->freeEvent(ep->ev);
+      return true;
+    }
+
+  public:
+    CoEvent(EvtSource &s, systime_t t) : src(s), time(t), flags(0) {
+    }
+
+    bool await_ready(void) {
+
+      return time == TIME_IMMEDIATE;
+    }
+
+    void await_suspend(TaskHandle h) {
+
+      handle = h;
+      poll = pollfn;
+      periodic = time != TIME_INFINITE;
+      exec = h.promise().exec;
+      ev = exec->allocEvent();
+      start = chTimeNow();
+      src.registerMask(&el, ev);
+      exec->park(this);
+    }
+
+    flagsmask_t await_resume(void) {
+
+      return flags;
+    }
+  };
+
+  /**
+   * @brief   Yields to the other ready tasks.
+   *
+   * @return                  The awaitable object.
+   */
+  inline CoYield coYield(void) {
+
+    return CoYield();
+  }
+
+  /**
+   * @brief   Suspends the task for a time interval.
+   *
+   * @param[in] time          the number of ticks
+   * @return                  The awaitable object.
+   */
+  inline CoSleep coSleep(systime_t time) {
+
+    return CoSleep(time);
+  }
+
+  /**
+   * @brief   Waits on a counter semaphore.
+   *
+   * @param[in] sem           the semaphore
+   * @param[in] time          the number of ticks before the operation
+   *                          timeouts
+   * @return                  The awaitable object, the result is the
+   *                          operation status as in @p chSemWaitTimeout().
+   */
+  inline auto coWait(CounterSemaphore &sem, systime_t time = TIME_INFINITE) {
+
+    return CoPoll([&sem]() { return sem.waitTimeout(TIME_IMMEDIATE); }, time);
+  }
+
+  /**
+   * @brief   Waits for a message from a mailbox.
+   *
+   * @param[in] mb            the mailbox
+   * @param[out] msgp         pointer to a message variable for the received
+   *                          message
+   * @param[in] time          the number of ticks before the operation
+   *                          timeouts
+   * @return                  The awaitable object, the result is the
+   *                          operation status as in @p chMBFetch().
+   */
+  inline auto coFetch(Mailbox &mb, msg_t *msgp,
+                      systime_t time = TIME_INFINITE) {
+
+    return CoPoll([&mb, msgp]() { return mb.fetch(msgp, TIME_IMMEDIATE); },
+                  time);
+  }
+
+  /**
+   * @brief   Waits for a byte from an input queue.
+   *
+   * @param[in] iq            the input queue
+   * @param[in] time          the number of ticks before the operation
+   *                          timeouts
+   * @return                  The awaitable object, the result is the byte
+   *                          or an error as in @p chIQGetTimeout().
+   */
+  inline auto coGet(InQueue &iq, systime_t time = TIME_INFINITE) {
+
+    return CoPoll([&iq]() { return iq.getTimeout(TIME_IMMEDIATE); }, time);
+  }
+
+  /**
+   * @brief   Waits for space in an output queue and writes a byte.
+   *
+   * @param[in] oq            the output queue
+   * @param[in] b             the byte to be written
+   * @param[in] time          the number of ticks before the operation
+   *                          timeouts
+   * @return                  The awaitable object, the result is the
+   *                          operation status as in @p chOQPutTimeout().
+   */
+  inline auto coPut(OutQueue &oq, uint8_t b, systime_t time = TIME_INFINITE) {
+
+    return CoPoll([&oq, b]() { return oq.putTimeout(b, TIME_IMMEDIATE); },
+                  time);
+  }
+
+  /**
+   * @brief   Waits for a broadcast on an event source.
+   * @note    Each executor can serve up to 31 event waits at the same time.
+   *
+   * @param[in] src           the event source
+   * @param[in] time          the number of ticks before the operation
+   *                          timeouts
+   * @return                  The awaitable object, the result is the flags
+   *                          added by the broadcast, zero on timeout.
+   */
+  inline CoEvent coWaitEvent(EvtSource &src, systime_t time = TIME_INFINITE) {
+
+    return CoEvent(src, time);
+  }
+}
+
+#endif /* (__cplusplus >= 202002L) && CH_USE_HEAP && CH_USE_EVENTS */
+
+#endif /* _CORO_HPP_ */
+
+/** @} */
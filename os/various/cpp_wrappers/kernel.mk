@@ -1,4 +1,5 @@
 # C++ wrapper files.
-CHCPPSRC = ${CHIBIOS}/os/various/cpp_wrappers/ch.cpp
+CHCPPSRC = ${CHIBIOS}/os/various/cpp_wrappers/ch.cpp \
+           ${CHIBIOS}/os/various/cpp_wrappers/coro.cpp
 
 CHCPPINC = ${CHIBIOS}/os/various/cpp_wrappers
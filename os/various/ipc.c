@@ -0,0 +1,359 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    ipc.c
+ * @brief   IPC servers code.
+ *
+ * @addtogroup ipc
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "ipc.h"
+
+#if HAL_IMPLEMENTS_COUNTERS
+#define ipc_now() halGetCounterValue()
+#else
+#define ipc_now() chTimeNow()
+#endif
+
+/*
+ * Initializes a buffers pool and loads the buffers area into it.
+ */
+static void pool_init(IpcPool *ipp, size_t size, void *p, size_t n) {
+
+  chPoolInit(&ipp->pool, IPC_BUFFER_SIZE(size), NULL);
+  if (n > 0)
+    chPoolLoadArray(&ipp->pool, p, n);
+  chSemInit(&ipp->sem, (cnt_t)n);
+  ipp->size = size;
+}
+
+/*
+ * Takes a buffer from a pool, waiting for one to be returned if the pool
+ * is empty.
+ */
+static IpcBuffer *pool_alloc(IpcServer *isp, IpcPool *ipp, systime_t time) {
+  IpcBuffer *bp;
+
+  chSysLock();
+  if (chSemWaitTimeoutS(&ipp->sem, time) != RDY_OK) {
+#if IPC_USE_STATS
+    isp->stats.starved++;
+#else
+    (void)isp;
+#endif
+    chSysUnlock();
+    return NULL;
+  }
+  bp = chPoolAllocI(&ipp->pool);
+  chSysUnlock();
+  bp->next   = NULL;
+  bp->pool   = ipp;
+  bp->sender = NULL;
+  bp->type   = 0;
+  bp->size   = 0;
+  bp->status = RDY_OK;
+  return bp;
+}
+
+/**
+ * @brief   Initializes an IPC server object.
+ * @details The request and reply buffers areas are loaded into the server
+ *          pools, the buffers are owned by the server until allocated.
+ *
+ * @param[out] isp      pointer to the @p IpcServer object
+ * @param[in] cfg       pointer to the @p IpcConfig object
+ *
+ * @init
+ */
+void ipcObjectInit(IpcServer *isp, const IpcConfig *cfg) {
+
+  chDbgCheck((isp != NULL) && (cfg != NULL) &&
+             ((cfg->req_n == 0) || (cfg->req_buffers != NULL)) &&
+             ((cfg->rpl_n == 0) || (cfg->rpl_buffers != NULL)),
+             "ipcObjectInit");
+
+  isp->config = cfg;
+  pool_init(&isp->reqpool, cfg->req_size, cfg->req_buffers, cfg->req_n);
+  pool_init(&isp->rplpool, cfg->rpl_size, cfg->rpl_buffers, cfg->rpl_n);
+  isp->head = isp->tail = NULL;
+  chSemInit(&isp->pending, 0);
+#if IPC_USE_STATS
+  memset(&isp->stats, 0, sizeof (IpcStats));
+#endif
+}
+
+/**
+ * @brief   Allocates a request buffer.
+ * @details The buffer is taken from the server request pool, if the pool
+ *          is empty the function waits for a buffer to be returned.
+ * @post    The caller owns the buffer until it is passed to @p ipcCall()
+ *          or returned using @p ipcFree().
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ * @param[in] time      the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              A pointer to the buffer header.
+ * @retval NULL         if the operation timed out.
+ *
+ * @api
+ */
+IpcBuffer *ipcAllocRequest(IpcServer *isp, systime_t time) {
+
+  chDbgCheck(isp != NULL, "ipcAllocRequest");
+
+  return pool_alloc(isp, &isp->reqpool, time);
+}
+
+/**
+ * @brief   Allocates a reply buffer.
+ * @details The buffer is taken from the server reply pool, if the pool
+ *          is empty the function waits for a buffer to be returned.
+ * @post    The caller owns the buffer until it is passed to @p ipcReply()
+ *          or returned using @p ipcFree().
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ * @param[in] time      the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              A pointer to the buffer header.
+ * @retval NULL         if the operation timed out.
+ *
+ * @api
+ */
+IpcBuffer *ipcAllocReply(IpcServer *isp, systime_t time) {
+
+  chDbgCheck(isp != NULL, "ipcAllocReply");
+
+  return pool_alloc(isp, &isp->rplpool, time);
+}
+
+/**
+ * @brief   Returns a buffer to the pool it belongs to.
+ *
+ * @param[in] bp        pointer to the @p IpcBuffer
+ *
+ * @iclass
+ */
+void ipcFreeI(IpcBuffer *bp) {
+
+  chDbgCheckClassI();
+  chDbgCheck(bp != NULL, "ipcFreeI");
+  chDbgAssert(bp->sender == NULL, "ipcFreeI(), #1", "buffer in use");
+
+  chPoolFreeI(&bp->pool->pool, bp);
+  chSemSignalI(&bp->pool->sem);
+}
+
+/**
+ * @brief   Returns a buffer to the pool it belongs to.
+ *
+ * @param[in] bp        pointer to the @p IpcBuffer
+ *
+ * @api
+ */
+void ipcFree(IpcBuffer *bp) {
+
+  chSysLock();
+  ipcFreeI(bp);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Sends a request and waits for the reply.
+ * @details The request is queued in the server in arrival or priority order
+ *          depending on the server configuration, then the caller is
+ *          suspended until a serving thread invokes @p ipcReply().
+ * @post    The request buffer is owned by the server, the returned reply
+ *          buffer is owned by the caller and must be returned using
+ *          @p ipcFree().
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ * @param[in] bp        pointer to the request buffer
+ * @return              The reply buffer, it can be the request buffer
+ *                      itself if the server answered in place.
+ * @retval NULL         if the server replied without a buffer.
+ *
+ * @api
+ */
+IpcBuffer *ipcCall(IpcServer *isp, IpcBuffer *bp) {
+  Thread *ctp = currp;
+  IpcBuffer *qp;
+
+  chDbgCheck((isp != NULL) && (bp != NULL), "ipcCall");
+
+  chSysLock();
+  chDbgAssert(bp->sender == NULL, "ipcCall(), #1", "buffer in use");
+
+  bp->sender = ctp;
+#if IPC_USE_STATS
+  bp->sent = ipc_now();
+  if (++isp->stats.queued > isp->stats.queued_peak)
+    isp->stats.queued_peak = isp->stats.queued;
+#endif
+  if ((isp->config->order == IPC_ORDER_FIFO) || (isp->head == NULL) ||
+      (isp->tail->sender->p_prio >= ctp->p_prio)) {
+    /* Insertion on tail.*/
+    bp->next = NULL;
+    if (isp->head == NULL)
+      isp->head = bp;
+    else
+      isp->tail->next = bp;
+    isp->tail = bp;
+  }
+  else if (isp->head->sender->p_prio < ctp->p_prio) {
+    /* Insertion on head.*/
+    bp->next = isp->head;
+    isp->head = bp;
+  }
+  else {
+    /* Insertion after the last request with greater or equal priority.*/
+    qp = isp->head;
+    while (qp->next->sender->p_prio >= ctp->p_prio)
+      qp = qp->next;
+    bp->next = qp->next;
+    qp->next = bp;
+  }
+  chSemSignalI(&isp->pending);
+  chSchGoSleepS(THD_STATE_SUSPENDED);
+  bp = (IpcBuffer *)ctp->p_u.rdymsg;
+  chSysUnlock();
+  return bp;
+}
+
+/**
+ * @brief   Waits for a request.
+ * @details More threads can serve the same server, each request is
+ *          received by a single thread.
+ * @post    The serving thread owns the request buffer until it is passed
+ *          to @p ipcReply().
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ * @param[in] time      the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              A pointer to the request buffer.
+ * @retval NULL         if the operation timed out.
+ *
+ * @api
+ */
+IpcBuffer *ipcReceive(IpcServer *isp, systime_t time) {
+  IpcBuffer *bp;
+
+  chDbgCheck(isp != NULL, "ipcReceive");
+
+  chSysLock();
+  if (chSemWaitTimeoutS(&isp->pending, time) != RDY_OK) {
+    chSysUnlock();
+    return NULL;
+  }
+  bp = isp->head;
+  if ((isp->head = bp->next) == NULL)
+    isp->tail = NULL;
+#if IPC_USE_STATS
+  bp->received = ipc_now();
+  if (bp->received - bp->sent > isp->stats.wait_worst)
+    isp->stats.wait_worst = bp->received - bp->sent;
+  isp->stats.queued--;
+#endif
+  chSysUnlock();
+  return bp;
+}
+
+/**
+ * @brief   Replies to a request.
+ * @details The client is resumed and receives the reply buffer. If the
+ *          reply buffer is not the request buffer then the request buffer
+ *          is returned to its pool.
+ * @pre     The request must have been obtained using @p ipcReceive().
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ * @param[in] req       pointer to the request buffer
+ * @param[in] rpl       pointer to the reply buffer, the request buffer
+ *                      itself or @p NULL
+ *
+ * @api
+ */
+void ipcReply(IpcServer *isp, IpcBuffer *req, IpcBuffer *rpl) {
+  Thread *tp;
+
+  chDbgCheck((isp != NULL) && (req != NULL), "ipcReply");
+
+  chSysLock();
+  tp = req->sender;
+  chDbgAssert((tp != NULL) && (tp->p_state == THD_STATE_SUSPENDED),
+              "ipcReply(), #1", "not a pending request");
+
+  req->sender = NULL;
+#if IPC_USE_STATS
+  {
+    ipctime_t now = ipc_now();
+
+    if (now - req->received > isp->stats.service_worst)
+      isp->stats.service_worst = now - req->received;
+    isp->stats.latency_last = now - req->sent;
+    if (isp->stats.latency_last > isp->stats.latency_worst)
+      isp->stats.latency_worst = isp->stats.latency_last;
+    isp->stats.latency_cumulative += isp->stats.latency_last;
+    isp->stats.requests++;
+  }
+#else
+  (void)isp;
+#endif
+  if (rpl != req)
+    ipcFreeI(req);
+  chSchWakeupS(tp, (msg_t)rpl);
+  chSysUnlock();
+}
+
+#if IPC_USE_STATS || defined(__DOXYGEN__)
+/**
+ * @brief   Resets the server statistics.
+ * @note    The number of currently queued requests is preserved.
+ *
+ * @param[in] isp       pointer to the @p IpcServer object
+ *
+ * @api
+ */
+void ipcResetStats(IpcServer *isp) {
+  uint32_t queued;
+
+  chSysLock();
+  queued = isp->stats.queued;
+  memset(&isp->stats, 0, sizeof (IpcStats));
+  isp->stats.queued = queued;
+  chSysUnlock();
+}
+#endif /* IPC_USE_STATS */
+
+/** @} */
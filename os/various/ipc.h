@@ -0,0 +1,315 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    ipc.h
+ * @brief   IPC servers structures and macros.
+ *
+ * @addtogroup ipc
+ * @{
+ */
+
+#ifndef _IPC_H_
+#define _IPC_H_
+
+/**
+ * @brief   Servers latency statistics.
+ */
+#if !defined(IPC_USE_STATS) || defined(__DOXYGEN__)
+#define IPC_USE_STATS               TRUE
+#endif
+
+/*
+ * Module dependencies check.
+ */
+#if !CH_USE_SEMAPHORES || !CH_USE_MEMPOOLS
+#error "the IPC servers require CH_USE_SEMAPHORES and CH_USE_MEMPOOLS"
+#endif
+
+/**
+ * @name    Requests queue ordering
+ * @{
+ */
+#define IPC_ORDER_FIFO              0   /**< @brief Arrival order.          */
+#define IPC_ORDER_PRIO              1   /**< @brief Sender priority order.  */
+/** @} */
+
+/**
+ * @brief   Type of an IPC server.
+ */
+typedef struct IpcServer IpcServer;
+
+/**
+ * @brief   Type of an IPC buffer header.
+ */
+typedef struct IpcBuffer IpcBuffer;
+
+/**
+ * @brief   Type of the time measurements.
+ */
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+typedef halrtcnt_t ipctime_t;
+#else
+typedef systime_t ipctime_t;
+#endif
+
+/**
+ * @brief   Pool of IPC buffers.
+ */
+typedef struct {
+  /**
+   * @brief Memory pool of the buffers.
+   */
+  MemoryPool            pool;
+  /**
+   * @brief Counter of the free buffers.
+   */
+  Semaphore             sem;
+  /**
+   * @brief Payload capacity of the buffers.
+   */
+  size_t                size;
+} IpcPool;
+
+/**
+ * @brief   Header of an IPC buffer.
+ * @details The header is followed by the payload, use @p ipcPayload() in
+ *          order to access it.
+ */
+struct IpcBuffer {
+  /**
+   * @brief Next buffer in the server requests queue.
+   */
+  IpcBuffer             *next;
+  /**
+   * @brief Pool owning the buffer.
+   */
+  IpcPool               *pool;
+  /**
+   * @brief Client thread waiting for the reply.
+   */
+  Thread                *sender;
+  /**
+   * @brief Message type, application defined.
+   */
+  uint32_t              type;
+  /**
+   * @brief Payload bytes in use, application defined.
+   */
+  size_t                size;
+  /**
+   * @brief Reply status, application defined.
+   */
+  msg_t                 status;
+#if IPC_USE_STATS || defined(__DOXYGEN__)
+  /**
+   * @brief Time of the request.
+   */
+  ipctime_t             sent;
+  /**
+   * @brief Time of the reception by the server.
+   */
+  ipctime_t             received;
+#endif
+};
+
+/**
+ * @brief   IPC server configuration.
+ */
+typedef struct {
+  /**
+   * @brief Payload capacity of the request buffers.
+   */
+  size_t                req_size;
+  /**
+   * @brief Request buffers area, see @p IPC_BUFFERS_DECL().
+   */
+  void                  *req_buffers;
+  /**
+   * @brief Number of request buffers.
+   */
+  size_t                req_n;
+  /**
+   * @brief Payload capacity of the reply buffers.
+   */
+  size_t                rpl_size;
+  /**
+   * @brief Reply buffers area, see @p IPC_BUFFERS_DECL().
+   * @note  Can be @p NULL if the server always replies using the request
+   *        buffer or without a buffer.
+   */
+  void                  *rpl_buffers;
+  /**
+   * @brief Number of reply buffers.
+   */
+  size_t                rpl_n;
+  /**
+   * @brief Requests queue ordering, @p IPC_ORDER_FIFO or
+   *        @p IPC_ORDER_PRIO.
+   */
+  uint8_t               order;
+} IpcConfig;
+
+#if IPC_USE_STATS || defined(__DOXYGEN__)
+/**
+ * @brief   Server statistics.
+ * @note    Times are in realtime counter cycles if the HAL implements the
+ *          counters else in system ticks.
+ */
+typedef struct {
+  /**
+   * @brief Number of completed requests.
+   */
+  uint32_t              requests;
+  /**
+   * @brief Number of failed buffer allocations.
+   */
+  uint32_t              starved;
+  /**
+   * @brief Requests currently queued.
+   */
+  uint32_t              queued;
+  /**
+   * @brief Maximum number of queued requests.
+   */
+  uint32_t              queued_peak;
+  /**
+   * @brief Worst time spent by a request in queue.
+   */
+  ipctime_t             wait_worst;
+  /**
+   * @brief Worst time from reception to reply.
+   */
+  ipctime_t             service_worst;
+  /**
+   * @brief Last request to reply latency.
+   */
+  ipctime_t             latency_last;
+  /**
+   * @brief Worst request to reply latency.
+   */
+  ipctime_t             latency_worst;
+  /**
+   * @brief Cumulative request to reply latency.
+   */
+  uint64_t              latency_cumulative;
+} IpcStats;
+#endif
+
+/**
+ * @brief   Structure representing an IPC server.
+ */
+struct IpcServer {
+  /**
+   * @brief Current configuration.
+   */
+  const IpcConfig       *config;
+  /**
+   * @brief Request buffers.
+   */
+  IpcPool               reqpool;
+  /**
+   * @brief Reply buffers.
+   */
+  IpcPool               rplpool;
+  /**
+   * @brief First queued request.
+   */
+  IpcBuffer             *head;
+  /**
+   * @brief Last queued request.
+   */
+  IpcBuffer             *tail;
+  /**
+   * @brief Counter of the queued requests, the serving threads wait on it.
+   */
+  Semaphore             pending;
+#if IPC_USE_STATS || defined(__DOXYGEN__)
+  /**
+   * @brief Latency statistics.
+   */
+  IpcStats              stats;
+#endif
+};
+
+/**
+ * @brief   Size of the buffers header.
+ */
+#define IPC_HEADER_SIZE             MEM_ALIGN_NEXT(sizeof (IpcBuffer))
+
+/**
+ * @brief   Size of a buffer with the specified payload capacity.
+ *
+ * @param[in] size      payload capacity
+ */
+#define IPC_BUFFER_SIZE(size)       (IPC_HEADER_SIZE + MEM_ALIGN_NEXT(size))
+
+/**
+ * @brief   Static buffers area initializer.
+ *
+ * @param[in] name      name of the buffers area
+ * @param[in] n         number of buffers
+ * @param[in] size      payload capacity of each buffer
+ */
+#define IPC_BUFFERS_DECL(name, n, size)                                     \
+  stkalign_t name[((n) * IPC_BUFFER_SIZE(size)) / sizeof (stkalign_t)]
+
+/**
+ * @name    Macro Functions
+ * @{
+ */
+/**
+ * @brief   Returns a pointer to the payload of a buffer.
+ *
+ * @param[in] bp        pointer to the @p IpcBuffer
+ * @return              A pointer to the payload.
+ */
+#define ipcPayload(bp) ((void *)((uint8_t *)(bp) + IPC_HEADER_SIZE))
+
+/**
+ * @brief   Returns the payload capacity of a buffer.
+ *
+ * @param[in] bp        pointer to the @p IpcBuffer
+ * @return              The payload capacity in bytes.
+ */
+#define ipcGetCapacity(bp) ((bp)->pool->size)
+/** @} */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void ipcObjectInit(IpcServer *isp, const IpcConfig *cfg);
+  IpcBuffer *ipcAllocRequest(IpcServer *isp, systime_t time);
+  IpcBuffer *ipcAllocReply(IpcServer *isp, systime_t time);
+  void ipcFreeI(IpcBuffer *bp);
+  void ipcFree(IpcBuffer *bp);
+  IpcBuffer *ipcCall(IpcServer *isp, IpcBuffer *bp);
+  IpcBuffer *ipcReceive(IpcServer *isp, systime_t time);
+  void ipcReply(IpcServer *isp, IpcBuffer *req, IpcBuffer *rpl);
+#if IPC_USE_STATS
+  void ipcResetStats(IpcServer *isp);
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _IPC_H_ */
+
+/** @} */
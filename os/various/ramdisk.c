@@ -0,0 +1,151 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    ramdisk.c
+ * @brief   RAM disk code.
+ *
+ * @addtogroup ram_disk
+ * @{
+ */
+
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "ramdisk.h"
+
+/*===========================================================================*/
+/* Driver local definitions.                                                 */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver exported variables.                                                */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local variables.                                                   */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver local functions.                                                   */
+/*===========================================================================*/
+
+static bool_t rd_is_inserted(void *instance) {
+
+  (void)instance;
+  return TRUE;
+}
+
+static bool_t rd_is_protected(void *instance) {
+
+  return ((RamDisk *)instance)->read_only;
+}
+
+static bool_t rd_connect(void *instance) {
+
+  (void)instance;
+  return CH_SUCCESS;
+}
+
+static bool_t rd_disconnect(void *instance) {
+
+  (void)instance;
+  return CH_SUCCESS;
+}
+
+static bool_t rd_read(void *instance, uint32_t startblk,
+                      uint8_t *buffer, uint32_t n) {
+  RamDisk *rdp = instance;
+
+  if ((startblk >= rdp->blk_num) || (n > rdp->blk_num - startblk))
+    return CH_FAILED;
+  rdp->state = BLK_READING;
+  memcpy(buffer, rdp->storage + startblk * RAMDISK_BLOCK_SIZE,
+         n * RAMDISK_BLOCK_SIZE);
+  rdp->state = BLK_READY;
+  return CH_SUCCESS;
+}
+
+static bool_t rd_write(void *instance, uint32_t startblk,
+                       const uint8_t *buffer, uint32_t n) {
+  RamDisk *rdp = instance;
+
+  if (rdp->read_only ||
+      (startblk >= rdp->blk_num) || (n > rdp->blk_num - startblk))
+    return CH_FAILED;
+  rdp->state = BLK_WRITING;
+  memcpy(rdp->storage + startblk * RAMDISK_BLOCK_SIZE, buffer,
+         n * RAMDISK_BLOCK_SIZE);
+  rdp->state = BLK_READY;
+  return CH_SUCCESS;
+}
+
+static bool_t rd_sync(void *instance) {
+
+  (void)instance;
+  return CH_SUCCESS;
+}
+
+static bool_t rd_get_info(void *instance, BlockDeviceInfo *bdip) {
+  RamDisk *rdp = instance;
+
+  bdip->blk_size = RAMDISK_BLOCK_SIZE;
+  bdip->blk_num  = rdp->blk_num;
+  return CH_SUCCESS;
+}
+
+static const struct RamDiskVMT vmt = {
+  rd_is_inserted,
+  rd_is_protected,
+  rd_connect,
+  rd_disconnect,
+  rd_read,
+  rd_write,
+  rd_sync,
+  rd_get_info
+};
+
+/*===========================================================================*/
+/* Driver exported functions.                                                */
+/*===========================================================================*/
+
+/**
+ * @brief   RAM disk object initialization.
+ * @post    The disk is in the @p BLK_READY state.
+ *
+ * @param[out] rdp      pointer to the @p RamDisk object to be initialized
+ * @param[in] storage   pointer to the disk storage, it must be at least
+ *                      @p RAMDISK_STORAGE_SIZE(blk_num) bytes large
+ * @param[in] blk_num   size of the disk in blocks
+ * @param[in] read_only the disk is write protected, ROM contents can be
+ *                      used as storage in this case
+ */
+void rdObjectInit(RamDisk *rdp, uint8_t *storage, uint32_t blk_num,
+                  bool_t read_only) {
+
+  rdp->vmt       = &vmt;
+  rdp->state     = BLK_READY;
+  rdp->storage   = storage;
+  rdp->blk_num   = blk_num;
+  rdp->read_only = read_only;
+}
+
+/** @} */
@@ -0,0 +1,109 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    ramdisk.h
+ * @brief   RAM disk structures and macros.
+ *
+ * @addtogroup ram_disk
+ * @{
+ */
+
+#ifndef _RAMDISK_H_
+#define _RAMDISK_H_
+
+/*===========================================================================*/
+/* Driver constants.                                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   RAM disk block size.
+ */
+#define RAMDISK_BLOCK_SIZE      512
+
+/*===========================================================================*/
+/* Driver pre-compile time settings.                                         */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Derived constants and error checks.                                       */
+/*===========================================================================*/
+
+/*===========================================================================*/
+/* Driver data structures and types.                                         */
+/*===========================================================================*/
+
+/**
+ * @brief   @p RamDisk specific data.
+ */
+#define _ram_disk_data                                                      \
+  _base_block_device_data                                                   \
+  /* Pointer to the disk storage.*/                                         \
+  uint8_t               *storage;                                           \
+  /* Size of the disk in blocks.*/                                          \
+  uint32_t              blk_num;                                            \
+  /* Write protection flag.*/                                               \
+  bool_t                read_only;
+
+/**
+ * @brief   @p RamDisk virtual methods table.
+ */
+struct RamDiskVMT {
+  _base_block_device_methods
+};
+
+/**
+ * @extends BaseBlockDevice
+ *
+ * @brief   RAM disk object.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct RamDiskVMT *vmt;
+  _ram_disk_data
+} RamDisk;
+
+/*===========================================================================*/
+/* Driver macros.                                                            */
+/*===========================================================================*/
+
+/**
+ * @brief   Size of the storage area required by a RAM disk.
+ *
+ * @param[in] n         number of blocks
+ */
+#define RAMDISK_STORAGE_SIZE(n) ((size_t)(n) * RAMDISK_BLOCK_SIZE)
+
+/*===========================================================================*/
+/* External declarations.                                                    */
+/*===========================================================================*/
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void rdObjectInit(RamDisk *rdp, uint8_t *storage, uint32_t blk_num,
+                    bool_t read_only);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _RAMDISK_H_ */
+
+/** @} */
@@ -0,0 +1,422 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    reactor.c
+ * @brief   Events reactor code.
+ *
+ * @addtogroup reactor
+ * @{
+ */
+
+#include "ch.h"
+#include "hal.h"
+#include "reactor.h"
+
+/*
+ * Count trailing zeros, the argument must not be zero.
+ */
+#if defined(__GNUC__)
+#define ctz(x) ((unsigned)__builtin_ctz(x))
+#else
+static unsigned ctz(uint32_t x) {
+  unsigned n = 0;
+
+  while ((x & 1) == 0)
+    x >>= 1, n++;
+  return n;
+}
+#endif
+
+#if HAL_IMPLEMENTS_COUNTERS
+#define reactor_now() halGetCounterValue()
+#else
+#define reactor_now() chTimeNow()
+#endif
+
+/*
+ * Marks a source as pending, the reactor thread is not signaled.
+ */
+static void pend(ReactorSource *rsp) {
+  Reactor *rp = rsp->reactor;
+
+  rp->pending[rsp->prio] |= (uint32_t)1 << rsp->slot;
+  rp->levels |= (uint32_t)1 << rsp->prio;
+}
+
+static void timer_cb(void *p) {
+  ReactorSource *rsp = p;
+
+  chSysLockFromIsr();
+  if (rsp->period > 0)
+    chVTSetI(&rsp->vt, rsp->period, timer_cb, rsp);
+  reactorSignalI(rsp, 0);
+  chSysUnlockFromIsr();
+}
+
+/*
+ * Allocates a position in a priority level.
+ */
+static bool_t source_bind(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                          rhandler_t handler, void *arg, uint8_t type) {
+  uint32_t free;
+
+  chDbgCheck((rp != NULL) && (rsp != NULL) && (handler != NULL) &&
+             (prio < REACTOR_PRIORITIES), "reactorBind");
+
+  chSysLock();
+  free = ~rp->used[prio];
+  if (free == 0) {
+    chSysUnlock();
+    return CH_FAILED;
+  }
+  rsp->reactor = rp;
+  rsp->handler = handler;
+  rsp->arg = arg;
+  rsp->type = type;
+  rsp->prio = (uint8_t)prio;
+  rsp->slot = (uint8_t)ctz(free);
+  rsp->flags = 0;
+  rsp->esp = NULL;
+  rsp->period = 0;
+  rp->used[prio] |= (uint32_t)1 << rsp->slot;
+  rp->sources[prio][rsp->slot] = rsp;
+  chSysUnlock();
+#if REACTOR_USE_STATS
+  reactorResetStats(rsp);
+#endif
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Initializes a reactor.
+ * @details The invoking thread becomes the thread running the reactor.
+ *
+ * @param[out] rp       pointer to the @p Reactor object
+ *
+ * @init
+ */
+void reactorInit(Reactor *rp) {
+  unsigned i;
+
+  chDbgCheck(rp != NULL, "reactorInit");
+
+  rp->thread = chThdSelf();
+  rp->levels = 0;
+  for (i = 0; i < REACTOR_PRIORITIES; i++) {
+    rp->pending[i] = 0;
+    rp->used[i] = 0;
+  }
+  for (i = 0; i < REACTOR_EVENT_BITS - 1; i++)
+    rp->events[i] = NULL;
+}
+
+/**
+ * @brief   Binds a software signaled source.
+ * @details The handler is invoked after the source is signaled using
+ *          @p reactorSignal() or @p reactorSignalI().
+ *
+ * @param[in] rp        pointer to the @p Reactor object
+ * @param[out] rsp      pointer to the @p ReactorSource object
+ * @param[in] prio      handler priority level, zero is the highest
+ * @param[in] handler   handler function
+ * @param[in] arg       handler argument
+ * @return              The operation status.
+ * @retval CH_SUCCESS   if the source has been bound.
+ * @retval CH_FAILED    if the priority level is full.
+ *
+ * @api
+ */
+bool_t reactorBind(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                   rhandler_t handler, void *arg) {
+
+  return source_bind(rp, rsp, prio, handler, arg, REACTOR_SOURCE_SIGNAL);
+}
+
+/**
+ * @brief   Binds an event source.
+ * @details The handler is invoked after each broadcast on the event
+ *          source, the broadcasted flags are passed to the handler.
+ * @note    Each event source uses one event flag of the reactor thread so
+ *          up to @p REACTOR_EVENT_BITS - 1 event sources can be bound.
+ * @note    Must be invoked by the thread running the reactor.
+ *
+ * @param[in] rp        pointer to the @p Reactor object
+ * @param[out] rsp      pointer to the @p ReactorSource object
+ * @param[in] prio      handler priority level, zero is the highest
+ * @param[in] handler   handler function
+ * @param[in] arg       handler argument
+ * @param[in] esp       the event source
+ * @return              The operation status.
+ * @retval CH_SUCCESS   if the source has been bound.
+ * @retval CH_FAILED    if the priority level is full or there are no free
+ *                      event flags.
+ *
+ * @api
+ */
+bool_t reactorBindEvent(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                        rhandler_t handler, void *arg, EventSource *esp) {
+  unsigned eid;
+
+  chDbgCheck(esp != NULL, "reactorBindEvent");
+  chDbgAssert(chThdSelf() == rp->thread,
+              "reactorBindEvent(), #1",
+              "not the reactor thread");
+
+  for (eid = 0; eid < REACTOR_EVENT_BITS - 1; eid++)
+    if (rp->events[eid] == NULL)
+      break;
+  if ((eid >= REACTOR_EVENT_BITS - 1) ||
+      source_bind(rp, rsp, prio, handler, arg, REACTOR_SOURCE_EVENT))
+    return CH_FAILED;
+  rsp->esp = esp;
+  rp->events[eid] = rsp;
+  chEvtRegister(esp, &rsp->el, eid);
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Binds a virtual timer.
+ * @details A virtual timer embedded in the source is started, the handler
+ *          is invoked after each expiration.
+ *
+ * @param[in] rp        pointer to the @p Reactor object
+ * @param[out] rsp      pointer to the @p ReactorSource object
+ * @param[in] prio      handler priority level, zero is the highest
+ * @param[in] handler   handler function
+ * @param[in] arg       handler argument
+ * @param[in] delay     delay of the first expiration
+ * @param[in] period    period of the following expirations or zero for a
+ *                      one-shot timer
+ * @return              The operation status.
+ * @retval CH_SUCCESS   if the source has been bound.
+ * @retval CH_FAILED    if the priority level is full.
+ *
+ * @api
+ */
+bool_t reactorBindTimer(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                        rhandler_t handler, void *arg,
+                        systime_t delay, systime_t period) {
+
+  chDbgCheck((delay != TIME_IMMEDIATE) && (delay != TIME_INFINITE) &&
+             (period != TIME_INFINITE), "reactorBindTimer");
+
+  if (source_bind(rp, rsp, prio, handler, arg, REACTOR_SOURCE_TIMER))
+    return CH_FAILED;
+  chSysLock();
+  rsp->period = period;
+  chVTSetI(&rsp->vt, delay, timer_cb, rsp);
+  chSysUnlock();
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Unbinds a source.
+ * @details A pending invocation of the handler is discarded.
+ * @note    Event sources must be unbound by the thread running the
+ *          reactor.
+ *
+ * @param[in] rsp       pointer to the @p ReactorSource object
+ *
+ * @api
+ */
+void reactorUnbind(ReactorSource *rsp) {
+  Reactor *rp;
+  unsigned eid;
+  uint32_t mask;
+
+  chDbgCheck((rsp != NULL) && (rsp->reactor != NULL), "reactorUnbind");
+
+  rp = rsp->reactor;
+  if (rsp->type == REACTOR_SOURCE_EVENT) {
+    chEvtUnregister(rsp->esp, &rsp->el);
+    for (eid = 0; eid < REACTOR_EVENT_BITS - 1; eid++)
+      if (rp->events[eid] == rsp) {
+        rp->events[eid] = NULL;
+        chEvtGetAndClearEvents(EVENT_MASK(eid));
+      }
+  }
+  chSysLock();
+  if ((rsp->type == REACTOR_SOURCE_TIMER) && chVTIsArmedI(&rsp->vt))
+    chVTResetI(&rsp->vt);
+  mask = (uint32_t)1 << rsp->slot;
+  rp->used[rsp->prio] &= ~mask;
+  rp->pending[rsp->prio] &= ~mask;
+  if (rp->pending[rsp->prio] == 0)
+    rp->levels &= ~((uint32_t)1 << rsp->prio);
+  rp->sources[rsp->prio][rsp->slot] = NULL;
+  rsp->reactor = NULL;
+  chSysUnlock();
+}
+
+/**
+ * @brief   Signals a source.
+ * @details The flags are accumulated until the handler is invoked.
+ *
+ * @param[in] rsp       pointer to the @p ReactorSource object
+ * @param[in] flags     flags to be passed to the handler
+ *
+ * @iclass
+ */
+void reactorSignalI(ReactorSource *rsp, flagsmask_t flags) {
+
+  chDbgCheckClassI();
+  chDbgCheck(rsp != NULL, "reactorSignalI");
+
+  if (rsp->reactor == NULL)
+    return;
+  rsp->flags |= flags;
+  pend(rsp);
+  chEvtSignalI(rsp->reactor->thread, REACTOR_SIGNAL_EVENT);
+}
+
+/**
+ * @brief   Signals a source.
+ * @details The flags are accumulated until the handler is invoked.
+ *
+ * @param[in] rsp       pointer to the @p ReactorSource object
+ * @param[in] flags     flags to be passed to the handler
+ *
+ * @api
+ */
+void reactorSignal(ReactorSource *rsp, flagsmask_t flags) {
+
+  chSysLock();
+  reactorSignalI(rsp, flags);
+  chSchRescheduleS();
+  chSysUnlock();
+}
+
+/**
+ * @brief   Queue notification callback.
+ * @details This function can be specified as notification callback of a
+ *          queue, the queue link field must point to a bound
+ *          @p ReactorSource. The source is signaled each time the queue
+ *          invokes the callback.
+ *
+ * @param[in] qp        the queue
+ *
+ * @iclass
+ */
+void reactorQueueNotify(GenericQueue *qp) {
+
+  reactorSignalI((ReactorSource *)chQGetLink(qp), 0);
+}
+
+/**
+ * @brief   Waits for sources and invokes their handlers.
+ * @details The pending handlers are invoked in priority order, within a
+ *          priority level in position order. The pending sources are
+ *          looked up again after each handler so a source of higher
+ *          priority signaled by a handler is served first.
+ * @note    Must be invoked by the thread running the reactor.
+ *
+ * @param[in] rp        pointer to the @p Reactor object
+ * @param[in] time      the number of ticks before the operation timeouts,
+ *                      the following special values are allowed:
+ *                      - @a TIME_IMMEDIATE immediate timeout.
+ *                      - @a TIME_INFINITE no timeout.
+ *                      .
+ * @return              The number of handlers invoked.
+ *
+ * @api
+ */
+cnt_t reactorDispatch(Reactor *rp, systime_t time) {
+  ReactorSource *rsp;
+  eventmask_t events;
+  flagsmask_t flags;
+  unsigned prio, slot;
+  cnt_t n = 0;
+#if REACTOR_USE_STATS
+  rtime_t start, t;
+#endif
+
+  chDbgCheck(rp != NULL, "reactorDispatch");
+  chDbgAssert(chThdSelf() == rp->thread,
+              "reactorDispatch(), #1",
+              "not the reactor thread");
+
+  events = chEvtWaitAnyTimeout(ALL_EVENTS, time) & ~REACTOR_SIGNAL_EVENT;
+
+  chSysLock();
+  /* The event flags of the bound event sources are moved into the pending
+     masks.*/
+  while (events != 0) {
+    unsigned eid = ctz(events);
+
+    events &= events - 1;
+    rsp = rp->events[eid];
+    if (rsp != NULL) {
+      rsp->flags |= chEvtGetAndClearFlagsI(&rsp->el);
+      pend(rsp);
+    }
+  }
+
+  while (rp->levels != 0) {
+    prio = ctz(rp->levels);
+    slot = ctz(rp->pending[prio]);
+    rp->pending[prio] &= ~((uint32_t)1 << slot);
+    if (rp->pending[prio] == 0)
+      rp->levels &= ~((uint32_t)1 << prio);
+    rsp = rp->sources[prio][slot];
+    flags = rsp->flags;
+    rsp->flags = 0;
+    chSysUnlock();
+
+#if REACTOR_USE_STATS
+    start = reactor_now();
+    rsp->handler(rsp->arg, flags);
+    t = reactor_now() - start;
+    rsp->stats.count++;
+    rsp->stats.last = t;
+    if (t > rsp->stats.worst)
+      rsp->stats.worst = t;
+    rsp->stats.cumulative += t;
+#else
+    rsp->handler(rsp->arg, flags);
+#endif
+    n++;
+
+    chSysLock();
+  }
+  chSysUnlock();
+  return n;
+}
+
+#if REACTOR_USE_STATS || defined(__DOXYGEN__)
+/**
+ * @brief   Resets the handler execution statistics of a source.
+ *
+ * @param[in] rsp       pointer to the @p ReactorSource object
+ *
+ * @api
+ */
+void reactorResetStats(ReactorSource *rsp) {
+
+  chDbgCheck(rsp != NULL, "reactorResetStats");
+
+  rsp->stats.count = 0;
+  rsp->stats.last = 0;
+  rsp->stats.worst = 0;
+  rsp->stats.cumulative = 0;
+}
+#endif
+
+/** @} */
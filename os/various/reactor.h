@@ -0,0 +1,242 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    reactor.h
+ * @brief   Events reactor structures and macros.
+ *
+ * @addtogroup reactor
+ * @{
+ */
+
+#ifndef _REACTOR_H_
+#define _REACTOR_H_
+
+/**
+ * @brief   Number of handler priority levels.
+ * @details Each level can hold up to 32 sources.
+ */
+#if !defined(REACTOR_PRIORITIES) || defined(__DOXYGEN__)
+#define REACTOR_PRIORITIES          4
+#endif
+
+/**
+ * @brief   Handlers execution time statistics.
+ */
+#if !defined(REACTOR_USE_STATS) || defined(__DOXYGEN__)
+#define REACTOR_USE_STATS           TRUE
+#endif
+
+/*
+ * Module dependencies check.
+ */
+#if !CH_USE_EVENTS || !CH_USE_EVENTS_TIMEOUT
+#error "The reactor requires CH_USE_EVENTS and CH_USE_EVENTS_TIMEOUT"
+#endif
+
+#if (REACTOR_PRIORITIES < 1) || (REACTOR_PRIORITIES > 32)
+#error "invalid REACTOR_PRIORITIES value"
+#endif
+
+/**
+ * @brief   Number of event flags of the reactor thread.
+ */
+#define REACTOR_EVENT_BITS          ((unsigned)(sizeof (eventmask_t) * 8))
+
+/**
+ * @brief   Event flag used by the signaled sources.
+ * @details The other event flags of the reactor thread are assigned to
+ *          the bound event sources.
+ */
+#define REACTOR_SIGNAL_EVENT        EVENT_MASK(REACTOR_EVENT_BITS - 1)
+
+/**
+ * @name    Source types
+ * @{
+ */
+#define REACTOR_SOURCE_SIGNAL       0   /**< @brief Signaled by software.   */
+#define REACTOR_SOURCE_EVENT        1   /**< @brief Event source.           */
+#define REACTOR_SOURCE_TIMER        2   /**< @brief Virtual timer.          */
+/** @} */
+
+/**
+ * @brief   Type of a reactor.
+ */
+typedef struct Reactor Reactor;
+
+/**
+ * @brief   Type of a reactor source.
+ */
+typedef struct ReactorSource ReactorSource;
+
+/**
+ * @brief   Reactor handler type.
+ *
+ * @param[in] arg       the argument specified when binding the source
+ * @param[in] flags     flags accumulated by the source since the previous
+ *                      invocation
+ */
+typedef void (*rhandler_t)(void *arg, flagsmask_t flags);
+
+/**
+ * @brief   Type of the time measurements.
+ */
+#if HAL_IMPLEMENTS_COUNTERS || defined(__DOXYGEN__)
+typedef halrtcnt_t rtime_t;
+#else
+typedef systime_t rtime_t;
+#endif
+
+/**
+ * @brief   Handler execution statistics.
+ * @note    Times are in realtime counter cycles if the HAL implements the
+ *          counters else in system ticks.
+ */
+typedef struct {
+  /**
+   * @brief Number of invocations.
+   */
+  uint32_t              count;
+  /**
+   * @brief Last execution time.
+   */
+  rtime_t               last;
+  /**
+   * @brief Worst execution time.
+   */
+  rtime_t               worst;
+  /**
+   * @brief Cumulative execution time.
+   */
+  uint64_t              cumulative;
+} ReactorStats;
+
+/**
+ * @brief   Structure representing a source bound to a reactor.
+ */
+struct ReactorSource {
+  /**
+   * @brief Reactor the source is bound to or @p NULL.
+   */
+  Reactor               *reactor;
+  /**
+   * @brief Handler function.
+   */
+  rhandler_t            handler;
+  /**
+   * @brief Handler argument.
+   */
+  void                  *arg;
+  /**
+   * @brief Source type.
+   */
+  uint8_t               type;
+  /**
+   * @brief Priority level, zero is the highest.
+   */
+  uint8_t               prio;
+  /**
+   * @brief Position in the priority level.
+   */
+  uint8_t               slot;
+  /**
+   * @brief Flags accumulated since the last handler invocation.
+   */
+  flagsmask_t           flags;
+  /**
+   * @brief Bound event source.
+   */
+  EventSource           *esp;
+  /**
+   * @brief Listener on the bound event source.
+   */
+  EventListener         el;
+  /**
+   * @brief Virtual timer of timer sources.
+   */
+  VirtualTimer          vt;
+  /**
+   * @brief Period of timer sources, zero for one-shot timers.
+   */
+  systime_t             period;
+#if REACTOR_USE_STATS || defined(__DOXYGEN__)
+  /**
+   * @brief Handler execution statistics.
+   */
+  ReactorStats          stats;
+#endif
+};
+
+/**
+ * @brief   Structure representing a reactor.
+ */
+struct Reactor {
+  /**
+   * @brief Thread running the reactor.
+   */
+  Thread                *thread;
+  /**
+   * @brief Mask of the priority levels with pending sources.
+   */
+  uint32_t              levels;
+  /**
+   * @brief Pending sources, one mask for each priority level.
+   */
+  uint32_t              pending[REACTOR_PRIORITIES];
+  /**
+   * @brief Allocated positions, one mask for each priority level.
+   */
+  uint32_t              used[REACTOR_PRIORITIES];
+  /**
+   * @brief Sources by priority level and position.
+   */
+  ReactorSource         *sources[REACTOR_PRIORITIES][32];
+  /**
+   * @brief Event sources by event flag.
+   */
+  ReactorSource         *events[REACTOR_EVENT_BITS - 1];
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void reactorInit(Reactor *rp);
+  bool_t reactorBind(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                     rhandler_t handler, void *arg);
+  bool_t reactorBindEvent(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                          rhandler_t handler, void *arg, EventSource *esp);
+  bool_t reactorBindTimer(Reactor *rp, ReactorSource *rsp, unsigned prio,
+                          rhandler_t handler, void *arg,
+                          systime_t delay, systime_t period);
+  void reactorUnbind(ReactorSource *rsp);
+  void reactorSignalI(ReactorSource *rsp, flagsmask_t flags);
+  void reactorSignal(ReactorSource *rsp, flagsmask_t flags);
+  void reactorQueueNotify(GenericQueue *qp);
+  cnt_t reactorDispatch(Reactor *rp, systime_t time);
+#if REACTOR_USE_STATS
+  void reactorResetStats(ReactorSource *rsp);
+#endif
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _REACTOR_H_ */
+
+/** @} */
@@ -110,12 +110,36 @@ static void cmd_systime(BaseSequentialStream *chp, int argc, char *argv[]) {
   chprintf(chp, "%lu\r\n", (unsigned long)chTimeNow());
 }
 
+#if (CH_USE_REGISTRY && CH_DBG_FILL_THREADS) || defined(__DOXYGEN__)
+static void cmd_stack(BaseSequentialStream *chp, int argc, char *argv[]) {
+  Thread *tp;
+
+  (void)argv;
+  if (argc > 0) {
+    usage(chp, "stack");
+    return;
+  }
+  chprintf(chp, "    addr   unused name\r\n");
+  tp = chRegFirstThread();
+  do {
+    if ((tp->p_flags & THD_STACK_EXTERNAL) == 0)
+      chprintf(chp, "%.8lx %8lu %s\r\n", (unsigned long)tp,
+               (unsigned long)chThdGetStackUnused(tp),
+               chRegGetThreadName(tp) != NULL ? chRegGetThreadName(tp) : "");
+    tp = chRegNextThread(tp);
+  } while (tp != NULL);
+}
+#endif
+
 /**
  * @brief   Array of the default commands.
  */
 static ShellCommand local_commands[] = {
   {"info", cmd_info},
   {"systime", cmd_systime},
+#if (CH_USE_REGISTRY && CH_DBG_FILL_THREADS) || defined(__DOXYGEN__)
+  {"stack", cmd_stack},
+#endif
   {NULL, NULL}
 };
 
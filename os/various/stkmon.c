@@ -0,0 +1,108 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    stkmon.c
+ * @brief   Stack usage monitor code.
+ *
+ * @addtogroup stack_monitor
+ * @{
+ */
+
+#include "ch.h"
+#include "stkmon.h"
+
+static msg_t stkmon_thread(void *p) {
+  StackMonitor *smp = p;
+
+  chRegSetThreadName("stkmon");
+  while (!chThdShouldTerminate()) {
+    smSample(smp);
+    chThdSleep(smp->config->interval);
+  }
+  return 0;
+}
+
+/**
+ * @brief   Samples the stack usage of all the threads.
+ * @details The high-water mark of each registered thread is measured, the
+ *          callback is invoked if the lowest margin in the system decreases
+ *          below the configured threshold.
+ * @note    This function is invoked periodically by the monitor thread, it
+ *          can also be invoked directly.
+ *
+ * @param[in] smp       pointer to the @p StackMonitor object
+ */
+void smSample(StackMonitor *smp) {
+  Thread *tp;
+
+  tp = chRegFirstThread();
+  do {
+    if ((tp->p_flags & THD_STACK_EXTERNAL) == 0) {
+      size_t unused = chThdGetStackUnused(tp);
+
+      if (unused < smp->min_unused) {
+        smp->min_unused = unused;
+        smp->min_name = chRegGetThreadName(tp);
+        if ((unused < smp->config->threshold) &&
+            (smp->config->callback != NULL))
+          smp->config->callback(smp, tp, unused);
+      }
+    }
+    tp = chRegNextThread(tp);
+  } while (tp != NULL);
+  smp->samples++;
+}
+
+/**
+ * @brief   Starts a stack monitor.
+ *
+ * @param[out] smp      pointer to the @p StackMonitor object
+ * @param[in] config    pointer to the @p StackMonitorConfig object
+ * @param[in] prio      priority of the monitor thread
+ */
+void smStart(StackMonitor *smp, const StackMonitorConfig *config,
+             tprio_t prio) {
+
+  smp->config = config;
+  smp->samples = 0;
+  smp->min_unused = (size_t)-1;
+  smp->min_name = NULL;
+  smp->thread = chThdCreateStatic(smp->wa, sizeof smp->wa, prio,
+                                  stkmon_thread, smp);
+}
+
+/**
+ * @brief   Stops a stack monitor.
+ * @note    The monitor thread terminates at the end of its current sampling
+ *          interval.
+ *
+ * @param[in] smp       pointer to the @p StackMonitor object
+ */
+void smStop(StackMonitor *smp) {
+
+  if (smp->thread != NULL) {
+    chThdTerminate(smp->thread);
+    chThdWait(smp->thread);
+    smp->thread = NULL;
+  }
+}
+
+/** @} */
@@ -0,0 +1,125 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+/**
+ * @file    stkmon.h
+ * @brief   Stack usage monitor structures and macros.
+ *
+ * @addtogroup stack_monitor
+ * @{
+ */
+
+#ifndef _STKMON_H_
+#define _STKMON_H_
+
+/**
+ * @brief   Stack monitor thread stack size.
+ */
+#if !defined(STKMON_THREAD_STACK_SIZE) || defined(__DOXYGEN__)
+#define STKMON_THREAD_STACK_SIZE    256
+#endif
+
+/*
+ * Module dependencies check.
+ */
+#if !CH_USE_REGISTRY || !CH_DBG_FILL_THREADS || !CH_USE_WAITEXIT
+#error "The stack monitor requires CH_USE_REGISTRY, CH_DBG_FILL_THREADS "   \
+       "and CH_USE_WAITEXIT"
+#endif
+
+/**
+ * @brief   Type of a stack monitor.
+ */
+typedef struct StackMonitor StackMonitor;
+
+/**
+ * @brief   Low stack notification callback type.
+ * @note    The callback is invoked from the monitor thread.
+ *
+ * @param[in] smp       pointer to the @p StackMonitor object
+ * @param[in] tp        thread with the new lowest stack margin
+ * @param[in] unused    stack space never used by the thread
+ */
+typedef void (*stkmoncb_t)(StackMonitor *smp, Thread *tp, size_t unused);
+
+/**
+ * @brief   Stack monitor configuration structure.
+ */
+typedef struct {
+  /**
+   * @brief Sampling interval in system ticks.
+   */
+  systime_t             interval;
+  /**
+   * @brief Notification threshold in bytes.
+   */
+  size_t                threshold;
+  /**
+   * @brief Low stack notification callback or @p NULL.
+   * @details The callback is invoked when the lowest stack margin in the
+   *          system decreases below the threshold.
+   */
+  stkmoncb_t            callback;
+} StackMonitorConfig;
+
+/**
+ * @brief   Structure representing a stack monitor.
+ */
+struct StackMonitor {
+  /**
+   * @brief Current configuration data.
+   */
+  const StackMonitorConfig *config;
+  /**
+   * @brief Monitor thread or @p NULL.
+   */
+  Thread                *thread;
+  /**
+   * @brief Number of samples taken.
+   */
+  uint32_t              samples;
+  /**
+   * @brief Lowest stack margin seen so far.
+   */
+  size_t                min_unused;
+  /**
+   * @brief Name of the thread with the lowest stack margin or @p NULL.
+   */
+  const char            *min_name;
+  /**
+   * @brief Monitor thread working area.
+   */
+  WORKING_AREA(wa, STKMON_THREAD_STACK_SIZE);
+};
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  void smStart(StackMonitor *smp, const StackMonitorConfig *config,
+               tprio_t prio);
+  void smStop(StackMonitor *smp);
+  void smSample(StackMonitor *smp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _STKMON_H_ */
+
+/** @} */
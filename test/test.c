@@ -33,37 +33,113 @@
 #include "testthd.h"
 #include "testsem.h"
 #include "testmtx.h"
+#include "testbudget.h"
+#include "testedf.h"
+#include "testlatency.h"
 #include "testmsg.h"
 #include "testmbox.h"
 #include "testevt.h"
 #include "testheap.h"
 #include "testpools.h"
+#include "testarena.h"
 #include "testdyn.h"
 #include "testqueues.h"
 #include "testbmk.h"
 
 /*
- * Array of all the test patterns.
- */
-static ROMCONST struct testcase * ROMCONST *patterns[] = {
-  patternthd,
-  patternsem,
-  patternmtx,
-  patternmsg,
-  patternmbox,
-  patternevt,
-  patternheap,
-  patternpools,
-  patterndyn,
-  patternqueues,
-  patternbmk,
-  NULL
+ * Kernel test suites, registered ahead of the user suites.
+ */
+static struct testsuite kernel_suites[] = {
+  {"threads",    NULL, NULL, patternthd,    FALSE, NULL},
+  {"semaphores", NULL, NULL, patternsem,    FALSE, NULL},
+  {"mutexes",    NULL, NULL, patternmtx,    FALSE, NULL},
+  {"budgets",    NULL, NULL, patternbudget, FALSE, NULL},
+  {"edf",        NULL, NULL, patternedf,    FALSE, NULL},
+  {"latency",    NULL, NULL, patternlatency, FALSE, NULL},
+  {"messages",   NULL, NULL, patternmsg,    FALSE, NULL},
+  {"mailboxes",  NULL, NULL, patternmbox,   TRUE,  NULL},
+  {"events",     NULL, NULL, patternevt,    FALSE, NULL},
+  {"heap",       NULL, NULL, patternheap,   FALSE, NULL},
+  {"pools",      NULL, NULL, patternpools,  FALSE, NULL},
+  {"arenas",     NULL, NULL, patternarena,  FALSE, NULL},
+  {"dynamic",    NULL, NULL, patterndyn,    FALSE, NULL},
+  {"queues",     NULL, NULL, patternqueues, FALSE, NULL},
+  {"benchmarks", NULL, NULL, patternbmk,    FALSE, NULL}
 };
 
-static bool_t local_fail, global_fail;
-static unsigned failpoint;
-static char tokens_buffer[MAX_TOKENS];
-static char *tokp;
+/*
+ * Registered suites list.
+ */
+static struct testsuite *suites;
+static struct testsuite **suites_tail = &suites;
+
+/*
+ * Parallel execution requires threads from the heap.
+ */
+#define TEST_HAS_PARALLEL   (CH_USE_HEAP && CH_USE_DYNAMIC &&               \
+                             CH_USE_WAITEXIT && (TEST_MAX_PARALLEL > 0))
+
+/*
+ * The cases results are retained for the JUnit output and for the deferred
+ * reports of the parallel suites.
+ */
+#define TEST_HAS_RESULTS    (TEST_USE_JUNIT || TEST_HAS_PARALLEL)
+
+#if TEST_HAS_RESULTS
+/*
+ * Result of a single test case.
+ */
+struct test_result {
+  const struct testcase     *tcp;
+  unsigned                  n;
+  bool_t                    fail;
+  unsigned                  point;
+  systime_t                 time;
+};
+#endif
+
+/*
+ * Execution context of a suite, the sequential context is also used by
+ * any thread not owning a parallel context.
+ */
+struct test_context {
+  BaseSequentialStream      *chp;
+  Thread                    *owner;
+  const struct testconfig   *cfgp;
+  const struct testsuite    *tsp;
+  unsigned                  n;
+  const struct testcase     *current;
+  bool_t                    bol;
+  bool_t                    local_fail;
+  unsigned                  failpoint;
+  char                      tokens_buffer[MAX_TOKENS];
+  char                      *tokp;
+  unsigned                  ncases;
+  unsigned                  nfail;
+#if TEST_HAS_RESULTS
+  struct test_result        results[TEST_MAX_CASES];
+#endif
+};
+
+static struct test_context seq_ctx;
+#if TEST_HAS_PARALLEL
+static struct test_context par_ctx[TEST_MAX_PARALLEL];
+#endif
+
+static bool_t global_fail;
+static unsigned tap_number;
+
+static struct test_context *get_ctx(void) {
+#if TEST_HAS_PARALLEL
+  Thread *tp = chThdSelf();
+  unsigned i;
+
+  for (i = 0; i < TEST_MAX_PARALLEL; i++)
+    if (par_ctx[i].owner == tp)
+      return &par_ctx[i];
+#endif
+  return &seq_ctx;
+}
 
 /*
  * Static working areas, the following areas can be used for threads or
@@ -85,7 +161,43 @@ void * ROMCONST wa[5] = {test.wa.T0, test.wa.T1, test.wa.T2,
 /*
  * Console output.
  */
-static BaseSequentialStream *chp;
+static const char *ntoa(char *buf, uint32_t n) {
+  char *p = buf + 11;
+
+  *p = '\0';
+  do
+    *--p = (n % 10) + '0', n /= 10;
+  while (n);
+  return p;
+}
+
+static void ctx_put(struct test_context *ctxp, char c) {
+
+  if (ctxp->chp == NULL)
+    return;
+  if (ctxp->bol && (ctxp->cfgp->output == TEST_OUTPUT_TAP))
+    chSequentialStreamWrite(ctxp->chp, (const uint8_t *)"# ", 2);
+  ctxp->bol = c == '\n';
+  chSequentialStreamPut(ctxp->chp, c);
+}
+
+static void rep_print(BaseSequentialStream *chp, const char *msgp) {
+
+  while (*msgp)
+    chSequentialStreamPut(chp, *msgp++);
+}
+
+static void rep_printn(BaseSequentialStream *chp, uint32_t n) {
+  char buf[12];
+
+  rep_print(chp, ntoa(buf, n));
+}
+
+static void rep_println(BaseSequentialStream *chp, const char *msgp) {
+
+  rep_print(chp, msgp);
+  chSequentialStreamWrite(chp, (const uint8_t *)"\r\n", 2);
+}
 
 /**
  * @brief   Prints a decimal unsigned number.
@@ -93,28 +205,23 @@ static BaseSequentialStream *chp;
  * @param[in] n         the number to be printed
  */
 void test_printn(uint32_t n) {
-  char buf[16], *p;
-
-  if (!n)
-    chSequentialStreamPut(chp, '0');
-  else {
-    p = buf;
-    while (n)
-      *p++ = (n % 10) + '0', n /= 10;
-    while (p > buf)
-      chSequentialStreamPut(chp, *--p);
-  }
+  char buf[12];
+
+  test_print(ntoa(buf, n));
 }
 
 /**
  * @brief   Prints a line without final end-of-line.
+ * @note    The output of parallel suites and of runs in JUnit format is
+ *          discarded, in TAP format it is emitted as diagnostic lines.
  *
  * @param[in] msgp      the message
  */
 void test_print(const char *msgp) {
+  struct test_context *ctxp = get_ctx();
 
   while (*msgp)
-    chSequentialStreamPut(chp, *msgp++);
+    ctx_put(ctxp, *msgp++);
 }
 
 /**
@@ -125,21 +232,21 @@ void test_print(const char *msgp) {
 void test_println(const char *msgp) {
 
   test_print(msgp);
-  chSequentialStreamWrite(chp, (const uint8_t *)"\r\n", 2);
+  test_print("\r\n");
 }
 
 /*
  * Tokens.
  */
-static void clear_tokens(void) {
+static void clear_tokens(struct test_context *ctxp) {
 
-  tokp = tokens_buffer;
+  ctxp->tokp = ctxp->tokens_buffer;
 }
 
-static void print_tokens(void) {
-  char *cp = tokens_buffer;
+static void print_tokens(BaseSequentialStream *chp, struct test_context *ctxp) {
+  char *cp = ctxp->tokens_buffer;
 
-  while (cp < tokp)
+  while (cp < ctxp->tokp)
     chSequentialStreamPut(chp, *cp++);
 }
 
@@ -149,9 +256,11 @@ static void print_tokens(void) {
  * @param[in] token     the token as a char
  */
 void test_emit_token(char token) {
+  struct test_context *ctxp = get_ctx();
 
   chSysLock();
-  *tokp++ = token;
+  if (ctxp->tokp < &ctxp->tokens_buffer[MAX_TOKENS])
+    *ctxp->tokp++ = token;
   chSysUnlock();
 }
 
@@ -159,10 +268,11 @@ void test_emit_token(char token) {
  * Assertions.
  */
 bool_t _test_fail(unsigned point) {
+  struct test_context *ctxp = get_ctx();
 
-  local_fail = TRUE;
+  ctxp->local_fail = TRUE;
+  ctxp->failpoint = point;
   global_fail = TRUE;
-  failpoint = point;
   return TRUE;
 }
 
@@ -174,14 +284,16 @@ bool_t _test_assert(unsigned point, bool_t condition) {
 }
 
 bool_t _test_assert_sequence(unsigned point, char *expected) {
-  char *cp = tokens_buffer;
-  while (cp < tokp) {
+  struct test_context *ctxp = get_ctx();
+  char *cp = ctxp->tokens_buffer;
+
+  while (cp < ctxp->tokp) {
     if (*cp++ != *expected++)
      return _test_fail(point);
   }
   if (*expected)
     return _test_fail(point);
-  clear_tokens();
+  clear_tokens(ctxp);
   return FALSE;
 }
 
@@ -280,28 +392,387 @@ void test_start_timer(unsigned ms) {
   chVTSet(&vt, duration, tmr, NULL);
 }
 
+/*
+ * Benchmarks harness.
+ */
+
+#if TEST_BENCH_LATENCY || defined(__DOXYGEN__)
+/*
+ * Time source of the harness, the HAL realtime counter if available else
+ * the system time.
+ */
+#if HAL_IMPLEMENTS_COUNTERS
+typedef halrtcnt_t bench_cnt_t;
+#define bench_now()             halGetCounterValue()
+#define bench_frequency()       ((uint32_t)halGetCounterFrequency())
+#else
+typedef systime_t bench_cnt_t;
+#define bench_now()             chTimeNow()
+#define bench_frequency()       ((uint32_t)CH_FREQUENCY)
+#endif
+
+/*
+ * Reported percentile, a 99th percentile requires at least 100 samples.
+ */
+#if TEST_BENCH_SAMPLES >= 100
+#define BENCH_PERCENTILE        99
+#define BENCH_PERCENTILE_NAME   "p99"
+#else
+#define BENCH_PERCENTILE        90
+#define BENCH_PERCENTILE_NAME   "p90"
+#endif
+
+static struct {
+  const char    *param;
+  uint32_t      value;
+  bench_cnt_t   overhead;
+  bench_cnt_t   start;
+  bench_cnt_t   min;
+  bench_cnt_t   max;
+  uint32_t      n;
+  bench_cnt_t   samples[TEST_BENCH_SAMPLES];
+} bench;
+
+/*
+ * Converts counts in nanoseconds per operation using 32 bits arithmetic,
+ * the counts are split in whole milliseconds and a remainder.
+ */
+static uint32_t bench_ns(bench_cnt_t cnt, uint32_t ops) {
+  uint32_t fk = bench_frequency() / 1000;
+  uint32_t r;
+
+  if (fk == 0)
+    return (uint32_t)cnt * (1000000000U / bench_frequency()) / ops;
+  r = ((uint32_t)cnt % fk) * 1000;
+  return ((uint32_t)cnt / fk * 1000000 + r / fk * 1000 +
+          r % fk * 1000 / fk) / ops;
+}
+
+/**
+ * @brief   Begins a latency measurement.
+ * @details The samples of the previous measurement are discarded and the
+ *          overhead of the time source is calibrated.
+ *
+ * @param[in] param     name of the swept parameter or @p NULL
+ * @param[in] value     value of the swept parameter
+ */
+void test_bench_begin(const char *param, uint32_t value) {
+  unsigned i;
+
+  bench.param = param;
+  bench.value = value;
+  bench.overhead = (bench_cnt_t)-1;
+  for (i = 0; i < 16; i++) {
+    bench_cnt_t t = bench_now();
+
+    t = (bench_cnt_t)(bench_now() - t);
+    if (t < bench.overhead)
+      bench.overhead = t;
+  }
+  bench.min = (bench_cnt_t)-1;
+  bench.max = 0;
+  bench.n = 0;
+}
+
+/**
+ * @brief   Checks if more latency samples are required.
+ *
+ * @return              The sampling state.
+ * @retval TRUE         if the warmup or the retained samples are not
+ *                      yet complete.
+ * @retval FALSE        if the measurement can be ended.
+ */
+bool_t test_bench_sampling(void) {
+
+  return bench.n < TEST_BENCH_WARMUP + TEST_BENCH_SAMPLES;
+}
+
+/**
+ * @brief   Starts a latency sample.
+ */
+void test_bench_start(void) {
+
+  bench.start = bench_now();
+}
+
+/**
+ * @brief   Stops a latency sample and records it.
+ * @details The first @p TEST_BENCH_WARMUP samples are discarded.
+ */
+void test_bench_stop(void) {
+  bench_cnt_t t = (bench_cnt_t)(bench_now() - bench.start);
+
+  t = t > bench.overhead ? t - bench.overhead : 0;
+  if (bench.n >= TEST_BENCH_WARMUP) {
+    if (t < bench.min)
+      bench.min = t;
+    if (t > bench.max)
+      bench.max = t;
+    if (bench.n < TEST_BENCH_WARMUP + TEST_BENCH_SAMPLES)
+      bench.samples[bench.n - TEST_BENCH_WARMUP] = t;
+  }
+  bench.n++;
+}
+#endif /* TEST_BENCH_LATENCY */
+
+#if TEST_BENCH_LATENCY || CH_USE_LATENCY || defined(__DOXYGEN__)
+static void bench_print_field(const char *name, uint32_t n) {
+
+#if TEST_BENCH_JSON
+  test_print(",\"");
+  test_print(name);
+  test_print("\":");
+#else
+  (void)name;
+  test_print(",");
+#endif
+  test_printn(n);
+}
+#endif /* TEST_BENCH_LATENCY || CH_USE_LATENCY */
+
+#if TEST_BENCH_LATENCY || defined(__DOXYGEN__)
+/**
+ * @brief   Ends a latency measurement and prints the results.
+ * @details The results are printed in a human readable line followed by a
+ *          machine readable record, CSV or JSON depending on the
+ *          @p TEST_BENCH_JSON setting. The CSV record fields are: test name,
+ *          parameter name, parameter value, samples, then minimum, median,
+ *          percentile and maximum latencies in nanoseconds. The
+ *          percentile is the 99th if @p TEST_BENCH_SAMPLES is at least 100
+ *          else the 90th, it is named in the human readable line and in the
+ *          JSON field name.
+ *
+ * @param[in] ops       number of operations performed in each sample
+ */
+void test_bench_end(uint32_t ops) {
+  uint32_t i, j, n;
+  bench_cnt_t t, median, pct;
+
+  if (bench.n <= TEST_BENCH_WARMUP)
+    return;
+  n = bench.n - TEST_BENCH_WARMUP;
+  if (n > TEST_BENCH_SAMPLES)
+    n = TEST_BENCH_SAMPLES;
+
+  /* Insertion sort of the retained samples.*/
+  for (i = 1; i < n; i++) {
+    t = bench.samples[i];
+    for (j = i; (j > 0) && (bench.samples[j - 1] > t); j--)
+      bench.samples[j] = bench.samples[j - 1];
+    bench.samples[j] = t;
+  }
+  median = bench.samples[n / 2];
+  /* Nearest rank percentile.*/
+  pct = bench.samples[(n * BENCH_PERCENTILE + 99) / 100 - 1];
+
+  test_print("--- Latency: ");
+  if (bench.param != NULL) {
+    test_print(bench.param);
+    test_print("=");
+    test_printn(bench.value);
+    test_print(", ");
+  }
+  test_print("min ");
+  test_printn(bench_ns(bench.min, ops));
+  test_print(", median ");
+  test_printn(bench_ns(median, ops));
+  test_print(", " BENCH_PERCENTILE_NAME " ");
+  test_printn(bench_ns(pct, ops));
+  test_print(", max ");
+  test_printn(bench_ns(bench.max, ops));
+  test_println(" nS/op");
+
+#if TEST_BENCH_JSON
+  test_print("{\"bench\":\"");
+  test_print(get_ctx()->current->name);
+  test_print("\",\"param\":\"");
+  test_print(bench.param != NULL ? bench.param : "");
+  test_print("\"");
+#else
+  test_print("#bench,\"");
+  test_print(get_ctx()->current->name);
+  test_print("\",");
+  test_print(bench.param != NULL ? bench.param : "");
+#endif
+  bench_print_field("value", bench.value);
+  bench_print_field("samples", bench.n - TEST_BENCH_WARMUP);
+  bench_print_field("min_ns", bench_ns(bench.min, ops));
+  bench_print_field("median_ns", bench_ns(median, ops));
+  bench_print_field(BENCH_PERCENTILE_NAME "_ns", bench_ns(pct, ops));
+  bench_print_field("max_ns", bench_ns(bench.max, ops));
+#if TEST_BENCH_JSON
+  test_println("}");
+#else
+  test_println("");
+#endif
+}
+#endif /* TEST_BENCH_LATENCY */
+
+#if CH_USE_LATENCY || defined(__DOXYGEN__)
+/**
+ * @brief   Prints a latency histogram.
+ * @details The histogram is printed in a human readable line followed by a
+ *          machine readable record, CSV or JSON depending on the
+ *          @p TEST_BENCH_JSON setting. The CSV record fields are: test name,
+ *          histogram name, latency clock frequency, samples, maximum
+ *          latency, budget overruns, then the counters of all the bins.
+ *
+ * @param[in] name      name of the histogram
+ * @param[in] lhp       pointer to the @p LatencyHistogram to be printed
+ */
+void test_print_latency(const char *name, const LatencyHistogram *lhp) {
+  unsigned i;
+
+  test_print("--- Histogram: ");
+  test_print(name);
+  test_print(", samples ");
+  test_printn(lhp->lh_samples);
+  test_print(", max ");
+  test_printn(LAT2US(lhp->lh_max));
+  test_println(" uS");
+
+#if TEST_BENCH_JSON
+  test_print("{\"latency\":\"");
+  test_print(get_ctx()->current->name);
+  test_print("\",\"name\":\"");
+  test_print(name);
+  test_print("\"");
+#else
+  test_print("#latency,\"");
+  test_print(get_ctx()->current->name);
+  test_print("\",");
+  test_print(name);
+#endif
+  bench_print_field("freq", CH_LATENCY_FREQUENCY);
+  bench_print_field("samples", lhp->lh_samples);
+  bench_print_field("max", lhp->lh_max);
+  bench_print_field("overruns", lhp->lh_overruns);
+#if TEST_BENCH_JSON
+  test_print(",\"bins\":[");
+  for (i = 0; i < CH_LATENCY_BINS; i++) {
+    if (i > 0)
+      test_print(",");
+    test_printn(lhp->lh_bins[i]);
+  }
+  test_println("]}");
+#else
+  for (i = 0; i < CH_LATENCY_BINS; i++) {
+    test_print(",");
+    test_printn(lhp->lh_bins[i]);
+  }
+  test_println("");
+#endif
+}
+#endif /* CH_USE_LATENCY */
+
 /*
  * Test suite execution.
  */
-static void execute_test(const struct testcase *tcp) {
+static bool_t name_match(const char *name, const char *filter) {
+  const char *np, *fp;
+
+  while (TRUE) {
+    for (np = name, fp = filter; (*fp != '\0') && (*np == *fp); np++, fp++)
+      ;
+    if (*fp == '\0')
+      return TRUE;
+    if (*name++ == '\0')
+      return FALSE;
+  }
+}
+
+static bool_t case_selected(const struct testconfig *cfgp,
+                            const struct testsuite *tsp,
+                            const struct testcase *tcp) {
+
+  return (cfgp->filter == NULL) ||
+         name_match(tsp->name, cfgp->filter) ||
+         name_match(tcp->name, cfgp->filter);
+}
+
+static unsigned count_cases(const struct testconfig *cfgp,
+                            const struct testsuite *tsp) {
+  unsigned j, n = 0;
+
+  for (j = 0; tsp->cases[j] != NULL; j++)
+    if (case_selected(cfgp, tsp, tsp->cases[j]))
+      n++;
+  return n;
+}
+
+static void register_kernel_suites(void) {
+  static bool_t done;
+  unsigned i;
+
+  if (!done) {
+    done = TRUE;
+    for (i = 0; i < sizeof kernel_suites / sizeof kernel_suites[0]; i++)
+      test_register_suite(&kernel_suites[i]);
+  }
+}
+
+static void ctx_init(struct test_context *ctxp,
+                     const struct testconfig *cfgp,
+                     const struct testsuite *tsp,
+                     unsigned n) {
+
+  ctxp->chp = cfgp->output == TEST_OUTPUT_JUNIT ? NULL : cfgp->chp;
+  ctxp->cfgp = cfgp;
+  ctxp->tsp = tsp;
+  ctxp->n = n;
+  ctxp->current = NULL;
+  ctxp->bol = TRUE;
+  ctxp->ncases = 0;
+  ctxp->nfail = 0;
+  clear_tokens(ctxp);
+}
+
+static void execute_test(struct test_context *ctxp,
+                         const struct testcase *tcp,
+                         unsigned n) {
+#if TEST_HAS_RESULTS
+  struct test_result *trp;
+#endif
+  systime_t start;
   int i;
 
   /* Initialization */
-  clear_tokens();
-  local_fail = FALSE;
-  for (i = 0; i < MAX_THREADS; i++)
-    threads[i] = NULL;
+  ctxp->current = tcp;
+  clear_tokens(ctxp);
+  ctxp->local_fail = FALSE;
+  if (ctxp == &seq_ctx)
+    for (i = 0; i < MAX_THREADS; i++)
+      threads[i] = NULL;
 
+  start = chTimeNow();
   if (tcp->setup != NULL)
     tcp->setup();
   tcp->execute();
   if (tcp->teardown != NULL)
     tcp->teardown();
 
-  test_wait_threads();
+  if (ctxp == &seq_ctx)
+    test_wait_threads();
+
+#if TEST_HAS_RESULTS
+  if (ctxp->ncases < TEST_MAX_CASES) {
+    trp = &ctxp->results[ctxp->ncases];
+    trp->tcp = tcp;
+    trp->n = n;
+    trp->fail = ctxp->local_fail;
+    trp->point = ctxp->failpoint;
+    trp->time = chTimeNow() - start;
+  }
+#else
+  (void)n;
+  (void)start;
+#endif
+  ctxp->ncases++;
+  if (ctxp->local_fail)
+    ctxp->nfail++;
 }
 
-static void print_line(void) {
+static void print_line(BaseSequentialStream *chp) {
   unsigned i;
 
   for (i = 0; i < 76; i++)
@@ -309,16 +780,259 @@ static void print_line(void) {
   chSequentialStreamWrite(chp, (const uint8_t *)"\r\n", 2);
 }
 
-/**
- * @brief   Test execution thread function.
- *
- * @param[in] p         pointer to a @p BaseChannel object for test output
- * @return              A failure boolean value.
+static void print_xml(BaseSequentialStream *chp, const char *s) {
+
+  while (*s) {
+    switch (*s) {
+    case '&':
+      rep_print(chp, "&amp;");
+      break;
+    case '<':
+      rep_print(chp, "&lt;");
+      break;
+    case '>':
+      rep_print(chp, "&gt;");
+      break;
+    case '"':
+      rep_print(chp, "&quot;");
+      break;
+    default:
+      chSequentialStreamPut(chp, *s);
+    }
+    s++;
+  }
+}
+
+static void print_case_header(struct test_context *ctxp,
+                              const struct testcase *tcp,
+                              unsigned n) {
+  BaseSequentialStream *chp = ctxp->cfgp->chp;
+
+  if (ctxp->cfgp->output != TEST_OUTPUT_TEXT)
+    return;
+  print_line(chp);
+  rep_print(chp, "--- Test Case ");
+  rep_printn(chp, ctxp->n);
+  rep_print(chp, ".");
+  rep_printn(chp, n);
+  rep_print(chp, " (");
+  rep_print(chp, tcp->name);
+  rep_println(chp, ")");
+}
+
+/*
+ * Reports a test case result, the tokens are only available while the
+ * case is the last one executed in the context.
  */
-msg_t TestThread(void *p) {
-  int i, j;
+static void report_case(struct test_context *ctxp,
+                        const struct testcase *tcp,
+                        bool_t fail, unsigned point, bool_t tokens) {
+  BaseSequentialStream *chp = ctxp->cfgp->chp;
+
+  switch (ctxp->cfgp->output) {
+  case TEST_OUTPUT_TEXT:
+    if (fail) {
+      rep_print(chp, "--- Result: FAILURE (#");
+      rep_printn(chp, point);
+      if (tokens) {
+        rep_print(chp, " [");
+        print_tokens(chp, ctxp);
+        rep_print(chp, "]");
+      }
+      rep_println(chp, ")");
+    }
+    else
+      rep_println(chp, "--- Result: SUCCESS");
+    break;
+  case TEST_OUTPUT_TAP:
+    rep_print(chp, fail ? "not ok " : "ok ");
+    rep_printn(chp, ++tap_number);
+    rep_print(chp, " - ");
+    rep_print(chp, ctxp->tsp->name);
+    rep_print(chp, ": ");
+    rep_println(chp, tcp->name);
+    if (fail) {
+      rep_print(chp, "# assertion #");
+      rep_printn(chp, point);
+      if (tokens) {
+        rep_print(chp, " [");
+        print_tokens(chp, ctxp);
+        rep_print(chp, "]");
+      }
+      rep_println(chp, "");
+    }
+    break;
+  default:
+    break;
+  }
+}
+
+#if TEST_USE_JUNIT || defined(__DOXYGEN__)
+/*
+ * Reports the results of a suite in JUnit format, the cases exceeding
+ * TEST_MAX_CASES are reported as a single failing case.
+ */
+static void report_junit(struct test_context *ctxp) {
+  BaseSequentialStream *chp = ctxp->cfgp->chp;
+  const struct test_result *trp;
+  unsigned i, n, nfail;
+  uint32_t ms;
+
+  n = ctxp->ncases < TEST_MAX_CASES ? ctxp->ncases : TEST_MAX_CASES;
+  nfail = 0;
+  for (i = 0; i < n; i++)
+    if (ctxp->results[i].fail)
+      nfail++;
+  if (ctxp->ncases > n)
+    global_fail = TRUE;
+
+  rep_print(chp, "  <testsuite name=\"");
+  print_xml(chp, ctxp->tsp->name);
+  rep_print(chp, "\" tests=\"");
+  rep_printn(chp, ctxp->ncases > n ? n + 1 : n);
+  rep_print(chp, "\" failures=\"");
+  rep_printn(chp, ctxp->ncases > n ? nfail + 1 : nfail);
+  rep_println(chp, "\">");
+  for (i = 0; i < n; i++) {
+    trp = &ctxp->results[i];
+    ms = (uint32_t)(trp->time / CH_FREQUENCY) * 1000 +
+         (uint32_t)(trp->time % CH_FREQUENCY) * 1000 / CH_FREQUENCY;
+    rep_print(chp, "    <testcase classname=\"");
+    print_xml(chp, ctxp->tsp->name);
+    rep_print(chp, "\" name=\"");
+    print_xml(chp, trp->tcp->name);
+    rep_print(chp, "\" time=\"");
+    rep_printn(chp, ms / 1000);
+    chSequentialStreamPut(chp, '.');
+    chSequentialStreamPut(chp, (ms / 100) % 10 + '0');
+    chSequentialStreamPut(chp, (ms / 10) % 10 + '0');
+    chSequentialStreamPut(chp, ms % 10 + '0');
+    if (trp->fail) {
+      rep_println(chp, "\">");
+      rep_print(chp, "      <failure message=\"assertion #");
+      rep_printn(chp, trp->point);
+      rep_println(chp, "\"/>");
+      rep_println(chp, "    </testcase>");
+    }
+    else
+      rep_println(chp, "\"/>");
+  }
+  if (ctxp->ncases > n) {
+    rep_print(chp, "    <testcase classname=\"");
+    print_xml(chp, ctxp->tsp->name);
+    rep_println(chp, "\" name=\"results truncated\">");
+    rep_print(chp, "      <failure message=\"");
+    rep_printn(chp, ctxp->ncases - n);
+    rep_println(chp, " cases not reported, increase TEST_MAX_CASES\"/>");
+    rep_println(chp, "    </testcase>");
+  }
+  rep_println(chp, "  </testsuite>");
+}
+#endif /* TEST_USE_JUNIT */
+
+/*
+ * Executes the selected cases of a suite. In the sequential context the
+ * results are reported while the cases are executed.
+ */
+static void run_suite(struct test_context *ctxp) {
+  const struct testsuite *tsp = ctxp->tsp;
+  const struct testcase *tcp;
+  unsigned j;
+
+  if (tsp->setup != NULL)
+    tsp->setup();
+  for (j = 0; tsp->cases[j] != NULL; j++) {
+    tcp = tsp->cases[j];
+    if (!case_selected(ctxp->cfgp, tsp, tcp))
+      continue;
+    if (ctxp == &seq_ctx) {
+      print_case_header(ctxp, tcp, j + 1);
+#if DELAY_BETWEEN_TESTS > 0
+      chThdSleepMilliseconds(DELAY_BETWEEN_TESTS);
+#endif
+    }
+    execute_test(ctxp, tcp, j + 1);
+    if (ctxp == &seq_ctx)
+      report_case(ctxp, tcp, ctxp->local_fail, ctxp->failpoint, TRUE);
+  }
+  if (tsp->teardown != NULL)
+    tsp->teardown();
+#if TEST_USE_JUNIT
+  if ((ctxp == &seq_ctx) && (ctxp->cfgp->output == TEST_OUTPUT_JUNIT))
+    report_junit(ctxp);
+#endif
+}
+
+#if TEST_HAS_PARALLEL
+static msg_t suite_thread(void *p) {
+  struct test_context *ctxp = p;
+
+  ctxp->owner = chThdSelf();
+  run_suite(ctxp);
+  return 0;
+}
+
+/*
+ * Executes the parallel suites in batches of TEST_MAX_PARALLEL threads,
+ * the results are reported after each batch completes. A suite whose
+ * thread cannot be allocated is executed by the calling thread.
+ */
+static void run_parallel(const struct testconfig *cfgp) {
+  Thread *tps[TEST_MAX_PARALLEL];
+  struct testsuite *tsp = suites;
+  struct test_context *ctxp;
+  const struct test_result *trp;
+  unsigned i, j, k, n = 1;
+
+  while (tsp != NULL) {
+    for (k = 0; (tsp != NULL) && (k < TEST_MAX_PARALLEL); tsp = tsp->next, n++) {
+      if (!tsp->parallel || (count_cases(cfgp, tsp) == 0))
+        continue;
+      ctxp = &par_ctx[k];
+      ctx_init(ctxp, cfgp, tsp, n);
+      ctxp->chp = NULL;
+      tps[k] = chThdCreateFromHeap(NULL,
+                                   THD_WA_SIZE(TEST_PARALLEL_STACK_SIZE),
+                                   chThdGetPriority(), suite_thread, ctxp);
+      if (tps[k] == NULL) {
+        ctxp->owner = chThdSelf();
+        run_suite(ctxp);
+        ctxp->owner = NULL;
+      }
+      k++;
+    }
+    for (i = 0; i < k; i++) {
+      ctxp = &par_ctx[i];
+      if (tps[i] != NULL)
+        chThdWait(tps[i]);
+      ctxp->owner = NULL;
+#if TEST_USE_JUNIT
+      if (cfgp->output == TEST_OUTPUT_JUNIT) {
+        report_junit(ctxp);
+        continue;
+      }
+#endif
+      for (j = 0; (j < ctxp->ncases) && (j < TEST_MAX_CASES); j++) {
+        trp = &ctxp->results[j];
+        print_case_header(ctxp, trp->tcp, trp->n);
+        report_case(ctxp, trp->tcp, trp->fail, trp->point, FALSE);
+      }
+      if (ctxp->ncases > TEST_MAX_CASES) {
+        /* The cases not retained cannot be reported.*/
+        global_fail = TRUE;
+        if (cfgp->output == TEST_OUTPUT_TEXT) {
+          rep_print(cfgp->chp, "--- Result: FAILURE (");
+          rep_printn(cfgp->chp, ctxp->ncases - TEST_MAX_CASES);
+          rep_println(cfgp->chp, " cases not reported)");
+        }
+      }
+    }
+  }
+}
+#endif /* TEST_HAS_PARALLEL */
+
+static void print_banner(void) {
 
-  chp = p;
   test_println("");
   test_println("*** ChibiOS/RT test suite");
   test_println("***");
@@ -349,46 +1063,125 @@ msg_t TestThread(void *p) {
   test_println(BOARD_NAME);
 #endif
   test_println("");
+}
+
+/**
+ * @brief   Registers a test suite.
+ * @details The suite is appended to the list of the suites executed by
+ *          @p test_run(), the kernel suites are always the first ones.
+ * @note    Suites must be registered before starting a run.
+ *
+ * @param[in] tsp       pointer to the @p testsuite structure
+ */
+void test_register_suite(struct testsuite *tsp) {
+
+  chDbgCheck((tsp != NULL) && (tsp->cases != NULL), "test_register_suite");
+
+  register_kernel_suites();
+  tsp->next = NULL;
+  *suites_tail = tsp;
+  suites_tail = &tsp->next;
+}
+
+/**
+ * @brief   Executes the registered test suites.
+ * @details Suites with no case matching the filter are skipped, a suite
+ *          whose name matches the filter is executed entirely. If enabled
+ *          in the configuration the parallel suites are executed first,
+ *          concurrently, then the remaining ones sequentially.
+ * @note    The JUnit output requires @p TEST_USE_JUNIT.
+ * @note    Parallel execution requires @p CH_USE_HEAP, @p CH_USE_DYNAMIC,
+ *          @p CH_USE_WAITEXIT and a non zero @p TEST_MAX_PARALLEL, without
+ *          them all the suites are executed sequentially.
+ *
+ * @param[in] cfgp      pointer to the @p testconfig structure
+ * @return              A failure boolean value.
+ */
+bool_t test_run(const struct testconfig *cfgp) {
+  struct testsuite *tsp;
+  bool_t parallel;
+  unsigned n;
+
+  chDbgCheck((cfgp != NULL) && (cfgp->chp != NULL), "test_run");
+#if !TEST_USE_JUNIT
+  chDbgCheck(cfgp->output != TEST_OUTPUT_JUNIT, "test_run");
+#endif
 
+  register_kernel_suites();
+#if TEST_HAS_PARALLEL
+  parallel = cfgp->parallel;
+#else
+  parallel = FALSE;
+#endif
   global_fail = FALSE;
-  i = 0;
-  while (patterns[i]) {
-    j = 0;
-    while (patterns[i][j]) {
-      print_line();
-      test_print("--- Test Case ");
-      test_printn(i + 1);
-      test_print(".");
-      test_printn(j + 1);
-      test_print(" (");
-      test_print(patterns[i][j]->name);
-      test_println(")");
-#if DELAY_BETWEEN_TESTS > 0
-      chThdSleepMilliseconds(DELAY_BETWEEN_TESTS);
+  tap_number = 0;
+  ctx_init(&seq_ctx, cfgp, NULL, 0);
+
+  switch (cfgp->output) {
+  case TEST_OUTPUT_TAP:
+    n = 0;
+    for (tsp = suites; tsp != NULL; tsp = tsp->next)
+      n += count_cases(cfgp, tsp);
+    rep_println(cfgp->chp, "TAP version 13");
+    rep_print(cfgp->chp, "1..");
+    rep_printn(cfgp->chp, n);
+    rep_println(cfgp->chp, "");
+    break;
+  case TEST_OUTPUT_JUNIT:
+    rep_println(cfgp->chp, "<?xml version=\"1.0\" encoding=\"UTF-8\"?>");
+    rep_println(cfgp->chp, "<testsuites>");
+    break;
+  default:
+    print_banner();
+  }
+
+#if TEST_HAS_PARALLEL
+  if (parallel)
+    run_parallel(cfgp);
 #endif
-      execute_test(patterns[i][j]);
-      if (local_fail) {
-        test_print("--- Result: FAILURE (#");
-        test_printn(failpoint);
-        test_print(" [");
-        print_tokens();
-        test_println("])");
-      }
-      else
-        test_println("--- Result: SUCCESS");
-      j++;
-    }
-    i++;
+
+  for (tsp = suites, n = 1; tsp != NULL; tsp = tsp->next, n++) {
+    if ((parallel && tsp->parallel) || (count_cases(cfgp, tsp) == 0))
+      continue;
+    ctx_init(&seq_ctx, cfgp, tsp, n);
+    run_suite(&seq_ctx);
   }
-  print_line();
-  test_println("");
-  test_print("Final result: ");
-  if (global_fail)
-    test_println("FAILURE");
-  else
-    test_println("SUCCESS");
 
-  return (msg_t)global_fail;
+  switch (cfgp->output) {
+  case TEST_OUTPUT_TAP:
+    break;
+  case TEST_OUTPUT_JUNIT:
+    rep_println(cfgp->chp, "</testsuites>");
+    break;
+  default:
+    print_line(cfgp->chp);
+    rep_println(cfgp->chp, "");
+    rep_print(cfgp->chp, "Final result: ");
+    if (global_fail)
+      rep_println(cfgp->chp, "FAILURE");
+    else
+      rep_println(cfgp->chp, "SUCCESS");
+  }
+
+  return global_fail;
+}
+
+/**
+ * @brief   Test execution thread function.
+ * @details Executes all the registered suites sequentially with text
+ *          output.
+ *
+ * @param[in] p         pointer to a @p BaseChannel object for test output
+ * @return              A failure boolean value.
+ */
+msg_t TestThread(void *p) {
+  struct testconfig cfg;
+
+  cfg.chp = p;
+  cfg.filter = NULL;
+  cfg.output = TEST_OUTPUT_TEXT;
+  cfg.parallel = FALSE;
+  return (msg_t)test_run(&cfg);
 }
 
 /** @} */
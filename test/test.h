@@ -43,6 +43,97 @@
 #define TEST_NO_BENCHMARKS      FALSE
 #endif
 
+/**
+ * @brief   If @p TRUE then the benchmarks latency harness is included.
+ * @details The harness requires a sample buffer and the printing of the
+ *          results, it is excluded by default on the smallest targets.
+ */
+#if !defined(TEST_BENCH_LATENCY) || defined(__DOXYGEN__)
+#if defined(CH_ARCHITECTURE_AVR) || defined(CH_ARCHITECTURE_MSP430) ||      \
+    defined(CH_ARCHITECTURE_STM8)
+#define TEST_BENCH_LATENCY      FALSE
+#else
+#define TEST_BENCH_LATENCY      TRUE
+#endif
+#endif
+
+/**
+ * @brief   Number of latency samples retained by the benchmarks harness.
+ * @details The median and percentile figures are computed over the
+ *          retained samples. The 99th percentile is reported with at least
+ *          100 samples, the 90th percentile with fewer samples.
+ */
+#if !defined(TEST_BENCH_SAMPLES) || defined(__DOXYGEN__)
+#if defined(CH_ARCHITECTURE_SIMIA32)
+#define TEST_BENCH_SAMPLES      128
+#else
+#define TEST_BENCH_SAMPLES      32
+#endif
+#endif
+
+/**
+ * @brief   Number of initial samples discarded by the benchmarks harness.
+ */
+#if !defined(TEST_BENCH_WARMUP) || defined(__DOXYGEN__)
+#define TEST_BENCH_WARMUP       16
+#endif
+
+/**
+ * @brief   Benchmarks machine readable output format.
+ * @details If @p TRUE the results are emitted as JSON objects else as CSV
+ *          records, one line for each result in both cases.
+ */
+#if !defined(TEST_BENCH_JSON) || defined(__DOXYGEN__)
+#define TEST_BENCH_JSON         FALSE
+#endif
+
+/**
+ * @brief   If @p TRUE then the JUnit output format is supported.
+ * @details The JUnit output requires the results of the cases of a suite
+ *          to be retained, it is excluded by default on the smallest
+ *          targets.
+ */
+#if !defined(TEST_USE_JUNIT) || defined(__DOXYGEN__)
+#if defined(CH_ARCHITECTURE_AVR) || defined(CH_ARCHITECTURE_MSP430) ||      \
+    defined(CH_ARCHITECTURE_STM8)
+#define TEST_USE_JUNIT          FALSE
+#else
+#define TEST_USE_JUNIT          TRUE
+#endif
+#endif
+
+/**
+ * @brief   Maximum number of test cases in a suite.
+ * @details Cases beyond this limit are executed but not listed in the
+ *          JUnit output nor in the deferred reports of parallel suites,
+ *          the truncation is reported as a failure.
+ */
+#if !defined(TEST_MAX_CASES) || defined(__DOXYGEN__)
+#define TEST_MAX_CASES          32
+#endif
+
+/**
+ * @brief   Maximum number of suites executed in parallel.
+ * @details Each parallel suite requires a context holding up to
+ *          @p TEST_MAX_CASES results, zero disables the parallel execution.
+ *          The parallel execution is only enabled by default in the
+ *          simulator.
+ */
+#if !defined(TEST_MAX_PARALLEL) || defined(__DOXYGEN__)
+#if defined(CH_ARCHITECTURE_SIMIA32)
+#define TEST_MAX_PARALLEL       4
+#else
+#define TEST_MAX_PARALLEL       0
+#endif
+#endif
+
+/**
+ * @brief   Stack size of the threads executing parallel suites.
+ */
+#if !defined(TEST_PARALLEL_STACK_SIZE) || defined(__DOXYGEN__)
+#define TEST_PARALLEL_STACK_SIZE 1024
+#endif
+
 #define MAX_THREADS             5
 #define MAX_TOKENS              16
 
@@ -67,6 +158,45 @@ struct testcase {
   void (*execute)(void);        /**< @brief Test case execution function.   */
 };
 
+/**
+ * @brief   Structure representing a test suite.
+ * @details Suites are registered using @p test_register_suite() and are
+ *          executed in registration order, after the kernel suites.
+ * @note    Suites marked as parallel are executed concurrently with other
+ *          parallel suites so they must not use the @p threads array, the
+ *          shared test buffers, the test timer nor the benchmarks helpers.
+ *          Their free-form output is discarded.
+ */
+struct testsuite {
+  const char *name;             /**< @brief Test suite name.                */
+  void (*setup)(void);          /**< @brief Suite preparation function.     */
+  void (*teardown)(void);       /**< @brief Suite clean up function.        */
+  ROMCONST struct testcase * ROMCONST *cases;
+                                /**< @brief Test cases, @p NULL terminated. */
+  bool_t parallel;              /**< @brief Suite can run in parallel.      */
+  struct testsuite *next;       /**< @brief Next registered suite.          */
+};
+
+/**
+ * @brief   Test results output formats.
+ */
+typedef enum {
+  TEST_OUTPUT_TEXT = 0,         /**< @brief Human readable report.          */
+  TEST_OUTPUT_TAP = 1,          /**< @brief Test Anything Protocol.         */
+  TEST_OUTPUT_JUNIT = 2         /**< @brief JUnit XML report.               */
+} testoutput_t;
+
+/**
+ * @brief   Structure representing a test run configuration.
+ */
+struct testconfig {
+  BaseSequentialStream *chp;    /**< @brief Output stream.                  */
+  const char *filter;           /**< @brief Suite or case name substring,
+                                     @p NULL for all.                       */
+  testoutput_t output;          /**< @brief Output format.                  */
+  bool_t parallel;              /**< @brief Enables parallel suites.        */
+};
+
 #ifndef __DOXYGEN__
 union test_buffers {
   struct {
@@ -84,6 +214,8 @@ union test_buffers {
 extern "C" {
 #endif
   msg_t TestThread(void *p);
+  void test_register_suite(struct testsuite *tsp);
+  bool_t test_run(const struct testconfig *cfgp);
   void test_printn(uint32_t n);
   void test_print(const char *msgp);
   void test_println(const char *msgp);
@@ -96,6 +228,16 @@ extern "C" {
   void test_wait_threads(void);
   systime_t test_wait_tick(void);
   void test_start_timer(unsigned ms);
+#if TEST_BENCH_LATENCY
+  void test_bench_begin(const char *param, uint32_t value);
+  bool_t test_bench_sampling(void);
+  void test_bench_start(void);
+  void test_bench_stop(void);
+  void test_bench_end(uint32_t ops);
+#endif
+#if CH_USE_LATENCY
+  void test_print_latency(const char *name, const LatencyHistogram *lhp);
+#endif
 #if CH_DBG_THREADS_PROFILING
   void test_cpu_pulse(unsigned duration);
 #endif
@@ -106,6 +248,14 @@ extern "C" {
 }
 #endif
 
+#if !TEST_BENCH_LATENCY
+#define test_bench_begin(param, value)
+#define test_bench_sampling()   FALSE
+#define test_bench_start()
+#define test_bench_stop()
+#define test_bench_end(ops)
+#endif
+
 /**
  * @brief   Test failure enforcement.
  */
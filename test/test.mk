@@ -3,11 +3,15 @@ TESTSRC = ${CHIBIOS}/test/test.c \
           ${CHIBIOS}/test/testthd.c \
           ${CHIBIOS}/test/testsem.c \
           ${CHIBIOS}/test/testmtx.c \
+          ${CHIBIOS}/test/testbudget.c \
+          ${CHIBIOS}/test/testedf.c \
+          ${CHIBIOS}/test/testlatency.c \
           ${CHIBIOS}/test/testmsg.c \
           ${CHIBIOS}/test/testmbox.c \
           ${CHIBIOS}/test/testevt.c \
           ${CHIBIOS}/test/testheap.c \
           ${CHIBIOS}/test/testpools.c \
+          ${CHIBIOS}/test/testarena.c \
           ${CHIBIOS}/test/testdyn.c \
           ${CHIBIOS}/test/testqueues.c \
           ${CHIBIOS}/test/testbmk.c
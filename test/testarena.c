@@ -0,0 +1,205 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ch.h"
+#include "test.h"
+
+/**
+ * @page test_arena Memory Arenas test
+ *
+ * File: @ref testarena.c
+ *
+ * <h2>Description</h2>
+ * This module implements the test sequence for the @ref arenas subsystem.
+ *
+ * <h2>Objective</h2>
+ * Objective of the test module is to cover 100% of the @ref arenas code.
+ *
+ * <h2>Preconditions</h2>
+ * The module requires the following kernel options:
+ * - @p CH_USE_MEMARENAS
+ * - @p CH_USE_MEMPOOLS (test case #2)
+ * .
+ * In case some of the required options are not enabled then some or all tests
+ * may be skipped.
+ *
+ * <h2>Test Cases</h2>
+ * - @subpage test_arena_001
+ * - @subpage test_arena_002
+ * .
+ * @file testarena.c
+ * @brief Memory Arenas test source file
+ * @file testarena.h
+ * @brief Memory Arenas test header file
+ */
+
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+
+#define BLOCK_SIZE  MEM_ALIGN_SIZE
+#define CHUNK_SIZE  (BLOCK_SIZE * 4)
+
+static MemoryArena arena;
+static uint8_t *nextmem;
+
+/*
+ * Chunks provider serving memory from the test buffers, the core memory is
+ * not touched.
+ */
+static void *test_provider(size_t size) {
+  void *p;
+
+  size = MEM_ALIGN_NEXT(size);
+  if ((size_t)(test.buffer + sizeof test.buffer - nextmem) < size)
+    return NULL;
+  p = nextmem;
+  nextmem += size;
+  return p;
+}
+
+static void *null_provider(size_t size) {
+
+  (void)size;
+  return NULL;
+}
+
+static void arena_setup(void) {
+
+  nextmem = test.buffer;
+  chArenaInit(&arena, CHUNK_SIZE, test_provider);
+}
+
+/**
+ * @page test_arena_001 Allocation, mark/release and reset
+ *
+ * <h2>Description</h2>
+ * Blocks are allocated from an arena until new chunks are required, then
+ * the arena is moved back using a mark and reset.<br>
+ * The test expects the blocks to be contiguous inside the chunks, the
+ * oversized blocks to get a chunk of their own and the retained chunks to
+ * be reused without invoking the provider again.
+ */
+
+static void arena1_execute(void) {
+  uint8_t *p1, *p2, *p3, *p4;
+  ArenaMark mark;
+
+  /* Filling the first chunk.*/
+  p1 = chArenaAllocFrom(&arena, BLOCK_SIZE);
+  test_assert(1, p1 != NULL, "allocation failed");
+  p2 = chArenaAllocFrom(&arena, CHUNK_SIZE - BLOCK_SIZE);
+  test_assert(2, p2 == p1 + BLOCK_SIZE, "not contiguous");
+  test_assert(3, arena.ma_refills == 1, "unexpected refill");
+
+  /* Second chunk.*/
+  p3 = chArenaAllocFrom(&arena, BLOCK_SIZE);
+  test_assert(4, p3 != NULL, "allocation failed");
+  test_assert(5, arena.ma_refills == 2, "chunk not obtained");
+
+  /* Oversized block after a mark.*/
+  chArenaGetMark(&arena, &mark);
+  p4 = chArenaAllocFrom(&arena, CHUNK_SIZE + BLOCK_SIZE);
+  test_assert(6, p4 != NULL, "allocation failed");
+  test_assert(7, arena.ma_refills == 3, "chunk not obtained");
+
+  /* Release to the mark.*/
+  chArenaRelease(&arena, &mark);
+  test_assert(8, chArenaAllocFrom(&arena, BLOCK_SIZE) == p3 + BLOCK_SIZE,
+              "wrong position");
+
+  /* Reset, the chunks must be reused in order.*/
+  chArenaReset(&arena);
+  test_assert(9, chArenaAllocFrom(&arena, BLOCK_SIZE) == p1,
+              "wrong position");
+  test_assert(10, chArenaAllocFrom(&arena, CHUNK_SIZE - BLOCK_SIZE) == p2,
+              "wrong position");
+  test_assert(11, chArenaAllocFrom(&arena, CHUNK_SIZE) == p3,
+              "chunk not reused");
+  test_assert(12, chArenaAllocFrom(&arena, CHUNK_SIZE + BLOCK_SIZE) == p4,
+              "chunk not reused");
+  test_assert(13, arena.ma_refills == 3, "unexpected refill");
+
+  /* Covering the case where a provider is unable to return more memory.*/
+  chArenaInit(&arena, CHUNK_SIZE, null_provider);
+  test_assert(14, chArenaAllocFrom(&arena, BLOCK_SIZE) == NULL,
+              "provider returned memory");
+}
+
+ROMCONST struct testcase testarena1 = {
+  "Memory Arenas, allocation, mark/release and reset",
+  arena_setup,
+  NULL,
+  arena1_execute
+};
+
+#if CH_USE_MEMPOOLS || defined(__DOXYGEN__)
+/**
+ * @page test_arena_002 Thread arena as pool provider
+ *
+ * <h2>Description</h2>
+ * The arena is registered as arena of the current thread and the function
+ * @p chArenaAllocI() is used as provider of an empty memory pool.<br>
+ * The test expects the pool objects to be allocated contiguously from the
+ * arena and the previous thread arena to be restored.
+ */
+
+static void arena2_execute(void) {
+  MemoryArena *omap;
+  MemoryPool mp;
+  uint8_t *p1, *p2;
+
+  omap = chArenaSetSelf(&arena);
+  test_assert(1, chArenaGetSelf() == &arena, "arena not set");
+
+  chPoolInit(&mp, BLOCK_SIZE, chArenaAllocI);
+  p1 = chPoolAlloc(&mp);
+  p2 = chPoolAlloc(&mp);
+  test_assert(2, (p1 != NULL) && (p2 == p1 + BLOCK_SIZE),
+              "not allocated from arena");
+  test_assert(3, arena.ma_nextmem == p2 + BLOCK_SIZE, "wrong arena position");
+
+  /* Returned objects are recycled by the pool.*/
+  chPoolFree(&mp, p1);
+  test_assert(4, chPoolAlloc(&mp) == p1, "not recycled");
+
+  test_assert(5, chArenaSetSelf(omap) == &arena, "wrong arena");
+}
+
+ROMCONST struct testcase testarena2 = {
+  "Memory Arenas, thread arena as pool provider",
+  arena_setup,
+  NULL,
+  arena2_execute
+};
+#endif /* CH_USE_MEMPOOLS */
+
+#endif /* CH_USE_MEMARENAS */
+
+/**
+ * @brief   Test sequence for arenas.
+ */
+ROMCONST struct testcase * ROMCONST patternarena[] = {
+#if CH_USE_MEMARENAS || defined(__DOXYGEN__)
+  &testarena1,
+#if CH_USE_MEMPOOLS || defined(__DOXYGEN__)
+  &testarena2,
+#endif
+#endif
+  NULL
+};
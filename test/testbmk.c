@@ -34,7 +34,13 @@
  * <h2>Objective</h2>
  * Objective of the test module is to provide a performance index for the
  * most critical system subsystems. The performance numbers allow to
- * discover performance regressions between successive ChibiOS/RT releases.
+ * discover performance regressions between successive ChibiOS/RT releases.<br>
+ * Besides the throughput score the benchmarks measure the latency of each
+ * operation in a separate pass executed before the throughput one, so the
+ * scores are not affected by the measurement. The minimum, median,
+ * percentile and maximum figures are printed followed by a machine readable
+ * record, see @p test_bench_end(). The latency pass is excluded if
+ * @p TEST_BENCH_LATENCY is @p FALSE.
  *
  * <h2>Preconditions</h2>
  * None.
@@ -53,6 +59,11 @@
  * - @subpage test_benchmarks_011
  * - @subpage test_benchmarks_012
  * - @subpage test_benchmarks_013
+ * - @subpage test_benchmarks_014
+ * - @subpage test_benchmarks_015
+ * - @subpage test_benchmarks_016
+ * - @subpage test_benchmarks_017
+ * - @subpage test_benchmarks_018
  * .
  * @file testbmk.c Kernel Benchmarks
  * @brief Kernel Benchmarks source file
@@ -84,6 +95,15 @@ __attribute__((noinline))
 static unsigned int msg_loop_test(Thread *tp) {
 
   uint32_t n = 0;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    (void)chMsgSend(tp, 1);
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -117,6 +137,7 @@ static void bmk1_execute(void) {
   test_print(" msgs/S, ");
   test_printn(n << 1);
   test_println(" ctxswc/S");
+  test_bench_end(1);
 }
 
 ROMCONST struct testcase testbmk1 = {
@@ -146,6 +167,7 @@ static void bmk2_execute(void) {
   test_print(" msgs/S, ");
   test_printn(n << 1);
   test_println(" ctxswc/S");
+  test_bench_end(1);
 }
 
 ROMCONST struct testcase testbmk2 = {
@@ -185,6 +207,7 @@ static void bmk3_execute(void) {
   test_print(" msgs/S, ");
   test_printn(n << 1);
   test_println(" ctxswc/S");
+  test_bench_end(1);
 }
 
 ROMCONST struct testcase testbmk3 = {
@@ -224,6 +247,20 @@ static void bmk4_execute(void) {
 
   tp = threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority()+1, thread4, NULL);
   n = 0;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chSysLock();
+    chSchWakeupS(tp, RDY_OK);
+    chSchWakeupS(tp, RDY_OK);
+    chSchWakeupS(tp, RDY_OK);
+    chSchWakeupS(tp, RDY_OK);
+    chSysUnlock();
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -246,6 +283,7 @@ static void bmk4_execute(void) {
   test_print("--- Score : ");
   test_printn(n * 2);
   test_println(" ctxswc/S");
+  test_bench_end(8);
 }
 
 ROMCONST struct testcase testbmk4 = {
@@ -271,6 +309,15 @@ static void bmk5_execute(void) {
   uint32_t n = 0;
   void *wap = wa[0];
   tprio_t prio = chThdGetPriority() - 1;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chThdWait(chThdCreateStatic(wap, WA_SIZE, prio, thread2, NULL));
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -283,6 +330,7 @@ static void bmk5_execute(void) {
   test_print("--- Score : ");
   test_printn(n);
   test_println(" threads/S");
+  test_bench_end(1);
 }
 
 ROMCONST struct testcase testbmk5 = {
@@ -310,6 +358,15 @@ static void bmk6_execute(void) {
   uint32_t n = 0;
   void *wap = wa[0];
   tprio_t prio = chThdGetPriority() + 1;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chThdCreateStatic(wap, WA_SIZE, prio, thread2, NULL);
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -322,6 +379,7 @@ static void bmk6_execute(void) {
   test_print("--- Score : ");
   test_printn(n);
   test_println(" threads/S");
+  test_bench_end(1);
 }
 
 ROMCONST struct testcase testbmk6 = {
@@ -339,7 +397,8 @@ ROMCONST struct testcase testbmk6 = {
  * semaphore where they are waiting on. The operation is performed into a
  * continuous loop.<br>
  * The performance is calculated by measuring the number of iterations after
- * a second of continuous operations.
+ * a second of continuous operations. The latency is measured for one to
+ * five waiting threads.
  */
 
 static msg_t thread3(void *p) {
@@ -356,13 +415,24 @@ static void bmk7_setup(void) {
 }
 
 static void bmk7_execute(void) {
-  uint32_t n;
-
-  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority()+5, thread3, NULL);
-  threads[1] = chThdCreateStatic(wa[1], WA_SIZE, chThdGetPriority()+4, thread3, NULL);
-  threads[2] = chThdCreateStatic(wa[2], WA_SIZE, chThdGetPriority()+3, thread3, NULL);
-  threads[3] = chThdCreateStatic(wa[3], WA_SIZE, chThdGetPriority()+2, thread3, NULL);
-  threads[4] = chThdCreateStatic(wa[4], WA_SIZE, chThdGetPriority()+1, thread3, NULL);
+  uint32_t i, n;
+
+  /* Latency sweep over the number of waiting threads.*/
+  for (i = 0; i < MAX_THREADS; i++) {
+    threads[i] = chThdCreateStatic(wa[i], WA_SIZE,
+                                   chThdGetPriority() + MAX_THREADS - i,
+                                   thread3, NULL);
+    test_bench_begin("threads", i + 1);
+    while (test_bench_sampling()) {
+      test_bench_start();
+      chSemReset(&sem1, 0);
+      test_bench_stop();
+#if defined(SIMULATOR)
+      ChkIntSources();
+#endif
+    }
+    test_bench_end(1);
+  }
 
   n = 0;
   test_wait_tick();
@@ -452,16 +522,36 @@ ROMCONST struct testcase testbmk8 = {
  * Four bytes are written and then read from an @p InputQueue into a continuous
  * loop.<br>
  * The performance is calculated by measuring the number of iterations after
- * a second of continuous operations.
+ * a second of continuous operations. The latency is also measured for
+ * blocks of one and sixteen bytes read using @p chIQReadTimeout().
  */
 
 static void bmk9_execute(void) {
-  uint32_t n;
-  static uint8_t ib[16];
+  static const uint32_t sizes[] = {1, 16};
+  uint32_t i, j, n;
+  static uint8_t ib[16], ob[16];
   static InputQueue iq;
 
   chIQInit(&iq, ib, sizeof(ib), NULL, NULL);
   n = 0;
+  test_bench_begin("bytes", 4);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chSysLock();
+    chIQPutI(&iq, 0);
+    chIQPutI(&iq, 1);
+    chIQPutI(&iq, 2);
+    chIQPutI(&iq, 3);
+    chSysUnlock();
+    (void)chIQGet(&iq);
+    (void)chIQGet(&iq);
+    (void)chIQGet(&iq);
+    (void)chIQGet(&iq);
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -483,6 +573,25 @@ static void bmk9_execute(void) {
   test_print("--- Score : ");
   test_printn(n * 4);
   test_println(" bytes/S");
+  test_bench_end(1);
+
+  /* Latency sweep over the block size.*/
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++) {
+    test_bench_begin("bytes", sizes[i]);
+    while (test_bench_sampling()) {
+      test_bench_start();
+      chSysLock();
+      for (j = 0; j < sizes[i]; j++)
+        chIQPutI(&iq, (uint8_t)j);
+      chSysUnlock();
+      (void)chIQReadTimeout(&iq, ob, sizes[i], TIME_IMMEDIATE);
+      test_bench_stop();
+#if defined(SIMULATOR)
+      ChkIntSources();
+#endif
+    }
+    test_bench_end(1);
+  }
 }
 
 ROMCONST struct testcase testbmk9 = {
@@ -507,6 +616,20 @@ static void bmk10_execute(void) {
   static VirtualTimer vt1, vt2;
   uint32_t n = 0;
 
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chSysLock();
+    chVTSetI(&vt1, 1, tmo, NULL);
+    chVTSetI(&vt2, 10000, tmo, NULL);
+    chVTResetI(&vt1);
+    chVTResetI(&vt2);
+    chSysUnlock();
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -524,6 +647,7 @@ static void bmk10_execute(void) {
   test_print("--- Score : ");
   test_printn(n * 2);
   test_println(" timers/S");
+  test_bench_end(2);
 }
 
 ROMCONST struct testcase testbmk10 = {
@@ -551,6 +675,22 @@ static void bmk11_setup(void) {
 static void bmk11_execute(void) {
   uint32_t n = 0;
 
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chSemWait(&sem1);
+    chSemSignal(&sem1);
+    chSemWait(&sem1);
+    chSemSignal(&sem1);
+    chSemWait(&sem1);
+    chSemSignal(&sem1);
+    chSemWait(&sem1);
+    chSemSignal(&sem1);
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -570,6 +710,7 @@ static void bmk11_execute(void) {
   test_print("--- Score : ");
   test_printn(n * 4);
   test_println(" wait+signal/S");
+  test_bench_end(4);
 }
 
 ROMCONST struct testcase testbmk11 = {
@@ -598,6 +739,22 @@ static void bmk12_setup(void) {
 static void bmk12_execute(void) {
   uint32_t n = 0;
 
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chMtxLock(&mtx1);
+    chMtxUnlock();
+    chMtxLock(&mtx1);
+    chMtxUnlock();
+    chMtxLock(&mtx1);
+    chMtxUnlock();
+    chMtxLock(&mtx1);
+    chMtxUnlock();
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
   test_wait_tick();
   test_start_timer(1000);
   do {
@@ -617,6 +774,7 @@ static void bmk12_execute(void) {
   test_print("--- Score : ");
   test_printn(n * 4);
   test_println(" lock+unlock/S");
+  test_bench_end(4);
 }
 
 ROMCONST struct testcase testbmk12 = {
@@ -689,6 +847,402 @@ ROMCONST struct testcase testbmk13 = {
   bmk13_execute
 };
 
+#if (CH_USE_DYNAMIC && CH_USE_HEAP && !CH_USE_MALLOC_HEAP) ||              \
+    defined(__DOXYGEN__)
+/**
+ * @page test_benchmarks_014 Dynamic threads performance, heap, full cycle
+ *
+ * <h2>Description</h2>
+ * Threads are continuously created from a memory heap and terminated into a
+ * loop. A full @p chThdCreateFromHeap() / @p chThdExit() / @p chThdWait()
+ * cycle is performed in each iteration, the working area is returned to
+ * the heap or to the threads cache each time.<br>
+ * The performance is calculated by measuring the number of iterations after
+ * a second of continuous operations.
+ */
+
+static MemoryHeap heap1;
+
+static void bmk14_setup(void) {
+
+  chHeapInit(&heap1, test.buffer, sizeof(union test_buffers));
+}
+
+static void bmk14_teardown(void) {
+
+#if CH_THD_CACHE_SIZE > 0
+  chThdCacheFlush();
+#endif
+}
+
+static void bmk14_execute(void) {
+
+  uint32_t n = 0;
+  tprio_t prio = chThdGetPriority() - 1;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chThdWait(chThdCreateFromHeap(&heap1, WA_SIZE, prio, thread2, NULL));
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    chThdWait(chThdCreateFromHeap(&heap1, WA_SIZE, prio, thread2, NULL));
+    n++;
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  } while (!test_timer_done);
+  test_print("--- Score : ");
+  test_printn(n);
+  test_println(" threads/S");
+  test_bench_end(1);
+}
+
+ROMCONST struct testcase testbmk14 = {
+  "Benchmark, threads from heap, full cycle",
+  bmk14_setup,
+  bmk14_teardown,
+  bmk14_execute
+};
+#endif /* CH_USE_DYNAMIC && CH_USE_HEAP && !CH_USE_MALLOC_HEAP */
+
+#if (CH_USE_DYNAMIC && CH_USE_MEMPOOLS) || defined(__DOXYGEN__)
+/**
+ * @page test_benchmarks_015 Dynamic threads performance, pool, full cycle
+ *
+ * <h2>Description</h2>
+ * Threads are continuously created from a memory pool and terminated into
+ * a loop. A full @p chThdCreateFromMemoryPool() / @p chThdExit() /
+ * @p chThdWait() cycle is performed in each iteration, the working area is
+ * returned to the pool or to the threads cache each time.<br>
+ * The performance is calculated by measuring the number of iterations after
+ * a second of continuous operations.
+ */
+
+static MemoryPool mp1;
+
+static void bmk15_setup(void) {
+
+  chPoolInit(&mp1, WA_SIZE, NULL);
+  chPoolAdd(&mp1, wa[0]);
+}
+
+static void bmk15_teardown(void) {
+
+#if CH_THD_CACHE_SIZE > 0
+  chThdCacheFlush();
+#endif
+}
+
+static void bmk15_execute(void) {
+
+  uint32_t n = 0;
+  tprio_t prio = chThdGetPriority() - 1;
+  test_bench_begin(NULL, 0);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    chThdWait(chThdCreateFromMemoryPool(&mp1, prio, thread2, NULL));
+    test_bench_stop();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    chThdWait(chThdCreateFromMemoryPool(&mp1, prio, thread2, NULL));
+    n++;
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  } while (!test_timer_done);
+  test_print("--- Score : ");
+  test_printn(n);
+  test_println(" threads/S");
+  test_bench_end(1);
+}
+
+ROMCONST struct testcase testbmk15 = {
+  "Benchmark, threads from memory pool, full cycle",
+  bmk15_setup,
+  bmk15_teardown,
+  bmk15_execute
+};
+#endif /* CH_USE_DYNAMIC && CH_USE_MEMPOOLS */
+
+/**
+ * @page test_benchmarks_016 Messages performance, reply and wait
+ *
+ * <h2>Description</h2>
+ * A message server thread is created with an higher priority than the client
+ * thread, the server answers using @p chMsgReplyAndWait() so that the
+ * control is handed over directly in both directions. The messages
+ * throughput per second is measured and the result printed in the output
+ * log, it can be compared with the result of @ref test_benchmarks_002.
+ */
+
+static msg_t thread9(void *p) {
+  Thread *tp;
+  msg_t msg;
+
+  (void)p;
+  tp = chMsgWait();
+  while ((msg = chMsgGet(tp)) != 0)
+    tp = chMsgReplyAndWait(tp, msg);
+  chMsgRelease(tp, msg);
+  return 0;
+}
+
+static void bmk16_execute(void) {
+  uint32_t n;
+
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority()+1, thread9, NULL);
+  n = msg_loop_test(threads[0]);
+  test_wait_threads();
+  test_print("--- Score : ");
+  test_printn(n);
+  test_print(" msgs/S, ");
+  test_printn(n << 1);
+  test_println(" ctxswc/S");
+  test_bench_end(1);
+}
+
+ROMCONST struct testcase testbmk16 = {
+  "Benchmark, messages, reply and wait",
+  NULL,
+  NULL,
+  bmk16_execute
+};
+
+#if (CH_USE_MEMARENAS && CH_USE_HEAP && CH_USE_MEMPOOLS) ||                \
+    defined(__DOXYGEN__)
+/**
+ * @page test_benchmarks_017 Allocators performance
+ *
+ * <h2>Description</h2>
+ * Bursts of small blocks are allocated and then released using the core
+ * allocator, the default heap, a memory pool and the arena of the current
+ * thread.<br>
+ * The performance is calculated by measuring the number of allocations
+ * after a second of continuous operations, the allocation latency is also
+ * measured for each allocator. The core allocator cannot release memory so
+ * only its latency is measured over a limited number of bursts.
+ */
+
+#define ALLOC_SIZE      16
+#define ALLOC_BURST     8
+#define ALLOC_CORE_MAX  (TEST_BENCH_WARMUP + TEST_BENCH_SAMPLES)
+
+static void *blocks[ALLOC_BURST];
+static MemoryPool mp17;
+static MemoryArena arena17;
+static ArenaMark mark17;
+static stkalign_t pool17_buf[ALLOC_BURST * MEM_ALIGN_NEXT(ALLOC_SIZE) /
+                             sizeof (stkalign_t)];
+
+static void *heap_alloc(void) {
+
+  return chHeapAlloc(NULL, ALLOC_SIZE);
+}
+
+static void heap_release(void) {
+  unsigned i;
+
+  for (i = 0; i < ALLOC_BURST; i++)
+    chHeapFree(blocks[i]);
+}
+
+static void *pool_alloc(void) {
+
+  return chPoolAlloc(&mp17);
+}
+
+static void pool_release(void) {
+  unsigned i;
+
+  for (i = 0; i < ALLOC_BURST; i++)
+    chPoolFree(&mp17, blocks[i]);
+}
+
+static void *arena_alloc(void) {
+
+  return chArenaAlloc(ALLOC_SIZE);
+}
+
+static void arena_release(void) {
+
+  chArenaRelease(&arena17, &mark17);
+}
+
+/*
+ * Measures the latency of an allocator then its throughput for a second.
+ */
+static void alloc_loop(const char *name, void *(*alloc)(void),
+                       void (*release)(void)) {
+  uint32_t n = 0;
+  unsigned i;
+
+  test_bench_begin(name, ALLOC_SIZE);
+  while (test_bench_sampling()) {
+    test_bench_start();
+    for (i = 0; i < ALLOC_BURST; i++)
+      blocks[i] = alloc();
+    test_bench_stop();
+    release();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_bench_end(ALLOC_BURST);
+
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    for (i = 0; i < ALLOC_BURST; i++)
+      blocks[i] = alloc();
+    release();
+    n += ALLOC_BURST;
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  } while (!test_timer_done);
+  test_print("--- Score : ");
+  test_printn(n);
+  test_print(" allocs/S, ");
+  test_println(name);
+}
+
+static void bmk17_setup(void) {
+
+  chPoolInit(&mp17, MEM_ALIGN_NEXT(ALLOC_SIZE), NULL);
+  chPoolLoadArray(&mp17, pool17_buf, ALLOC_BURST);
+  chArenaInit(&arena17, 1024, NULL);
+}
+
+static void bmk17_execute(void) {
+  MemoryArena *omap;
+#if TEST_BENCH_LATENCY
+  unsigned i;
+
+  /* The core allocator cannot release memory, only its latency is
+     measured.*/
+  if (chCoreStatus() >= 4 * ALLOC_CORE_MAX * ALLOC_BURST * ALLOC_SIZE) {
+    test_bench_begin("core", ALLOC_SIZE);
+    while (test_bench_sampling()) {
+      test_bench_start();
+      for (i = 0; i < ALLOC_BURST; i++)
+        blocks[i] = chCoreAlloc(ALLOC_SIZE);
+      test_bench_stop();
+#if defined(SIMULATOR)
+      ChkIntSources();
+#endif
+    }
+    test_bench_end(ALLOC_BURST);
+  }
+#endif
+
+  alloc_loop("heap", heap_alloc, heap_release);
+  alloc_loop("pool", pool_alloc, pool_release);
+
+  omap = chArenaSetSelf(&arena17);
+  chArenaGetMark(&arena17, &mark17);
+  alloc_loop("arena", arena_alloc, arena_release);
+  chArenaSetSelf(omap);
+}
+
+ROMCONST struct testcase testbmk17 = {
+  "Benchmark, allocators",
+  bmk17_setup,
+  NULL,
+  bmk17_execute
+};
+#endif /* CH_USE_MEMARENAS && CH_USE_HEAP && CH_USE_MEMPOOLS */
+
+#if CH_USE_EDF || defined(__DOXYGEN__)
+/**
+ * @page test_benchmarks_018 Ready list insertion, fixed priority and EDF
+ *
+ * <h2>Description</h2>
+ * Four suspended threads of equal priority are inserted in the ready list
+ * and then removed, first at a fixed priority level and then in the EDF
+ * band with increasing deadlines, each insertion scans all the previously
+ * inserted threads in both cases.<br>
+ * The performance is calculated by measuring the number of insertions
+ * after a second of continuous operations.
+ */
+
+#define READY_THREADS   4
+
+static void ready_loop(const char *name, tprio_t prio) {
+  uint32_t n = 0;
+  unsigned i;
+
+  chSysLock();
+  for (i = 0; i < READY_THREADS; i++) {
+    threads[i] = chThdCreateI(wa[i], WA_SIZE, prio, thread2, NULL);
+    threads[i]->p_deadline = chTimeNow() + i;
+  }
+  chSysUnlock();
+
+  test_bench_begin(name, READY_THREADS);
+  while (test_bench_sampling()) {
+    chSysLock();
+    test_bench_start();
+    for (i = 0; i < READY_THREADS; i++)
+      chSchReadyI(threads[i]);
+    test_bench_stop();
+    for (i = 0; i < READY_THREADS; i++)
+      dequeue(threads[i])->p_state = THD_STATE_SUSPENDED;
+    chSysUnlock();
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_bench_end(READY_THREADS);
+
+  test_wait_tick();
+  test_start_timer(1000);
+  do {
+    chSysLock();
+    for (i = 0; i < READY_THREADS; i++)
+      chSchReadyI(threads[i]);
+    for (i = 0; i < READY_THREADS; i++)
+      dequeue(threads[i])->p_state = THD_STATE_SUSPENDED;
+    chSysUnlock();
+    n += READY_THREADS;
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  } while (!test_timer_done);
+
+  for (i = 0; i < READY_THREADS; i++)
+    chThdResume(threads[i]);
+  test_wait_threads();
+  test_print("--- Score : ");
+  test_printn(n);
+  test_print(" insertions/S, ");
+  test_println(name);
+}
+
+static void bmk18_execute(void) {
+
+  ready_loop("fixed", chThdGetPriority() - 1);
+  ready_loop("edf", CH_EDF_PRIO);
+}
+
+ROMCONST struct testcase testbmk18 = {
+  "Benchmark, ready list insertion, fixed priority and EDF",
+  NULL,
+  NULL,
+  bmk18_execute
+};
+#endif /* CH_USE_EDF */
+
 /**
  * @brief   Test sequence for benchmarks.
  */
@@ -709,6 +1263,21 @@ ROMCONST struct testcase * ROMCONST patternbmk[] = {
   &testbmk12,
 #endif
   &testbmk13,
+#if (CH_USE_DYNAMIC && CH_USE_HEAP && !CH_USE_MALLOC_HEAP) ||              \
+    defined(__DOXYGEN__)
+  &testbmk14,
+#endif
+#if (CH_USE_DYNAMIC && CH_USE_MEMPOOLS) || defined(__DOXYGEN__)
+  &testbmk15,
+#endif
+  &testbmk16,
+#if (CH_USE_MEMARENAS && CH_USE_HEAP && CH_USE_MEMPOOLS) ||                \
+    defined(__DOXYGEN__)
+  &testbmk17,
+#endif
+#if CH_USE_EDF || defined(__DOXYGEN__)
+  &testbmk18,
+#endif
 #endif
   NULL
 };
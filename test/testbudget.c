@@ -0,0 +1,249 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ch.h"
+#include "test.h"
+
+/**
+ * @page test_budget CPU Budget Servers test
+ *
+ * File: @ref testbudget.c
+ *
+ * <h2>Description</h2>
+ * This module implements the test sequence for the @ref budgets subsystem
+ * and for the per-thread round robin quanta.
+ *
+ * <h2>Objective</h2>
+ * Objective of the test module is to cover 100% of the @ref budgets code
+ * and to verify that a budget server bounds the interference of its group
+ * on lower priority threads.
+ *
+ * <h2>Preconditions</h2>
+ * The module requires the following kernel options:
+ * - @p CH_USE_BUDGETS (test cases #1 and #2)
+ * - @p CH_TIME_QUANTUM greater than zero (test case #3)
+ * .
+ * In case some of the required options are not enabled then some or all tests
+ * may be skipped.
+ *
+ * <h2>Test Cases</h2>
+ * - @subpage test_budget_001
+ * - @subpage test_budget_002
+ * - @subpage test_budget_003
+ * .
+ * @file testbudget.c
+ * @brief CPU Budget Servers test source file
+ * @file testbudget.h
+ * @brief CPU Budget Servers test header file
+ */
+
+#if CH_USE_BUDGETS || defined(__DOXYGEN__)
+
+#define BUDGET      2
+#define PERIOD      10
+#define WINDOW      (PERIOD * 10)
+
+static BudgetServer server;
+
+/**
+ * @page test_budget_001 Group demotion and restore
+ *
+ * <h2>Description</h2>
+ * The test thread joins a server with a single tick budget and runs until
+ * the budget is exhausted, its priority is expected to be lowered to the
+ * server low priority. A priority change while demoted is expected to be
+ * deferred, leaving the group is expected to restore the own priority.
+ */
+
+static void budget1_execute(void) {
+  tprio_t prio = chThdGetPriority();
+
+  chBudgetObjectInit(&server, 1, S2ST(10), prio - 1);
+  chBudgetAdd(&server, chThdSelf());
+  chBudgetStart(&server);
+  while (!chBudgetIsDepletedI(&server)) {
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_assert(1, chThdGetPriority() == prio - 1, "not demoted");
+  test_assert(2, chThdSetPriority(prio + 1) == prio, "wrong own priority");
+  test_assert(3, chThdGetPriority() == prio - 1, "priority changed");
+  chBudgetRemove(chThdSelf());
+  test_assert(4, chThdGetPriority() == prio + 1, "not restored");
+  (void)chThdSetPriority(prio);
+  test_assert(5, server.bs_depletions == 1, "wrong depletions count");
+  chBudgetStop(&server);
+}
+
+ROMCONST struct testcase testbudget1 = {
+  "CPU budgets, group demotion and restore",
+  NULL,
+  NULL,
+  budget1_execute
+};
+
+/**
+ * @page test_budget_002 Bounded interference
+ *
+ * <h2>Description</h2>
+ * A thread spinning at a priority higher than the test thread is limited
+ * by a server to @p BUDGET ticks every @p PERIOD ticks. The test thread
+ * is expected to make progress and the spinning thread is expected to be
+ * charged no more than its budget in each period.
+ */
+
+static msg_t hog(void *p) {
+
+  (void)p;
+  while (!chThdShouldTerminate()) {
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  return 0;
+}
+
+static void budget2_execute(void) {
+  systime_t start;
+  uint32_t consumed;
+  unsigned n = 0;
+
+  chBudgetObjectInit(&server, BUDGET, PERIOD, chThdGetPriority() - 1);
+  start = test_wait_tick();
+  chSysLock();
+  threads[0] = chThdCreateI(wa[0], WA_SIZE, chThdGetPriority() + 1,
+                            hog, NULL);
+  chBudgetAddI(&server, threads[0]);
+  chBudgetStartI(&server);
+  chSchWakeupS(threads[0], RDY_OK);
+  chSysUnlock();
+  while ((systime_t)(chTimeNow() - start) < WINDOW) {
+    n++;
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  consumed = server.bs_consumed;
+  chThdTerminate(threads[0]);
+  test_wait_threads();
+  chBudgetStop(&server);
+
+  test_assert(1, n > 0, "starved");
+  test_assert(2, consumed <= BUDGET * (WINDOW / PERIOD + 1),
+              "budget exceeded");
+  test_assert(3, server.bs_depletions >= WINDOW / PERIOD - 1,
+              "budget not depleted");
+}
+
+ROMCONST struct testcase testbudget2 = {
+  "CPU budgets, bounded interference",
+  NULL,
+  NULL,
+  budget2_execute
+};
+
+#endif /* CH_USE_BUDGETS */
+
+#if (CH_TIME_QUANTUM > 0) || defined(__DOXYGEN__)
+
+#define SMALL_QUANTUM   2
+#define LARGE_QUANTUM   20
+#define BATCH_WINDOW    100
+
+/**
+ * @page test_budget_003 Per-thread time quanta
+ *
+ * <h2>Description</h2>
+ * Two batch workers of equal priority spin for a fixed time, first with a
+ * small and then with a large round robin quantum. The number of switches
+ * between the workers is expected to be bounded by the number of quanta
+ * in the run and to decrease with the larger quantum.
+ */
+
+static Thread * volatile last;
+static unsigned switches;
+static tslices_t quantum;
+static systime_t batch_start;
+
+static msg_t worker(void *p) {
+
+  (void)p;
+  (void)chThdSetQuantum(quantum);
+  while ((systime_t)(chTimeNow() - batch_start) < BATCH_WINDOW) {
+    if (last != chThdSelf()) {
+      last = chThdSelf();
+      switches++;
+    }
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  return 0;
+}
+
+static unsigned batch_run(tslices_t q) {
+
+  quantum = q;
+  switches = 0;
+  last = NULL;
+  batch_start = test_wait_tick();
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority() - 1,
+                                 worker, NULL);
+  threads[1] = chThdCreateStatic(wa[1], WA_SIZE, chThdGetPriority() - 1,
+                                 worker, NULL);
+  test_wait_threads();
+  return switches;
+}
+
+static void budget3_execute(void) {
+  unsigned small, large;
+
+  small = batch_run(SMALL_QUANTUM);
+  large = batch_run(LARGE_QUANTUM);
+  test_assert(1, small <= BATCH_WINDOW / SMALL_QUANTUM + 2,
+              "too many switches");
+  test_assert(2, large <= BATCH_WINDOW / LARGE_QUANTUM + 2,
+              "too many switches");
+  test_assert(3, large < small, "no improvement");
+}
+
+ROMCONST struct testcase testbudget3 = {
+  "CPU budgets, per-thread time quanta",
+  NULL,
+  NULL,
+  budget3_execute
+};
+
+#endif /* CH_TIME_QUANTUM > 0 */
+
+/**
+ * @brief   Test sequence for CPU budgets.
+ */
+ROMCONST struct testcase * ROMCONST patternbudget[] = {
+#if CH_USE_BUDGETS || defined(__DOXYGEN__)
+  &testbudget1,
+  &testbudget2,
+#endif
+#if (CH_TIME_QUANTUM > 0) || defined(__DOXYGEN__)
+  &testbudget3,
+#endif
+  NULL
+};
@@ -78,6 +78,19 @@ static msg_t thread(void *p) {
   return 0;
 }
 
+#if CH_THD_CACHE_SIZE > 0
+/*
+ * The allocators are initialized again by the next test case, the cached
+ * working areas must not survive them.
+ */
+static void dyn_teardown(void) {
+
+  chThdCacheFlush();
+}
+#else
+#define dyn_teardown NULL
+#endif
+
 #if (CH_USE_HEAP && !CH_USE_MALLOC_HEAP) || defined(__DOXYGEN__)
 static void dyn1_setup(void) {
 
@@ -114,6 +127,9 @@ static void dyn1_execute(void) {
   test_assert_sequence(2, "AB");
 
   /* Heap status checked again.*/
+#if CH_THD_CACHE_SIZE > 0
+  chThdCacheFlush();
+#endif
   test_assert(3, chHeapStatus(&heap1, &n) == 1, "heap fragmented");
   test_assert(4, n == sz, "heap size changed");
 }
@@ -121,7 +137,7 @@ static void dyn1_execute(void) {
 ROMCONST struct testcase testdyn1 = {
   "Dynamic APIs, threads creation from heap",
   dyn1_setup,
-  NULL,
+  dyn_teardown,
   dyn1_execute
 };
 #endif /* (CH_USE_HEAP && !CH_USE_MALLOC_HEAP) */
@@ -148,7 +164,7 @@ static void dyn2_execute(void) {
 
   /* Adding the WAs to the pool. */
   for (i = 0; i < 4; i++)
-    chPoolFree(&mp1, wa[i]);
+    chPoolAdd(&mp1, wa[i]);
 
   /* Starting threads from the memory pool. */
   threads[0] = chThdCreateFromMemoryPool(&mp1, prio-1, thread, "A");
@@ -169,6 +185,9 @@ static void dyn2_execute(void) {
   test_assert_sequence(2, "ABCD");
 
   /* Now the pool must be full again. */
+#if CH_THD_CACHE_SIZE > 0
+  chThdCacheFlush();
+#endif
   for (i = 0; i < 4; i++)
     test_assert(3, chPoolAlloc(&mp1) != NULL, "pool list empty");
   test_assert(4, chPoolAlloc(&mp1) == NULL, "pool list not empty");
@@ -177,7 +196,7 @@ static void dyn2_execute(void) {
 ROMCONST struct testcase testdyn2 = {
   "Dynamic APIs, threads creation from memory pool",
   dyn2_setup,
-  NULL,
+  dyn_teardown,
   dyn2_execute
 };
 #endif /* CH_USE_MEMPOOLS */
@@ -204,6 +223,21 @@ static bool_t regfind(Thread *tp) {
   return found;
 }
 
+/*
+ * The snapshot does not add references, the thread is not affected.
+ */
+static bool_t snapfind(Thread *tp) {
+  ThreadSnapshot ts[16];
+  cnt_t i, n;
+
+  n = chRegSnapshot(ts, 16);
+  for (i = 0; (i < n) && (i < 16); i++) {
+    if ((ts[i].ts_thread == tp) && (ts[i].ts_refs == tp->p_refs))
+      return TRUE;
+  }
+  return FALSE;
+}
+
 static void dyn3_setup(void) {
 
   chHeapInit(&heap1, test.buffer, sizeof(union test_buffers));
@@ -224,25 +258,26 @@ static void dyn3_execute(void) {
   /* Verify the new threads count.*/
   test_assert(4, regfind(tp), "thread missing from registry");
   test_assert(5, regfind(tp), "thread disappeared");
+  test_assert(6, snapfind(tp), "thread missing from snapshot");
 
   /* Detach and let the thread execute and terminate.*/
   chThdRelease(tp);
-  test_assert(6, tp->p_refs == 0, "detach failure");
-  test_assert(7, tp->p_state == THD_STATE_READY, "invalid state");
-  test_assert(8, regfind(tp), "thread disappeared");
+  test_assert(7, tp->p_refs == 0, "detach failure");
+  test_assert(8, tp->p_state == THD_STATE_READY, "invalid state");
   test_assert(9, regfind(tp), "thread disappeared");
+  test_assert(10, regfind(tp), "thread disappeared");
   chThdSleepMilliseconds(50);           /* The thread just terminates.      */
-  test_assert(10, tp->p_state == THD_STATE_FINAL, "invalid state");
+  test_assert(11, tp->p_state == THD_STATE_FINAL, "invalid state");
 
   /* Clearing the zombie by scanning the registry.*/
-  test_assert(11, regfind(tp), "thread disappeared");
-  test_assert(12, !regfind(tp), "thread still in registry");
+  test_assert(12, regfind(tp), "thread disappeared");
+  test_assert(13, !regfind(tp), "thread still in registry");
 }
 
 ROMCONST struct testcase testdyn3 = {
   "Dynamic APIs, registry and references",
   dyn3_setup,
-  NULL,
+  dyn_teardown,
   dyn3_execute
 };
 #endif /* CH_USE_HEAP && CH_USE_REGISTRY */
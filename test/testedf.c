@@ -0,0 +1,223 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ch.h"
+#include "test.h"
+
+/**
+ * @page test_edf EDF Scheduling test
+ *
+ * File: @ref testedf.c
+ *
+ * <h2>Description</h2>
+ * This module implements the test sequence for the EDF scheduling class
+ * of the @ref scheduler and for the periodic threads APIs.
+ *
+ * <h2>Objective</h2>
+ * Objective of the test module is to verify the deadline ordering of the
+ * EDF band and to show that a task set not schedulable by rate monotonic
+ * priorities is scheduled by EDF without deadline misses.
+ *
+ * <h2>Preconditions</h2>
+ * The module requires the following kernel options:
+ * - @p CH_USE_EDF
+ * - @p CH_USE_WAITEXIT
+ * - @p CH_DBG_THREADS_PROFILING (test case #2)
+ * .
+ * In case some of the required options are not enabled then some or all tests
+ * may be skipped.
+ *
+ * <h2>Test Cases</h2>
+ * - @subpage test_edf_001
+ * - @subpage test_edf_002
+ * - @subpage test_edf_003
+ * .
+ * @file testedf.c
+ * @brief EDF Scheduling test source file
+ * @file testedf.h
+ * @brief EDF Scheduling test header file
+ */
+
+#if (CH_USE_EDF && CH_USE_WAITEXIT) || defined(__DOXYGEN__)
+
+/**
+ * @page test_edf_001 Deadline ordering
+ *
+ * <h2>Description</h2>
+ * Five threads are made ready in the EDF band with absolute deadlines not
+ * in arrival order, one of them already expired. The threads are expected
+ * to run in deadline order.
+ */
+
+static msg_t thread1(void *p) {
+
+  test_emit_token(*(char *)p);
+  return 0;
+}
+
+static Thread *edf_ready(void *wsp, systime_t deadline, char *token) {
+  Thread *tp;
+
+  tp = chThdCreateI(wsp, WA_SIZE, CH_EDF_PRIO, thread1, token);
+  tp->p_deadline = deadline;
+  return chSchReadyI(tp);
+}
+
+static void edf1_execute(void) {
+  systime_t now;
+
+  chSysLock();
+  now = chTimeNow();
+  threads[0] = edf_ready(wa[0], now + 40, "A");
+  threads[1] = edf_ready(wa[1], now + 10, "B");
+  threads[2] = edf_ready(wa[2], now + 30, "C");
+  threads[3] = edf_ready(wa[3], now + 20, "D");
+  threads[4] = edf_ready(wa[4], now - 5, "E");
+  chSchRescheduleS();
+  chSysUnlock();
+  test_wait_threads();
+  test_assert_sequence(1, "EBDCA");
+}
+
+ROMCONST struct testcase testedf1 = {
+  "EDF, deadline ordering",
+  NULL,
+  NULL,
+  edf1_execute
+};
+
+#if CH_DBG_THREADS_PROFILING || defined(__DOXYGEN__)
+/**
+ * @page test_edf_002 Schedulability above the rate monotonic bound
+ *
+ * <h2>Description</h2>
+ * Two periodic threads, 20mS every 50mS and 35mS every 70mS, load the
+ * system at 90% for a whole hyperperiod. With rate monotonic priorities
+ * the second thread is expected to miss deadlines, in the EDF band both
+ * threads are expected to meet all their deadlines.
+ */
+
+struct edf_task {
+  unsigned      cost;           /* CPU time of each job in mS.              */
+  unsigned      period;         /* Period and relative deadline in mS.      */
+  uint32_t      jobs;           /* Jobs in the hyperperiod.                 */
+};
+
+static ROMCONST struct edf_task task1 = {20, 50, 7};
+static ROMCONST struct edf_task task2 = {35, 70, 5};
+static systime_t edf_start;
+
+static msg_t periodic(void *p) {
+  const struct edf_task *etp = p;
+
+  chThdSleepUntil(edf_start);
+  chThdSetPeriodic(MS2ST(etp->period), MS2ST(etp->period));
+  do {
+    test_cpu_pulse(etp->cost);
+    chThdWaitNextPeriod();
+  } while (chThdGetJobs(chThdSelf()) < etp->jobs);
+  return (msg_t)chThdGetDeadlineMisses(chThdSelf());
+}
+
+/*
+ * Runs the task set for a hyperperiod, returns the deadline misses of each
+ * thread.
+ */
+static void edf_run(tprio_t prio1, tprio_t prio2, msg_t *m1p, msg_t *m2p) {
+
+  edf_start = chTimeNow() + MS2ST(10);
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, prio1, periodic,
+                                 (void *)&task1);
+  threads[1] = chThdCreateStatic(wa[1], WA_SIZE, prio2, periodic,
+                                 (void *)&task2);
+  *m1p = chThdWait(threads[0]);
+  threads[0] = NULL;
+  *m2p = chThdWait(threads[1]);
+  threads[1] = NULL;
+}
+
+static void edf2_execute(void) {
+  msg_t m1, m2;
+
+  /* Rate monotonic, the shorter period has the higher priority.*/
+  edf_run(chThdGetPriority() + 2, chThdGetPriority() + 1, &m1, &m2);
+  test_assert(1, m1 == 0, "deadline missed by the higher priority");
+  test_assert(2, m2 > 0, "no deadline misses under rate monotonic");
+
+  /* Earliest deadline first.*/
+  edf_run(CH_EDF_PRIO, CH_EDF_PRIO, &m1, &m2);
+  test_assert(3, (m1 == 0) && (m2 == 0), "deadline missed under EDF");
+}
+
+ROMCONST struct testcase testedf2 = {
+  "EDF, schedulability above the rate monotonic bound",
+  NULL,
+  NULL,
+  edf2_execute
+};
+#endif /* CH_DBG_THREADS_PROFILING */
+
+/**
+ * @page test_edf_003 Non periodic threads timing
+ *
+ * <h2>Description</h2>
+ * A thread is created, without running it, in a working area filled with
+ * a non zero pattern as a recycled area would be. The thread is expected
+ * to have no deadline, period, jobs nor deadline misses.
+ */
+
+static void edf3_execute(void) {
+  uint8_t *p;
+
+  for (p = (uint8_t *)wa[0]; p < (uint8_t *)wa[0] + WA_SIZE; p++)
+    *p = 0x55;
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority() - 1,
+                                 thread1, "A");
+  test_assert(1, chThdGetJobs(threads[0]) == 0, "jobs not zero");
+  test_assert(2, chThdGetDeadlineMisses(threads[0]) == 0,
+              "deadline misses not zero");
+  test_assert(3, (threads[0]->p_deadline == 0) &&
+                 (threads[0]->p_period == 0), "timing not cleared");
+  test_wait_threads();
+  test_assert_sequence(4, "A");
+}
+
+ROMCONST struct testcase testedf3 = {
+  "EDF, non periodic threads timing",
+  NULL,
+  NULL,
+  edf3_execute
+};
+
+#endif /* CH_USE_EDF && CH_USE_WAITEXIT */
+
+/**
+ * @brief   Test sequence for EDF scheduling.
+ */
+ROMCONST struct testcase * ROMCONST patternedf[] = {
+#if (CH_USE_EDF && CH_USE_WAITEXIT) || defined(__DOXYGEN__)
+  &testedf1,
+#if CH_DBG_THREADS_PROFILING || defined(__DOXYGEN__)
+  &testedf2,
+#endif
+  &testedf3,
+#endif
+  NULL
+};
@@ -35,12 +35,14 @@
  * <h2>Preconditions</h2>
  * The module requires the following kernel options:
  * - @p CH_USE_HEAP
+ * - @p CH_USE_MEMACCT (test @ref test_heap_002 only)
  * .
  * In case some of the required options are not enabled then some or all tests
  * may be skipped.
  *
  * <h2>Test Cases</h2>
  * - @subpage test_heap_001
+ * - @subpage test_heap_002
  * .
  * @file testheap.c
  * @brief Heap test source file
@@ -150,6 +152,92 @@ ROMCONST struct testcase testheap1 = {
   heap1_execute
 };
 
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+/**
+ * @page test_heap_002 Memory accounting test
+ *
+ * <h2>Description</h2>
+ * The heap account and the owners table are checked after an allocation,
+ * a release and a failed allocation. A thread then allocates a block and
+ * terminates without releasing it, the block is expected to remain
+ * accounted to the terminated thread until it is released by the test
+ * thread.
+ */
+
+static MemAcctSnapshot snapshot;
+static unsigned leak_owner;
+
+static void heap2_setup(void) {
+
+  chHeapInit(&test_heap, wa[1], WA_SIZE);
+}
+
+static msg_t thread_leak(void *p) {
+
+  *(void **)p = chHeapAlloc(&test_heap, SIZE);
+  leak_owner = currp->p_memowner;
+  return 0;
+}
+
+static void heap2_execute(void) {
+  MemAccount acct;
+  size_t live;
+  void *p1;
+
+  /* Allocation and release.*/
+  p1 = chHeapAlloc(&test_heap, SIZE);
+  test_assert(1, p1 != NULL, "allocation failed");
+  chHeapGetAccount(&test_heap, &acct);
+  test_assert(2, (acct.ma_live == MEM_ALIGN_NEXT(SIZE)) &&
+                 (acct.ma_peak == acct.ma_live) &&
+                 (acct.ma_allocs == 1), "wrong heap account");
+  test_assert(3, currp->p_memowner != 0, "no owner entry");
+  chMemAcctSnapshot(&snapshot);
+  live = snapshot.owners[currp->p_memowner].mo_acct.ma_live;
+  test_assert(4, live >= MEM_ALIGN_NEXT(SIZE), "wrong owner account");
+  chHeapFree(p1);
+  chHeapGetAccount(&test_heap, &acct);
+  test_assert(5, (acct.ma_live == 0) &&
+                 (acct.ma_peak == MEM_ALIGN_NEXT(SIZE)) &&
+                 (acct.ma_frees == 1), "wrong heap account");
+  chMemAcctSnapshot(&snapshot);
+  test_assert(6, snapshot.owners[currp->p_memowner].mo_acct.ma_live ==
+                 live - MEM_ALIGN_NEXT(SIZE), "wrong owner account");
+
+  /* Failed allocation.*/
+  p1 = chHeapAlloc(&test_heap, WA_SIZE * 2);
+  test_assert(7, p1 == NULL, "allocation not failed");
+  chHeapGetAccount(&test_heap, &acct);
+  test_assert(8, acct.ma_failures == 1, "failure not accounted");
+
+  /* Leak by a terminated thread.*/
+  p1 = NULL;
+  leak_owner = 0;
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority()+1,
+                                 thread_leak, &p1);
+  test_wait_threads();
+  test_assert(9, (p1 != NULL) && (leak_owner != 0), "allocation failed");
+  chMemAcctSnapshot(&snapshot);
+  test_assert(10, snapshot.owners[leak_owner].mo_thread == NULL,
+              "owner still attached");
+  test_assert(11, snapshot.owners[leak_owner].mo_acct.ma_live ==
+                  MEM_ALIGN_NEXT(SIZE), "leak not accounted");
+  chHeapFree(p1);
+  chMemAcctSnapshot(&snapshot);
+  test_assert(12, snapshot.owners[leak_owner].mo_acct.ma_live == 0,
+              "release not credited to the owner");
+  chHeapGetAccount(&test_heap, &acct);
+  test_assert(13, acct.ma_live == 0, "heap not empty");
+}
+
+ROMCONST struct testcase testheap2 = {
+  "Heap, memory accounting",
+  heap2_setup,
+  NULL,
+  heap2_execute
+};
+#endif /* CH_USE_MEMACCT */
+
 #endif /* CH_USE_HEAP.*/
 
 /**
@@ -158,6 +246,9 @@ ROMCONST struct testcase testheap1 = {
 ROMCONST struct testcase * ROMCONST patternheap[] = {
 #if (CH_USE_HEAP && !CH_USE_MALLOC_HEAP) || defined(__DOXYGEN__)
   &testheap1,
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+  &testheap2,
+#endif
 #endif
   NULL
 };
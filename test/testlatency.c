@@ -0,0 +1,270 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include "ch.h"
+#include "test.h"
+
+/**
+ * @page test_latency Latency Histograms test
+ *
+ * File: @ref testlatency.c
+ *
+ * <h2>Description</h2>
+ * This module implements the test sequence for the @ref latency
+ * subsystem.
+ *
+ * <h2>Objective</h2>
+ * Objective of the test module is to cover 100% of the @ref latency code
+ * and to export the system histograms on the test stream.
+ *
+ * <h2>Preconditions</h2>
+ * The module requires the following kernel options:
+ * - @p CH_USE_LATENCY
+ * - @p CH_USE_WAITEXIT
+ * .
+ * In case some of the required options are not enabled then some or all tests
+ * may be skipped.
+ *
+ * <h2>Test Cases</h2>
+ * - @subpage test_latency_001
+ * - @subpage test_latency_002
+ * - @subpage test_latency_003
+ * - @subpage test_latency_004
+ * .
+ * @file testlatency.c
+ * @brief Latency Histograms test source file
+ * @file testlatency.h
+ * @brief Latency Histograms test header file
+ */
+
+#if (CH_USE_LATENCY && CH_USE_WAITEXIT) || defined(__DOXYGEN__)
+
+/*
+ * One millisecond budget, at least one clock unit.
+ */
+#define BUDGET      ((CH_LATENCY_FREQUENCY + 999) / 1000)
+
+static LatencyHistogram lh;
+static volatile unsigned alarms;
+static uint32_t last_latency;
+
+static void lat_alarm(LatencyHistogram *lhp, uint32_t latency) {
+
+  (void)lhp;
+  alarms++;
+  last_latency = latency;
+}
+
+static msg_t thread1(void *p) {
+
+  (void)p;
+  return 0;
+}
+
+static msg_t thread2(void *p) {
+
+  (void)p;
+  chThdSleep(1);
+  return 0;
+}
+
+/*
+ * Spins until the specified time elapsed since the timestamp, the spinning
+ * thread is never preempted by lower priority threads.
+ */
+static void spin_since(uint32_t ts, uint32_t time) {
+
+  while ((uint32_t)(CH_LATENCY_CLOCK() - ts) <= time) {
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+}
+
+static uint32_t bins_sum(const LatencyHistogram *lhp) {
+  uint32_t n = 0;
+  unsigned i;
+
+  for (i = 0; i < CH_LATENCY_BINS; i++)
+    n += lhp->lh_bins[i];
+  return n;
+}
+
+/**
+ * @page test_latency_001 Ready-to-run and timers latency recording
+ *
+ * <h2>Description</h2>
+ * A lower priority thread with an attached histogram is created, it sleeps
+ * for a tick and terminates. The thread histogram is expected to record
+ * both its runs and to be detached on termination, the system histograms
+ * are expected to grow and to have consistent bins.
+ */
+
+static void latency1_execute(void) {
+  LatencyHistogram threads1, timers1, threads2, timers2;
+
+  chLatencySnapshot(&threads1, &timers1);
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority() - 1,
+                                 thread2, NULL);
+  chLatencyAttach(&lh, threads[0], 0);
+  test_wait_threads();
+  chLatencySnapshot(&threads2, &timers2);
+  chLatencyDetach(&lh);
+
+  test_assert(1, lh.lh_samples >= 2, "thread samples missing");
+  test_assert(2, lh.lh_thread == NULL, "not detached on exit");
+  test_assert(3, bins_sum(&lh) == lh.lh_samples, "inconsistent bins");
+  test_assert(4, lh.lh_overruns == 0, "overruns without budget");
+  test_assert(5, threads2.lh_samples - threads1.lh_samples >= 2,
+              "system samples missing");
+  test_assert(6, timers2.lh_samples != timers1.lh_samples,
+              "timer lateness not recorded");
+}
+
+ROMCONST struct testcase testlatency1 = {
+  "Latency, ready-to-run and timers recording",
+  NULL,
+  NULL,
+  latency1_execute
+};
+
+/**
+ * @page test_latency_002 Budget overruns and stalls
+ *
+ * <h2>Description</h2>
+ * A lower priority thread with a latency budget is kept in the ready list
+ * for twice its budget. The check is expected to report the stall once,
+ * after the thread run the check is expected to report the budget overrun.
+ */
+
+static void latency2_execute(void) {
+
+  alarms = 0;
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority() - 1,
+                                 thread1, NULL);
+  chLatencyAttach(&lh, threads[0], BUDGET);
+  test_assert(1, chLatencyCheck(lat_alarm) == 0, "early alarm");
+  spin_since(threads[0]->p_readyts, BUDGET * 2);
+  test_assert(2, chLatencyCheck(lat_alarm) == 1, "stall not detected");
+  test_assert(3, last_latency > BUDGET, "wrong stall latency");
+  test_assert(4, chLatencyCheck(lat_alarm) == 0, "stall reported twice");
+  test_wait_threads();
+  test_assert(5, chLatencyCheck(lat_alarm) == 1, "overrun not detected");
+  test_assert(6, last_latency > BUDGET * 2, "wrong overrun latency");
+  test_assert(7, (lh.lh_stalls == 1) && (lh.lh_overruns == 1),
+              "wrong counters");
+  test_assert(8, alarms == 2, "wrong alarms count");
+  chLatencyDetach(&lh);
+}
+
+ROMCONST struct testcase testlatency2 = {
+  "Latency, budget overruns and stalls",
+  NULL,
+  NULL,
+  latency2_execute
+};
+
+/**
+ * @page test_latency_003 Deadline monitor thread
+ *
+ * <h2>Description</h2>
+ * The monitor thread is started at a priority higher than the test thread
+ * while a lower priority thread with a latency budget is kept in the ready
+ * list, the monitor is expected to raise the stall alarm and to terminate
+ * on request.
+ */
+
+static const LatencyMonitorConfig lmc = {1, lat_alarm};
+
+static void latency3_execute(void) {
+  uint32_t start;
+
+  alarms = 0;
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, chThdGetPriority() - 1,
+                                 thread1, NULL);
+  chLatencyAttach(&lh, threads[0], BUDGET);
+  threads[1] = chLatencyMonitorStart(wa[1], WA_SIZE, chThdGetPriority() + 1,
+                                     &lmc);
+  start = CH_LATENCY_CLOCK();
+  while ((alarms == 0) &&
+         ((uint32_t)(CH_LATENCY_CLOCK() - start) < BUDGET * 100)) {
+#if defined(SIMULATOR)
+    ChkIntSources();
+#endif
+  }
+  test_assert(1, alarms > 0, "stall not reported");
+  chThdTerminate(threads[1]);
+  test_wait_threads();
+  chLatencyDetach(&lh);
+}
+
+ROMCONST struct testcase testlatency3 = {
+  "Latency, deadline monitor thread",
+  NULL,
+  NULL,
+  latency3_execute
+};
+
+/**
+ * @page test_latency_004 Histograms report
+ *
+ * <h2>Description</h2>
+ * The system histograms are printed on the test stream as machine readable
+ * records, the worst latency is expected to fall into the highest non
+ * empty bin.
+ */
+
+static void latency4_execute(void) {
+  LatencyHistogram thd, tmr;
+  unsigned i;
+
+  chLatencySnapshot(&thd, &tmr);
+  test_print_latency("threads", &thd);
+  test_print_latency("timers", &tmr);
+  test_assert(1, bins_sum(&thd) == thd.lh_samples,
+              "inconsistent threads bins");
+  test_assert(2, bins_sum(&tmr) == tmr.lh_samples,
+              "inconsistent timers bins");
+  for (i = CH_LATENCY_BINS - 1; (i > 0) && (thd.lh_bins[i] == 0); i--)
+    ;
+  test_assert(3, thd.lh_max >= chLatencyBinBase(i), "wrong max");
+}
+
+ROMCONST struct testcase testlatency4 = {
+  "Latency, histograms report",
+  NULL,
+  NULL,
+  latency4_execute
+};
+
+#endif /* CH_USE_LATENCY && CH_USE_WAITEXIT */
+
+/**
+ * @brief   Test sequence for latency histograms.
+ */
+ROMCONST struct testcase * ROMCONST patternlatency[] = {
+#if (CH_USE_LATENCY && CH_USE_WAITEXIT) || defined(__DOXYGEN__)
+  &testlatency1,
+  &testlatency2,
+  &testlatency3,
+  &testlatency4,
+#endif
+  NULL
+};
@@ -28,6 +28,8 @@
  *
  * <h2>Description</h2>
  * This module implements the test sequence for the @ref mailboxes subsystem.
+ * The module does not use the shared test threads and buffers so it is
+ * executed as a parallel suite when the parallel execution is enabled.
  *
  * <h2>Objective</h2>
  * Objective of the test module is to cover 100% of the @ref mailboxes
@@ -61,7 +63,8 @@
  * variables are explicitly initialized in each test case. It is done in order
  * to test the macros.
  */
-static MAILBOX_DECL(mb1, test.wa.T0, MB_SIZE);
+static msg_t mb1_buffer[MB_SIZE];
+static MAILBOX_DECL(mb1, mb1_buffer, MB_SIZE);
 
 /**
  * @page test_mbox_001 Queuing and timeouts
@@ -74,7 +77,7 @@ static MAILBOX_DECL(mb1, test.wa.T0, MB_SIZE);
 
 static void mbox1_setup(void) {
 
-  chMBInit(&mb1, (msg_t *)test.wa.T0, MB_SIZE);
+  chMBInit(&mb1, mb1_buffer, MB_SIZE);
 }
 
 static void mbox1_execute(void) {
@@ -42,6 +42,7 @@
  *
  * <h2>Test Cases</h2>
  * - @subpage test_msg_001
+ * - @subpage test_msg_002
  * .
  * @file testmsg.c
  * @brief Messages test source file
@@ -99,6 +100,71 @@ ROMCONST struct testcase testmsg1 = {
   msg1_execute
 };
 
+/**
+ * @page test_msg_002 Messages, reply and wait
+ *
+ * <h2>Description</h2>
+ * A server thread answers messages using @p chMsgReplyAndWait(), each
+ * answer is the lowercase version of the received letter.<br>
+ * In the first part the server has a lower priority than its clients and
+ * finds messages already queued when replying, in the second part the
+ * server has an higher priority and the answers are handed over directly
+ * to the waiting client.<br>
+ * The test expects the requests and the answers to be interleaved in the
+ * correct sequence.
+ */
+
+static msg_t server(void *p) {
+  Thread *tp;
+  msg_t msg;
+
+  (void)p;
+  tp = chMsgWait();
+  while ((msg = chMsgGet(tp)) != 0) {
+    test_emit_token(msg);
+    tp = chMsgReplyAndWait(tp, msg + 'a' - 'A');
+  }
+  chMsgRelease(tp, 0);
+  return 0;
+}
+
+static msg_t client(void *p) {
+
+  test_emit_token(chMsgSend(threads[0], (msg_t)p));
+  return 0;
+}
+
+static void msg2_execute(void) {
+  tprio_t prio = chThdGetPriority();
+
+  /*
+   * Server with lower priority, the messages are queued when it runs.
+   */
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, prio - 1, server, NULL);
+  threads[1] = chThdCreateStatic(wa[1], WA_SIZE, prio + 2, client, (void *)'A');
+  threads[2] = chThdCreateStatic(wa[2], WA_SIZE, prio + 1, client, (void *)'B');
+  test_emit_token(chMsgSend(threads[0], 'C'));
+  (void)chMsgSend(threads[0], 0);
+  test_wait_threads();
+
+  /*
+   * Server with higher priority, direct handoff in both directions.
+   */
+  threads[0] = chThdCreateStatic(wa[0], WA_SIZE, prio + 1, server, NULL);
+  test_emit_token(chMsgSend(threads[0], 'D'));
+  test_emit_token(chMsgSend(threads[0], 'E'));
+  (void)chMsgSend(threads[0], 0);
+  test_wait_threads();
+  test_assert_sequence(1, "AaBbCcDdEe");
+}
+
+ROMCONST struct testcase testmsg2 = {
+  "Messages, reply and wait",
+  NULL,
+  NULL,
+  msg2_execute
+};
+
 #endif /* CH_USE_MESSAGES */
 
 /**
@@ -107,6 +173,7 @@ ROMCONST struct testcase testmsg1 = {
 ROMCONST struct testcase * ROMCONST patternmsg[] = {
 #if CH_USE_MESSAGES || defined(__DOXYGEN__)
   &testmsg1,
+  &testmsg2,
 #endif
   NULL
 };
@@ -35,12 +35,14 @@
  * <h2>Preconditions</h2>
  * The module requires the following kernel options:
  * - @p CH_USE_MEMPOOLS
+ * - @p CH_USE_MEMACCT (test case #2)
  * .
  * In case some of the required options are not enabled then some or all tests
  * may be skipped.
  *
  * <h2>Test Cases</h2>
  * - @subpage test_pools_001
+ * - @subpage test_pools_002
  * .
  * @file testpools.c
  * @brief Memory Pools test source file
@@ -108,6 +110,43 @@ ROMCONST struct testcase testpools1 = {
   pools1_execute
 };
 
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+/**
+ * @page test_pools_002 Memory accounting
+ *
+ * <h2>Description</h2>
+ * An object is allocated from the pool, a new object is loaded into the
+ * pool while the first one is still allocated then the first object is
+ * released. Loading is expected not to be accounted and the release is
+ * expected to bring the live memory back to zero.
+ */
+
+static void pools2_execute(void) {
+  MemAccount acct;
+  void *p1;
+
+  chPoolAdd(&mp1, wa[0]);
+  p1 = chPoolAlloc(&mp1);
+  test_assert(1, p1 == wa[0], "allocation failed");
+  chPoolAdd(&mp1, wa[1]);
+  chPoolGetAccount(&mp1, &acct);
+  test_assert(2, (acct.ma_live == mp1.mp_object_size) &&
+                 (acct.ma_allocs == 1) && (acct.ma_frees == 0),
+              "loading accounted");
+  chPoolFree(&mp1, p1);
+  chPoolGetAccount(&mp1, &acct);
+  test_assert(3, (acct.ma_live == 0) && (acct.ma_frees == 1),
+              "release not accounted");
+}
+
+ROMCONST struct testcase testpools2 = {
+  "Memory Pools, memory accounting",
+  pools1_setup,
+  NULL,
+  pools2_execute
+};
+#endif /* CH_USE_MEMACCT */
+
 #endif /* CH_USE_MEMPOOLS */
 
 /*
@@ -116,6 +155,9 @@ ROMCONST struct testcase testpools1 = {
 ROMCONST struct testcase * ROMCONST patternpools[] = {
 #if CH_USE_MEMPOOLS || defined(__DOXYGEN__)
   &testpools1,
+#if CH_USE_MEMACCT || defined(__DOXYGEN__)
+  &testpools2,
+#endif
 #endif
   NULL
 };
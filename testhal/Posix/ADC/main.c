@@ -0,0 +1,399 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#define SAMPLES_FILE        "samples.raw"
+#define CHANNELS            2
+#define DEPTH               512
+#define NBLOCKS             4
+#define RATE                200000
+#define PERIOD_ROWS         2000
+#define PULSE_START         1000
+#define PULSE_ROWS          200
+#define FILE_ROWS           (PERIOD_ROWS * 10)
+#define DC_LEVEL            2048
+#define NOISE               64
+#define PULSE_LOW           500
+#define PULSE_HIGH          3000
+#define CIC_ORDER           3
+#define CIC_RATIO           8
+#define FIR_RATIO           4
+#define DECIMATION          (CIC_RATIO * FIR_RATIO)
+#define STATS_WINDOW        (RATE / DECIMATION / 10)
+#define BENCH_ROUNDS        2000
+
+static unsigned failures;
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+/*===========================================================================*/
+/* Pipeline.                                                                 */
+/*===========================================================================*/
+
+/*
+ * Half band low pass, Hamming windowed, unity DC gain.
+ */
+static const int16_t fir_coeffs[16] = {
+  -114, -159, -139, 291, 1450, 3284, 5246, 6525,
+  6525, 5246, 3284, 1450, 291, -139, -159, -114
+};
+
+static const ADCConversionGroup adcgrp = {
+  TRUE,
+  CHANNELS,
+  NULL,
+  NULL
+};
+
+static adcsample_t buffer[CHANNELS * DEPTH];
+static adcsample_t pool[ADC_STREAM_POOL_SIZE(CHANNELS, DEPTH, NBLOCKS)];
+static adcstreamsample_t work[ADC_STREAM_WORK_SIZE(CHANNELS, DEPTH)];
+
+static ADCStageCIC cic;
+static ADCStageFIR fir;
+static ADCStageStats stats;
+static ADCStageTrigger trigger;
+static ADCStageSink sink;
+
+static ADCStage * const decimating[] = {
+  (ADCStage *)&cic,
+  (ADCStage *)&fir,
+  (ADCStage *)&stats,
+  (ADCStage *)&trigger,
+  (ADCStage *)&sink,
+  NULL
+};
+
+static ADCStream stream;
+
+/*
+ * Sink state.
+ */
+static struct {
+  uint32_t      blocks;
+  uint32_t      samples;
+  uint32_t      gaps;
+  uint32_t      next;
+  bool_t        ordered;
+  systime_t     delay;
+} out;
+
+static void sink_cb(ADCStageSink *skp, const ADCStreamData *dp) {
+
+  (void)skp;
+  if (dp->gap)
+    out.gaps++;
+  else if ((out.blocks > 0) && (dp->index != out.next))
+    out.ordered = FALSE;
+  out.next = dp->index + DEPTH / 2;
+  out.blocks++;
+  out.samples += dp->n;
+  if (out.delay > 0)
+    chThdSleep(out.delay);
+}
+
+/*
+ * Creates the played file, a noisy DC level on the first channel and a
+ * pulse train on the second one.
+ */
+static void make_samples(void) {
+  static adcsample_t row[CHANNELS];
+  uint32_t lcg = 1, i;
+  FILE *fp;
+
+  fp = fopen(SAMPLES_FILE, "wb");
+  for (i = 0; i < FILE_ROWS; i++) {
+    uint32_t phase = i % PERIOD_ROWS;
+
+    lcg = lcg * 1103515245U + 12345U;
+    row[0] = (adcsample_t)(DC_LEVEL - NOISE + (lcg >> 16) % (2 * NOISE + 1));
+    row[1] = (phase >= PULSE_START) && (phase < PULSE_START + PULSE_ROWS) ?
+             PULSE_HIGH : PULSE_LOW;
+    fwrite(row, sizeof row, 1, fp);
+  }
+  fclose(fp);
+}
+
+/*
+ * Starts a stream on ADCD1 through the decimating pipeline.
+ */
+static void stream_start(const ADCConfig *cfg, tprio_t prio) {
+  static ADCStreamConfig scfg;
+
+  adcStageCICObjectInit(&cic, CIC_ORDER, CIC_RATIO);
+  adcStageFIRObjectInit(&fir, fir_coeffs, 16, FIR_RATIO);
+  adcStageStatsObjectInit(&stats, STATS_WINDOW, NULL);
+  adcStageTriggerObjectInit(&trigger, 1, (PULSE_LOW + PULSE_HIGH) / 2,
+                            (PULSE_HIGH - PULSE_LOW) / 8,
+                            ADC_TRIGGER_BOTH, NULL);
+  adcStageSinkObjectInit(&sink, sink_cb, NULL);
+  out.blocks  = 0;
+  out.samples = 0;
+  out.gaps    = 0;
+  out.ordered = TRUE;
+
+  scfg.adcp    = &ADCD1;
+  scfg.grpp    = &adcgrp;
+  scfg.buffer  = buffer;
+  scfg.depth   = DEPTH;
+  scfg.pool    = pool;
+  scfg.nblocks = NBLOCKS;
+  scfg.work    = work;
+  scfg.stages  = decimating;
+  scfg.prio    = prio;
+  adcStart(&ADCD1, cfg);
+  adcStreamStart(&stream, &scfg);
+}
+
+static void stream_stop(void) {
+
+  adcStreamStop(&stream);
+  adcStop(&ADCD1);
+}
+
+/*===========================================================================*/
+/* Streaming.                                                                */
+/*===========================================================================*/
+
+/*
+ * One second of samples through the decimating pipeline, the results are
+ * compared with the played signal.
+ */
+static void test_stream(void) {
+  static const ADCConfig cfg = {SAMPLES_FILE, RATE, TRUE};
+  uint32_t rows, expected, pulses;
+
+  printf("\n*** Streaming %u rows/s, decimation %u\n", RATE, DECIMATION);
+
+  out.delay = 0;
+  stream_start(&cfg, NORMALPRIO + 1);
+  chThdSleepMilliseconds(1000);
+  stream_stop();
+
+  rows = (stream.converted - stream.dropped) * (DEPTH / 2);
+  expected = rows / DECIMATION;
+  pulses = rows > PULSE_START ? (rows - PULSE_START) / PERIOD_ROWS + 1 : 0;
+  printf("%u blocks, %u dropped, %u lost rows, peak %u, "
+         "%u output samples\n", (unsigned)stream.converted,
+         (unsigned)stream.dropped, (unsigned)ADCD1.lost,
+         (unsigned)stream.peak, (unsigned)out.samples);
+  printf("dc: mean %d min %d max %d rms %u, pulses: mean %d, "
+         "%u rising %u falling\n",
+         (int)stats.last[0].mean, (int)stats.last[0].min,
+         (int)stats.last[0].max, (unsigned)stats.last[0].rms,
+         (int)stats.last[1].mean, (unsigned)trigger.rising,
+         (unsigned)trigger.falling);
+
+  check("conversion rate",
+        (stream.converted >= RATE / (DEPTH / 2) * 9 / 10) &&
+        (stream.converted <= RATE / (DEPTH / 2) * 11 / 10));
+  check("no blocks dropped", (stream.dropped == 0) && (out.gaps == 0));
+  check("blocks in order", out.ordered);
+  check("decimated samples",
+        (out.samples + 1 >= expected) && (out.samples <= expected + 1));
+  check("statistics windows", stats.windows == out.samples / STATS_WINDOW);
+  check("dc level preserved",
+        (stats.last[0].mean >= DC_LEVEL - 4) &&
+        (stats.last[0].mean <= DC_LEVEL + 4));
+  check("noise filtered",
+        (stats.last[0].max - stats.last[0].min < NOISE) &&
+        (stats.last[0].rms >= DC_LEVEL - 4) &&
+        (stats.last[0].rms <= DC_LEVEL + 4));
+  check("pulse train average",
+        (stats.last[1].mean >= 700) && (stats.last[1].mean <= 800));
+  check("pulses triggered",
+        (trigger.rising + 1 >= pulses) && (trigger.rising <= pulses) &&
+        (trigger.falling + 1 >= trigger.rising) &&
+        (trigger.falling <= trigger.rising));
+}
+
+/*
+ * A slow consumer, the blocks arriving while the pool is full are
+ * dropped and accounted.
+ */
+static void test_backpressure(void) {
+  static const ADCConfig cfg = {SAMPLES_FILE, RATE, TRUE};
+  EventListener el;
+  flagsmask_t flags;
+
+  printf("\n*** Backpressure\n");
+
+  chEvtRegisterMask(adcStreamGetEventSource(&stream), &el, EVENT_MASK(0));
+  out.delay = MS2ST(5);
+  stream_start(&cfg, NORMALPRIO + 1);
+  chThdSleepMilliseconds(200);
+  stream_stop();
+  out.delay = 0;
+  flags = chEvtGetAndClearFlags(&el);
+  chEvtUnregister(adcStreamGetEventSource(&stream), &el);
+
+  printf("%u blocks, %u processed, %u dropped, %u gaps, peak %u\n",
+         (unsigned)stream.converted, (unsigned)out.blocks,
+         (unsigned)stream.dropped, (unsigned)out.gaps,
+         (unsigned)stream.peak);
+  check("blocks dropped", stream.dropped > 0);
+  check("drops accounted",
+        stream.converted == out.blocks + stream.dropped);
+  check("gaps reported", (out.gaps > 0) && (out.gaps <= stream.dropped));
+  check("pool filled", stream.peak == NBLOCKS);
+  check("overrun event", (flags & ADC_STREAM_OVERRUN) != 0);
+}
+
+/*
+ * Without looping the conversion stops at the end of the file.
+ */
+static void test_eof(void) {
+  static const ADCConfig cfg = {SAMPLES_FILE, RATE * 4, FALSE};
+  EventListener el;
+  flagsmask_t flags;
+
+  printf("\n*** End of file\n");
+
+  chEvtRegisterMask(adcStreamGetEventSource(&stream), &el, EVENT_MASK(0));
+  stream_start(&cfg, NORMALPRIO + 1);
+  chThdSleepMilliseconds(FILE_ROWS / (RATE * 4 / 1000) + 20);
+  flags = chEvtGetAndClearFlags(&el);
+  stream_stop();
+  chEvtUnregister(adcStreamGetEventSource(&stream), &el);
+
+  check("error event", ((flags & ADC_STREAM_ERROR) != 0) &&
+                       (stream.errors == 1));
+  check("whole file played",
+        (stream.converted * (DEPTH / 2) + ADCD1.lost <= FILE_ROWS) &&
+        (stream.converted * (DEPTH / 2) + ADCD1.lost > FILE_ROWS - DEPTH / 2));
+}
+
+/*===========================================================================*/
+/* Benchmarks.                                                               */
+/*===========================================================================*/
+
+/*
+ * Processing cost of a chain of stages per ADC row, the stages run on
+ * in memory blocks.
+ */
+static void bench_stages(const char *name, ADCStage * const *stages) {
+  ADCStreamData data;
+  halrtcnt_t start;
+  uint32_t elapsed;
+  unsigned i, ch;
+
+  for (i = 0; stages[i] != NULL; i++)
+    adcStageReset(stages[i], CHANNELS);
+  data.stride   = ADC_STREAM_HEADROOM + DEPTH / 2;
+  data.channels = CHANNELS;
+  data.gap      = FALSE;
+  start = halGetCounterValue();
+  for (i = 0; i < BENCH_ROUNDS; i++) {
+    data.data    = work;
+    data.scratch = work + CHANNELS * data.stride;
+    data.n       = DEPTH / 2;
+    data.index   = i * (DEPTH / 2);
+    for (ch = 0; ch < CHANNELS; ch++) {
+      adcstreamsample_t *x = adcStreamChannel(&data, ch);
+      unsigned k;
+
+      for (k = 0; k < DEPTH / 2; k++)
+        x[k] = DC_LEVEL + (adcstreamsample_t)((k * 37) & 127) - NOISE;
+    }
+    adcStreamRun(stages, &data);
+  }
+  elapsed = halGetCounterValue() - start;
+  printf("%-28s %6u ns per row, %5u Krows/s\n", name,
+         (unsigned)((uint64_t)elapsed * 1000000000 /
+                    halGetCounterFrequency() / (BENCH_ROUNDS * (DEPTH / 2))),
+         (unsigned)((uint64_t)BENCH_ROUNDS * (DEPTH / 2) *
+                    halGetCounterFrequency() / (elapsed ? elapsed : 1) /
+                    1000));
+}
+
+/*
+ * Streaming at increasing rates, the processing load and the drops are
+ * reported.
+ */
+static void bench_stream(uint32_t rate) {
+  ADCConfig cfg = {SAMPLES_FILE, rate, TRUE};
+
+  stream_start(&cfg, NORMALPRIO + 1);
+  chThdSleepMilliseconds(500);
+  stream_stop();
+
+  printf("%7u rows/s: %3u%% busy, %5u us worst block, %u/%u blocks "
+         "dropped, %u rows lost\n", (unsigned)rate,
+         (unsigned)(stream.busy_total * 100 / halGetCounterFrequency() * 2),
+         (unsigned)((uint64_t)stream.busy_worst * 1000000 /
+                    halGetCounterFrequency()),
+         (unsigned)stream.dropped, (unsigned)stream.converted,
+         (unsigned)ADCD1.lost);
+}
+
+/*
+ * Application entry point.
+ */
+int main(void) {
+  static ADCStage * const load[] = {NULL};
+  static ADCStage * const cic_only[] = {(ADCStage *)&cic, NULL};
+  static ADCStage * const cic_fir[] = {(ADCStage *)&cic, (ADCStage *)&fir,
+                                       NULL};
+  static ADCStage * const analysis[] = {(ADCStage *)&stats,
+                                        (ADCStage *)&trigger, NULL};
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  make_samples();
+  adcStreamObjectInit(&stream);
+
+  test_stream();
+  test_backpressure();
+  test_eof();
+
+  printf("\n*** Stages cost, %u channels\n", CHANNELS);
+  out.delay = 0;
+  bench_stages("none", load);
+  bench_stages("cic", cic_only);
+  bench_stages("cic + fir", cic_fir);
+  bench_stages("stats + trigger", analysis);
+  bench_stages("cic + fir + stats + trigger", decimating);
+
+  printf("\n*** Streaming load\n");
+  bench_stream(RATE);
+  bench_stream(RATE * 5);
+  bench_stream(RATE * 20);
+
+  remove(SAMPLES_FILE);
+  printf("\n%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,209 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ramdisk.h"
+#include "filedisk.h"
+
+#define DISK_BLOCKS         2048
+#define BLOCK_SIZE          512
+#define FILE_NAME           "blk_queue.img"
+
+#define MAX_DEPTH           32
+#define BUFFER_BLOCKS       64
+#define BENCH_TIME          MS2ST(500)
+
+#define TICKS2MS(t)         ((uint32_t)(t) * 1000 / CH_FREQUENCY)
+
+static uint8_t ram_storage[RAMDISK_STORAGE_SIZE(DISK_BLOCKS)];
+static RamDisk RD1;
+static FileDisk FD1;
+
+static BlockQueue BQ1;
+static BlockQueueConfig bqcfg;
+
+static BlockRequest requests[MAX_DEPTH];
+static uint8_t buffer[BUFFER_BLOCKS * BLOCK_SIZE];
+static uint8_t check_buffer[BUFFER_BLOCKS * BLOCK_SIZE];
+static unsigned failures;
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+static void fill(uint8_t *p, size_t n, uint32_t seed) {
+
+  while (n-- > 0) {
+    seed = seed * 1103515245 + 12345;
+    *p++ = (uint8_t)(seed >> 16);
+  }
+}
+
+/*
+ * Completion callback, counts the failed requests.
+ */
+static void count_errors(BlockQueue *bqp, BlockRequest *brp) {
+
+  (void)bqp;
+  if (brp->result == CH_FAILED)
+    (*(uint32_t *)brp->arg)++;
+}
+
+/*
+ * Functional checks, the queue must preserve the submission order of
+ * overlapping requests.
+ */
+static void test_ordering(void) {
+  uint32_t errors = 0;
+  unsigned i;
+
+  /* Burst of single block writes, merged by the queue.*/
+  fill(buffer, sizeof buffer, 1);
+  for (i = 0; i < 16; i++) {
+    requests[i].arg = &errors;
+    bqStartWrite(&BQ1, &requests[i], 100 + i, buffer + i * BLOCK_SIZE, 1,
+                 count_errors);
+  }
+
+  /* Read overlapping the writes, it must see the new data.*/
+  requests[16].arg = &errors;
+  bqStartRead(&BQ1, &requests[16], 104, check_buffer, 8, count_errors);
+  for (i = 0; i <= 16; i++)
+    bqWait(&requests[i]);
+  check("Read after overlapping writes",
+        (errors == 0) &&
+        (memcmp(check_buffer, buffer + 4 * BLOCK_SIZE, 8 * BLOCK_SIZE) == 0));
+
+  /* Synchronous wrappers.*/
+  check("Synchronous read",
+        (blkRead(&BQ1, 100, check_buffer, 16) == CH_SUCCESS) &&
+        (memcmp(check_buffer, buffer, 16 * BLOCK_SIZE) == 0));
+  check("Synchronous sync", blkSync(&BQ1) == CH_SUCCESS);
+  check("Out of range request fails",
+        blkRead(&BQ1, DISK_BLOCKS - 1, check_buffer, 2) == CH_FAILED);
+}
+
+/*
+ * Keeps a number of single block sequential requests in flight for a
+ * fixed time.
+ */
+static void bench(const char *name, uint8_t op, unsigned depth) {
+  uint32_t transfers = BQ1.transfers, errors = 0, completed = 0;
+  uint32_t blk = 0, rps;
+  systime_t start, time;
+  unsigned i;
+
+  start = chTimeNow();
+  for (i = 0; i < depth; i++, blk++) {
+    requests[i].arg = &errors;
+    bqSubmit(&BQ1, &requests[i], op, blk,
+             buffer + (blk % BUFFER_BLOCKS) * BLOCK_SIZE, 1, count_errors);
+  }
+  i = 0;
+  do {
+    bqWait(&requests[i]);
+    completed++;
+    bqSubmit(&BQ1, &requests[i], op, blk % DISK_BLOCKS,
+             buffer + (blk % BUFFER_BLOCKS) * BLOCK_SIZE, 1, count_errors);
+    blk++;
+    i = (i + 1) % depth;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+  for (i = 0; i < depth; i++)
+    bqWait(&requests[i]);
+  completed += depth;
+  time = chTimeNow() - start;
+
+  rps = completed * 1000 / TICKS2MS(time);
+  printf("%-12s depth %2u: %6lu req/s, %3lu.%02lu req/transfer, "
+         "%lu.%03lu MB/s\n",
+         name, depth, (unsigned long)rps,
+         (unsigned long)(completed / (BQ1.transfers - transfers)),
+         (unsigned long)(completed * 100 / (BQ1.transfers - transfers) % 100),
+         (unsigned long)(rps * BLOCK_SIZE / 1000000),
+         (unsigned long)(rps * BLOCK_SIZE / 1000 % 1000));
+  if (errors > 0)
+    check(name, FALSE);
+}
+
+static void bench_device(const char *name, BaseBlockDevice *bbdp) {
+  static const unsigned depths[] = {1, 2, 4, 8, 16, 32};
+  char label[32];
+  unsigned i;
+
+  bqcfg.bbdp = bbdp;
+  bqcfg.prio = NORMALPRIO;
+  bqStart(&BQ1, &bqcfg);
+
+  printf("\n*** %s\n", name);
+  test_ordering();
+  for (i = 0; i < sizeof depths / sizeof depths[0]; i++) {
+    sprintf(label, "%s read", name);
+    bench(label, BQ_OP_READ, depths[i]);
+  }
+  for (i = 0; i < sizeof depths / sizeof depths[0]; i++) {
+    sprintf(label, "%s write", name);
+    bench(label, BQ_OP_WRITE, depths[i]);
+  }
+
+  bqStop(&BQ1);
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  rdObjectInit(&RD1, ram_storage, DISK_BLOCKS, FALSE);
+  if (fdOpen(&FD1, FILE_NAME, DISK_BLOCKS, MS2ST(1), 0) != CH_SUCCESS) {
+    printf("cannot open %s\n", FILE_NAME);
+    return 1;
+  }
+
+  /*
+   * The queue thread has the same priority of the main thread, requests
+   * submitted in a burst are accumulated and merged.
+   */
+  bqObjectInit(&BQ1);
+  bench_device("RAM", (BaseBlockDevice *)&RD1);
+  bench_device("File", (BaseBlockDevice *)&FD1);
+
+  fdClose(&FD1);
+  printf("\n%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,670 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#define BITRATE             1000000
+#define BURST_SIZE          48
+#define BENCH_FRAMES        5000
+#define BATCH_SIZE          16
+#define ROUTE_SLOTS         8
+#define LOAD_BITRATE        500000
+#define LOAD_TIME           MS2ST(1000)
+#define PROBE_PERIOD        MS2ST(2)
+#define ECHO_PINGS          1000
+
+static const CANConfig cancfg = {BITRATE, FALSE, NULL, 0};
+
+static CANRxFrame frames[CAN_RX_FIFO_SIZE];
+static cantime_t times[CAN_RX_FIFO_SIZE];
+static unsigned failures;
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+/*===========================================================================*/
+/* Sender.                                                                   */
+/*===========================================================================*/
+
+static WORKING_AREA(waSender, 2048);
+
+struct burst {
+  bool_t            ide;
+  uint32_t          first;
+  uint32_t          step;
+  uint32_t          n;
+};
+
+static void make_frame(CANTxFrame *ctfp, bool_t ide, uint32_t id,
+                       uint32_t seq) {
+
+  memset(ctfp, 0, sizeof *ctfp);
+  ctfp->IDE = ide;
+  if (ide)
+    ctfp->EID = id;
+  else
+    ctfp->SID = id;
+  ctfp->DLC = 8;
+  ctfp->data32[0] = seq;
+  ctfp->data32[1] = ~seq;
+}
+
+/*
+ * Transmits a sequence of frames from CAND1, the identifier is incremented
+ * by the step after each frame and the data carries a sequence number.
+ */
+static msg_t Sender(void *arg) {
+  struct burst *bp = arg;
+  CANTxFrame ctf;
+  uint32_t i;
+
+  for (i = 0; i < bp->n; i++) {
+    make_frame(&ctf, bp->ide, bp->first + bp->step * i, i);
+    canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+  }
+  return 0;
+}
+
+/*
+ * Waits for the transmission of the frames in the mailboxes of a node.
+ */
+static void wait_transmitted(CANDriver *canp) {
+
+  while (canp->txpending != 0)
+    chThdSleepMilliseconds(1);
+}
+
+/*
+ * Transmits a burst and waits for it to be on the bus, the receiver does
+ * not run meanwhile.
+ */
+static void send_burst(bool_t ide, uint32_t first, uint32_t step,
+                       uint32_t n) {
+  struct burst b;
+
+  b.ide   = ide;
+  b.first = first;
+  b.step  = step;
+  b.n     = n;
+  chThdWait(chThdCreateStatic(waSender, sizeof waSender, NORMALPRIO + 1,
+                              Sender, &b));
+  wait_transmitted(&CAND1);
+}
+
+/*===========================================================================*/
+/* Receive FIFO.                                                             */
+/*===========================================================================*/
+
+/*
+ * A burst larger than the hardware queue is buffered by the software FIFO
+ * in order and with increasing timestamps.
+ */
+static void test_fifo(void) {
+  EventListener el;
+  bool_t ordered = TRUE;
+  size_t i, n;
+
+  printf("*** Receive FIFO, %u frames, hardware queue %u frames\n",
+         CAN_RX_FIFO_SIZE, CAN_SIM_RX_DEPTH);
+
+  canStart(&CAND1, &cancfg);
+  canStart(&CAND2, &cancfg);
+  chEvtRegisterMask(&CAND2.error_event, &el, EVENT_MASK(0));
+
+  send_burst(FALSE, 0x100, 1, BURST_SIZE);
+  check("single frame receive",
+        (canReceive(&CAND2, CAN_ANY_MAILBOX, &frames[0],
+                    TIME_IMMEDIATE) == RDY_OK) && (frames[0].SID == 0x100));
+  n = canReceiveN(&CAND2, frames + 1, times + 1, CAN_RX_FIFO_SIZE - 1,
+                  TIME_IMMEDIATE) + 1;
+  for (i = 1; i < n; i++) {
+    if ((frames[i].SID != 0x100 + i) || (frames[i].data32[0] != i) ||
+        ((i > 1) && ((uint32_t)(times[i] - times[i - 1]) > 0x80000000U)))
+      ordered = FALSE;
+  }
+  check("burst fully buffered", n == BURST_SIZE);
+  check("frames and timestamps in order", ordered);
+  check("no overflows", canGetRxOverflows(&CAND2) == 0);
+  check("peak level", CAND2.rxpeak == BURST_SIZE);
+
+  send_burst(FALSE, 0x100, 1, CAN_RX_FIFO_SIZE + 16);
+  n = canReceiveN(&CAND2, frames, NULL, CAN_RX_FIFO_SIZE, TIME_IMMEDIATE);
+  check("overflowing burst truncated", n == CAN_RX_FIFO_SIZE);
+  check("overflows counted", canGetRxOverflows(&CAND2) == 16);
+  check("overflow event", (chEvtGetAndClearFlags(&el) &
+                           CAN_OVERFLOW_ERROR) != 0);
+  check("FIFO empty", canReceiveN(&CAND2, frames, NULL, 1,
+                                  TIME_IMMEDIATE) == 0);
+
+  chEvtUnregister(&CAND2.error_event, &el);
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*===========================================================================*/
+/* Filter and routes.                                                        */
+/*===========================================================================*/
+
+static CANRxStamped std_objs[ROUTE_SLOTS], ext_objs[ROUTE_SLOTS];
+static msg_t std_buf[ROUTE_SLOTS], ext_buf[ROUTE_SLOTS];
+static MEMORYPOOL_DECL(std_pool, sizeof (CANRxStamped), NULL);
+static MEMORYPOOL_DECL(ext_pool, sizeof (CANRxStamped), NULL);
+static MAILBOX_DECL(std_mb, std_buf, ROUTE_SLOTS);
+static MAILBOX_DECL(ext_mb, ext_buf, ROUTE_SLOTS);
+
+static CANRxFilter filter;
+static CANRxRoute std_route, ext_route, ext_accept;
+
+/*
+ * Counts the frames received from a route.
+ */
+static unsigned drain_route(CANRxRoute *crp, bool_t ide, uint32_t id) {
+  CANRxFrame crf;
+  unsigned n = 0;
+
+  while (canRouteReceive(crp, &crf, NULL, TIME_IMMEDIATE) == RDY_OK) {
+    if ((crf.IDE == ide) && ((ide ? crf.EID : crf.SID) == id))
+      n++;
+  }
+  return n;
+}
+
+/*
+ * Standard identifiers accepted by range, a routed standard and extended
+ * identifier, an extended identifier accepted into the FIFO and an
+ * extended identifier not accepted.
+ */
+static void test_filter(void) {
+  size_t n;
+
+  printf("\n*** Filter, %u buckets\n", CAN_RX_FILTER_BUCKETS);
+
+  chPoolLoadArray(&std_pool, std_objs, ROUTE_SLOTS);
+  chPoolLoadArray(&ext_pool, ext_objs, ROUTE_SLOTS);
+  canFilterObjectInit(&filter, FALSE);
+  canFilterAcceptStd(&filter, 0x100, 0x10F);
+  canRouteObjectInit(&std_route, FALSE, 0x200, &std_mb, &std_pool);
+  canRouteObjectInit(&ext_route, TRUE, 0x1234567, &ext_mb, &ext_pool);
+  canRouteObjectInit(&ext_accept, TRUE, 0x0ABCDEF, NULL, NULL);
+  canFilterAddRoute(&filter, &std_route);
+  canFilterAddRoute(&filter, &ext_route);
+  canFilterAddRoute(&filter, &ext_accept);
+
+  canStart(&CAND1, &cancfg);
+  canStart(&CAND2, &cancfg);
+  canSetFilter(&CAND2, &filter);
+
+  send_burst(FALSE, 0x100, 1, 32);
+  send_burst(FALSE, 0x200, 0, 4);
+  send_burst(TRUE, 0x1234567, 0, 4);
+  send_burst(TRUE, 0x0ABCDEF, 0, 4);
+  send_burst(TRUE, 0x0000001, 0, 4);
+
+  n = canReceiveN(&CAND2, frames, NULL, CAN_RX_FIFO_SIZE, TIME_IMMEDIATE);
+  check("accepted frames in the FIFO", n == 16 + 4);
+  check("standard route", drain_route(&std_route, FALSE, 0x200) == 4);
+  check("extended route", drain_route(&ext_route, TRUE, 0x1234567) == 4);
+  check("rejected frames", CAND2.rxrejected == 16 + 4);
+
+  /* Route exhaustion, the frames exceeding the mailbox are dropped.*/
+  send_burst(FALSE, 0x200, 0, ROUTE_SLOTS + 2);
+  check("route overflow", (drain_route(&std_route, FALSE, 0x200) ==
+                           ROUTE_SLOTS) && (std_route.dropped == 2));
+
+  /* A removed standard route falls back to the FIFO.*/
+  canFilterRemoveRoute(&filter, &std_route);
+  send_burst(FALSE, 0x200, 0, 2);
+  n = canReceiveN(&CAND2, frames, NULL, CAN_RX_FIFO_SIZE, TIME_IMMEDIATE);
+  check("unrouted identifier in the FIFO", n == 2);
+
+  canSetFilter(&CAND2, NULL);
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*===========================================================================*/
+/* Bus model.                                                                */
+/*===========================================================================*/
+
+/*
+ * Empties the receive FIFO of a node.
+ */
+static void drain(CANDriver *canp) {
+
+  while (canReceiveN(canp, frames, NULL, CAN_RX_FIFO_SIZE, TIME_IMMEDIATE) > 0)
+    ;
+}
+
+/*
+ * A stream of frames from a single node keeps the bus busy, the frame
+ * rate is compared with the modelled frame length.
+ */
+static void test_timing(void) {
+  static const CANConfig cfg = {LOAD_BITRATE, FALSE, NULL, 0};
+  CANSimBusStats bs;
+  CANTxFrame ctf;
+  uint32_t bits, model;
+
+  printf("\n*** Bit timing, %u bit/s\n", LOAD_BITRATE);
+
+  canStart(&CAND1, &cfg);
+  canStart(&CAND2, &cfg);
+  canSimResetStats(&CAND1);
+
+  make_frame(&ctf, FALSE, 0x100, 0);
+  bits = canSimGetFrameBits(&ctf);
+  model = LOAD_BITRATE / bits;
+  send_burst(FALSE, 0x100, 0, 1000);
+  canSimGetBusStats(&CAND1, &bs);
+  printf("%u bits per frame, %u frames/s modelled, %u frames/s on the bus, "
+         "%u.%u%% load\n", (unsigned)bits, (unsigned)model,
+         (unsigned)((uint64_t)bs.frames * 1000000000 / bs.elapsed),
+         (unsigned)bs.load / 10, (unsigned)bs.load % 10);
+  check("frames transmitted back to back",
+        (bs.frames == 1000) &&
+        (bs.busy >= (uint64_t)1000 * bits * 1000000000 / LOAD_BITRATE) &&
+        (bs.load >= 900));
+  check("frames received", CAND2.rxframes >= 1000);
+
+  drain(&CAND2);
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*
+ * Frames queued by both nodes while the bus is busy are transmitted in
+ * identifiers order, CAND2 is in loopback mode and sees all the frames.
+ */
+static void test_arbitration(void) {
+  static const CANConfig cfg1 = {10000, FALSE, NULL, 0};
+  static const CANConfig cfg2 = {10000, TRUE, NULL, 0};
+  static const uint32_t order[] = {0x7FF, 0x050, 0x100, 0x180, 0x200, 0x300};
+  CANTxFrame ctf;
+  bool_t ok;
+  size_t i, n;
+
+  printf("\n*** Arbitration\n");
+
+  canStart(&CAND1, &cfg1);
+  canStart(&CAND2, &cfg2);
+
+  /* The first frame occupies the bus while the others are queued.*/
+  make_frame(&ctf, FALSE, 0x7FF, 0);
+  canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  chThdSleepMilliseconds(2);
+  make_frame(&ctf, FALSE, 0x300, 0);
+  canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  make_frame(&ctf, FALSE, 0x100, 0);
+  canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  make_frame(&ctf, FALSE, 0x200, 0);
+  canTransmit(&CAND2, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  make_frame(&ctf, FALSE, 0x050, 0);
+  canTransmit(&CAND2, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  make_frame(&ctf, FALSE, 0x180, 0);
+  canTransmit(&CAND2, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  wait_transmitted(&CAND1);
+  wait_transmitted(&CAND2);
+
+  n = canReceiveN(&CAND2, frames, NULL, CAN_RX_FIFO_SIZE, TIME_IMMEDIATE);
+  ok = n == sizeof order / sizeof order[0];
+  for (i = 0; ok && (i < n); i++)
+    ok = frames[i].SID == order[i];
+  check("frames in identifiers order", ok);
+
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*
+ * Errors are injected in the frames of CAND1, the frames are retransmitted
+ * and the error frames are seen by the receiver. With all the frames
+ * destroyed the transmitter reaches the bus-off state.
+ */
+static void test_errors(void) {
+  static const CANConfig noisy = {LOAD_BITRATE, FALSE, NULL, 100000};
+  static const CANConfig broken = {LOAD_BITRATE, FALSE, NULL, 1000000};
+  static const CANConfig cfg = {LOAD_BITRATE, FALSE, NULL, 0};
+  EventListener el;
+  CANSimBusStats bs;
+  CANTxFrame ctf;
+  flagsmask_t flags;
+  uint32_t rxframes;
+
+  printf("\n*** Error frames\n");
+
+  canStart(&CAND1, &noisy);
+  canStart(&CAND2, &cfg);
+  canSimResetStats(&CAND1);
+  rxframes = CAND2.rxframes;
+  chEvtRegisterMask(&CAND2.error_event, &el, EVENT_MASK(0));
+  send_burst(FALSE, 0x100, 0, 200);
+  canSimGetBusStats(&CAND1, &bs);
+  flags = chEvtGetAndClearFlags(&el);
+  chEvtUnregister(&CAND2.error_event, &el);
+  printf("%u frames, %u error frames\n", (unsigned)bs.frames,
+         (unsigned)bs.errors);
+  check("frames retransmitted", CAND2.rxframes - rxframes == 200);
+  check("error frames", (bs.errors > 0) && (CAND2.errors >= bs.errors));
+  check("framing error event", (flags & CAN_FRAMING_ERROR) != 0);
+  drain(&CAND2);
+  canStop(&CAND1);
+
+  canStart(&CAND1, &broken);
+  chEvtRegisterMask(&CAND1.error_event, &el, EVENT_MASK(0));
+  make_frame(&ctf, FALSE, 0x100, 0);
+  canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_IMMEDIATE);
+  flags = 0;
+  while ((flags & CAN_BUS_OFF_ERROR) == 0) {
+    if (chEvtWaitAnyTimeout(EVENT_MASK(0), MS2ST(100)) == 0)
+      break;
+    flags |= chEvtGetAndClearFlags(&el);
+  }
+  chEvtUnregister(&CAND1.error_event, &el);
+  check("error warning and passive states",
+        (flags & (CAN_LIMIT_WARNING | CAN_LIMIT_ERROR)) ==
+        (CAN_LIMIT_WARNING | CAN_LIMIT_ERROR));
+  check("bus-off state", (flags & CAN_BUS_OFF_ERROR) != 0);
+
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*===========================================================================*/
+/* Latency under load.                                                       */
+/*===========================================================================*/
+
+static WORKING_AREA(waLoad, 2048);
+static volatile bool_t load_stop;
+
+/*
+ * Background traffic from CAND2, frames are paced in order to generate
+ * the requested bus load in permille.
+ */
+static msg_t LoadThread(void *arg) {
+  uint32_t load = (uint32_t)arg;
+  uint64_t frame_ns, sent = 0;
+  systime_t start = chTimeNow();
+  CANTxFrame ctf;
+
+  make_frame(&ctf, FALSE, 0x400, 0);
+  frame_ns = (uint64_t)canSimGetFrameBits(&ctf) * 1000000000 / LOAD_BITRATE;
+  while (!load_stop) {
+    uint64_t due = (uint64_t)(chTimeNow() - start) *
+                   (1000000000 / CH_FREQUENCY) * load / 1000 / frame_ns;
+
+    if ((load < 1000) && (sent >= due)) {
+      chThdSleep(1);
+      continue;
+    }
+    ctf.data32[0] = (uint32_t)sent++;
+    canTransmit(&CAND2, CAN_ANY_MAILBOX, &ctf, MS2ST(10));
+  }
+  return 0;
+}
+
+/*
+ * A periodic high priority probe from CAND1 competes with the background
+ * traffic, the probe latency is measured from the transmit request to the
+ * end of the frame.
+ */
+static void bench_load(uint32_t load) {
+  static const CANConfig cfg = {LOAD_BITRATE, FALSE, NULL, 0};
+  CANSimBusStats bs;
+  CANTxFrame ctf;
+  uint32_t frame_ns, avg;
+  systime_t start, next;
+  Thread *tp;
+
+  canStart(&CAND1, &cfg);
+  canStart(&CAND2, &cfg);
+  canSimResetStats(&CAND1);
+
+  load_stop = FALSE;
+  tp = chThdCreateStatic(waLoad, sizeof waLoad, NORMALPRIO + 1,
+                         LoadThread, (void *)load);
+  make_frame(&ctf, FALSE, 0x100, 0);
+  frame_ns = (uint32_t)((uint64_t)canSimGetFrameBits(&ctf) * 1000000000 /
+                        LOAD_BITRATE);
+  start = next = chTimeNow();
+  while (chTimeNow() - start < LOAD_TIME) {
+    next += PROBE_PERIOD;
+    canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+    chThdSleepUntil(next);
+  }
+  canSimGetBusStats(&CAND1, &bs);
+  load_stop = TRUE;
+  chThdWait(tp);
+  wait_transmitted(&CAND1);
+  wait_transmitted(&CAND2);
+
+  avg = CAND1.txframes > 0 ?
+        (uint32_t)(CAND1.txlat_total / CAND1.txframes) : 0;
+  printf("load %3u%%: bus %3u.%u%%, %5u frames/s, probe latency %4u us "
+         "average %4u us worst, frame %u us\n",
+         (unsigned)load / 10, (unsigned)bs.load / 10, (unsigned)bs.load % 10,
+         (unsigned)((uint64_t)bs.frames * 1000000000 / bs.elapsed),
+         (unsigned)(avg / 1000), (unsigned)(CAND1.txlat_worst / 1000),
+         (unsigned)(frame_ns / 1000));
+  check("bus load reached", bs.load + 50 >= load);
+  check("probe latency bounded", avg < 4 * frame_ns);
+
+  canStop(&CAND2);
+  canStop(&CAND1);
+  chThdSleepMilliseconds(1);
+}
+
+/*===========================================================================*/
+/* Shared memory bus.                                                        */
+/*===========================================================================*/
+
+static char bus_name[32];
+static pid_t echo_pid;
+
+/*
+ * Node running in a child process, each frame is echoed with the next
+ * identifier, the 0x7FF identifier terminates the node.
+ */
+static void echo_node(void) {
+  CANConfig cfg = {LOAD_BITRATE, FALSE, bus_name, 0};
+  CANRxFrame crf;
+  CANTxFrame ctf;
+
+  canStart(&CAND1, &cfg);
+  while ((canReceive(&CAND1, CAN_ANY_MAILBOX, &crf, S2ST(30)) == RDY_OK) &&
+         (crf.SID != 0x7FF)) {
+    make_frame(&ctf, FALSE, crf.SID + 1, crf.data32[0]);
+    canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+  }
+  canStop(&CAND1);
+}
+
+/*
+ * Round trip through a node in another process.
+ */
+static void test_shared(void) {
+  CANConfig cfg = {LOAD_BITRATE, FALSE, bus_name, 0};
+  uint32_t i, answered = 0, worst = 0;
+  uint64_t total = 0;
+  CANRxFrame crf;
+  CANTxFrame ctf;
+  int status = -1;
+
+  printf("\n*** Shared memory bus %s\n", bus_name);
+
+  canStart(&CAND1, &cfg);
+
+  /* Waits for the other process to attach.*/
+  make_frame(&ctf, FALSE, 0x010, 0xFFFFFFFF);
+  for (i = 0; i < 500; i++) {
+    canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+    if ((canReceive(&CAND1, CAN_ANY_MAILBOX, &crf, MS2ST(10)) == RDY_OK) &&
+        (crf.SID == 0x011))
+      break;
+  }
+  drain(&CAND1);
+
+  for (i = 0; i < ECHO_PINGS; i++) {
+    halrtcnt_t t = halGetCounterValue();
+
+    make_frame(&ctf, FALSE, 0x010, i);
+    canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+    if ((canReceive(&CAND1, CAN_ANY_MAILBOX, &crf, MS2ST(100)) != RDY_OK) ||
+        (crf.SID != 0x011) || (crf.data32[0] != i))
+      break;
+    t = halGetCounterValue() - t;
+    total += t;
+    if (t > worst)
+      worst = t;
+    answered++;
+  }
+  make_frame(&ctf, FALSE, 0x7FF, 0);
+  canTransmit(&CAND1, CAN_ANY_MAILBOX, &ctf, TIME_INFINITE);
+  wait_transmitted(&CAND1);
+  canStop(&CAND1);
+
+  waitpid(echo_pid, &status, 0);
+  shm_unlink(bus_name);
+
+  printf("%u round trips, %u us average, %u us worst\n", (unsigned)answered,
+         (unsigned)(total / (answered ? answered : 1) / 1000),
+         (unsigned)(worst / 1000));
+  check("echo node answered", answered == ECHO_PINGS);
+  check("echo node terminated", WIFEXITED(status) &&
+                                (WEXITSTATUS(status) == 0));
+}
+
+/*===========================================================================*/
+/* Receive throughput.                                                       */
+/*===========================================================================*/
+
+/*
+ * The sender streams frames while the receiver drains them one at time
+ * or in batches, the latency is measured between the arrival timestamp
+ * and the moment the frame is returned to the application.
+ */
+static void bench_receive(size_t batch) {
+  static struct burst b;
+  uint64_t latency = 0;
+  uint32_t received = 0, expected = 0, overflows;
+  systime_t start, time;
+  bool_t ordered = TRUE;
+  Thread *tp;
+
+  canStart(&CAND1, &cancfg);
+  canStart(&CAND2, &cancfg);
+  overflows = canGetRxOverflows(&CAND2);
+
+  b.ide   = TRUE;
+  b.first = 0x123;
+  b.step  = 0;
+  b.n     = BENCH_FRAMES;
+  start = chTimeNow();
+  tp = chThdCreateStatic(waSender, sizeof waSender, NORMALPRIO + 1,
+                         Sender, &b);
+  while (received < BENCH_FRAMES) {
+    size_t i, n;
+
+    n = canReceiveN(&CAND2, frames, times, batch, MS2ST(100));
+    if (n == 0)
+      break;
+    for (i = 0; i < n; i++) {
+      if (frames[i].data32[0] != expected++)
+        ordered = FALSE;
+      latency += (uint32_t)(halGetCounterValue() - times[i]);
+    }
+    received += n;
+  }
+  time = chTimeNow() - start;
+  chThdWait(tp);
+
+  overflows = canGetRxOverflows(&CAND2) - overflows;
+  printf("batch %2u: %6u frames/s, %u ns average delivery latency, "
+         "%u overflows\n", (unsigned)batch,
+         (unsigned)((uint64_t)received * CH_FREQUENCY / (time ? time : 1)),
+         (unsigned)(latency / (received ? received : 1)),
+         (unsigned)overflows);
+  check("stream received in order",
+        (received == BENCH_FRAMES) && ordered && (overflows == 0));
+
+  canStop(&CAND2);
+  canStop(&CAND1);
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+
+  /*
+   * The node at the other end of the shared memory bus is a child process
+   * running its own simulator instance.
+   */
+  snprintf(bus_name, sizeof bus_name, "/chibios-can-%d", (int)getpid());
+  echo_pid = fork();
+  if (echo_pid == 0) {
+    halInit();
+    chSysInit();
+    echo_node();
+    return 0;
+  }
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  test_fifo();
+  test_filter();
+  test_timing();
+  test_arbitration();
+  test_errors();
+
+  printf("\n*** Latency under load, %u bit/s\n", LOAD_BITRATE);
+  bench_load(800);
+  bench_load(900);
+  bench_load(1000);
+
+  if (echo_pid > 0)
+    test_shared();
+
+  printf("\n*** Receive throughput\n");
+  bench_receive(1);
+  bench_receive(BATCH_SIZE);
+
+  printf("\n%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
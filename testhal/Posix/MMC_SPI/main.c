@@ -0,0 +1,230 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "sim_sdcard.h"
+
+#define CARD_BLOCKS         4096
+#define BLOCK_SIZE          512
+#define FILE_NAME           "mmc_spi.img"
+
+#define BUFFER_BLOCKS       32
+#define BENCH_TIME          MS2ST(500)
+
+#define TICKS2MS(t)         ((uint32_t)(t) * 1000 / CH_FREQUENCY)
+
+static SimSDCard card;
+
+/*
+ * Modelled bus clocks, 400kHz during the initialization and 25MHz for the
+ * transfers, and a 5uS setup time for each exchange.
+ */
+static const SPIConfig ls_spicfg = {
+  NULL,
+  simsdGetSlave(&card),
+  400000,
+  5
+};
+
+static const SPIConfig hs_spicfg = {
+  NULL,
+  simsdGetSlave(&card),
+  25000000,
+  5
+};
+
+static const MMCConfig mmccfg = {&SPID1, &ls_spicfg, &hs_spicfg};
+
+static MMCDriver MMCD1;
+
+static uint8_t buffer[BUFFER_BLOCKS * BLOCK_SIZE];
+static uint8_t check_buffer[BUFFER_BLOCKS * BLOCK_SIZE];
+static unsigned failures;
+
+bool_t mmc_lld_is_card_inserted(MMCDriver *mmcp) {
+
+  (void)mmcp;
+  return card.fd >= 0;
+}
+
+bool_t mmc_lld_is_write_protected(MMCDriver *mmcp) {
+
+  (void)mmcp;
+  return FALSE;
+}
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+static void fill(uint8_t *p, size_t n, uint32_t seed) {
+
+  while (n-- > 0) {
+    seed = seed * 1103515245 + 12345;
+    *p++ = (uint8_t)(seed >> 16);
+  }
+}
+
+static bool_t read_check(uint32_t startblk, const uint8_t *p, uint32_t n) {
+
+  memset(check_buffer, 0, n * BLOCK_SIZE);
+  return (mmcRead(&MMCD1, startblk, check_buffer, n) == CH_SUCCESS) &&
+         (memcmp(check_buffer, p, n * BLOCK_SIZE) == 0);
+}
+
+/*
+ * Functional checks.
+ */
+static void test_transfers(void) {
+  unsigned i;
+
+  check("Card capacity", mmcsdGetCardCapacity(&MMCD1) == CARD_BLOCKS);
+
+  fill(buffer, BLOCK_SIZE, 1);
+  check("Single block write",
+        mmcWrite(&MMCD1, 10, buffer, 1) == CH_SUCCESS);
+  check("Single block read", read_check(10, buffer, 1));
+
+  fill(buffer, sizeof buffer, 2);
+  check("Multiple blocks write",
+        mmcWrite(&MMCD1, 100, buffer, BUFFER_BLOCKS) == CH_SUCCESS);
+  check("Multiple blocks read", read_check(100, buffer, BUFFER_BLOCKS));
+  check("Last block read", (mmcWrite(&MMCD1, CARD_BLOCKS - 1, buffer, 1) ==
+                            CH_SUCCESS) &&
+                           read_check(CARD_BLOCKS - 1, buffer, 1));
+
+  /* Sequential API, same blocks.*/
+  memset(check_buffer, 0, sizeof check_buffer);
+  i = 0;
+  if (mmcStartSequentialRead(&MMCD1, 100) == CH_SUCCESS) {
+    while ((i < 4) &&
+           (mmcSequentialRead(&MMCD1, check_buffer + i * BLOCK_SIZE) ==
+            CH_SUCCESS))
+      i++;
+    mmcStopSequentialRead(&MMCD1);
+  }
+  check("Sequential read",
+        (i == 4) && (memcmp(check_buffer, buffer, 4 * BLOCK_SIZE) == 0));
+
+  /* Block device interface.*/
+  check("Block device read",
+        (blkRead(&MMCD1, 104, check_buffer, 8) == CH_SUCCESS) &&
+        (memcmp(check_buffer, buffer + 4 * BLOCK_SIZE, 8 * BLOCK_SIZE) == 0));
+
+  check("Out of range read fails",
+        mmcRead(&MMCD1, CARD_BLOCKS, check_buffer, 1) == CH_FAILED);
+  check("Read crossing the end fails",
+        mmcRead(&MMCD1, CARD_BLOCKS - 1, check_buffer, 2) == CH_FAILED);
+  check("Read after a failure", read_check(100, buffer, 2));
+
+#if MMC_USE_CRC
+  /* The card sends a wrong CRC for the next block.*/
+  simsdCorruptNextRead(&card);
+  check("Corrupted block detected",
+        (mmcRead(&MMCD1, 100, check_buffer, 4) == CH_FAILED) &&
+        (MMCD1.crc_errors == 1));
+  check("Read after a CRC error", read_check(100, buffer, 4));
+#endif
+}
+
+/*
+ * Transfers of a fixed size for a fixed time.
+ */
+static void bench(const char *name, bool_t write, uint32_t n) {
+  uint32_t exchanges = SPID1.exchanges, frames = SPID1.frames;
+  uint32_t blk = 0, blocks = 0, bps;
+  systime_t start, time;
+  bool_t ok = TRUE;
+
+  start = chTimeNow();
+  do {
+    if (blk + n > CARD_BLOCKS)
+      blk = 0;
+    if (write)
+      ok = mmcWrite(&MMCD1, blk, buffer, n) == CH_SUCCESS;
+    else
+      ok = mmcRead(&MMCD1, blk, buffer, n) == CH_SUCCESS;
+    blk += n;
+    blocks += n;
+    time = chTimeNow() - start;
+  } while (ok && (time < BENCH_TIME));
+
+  bps = blocks * 1000 / TICKS2MS(time) * BLOCK_SIZE;
+  printf("%-6s %2lu blocks: %lu.%03lu MB/s, %lu SPI exchanges/block, "
+         "%lu bytes/block\n",
+         name, (unsigned long)n,
+         (unsigned long)(bps / 1000000), (unsigned long)(bps / 1000 % 1000),
+         (unsigned long)((SPID1.exchanges - exchanges) / blocks),
+         (unsigned long)((SPID1.frames - frames) / blocks));
+  if (!ok)
+    check(name, FALSE);
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+  static const uint32_t sizes[] = {1, 4, 16, BUFFER_BLOCKS};
+  unsigned i;
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  if (simsdOpen(&card, FILE_NAME, CARD_BLOCKS) != CH_SUCCESS) {
+    printf("cannot open %s\n", FILE_NAME);
+    return 1;
+  }
+
+  mmcObjectInit(&MMCD1);
+  mmcStart(&MMCD1, &mmccfg);
+  if (mmcConnect(&MMCD1) != CH_SUCCESS) {
+    printf("card initialization failed\n");
+    simsdClose(&card);
+    return 1;
+  }
+
+  printf("*** CRC %s\n", MMC_USE_CRC ? "enabled" : "disabled");
+  test_transfers();
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    bench("read", FALSE, sizes[i]);
+  for (i = 0; i < sizeof sizes / sizeof sizes[0]; i++)
+    bench("write", TRUE, sizes[i]);
+
+  mmcDisconnect(&MMCD1);
+  mmcStop(&MMCD1);
+  simsdClose(&card);
+  printf("\n%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
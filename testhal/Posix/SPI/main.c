@@ -0,0 +1,431 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "lis302dl.h"
+#include "sim_sdcard.h"
+#include "sim_spiflash.h"
+#include "sim_lis302dl.h"
+
+#define SD_BLOCKS           4096
+#define SD_FILE_NAME        "spi_sd.img"
+#define FLASH_SIZE          (1024 * 1024)
+
+#define BUFFER_SIZE         (16 * 512)
+#define BENCH_TIME          MS2ST(500)
+
+/* Modelled setup time of each exchange, microseconds.*/
+#define SPI_LATENCY         5
+
+#define TICKS2MS(t)         ((uint32_t)(t) * 1000 / CH_FREQUENCY)
+
+static SimSDCard card;
+static SimSPIFlash flash;
+static SimLIS302DL accel;
+static uint8_t flash_storage[FLASH_SIZE];
+
+/*
+ * One configuration for each slave, as the chip select lines of a
+ * physical bus.
+ */
+static const SPIConfig sd_lscfg = {
+  NULL,
+  simsdGetSlave(&card),
+  400000,
+  SPI_LATENCY
+};
+
+static const SPIConfig sd_hscfg = {
+  NULL,
+  simsdGetSlave(&card),
+  25000000,
+  SPI_LATENCY
+};
+
+static const SPIConfig flash_cfg = {
+  NULL,
+  simflashGetSlave(&flash),
+  50000000,
+  SPI_LATENCY
+};
+
+static const SPIConfig accel_cfg = {
+  NULL,
+  simlisGetSlave(&accel),
+  10000000,
+  SPI_LATENCY
+};
+
+static const MMCConfig mmccfg = {&SPID1, &sd_lscfg, &sd_hscfg};
+
+static MMCDriver MMCD1;
+
+static uint8_t buffer[BUFFER_SIZE];
+static uint8_t check_buffer[BUFFER_SIZE];
+static unsigned failures;
+
+bool_t mmc_lld_is_card_inserted(MMCDriver *mmcp) {
+
+  (void)mmcp;
+  return card.fd >= 0;
+}
+
+bool_t mmc_lld_is_write_protected(MMCDriver *mmcp) {
+
+  (void)mmcp;
+  return FALSE;
+}
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+static void fill(uint8_t *p, size_t n, uint32_t seed) {
+
+  while (n-- > 0) {
+    seed = seed * 1103515245 + 12345;
+    *p++ = (uint8_t)(seed >> 16);
+  }
+}
+
+/*
+ * Throughput in kB/s of a number of bytes transferred in a time interval.
+ */
+static uint32_t kbps(uint32_t bytes, systime_t time) {
+
+  return (uint32_t)((uint64_t)bytes * 1000 / TICKS2MS(time) / 1000);
+}
+
+/*===========================================================================*/
+/* Bus timing.                                                               */
+/*===========================================================================*/
+
+/*
+ * Exchanges of a fixed size with no slave, the measured throughput is
+ * compared with the modelled one.
+ */
+static void bench_bus(uint32_t bitrate, size_t n) {
+  SPIConfig cfg = {NULL, NULL, 0, SPI_LATENCY};
+  uint32_t bytes = 0, model;
+  systime_t start, time;
+
+  cfg.bitrate = bitrate;
+  spiStart(&SPID1, &cfg);
+  start = chTimeNow();
+  do {
+    spiExchange(&SPID1, n, buffer, check_buffer);
+    bytes += n;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+  spiStop(&SPID1);
+
+  model = (uint32_t)((uint64_t)n * 1000000 /
+                     (SPI_LATENCY + ((uint64_t)n * 8 * 1000000 + bitrate - 1) /
+                                    bitrate) / 1000);
+  printf("bus   %5lu kHz %4u bytes: %6lu kB/s, model %6lu kB/s\n",
+         (unsigned long)(bitrate / 1000), (unsigned)n,
+         (unsigned long)kbps(bytes, time), (unsigned long)model);
+}
+
+/*===========================================================================*/
+/* Accelerometer.                                                            */
+/*===========================================================================*/
+
+static void test_accel(void) {
+  uint32_t samples = 0;
+  systime_t start, time;
+  bool_t ok;
+
+  printf("\n*** LIS302DL\n");
+  simlisObjectInit(&accel);
+  spiStart(&SPID1, &accel_cfg);
+
+  check("WHO_AM_I",
+        lis302dlReadRegister(&SPID1, LIS302DL_WHO_AM_I) ==
+        SIMLIS_WHO_AM_I_VALUE);
+  check("Outputs zero when powered down",
+        lis302dlReadRegister(&SPID1, LIS302DL_OUTX) == 0);
+
+  /* Power up, 400Hz, all axes enabled.*/
+  lis302dlWriteRegister(&SPID1, LIS302DL_CTRL_REG1, 0xC7);
+  simlisSetAcceleration(&accel, 10, -20, 55);
+  check("Control register",
+        lis302dlReadRegister(&SPID1, LIS302DL_CTRL_REG1) == 0xC7);
+  check("Acceleration",
+        ((int8_t)lis302dlReadRegister(&SPID1, LIS302DL_OUTX) == 10) &&
+        ((int8_t)lis302dlReadRegister(&SPID1, LIS302DL_OUTY) == -20) &&
+        ((int8_t)lis302dlReadRegister(&SPID1, LIS302DL_OUTZ) == 55));
+
+  /* Polling the status register for new samples.*/
+  ok = TRUE;
+  start = chTimeNow();
+  do {
+    if (lis302dlReadRegister(&SPID1, LIS302DL_STATUS_REG) & 0x08) {
+      ok = ok && ((int8_t)lis302dlReadRegister(&SPID1, LIS302DL_OUTX) == 10);
+      (void)lis302dlReadRegister(&SPID1, LIS302DL_OUTY);
+      (void)lis302dlReadRegister(&SPID1, LIS302DL_OUTZ);
+      samples++;
+    }
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+  printf("%lu samples/s at 400Hz output data rate\n",
+         (unsigned long)(samples * 1000 / TICKS2MS(time)));
+  check("Sampling", ok && (samples > 0));
+
+  spiStop(&SPID1);
+}
+
+/*===========================================================================*/
+/* NOR flash.                                                                */
+/*===========================================================================*/
+
+static void flash_command(uint8_t cmd, uint32_t addr, size_t n) {
+  uint8_t hdr[4];
+
+  hdr[0] = cmd;
+  hdr[1] = (uint8_t)(addr >> 16);
+  hdr[2] = (uint8_t)(addr >> 8);
+  hdr[3] = (uint8_t)addr;
+  spiSend(&SPID1, n, hdr);
+}
+
+static void flash_simple_command(uint8_t cmd) {
+
+  spiSelect(&SPID1);
+  flash_command(cmd, 0, 1);
+  spiUnselect(&SPID1);
+}
+
+static void flash_wait(void) {
+  uint8_t sr;
+
+  spiSelect(&SPID1);
+  flash_command(SIMFLASH_CMD_READ_STATUS, 0, 1);
+  do {
+    spiReceive(&SPID1, 1, &sr);
+  } while (sr & SIMFLASH_SR_WIP);
+  spiUnselect(&SPID1);
+}
+
+static void flash_read(uint32_t addr, uint8_t *p, size_t n) {
+
+  spiSelect(&SPID1);
+  flash_command(SIMFLASH_CMD_READ, addr, 4);
+  spiReceive(&SPID1, n, p);
+  spiUnselect(&SPID1);
+}
+
+static void flash_program(uint32_t addr, const uint8_t *p, size_t n) {
+  size_t chunk;
+
+  while (n > 0) {
+    chunk = SIMFLASH_PAGE_SIZE - (addr % SIMFLASH_PAGE_SIZE);
+    if (chunk > n)
+      chunk = n;
+    flash_simple_command(SIMFLASH_CMD_WRITE_ENABLE);
+    spiSelect(&SPID1);
+    flash_command(SIMFLASH_CMD_PAGE_PROGRAM, addr, 4);
+    spiSend(&SPID1, chunk, p);
+    spiUnselect(&SPID1);
+    flash_wait();
+    addr += chunk;
+    p += chunk;
+    n -= chunk;
+  }
+}
+
+static void flash_erase(uint32_t addr) {
+
+  flash_simple_command(SIMFLASH_CMD_WRITE_ENABLE);
+  spiSelect(&SPID1);
+  flash_command(SIMFLASH_CMD_SECTOR_ERASE, addr, 4);
+  spiUnselect(&SPID1);
+  flash_wait();
+}
+
+static bool_t is_erased(const uint8_t *p, size_t n) {
+
+  while (n-- > 0) {
+    if (*p++ != 0xFF)
+      return FALSE;
+  }
+  return TRUE;
+}
+
+static void test_flash(void) {
+  static const uint8_t zero[1];
+  uint8_t id[3];
+  uint32_t bytes;
+  systime_t start, time;
+
+  printf("\n*** NOR flash\n");
+  simflashObjectInit(&flash, flash_storage, FLASH_SIZE);
+  spiStart(&SPID1, &flash_cfg);
+
+  spiSelect(&SPID1);
+  flash_command(SIMFLASH_CMD_READ_ID, 0, 1);
+  spiReceive(&SPID1, sizeof id, id);
+  spiUnselect(&SPID1);
+  check("JEDEC ID", (id[0] == 0xEF) && (id[1] == 0x40) && (id[2] == 20));
+
+  /* Program across page boundaries and read back.*/
+  fill(buffer, 2 * SIMFLASH_SECTOR_SIZE, 3);
+  flash_program(100, buffer, 2 * SIMFLASH_SECTOR_SIZE - 100);
+  flash_read(100, check_buffer, 2 * SIMFLASH_SECTOR_SIZE - 100);
+  check("Program and read",
+        memcmp(check_buffer, buffer, 2 * SIMFLASH_SECTOR_SIZE - 100) == 0);
+
+  /* Programming can only clear bits.*/
+  flash_program(SIMFLASH_SECTOR_SIZE * 4, zero, 1);
+  flash_program(SIMFLASH_SECTOR_SIZE * 4, (const uint8_t *)"\xFF", 1);
+  flash_read(SIMFLASH_SECTOR_SIZE * 4, check_buffer, 1);
+  check("Programming clears bits only", check_buffer[0] == 0x00);
+
+  /* A program without write enable is ignored.*/
+  spiSelect(&SPID1);
+  flash_command(SIMFLASH_CMD_PAGE_PROGRAM, SIMFLASH_SECTOR_SIZE * 5, 4);
+  spiSend(&SPID1, 16, zero);
+  spiUnselect(&SPID1);
+  flash_read(SIMFLASH_SECTOR_SIZE * 5, check_buffer, 16);
+  check("Write enable required", is_erased(check_buffer, 16));
+
+  start = chTimeNow();
+  flash_erase(0);
+  time = chTimeNow() - start;
+  flash_read(0, check_buffer, SIMFLASH_SECTOR_SIZE);
+  check("Sector erase", is_erased(check_buffer, SIMFLASH_SECTOR_SIZE) &&
+                        (flash_storage[SIMFLASH_SECTOR_SIZE + 1] ==
+                         buffer[SIMFLASH_SECTOR_SIZE + 1 - 100]));
+  printf("sector erase: %lu ms\n", (unsigned long)TICKS2MS(time));
+
+  bytes = 0;
+  start = chTimeNow();
+  do {
+    flash_read(bytes % FLASH_SIZE, buffer, BUFFER_SIZE);
+    bytes += BUFFER_SIZE;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+  printf("read:    %6lu kB/s\n", (unsigned long)kbps(bytes, time));
+
+  bytes = 0;
+  start = chTimeNow();
+  do {
+    flash_program(SIMFLASH_BLOCK_SIZE + bytes % (FLASH_SIZE / 2),
+                  buffer, SIMFLASH_PAGE_SIZE);
+    bytes += SIMFLASH_PAGE_SIZE;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+  printf("program: %6lu kB/s\n", (unsigned long)kbps(bytes, time));
+
+  spiStop(&SPID1);
+}
+
+/*===========================================================================*/
+/* SD card.                                                                  */
+/*===========================================================================*/
+
+static void bench_sd(const char *name, bool_t write, uint32_t n) {
+  uint32_t blk = 0, blocks = 0;
+  systime_t start, time;
+  bool_t ok;
+
+  start = chTimeNow();
+  do {
+    if (write)
+      ok = mmcWrite(&MMCD1, blk, buffer, n) == CH_SUCCESS;
+    else
+      ok = mmcRead(&MMCD1, blk, buffer, n) == CH_SUCCESS;
+    blk = (blk + n) % (SD_BLOCKS - n);
+    blocks += n;
+    time = chTimeNow() - start;
+  } while (ok && (time < BENCH_TIME));
+  printf("%-6s %2lu blocks: %6lu kB/s\n", name, (unsigned long)n,
+         (unsigned long)kbps(blocks * MMCSD_BLOCK_SIZE, time));
+  if (!ok)
+    check(name, FALSE);
+}
+
+static void test_sd(void) {
+
+  printf("\n*** SD card\n");
+  if (simsdOpen(&card, SD_FILE_NAME, SD_BLOCKS) != CH_SUCCESS) {
+    check("Card image", FALSE);
+    return;
+  }
+
+  mmcObjectInit(&MMCD1);
+  mmcStart(&MMCD1, &mmccfg);
+  check("Card initialization", mmcConnect(&MMCD1) == CH_SUCCESS);
+  if (blkGetDriverState(&MMCD1) == BLK_READY) {
+    fill(buffer, BUFFER_SIZE, 4);
+    check("Write and read",
+          (mmcWrite(&MMCD1, 0, buffer, BUFFER_SIZE / MMCSD_BLOCK_SIZE) ==
+           CH_SUCCESS) &&
+          (mmcRead(&MMCD1, 0, check_buffer, BUFFER_SIZE / MMCSD_BLOCK_SIZE) ==
+           CH_SUCCESS) &&
+          (memcmp(buffer, check_buffer, BUFFER_SIZE) == 0));
+    bench_sd("read", FALSE, 1);
+    bench_sd("read", FALSE, BUFFER_SIZE / MMCSD_BLOCK_SIZE);
+    bench_sd("write", TRUE, 1);
+    bench_sd("write", TRUE, BUFFER_SIZE / MMCSD_BLOCK_SIZE);
+    mmcDisconnect(&MMCD1);
+  }
+  mmcStop(&MMCD1);
+  simsdClose(&card);
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+  static const uint32_t bitrates[] = {1000000, 10000000, 50000000};
+  static const size_t sizes[] = {1, 16, 512};
+  unsigned i, j;
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  printf("*** Bus, %u us exchange latency\n", SPI_LATENCY);
+  for (i = 0; i < sizeof bitrates / sizeof bitrates[0]; i++)
+    for (j = 0; j < sizeof sizes / sizeof sizes[0]; j++)
+      bench_bus(bitrates[i], sizes[j]);
+
+  test_accel();
+  test_flash();
+  test_sd();
+
+  printf("\n%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}
@@ -0,0 +1,418 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "usb_cdc.h"
+
+/*===========================================================================*/
+/* USB related stuff.                                                        */
+/*===========================================================================*/
+
+/*
+ * Serial over USB Driver structure.
+ */
+static SerialUSBDriver SDU1;
+
+/*
+ * USB Device Descriptor.
+ */
+static const uint8_t vcom_device_descriptor_data[18] = {
+  USB_DESC_DEVICE       (0x0110,        /* bcdUSB (1.1).                    */
+                         0x02,          /* bDeviceClass (CDC).              */
+                         0x00,          /* bDeviceSubClass.                 */
+                         0x00,          /* bDeviceProtocol.                 */
+                         0x40,          /* bMaxPacketSize.                  */
+                         0x0483,        /* idVendor (ST).                   */
+                         0x5740,        /* idProduct.                       */
+                         0x0200,        /* bcdDevice.                       */
+                         0,             /* iManufacturer.                   */
+                         0,             /* iProduct.                        */
+                         0,             /* iSerialNumber.                   */
+                         1)             /* bNumConfigurations.              */
+};
+
+/*
+ * Device Descriptor wrapper.
+ */
+static const USBDescriptor vcom_device_descriptor = {
+  sizeof vcom_device_descriptor_data,
+  vcom_device_descriptor_data
+};
+
+/* Configuration Descriptor tree for a CDC.*/
+static const uint8_t vcom_configuration_descriptor_data[67] = {
+  /* Configuration Descriptor.*/
+  USB_DESC_CONFIGURATION(67,            /* wTotalLength.                    */
+                         0x02,          /* bNumInterfaces.                  */
+                         0x01,          /* bConfigurationValue.             */
+                         0,             /* iConfiguration.                  */
+                         0xC0,          /* bmAttributes (self powered).     */
+                         50),           /* bMaxPower (100mA).               */
+  /* Interface Descriptor.*/
+  USB_DESC_INTERFACE    (0x00,          /* bInterfaceNumber.                */
+                         0x00,          /* bAlternateSetting.               */
+                         0x01,          /* bNumEndpoints.                   */
+                         0x02,          /* bInterfaceClass (Communications
+                                           Interface Class, CDC section
+                                           4.2).                            */
+                         0x02,          /* bInterfaceSubClass (Abstract
+                                         Control Model, CDC section 4.3).   */
+                         0x01,          /* bInterfaceProtocol (AT commands,
+                                           CDC section 4.4).                */
+                         0),            /* iInterface.                      */
+  /* Header Functional Descriptor (CDC section 5.2.3).*/
+  USB_DESC_BYTE         (5),            /* bLength.                         */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x00),         /* bDescriptorSubtype (Header
+                                           Functional Descriptor.           */
+  USB_DESC_BCD          (0x0110),       /* bcdCDC.                          */
+  /* Call Management Functional Descriptor. */
+  USB_DESC_BYTE         (5),            /* bFunctionLength.                 */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x01),         /* bDescriptorSubtype (Call Management
+                                           Functional Descriptor).          */
+  USB_DESC_BYTE         (0x00),         /* bmCapabilities (D0+D1).          */
+  USB_DESC_BYTE         (0x01),         /* bDataInterface.                  */
+  /* ACM Functional Descriptor.*/
+  USB_DESC_BYTE         (4),            /* bFunctionLength.                 */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x02),         /* bDescriptorSubtype (Abstract
+                                           Control Management Descriptor).  */
+  USB_DESC_BYTE         (0x02),         /* bmCapabilities.                  */
+  /* Union Functional Descriptor.*/
+  USB_DESC_BYTE         (5),            /* bFunctionLength.                 */
+  USB_DESC_BYTE         (0x24),         /* bDescriptorType (CS_INTERFACE).  */
+  USB_DESC_BYTE         (0x06),         /* bDescriptorSubtype (Union
+                                           Functional Descriptor).          */
+  USB_DESC_BYTE         (0x00),         /* bMasterInterface (Communication
+                                           Class Interface).                */
+  USB_DESC_BYTE         (0x01),         /* bSlaveInterface0 (Data Class
+                                           Interface).                      */
+  /* Endpoint 2 Descriptor.*/
+  USB_DESC_ENDPOINT     (USB_CDC_INTERRUPT_REQUEST_EP|0x80,
+                         0x03,          /* bmAttributes (Interrupt).        */
+                         0x0008,        /* wMaxPacketSize.                  */
+                         0xFF),         /* bInterval.                       */
+  /* Interface Descriptor.*/
+  USB_DESC_INTERFACE    (0x01,          /* bInterfaceNumber.                */
+                         0x00,          /* bAlternateSetting.               */
+                         0x02,          /* bNumEndpoints.                   */
+                         0x0A,          /* bInterfaceClass (Data Class
+                                           Interface, CDC section 4.5).     */
+                         0x00,          /* bInterfaceSubClass (CDC section
+                                           4.6).                            */
+                         0x00,          /* bInterfaceProtocol (CDC section
+                                           4.7).                            */
+                         0x00),         /* iInterface.                      */
+  /* Endpoint 3 Descriptor.*/
+  USB_DESC_ENDPOINT     (USB_CDC_DATA_AVAILABLE_EP,     /* bEndpointAddress.*/
+                         0x02,          /* bmAttributes (Bulk).             */
+                         0x0040,        /* wMaxPacketSize.                  */
+                         0x00),         /* bInterval.                       */
+  /* Endpoint 1 Descriptor.*/
+  USB_DESC_ENDPOINT     (USB_CDC_DATA_REQUEST_EP|0x80,  /* bEndpointAddress.*/
+                         0x02,          /* bmAttributes (Bulk).             */
+                         0x0040,        /* wMaxPacketSize.                  */
+                         0x00)          /* bInterval.                       */
+};
+
+/*
+ * Configuration Descriptor wrapper.
+ */
+static const USBDescriptor vcom_configuration_descriptor = {
+  sizeof vcom_configuration_descriptor_data,
+  vcom_configuration_descriptor_data
+};
+
+/*
+ * Handles the GET_DESCRIPTOR callback. All required descriptors must be
+ * handled here.
+ */
+static const USBDescriptor *get_descriptor(USBDriver *usbp,
+                                           uint8_t dtype,
+                                           uint8_t dindex,
+                                           uint16_t lang) {
+
+  (void)usbp;
+  (void)dindex;
+  (void)lang;
+  switch (dtype) {
+  case USB_DESCRIPTOR_DEVICE:
+    return &vcom_device_descriptor;
+  case USB_DESCRIPTOR_CONFIGURATION:
+    return &vcom_configuration_descriptor;
+  }
+  return NULL;
+}
+
+/**
+ * @brief   IN EP1 state.
+ */
+static USBInEndpointState ep1instate;
+
+/**
+ * @brief   OUT EP1 state.
+ */
+static USBOutEndpointState ep1outstate;
+
+/**
+ * @brief   EP1 initialization structure (both IN and OUT).
+ */
+static const USBEndpointConfig ep1config = {
+  USB_EP_MODE_TYPE_BULK,
+  NULL,
+  sduDataTransmitted,
+  sduDataReceived,
+  0x0040,
+  0x0040,
+  &ep1instate,
+  &ep1outstate,
+  1,
+  NULL
+};
+
+/**
+ * @brief   IN EP2 state.
+ */
+static USBInEndpointState ep2instate;
+
+/**
+ * @brief   EP2 initialization structure (IN only).
+ */
+static const USBEndpointConfig ep2config = {
+  USB_EP_MODE_TYPE_INTR,
+  NULL,
+  sduInterruptTransmitted,
+  NULL,
+  0x0010,
+  0x0000,
+  &ep2instate,
+  NULL,
+  1,
+  NULL
+};
+
+/*
+ * Handles the USB driver global events.
+ */
+static void usb_event(USBDriver *usbp, usbevent_t event) {
+
+  switch (event) {
+  case USB_EVENT_CONFIGURED:
+    chSysLockFromIsr();
+
+    /* Enables the endpoints specified into the configuration.
+       Note, this callback is invoked from an ISR so I-Class functions
+       must be used.*/
+    usbInitEndpointI(usbp, USB_CDC_DATA_REQUEST_EP, &ep1config);
+    usbInitEndpointI(usbp, USB_CDC_INTERRUPT_REQUEST_EP, &ep2config);
+
+    /* Resetting the state of the CDC subsystem.*/
+    sduConfigureHookI(usbp);
+
+    chSysUnlockFromIsr();
+    return;
+  default:
+    return;
+  }
+}
+
+/*
+ * USB driver configuration.
+ */
+static const USBConfig usbcfg = {
+  usb_event,
+  get_descriptor,
+  sduRequestsHook,
+  NULL
+};
+
+/*
+ * Serial over USB driver configuration.
+ */
+static const SerialUSBConfig serusbcfg = {
+  &USBD1
+};
+
+/*===========================================================================*/
+/* Device side activity.                                                     */
+/*===========================================================================*/
+
+#define BENCH_WA_SIZE       THD_WA_SIZE(4096)
+#define BENCH_TIME          MS2ST(1000)
+#define BENCH_ENUMERATIONS  100
+#define BENCH_BUFFER_SIZE   4096
+
+#define TICKS2MS(t)         ((uint32_t)(t) * 1000 / CH_FREQUENCY)
+
+static uint8_t devbuf[BENCH_BUFFER_SIZE];
+static uint8_t hostbuf[BENCH_BUFFER_SIZE];
+
+/*
+ * Keeps the IN data pipe full.
+ */
+static msg_t writer_thread(void *arg) {
+
+  (void)arg;
+  chRegSetThreadName("writer");
+  while (!chThdShouldTerminate())
+    chnWriteTimeout(&SDU1, devbuf, sizeof devbuf, MS2ST(10));
+  return 0;
+}
+
+/*
+ * Keeps the OUT data pipe empty.
+ */
+static msg_t reader_thread(void *arg) {
+
+  (void)arg;
+  chRegSetThreadName("reader");
+  while (!chThdShouldTerminate())
+    chnReadTimeout(&SDU1, devbuf, sizeof devbuf, MS2ST(10));
+  return 0;
+}
+
+/*===========================================================================*/
+/* Host side activity.                                                       */
+/*===========================================================================*/
+
+static void print_rate(const char *name, uint32_t bytes, systime_t time) {
+  uint32_t kbps = bytes / TICKS2MS(time);
+
+  printf("%-28s %9lu bytes in %4lu ms, %lu.%03lu MB/s\n", name,
+         (unsigned long)bytes, (unsigned long)TICKS2MS(time),
+         (unsigned long)(kbps / 1000), (unsigned long)(kbps % 1000));
+}
+
+static bool_t bench_enumeration(void) {
+  systime_t start, time;
+  unsigned i;
+
+  start = chTimeNow();
+  for (i = 0; i < BENCH_ENUMERATIONS; i++) {
+    if (usbSimEnumerate(&USBD1, 1, 1, MS2ST(100)) != RDY_OK) {
+      printf("enumeration failed\n");
+      return FALSE;
+    }
+  }
+  time = chTimeNow() - start;
+  printf("%-28s %9lu us per enumeration\n", "Enumeration",
+         (unsigned long)(TICKS2MS(time) * 1000 / BENCH_ENUMERATIONS));
+  return TRUE;
+}
+
+static bool_t bench_in(void) {
+  systime_t start, time;
+  uint32_t bytes = 0;
+  Thread *tp;
+
+  tp = chThdCreateFromHeap(NULL, BENCH_WA_SIZE, NORMALPRIO,
+                           writer_thread, NULL);
+  start = chTimeNow();
+  do {
+    size_t n = sizeof hostbuf;
+
+    if (usbSimInTransfer(&USBD1, USB_CDC_DATA_REQUEST_EP,
+                         hostbuf, &n, MS2ST(100)) != RDY_OK) {
+      printf("IN transfer failed\n");
+      return FALSE;
+    }
+    bytes += n;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+
+  chThdTerminate(tp);
+  while (!chThdTerminated(tp)) {
+    size_t n = sizeof hostbuf;
+
+    usbSimInTransfer(&USBD1, USB_CDC_DATA_REQUEST_EP,
+                     hostbuf, &n, MS2ST(10));
+  }
+  chThdRelease(tp);
+  print_rate("IN (device to host)", bytes, time);
+  return TRUE;
+}
+
+static bool_t bench_out(void) {
+  systime_t start, time;
+  uint32_t bytes = 0;
+  Thread *tp;
+
+  tp = chThdCreateFromHeap(NULL, BENCH_WA_SIZE, NORMALPRIO,
+                           reader_thread, NULL);
+  start = chTimeNow();
+  do {
+    if (usbSimOutTransfer(&USBD1, USB_CDC_DATA_AVAILABLE_EP,
+                          hostbuf, sizeof hostbuf, MS2ST(100)) != RDY_OK) {
+      printf("OUT transfer failed\n");
+      return FALSE;
+    }
+    bytes += sizeof hostbuf;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+
+  chThdTerminate(tp);
+  chThdWait(tp);
+  print_rate("OUT (host to device)", bytes, time);
+  return TRUE;
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+  bool_t ok;
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  /*
+   * Initializes a serial-over-USB CDC driver.
+   */
+  sduObjectInit(&SDU1);
+  sduStart(&SDU1, &serusbcfg);
+
+  /*
+   * Activates the USB driver and then the simulated bus connection.
+   */
+  usbStart(serusbcfg.usbp, &usbcfg);
+  usbConnectBus(serusbcfg.usbp);
+
+  /*
+   * The main thread acts as the USB host.
+   */
+  ok = bench_enumeration() && bench_in() && bench_out();
+  printf("%-28s %9lu packets, %lu bytes\n", "Bus totals",
+         (unsigned long)USBD1.packets, (unsigned long)USBD1.bytes);
+
+  return ok ? 0 : 1;
+}
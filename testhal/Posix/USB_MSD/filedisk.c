@@ -0,0 +1,162 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ch.h"
+#include "hal.h"
+#include "filedisk.h"
+
+static void fd_delay(FileDisk *fdp, uint32_t n) {
+  systime_t time = fdp->access_time + fdp->block_time * n;
+
+  if (time > 0)
+    chThdSleep(time);
+}
+
+static bool_t fd_is_inserted(void *instance) {
+
+  return ((FileDisk *)instance)->fd >= 0;
+}
+
+static bool_t fd_is_protected(void *instance) {
+
+  (void)instance;
+  return FALSE;
+}
+
+static bool_t fd_connect(void *instance) {
+
+  (void)instance;
+  return CH_SUCCESS;
+}
+
+static bool_t fd_disconnect(void *instance) {
+
+  (void)instance;
+  return CH_SUCCESS;
+}
+
+static bool_t fd_read(void *instance, uint32_t startblk,
+                      uint8_t *buffer, uint32_t n) {
+  FileDisk *fdp = instance;
+  size_t size = (size_t)n * FILEDISK_BLOCK_SIZE;
+
+  if ((startblk >= fdp->blk_num) || (n > fdp->blk_num - startblk))
+    return CH_FAILED;
+  fdp->state = BLK_READING;
+  fd_delay(fdp, n);
+  if (pread(fdp->fd, buffer, size,
+            (off_t)startblk * FILEDISK_BLOCK_SIZE) != (ssize_t)size) {
+    fdp->state = BLK_READY;
+    return CH_FAILED;
+  }
+  fdp->state = BLK_READY;
+  return CH_SUCCESS;
+}
+
+static bool_t fd_write(void *instance, uint32_t startblk,
+                       const uint8_t *buffer, uint32_t n) {
+  FileDisk *fdp = instance;
+  size_t size = (size_t)n * FILEDISK_BLOCK_SIZE;
+
+  if ((startblk >= fdp->blk_num) || (n > fdp->blk_num - startblk))
+    return CH_FAILED;
+  fdp->state = BLK_WRITING;
+  fd_delay(fdp, n);
+  if (pwrite(fdp->fd, buffer, size,
+             (off_t)startblk * FILEDISK_BLOCK_SIZE) != (ssize_t)size) {
+    fdp->state = BLK_READY;
+    return CH_FAILED;
+  }
+  fdp->state = BLK_READY;
+  return CH_SUCCESS;
+}
+
+static bool_t fd_sync(void *instance) {
+  FileDisk *fdp = instance;
+
+  return fsync(fdp->fd) == 0 ? CH_SUCCESS : CH_FAILED;
+}
+
+static bool_t fd_get_info(void *instance, BlockDeviceInfo *bdip) {
+  FileDisk *fdp = instance;
+
+  bdip->blk_size = FILEDISK_BLOCK_SIZE;
+  bdip->blk_num  = fdp->blk_num;
+  return CH_SUCCESS;
+}
+
+static const struct FileDiskVMT vmt = {
+  fd_is_inserted,
+  fd_is_protected,
+  fd_connect,
+  fd_disconnect,
+  fd_read,
+  fd_write,
+  fd_sync,
+  fd_get_info
+};
+
+/**
+ * @brief   Opens a file disk.
+ * @details The host file is created, or extended, to the disk size.
+ *
+ * @param[out] fdp          pointer to the @p FileDisk object
+ * @param[in] name          host file name
+ * @param[in] blk_num       size of the disk in blocks
+ * @param[in] access_time   simulated access time of each operation
+ * @param[in] block_time    simulated transfer time per block
+ * @return                  The operation status.
+ * @retval CH_SUCCESS       the disk is ready.
+ * @retval CH_FAILED        the host file cannot be opened.
+ */
+bool_t fdOpen(FileDisk *fdp, const char *name, uint32_t blk_num,
+              systime_t access_time, systime_t block_time) {
+
+  fdp->vmt         = &vmt;
+  fdp->state       = BLK_STOP;
+  fdp->blk_num     = blk_num;
+  fdp->access_time = access_time;
+  fdp->block_time  = block_time;
+  fdp->fd          = open(name, O_RDWR | O_CREAT, 0644);
+  if (fdp->fd < 0)
+    return CH_FAILED;
+  if (ftruncate(fdp->fd, (off_t)blk_num * FILEDISK_BLOCK_SIZE) != 0) {
+    fdClose(fdp);
+    return CH_FAILED;
+  }
+  fdp->state = BLK_READY;
+  return CH_SUCCESS;
+}
+
+/**
+ * @brief   Closes a file disk.
+ *
+ * @param[in] fdp           pointer to the @p FileDisk object
+ */
+void fdClose(FileDisk *fdp) {
+
+  if (fdp->fd >= 0)
+    close(fdp->fd);
+  fdp->fd    = -1;
+  fdp->state = BLK_STOP;
+}
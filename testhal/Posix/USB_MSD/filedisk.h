@@ -0,0 +1,73 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#ifndef _FILEDISK_H_
+#define _FILEDISK_H_
+
+/**
+ * @brief   File disk block size.
+ */
+#define FILEDISK_BLOCK_SIZE     512
+
+/**
+ * @brief   @p FileDisk specific data.
+ */
+#define _file_disk_data                                                     \
+  _base_block_device_data                                                   \
+  /* Host file descriptor.*/                                                \
+  int                   fd;                                                 \
+  /* Size of the disk in blocks.*/                                          \
+  uint32_t              blk_num;                                            \
+  /* Simulated access time of each operation.*/                             \
+  systime_t             access_time;                                        \
+  /* Simulated transfer time per block.*/                                   \
+  systime_t             block_time;
+
+/**
+ * @brief   @p FileDisk virtual methods table.
+ */
+struct FileDiskVMT {
+  _base_block_device_methods
+};
+
+/**
+ * @extends BaseBlockDevice
+ *
+ * @brief   Block device backed by an host file.
+ * @details The access and transfer times simulate the timings of a
+ *          physical device, for example an SD card.
+ */
+typedef struct {
+  /** @brief Virtual Methods Table.*/
+  const struct FileDiskVMT *vmt;
+  _file_disk_data
+} FileDisk;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+  bool_t fdOpen(FileDisk *fdp, const char *name, uint32_t blk_num,
+                systime_t access_time, systime_t block_time);
+  void fdClose(FileDisk *fdp);
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* _FILEDISK_H_ */
@@ -0,0 +1,545 @@
+/*
+    ChibiOS/RT - Copyright (C) 2006,2007,2008,2009,2010,
+                 2011,2012,2013 Giovanni Di Sirio.
+
+    This file is part of ChibiOS/RT.
+
+    ChibiOS/RT is free software; you can redistribute it and/or modify
+    it under the terms of the GNU General Public License as published by
+    the Free Software Foundation; either version 3 of the License, or
+    (at your option) any later version.
+
+    ChibiOS/RT is distributed in the hope that it will be useful,
+    but WITHOUT ANY WARRANTY; without even the implied warranty of
+    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+    GNU General Public License for more details.
+
+    You should have received a copy of the GNU General Public License
+    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*/
+
+#include <stdio.h>
+#include <string.h>
+
+#include "ch.h"
+#include "hal.h"
+
+#include "ramdisk.h"
+#include "filedisk.h"
+
+/*===========================================================================*/
+/* Storage back ends.                                                        */
+/*===========================================================================*/
+
+#define RAM_BLOCKS          1024
+#define CONFIG_START        896
+#define FILE_BLOCKS         2048
+#define FILE_NAME           "usb_msd.img"
+
+/*
+ * Fast RAM disk, the last blocks are exposed as a separate read-only
+ * configuration volume.
+ */
+static uint8_t ram_storage[RAMDISK_STORAGE_SIZE(RAM_BLOCKS)];
+static RamDisk RD1;
+
+/*
+ * Slow file disk, simulating the access time of an SD card.
+ */
+static FileDisk FD1;
+
+/*
+ * Write-behind resources of the file disk unit.
+ */
+#define FILE_QUEUE_DEPTH    4
+static msd_slot_t file_slots[FILE_QUEUE_DEPTH];
+static WORKING_AREA(waFileLun, 1024);
+
+/*
+ * Logical units.
+ */
+static const MSDLunConfig luns[] = {
+  /* LUN 0, RAM disk data partition.*/
+  {(BaseBlockDevice *)&RD1, 0, CONFIG_START, FALSE, NULL, 0, NULL, 0},
+  /* LUN 1, file disk with write-behind queue.*/
+  {(BaseBlockDevice *)&FD1, 0, 0, FALSE, file_slots, FILE_QUEUE_DEPTH,
+   waFileLun, sizeof waFileLun},
+  /* LUN 2, read-only configuration volume on the RAM disk.*/
+  {(BaseBlockDevice *)&RD1, CONFIG_START, 0, TRUE, NULL, 0, NULL, 0}
+};
+
+#define NUM_LUNS            (sizeof luns / sizeof luns[0])
+
+static USBMassStorageDriver UMSD1;
+
+/*===========================================================================*/
+/* USB related stuff.                                                        */
+/*===========================================================================*/
+
+#define MSD_DATA_EP         1
+
+/*
+ * USB Device Descriptor.
+ */
+static const uint8_t msd_device_descriptor_data[18] = {
+  USB_DESC_DEVICE       (0x0200,        /* bcdUSB (2.0).                    */
+                         0x00,          /* bDeviceClass (None).             */
+                         0x00,          /* bDeviceSubClass.                 */
+                         0x00,          /* bDeviceProtocol.                 */
+                         0x40,          /* Control Endpoint Size.           */
+                         0x0483,        /* idVendor (ST).                   */
+                         0x5742,        /* idProduct.                       */
+                         0x0100,        /* bcdDevice.                       */
+                         0,             /* iManufacturer.                   */
+                         0,             /* iProduct.                        */
+                         0,             /* iSerialNumber.                   */
+                         1)             /* bNumConfigurations.              */
+};
+
+/*
+ * Device Descriptor wrapper.
+ */
+static const USBDescriptor msd_device_descriptor = {
+  sizeof msd_device_descriptor_data,
+  msd_device_descriptor_data
+};
+
+/* Configuration Descriptor tree for a Mass Storage device.*/
+static const uint8_t msd_configuration_descriptor_data[32] = {
+  /* Configuration Descriptor.*/
+  USB_DESC_CONFIGURATION(32,            /* wTotalLength.                    */
+                         0x01,          /* bNumInterfaces.                  */
+                         0x01,          /* bConfigurationValue.             */
+                         0,             /* iConfiguration.                  */
+                         0xC0,          /* bmAttributes (self powered).     */
+                         50),           /* bMaxPower (100mA).               */
+  /* Interface Descriptor.*/
+  USB_DESC_INTERFACE    (0x00,          /* bInterfaceNumber.                */
+                         0x00,          /* bAlternateSetting.               */
+                         0x02,          /* bNumEndpoints.                   */
+                         0x08,          /* bInterfaceClass (Mass Storage).  */
+                         0x06,          /* bInterfaceSubClass (SCSI
+                                           Transparent storage class).      */
+                         0x50,          /* bInterfaceProtocol (Bulk Only).  */
+                         0),            /* iInterface.                      */
+  /* Mass Storage Data In Endpoint Descriptor.*/
+  USB_DESC_ENDPOINT     (MSD_DATA_EP|0x80,
+                         0x02,          /* bmAttributes (Bulk).             */
+                         USB_MS_EP_SIZE,/* wMaxPacketSize.                  */
+                         0x00),         /* bInterval.                       */
+  /* Mass Storage Data Out Endpoint Descriptor.*/
+  USB_DESC_ENDPOINT     (MSD_DATA_EP,
+                         0x02,          /* bmAttributes (Bulk).             */
+                         USB_MS_EP_SIZE,/* wMaxPacketSize.                  */
+                         0x00)          /* bInterval.                       */
+};
+
+/*
+ * Configuration Descriptor wrapper.
+ */
+static const USBDescriptor msd_configuration_descriptor = {
+  sizeof msd_configuration_descriptor_data,
+  msd_configuration_descriptor_data
+};
+
+/*
+ * Handles the GET_DESCRIPTOR callback. All required descriptors must be
+ * handled here.
+ */
+static const USBDescriptor *get_descriptor(USBDriver *usbp,
+                                           uint8_t dtype,
+                                           uint8_t dindex,
+                                           uint16_t lang) {
+
+  (void)usbp;
+  (void)dindex;
+  (void)lang;
+  switch (dtype) {
+  case USB_DESCRIPTOR_DEVICE:
+    return &msd_device_descriptor;
+  case USB_DESCRIPTOR_CONFIGURATION:
+    return &msd_configuration_descriptor;
+  }
+  return NULL;
+}
+
+/**
+ * @brief   IN EP1 state.
+ */
+static USBInEndpointState ep1instate;
+
+/**
+ * @brief   OUT EP1 state.
+ */
+static USBOutEndpointState ep1outstate;
+
+/**
+ * @brief   EP1 initialization structure (both IN and OUT).
+ */
+static const USBEndpointConfig ep1config = {
+  USB_EP_MODE_TYPE_BULK,
+  NULL,
+  msdUsbEvent,
+  msdUsbEvent,
+  USB_MS_EP_SIZE,
+  USB_MS_EP_SIZE,
+  &ep1instate,
+  &ep1outstate,
+  1,
+  NULL
+};
+
+/*
+ * Handles the USB driver global events.
+ */
+static void usb_event(USBDriver *usbp, usbevent_t event) {
+  USBMassStorageDriver *msdp = (USBMassStorageDriver *)usbp->USBD_PARAM_NAME;
+
+  switch (event) {
+  case USB_EVENT_RESET:
+    msdp->reconfigured_or_reset_event = TRUE;
+    return;
+  case USB_EVENT_CONFIGURED:
+    chSysLockFromIsr();
+    msdp->reconfigured_or_reset_event = TRUE;
+    usbInitEndpointI(usbp, MSD_DATA_EP, &ep1config);
+
+    /* Waking up the mass storage thread.*/
+    chBSemSignalI(&msdp->bsem);
+    chEvtBroadcastI(&msdp->evt_connected);
+    chSysUnlockFromIsr();
+    return;
+  default:
+    return;
+  }
+}
+
+/*
+ * USB driver configuration.
+ */
+static const USBConfig usbcfg = {
+  usb_event,
+  get_descriptor,
+  msdRequestsHook,
+  NULL
+};
+
+/*===========================================================================*/
+/* Host side, Bulk-Only Transport.                                           */
+/*===========================================================================*/
+
+#define HOST_TIMEOUT        MS2ST(2000)
+#define BENCH_TIME          MS2ST(1000)
+#define BENCH_BLOCKS        128
+
+#define TICKS2MS(t)         ((uint32_t)(t) * 1000 / CH_FREQUENCY)
+
+static uint8_t hostbuf[BENCH_BLOCKS * MSD_BLOCK_SIZE];
+static uint8_t checkbuf[BENCH_BLOCKS * MSD_BLOCK_SIZE];
+static uint32_t host_tag;
+static unsigned failures;
+
+/*
+ * Clears an halted endpoint.
+ */
+static msg_t clear_halt(uint8_t ep_address) {
+  uint8_t setup[8] = {
+    USB_RTYPE_RECIPIENT_ENDPOINT, USB_REQ_CLEAR_FEATURE,
+    USB_FEATURE_ENDPOINT_HALT, 0x00, ep_address, 0x00, 0x00, 0x00
+  };
+
+  return usbSimControlTransfer(&USBD1, setup, NULL, NULL, HOST_TIMEOUT);
+}
+
+/*
+ * Executes a SCSI command, returns the CSW status or -1 on a transport
+ * error.
+ */
+static int scsi_command(uint8_t lun, const uint8_t *cdb, size_t cdblen,
+                        bool_t in, uint8_t *data, size_t n) {
+  msd_cbw_t cbw;
+  msd_csw_t csw;
+  size_t cnt;
+  msg_t msg;
+
+  memset(&cbw, 0, sizeof cbw);
+  cbw.signature    = MSD_CBW_SIGNATURE;
+  cbw.tag          = ++host_tag;
+  cbw.data_len     = n;
+  cbw.flags        = in ? MSD_COMMAND_DIR_DATA_IN : MSD_COMMAND_DIR_DATA_OUT;
+  cbw.lun          = lun;
+  cbw.scsi_cmd_len = (uint8_t)cdblen;
+  memcpy(cbw.scsi_cmd_data, cdb, cdblen);
+  if (usbSimOutTransfer(&USBD1, MSD_DATA_EP, (const uint8_t *)&cbw,
+                        sizeof cbw, HOST_TIMEOUT) != RDY_OK)
+    return -1;
+
+  /* Data phase, a stall means that the device terminated it early.*/
+  if (n > 0) {
+    if (in) {
+      cnt = n;
+      msg = usbSimInTransfer(&USBD1, MSD_DATA_EP, data, &cnt, HOST_TIMEOUT);
+      if (msg == USB_SIM_STALLED)
+        msg = clear_halt(MSD_DATA_EP | 0x80);
+    }
+    else {
+      msg = usbSimOutTransfer(&USBD1, MSD_DATA_EP, data, n, HOST_TIMEOUT);
+      if (msg == USB_SIM_STALLED)
+        msg = clear_halt(MSD_DATA_EP);
+    }
+    if (msg != RDY_OK)
+      return -1;
+  }
+
+  /* Status phase.*/
+  cnt = sizeof csw;
+  if ((usbSimInTransfer(&USBD1, MSD_DATA_EP, (uint8_t *)&csw, &cnt,
+                        HOST_TIMEOUT) != RDY_OK) ||
+      (cnt != sizeof csw) || (csw.signature != MSD_CSW_SIGNATURE) ||
+      (csw.tag != cbw.tag))
+    return -1;
+  return csw.status;
+}
+
+static int scsi_rw10(uint8_t lun, bool_t write, uint32_t lba,
+                     uint8_t *data, uint16_t n) {
+  uint8_t cdb[10];
+
+  memset(cdb, 0, sizeof cdb);
+  cdb[0] = write ? SCSI_CMD_WRITE_10 : SCSI_CMD_READ_10;
+  cdb[2] = (uint8_t)(lba >> 24);
+  cdb[3] = (uint8_t)(lba >> 16);
+  cdb[4] = (uint8_t)(lba >> 8);
+  cdb[5] = (uint8_t)lba;
+  cdb[7] = (uint8_t)(n >> 8);
+  cdb[8] = (uint8_t)n;
+  return scsi_command(lun, cdb, sizeof cdb, !write, data,
+                      (size_t)n * MSD_BLOCK_SIZE);
+}
+
+static int scsi_simple(uint8_t lun, uint8_t op) {
+  uint8_t cdb[10];
+
+  memset(cdb, 0, sizeof cdb);
+  cdb[0] = op;
+  return scsi_command(lun, cdb, op == SCSI_CMD_SYNCHRONIZE_CACHE_10 ? 10 : 6,
+                      FALSE, NULL, 0);
+}
+
+static uint8_t scsi_sense_key(uint8_t lun, uint8_t *asc) {
+  uint8_t cdb[6] = {SCSI_CMD_REQUEST_SENSE, 0, 0, 0, 18, 0};
+  uint8_t sense[18];
+
+  if (scsi_command(lun, cdb, sizeof cdb, TRUE, sense, sizeof sense) != 0)
+    return 0xFF;
+  *asc = sense[12];
+  return sense[2] & 0x0F;
+}
+
+static uint32_t scsi_capacity(uint8_t lun) {
+  uint8_t cdb[10] = {SCSI_CMD_READ_CAPACITY_10, 0, 0, 0, 0, 0, 0, 0, 0, 0};
+  uint8_t rsp[8];
+
+  if (scsi_command(lun, cdb, sizeof cdb, TRUE, rsp, sizeof rsp) != 0)
+    return 0;
+  return (((uint32_t)rsp[0] << 24) | ((uint32_t)rsp[1] << 16) |
+          ((uint32_t)rsp[2] << 8) | rsp[3]) + 1;
+}
+
+static void check(const char *name, bool_t ok) {
+
+  printf("%-44s %s\n", name, ok ? "PASS" : "FAIL");
+  if (!ok)
+    failures++;
+}
+
+static void fill(uint8_t *p, size_t n, uint32_t seed) {
+
+  while (n-- > 0) {
+    seed = seed * 1103515245 + 12345;
+    *p++ = (uint8_t)(seed >> 16);
+  }
+}
+
+/*===========================================================================*/
+/* Test sequences.                                                           */
+/*===========================================================================*/
+
+static void test_units(void) {
+  uint8_t max_lun = 0xFF;
+  uint8_t setup[8] = {
+    USB_RTYPE_DIR_DEV2HOST | USB_RTYPE_TYPE_CLASS |
+    USB_RTYPE_RECIPIENT_INTERFACE, MSD_GET_MAX_LUN, 0, 0, 0, 0, 1, 0
+  };
+  unsigned i;
+
+  check("GET_MAX_LUN",
+        (usbSimControlTransfer(&USBD1, setup, &max_lun, NULL,
+                               HOST_TIMEOUT) == RDY_OK) &&
+        (max_lun == NUM_LUNS - 1));
+
+  for (i = 0; i < NUM_LUNS; i++) {
+    static const uint32_t expected[] = {CONFIG_START, FILE_BLOCKS,
+                                        RAM_BLOCKS - CONFIG_START};
+    char name[48];
+
+    sprintf(name, "LUN %u TEST UNIT READY", i);
+    check(name, scsi_simple(i, SCSI_CMD_TEST_UNIT_READY) == 0);
+    sprintf(name, "LUN %u READ CAPACITY (%lu blocks)", i,
+            (unsigned long)expected[i]);
+    check(name, scsi_capacity(i) == expected[i]);
+  }
+}
+
+static void test_data(void) {
+  uint8_t asc = 0;
+
+  /* RAM unit, data must land at the translated address.*/
+  fill(hostbuf, 64 * MSD_BLOCK_SIZE, 1);
+  check("LUN 0 WRITE(10) 64 blocks",
+        scsi_rw10(0, TRUE, 10, hostbuf, 64) == 0);
+  check("LUN 0 READ(10) 64 blocks and compare",
+        (scsi_rw10(0, FALSE, 10, checkbuf, 64) == 0) &&
+        (memcmp(hostbuf, checkbuf, 64 * MSD_BLOCK_SIZE) == 0));
+  check("LUN 0 data in the RAM disk",
+        memcmp(hostbuf, ram_storage + 10 * MSD_BLOCK_SIZE,
+               64 * MSD_BLOCK_SIZE) == 0);
+
+  /* Queued unit, the read must see the data still in the queue.*/
+  fill(hostbuf, 100 * MSD_BLOCK_SIZE, 2);
+  check("LUN 1 WRITE(10) 100 blocks (write-behind)",
+        scsi_rw10(1, TRUE, 1000, hostbuf, 100) == 0);
+  check("LUN 1 READ(10) 100 blocks and compare",
+        (scsi_rw10(1, FALSE, 1000, checkbuf, 100) == 0) &&
+        (memcmp(hostbuf, checkbuf, 100 * MSD_BLOCK_SIZE) == 0));
+  check("LUN 1 SYNCHRONIZE CACHE",
+        scsi_simple(1, SCSI_CMD_SYNCHRONIZE_CACHE_10) == 0);
+
+  /* Read-only configuration unit.*/
+  check("LUN 2 READ(10) maps to RAM disk block 896",
+        (scsi_rw10(2, FALSE, 0, checkbuf, 4) == 0) &&
+        (memcmp(checkbuf, ram_storage + CONFIG_START * MSD_BLOCK_SIZE,
+                4 * MSD_BLOCK_SIZE) == 0));
+  check("LUN 2 WRITE(10) rejected",
+        scsi_rw10(2, TRUE, 0, hostbuf, 4) == MSD_COMMAND_FAILED);
+  check("LUN 2 sense DATA PROTECT",
+        (scsi_sense_key(2, &asc) == SCSI_SENSE_KEY_DATA_PROTECT) &&
+        (asc == SCSI_ASENSE_WRITE_PROTECTED));
+  check("LUN 2 READ(10) past the end rejected",
+        scsi_rw10(2, FALSE, RAM_BLOCKS - CONFIG_START, checkbuf, 1) ==
+        MSD_COMMAND_FAILED);
+  check("LUN 2 sense LBA OUT OF RANGE",
+        (scsi_sense_key(2, &asc) == SCSI_SENSE_KEY_ILLEGAL_REQUEST) &&
+        (asc == SCSI_ASENSE_LOGICAL_BLOCK_ADDRESS_OUT_OF_RANGE));
+  check("LUN 0 sense still GOOD",
+        scsi_sense_key(0, &asc) == SCSI_SENSE_KEY_GOOD);
+}
+
+static void test_isolation(void) {
+  systime_t start, t_write, t_read, t_sync;
+
+  /* A large write to the slow unit followed by a read on the fast unit,
+     the read must not wait for the slow device.*/
+  fill(hostbuf, 32 * MSD_BLOCK_SIZE, 3);
+  start = chTimeNow();
+  scsi_rw10(1, TRUE, 0, hostbuf, 32);
+  t_write = chTimeNow() - start;
+  start = chTimeNow();
+  scsi_rw10(0, FALSE, 0, checkbuf, 32);
+  t_read = chTimeNow() - start;
+  start = chTimeNow();
+  scsi_simple(1, SCSI_CMD_SYNCHRONIZE_CACHE_10);
+  t_sync = chTimeNow() - start;
+
+  printf("%-44s %4lu ms\n", "LUN 1 WRITE(10) 32 blocks completion",
+         (unsigned long)TICKS2MS(t_write));
+  printf("%-44s %4lu ms\n", "LUN 0 READ(10) 32 blocks meanwhile",
+         (unsigned long)TICKS2MS(t_read));
+  printf("%-44s %4lu ms\n", "LUN 1 SYNCHRONIZE CACHE",
+         (unsigned long)TICKS2MS(t_sync));
+  check("LUN 0 not stalled by LUN 1", t_read < t_sync);
+}
+
+static void bench(const char *name, uint8_t lun, bool_t write) {
+  systime_t start, time;
+  uint32_t bytes = 0, kbps;
+
+  start = chTimeNow();
+  do {
+    if (scsi_rw10(lun, write, 0, hostbuf, BENCH_BLOCKS) != 0) {
+      check(name, FALSE);
+      return;
+    }
+    bytes += BENCH_BLOCKS * MSD_BLOCK_SIZE;
+    time = chTimeNow() - start;
+  } while (time < BENCH_TIME);
+
+  kbps = bytes / TICKS2MS(time);
+  printf("%-44s %lu.%03lu MB/s\n", name,
+         (unsigned long)(kbps / 1000), (unsigned long)(kbps % 1000));
+}
+
+static void print_histogram(const char *name, const msd_histogram_t *hp) {
+  unsigned i;
+
+  printf("%-8s %6lu commands, max %lu ticks:", name,
+         (unsigned long)hp->count, (unsigned long)hp->max);
+  for (i = 0; i < MSD_HISTOGRAM_BINS; i++)
+    if (hp->bins[i] > 0)
+      printf(" <%u:%lu", 1U << (i + 1), (unsigned long)hp->bins[i]);
+  printf("\n");
+}
+
+/*------------------------------------------------------------------------*
+ * Simulator main.                                                        *
+ *------------------------------------------------------------------------*/
+int main(void) {
+
+  /*
+   * System initializations.
+   * - HAL initialization, this also initializes the configured device drivers
+   *   and performs the board-specific initializations.
+   * - Kernel initialization, the main() function becomes a thread and the
+   *   RTOS is active.
+   */
+  halInit();
+  chSysInit();
+
+  /*
+   * Storage back ends, the configuration volume gets a recognizable
+   * content.
+   */
+  rdObjectInit(&RD1, ram_storage, RAM_BLOCKS, FALSE);
+  fill(ram_storage + CONFIG_START * MSD_BLOCK_SIZE,
+       (RAM_BLOCKS - CONFIG_START) * MSD_BLOCK_SIZE, 4);
+  if (fdOpen(&FD1, FILE_NAME, FILE_BLOCKS, MS2ST(2), 0) != CH_SUCCESS) {
+    printf("cannot open %s\n", FILE_NAME);
+    return 1;
+  }
+
+  /*
+   * Mass storage driver, USB driver and simulated bus connection.
+   */
+  msdInitLuns(&USBD1, &UMSD1, MSD_DATA_EP, luns, NUM_LUNS);
+  msdStart(&UMSD1);
+  usbStart(&USBD1, &usbcfg);
+  usbConnectBus(&USBD1);
+
+  /*
+   * The main thread acts as the USB host.
+   */
+  check("Enumeration", usbSimEnumerate(&USBD1, 1, 1, HOST_TIMEOUT) == RDY_OK);
+  test_units();
+  test_data();
+  test_isolation();
+  bench("LUN 0 READ(10) 128 blocks throughput", 0, FALSE);
+  bench("LUN 0 WRITE(10) 128 blocks throughput", 0, TRUE);
+
+  print_histogram("READ", &UMSD1.latency[MSD_HIST_READ]);
+  print_histogram("WRITE", &UMSD1.latency[MSD_HIST_WRITE]);
+  print_histogram("OTHER", &UMSD1.latency[MSD_HIST_OTHER]);
+
+  fdClose(&FD1);
+  printf("%u failures\n", failures);
+  return failures > 0 ? 1 : 0;
+}